@@ -67,6 +67,7 @@ void __cdecl NoirDebugPrint(IN CONST CHAR8 *Format,...);
 void NoirDisplayProcessorState();
 EFI_STATUS NoirBuildHostEnvironment();
 UINT32 NoirBuildHypervisor();
+void NoirStopTraceDrainer();
 UINT32 NoirQueryVirtualizationSupportability();
 BOOLEAN NoirIsVirtualizationEnabled();
 BOOLEAN NoirInitializeCodeIntegrity(IN VOID* ImageBase);
@@ -49,7 +49,9 @@ PVOID NoirGetOutputBuffer(IN PIRP Irp)
 void NoirDriverUnload(IN PDRIVER_OBJECT DriverObject)
 {
 	UNICODE_STRING uniLinkName=RTL_CONSTANT_STRING(LINK_NAME);
+	NoirFinalizeMemoryChangeCallback();
 	NoirTeardownHypervisor();
+	NoirFinalizeProcessorKicks();
 	NoirTeardownHookedPages();
 	NoirTeardownProtectedFile();
 	NoirFinalizeCodeIntegrity();
@@ -169,6 +171,12 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			*(PBOOLEAN)OutputBuffer=NoirIsVirtualizationEnabled();
 			break;
 		}
+		case IOCTL_CiLatency:
+		{
+			st=STATUS_SUCCESS;
+			*(PULONG64)OutputBuffer=NoirQueryCodeIntegrityLatency();
+			break;
+		}
 		case IOCTL_CvmCreateVm:
 		{
 			PCVM_HANDLE VmHandle=(PCVM_HANDLE)((ULONG_PTR)OutputBuffer+sizeof(CVM_HANDLE));
@@ -191,6 +199,53 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			st=STATUS_SUCCESS;
 			break;
 		}
+		case IOCTL_CvmSetMappingEx:
+		{
+			PNOIR_ADDRESS_MAPPING_BATCH Batch=(PNOIR_ADDRESS_MAPPING_BATCH)InputBuffer;
+			st=STATUS_INVALID_PARAMETER;
+			// The ranges must be entirely inside the input buffer.
+			if(InputSize>=FIELD_OFFSET(NOIR_ADDRESS_MAPPING_BATCH,Ranges) && InputSize>=FIELD_OFFSET(NOIR_ADDRESS_MAPPING_BATCH,Ranges)+(ULONG64)Batch->NumberOfRanges*sizeof(NOIR_ADDRESS_MAPPING))
+			{
+				*(PULONG32)OutputBuffer=NoirSetMappingBatch(Batch->VirtualMachine,Batch->Ranges,Batch->NumberOfRanges);
+				st=STATUS_SUCCESS;
+			}
+			break;
+		}
+		case IOCTL_CvmSetCpuidQuickPath:
+		{
+			PNOIR_CPUID_QUICKPATH_CONTEXT Context=(PNOIR_CPUID_QUICKPATH_CONTEXT)InputBuffer;
+			st=STATUS_INVALID_PARAMETER;
+			if(InputSize>=sizeof(NOIR_CPUID_QUICKPATH_CONTEXT))
+			{
+				*(PULONG32)OutputBuffer=NoirSetCpuidQuickPath(Context->VirtualMachine,Context->VpIndex,&Context->QuickPath);
+				st=STATUS_SUCCESS;
+			}
+			break;
+		}
+		case IOCTL_CvmSetMsrQuickPath:
+		{
+			PNOIR_MSR_QUICKPATH_CONTEXT Context=(PNOIR_MSR_QUICKPATH_CONTEXT)InputBuffer;
+			st=STATUS_INVALID_PARAMETER;
+			if(InputSize>=sizeof(NOIR_MSR_QUICKPATH_CONTEXT))
+			{
+				*(PULONG32)OutputBuffer=NoirSetMsrQuickPath(Context->VirtualMachine,&Context->QuickPath);
+				st=STATUS_SUCCESS;
+			}
+			break;
+		}
+		case IOCTL_CvmQueryMsrQuickPath:
+		{
+			// Input is the VM handle and the MSR index. Output is the status followed by the rule covering the MSR.
+			CVM_HANDLE VmHandle=*(PCVM_HANDLE)InputBuffer;
+			ULONG32 Index=*(PULONG32)((ULONG_PTR)InputBuffer+sizeof(CVM_HANDLE));
+			st=STATUS_INVALID_PARAMETER;
+			if(InputSize>=sizeof(CVM_HANDLE)+sizeof(ULONG32) && OutputSize>=sizeof(ULONG64)+sizeof(NOIR_MSR_QUICKPATH))
+			{
+				*(PULONG32)OutputBuffer=NoirQueryMsrQuickPath(VmHandle,Index,(PNOIR_MSR_QUICKPATH)((ULONG_PTR)OutputBuffer+sizeof(ULONG64)));
+				st=STATUS_SUCCESS;
+			}
+			break;
+		}
 		case IOCTL_CvmQueryGpaAdMap:
 		{
 			PNOIR_QUERY_ADBITMAP_CONTEXT Param=(PNOIR_QUERY_ADBITMAP_CONTEXT)InputBuffer;
@@ -205,6 +260,18 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			st=STATUS_SUCCESS;
 			break;
 		}
+		case IOCTL_CvmQueryGpaDirtyMap:
+		{
+			PNOIR_QUERY_DIRTY_BITMAP_CONTEXT Param=(PNOIR_QUERY_DIRTY_BITMAP_CONTEXT)InputBuffer;
+			st=STATUS_INVALID_PARAMETER;
+			if(InputSize>=sizeof(NOIR_QUERY_DIRTY_BITMAP_CONTEXT))
+			{
+				BOOLEAN Accumulate=(Param->Flags&NOIR_DIRTY_BITMAP_ACCUMULATE)!=0;
+				*(PULONG32)OutputBuffer=NoirQueryGpaDirtyBitmap(Param->VirtualMachine,Param->GpaStart,Param->NumberOfPages,(PVOID)Param->BitmapBuffer,Param->BitmapLength,Accumulate);
+				st=STATUS_SUCCESS;
+			}
+			break;
+		}
 		case IOCTL_CvmCreateVmEx:
 		{
 			PULONG32 Input=(PULONG32)InputBuffer;
@@ -221,6 +288,15 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			st=STATUS_SUCCESS;
 			break;
 		}
+		case IOCTL_CvmQueryHostProfile:
+		{
+			ULONG32 ProcessorNumber=*(PULONG32)InputBuffer;
+			ULONG32 BufferSize=*(PULONG32)((ULONG_PTR)InputBuffer+4);
+			PVOID ProfileBuffer=*(PVOID*)((ULONG_PTR)InputBuffer+8);
+			*(PULONG32)OutputBuffer=NoirQueryHostExitProfile(ProcessorNumber,ProfileBuffer,BufferSize);
+			st=STATUS_SUCCESS;
+			break;
+		}
 		case IOCTL_CvmCreateVcpu:
 		{
 			CVM_HANDLE VmHandle=*(PCVM_HANDLE)InputBuffer;
@@ -302,6 +378,15 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			st=STATUS_SUCCESS;
 			break;
 		}
+		case IOCTL_CvmSetVcpuVpcb:
+		{
+			CVM_HANDLE VmHandle=*(PCVM_HANDLE)InputBuffer;
+			ULONG32 VpIndex=*(PULONG32)((ULONG_PTR)InputBuffer+sizeof(CVM_HANDLE));
+			PVOID Vpcb=*(PVOID*)((ULONG_PTR)InputBuffer+16);
+			*(PULONG32)OutputBuffer=NoirSetVirtualProcessorControlBlock(VmHandle,VpIndex,Vpcb);
+			st=STATUS_SUCCESS;
+			break;
+		}
 		case IOCTL_CvmQueryVcpuStats:
 		{
 			CVM_HANDLE VmHandle=*(PCVM_HANDLE)InputBuffer;
@@ -312,6 +397,16 @@ NTSTATUS NoirVisorDispatchIoControl(IN PDEVICE_OBJECT DeviceObject,IN PIRP Irp)
 			st=STATUS_SUCCESS;
 			break;
 		}
+		case IOCTL_CvmQueryVcpuProfile:
+		{
+			CVM_HANDLE VmHandle=*(PCVM_HANDLE)InputBuffer;
+			ULONG32 VpIndex=*(PULONG32)((ULONG_PTR)InputBuffer+sizeof(CVM_HANDLE));
+			ULONG32 BufferSize=*(PULONG32)((ULONG_PTR)InputBuffer+sizeof(CVM_HANDLE)+4);
+			PVOID ProfileBuffer=*(PVOID*)((ULONG_PTR)InputBuffer+sizeof(CVM_HANDLE)+8);
+			*(PULONG32)OutputBuffer=NoirQueryVirtualProcessorExitProfile(VmHandle,VpIndex,ProfileBuffer,BufferSize);
+			st=STATUS_SUCCESS;
+			break;
+		}
 		case IOCTL_CvmViewVcpuReg2:
 		{
 			PNOIR_VIEW_EDIT_REGISTER_CONTEXT2 Context=(PNOIR_VIEW_EDIT_REGISTER_CONTEXT2)InputBuffer;
@@ -357,6 +452,10 @@ void static NoirDriverReinitialize(IN PDRIVER_OBJECT DriverObject,IN PVOID Conte
 	NoirBuildHookedPages();
 	NoirBuildProtectedFile();
 	NoirInitializePowerStateCallback();
+	NoirInitializeMemoryChangeCallback();
+	// Without kick DPCs, noir_kick_processor fails and kicked vCPUs leave guest mode upon the next interrupt.
+	st=NoirInitializeProcessorKicks();
+	if(NT_ERROR(st))NoirDebugPrint("Failed to initialize processor kicks! Status=0x%X\n",st);
 	NoirSubvertSystemOnDriverLoad(&SubvertOnDriverLoad);
 	NoirConfigureInternalDebugger();
 	NoirAcpiInitialize();
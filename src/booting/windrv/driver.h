@@ -53,6 +53,7 @@ typedef ULONG32 NOIR_STATUS;
 #define IOCTL_OsVer			CTL_CODE_GEN(0x813)
 #define IOCTL_VirtCap		CTL_CODE_GEN(0x814)
 #define IOCTL_VirtEn		CTL_CODE_GEN(0x815)
+#define IOCTL_CiLatency		CTL_CODE_GEN(0x816)
 
 // Following definitions are intended for CVM use.
 #define IOCTL_CvmCreateVm		CTL_CODE_GEN(0x880)
@@ -61,6 +62,12 @@ typedef ULONG32 NOIR_STATUS;
 #define IOCTL_CvmQueryGpaAdMap	CTL_CODE_GEN(0x883)
 #define IOCTL_CvmClearGpaAdBit	CTL_CODE_GEN(0x884)
 #define IOCTL_CvmCreateVmEx		CTL_CODE_GEN(0x885)
+#define IOCTL_CvmSetMappingEx	CTL_CODE_GEN(0x886)
+#define IOCTL_CvmSetCpuidQuickPath	CTL_CODE_GEN(0x887)
+#define IOCTL_CvmSetMsrQuickPath	CTL_CODE_GEN(0x888)
+#define IOCTL_CvmQueryMsrQuickPath	CTL_CODE_GEN(0x889)
+#define IOCTL_CvmQueryGpaDirtyMap	CTL_CODE_GEN(0x88A)
+#define IOCTL_CvmQueryHostProfile	CTL_CODE_GEN(0x88B)
 #define IOCTL_CvmQueryHvStatus	CTL_CODE_GEN(0x88F)
 #define IOCTL_CvmCreateVcpu		CTL_CODE_GEN(0x890)
 #define IOCTL_CvmDeleteVcpu		CTL_CODE_GEN(0x891)
@@ -73,6 +80,8 @@ typedef ULONG32 NOIR_STATUS;
 #define IOCTL_CvmQueryVcpuStats	CTL_CODE_GEN(0x898)
 #define IOCTL_CvmViewVcpuReg2	CTL_CODE_GEN(0x899)
 #define IOCTL_CvmEditVcpuReg2	CTL_CODE_GEN(0x89A)
+#define IOCTL_CvmSetVcpuVpcb	CTL_CODE_GEN(0x89B)
+#define IOCTL_CvmQueryVcpuProfile	CTL_CODE_GEN(0x89C)
 
 // Layered Hypervisor Functions
 typedef ULONG64 CVM_HANDLE;
@@ -99,6 +108,73 @@ typedef struct _NOIR_ADDRESS_MAPPING
 	}Attributes;
 }NOIR_ADDRESS_MAPPING,*PNOIR_ADDRESS_MAPPING;
 
+typedef struct _NOIR_ADDRESS_MAPPING_BATCH
+{
+	CVM_HANDLE VirtualMachine;
+	ULONG32 NumberOfRanges;
+	ULONG32 Reserved;
+	NOIR_ADDRESS_MAPPING Ranges[1];
+}NOIR_ADDRESS_MAPPING_BATCH,*PNOIR_ADDRESS_MAPPING_BATCH;
+
+typedef struct _NOIR_CPUID_QUICKPATH
+{
+	ULONG32 Leaf;
+	ULONG32 Subleaf;
+	union
+	{
+		struct
+		{
+			ULONG64 Active:1;
+			ULONG64 HasSubleaf:1;
+			ULONG64 VmWide:1;
+			ULONG64 HostMasked:1;		// Eax-Edx are masks applied to host CPUID result.
+			ULONG64 Reserved:60;
+		};
+		ULONG64 Value;
+	}Options;
+	ULONG32 Eax;
+	ULONG32 Ebx;
+	ULONG32 Ecx;
+	ULONG32 Edx;
+}NOIR_CPUID_QUICKPATH,*PNOIR_CPUID_QUICKPATH;
+
+#define NOIR_CPUID_QUICKPATH_VM_WIDE		0xFFFFFFFF
+#define NOIR_CPUID_QUICKPATH_FALLBACK		0xFFFFFFFE
+
+typedef struct _NOIR_CPUID_QUICKPATH_CONTEXT
+{
+	CVM_HANDLE VirtualMachine;
+	ULONG32 VpIndex;
+	ULONG32 Reserved;
+	NOIR_CPUID_QUICKPATH QuickPath;
+}NOIR_CPUID_QUICKPATH_CONTEXT,*PNOIR_CPUID_QUICKPATH_CONTEXT;
+
+typedef struct _NOIR_MSR_QUICKPATH
+{
+	ULONG32 First;
+	ULONG32 Last;
+	union
+	{
+		struct
+		{
+			ULONG32 Active:1;
+			ULONG32 Passthrough:1;		// Reads go to hardware without exits. Writes raise #GP.
+			ULONG32 Reserved:30;
+		};
+		ULONG32 Value;
+	}Options;
+	ULONG32 Reserved;
+	ULONG64 Value;
+	ULONG64 ReadOnlyMask;
+	ULONG64 Hits;
+}NOIR_MSR_QUICKPATH,*PNOIR_MSR_QUICKPATH;
+
+typedef struct _NOIR_MSR_QUICKPATH_CONTEXT
+{
+	CVM_HANDLE VirtualMachine;
+	NOIR_MSR_QUICKPATH QuickPath;
+}NOIR_MSR_QUICKPATH_CONTEXT,*PNOIR_MSR_QUICKPATH_CONTEXT;
+
 typedef struct _NOIR_QUERY_ADBITMAP_CONTEXT
 {
 	CVM_HANDLE VirtualMachine;
@@ -108,6 +184,20 @@ typedef struct _NOIR_QUERY_ADBITMAP_CONTEXT
 	ULONG32 NumberOfPages;
 }NOIR_QUERY_ADBITMAP_CONTEXT,*PNOIR_QUERY_ADBITMAP_CONTEXT;
 
+// Merge the dirty pages into the bitmap rather than overwriting it.
+#define NOIR_DIRTY_BITMAP_ACCUMULATE		0x1
+
+typedef struct _NOIR_QUERY_DIRTY_BITMAP_CONTEXT
+{
+	CVM_HANDLE VirtualMachine;
+	ULONG64 GpaStart;
+	ULONG64 BitmapBuffer;
+	ULONG32 BitmapLength;
+	ULONG32 NumberOfPages;
+	ULONG32 Flags;
+	ULONG32 Reserved;
+}NOIR_QUERY_DIRTY_BITMAP_CONTEXT,*PNOIR_QUERY_DIRTY_BITMAP_CONTEXT;
+
 typedef enum _NOIR_CVM_REGISTER_TYPE
 {
 	NoirCvmGeneralPurposeRegister,
@@ -149,21 +239,29 @@ typedef struct _NOIR_VIEW_EDIT_REGISTER_CONTEXT2
 }NOIR_VIEW_EDIT_REGISTER_CONTEXT2,*PNOIR_VIEW_EDIT_REGISTER_CONTEXT2;
 
 NOIR_STATUS NoirQueryHypervisorStatus(IN ULONG64 StatusType,OUT PULONG64 Status);
+NOIR_STATUS NoirQueryHostExitProfile(IN ULONG32 ProcessorNumber,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirCreateVirtualMachine(OUT PCVM_HANDLE VirtualMachine);
 NOIR_STATUS NoirCreateVirtualMachineEx(OUT PCVM_HANDLE VirtualMachine,IN ULONG32 Properties);
 NOIR_STATUS NoirReleaseVirtualMachine(IN CVM_HANDLE VirtualMachine);
 NOIR_STATUS NoirCreateVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 NOIR_STATUS NoirReleaseVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 NOIR_STATUS NoirSetMapping(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation);
+NOIR_STATUS NoirSetMappingBatch(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation,IN ULONG32 NumberOfRanges);
+NOIR_STATUS NoirSetCpuidQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PNOIR_CPUID_QUICKPATH QuickPath);
+NOIR_STATUS NoirSetMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN PNOIR_MSR_QUICKPATH QuickPath);
+NOIR_STATUS NoirQueryMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 Index,OUT PNOIR_MSR_QUICKPATH QuickPath);
 NOIR_STATUS NoirQueryGpaAccessingBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,OUT PVOID Bitmap,IN ULONG32 BitmapSize);
+NOIR_STATUS NoirQueryGpaDirtyBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,IN OUT PVOID Bitmap,IN ULONG32 BitmapSize,IN BOOLEAN Accumulate);
 NOIR_STATUS NoirClearGpaAccessingBits(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages);
 NOIR_STATUS NoirViewVirtualProcessorRegisters(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN NOIR_CVM_REGISTER_TYPE RegisterType,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirEditVirtualProcessorRegisters(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN NOIR_CVM_REGISTER_TYPE RegisterType,IN PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirViewVirtualProcessorRegisters2(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PULONG32 RegisterNames,IN ULONG32 RegisterCount,IN ULONG32 RegisterSize,OUT PVOID Buffer);
 NOIR_STATUS NoirEditVirtualProcessorRegisters2(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PULONG32 RegisterNames,IN ULONG32 RegisterCount,IN ULONG32 RegisterSize,IN PVOID Buffer);
 NOIR_STATUS NoirQueryVirtualProcessorStatistics(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize);
+NOIR_STATUS NoirQueryVirtualProcessorExitProfile(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirSetEventInjection(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN ULONG64 InjectedEvent);
 NOIR_STATUS NoirSetVirtualProcessorOptions(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN ULONG32 OptionType,IN ULONG32 Options);
+NOIR_STATUS NoirSetVirtualProcessorControlBlock(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PVOID Vpcb);
 NOIR_STATUS NoirRunVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID ExitContext);
 NOIR_STATUS NoirRescindVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 
@@ -189,8 +287,13 @@ BOOLEAN NoirIsVirtualizationEnabled();
 void NoirLocatePsLoadedModule(IN PDRIVER_OBJECT DriverObject);
 BOOLEAN NoirInitializeCodeIntegrity(IN PVOID ImageBase);
 void NoirFinalizeCodeIntegrity();
+ULONG64 NoirQueryCodeIntegrityLatency();
 NTSTATUS NoirInitializePowerStateCallback();
 void NoirFinalizePowerStateCallback();
+NTSTATUS NoirInitializeMemoryChangeCallback();
+void NoirFinalizeMemoryChangeCallback();
+NTSTATUS NoirInitializeProcessorKicks();
+void NoirFinalizeProcessorKicks();
 void NoirGetVendorString(OUT PSTR VendorString);
 void NoirGetProcessorName(OUT PSTR ProcessorName);
 void NoirGetNtOpenProcessIndex();
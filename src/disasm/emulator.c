@@ -47,47 +47,52 @@ ZydisDecodedOperand* nvc_emu_get_explicit_operand(ZydisDecodedInstruction *Instr
 }
 
 // Please note that "ZydisCalcAbsoluteAddress" can't do the work for us.
-u64 static nvc_emu_calculate_absolute_address(noir_cvm_virtual_cpu_p vcpu,ZydisDecodedInstruction *Instruction,ZydisDecodedOperand *Operand)
+u64 static nvc_emu_calculate_absolute_address(noir_cvm_virtual_cpu_p vcpu,noir_cvm_decode_cache_entry_p entry)
 {
 	// Address width may not be full.
-	u64 addr_mask=(1ui64<<Instruction->address_width)-1;
+	u64 addr_mask=entry->mem.address_width<64?(1ui64<<entry->mem.address_width)-1:maxu64;
+	ZydisRegister base=(ZydisRegister)entry->mem.base;
+	ZydisRegister index=(ZydisRegister)entry->mem.index;
 	// Generally, an memory operand is referenced by the following format:
 	// AbsoluteAddress=SegmentBase+BaseRegister+IndexRegister*ScalingFactor+Displacement
 	// None of them are required to be present.
 	u64p gpr=(u64p)&vcpu->gpr;
 	segment_register_p segs=(segment_register_p)&vcpu->seg;
-	u64 abs_addr=segs[Operand->mem.segment-ZYDIS_REGISTER_ES].base;
+	u64 abs_addr=segs[entry->mem.segment-ZYDIS_REGISTER_ES].base;
 	// Base Register...
-	if(Operand->mem.base>=ZYDIS_REGISTER_AX && Operand->mem.base<=ZYDIS_REGISTER_R15W)
-		abs_addr+=(u16)gpr[Operand->mem.base-ZYDIS_REGISTER_AX];		// 16-Bit GPRs
-	else if(Operand->mem.base>=ZYDIS_REGISTER_EAX && Operand->mem.base<=ZYDIS_REGISTER_R15D)
-		abs_addr+=(u32)gpr[Operand->mem.base-ZYDIS_REGISTER_EAX];		// 32-Bit GPRs
-	else if(Operand->mem.base>=ZYDIS_REGISTER_RAX && Operand->mem.base<=ZYDIS_REGISTER_R15)
-		abs_addr+=(u64)gpr[Operand->mem.base-ZYDIS_REGISTER_RAX];		// 64-Bit GPRs
+	if(base>=ZYDIS_REGISTER_AX && base<=ZYDIS_REGISTER_R15W)
+		abs_addr+=(u16)gpr[base-ZYDIS_REGISTER_AX];		// 16-Bit GPRs
+	else if(base>=ZYDIS_REGISTER_EAX && base<=ZYDIS_REGISTER_R15D)
+		abs_addr+=(u32)gpr[base-ZYDIS_REGISTER_EAX];		// 32-Bit GPRs
+	else if(base>=ZYDIS_REGISTER_RAX && base<=ZYDIS_REGISTER_R15)
+		abs_addr+=(u64)gpr[base-ZYDIS_REGISTER_RAX];		// 64-Bit GPRs
 	// Note that there could be RIP-relative addressing.
-	else if(Operand->mem.base==ZYDIS_REGISTER_EIP)
-		abs_addr+=(u32)vcpu->exit_context.rip+Instruction->length;
-	else if(Operand->mem.base==ZYDIS_REGISTER_RIP)
-		abs_addr+=(u64)vcpu->exit_context.rip+Instruction->length;
+	else if(base==ZYDIS_REGISTER_EIP)
+		abs_addr+=(u32)vcpu->exit_context.rip+entry->length;
+	else if(base==ZYDIS_REGISTER_RIP)
+		abs_addr+=(u64)vcpu->exit_context.rip+entry->length;
 	// Index and Scale...
-	if(Operand->mem.index>=ZYDIS_REGISTER_AX && Operand->mem.index<=ZYDIS_REGISTER_R15W)
-		abs_addr+=(u16)gpr[Operand->mem.index-ZYDIS_REGISTER_AX]*Operand->mem.scale;		// 16-Bit GPRs
-	else if(Operand->mem.index>=ZYDIS_REGISTER_EAX && Operand->mem.index<=ZYDIS_REGISTER_R15D)
-		abs_addr+=(u32)gpr[Operand->mem.index-ZYDIS_REGISTER_EAX]*Operand->mem.scale;		// 32-Bit GPRs
-	else if(Operand->mem.index>=ZYDIS_REGISTER_RAX && Operand->mem.index<=ZYDIS_REGISTER_R15)
-		abs_addr+=(u64)gpr[Operand->mem.index-ZYDIS_REGISTER_RAX]*Operand->mem.scale;		// 64-Bit GPRs
+	if(index>=ZYDIS_REGISTER_AX && index<=ZYDIS_REGISTER_R15W)
+		abs_addr+=(u16)gpr[index-ZYDIS_REGISTER_AX]*entry->mem.scale;		// 16-Bit GPRs
+	else if(index>=ZYDIS_REGISTER_EAX && index<=ZYDIS_REGISTER_R15D)
+		abs_addr+=(u32)gpr[index-ZYDIS_REGISTER_EAX]*entry->mem.scale;		// 32-Bit GPRs
+	else if(index>=ZYDIS_REGISTER_RAX && index<=ZYDIS_REGISTER_R15)
+		abs_addr+=(u64)gpr[index-ZYDIS_REGISTER_RAX]*entry->mem.scale;		// 64-Bit GPRs
 	// Displacement
-	if(Operand->mem.disp.has_displacement)abs_addr+=Operand->mem.disp.value;
+	abs_addr+=entry->mem.disp;
 	return abs_addr&addr_mask;
 }
 
-void static nvc_emu_decode_instruction_mov(noir_cvm_virtual_cpu_p vcpu,ZydisDecodedInstruction *instruction,ZydisDecodedOperand operands[])
+// Decode the operand in interest of the MMIO instruction.
+// The memory reference is saved to the cache entry so that it can be recalculated on a cache hit.
+void static nvc_emu_decode_operand(noir_cvm_virtual_cpu_p vcpu,ZydisDecodedInstruction *instruction,ZydisDecodedOperand *target_op,noir_cvm_decode_cache_entry_p entry)
 {
 	noir_cvm_memory_access_context_p mem_ctxt=&vcpu->exit_context.memory_access;
-	// For mov instruction, the first operand is destination and the second operand is source.
-	// Get the first operand for MMIO reads and second operand for MMIO writes.
-	ZydisDecodedOperand* target_op=&operands[mem_ctxt->access.write];
-	ZydisDecodedOperand* counter_op=&operands[1-mem_ctxt->access.write];
+	if(target_op==null)
+	{
+		mem_ctxt->flags.operand_class=noir_cvm_operand_class_unknown;
+		return;
+	}
 	// Decode the operand for MMIO operation.
 	switch(target_op->type)
 	{
@@ -150,7 +155,13 @@ void static nvc_emu_decode_instruction_mov(noir_cvm_virtual_cpu_p vcpu,ZydisDeco
 		case ZYDIS_OPERAND_TYPE_MEMORY:
 		{
 			mem_ctxt->flags.operand_class=noir_cvm_operand_class_memory;
-			mem_ctxt->operand.mem=nvc_emu_calculate_absolute_address(vcpu,instruction,target_op);
+			entry->mem.segment=(u16)target_op->mem.segment;
+			entry->mem.base=(u16)target_op->mem.base;
+			entry->mem.index=(u16)target_op->mem.index;
+			entry->mem.scale=target_op->mem.scale;
+			entry->mem.disp=target_op->mem.disp.has_displacement?target_op->mem.disp.value:0;
+			entry->mem.address_width=(u8)instruction->address_width;
+			mem_ctxt->operand.mem=nvc_emu_calculate_absolute_address(vcpu,entry);
 			break;
 		}
 		case ZYDIS_OPERAND_TYPE_POINTER:
@@ -177,58 +188,236 @@ void static nvc_emu_decode_instruction_mov(noir_cvm_virtual_cpu_p vcpu,ZydisDeco
 	}
 }
 
+// Instructions like mov, xchg and the ALU read-modify-write forms have an explicit memory operand accessing the MMIO.
+// The operand in interest is the other explicit operand. The writemask of EVEX-encoded moves is not considered.
+void static nvc_emu_decode_explicit_form(noir_cvm_virtual_cpu_p vcpu,ZydisDecodedInstruction *instruction,ZydisDecodedOperand operands[],noir_cvm_decode_cache_entry_p entry)
+{
+	noir_cvm_memory_access_context_p mem_ctxt=&vcpu->exit_context.memory_access;
+	ZydisDecodedOperand *mmio_op=null,*target_op=null;
+	for(ZyanU8 i=0;i<instruction->operand_count;i++)
+	{
+		ZydisDecodedOperand *op=&operands[i];
+		if(op->visibility!=ZYDIS_OPERAND_VISIBILITY_EXPLICIT)continue;
+		if(op->type==ZYDIS_OPERAND_TYPE_MEMORY && mmio_op==null)
+			mmio_op=op;
+		else if(op->type==ZYDIS_OPERAND_TYPE_REGISTER && op->reg.value>=ZYDIS_REGISTER_K0 && op->reg.value<=ZYDIS_REGISTER_K7)
+			continue;
+		else if(target_op==null)
+			target_op=op;
+	}
+	if(mmio_op)mem_ctxt->flags.operand_size=mmio_op->size>>3;
+	nvc_emu_decode_operand(vcpu,instruction,target_op,entry);
+}
+
+// String instructions have implicit operands only.
+// For movs, the operand in interest is the other side of the move. For stos, it is the accumulator.
+void static nvc_emu_decode_string_form(noir_cvm_virtual_cpu_p vcpu,ZydisDecodedInstruction *instruction,ZydisDecodedOperand operands[],noir_cvm_decode_cache_entry_p entry)
+{
+	noir_cvm_memory_access_context_p mem_ctxt=&vcpu->exit_context.memory_access;
+	ZydisDecodedOperand *target_op=null;
+	for(ZyanU8 i=0;i<instruction->operand_count;i++)
+	{
+		ZydisDecodedOperand *op=&operands[i];
+		if(op->type==ZYDIS_OPERAND_TYPE_MEMORY)
+		{
+			bool destination=(op->actions & ZYDIS_OPERAND_ACTION_WRITE)!=0;
+			mem_ctxt->flags.operand_size=op->size>>3;
+			// MMIO writes go to the destination, so the other side is the source, and vice versa.
+			if(mem_ctxt->flags.instruction_code==noir_cvm_instruction_code_movs && destination!=(bool)mem_ctxt->access.write)
+				target_op=op;
+		}
+		else if(op->type==ZYDIS_OPERAND_TYPE_REGISTER && mem_ctxt->flags.instruction_code==noir_cvm_instruction_code_stos)
+		{
+			ZydisRegister reg=op->reg.value;
+			if(reg==ZYDIS_REGISTER_AL || reg==ZYDIS_REGISTER_AX || reg==ZYDIS_REGISTER_EAX || reg==ZYDIS_REGISTER_RAX)
+				target_op=op;
+		}
+	}
+	mem_ctxt->flags.rep_prefix=(instruction->attributes & ZYDIS_ATTRIB_HAS_REP)!=0;
+	nvc_emu_decode_operand(vcpu,instruction,target_op,entry);
+}
+
+u16 static nvc_emu_get_instruction_code(ZydisDecodedInstruction *instruction)
+{
+	switch(instruction->mnemonic)
+	{
+		case ZYDIS_MNEMONIC_MOV:
+		case ZYDIS_MNEMONIC_MOVNTI:
+			return noir_cvm_instruction_code_mov;
+		case ZYDIS_MNEMONIC_MOVZX:
+			return noir_cvm_instruction_code_movzx;
+		case ZYDIS_MNEMONIC_MOVSX:
+		case ZYDIS_MNEMONIC_MOVSXD:
+			return noir_cvm_instruction_code_movsx;
+		case ZYDIS_MNEMONIC_MOVSB:
+		case ZYDIS_MNEMONIC_MOVSW:
+		case ZYDIS_MNEMONIC_MOVSQ:
+			return noir_cvm_instruction_code_movs;
+		case ZYDIS_MNEMONIC_MOVSD:
+		{
+			// Zydis shares the mnemonic between the string move and the scalar SSE move.
+			if(instruction->meta.category==ZYDIS_CATEGORY_STRINGOP)return noir_cvm_instruction_code_movs;
+			return noir_cvm_instruction_code_simd_mov;
+		}
+		case ZYDIS_MNEMONIC_STOSB:
+		case ZYDIS_MNEMONIC_STOSW:
+		case ZYDIS_MNEMONIC_STOSD:
+		case ZYDIS_MNEMONIC_STOSQ:
+			return noir_cvm_instruction_code_stos;
+		case ZYDIS_MNEMONIC_XCHG:
+			return noir_cvm_instruction_code_xchg;
+		case ZYDIS_MNEMONIC_ADD:
+			return noir_cvm_instruction_code_add;
+		case ZYDIS_MNEMONIC_OR:
+			return noir_cvm_instruction_code_or;
+		case ZYDIS_MNEMONIC_ADC:
+			return noir_cvm_instruction_code_adc;
+		case ZYDIS_MNEMONIC_SBB:
+			return noir_cvm_instruction_code_sbb;
+		case ZYDIS_MNEMONIC_AND:
+			return noir_cvm_instruction_code_and;
+		case ZYDIS_MNEMONIC_SUB:
+			return noir_cvm_instruction_code_sub;
+		case ZYDIS_MNEMONIC_XOR:
+			return noir_cvm_instruction_code_xor;
+		case ZYDIS_MNEMONIC_CMP:
+			return noir_cvm_instruction_code_cmp;
+		case ZYDIS_MNEMONIC_TEST:
+			return noir_cvm_instruction_code_test;
+		// SSE and AVX moves commonly used by drivers for MMIO.
+		case ZYDIS_MNEMONIC_MOVD:
+		case ZYDIS_MNEMONIC_MOVQ:
+		case ZYDIS_MNEMONIC_MOVSS:
+		case ZYDIS_MNEMONIC_MOVAPS:
+		case ZYDIS_MNEMONIC_MOVUPS:
+		case ZYDIS_MNEMONIC_MOVAPD:
+		case ZYDIS_MNEMONIC_MOVUPD:
+		case ZYDIS_MNEMONIC_MOVDQA:
+		case ZYDIS_MNEMONIC_MOVDQU:
+		case ZYDIS_MNEMONIC_MOVNTDQ:
+		case ZYDIS_MNEMONIC_MOVNTPS:
+		case ZYDIS_MNEMONIC_MOVNTPD:
+		case ZYDIS_MNEMONIC_VMOVD:
+		case ZYDIS_MNEMONIC_VMOVQ:
+		case ZYDIS_MNEMONIC_VMOVSS:
+		case ZYDIS_MNEMONIC_VMOVSD:
+		case ZYDIS_MNEMONIC_VMOVAPS:
+		case ZYDIS_MNEMONIC_VMOVUPS:
+		case ZYDIS_MNEMONIC_VMOVAPD:
+		case ZYDIS_MNEMONIC_VMOVUPD:
+		case ZYDIS_MNEMONIC_VMOVDQA:
+		case ZYDIS_MNEMONIC_VMOVDQU:
+		case ZYDIS_MNEMONIC_VMOVDQA32:
+		case ZYDIS_MNEMONIC_VMOVDQA64:
+		case ZYDIS_MNEMONIC_VMOVDQU8:
+		case ZYDIS_MNEMONIC_VMOVDQU16:
+		case ZYDIS_MNEMONIC_VMOVDQU32:
+		case ZYDIS_MNEMONIC_VMOVDQU64:
+		case ZYDIS_MNEMONIC_VMOVNTDQ:
+		case ZYDIS_MNEMONIC_VMOVNTPS:
+		case ZYDIS_MNEMONIC_VMOVNTPD:
+			return noir_cvm_instruction_code_simd_mov;
+	}
+	return noir_cvm_instruction_code_unknown;
+}
+
+// The direction of the access is a part of the key, because movs decodes the other side of the move.
+// Only the fetched bytes are compared. The rest of the buffer is stale and cannot confirm a hit.
+bool static nvc_emu_lookup_decode_cache(noir_cvm_decode_cache_entry_p entry,u64 rip,u8 mode,noir_cvm_memory_access_context_p mem_ctxt)
+{
+	if(entry->length==0 || entry->rip!=rip || entry->mode!=mode)return false;
+	if(entry->write!=mem_ctxt->access.write || entry->length>mem_ctxt->access.fetched_bytes)return false;
+	for(u8 i=0;i<entry->length;i++)
+		if(entry->instruction_bytes[i]!=mem_ctxt->instruction_bytes[i])
+			return false;
+	return true;
+}
+
 noir_status nvc_emu_decode_memory_access(noir_cvm_virtual_cpu_p vcpu)
 {
 	noir_status st=noir_invalid_parameter;
 	noir_cvm_memory_access_context_p mem_ctxt=&vcpu->exit_context.memory_access;
 	if(vcpu->exit_context.intercept_code==cv_memory_access && mem_ctxt->access.execute==false)
 	{
-		ZydisDecodedInstruction ZyIns;
-		ZydisDecodedOperand ZyOps[ZYDIS_MAX_OPERAND_COUNT];
-		ZydisDecoder *SelectedDecoder;
-		ZyanStatus zst;
+		const u64 rip=vcpu->exit_context.rip;
+		noir_cvm_decode_cache_entry_p entry=&vcpu->decode_cache[(rip^(rip>>4))&(noir_cvm_decode_cache_entries-1)];
+		u8 mode=16;
 		st=noir_unsuccessful;
 		if(noir_bt(&vcpu->exit_context.cs.attrib,13))		// Long Mode?
-			SelectedDecoder=&ZyDec64;
+			mode=64;
 		else if(noir_bt(&vcpu->exit_context.cs.attrib,14))	// Default-Big?
-			SelectedDecoder=&ZyDec32;
+			mode=32;
+		if(nvc_emu_lookup_decode_cache(entry,rip,mode,mem_ctxt))
+		{
+			// Repeated MMIO from the same instruction skips the decoder.
+			// Only the memory reference depends on the registers at the time of the access.
+			mem_ctxt->flags.value=entry->flags;
+			noir_movsb((u8p)&mem_ctxt->operand,(u8p)entry->operand,sizeof(mem_ctxt->operand));
+			if(mem_ctxt->flags.operand_class==noir_cvm_operand_class_memory)
+				mem_ctxt->operand.mem=nvc_emu_calculate_absolute_address(vcpu,entry);
+			vcpu->statistics.decode_cache.hits++;
+			st=noir_success;
+		}
 		else
-			SelectedDecoder=&ZyDec16;
-		zst=ZydisDecoderDecodeFull(SelectedDecoder,vcpu->exit_context.memory_access.instruction_bytes,15,&ZyIns,ZyOps);
-		if(ZYAN_SUCCESS(zst))
 		{
-			// Decode the identity of the MMIO instruction
-			switch(ZyIns.mnemonic)
+			ZydisDecodedInstruction ZyIns;
+			ZydisDecodedOperand ZyOps[ZYDIS_MAX_OPERAND_COUNT];
+			ZydisDecoder *SelectedDecoder=mode==64?&ZyDec64:mode==32?&ZyDec32:&ZyDec16;
+			ZyanStatus zst=ZydisDecoderDecodeFull(SelectedDecoder,mem_ctxt->instruction_bytes,15,&ZyIns,ZyOps);
+			vcpu->statistics.decode_cache.misses++;
+			if(ZYAN_SUCCESS(zst))
 			{
-				case ZYDIS_MNEMONIC_MOV:
-				{
-					mem_ctxt->flags.instruction_code=noir_cvm_instruction_code_mov;
-					nvc_emu_decode_instruction_mov(vcpu,&ZyIns,ZyOps);
-					break;
-				}
-				default:
+				// The length is required by RIP-relative addressing.
+				entry->length=ZyIns.length;
+				// Decode the identity of the MMIO instruction
+				mem_ctxt->flags.value=0;
+				mem_ctxt->flags.instruction_code=nvc_emu_get_instruction_code(&ZyIns);
+				switch(mem_ctxt->flags.instruction_code)
 				{
-					mem_ctxt->flags.instruction_code=noir_cvm_instruction_code_unknown;
-					break;
+					case noir_cvm_instruction_code_movs:
+					case noir_cvm_instruction_code_stos:
+					{
+						nvc_emu_decode_string_form(vcpu,&ZyIns,ZyOps,entry);
+						break;
+					}
+					case noir_cvm_instruction_code_unknown:
+					{
+						mem_ctxt->flags.operand_class=noir_cvm_operand_class_unknown;
+						break;
+					}
+					default:
+					{
+						nvc_emu_decode_explicit_form(vcpu,&ZyIns,ZyOps,entry);
+						break;
+					}
 				}
+				// Mark the decoder has completed operation.
+				mem_ctxt->flags.decoded=true;
+				// Save the decoded instruction to the cache.
+				entry->rip=rip;
+				entry->mode=mode;
+				entry->write=mem_ctxt->access.write;
+				entry->flags=mem_ctxt->flags.value;
+				noir_movsb((u8p)entry->operand,(u8p)&mem_ctxt->operand,sizeof(mem_ctxt->operand));
+				noir_movsb(entry->instruction_bytes,mem_ctxt->instruction_bytes,sizeof(entry->instruction_bytes));
+				st=noir_success;
+			}
+			else
+			{
+				char ins_byte_str[48];
+				for(u8 j=0;j<15;j++)
+					nv_snprintf(&ins_byte_str[j*3],sizeof(ins_byte_str)-(j*3),"%02X ",mem_ctxt->instruction_bytes[j]);
+				nvd_printf("[CVM MMIO] Failed to decode %u-bit instruction! Instruction Bytes: %s\n",mode,ins_byte_str);
+				noir_int3();
 			}
-			// Decode Next-Rip.
-			vcpu->exit_context.vcpu_state.instruction_length=ZyIns.length;
-			vcpu->exit_context.next_rip=vcpu->exit_context.rip+ZyIns.length;
-			// Reset the higher 32 bits of the advanced rip if the guest is not in long mode.
-			if(noir_bt(&vcpu->exit_context.cs.selector,13)==false)vcpu->exit_context.next_rip&=maxu32;
-			// Mark the decoder has completed operation.
-			mem_ctxt->flags.decoded=true;
 		}
-		else
+		if(st==noir_success)
 		{
-			u8 mode=(noir_bt(&vcpu->exit_context.cs.attrib,13)<<2)+(noir_bt(&vcpu->exit_context.cs.attrib,14)<<1);
-			char ins_byte_str[48];
-			for(u8 j=0;j<15;j++)
-				nv_snprintf(&ins_byte_str[j*3],sizeof(ins_byte_str)-(j*3),"%02X ",vcpu->exit_context.memory_access.instruction_bytes[j]);
-			if(mode==0)mode=1;
-			nvd_printf("[CVM MMIO] Failed to decode %u-bit instruction! Instruction Bytes: %s\n",mode<<4,ins_byte_str);
-			noir_int3();
+			// Decode Next-Rip.
+			vcpu->exit_context.vcpu_state.instruction_length=entry->length;
+			vcpu->exit_context.next_rip=rip+entry->length;
+			// Reset the higher 32 bits of the advanced rip if the guest is not in long mode.
+			if(mode!=64)vcpu->exit_context.next_rip&=maxu32;
 		}
 	}
 	return st;
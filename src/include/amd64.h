@@ -80,6 +80,10 @@
 #define amd64_cr4_pke_bit			0x400000
 #define amd64_cr4_cet_bit			0x800000
 
+// XCR0 Bit Fields
+#define amd64_xcr0_pkru				9
+#define amd64_xcr0_pkru_bit			0x200
+
 // EFER Bit Fields
 #define amd64_efer_sce			0
 #define amd64_efer_lme			8
@@ -414,6 +418,14 @@ typedef union _amd64_x2apic_register_icr
 #define amd64_cpuid_hv_presence			31
 #define amd64_cpuid_hv_presence_bit		0x80000000
 
+// CPUID flags for Extended Processor Features
+#define amd64_cpuid_page1gb				26
+#define amd64_cpuid_page1gb_bit			0x4000000
+
+// CPUID flags for Extended Feature Extensions
+#define amd64_cpuid_invlpgb				3
+#define amd64_cpuid_invlpgb_bit			0x8
+
 // This is used for defining AMD64 RFlags bits.
 #define amd64_rflags_cf			0
 #define amd64_rflags_pf			2
@@ -18,6 +18,13 @@
 #define ci_enforcement_delay 50000
 #endif
 
+// Time budget of a scanning slice, in units of 100ns.
+#if !defined(ci_enforcement_slice)
+#define ci_enforcement_slice 20000
+#endif
+
+#define ci_max_workers		8
+
 typedef struct _noir_ci_page
 {
 	void* virt;
@@ -35,10 +42,22 @@ typedef struct _noir_ci_page
 	}options;
 }noir_ci_page,*noir_ci_page_p;
 
+typedef struct _noir_ci_worker
+{
+	noir_thread thread;
+	u32 index;
+	u32 processor;
+	u32 selected_page;
+	// Time is in units of 100ns.
+	u64 sweep_start;
+	u64 sweep_latency;
+}noir_ci_worker,*noir_ci_worker_p;
+
 typedef struct _noir_ci_context
 {
 #if !defined(_hv_type1)
-	noir_thread ci_thread;
+	u32 workers;
+	noir_ci_worker worker[ci_max_workers];
 #endif
 	u32 limit;
 	u32 pages;
@@ -59,10 +78,12 @@ typedef struct _noir_ci_context
 u8 nvc_confirm_cpu_manufacturer(char* vendor_string);
 bool nvc_is_vt_supported();
 u32 stdcall noir_crc32_page_sse(void* page);
+u32 stdcall noir_crc32_page_clmul(void* page);
 bool fastcall noir_check_sse42();
+bool fastcall noir_check_pclmulqdq();
+u64 noir_ci_query_sweep_latency();
 
 #if defined(_code_integrity)
-u32 noir_ci_selected_page=0;
 u32v noir_ci_stop_signal=0;
 noir_hvdata noir_ci_context_p noir_ci=null;
 noir_hvdata noir_crc32_page_func noir_crc32_page=null;
@@ -170,8 +170,12 @@ typedef enum _noir_cvm_vcpu_option_type
 	noir_cvm_msr_interception
 }noir_cvm_vcpu_option_type,*noir_cvm_vcpu_option_type_p;
 
-#define noir_cvm_cpuid_quickpath_limit_per_vm		64
-#define noir_cvm_cpuid_quickpath_limit_per_vcpu		16
+// CPUID Quick-Paths are open-addressed hash tables keyed by (leaf,subleaf).
+// Slot counts must be powers of two. Limits keep the tables at most 3/4 full.
+#define noir_cvm_cpuid_quickpath_slots_per_vm		512
+#define noir_cvm_cpuid_quickpath_slots_per_vcpu		16
+#define noir_cvm_cpuid_quickpath_limit_per_vm		384
+#define noir_cvm_cpuid_quickpath_limit_per_vcpu		12
 
 typedef struct _noir_cvm_cpuid_quickpath_info
 {
@@ -184,7 +188,9 @@ typedef struct _noir_cvm_cpuid_quickpath_info
 			u64 active:1;
 			u64 has_subleaf:1;
 			u64 vm_wide:1;
-			u64 reserved:61;
+			u64 host_masked:1;		// Registers are masks applied to host CPUID result.
+			u64 retired:1;			// Removed entry. Lookups must probe past it.
+			u64 reserved:59;
 		};
 		u64 value;
 	}options;
@@ -194,6 +200,36 @@ typedef struct _noir_cvm_cpuid_quickpath_info
 	u32 edx;
 }noir_cvm_cpuid_quickpath_info,*noir_cvm_cpuid_quickpath_info_p;
 
+// MSR Quick-Path rules are sorted by range and must not overlap.
+#define noir_cvm_msr_quickpath_limit		64
+
+typedef struct _noir_cvm_msr_quickpath_rule
+{
+	u32 first;
+	u32 last;
+	union
+	{
+		struct
+		{
+			u32 active:1;
+			u32 passthrough:1;		// Reads go to hardware without exits. Writes are never passed through.
+			u32 reserved:30;
+		};
+		u32 value;
+	}options;
+	u32 reserved;
+	u64 value;				// Emulated value shared by every MSR in the range.
+	u64 readonly_mask;		// Writes changing these bits raise #GP.
+	u64v hits;
+}noir_cvm_msr_quickpath_rule,*noir_cvm_msr_quickpath_rule_p;
+
+typedef enum _noir_cvm_msr_quickpath_result
+{
+	noir_cvm_msr_quickpath_miss,
+	noir_cvm_msr_quickpath_handled,
+	noir_cvm_msr_quickpath_fault
+}noir_cvm_msr_quickpath_result,*noir_cvm_msr_quickpath_result_p;
+
 typedef union _noir_cvm_invalid_state_context
 {
 	struct
@@ -291,6 +327,21 @@ typedef struct _noir_cvm_task_switch_context
 #define noir_cvm_operand_class_unknown		31
 
 #define noir_cvm_instruction_code_mov			0
+#define noir_cvm_instruction_code_movzx			1
+#define noir_cvm_instruction_code_movsx			2
+#define noir_cvm_instruction_code_movs			3		// The operand is the other side of the string move.
+#define noir_cvm_instruction_code_stos			4		// The operand is the accumulator.
+#define noir_cvm_instruction_code_xchg			5
+#define noir_cvm_instruction_code_add			6
+#define noir_cvm_instruction_code_or			7
+#define noir_cvm_instruction_code_adc			8
+#define noir_cvm_instruction_code_sbb			9
+#define noir_cvm_instruction_code_and			10
+#define noir_cvm_instruction_code_sub			11
+#define noir_cvm_instruction_code_xor			12
+#define noir_cvm_instruction_code_cmp			13
+#define noir_cvm_instruction_code_test			14
+#define noir_cvm_instruction_code_simd_mov		15		// movd, movdqu, vmovaps, etc.
 // NoirVisor's internal emulator cannot emulate this instruction...
 #define noir_cvm_instruction_code_unknown		0xffff
 
@@ -321,7 +372,9 @@ typedef struct _noir_cvm_memory_access_context
 			// The index of operand.
 			// (e.g.: rax is 0 because it's the first register among GPR)
 			u64 operand_code:7;
-			u64 reserved:19;
+			// The instruction has a rep prefix. The count is in rcx.
+			u64 rep_prefix:1;
+			u64 reserved:18;
 			u64 decoded:1;
 		};
 		u64 value;
@@ -557,7 +610,8 @@ typedef union _noir_cvm_vcpu_state_cache
 		u32 ss_valid:1;		// Includes ssp,pln_ssp,u/s_cet,isst
 		u32 ts_valid:1;		// Includes TSC
 		u32 reserved:15;
-		u32 tl_valid:1;		// Includes TLB of EPT/NPT.
+		// TLB of EPT/NPT is not cached here. It is tracked per processor by the TLB tracker of the VM.
+		u32 gt_valid:1;		// Includes software TLB of guest-virtual address translation.
 		// This field indicates whether the state in VMCS/VMCB is
 		// updated to the state save area in the vCPU structure.
 		u32 synchronized:1;
@@ -589,6 +643,18 @@ typedef struct _noir_cvm_interception_counter
 	u64 time;
 }noir_cvm_interception_counter,*noir_cvm_interception_counter_p;
 
+// Log-scale histograms of cycles, used by the exit profiler and by vCPU kicks.
+// Bucket n counts the samples that took [2^n,2^(n+1)) cycles. The last bucket counts the rest.
+#define noir_exit_profiler_buckets		32
+
+typedef struct _noir_exit_histogram
+{
+	u64 count;
+	u64 cycles;
+	u64 max_cycles;
+	u32 buckets[noir_exit_profiler_buckets];
+}noir_exit_histogram,*noir_exit_histogram_p;
+
 typedef struct _noir_cvm_vcpu_statistics
 {
 	struct
@@ -608,8 +674,97 @@ typedef struct _noir_cvm_vcpu_statistics
 		noir_cvm_interception_counter rsm;
 	}interceptions;
 	u64 runtime;
+	struct
+	{
+		u64 hits;
+		u64 misses;
+		u64 flushes;
+	}gva_tlb;
+	struct
+	{
+		u64 fpu_avoided;	// World switches that skipped extended state.
+		u64 dr_avoided;		// World switches that skipped debug registers.
+		u64 cycles_saved;	// Estimated by the cost of the last eager switch.
+	}lazy_switch;
+	struct
+	{
+		u64 issued;		// NPT invalidations that required this vCPU to flush its ASID.
+		u64 avoided;	// NPT invalidations skipped because this processor did not cache the ASID.
+	}tlb_flush;
+	struct
+	{
+		u64 hits;
+		u64 misses;
+	}decode_cache;
+	struct
+	{
+		u64v requested;
+		u64v coalesced;		// Kicks that found an earlier kick still pending.
+		u64v ipi_sent;		// Kicks that found the vCPU in guest mode.
+		u64 ipi_redundant;	// IPIs that arrived after the vCPU had already left guest mode.
+		noir_exit_histogram latency;	// Cycles from the kick to the exit of the vCPU.
+	}kick;
 }noir_cvm_vcpu_statistics,*noir_cvm_vcpu_statistics_p;
 
+// Histograms are indexed by the architectural exit reason of the selected core.
+typedef struct _noir_exit_profiler
+{
+	u32 reasons;
+	u32 reserved;
+	noir_exit_histogram histogram[0];
+}noir_exit_profiler,*noir_exit_profiler_p;
+
+#define noir_exit_profiler_size(r)		(sizeof(noir_exit_profiler)+sizeof(noir_exit_histogram)*(r))
+
+// Software TLB for guest-virtual address translations.
+// It is direct-mapped by the guest-virtual page number.
+#define noir_cvm_gva_tlb_entries		32
+
+typedef struct _noir_cvm_gva_tlb_entry
+{
+	u64 cr3;		// Tag: CR3 value, including PCID.
+	u64 gva;		// Tag: Base of the guest-virtual page.
+	u64 gpa;		// Base of the translated guest-physical page.
+	u32 access;		// Accesses that were granted by page-walking.
+	bool valid;
+}noir_cvm_gva_tlb_entry,*noir_cvm_gva_tlb_entry_p;
+
+// Cache of decoded MMIO instructions. It is direct-mapped by the rip.
+// An entry is hit only if the instruction bytes are identical, so that modified code is decoded again.
+#define noir_cvm_decode_cache_entries	16
+
+typedef struct _noir_cvm_decode_cache_entry
+{
+	u64 rip;			// Tag: rip of the instruction.
+	u64 flags;			// Decoded flags of the memory-access context.
+	u64 operand[2];		// Decoded operand of the memory-access context.
+	// Memory operands are calculated with the registers at the time of the access.
+	struct
+	{
+		i64 disp;
+		u16 segment;
+		u16 base;
+		u16 index;
+		u8 scale;
+		u8 address_width;
+	}mem;
+	u8 instruction_bytes[15];
+	u8 length;			// Zero if the entry is vacant.
+	u8 mode;			// Decoding mode: 16, 32 or 64.
+	u8 write;			// Direction of the access.
+}noir_cvm_decode_cache_entry,*noir_cvm_decode_cache_entry_p;
+
+// Guest-physical range of the buffer of a string I/O instruction.
+typedef struct _noir_cvm_pio_scatter_entry
+{
+	u64 gpa;
+	u32 length;
+	u32 reserved;
+}noir_cvm_pio_scatter_entry,*noir_cvm_pio_scatter_entry_p;
+
+#define noir_cvm_pio_scatter_limit		64		// Entries that fit in the I/O buffer of VPCB.
+#define noir_cvm_pio_element_limit		0x10000	// Elements of a REP string I/O handled in one exit.
+
 // Virtual-Processor Control Block (VPCB) is one or more shared page(s) between the NoirVisor
 // and the User Hypervisors to accelerate VM-Exit handlings, especially I/O emulations.
 // When VPCB is active, Exit-Context is not used.
@@ -632,11 +787,18 @@ typedef struct _noir_cvm_vcpu_control_block
 	}flags;
 	union
 	{
+		// For string I/O, the I/O buffer holds a scatter list of guest-physical ranges in ascending order.
+		// If df is set, elements are transferred from the highest address downward.
+		// The User Hypervisor updates rcx, rsi/rdi by count, and advances rip only if the rcx reaches zero.
 		struct
 		{
 			u16 port;
 			u8 size;
 			u8 direction;
+			u8 string;
+			u8 df;
+			u8 scatter_count;
+			u8 reserved;
 			u64 count;
 		}pio;
 		struct
@@ -653,8 +815,42 @@ typedef struct _noir_cvm_vcpu_control_block
 	// Align the I/O buffer at 1024 bytes.
 	// Note that the biggest registers in x86 have 1024 bytes (AMX registers).
 	align_at(1024) u8 io_buff[1024];
+	// Register groups shared with the User Hypervisor.
+	// Groups in the publish mask are written to VPCB on every exit and are marked valid.
+	// Groups marked dirty by the User Hypervisor are loaded to the vCPU before the next run.
+	struct
+	{
+		u32 publish;
+		u32 valid;
+		u32 dirty;
+		u32 reserved;
+		noir_gpr_state gpr;
+		u64 rflags;
+		u64 rip;
+		noir_seg_state seg;
+		noir_cr_state crs;
+		align_at(64) noir_fx_state fx;
+	}registers;
 }noir_cvm_vcpu_control_block,*noir_cvm_vcpu_control_block_p;
 
+#define noir_cvm_vpcb_group_gpr		0	// Includes rflags,rip.
+#define noir_cvm_vpcb_group_seg		1	// Includes all segments and descriptor tables.
+#define noir_cvm_vpcb_group_cr		2	// Includes cr0,cr2,cr3,cr4,cr8.
+#define noir_cvm_vpcb_group_fpu		3	// Includes x87 FPU and XMM state.
+#define noir_cvm_vpcb_group_mask	0xF
+
+// Bits of the vCPU Run-State. They share one atomic word.
+#define noir_cvm_vcpu_running		0	// A thread is in the run path of this vCPU.
+#define noir_cvm_vcpu_kicked		1	// A kick is pending. The vCPU leaves guest mode, or its next run is rescinded.
+#define noir_cvm_vcpu_excluded		2	// An exclusive operation holds this vCPU.
+#define noir_cvm_vcpu_in_guest		3	// The vCPU is in guest mode on the processor it was scheduled to.
+#define noir_cvm_vcpu_kick_ipi		4	// The pending kick has interrupted the processor.
+#define noir_cvm_vcpu_preempted		5	// An exclusive operation forces the vCPU out of guest mode. The run resumes silently.
+#define noir_cvm_vcpu_resuming		6	// The preempted run waits for exclusive operations without the running bit.
+
+// Waiters of the run-state spin for this many times before they yield the processor.
+#define noir_cvm_exclusion_spin_limit	0x400
+
 typedef struct _noir_cvm_virtual_cpu
 {
 	noir_gpr_state gpr;
@@ -670,10 +866,12 @@ typedef struct _noir_cvm_virtual_cpu
 	u64 rip;
 	u64 tsc_offset;
 	void* tunnel;
+	void* tunnel_locker;
 	void* iobuff;
 	u64 swapped_pte;
-	noir_pushlock vcpu_lock;
+	u32v run_state;
 	u32v ref_count;
+	u64 kick_tsc;
 	noir_cvm_event_injection injected_event;
 	noir_cvm_exit_context exit_context;
 	noir_cvm_vcpu_options vcpu_options;
@@ -685,9 +883,22 @@ typedef struct _noir_cvm_virtual_cpu
 		noir_cvm_interception_counter_p selector;
 		u64 runtime_start;
 	}statistics_internal;
+	noir_exit_profiler_p profiler;		// Null if the exit profiler is disabled.
 	u32 exception_bitmap;
 	u32 scheduling_priority;
-	noir_cvm_cpuid_quickpath_info cpuid_quickpath[8];
+	u32 cpuid_quickpath_count;
+	noir_cvm_cpuid_quickpath_info cpuid_quickpath[noir_cvm_cpuid_quickpath_slots_per_vcpu];
+	// The software TLB survives guest runs. While it holds translations, the guest's writes to CR3
+	// and invalidations of its TLB are intercepted so that the software TLB could be discarded.
+	u64 gva_tlb_paging;		// Paging controls that the software TLB was filled under.
+	u32 gva_tlb_filled;		// Entries filled since the last flush of the software TLB.
+	bool gva_tlb_armed;		// TLB maintenance of the guest is intercepted.
+	// Broadcast invalidations by any vCPU of the VM bump the shootdown counter of the VM.
+	// The software TLB is discarded if the counter differs from the one it was filled under.
+	u32v* gva_tlb_shootdown;
+	u32 gva_tlb_shootdown_seen;
+	noir_cvm_gva_tlb_entry gva_tlb[noir_cvm_gva_tlb_entries];
+	noir_cvm_decode_cache_entry decode_cache[noir_cvm_decode_cache_entries];
 }noir_cvm_virtual_cpu,*noir_cvm_virtual_cpu_p;
 
 #define noir_cvm_memory_uc	0
@@ -710,6 +921,12 @@ typedef union _noir_cvm_mapping_attributes
 	u32 value;
 }noir_cvm_mapping_attributes,*noir_cvm_mapping_attributes_p;
 
+// Number of 4KiB pages in a page of the specified size. (0=4KiB, 1=2MiB, 2=1GiB)
+#define noir_cvm_psize_pages(s)		(1<<((s)*9))
+
+// Maximum number of ranges in a single batched mapping request.
+#define noir_cvm_mapping_batch_limit	256
+
 typedef struct _noir_cvm_address_mapping
 {
 	u64 gpa;
@@ -718,21 +935,34 @@ typedef struct _noir_cvm_address_mapping
 	noir_cvm_mapping_attributes attributes;
 }noir_cvm_address_mapping,*noir_cvm_address_mapping_p;
 
+// Present translation of a GPA range captured before a batched mapping, one record per leaf entry.
+// A failed batch unmaps the ranges it has overwritten and restores these translations.
+typedef struct _noir_cvm_prior_mapping
+{
+	u64 gpa;
+	u64 hpa;
+	u32 pages;
+	noir_cvm_mapping_attributes attributes;
+}noir_cvm_prior_mapping,*noir_cvm_prior_mapping_p;
+
+// Absent translations are not recorded. Capturing ranges that are not mapped yet allocates nothing.
+typedef struct _noir_cvm_prior_journal
+{
+	noir_cvm_prior_mapping_p list;
+	u32 count;
+	u32 limit;
+}noir_cvm_prior_journal,*noir_cvm_prior_journal_p;
+
 // Each list takes a page.
+// For 64-bit, there are 511 lockers. For 32-bit, there are 1023 lockers.
+// A free slot links to the next free slot, tagged with bit 0 set.
+// Lockers are pointers to MDLs which are never tagged.
+#define noir_cvm_lockers_per_array	((page_size/sizeof(void*))-1)
+#define noir_cvm_free_locker_tag	1
+
 typedef struct _noir_cvm_lockers_list
 {
 	struct _noir_cvm_lockers_list *next;
-#if defined(_amd64)
-	// For 64-bit, there are 503 lockers.
-	// The bitmap would be 64 bytes.
-#define noir_cvm_lockers_per_array	503
-	u8 bitmap[64];
-#else
-	// For 32-bit, there are 992 lockers.
-	// The bitmap would be 128 bytes.
-#define noir_cvm_lockers_per_array	992
-	u8 bitmap[128];
-#endif
 	void* lockers[noir_cvm_lockers_per_array];
 }noir_cvm_lockers_list,*noir_cvm_lockers_list_p;
 
@@ -761,9 +991,22 @@ typedef struct _noir_cvm_virtual_machine
 	memory_descriptor vmsa;
 	noir_cvm_vm_properties properties;
 	noir_cvm_lockers_list_p locker_head;
-	noir_cvm_lockers_list_p locker_tail;
-	noir_cvm_cpuid_quickpath_info cpuid_quickpath[64];
+	void** locker_free;
+	noir_pushlock locker_lock;
 	noir_reslock vcpu_list_lock;
+	// Exclusive operations on the VM make the generation odd. vCPUs do not enter the guest while it is odd.
+	u32v exclusion_gen;
+	// Updates to any CPUID Quick-Path of this VM make the sequence odd.
+	u32v cpuid_quickpath_seq;
+	// Broadcast invalidations of guest TLB increment this counter. See gva_tlb_shootdown in vCPU.
+	u32v gva_tlb_shootdown;
+	u32 cpuid_quickpath_count;
+	// If active, leaves missing from Quick-Paths are passed to host CPUID and masked.
+	noir_cvm_cpuid_quickpath_info cpuid_fallback;
+	noir_cvm_cpuid_quickpath_info cpuid_quickpath[noir_cvm_cpuid_quickpath_slots_per_vm];
+	// MSR Quick-Path is only updated while all vCPUs are excluded.
+	u32 msr_quickpath_count;
+	noir_cvm_msr_quickpath_rule msr_quickpath[noir_cvm_msr_quickpath_limit];
 }noir_cvm_virtual_machine,*noir_cvm_virtual_machine_p;
 
 typedef struct _noir_cvm_gmem_op_context
@@ -781,6 +1024,25 @@ typedef struct _noir_cvm_gmem_op_context
 	noir_status status;
 }noir_cvm_gmem_op_context,*noir_cvm_gmem_op_context_p;
 
+// Ownership index of a guest. It records host ranges that might be owned by the guest's ASID,
+// so that tearing down a guest does not have to scan the whole Reverse-Mapping Table.
+// Extents are only appended. Pages returned to the host are filtered by the ASID in RMT entries.
+#define noir_rmt_index_initial_extents	64
+
+typedef struct _noir_rmt_extent
+{
+	u64 hpa_start;
+	u64 pages;
+}noir_rmt_extent,*noir_rmt_extent_p;
+
+typedef struct _noir_rmt_ownership_index
+{
+	noir_rmt_extent_p extents;
+	u32 count;
+	u32 limit;
+	bool overflow;
+}noir_rmt_ownership_index,*noir_rmt_ownership_index_p;
+
 typedef struct _noir_rmt_remap_context
 {
 	u64p hpa_list;
@@ -813,23 +1075,33 @@ void nvc_svmc_release_vm(noir_cvm_virtual_machine_p vm);
 noir_status nvc_svmc_create_vcpu(noir_cvm_virtual_cpu_p* virtual_cpu,noir_cvm_virtual_machine_p virtual_machine,u32 vcpu_id);
 void nvc_svmc_release_vcpu(noir_cvm_virtual_cpu_p vcpu);
 noir_status nvc_svmc_run_vcpu(noir_cvm_virtual_cpu_p vcpu);
-noir_status nvc_svmc_rescind_vcpu(noir_cvm_virtual_cpu_p vcpu);
 noir_cvm_virtual_cpu_p nvc_svmc_reference_vcpu(noir_cvm_virtual_machine_p vm,u32 vcpu_id);
 noir_status nvc_svmc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u64p phys_array);
+noir_status nvc_svmc_set_mapping_batch(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array);
 noir_status nvc_svmc_set_unmapping(noir_cvm_virtual_machine_p virtual_machine,u64 gpa,u32 pages);
 noir_status nvc_svmc_query_gpa_accessing_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size);
 noir_status nvc_svmc_clear_gpa_accessing_bits(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count);
+noir_status nvc_svmc_harvest_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
 u32 nvc_svmc_get_vm_asid(noir_cvm_virtual_machine_p vm);
+u32 nvc_svmc_get_vcpu_processor(noir_cvm_virtual_cpu_p vcpu);
+bool nvc_svmc_set_msr_passthrough(noir_cvm_virtual_machine_p vm,u32 first,u32 last,bool passthrough);
+noir_exit_profiler_p nvc_svmc_get_host_exit_profiler(u32 processor);
 // CVM Functions from VT-Core
 noir_status nvc_vtc_create_vm(noir_cvm_virtual_machine_p *virtual_machine);
 void nvc_vtc_release_vm(noir_cvm_virtual_machine_p virtual_machine);
 noir_status nvc_vtc_create_vcpu(noir_cvm_virtual_cpu_p *virtual_processor,noir_cvm_virtual_machine_p virtual_machine,u32 vcpu_id);
 void nvc_vtc_release_vcpu(noir_cvm_virtual_cpu_p virtual_processor);
 noir_status nvc_vtc_run_vcpu(noir_cvm_virtual_cpu_p vcpu);
-noir_status nvc_vtc_rescind_vcpu(noir_cvm_virtual_cpu_p vcpu);
 noir_cvm_virtual_cpu_p nvc_vtc_reference_vcpu(noir_cvm_virtual_machine_p vm,u32 vcpu_id);
 noir_status nvc_vtc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+noir_status nvc_vtc_set_mapping_batch(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array);
+noir_status nvc_vtc_query_gpa_accessing_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size);
+noir_status nvc_vtc_clear_gpa_accessing_bits(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count);
+noir_status nvc_vtc_harvest_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
 u32 nvc_vtc_get_vm_asid(noir_cvm_virtual_machine_p vm);
+u32 nvc_vtc_get_vcpu_processor(noir_cvm_virtual_cpu_p vcpu);
+bool nvc_vtc_set_msr_passthrough(noir_cvm_virtual_machine_p vm,u32 first,u32 last,bool passthrough);
+noir_exit_profiler_p nvc_vtc_get_host_exit_profiler(u32 processor);
 
 // Idle VM is to be considered as the List Head.
 noir_cvm_virtual_machine noir_idle_vm={0};
@@ -864,8 +1136,35 @@ noir_hvdata u32 noir_cvm_register_buffer_limit[noir_cvm_maximum_register_type]=
 	8								// APIC-BAR Register
 };
 #elif defined(_vt_core) || defined(_svm_core)
+// vCPU Run-State Functions
+u32 nvc_enter_vcpu_run(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu);
+void nvc_leave_vcpu_run(noir_cvm_virtual_cpu_p vcpu);
+bool nvc_resume_preempted_vcpu_run(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu);
+noir_status nvc_kick_vcpu(noir_cvm_virtual_cpu_p vcpu);
+void nvc_park_vcpu_run(noir_cvm_virtual_cpu_p vcpu);
+void nvc_unpark_vcpu_run(noir_cvm_virtual_cpu_p vcpu);
+void nvc_acquire_vcpu_exclusion(noir_cvm_virtual_cpu_p vcpu);
+void nvc_release_vcpu_exclusion(noir_cvm_virtual_cpu_p vcpu);
+void nvc_acquire_vm_exclusion(noir_cvm_virtual_machine_p vm);
+void nvc_release_vm_exclusion(noir_cvm_virtual_machine_p vm);
 // Emulator Functions
 noir_status nvc_emu_decode_memory_access(noir_cvm_virtual_cpu_p vcpu);
+// Software TLB Functions
+void nvc_shootdown_gva_tlb(noir_cvm_virtual_machine_p vm);
+// CPUID Quick-Path Functions
+noir_status nvc_insert_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32 limit,u32p count,noir_cvm_cpuid_quickpath_info_p info);
+bool nvc_resolve_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,noir_cpuid_general_info_p info);
+// MSR Quick-Path Functions
+noir_cvm_msr_quickpath_result nvc_handle_msr_quickpath(noir_cvm_virtual_machine_p vm,u32 index,bool write,u64p value);
+// Batched Mapping Functions
+bool nvc_record_prior_mapping(noir_cvm_prior_journal_p journal,u64 gpa,u64 hpa,u32 pages,noir_cvm_mapping_attributes attributes);
+void nvc_free_prior_journal(noir_cvm_prior_journal_p journal);
+// Dirty Page Harvesting Functions
+void nvc_report_dirty_pages(void* bitmap,u32 start,u32 count,bool dirty,bool accumulate);
+// Exit Profiler Functions
+noir_exit_profiler_p nvc_alloc_exit_profiler(u32 reasons);
+void nvc_free_exit_profiler(noir_exit_profiler_p profiler);
+void nvc_record_exit_latency(noir_exit_profiler_p profiler,u32 reason,u64 cycles);
 void nvc_release_lockers(noir_cvm_virtual_machine_p virtual_machine);
 extern noir_cvm_virtual_machine noir_idle_vm;
 extern noir_reslock noir_vm_list_lock;
@@ -873,6 +1172,7 @@ extern noir_reslock noir_vm_list_lock;
 noir_status nvc_edit_vcpu_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_register_type register_type,void* buffer,u32 buffer_size);
 noir_status nvc_view_vcpu_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_register_type register_type,void* buffer,u32 buffer_size);
 noir_status nvc_set_guest_vcpu_options(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_option_type option_type,u32 data);
+noir_status nvc_set_event_injection(noir_cvm_virtual_cpu_p vcpu,noir_cvm_event_injection injected_event);
 noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
 void nvc_synchronize_vcpu_state(noir_cvm_virtual_cpu_p vcpu);
 noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context);
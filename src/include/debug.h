@@ -27,6 +27,35 @@ typedef enum _noir_debug_mode
 	noir_debug_interactive
 }noir_debug_mode,*noir_debug_mode_p;
 
+// Trace Ring size must be power of 2.
+#define noir_trace_ring_size		1024
+#define noir_trace_max_args			4
+
+typedef struct _noir_trace_record
+{
+	u64 timestamp;
+	// Sequence is written at last so that the drainer may know the record is complete.
+	u64v sequence;
+	u32 event_id;
+	u32 proc_id;
+	u64 args[noir_trace_max_args];
+}noir_trace_record,*noir_trace_record_p;
+
+typedef struct _noir_trace_ring
+{
+	// Producers reserve slots by advancing the head.
+	i64v head;
+	// Drainer releases slots by advancing the tail.
+	i64v tail;
+	i64v dropped;
+	u64 pad[5];
+	noir_trace_record records[noir_trace_ring_size];
+}noir_trace_ring,*noir_trace_ring_p;
+
+// Drainers receive formatted records so that the layout of records is known to the core only.
+typedef void (*noir_trace_output_routine)(u32 proc_id,u64 timestamp,const char* text);
+#define noir_trace_drain_batch		32
+
 typedef struct _noir_debugger
 {
 	noir_debug_media_type medium_type;
@@ -45,6 +74,11 @@ typedef struct _noir_debugger
 		}qemu_debugcon;
 	}debug_port;
 	u32v port_lock;
+	struct
+	{
+		noir_trace_ring_p rings;
+		u32 processors;
+	}trace;
 }noir_debugger,*noir_debugger_p;
 
 // Serial Driver
@@ -55,6 +89,13 @@ noir_status nvc_io_serial_write(u8 port_number,u8p buffer,size_t length);
 noir_status nvc_io_qemu_debugcon_init(u16 port_number);
 noir_status nvc_io_qemu_debugcon_read(u8p buffer,size_t length);
 noir_status nvc_io_qemu_debugcon_write(u8p buffer,size_t length);
+// Binary Tracing Facility
+noir_status nvd_trace_initialize();
+void nvd_trace_finalize();
+u32 nvd_trace_drain(u32 proc_id,noir_trace_record_p buffer,u32 limit);
+u64 nvd_trace_query_dropped(u32 proc_id);
+i32 nvd_trace_format(noir_trace_record_p record,char* buffer,size_t limit);
+u32 nvd_trace_flush(u32 proc_id,noir_trace_output_routine output);
 
 #if defined(_nvdbg)
 // String Facility
@@ -106,6 +106,10 @@
 #define hv_x64_msr_nested_sint14				0x4000109E
 #define hv_x64_msr_nested_sint15				0x4000109F
 
+// The hypercall page loads this signature into eax before vmcall/vmmcall,
+// so that Hv#1 hypercalls can be told apart from NoirVisor's own hypercalls.
+#define noir_mshv_hypercall_signature		0x6348764E	// "NvHc"
+
 #define noir_mshv_npiep_prevent_sgdt		0
 #define noir_mshv_npiep_prevent_sidt		1
 #define noir_mshv_npiep_prevent_sldt		2
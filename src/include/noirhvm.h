@@ -185,6 +185,32 @@ typedef struct _noir_rmt_directory_entry
 	u64 hpa_end;
 }noir_rmt_directory_entry,*noir_rmt_directory_entry_p;
 
+#define noir_rmt_directory_limit	(page_size/sizeof(noir_rmt_directory_entry))
+
+typedef void (*noir_rmt_enum_callback)
+(
+ u64 hpa,
+ noir_rmt_entry_p entry,
+ void* context
+);
+
+// Cached Physical Memory Map
+typedef struct _noir_physical_range
+{
+	u64 start;
+	u64 end;
+}noir_physical_range,*noir_physical_range_p;
+
+#define noir_physical_range_limit	(page_size/sizeof(noir_physical_range))
+
+typedef struct _noir_physical_memory_map
+{
+	noir_physical_range_p ranges;
+	u32 count;
+	u32 dropped;
+	noir_pushlock lock;
+}noir_physical_memory_map,*noir_physical_memory_map_p;
+
 // Hypervisor Structure
 typedef struct _noir_hypervisor
 {
@@ -251,7 +277,8 @@ typedef struct _noir_hypervisor
 			u64 tlfs_passthrough:1;
 			u64 hide_from_pt:1;
 			u64 enable_nsv:1;
-			u64 reserved:54;
+			u64 exit_profiler:1;
+			u64 reserved:53;
 			u64 software_decoder:1;
 		};
 		u64 value;
@@ -268,7 +295,8 @@ typedef struct _noir_hypervisor
 			u64 builtin_x2apic:1;
 			u64 large_page:1;
 			u64 huge_page:1;
-			u64 reserved:56;
+			u64 accessed_dirty:1;
+			u64 reserved:55;
 		};
 		u64 value;
 	}cvm_cap;
@@ -317,7 +345,9 @@ typedef struct _noir_hypervisor
 		memory_descriptor directory;
 		u64 dir_count;
 		noir_pushlock lock;
+		u32v sequence;		// Odd while the directory is being extended.
 	}rmd;
+	noir_physical_memory_map phys_map;
 	u32 cpu_count;
 	char vendor_string[13];
 	u8 cpu_manuf;
@@ -361,6 +391,7 @@ bool nvc_is_svm_disabled();
 u32 nvc_svm_get_avail_asid();
 bool nvc_svm_subvert_system(noir_hypervisor_p hvm);
 void nvc_svm_restore_system(noir_hypervisor_p hvm);
+bool nvc_npt_protect_reverse_mapping_table(u64 table_phys,u64 size);
 // Central Hypervisor Structure.
 void nvc_store_image_info(ulong_ptr* base,u32* size);
 noir_hypervisor hvm_t={0};
@@ -372,10 +403,17 @@ char virtual_nstr[49]="AMD Ryzen 7 1700 Eight-Core Processor\0";
 noir_custom_gpa_translation_callback noir_translate_custom_gpa=null;
 noir_custom_vcpu_get_nested_paging_base noir_get_custom_vcpu_np_base=null;
 #else
+u32 nvc_enum_physical_memory_map(noir_physical_range_callback callback,void* context);
 bool nvc_build_reverse_mapping_table();
 void nvc_configure_reverse_mapping(u64 hpa,u64 gpa,u32 asid,bool shared,u8 ownership);
+void nvc_configure_reverse_mapping_list(u64p hpa,u64p gpa,u32 pages,u32 asid,bool shared,u8 ownership);
 bool nvc_validate_rmt_reassignment(u64p hpa,u64p gpa,u32 pages,u32 asid,bool shared,u8 ownership);
 noir_rmt_entry_p nvc_get_rmt_entry(u64 hpa);
+noir_rmt_entry_p nvc_get_rmt_range(u64 hpa,u64p pages);
+void nvc_rmt_index_insert(noir_rmt_ownership_index_p index,u64p hpa_list,u32 pages);
+void nvc_rmt_index_remove(noir_rmt_ownership_index_p index,u64p hpa_list,u32 pages);
+void nvc_rmt_index_release(noir_rmt_ownership_index_p index);
+u32 nvc_enum_rmt_entries_by_asid(noir_rmt_ownership_index_p index,u32 asid,noir_rmt_enum_callback callback,void* context);
 extern noir_hypervisor_p hvm_p;
 extern ulong_ptr system_cr3;
 extern ulong_ptr orig_system_call;
@@ -384,17 +422,24 @@ extern noir_custom_vcpu_get_nested_paging_base noir_get_custom_vcpu_np_base;
 #endif
 #if defined(_mshv_core)
 void nvc_svm_reconfigure_npiep_interceptions(void* vcpu);
+bool nvc_svm_is_broadcast_tlb_flush_supported();
+bool nvc_svm_mshv_flush_guest_tlb(void* vcpu,u64p gva_list,u32 count,bool remote,bool non_global);
+bool nvc_vt_mshv_flush_guest_tlb(void* vcpu,u64p gva_list,u32 count,bool remote,bool non_global);
 #elif defined(_vt_core)
 #elif defined(_svm_core)
 bool nvc_svm_translate_custom_gpa(u64 pt,u32 level,u64 gpa,u32 access,u64p hpa,noir_page_fault_error_code_p err_code);
 void nvc_svm_reconfigure_npiep_interceptions(noir_svm_vcpu_p vcpu);
+bool nvc_svm_is_broadcast_tlb_flush_supported();
 u64 nvc_svmc_get_vcpu_npt_base(noir_cvm_virtual_cpu_p vcpu);
 #endif
 // Functions from MSHV Core.
 u32 fastcall nvc_mshv_build_cpuid_handlers();
 void fastcall nvc_mshv_teardown_cpuid_handlers();
+void fastcall nvc_mshv_initialize_reference_time();
+void fastcall nvc_mshv_finalize_reference_time();
 u64 fastcall nvc_mshv_rdmsr_handler(noir_mshv_vcpu_p vcpu,u32 index);
 void fastcall nvc_mshv_wrmsr_handler(noir_mshv_vcpu_p vcpu,u32 index,u64 val);
+u64 fastcall nvc_mshv_hypercall_handler(noir_mshv_vcpu_p vcpu,u64 input,u64 input_gpa,u64 output_gpa);
 
 // Functions from NoirVisor internal debugger.
 noir_status noir_configure_serial_port_debugger(u8 port_number,u16 port_base,u32 baudrate);
@@ -408,6 +453,7 @@ u8 nvc_emu_try_vmexit_write_memory(noir_gpr_state_p gpr_state,noir_seg_state_p s
 bool nvc_translate_host_virtual_address_routine64(u64 pt,u64 va,u32 level,u64p pa,u32p error_code,bool r,bool w,bool x,bool u);
 size_t nvc_copy_host_virtual_memory64(u64 pt,u64 va,void* buffer,size_t length,bool write,bool la57,u32p error_code);
 size_t nvc_copy_guest_virtual_memory(noir_cvm_virtual_cpu_p vcpu,u64 gva,void* buffer,size_t length,bool write,u32p error_code);
+u32 nvc_build_pio_scatter_list(noir_cvm_virtual_cpu_p vcpu,noir_cvm_pio_scatter_entry_p list,u32 limit,u32p entries);
 
 // Exception Handlers in Assembly
 void noir_divide_error_fault_handler_a(void);
@@ -506,4 +552,10 @@ extern noir_mshv_msr_handler*	hvm_msr_handlers;
 #if defined(_mshv_msr)
 noir_hvdata u64v noir_mshv_guest_os_id=0;
 noir_hvdata u64v noir_mshv_hypercall_ctrl=0;
+noir_hvdata u64v noir_mshv_reference_tsc_ctrl=0;
+noir_hvdata u64 noir_mshv_tsc_scale=0;
+noir_hvdata u64 noir_mshv_tsc_offset=0;
+noir_hvdata u64 noir_mshv_reference_time_base=0;
+#elif defined(_mshv_cpuid)
+extern u64 noir_mshv_tsc_scale;
 #endif
\ No newline at end of file
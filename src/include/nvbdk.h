@@ -552,6 +552,7 @@ typedef void (*noir_broadcast_worker)(void* context,u32 processor_id);
 void noir_save_processor_state(noir_processor_state_p state);
 u16 noir_get_segment_attributes(ulong_ptr gdt_base,u16 selector);
 void noir_generic_call(noir_broadcast_worker worker,void* context);
+bool noir_kick_processor(u32 processor_number);
 void* noir_get_host_idt_base(u32 processor_number);
 u32 noir_get_processor_count();
 u32 noir_get_current_processor();
@@ -601,6 +602,9 @@ void* noir_alloc_contd_memory(size_t length);
 void* noir_alloc_nonpg_memory(size_t length);
 void* noir_alloc_paged_memory(size_t length);
 void* noir_alloc_2mb_page();
+void* noir_alloc_contd_memory_for_numa(u32 numa_node,size_t length);
+void* noir_alloc_nonpg_memory_for_numa(u32 numa_node,size_t length);
+u32 noir_get_processor_numa_node(u32 processor_number);
 void noir_free_contd_memory(void* virtual_address,size_t length);
 void noir_free_nonpg_memory(void* virtual_address);
 void noir_free_paged_memory(void* virtual_address);
@@ -611,6 +615,7 @@ u64 noir_get_current_process_cr3();
 void* noir_lock_pages(void* virt,size_t bytes,u64p phys);
 void noir_unlock_pages(void* locker);
 void noir_get_locked_range(void* locker,void** virt,u32p bytes);
+void* noir_map_locked_pages(void* locker);
 void* noir_map_physical_memory(u64 physical_address,size_t length);
 void noir_unmap_physical_memory(void* virtual_address,size_t length);
 void* noir_find_virt_by_phys(u64 physical_address);
@@ -638,6 +643,29 @@ void cdecl nvd_printf_raw(const char* format,...);
 
 void cdecl nvd_panicf(const char* format,...);
 
+// Event IDs of binary tracing. Formatting is deferred to the drainer or the host-side decoder.
+typedef enum _noir_trace_event
+{
+	noir_trace_event_none,
+	noir_trace_event_msr_read,			// Args: Index
+	noir_trace_event_msr_write,			// Args: Index, Value
+	noir_trace_event_msr_unknown,		// Args: Index, Write
+	noir_trace_event_gva_walk_failed,	// Args: GVA, Table GPA, #NPF Error
+	noir_trace_event_gva_denied,		// Args: GVA, Level, #PF Error
+	noir_trace_event_gpa_failed,		// Args: GPA, #NPF Error
+	noir_trace_event_hva_denied,		// Args: VA, Level, #PF Error
+	noir_trace_event_fetch_span,		// Args: Size, VA
+	noir_trace_event_maximum
+}noir_trace_event,*noir_trace_event_p;
+
+void nvd_trace_fn(u32 event_id,u64 arg0,u64 arg1,u64 arg2,u64 arg3);
+
+#define nvd_trace0(ev)					nvd_trace_fn(ev,0,0,0,0)
+#define nvd_trace1(ev,a0)				nvd_trace_fn(ev,(u64)(a0),0,0,0)
+#define nvd_trace2(ev,a0,a1)			nvd_trace_fn(ev,(u64)(a0),(u64)(a1),0,0)
+#define nvd_trace3(ev,a0,a1,a2)			nvd_trace_fn(ev,(u64)(a0),(u64)(a1),(u64)(a2),0)
+#define nvd_trace4(ev,a0,a1,a2,a3)		nvd_trace_fn(ev,(u64)(a0),(u64)(a1),(u64)(a2),(u64)(a3))
+
 void noir_hbreak(void);
 
 // Threading Facility
@@ -650,7 +678,9 @@ noir_thread noir_create_thread(noir_thread_procedure procedure,void* context);
 void noir_exit_thread(u32 status);
 bool noir_join_thread(noir_thread thread);
 bool noir_alert_thread(noir_thread thread);
+void noir_set_thread_affinity(u32 processor_number);
 void noir_sleep(u64 ms);
+u64 noir_query_tsc_frequency();
 noir_reslock noir_initialize_reslock();
 void noir_finalize_reslock(noir_reslock lock);
 void noir_acquire_reslock_shared(noir_reslock lock);
@@ -668,8 +698,8 @@ typedef u32 (stdcall *noir_crc32_page_func)(void* page);
 extern noir_crc32_page_func noir_crc32_page;
 
 void noir_aes128_expand_key(u8p key,bool expand_encrypt,u8p expanded_keys);
-void noir_aes128_encrypt_pages(void* page_base,u8p expanded_keys,u64 pages,u8p key);
-void noir_aes128_decrypt_pages(void* page_base,u8p expanded_keys,u64 pages,u8p key);
+void noir_aes128_encrypt_pages(void* page_base,u8p expanded_keys,u64 pages,u8p key,u64 tweak);
+void noir_aes128_decrypt_pages(void* page_base,u8p expanded_keys,u64 pages,u8p key,u64 tweak,u8p expanded_encryption_keys);
 
 // Miscellaneous
 typedef i32(cdecl *noir_sorting_comparator)(const void* a,const void*b);
@@ -252,6 +252,16 @@ typedef u32 noir_status;
 
 #define noir_acpi_no_such_table			0xC000000F
 
+/*
+  Status Indicator: noir_vcpu_already_running
+  If a vCPU is requested to run while another thread
+  is running it, then this value is supposed to be returned.
+
+  Value: 0xC0000010
+*/
+
+#define noir_vcpu_already_running		0xC0000010
+
 /*
   Status Indicator: noir_not_intel
   If a procedure is specific for Intel Processor,
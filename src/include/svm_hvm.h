@@ -95,6 +95,12 @@ typedef struct _noir_svm_hvm
 		u32 simultaneous;
 		u32 minimum_asid;
 	}sev_cap;
+	struct
+	{
+		u32 capabilities;
+		u16 invlpgb_count_max;
+		u16 reserved;
+	}ext_cap;
 	u32 hvm_cpuid_leaf_max;
 }noir_svm_hvm,*noir_svm_hvm_p;
 
@@ -207,9 +213,9 @@ typedef struct _noir_svm_vcpu
 
 struct _noir_svm_custom_vm;
 struct _noir_svm_secure_vm;
-struct _noir_npt_pdpte_descriptor;
-struct _noir_npt_pde_descriptor;
-struct _noir_npt_pte_descriptor;
+struct _noir_npt_cvm_pdpte_descriptor;
+struct _noir_npt_cvm_pde_descriptor;
+struct _noir_npt_cvm_pte_descriptor;
 
 typedef struct _noir_svm_custom_npt_manager
 {
@@ -218,21 +224,15 @@ typedef struct _noir_svm_custom_npt_manager
 		union _amd64_npt_pml4e *virt;	// There are only 512 possible PML4Es in principle.
 		u64 phys;
 	}ncr3;
+	// Root of the shadow radix tree. PDPTE descriptors are indexed by PML4E offset.
+	struct _noir_npt_cvm_pdpte_descriptor **pdpte;
+	// Number of paging structures allocated in each level.
 	struct
 	{
-		struct _noir_npt_pdpte_descriptor *head;
-		struct _noir_npt_pdpte_descriptor *tail;
-	}pdpte;
-	struct
-	{
-		struct _noir_npt_pde_descriptor *head;
-		struct _noir_npt_pde_descriptor *tail;
-	}pde;
-	struct
-	{
-		struct _noir_npt_pte_descriptor *head;
-		struct _noir_npt_pte_descriptor *tail;
-	}pte;
+		u32 pdpte;
+		u32 pde;
+		u32 pte;
+	}tables;
 }noir_svm_custom_npt_manager,*noir_svm_custom_npt_manager_p;
 
 // Some bits are host-owned. Therefore, Guest's bit must be saved accordingly.
@@ -245,7 +245,8 @@ typedef union _noir_svm_shadowed_bits
 		u64 tf:1;	// Shadowed bit for MTF
 		u64 btf:1;	// Shadowed bit for MTF
 		u64 sce:1;	// Shadowed bit for MTF
-		u64 reserved:59;
+		u64 ts:1;	// Shadowed bit for lazy extended-state switching
+		u64 reserved:58;
 	};
 	u64 value;
 }noir_svm_shadowed_bits,*noir_svm_shadowed_bits_p;
@@ -266,14 +267,19 @@ typedef struct _noir_svm_custom_vcpu
 			u64 prev_nmi:1;
 			u64 mtf_active:1;
 			u64 gif:1;
-			u64 reserved:57;
+			u64 fpu_owned:1;	// Extended state of guest is loaded.
+			u64 dr_owned:1;		// Debug registers of guest are loaded.
+			u64 reserved:56;
 			u64 switch_success:1;
 			u64 hv_mtf:1;		// Trap-Flag by NoirVisor.
-			u64 rescission:1;
 		};
 		u64 value;
 	}special_state;
 	u64 lasted_tsc;
+	// Cost of the last eager switch, for estimating cycles saved by lazy switching.
+	u64 fpu_switch_cost;
+	u64 dr_switch_cost;
+	u32 tlb_generation;	// The invalidation generation of the VM this vCPU last observed.
 	u32 proc_id;	// The physical processor id this vCPU was scheduled to
 	u32 vcpu_id;	// The virtual processor id of this vCPU
 }noir_svm_custom_vcpu,*noir_svm_custom_vcpu_p;
@@ -284,6 +290,16 @@ typedef struct _noir_svm_custom_vm
 	noir_svm_custom_vcpu_p* vcpu;
 	u32 vcpu_count;
 	u32 asid;
+	// Track which physical processors may cache translations of the ASID.
+	// An NPT update only requires a flush on processors that ran this VM.
+	struct
+	{
+		i32v* ran;		// Processors that ran this ASID since the last invalidation.
+		i32v* stale;	// Processors that must flush this ASID before the next entry.
+		i32v generation;
+		u32 words;
+	}tlb_tracker;
+	noir_rmt_ownership_index rmt_index;
 	memory_descriptor iopm;
 	memory_descriptor msrpm;
 	memory_descriptor msrpm_full;
@@ -351,6 +367,9 @@ void nvc_svm_dump_guest_fs_gs(noir_cvm_virtual_cpu_p vcpu,void* vmcb);
 void nvc_svm_set_guest_vcpu_options(noir_svm_custom_vcpu_p vcpu);
 void nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void nvc_svm_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu);
+void nvc_svm_acquire_guest_fpu(noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void nvc_svm_acquire_guest_debug_registers(noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void nvc_svm_release_gva_tlb(noir_svm_custom_vcpu_p cvcpu);
 void nvc_svm_inject_cvm_exception(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu,u8 vector,bool ev,u32 error_code,u64 pf_addr,u8 fetch_length,u8p fetched_instruction);
 bool nvc_svm_nsv_save_guest_vcpu(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 bool nvc_svm_nsv_load_guest_vcpu(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
@@ -364,6 +383,7 @@ void noir_hvcode nvc_svm_set_nested_gif(noir_svm_vcpu_p vcpu);
 bool nvc_svmc_get_physical_mapping(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64p hpa,bool r,bool w,bool x);
 void nvc_npt_reassign_page_ownership_hvrt(noir_svm_vcpu_p vcpu,noir_rmt_remap_context_p context);
 bool nvc_npt_reassign_page_ownership(u64p hpa,u64p gpa,u32 pages,u32 asid,bool shared,u8 ownership);
+bool nvc_npt_protect_reverse_mapping_table(u64 table_phys,u64 size);
 bool nvc_npt_reassign_cvm_all_pages_ownership(noir_svm_custom_vm_p vm,u32 asid,bool shared,u8 ownership);
 u8 nvc_npt_get_host_pat_index(u8 type);
 noir_status nvc_svmc_initialize_cvm_module();
@@ -32,6 +32,9 @@ u32 inline svm_msrpm_bit(u8 bitmap,u32 index,u8 operation)
 #define noir_svm_stgi		__svm_stgi
 #define noir_svm_clgi		__svm_clgi
 #define noir_svm_invlpga	__svm_invlpga
+// INVLPGB and TLBSYNC are not provided as MSVC intrinsics.
+void stdcall noir_svm_invlpgb(u64 rax,u32 edx,u32 ecx);
+void stdcall noir_svm_tlbsync();
 #elif defined(_llvm) || defined(_gcc)
 // I really don't know why clang is compiling these intrinsics into
 // instructions like "call __svm_invlpga", "call __svm_stgi", etc.
@@ -42,6 +45,8 @@ u32 inline svm_msrpm_bit(u8 bitmap,u32 index,u8 operation)
 #define noir_svm_stgi()			__asm__ __volatile__("stgi")
 #define noir_svm_clgi()			__asm__ __volatile__("clgi")
 #define noir_svm_invlpga(a,i)	__asm__	__volatile__("invlpga %%rax,%%ecx" : : "a"(a),"c"(i))
+#define noir_svm_invlpgb(a,d,c)	__asm__	__volatile__(".byte 0x0F,0x01,0xFE" : : "a"(a),"d"(d),"c"(c) : "memory")
+#define noir_svm_tlbsync()		__asm__	__volatile__(".byte 0x0F,0x01,0xFF" : : : "memory")
 #endif
 
 void stdcall noir_svm_vmmcall(u32 index,ulong_ptr context);
\ No newline at end of file
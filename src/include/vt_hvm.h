@@ -93,6 +93,7 @@ typedef struct _noir_vt_hvm
 	memory_descriptor io_bitmap_a;
 	memory_descriptor io_bitmap_b;
 	u32 hvm_cpuid_leaf_max;
+	u32 cvm_invept_type;	// Single-context if supported. Otherwise, all-context.
 }noir_vt_hvm,*noir_vt_hvm_p;
 
 typedef struct _noir_vt_msr_entry
@@ -192,15 +193,6 @@ typedef struct _noir_vt_custom_vcpu
 	struct _noir_vt_custom_vm *vm;
 	memory_descriptor vmcs;
 	memory_descriptor msr_auto;
-	union
-	{
-		struct
-		{
-			u64 reserved:63;
-			u64 rescission:1;
-		};
-		u64 value;
-	}special_state;
 	u64 lasted_tsc;
 	u32 proc_id;
 	u32 vcpu_id;
@@ -214,6 +206,14 @@ typedef struct _noir_vt_custom_vm
 	u32 vcpu_count;
 	u16 vpid;
 	struct _noir_vt_custom_ept_manager eptm;
+	// Track which physical processors may cache translations of the EPT.
+	// An EPT update only requires an invalidation on processors that ran this VM.
+	struct
+	{
+		i32v* ran;		// Processors that ran this VM since the last invalidation.
+		i32v* stale;	// Processors that must invalidate the EPT before the next entry.
+		u32 words;
+	}tlb_tracker;
 }noir_vt_custom_vm,*noir_vt_custom_vm_p;
 
 typedef struct _noir_vt_initial_stack
@@ -244,6 +244,8 @@ void nvc_vtc_finalize_cvm_module();
 void nvc_vt_initialize_cvm_vmcs(noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void nvc_vt_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void nvc_vt_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu);
+void nvc_vt_release_gva_tlb(noir_vt_custom_vcpu_p cvcpu);
+void nvc_vt_invalidate_stale_ept(noir_vt_custom_vcpu_p cvcpu,u32 proc_id);
 void nvc_vt_dump_vcpu_state(noir_vt_custom_vcpu_p vcpu);
 void nvc_vt_set_guest_vcpu_options(noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void nvc_vt_dump_vmcs_guest_state();
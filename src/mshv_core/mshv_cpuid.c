@@ -52,6 +52,12 @@ void static fastcall nvc_mshv_cpuid_fn40000003_handler(noir_cpuid_general_info_p
 	// Requirements of Minimal Hv#1 Interface
 	info->feat1.access_hypercall_msrs=true;
 	info->feat1.access_vp_index=true;
+	// Partition Reference Time is available only if TSC is invariant and its frequency is determined.
+	if(noir_mshv_tsc_scale)
+	{
+		info->feat1.access_partition_ref_counter=true;
+		info->feat1.access_partition_ref_tsc=true;
+	}
 	// Support of Non-Privileged Instruction Execution Prevention (NPIEP)
 	// info->feat3.npiep=true;
 }
@@ -65,6 +71,12 @@ void static fastcall nvc_mshv_cpuid_fn40000004_handler(noir_cpuid_general_info_p
 	// For Type-I hypervisor on AMD-V, it is efficient to virtualize APIC via Microsoft Synthetic MSRs.
 	if(hvm_p->selected_core==use_svm_core)info->recommendation1.msr_apic_access=true;
 #endif
+	// Remote TLB flushes can only be offloaded if the processor can broadcast invalidations.
+	if(hvm_p->selected_core==use_svm_core && nvc_svm_is_broadcast_tlb_flush_supported())
+	{
+		info->recommendation1.remote_tlb=true;
+		info->recommendation1.newer_exprocmask=true;
+	}
 }
 
 // Hypervisor Implementation Limits
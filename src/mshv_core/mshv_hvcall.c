@@ -0,0 +1,173 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file is the Hypercall Handler of MSHV Core.
+
+  This program is distributed in the hope that it will be useful, but 
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /mshv_core/mshv_hvcall.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include "mshv_def.h"
+#include "mshv_hvcall.h"
+
+// Flushing too many pages one by one is slower than flushing the whole address space.
+#define noir_mshv_flush_page_threshold		512
+
+bool static fastcall nvc_mshv_flush_guest_tlb(noir_mshv_vcpu_p vcpu,u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	if(gva_list)
+	{
+		u32 pages=0;
+		for(u32 i=0;i<count;i++)
+			pages+=noir_mshv_gva_range_additional_pages(gva_list[i])+1;
+		if(pages>noir_mshv_flush_page_threshold)gva_list=null,count=0;
+	}
+	if(hvm_p->selected_core==use_svm_core)
+		return nvc_svm_mshv_flush_guest_tlb(vcpu->root_vcpu,gva_list,count,remote,non_global);
+	else if(hvm_p->selected_core==use_vt_core)
+		return nvc_vt_mshv_flush_guest_tlb(vcpu->root_vcpu,gva_list,count,remote,non_global);
+	return false;
+}
+
+// Check if the processor set targets any processors other than the caller.
+// The return value indicates whether the processor set is valid.
+bool static fastcall nvc_mshv_check_processor_set(noir_mshv_vcpu_p vcpu,noir_mshv_vp_set_p vp_set,u32 bank_limit,bool *self,bool *remote)
+{
+	if(vp_set->format==hv_generic_set_all)
+	{
+		*self=true;
+		*remote=hvm_p->cpu_count>1;
+		return true;
+	}
+	else if(vp_set->format==hv_generic_set_sparse_4k)
+	{
+		u32 j=0;
+		*self=*remote=false;
+		for(u32 i=0;i<64;i++)
+		{
+			if(vp_set->valid_bank_mask & (1ull<<i))
+			{
+				u64 bank;
+				// Do not read the bank beyond the variable header.
+				if(j>=bank_limit)return false;
+				bank=vp_set->bank_contents[j++];
+				if(i==(vcpu->vp_index>>6))
+				{
+					if(bank & (1ull<<(vcpu->vp_index&63)))*self=true;
+					bank&=~(1ull<<(vcpu->vp_index&63));
+				}
+				if(bank)*remote=true;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+// Implements HvCallFlushVirtualAddressSpace(Ex) and HvCallFlushVirtualAddressList(Ex).
+u16 static fastcall nvc_mshv_hypercall_flush_virtual_address(noir_mshv_vcpu_p vcpu,noir_mshv_hypercall_input_p input,u64 input_gpa)
+{
+	const bool extended=input->call_code==hv_call_flush_virtual_address_space_ex || input->call_code==hv_call_flush_virtual_address_list_ex;
+	const bool list=input->call_code==hv_call_flush_virtual_address_list || input->call_code==hv_call_flush_virtual_address_list_ex;
+	u32 header_size=extended?sizeof(noir_mshv_flush_va_ex_input):sizeof(noir_mshv_flush_va_input);
+	u64 flags;
+	u64p gva_list=null;
+	u32 count=0;
+	bool self,remote;
+	// Fast hypercalls are not supported for flushes.
+	if(input->fast)return hv_status_invalid_hypercall_input;
+	// Only list flushes are rep hypercalls.
+	if(list!=(input->rep_count!=0) || input->rep_start>input->rep_count)return hv_status_invalid_hypercall_input;
+	if(extended)
+		header_size+=(u32)input->var_header_size<<3;
+	else if(input->var_header_size)
+		return hv_status_invalid_hypercall_input;
+	// Input parameters must be aligned and must not cross a page boundary.
+	if(input_gpa&7)return hv_status_invalid_alignment;
+	if(page_offset(input_gpa)+header_size+(input->rep_count<<3)>page_size)return hv_status_invalid_alignment;
+	if(extended)
+	{
+		noir_mshv_flush_va_ex_input_p param=(noir_mshv_flush_va_ex_input_p)noir_find_virt_by_phys(input_gpa);
+		// The input page may not be mapped in the host.
+		if(param==null)return hv_status_invalid_parameter;
+		flags=param->flags;
+		if(!nvc_mshv_check_processor_set(vcpu,&param->processor_set,(u32)input->var_header_size,&self,&remote))return hv_status_invalid_parameter;
+		gva_list=(u64p)((ulong_ptr)param+header_size);
+	}
+	else
+	{
+		noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)noir_find_virt_by_phys(input_gpa);
+		if(param==null)return hv_status_invalid_parameter;
+		flags=param->flags;
+		if(flags & hv_flush_all_processors)
+		{
+			self=true;
+			remote=hvm_p->cpu_count>1;
+		}
+		else
+		{
+			u64 mask=param->processor_mask;
+			self=vcpu->vp_index<64 && (mask & (1ull<<vcpu->vp_index));
+			if(vcpu->vp_index<64)mask&=~(1ull<<vcpu->vp_index);
+			remote=mask!=0;
+		}
+		gva_list=param->gva_list;
+	}
+	if(flags & ~hv_flush_valid_flags)return hv_status_invalid_parameter;
+	// Nothing to flush if no processors are targeted.
+	if(!self && !remote)return hv_status_success;
+	if(list)
+	{
+		gva_list+=input->rep_start;
+		count=(u32)(input->rep_count-input->rep_start);
+	}
+	else
+		gva_list=null;
+	// Address spaces are not tracked by the tagged TLB. Flush all of them.
+	if(nvc_mshv_flush_guest_tlb(vcpu,gva_list,count,remote,(flags & hv_flush_non_global_mappings_only)!=0))return hv_status_success;
+	return hv_status_operation_denied;
+}
+
+u64 fastcall nvc_mshv_hypercall_handler(noir_mshv_vcpu_p vcpu,u64 input,u64 input_gpa,u64 output_gpa)
+{
+	noir_mshv_hypercall_input hc_input;
+	noir_mshv_hypercall_result result;
+	// None of the implemented hypercalls have output parameters.
+	unref_var(output_gpa);
+	hc_input.value=input;
+	result.value=0;
+	if(hc_input.reserved1 || hc_input.reserved2 || hc_input.reserved3 || hc_input.nested)
+		result.status=hv_status_invalid_hypercall_input;
+	else
+	{
+		switch(hc_input.call_code)
+		{
+			case hv_call_flush_virtual_address_space:
+			case hv_call_flush_virtual_address_list:
+			case hv_call_flush_virtual_address_space_ex:
+			case hv_call_flush_virtual_address_list_ex:
+			{
+				result.status=nvc_mshv_hypercall_flush_virtual_address(vcpu,&hc_input,input_gpa);
+				break;
+			}
+			default:
+			{
+				result.status=hv_status_invalid_hypercall_code;
+				break;
+			}
+		}
+	}
+	// Rep hypercalls are always completed at once.
+	if(result.status==hv_status_success)result.reps_completed=hc_input.rep_count;
+	return result.value;
+}
@@ -0,0 +1,87 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file includes definitions of Hypercalls for MSHV-Core.
+
+  This program is distributed in the hope that it will be useful, but 
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /mshv_core/mshv_hvcall.h
+*/
+
+#include <nvdef.h>
+
+// Hypercall Codes
+#define hv_call_flush_virtual_address_space			0x0002
+#define hv_call_flush_virtual_address_list			0x0003
+#define hv_call_flush_virtual_address_space_ex		0x0013
+#define hv_call_flush_virtual_address_list_ex		0x0014
+
+// Flags for Flush Hypercalls
+#define hv_flush_all_processors					0x1
+#define hv_flush_all_virtual_address_spaces		0x2
+#define hv_flush_non_global_mappings_only		0x4
+#define hv_flush_use_extended_range_format		0x8
+#define hv_flush_valid_flags					0x7
+
+// Formats of Generic Processor Set
+#define hv_generic_set_sparse_4k	0
+#define hv_generic_set_all			1
+
+typedef union _noir_mshv_hypercall_input
+{
+	struct
+	{
+		u64 call_code:16;			// Bits	0-15
+		u64 fast:1;					// Bit	16
+		u64 var_header_size:10;		// Bits	17-26
+		u64 reserved1:4;			// Bits	27-30
+		u64 nested:1;				// Bit	31
+		u64 rep_count:12;			// Bits	32-43
+		u64 reserved2:4;			// Bits	44-47
+		u64 rep_start:12;			// Bits	48-59
+		u64 reserved3:4;			// Bits	60-63
+	};
+	u64 value;
+}noir_mshv_hypercall_input,*noir_mshv_hypercall_input_p;
+
+typedef union _noir_mshv_hypercall_result
+{
+	struct
+	{
+		u64 status:16;				// Bits	0-15
+		u64 reserved1:16;			// Bits	16-31
+		u64 reps_completed:12;		// Bits	32-43
+		u64 reserved2:20;			// Bits	44-63
+	};
+	u64 value;
+}noir_mshv_hypercall_result,*noir_mshv_hypercall_result_p;
+
+typedef struct _noir_mshv_flush_va_input
+{
+	u64 address_space;
+	u64 flags;
+	u64 processor_mask;
+	u64 gva_list[0];
+}noir_mshv_flush_va_input,*noir_mshv_flush_va_input_p;
+
+typedef struct _noir_mshv_vp_set
+{
+	u64 format;
+	u64 valid_bank_mask;
+	u64 bank_contents[0];
+}noir_mshv_vp_set,*noir_mshv_vp_set_p;
+
+// The bank contents of processor set are variable-sized header.
+typedef struct _noir_mshv_flush_va_ex_input
+{
+	u64 address_space;
+	u64 flags;
+	noir_mshv_vp_set processor_set;
+}noir_mshv_flush_va_ex_input,*noir_mshv_flush_va_ex_input_p;
+
+// Each GVA range in the flush list specifies additional pages in the low 12 bits.
+#define noir_mshv_gva_range_additional_pages(x)		((u32)page_offset(x))
@@ -20,10 +20,12 @@
 #include "mshv_msr.h"
 
 // Return value will be included in rax register.
-// Accessing eax will clear higher 32 bits in rax.
-u8 nvc_mshv_hypercall_code64[6]=
+// The signature in eax tells the hypervisor it is an Hv#1 hypercall.
+// The vmcall instruction is replaced with vmmcall on AMD-V.
+u8 nvc_mshv_hypercall_code64[9]=
 {
-	0xB8,0x02,0x00,0x00,0x00,	// mov eax,HV_STATUS_INVALID_HYPERCALL_CODE
+	0xB8,0x4E,0x76,0x48,0x63,	// mov eax,noir_mshv_hypercall_signature
+	0x0F,0x01,0xC1,				// vmcall
 	0xC3						// ret
 };
 
@@ -97,6 +99,7 @@ u64 static fastcall nvc_mshv_msr_r40000001_handler(noir_mshv_vcpu_p vcpu,bool wr
 				u64 pa=page_mult(msr.hypercall_gpfn);
 				void* va=noir_find_virt_by_phys(pa);
 				noir_movsb(va,nvc_mshv_hypercall_code64,sizeof(nvc_mshv_hypercall_code64));
+				if(hvm_p->selected_core==use_svm_core)*(u8p)((ulong_ptr)va+7)=0xD9;
 				noir_stosb((void*)((ulong_ptr)va+sizeof(nvc_mshv_hypercall_code64)),0,page_size-sizeof(nvc_mshv_hypercall_code64));
 			}
 		}
@@ -109,6 +112,107 @@ u64 static fastcall nvc_mshv_msr_r40000002_handler(noir_mshv_vcpu_p vcpu,bool wr
 	return vcpu->vp_index;
 }
 
+// Upper 64 bits of the 128-bit product. Portable to 32-bit builds.
+u64 static nvc_mshv_mulh64(u64 a,u64 b)
+{
+	const u64 al=(u32)a,ah=a>>32,bl=(u32)b,bh=b>>32;
+	const u64 ll=al*bl,lh=al*bh,hl=ah*bl,hh=ah*bh;
+	const u64 mid=(ll>>32)+(u32)lh+(u32)hl;
+	return hh+(lh>>32)+(hl>>32)+(mid>>32);
+}
+
+u64 static fastcall nvc_mshv_msr_r40000020_handler(noir_mshv_vcpu_p vcpu,bool write,u64 val)
+{
+	// The Partition Reference Counter is read-only.
+	if(noir_mshv_tsc_scale)return nvc_mshv_mulh64(noir_rdtsc(),noir_mshv_tsc_scale)+noir_mshv_tsc_offset;
+	return 0;
+}
+
+// Refill the Reference TSC Page, if enabled, with the current scale-offset pair.
+void static nvc_mshv_update_reference_tsc_page()
+{
+	noir_mshv_msr_reference_tsc msr;
+	msr.value=noir_mshv_reference_tsc_ctrl;
+	if(msr.enable)
+	{
+		// Like the hypercall page, fill the guest-specified page directly.
+		noir_mshv_reference_tsc_page_p ref_page=(noir_mshv_reference_tsc_page_p)noir_find_virt_by_phys(page_mult(msr.tsc_gpfn));
+		if(ref_page)
+		{
+			// Guests retry if the sequence differs before and after reading the scale-offset pair.
+			// Therefore, the sequence must advance on every update, skipping the invalid value.
+			u32 seq=ref_page->tsc_sequence+1;
+			if(seq==noir_mshv_reference_tsc_invalid_sequence)seq++;
+			// Invalidate the page while updating, so that guests would not see a torn scale-offset pair.
+			ref_page->tsc_sequence=noir_mshv_reference_tsc_invalid_sequence;
+			noir_store_fence();
+			ref_page->tsc_scale=noir_mshv_tsc_scale;
+			ref_page->tsc_offset=(i64)noir_mshv_tsc_offset;
+			noir_store_fence();
+			ref_page->tsc_sequence=seq;
+		}
+	}
+}
+
+u64 static fastcall nvc_mshv_msr_r40000021_handler(noir_mshv_vcpu_p vcpu,bool write,u64 val)
+{
+	if(write && noir_mshv_tsc_scale)
+	{
+		noir_locked_xchg64(&noir_mshv_reference_tsc_ctrl,val);
+		nvc_mshv_update_reference_tsc_page();
+	}
+	return noir_mshv_reference_tsc_ctrl;
+}
+
+// Scale=(10^7<<64)/Frequency. The quotient fits in 64 bits because frequency exceeds 10MHz.
+u64 nvc_mshv_compute_tsc_scale(u64 freq)
+{
+	u64 rem=noir_mshv_reference_time_frequency,scale=0;
+	for(u32 i=0;i<64;i++)
+	{
+		const bool carry=(rem>>63)!=0;
+		rem<<=1;
+		scale<<=1;
+		if(carry || rem>=freq)
+		{
+			rem-=freq;
+			scale|=1;
+		}
+	}
+	return scale;
+}
+
+void fastcall nvc_mshv_initialize_reference_time()
+{
+	u32 d;
+	u64 freq,scale;
+	noir_cpuid(noir_mshv_cpuid_ext_powermgr_ras,0,null,null,null,&d);
+	if(!noir_bt(&d,noir_mshv_cpuid_invariant_tsc))
+	{
+		nv_dprintf("TSC is not invariant! Partition Reference Time is unavailable!\n");
+		return;
+	}
+	freq=noir_query_tsc_frequency();
+	if(freq<=noir_mshv_reference_time_frequency)
+	{
+		nv_dprintf("Failed to determine TSC frequency! Partition Reference Time is unavailable!\n");
+		return;
+	}
+	scale=nvc_mshv_compute_tsc_scale(freq);
+	// Partition Reference Time starts from zero when NoirVisor is loaded for the first time.
+	// When NoirVisor is restarted (e.g.: resuming from sleep), the TSC may have been reset.
+	// Continue from the time saved at teardown so that Reference Time never goes backwards.
+	noir_mshv_tsc_offset=noir_mshv_reference_time_base-nvc_mshv_mulh64(noir_rdtsc(),scale);
+	noir_mshv_tsc_scale=scale;
+	nvc_mshv_update_reference_tsc_page();
+	nv_dprintf("TSC Frequency: %llu Hz, Reference TSC Scale: 0x%016llX\n",freq,scale);
+}
+
+void fastcall nvc_mshv_finalize_reference_time()
+{
+	if(noir_mshv_tsc_scale)noir_mshv_reference_time_base=nvc_mshv_msr_r40000020_handler(null,false,0);
+}
+
 u64 static fastcall nvc_mshv_msr_r40000040_handler(noir_mshv_vcpu_p vcpu,bool write,u64 val)
 {
 	if(write)
@@ -122,7 +226,9 @@ u64 static fastcall nvc_mshv_msr_r40000040_handler(noir_mshv_vcpu_p vcpu,bool wr
 
 u64 fastcall nvc_mshv_rdmsr_handler(noir_mshv_vcpu_p vcpu,u32 index)
 {
-	nvd_printf("Intercepted Microsoft Synthetic MSR-Read! Index=0x%X\n",index);
+	// Time MSRs are frequently accessed. Logging them would flood the debug output.
+	if(index!=hv_x64_msr_time_ref_count && index!=hv_x64_msr_reference_tsc)
+		nvd_printf("Intercepted Microsoft Synthetic MSR-Read! Index=0x%X\n",index);
 	switch(index)
 	{
 		case hv_x64_msr_guest_os_id:
@@ -131,6 +237,10 @@ u64 fastcall nvc_mshv_rdmsr_handler(noir_mshv_vcpu_p vcpu,u32 index)
 			return nvc_mshv_msr_r40000001_handler(vcpu,false,0);
 		case hv_x64_msr_vp_index:
 			return nvc_mshv_msr_r40000002_handler(vcpu,false,0);
+		case hv_x64_msr_time_ref_count:
+			return nvc_mshv_msr_r40000020_handler(vcpu,false,0);
+		case hv_x64_msr_reference_tsc:
+			return nvc_mshv_msr_r40000021_handler(vcpu,false,0);
 		case hv_x64_msr_npiep_config:
 			return nvc_mshv_msr_r40000040_handler(vcpu,false,0);
 	}
@@ -139,7 +249,8 @@ u64 fastcall nvc_mshv_rdmsr_handler(noir_mshv_vcpu_p vcpu,u32 index)
 
 void fastcall nvc_mshv_wrmsr_handler(noir_mshv_vcpu_p vcpu,u32 index,u64 val)
 {
-	nvd_printf("Intercepted Microsoft Synthetic MSR-Write! Index=0x%X, Value=0x%016llX\n",index,val);
+	if(index!=hv_x64_msr_time_ref_count && index!=hv_x64_msr_reference_tsc)
+		nvd_printf("Intercepted Microsoft Synthetic MSR-Write! Index=0x%X, Value=0x%016llX\n",index,val);
 	switch(index)
 	{
 		case hv_x64_msr_guest_os_id:
@@ -151,6 +262,9 @@ void fastcall nvc_mshv_wrmsr_handler(noir_mshv_vcpu_p vcpu,u32 index,u64 val)
 		case hv_x64_msr_vp_index:
 			nvc_mshv_msr_r40000002_handler(vcpu,true,val);
 			break;
+		case hv_x64_msr_reference_tsc:
+			nvc_mshv_msr_r40000021_handler(vcpu,true,val);
+			break;
 		case hv_x64_msr_npiep_config:
 			nvc_mshv_msr_r40000040_handler(vcpu,true,val);
 			break;
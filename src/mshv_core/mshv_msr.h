@@ -80,6 +80,34 @@ typedef union _noir_mshv_msr_hypercall
 	u64 value;
 }noir_mshv_msr_hypercall,*noir_mshv_msr_hypercall_p;
 
+typedef union _noir_mshv_msr_reference_tsc
+{
+	struct
+	{
+		u64 enable:1;			// Bit	0
+		u64 reserved:11;		// Bits	1-11
+		u64 tsc_gpfn:52;		// Bits	12-63
+	};
+	u64 value;
+}noir_mshv_msr_reference_tsc,*noir_mshv_msr_reference_tsc_p;
+
+// Reference Time = ((TSC * Scale) >> 64) + Offset, in 100ns units.
+typedef struct _noir_mshv_reference_tsc_page
+{
+	u32v tsc_sequence;
+	u32 reserved1;
+	u64 tsc_scale;
+	i64 tsc_offset;
+	u64 reserved2[509];
+}noir_mshv_reference_tsc_page,*noir_mshv_reference_tsc_page_p;
+
+// Sequence value of zero instructs the guest to use the Reference Counter MSR instead.
+#define noir_mshv_reference_tsc_invalid_sequence	0
+#define noir_mshv_reference_time_frequency			10000000
+
+#define noir_mshv_cpuid_ext_powermgr_ras	0x80000007
+#define noir_mshv_cpuid_invariant_tsc		8
+
 typedef u32 hv_vp_index;
 #define hv_any_vp			((hv_vp_index)-1)
 #define hv_vp_index_self	((hv_vp_index)-2)
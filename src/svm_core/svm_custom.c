@@ -23,6 +23,116 @@
 #include "svm_def.h"
 #include "svm_npt.h"
 
+// Lazy switching of Extended State and Debug Registers.
+// Extended state of the guest is loaded only if the guest executes x87/SSE/AVX instructions.
+// Until then, CR0.TS is set on behalf of the guest so that these instructions would trigger #NM.
+// Accesses to CR0 are intercepted as well so that the guest could neither observe nor clear the TS bit.
+// The xsetbv instruction is intercepted so that the guest could not change XCR0 while the host's extended state is loaded.
+// Debug registers of the guest are loaded only if the guest accesses them or enables breakpoints in DR7.
+void static noir_hvcode nvc_svm_arm_lazy_fpu(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	cvcpu->special_state.fpu_owned=false;
+	cvcpu->shadowed_bits.ts=noir_svm_vmcb_bts32(vmcb,guest_cr0,amd64_cr0_ts);
+	noir_svm_vmcb_bts32(vmcb,intercept_exceptions,amd64_no_math_coprocessor);
+	noir_svm_vmcb_bts32(vmcb,intercept_access_cr,nvc_svm_lazy_cr0_read_intercept);
+	noir_svm_vmcb_bts32(vmcb,intercept_access_cr,nvc_svm_lazy_cr0_write_intercept);
+	noir_svm_vmcb_bts32(vmcb,intercept_instruction2,nvc_svm_lazy_xsetbv_intercept);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_control_reg);
+}
+
+void static noir_hvcode nvc_svm_disarm_lazy_fpu(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	// Restore the TS bit of the guest.
+	if(!cvcpu->shadowed_bits.ts)noir_svm_vmcb_btr32(vmcb,guest_cr0,amd64_cr0_ts);
+	// Keep #NM intercepted if the subverted host specifies so.
+	if(!cvcpu->header.vcpu_options.intercept_exceptions || !noir_bt(&cvcpu->header.exception_bitmap,amd64_no_math_coprocessor))
+		noir_svm_vmcb_btr32(vmcb,intercept_exceptions,amd64_no_math_coprocessor);
+	noir_svm_vmcb_btr32(vmcb,intercept_access_cr,nvc_svm_lazy_cr0_read_intercept);
+	noir_svm_vmcb_btr32(vmcb,intercept_access_cr,nvc_svm_lazy_cr0_write_intercept);
+	noir_svm_vmcb_btr32(vmcb,intercept_instruction2,nvc_svm_lazy_xsetbv_intercept);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_control_reg);
+}
+
+void static noir_hvcode nvc_svm_arm_lazy_dr(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	cvcpu->special_state.dr_owned=false;
+	noir_svm_vmwrite32(vmcb,intercept_access_dr,noir_svm_vmread32(vmcb,intercept_access_dr)|nvc_svm_lazy_dr_intercepts);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+}
+
+void static noir_hvcode nvc_svm_disarm_lazy_dr(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	noir_svm_vmwrite32(vmcb,intercept_access_dr,cvcpu->header.vcpu_options.intercept_drx?0xFFFFFFFF:0);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+}
+
+// Software TLB of guest-virtual translations.
+// While the software TLB holds translations, writes to CR3 and invalidations of TLB by the guest are intercepted.
+// The first interception discards the software TLB, disarms the interceptions and re-executes the instruction.
+// INVLPGB is not enabled for CVMs, so it raises #UD without interception. It is still intercepted while armed
+// so that a broadcast invalidation discards the software TLBs of all vCPUs before the #UD is delivered.
+void static noir_hvcode nvc_svm_arm_gva_tlb(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	cvcpu->header.gva_tlb_armed=true;
+	noir_svm_vmcb_bts32(vmcb,intercept_access_cr,nvc_svm_gva_tlb_cr3_write_intercept);
+	noir_svm_vmcb_bts32(vmcb,intercept_instruction1,nvc_svm_intercept_vector1_invlpg);
+	noir_svm_vmcb_bts32(vmcb,intercept_instruction3,nvc_svm_gva_tlb_invpcid_intercept);
+	noir_svm_vmcb_bts32(vmcb,intercept_instruction3,nvc_svm_gva_tlb_invlpgb_intercept);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+}
+
+// This function is called when the guest is about to invalidate its TLB.
+void noir_hvcode nvc_svm_release_gva_tlb(noir_svm_custom_vcpu_p cvcpu)
+{
+	void* vmcb=cvcpu->vmcb.virt;
+	cvcpu->header.state_cache.gt_valid=false;
+	cvcpu->header.gva_tlb_filled=0;
+	cvcpu->header.gva_tlb_armed=false;
+	// Keep writes to CR3 intercepted if the subverted host specifies so.
+	if(!cvcpu->header.vcpu_options.intercept_cr3)
+		noir_svm_vmcb_btr32(vmcb,intercept_access_cr,nvc_svm_gva_tlb_cr3_write_intercept);
+	noir_svm_vmcb_btr32(vmcb,intercept_instruction1,nvc_svm_intercept_vector1_invlpg);
+	noir_svm_vmcb_btr32(vmcb,intercept_instruction3,nvc_svm_gva_tlb_invpcid_intercept);
+	noir_svm_vmcb_btr32(vmcb,intercept_instruction3,nvc_svm_gva_tlb_invlpgb_intercept);
+	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
+}
+
+// This function is called when the guest is about to use its extended state.
+// XCR0 of the host and the guest are identical if lazy switching is armed, because xsetbv is intercepted until then.
+void noir_hvcode nvc_svm_acquire_guest_fpu(noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// Save x87 FPU and SSE/AVX State of the host...
+	noir_xsave(vcpu->cvm_state.xsave_area,maxu64);
+	// Load x87 FPU and SSE/AVX State of the guest...
+	noir_xrestore(cvcpu->header.xsave_area,maxu64);
+	cvcpu->special_state.fpu_owned=true;
+	nvc_svm_disarm_lazy_fpu(cvcpu);
+}
+
+// This function is called when the guest is about to use its debug registers.
+void noir_hvcode nvc_svm_acquire_guest_debug_registers(noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// Save Debug Registers of the host...
+	vcpu->cvm_state.drs.dr0=noir_readdr0();
+	vcpu->cvm_state.drs.dr1=noir_readdr1();
+	vcpu->cvm_state.drs.dr2=noir_readdr2();
+	vcpu->cvm_state.drs.dr3=noir_readdr3();
+	// Load Debug Registers of the guest...
+	noir_writedr0(cvcpu->header.drs.dr0);
+	noir_writedr1(cvcpu->header.drs.dr1);
+	noir_writedr2(cvcpu->header.drs.dr2);
+	noir_writedr3(cvcpu->header.drs.dr3);
+	cvcpu->special_state.dr_owned=true;
+	nvc_svm_disarm_lazy_dr(cvcpu);
+}
+
 void noir_hvcode nvc_svm_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu)
 {
 	noir_svm_initial_stack_p loader_stack=noir_svm_get_loader_stack(vcpu->hv_stack);
@@ -44,11 +154,14 @@ void noir_hvcode nvc_svm_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_svm
 		cvcpu->header.rflags=noir_svm_vmread64(cvcpu->vmcb.virt,guest_rflags);
 		// Save Extended Control Registers...
 		cvcpu->header.xcrs.xcr0=noir_xgetbv(0);
-		// Save Debug Registers...
-		cvcpu->header.drs.dr0=noir_readdr0();
-		cvcpu->header.drs.dr1=noir_readdr1();
-		cvcpu->header.drs.dr2=noir_readdr2();
-		cvcpu->header.drs.dr3=noir_readdr3();
+		// Save Debug Registers if they are owned by the guest...
+		if(cvcpu->special_state.dr_owned)
+		{
+			cvcpu->header.drs.dr0=noir_readdr0();
+			cvcpu->header.drs.dr1=noir_readdr1();
+			cvcpu->header.drs.dr2=noir_readdr2();
+			cvcpu->header.drs.dr3=noir_readdr3();
+		}
 		cvcpu->special_state.switch_success=true;
 	}
 	// Save the event injection field...
@@ -77,16 +190,43 @@ void noir_hvcode nvc_svm_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_svm
 	noir_movsp(gpr_state,&vcpu->cvm_state.gpr,sizeof(void*)*2);
 	// Load Extended Control Registers...
 	noir_xsetbv(0,vcpu->cvm_state.xcrs.xcr0);
-	// Save x87 FPU and SSE/AVX State...
-	noir_xsave(cvcpu->header.xsave_area,maxu64);
-	// Load x87 FPU and SSE/AVX State...
-	noir_xrestore(vcpu->cvm_state.xsave_area,maxu64);
-	// Load Debug Registers...
-	noir_writedr0(vcpu->cvm_state.drs.dr0);
-	noir_writedr1(vcpu->cvm_state.drs.dr1);
-	noir_writedr2(vcpu->cvm_state.drs.dr2);
-	noir_writedr3(vcpu->cvm_state.drs.dr3);
+	if(cvcpu->special_state.fpu_owned)
+	{
+		u64 t=noir_rdtsc();
+		// Save x87 FPU and SSE/AVX State...
+		noir_xsave(cvcpu->header.xsave_area,maxu64);
+		// Load x87 FPU and SSE/AVX State...
+		noir_xrestore(vcpu->cvm_state.xsave_area,maxu64);
+		// The same cost is paid on the way to the guest.
+		cvcpu->fpu_switch_cost=(noir_rdtsc()-t)<<1;
+	}
+	else
+	{
+		// The guest did not use its extended state. The host's extended state is still loaded.
+		nvc_svm_disarm_lazy_fpu(cvcpu);
+		cvcpu->header.statistics.lazy_switch.fpu_avoided++;
+		cvcpu->header.statistics.lazy_switch.cycles_saved+=cvcpu->fpu_switch_cost;
+	}
+	if(cvcpu->special_state.dr_owned)
+	{
+		u64 t=noir_rdtsc();
+		// Load Debug Registers...
+		noir_writedr0(vcpu->cvm_state.drs.dr0);
+		noir_writedr1(vcpu->cvm_state.drs.dr1);
+		noir_writedr2(vcpu->cvm_state.drs.dr2);
+		noir_writedr3(vcpu->cvm_state.drs.dr3);
+		cvcpu->dr_switch_cost=(noir_rdtsc()-t)<<1;
+		cvcpu->special_state.dr_owned=false;
+	}
+	else
+	{
+		// The guest did not use its debug registers. The host's debug registers are still loaded.
+		nvc_svm_disarm_lazy_dr(cvcpu);
+		cvcpu->header.statistics.lazy_switch.dr_avoided++;
+		cvcpu->header.statistics.lazy_switch.cycles_saved+=cvcpu->dr_switch_cost;
+	}
 	// Step 3: Switch vCPU to Host.
+	noir_locked_btr(&cvcpu->header.run_state,noir_cvm_vcpu_in_guest);
 	loader_stack->custom_vcpu=&nvc_svm_idle_cvcpu;		// Indicate that CVM is not running.
 	loader_stack->guest_vmcb_pa=vcpu->vmcb.phys;
 	// The context will go to the host when vmrun is executed.
@@ -108,22 +248,28 @@ void noir_hvcode nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_sv
 	noir_movsp(&vcpu->cvm_state.gpr,gpr_state,sizeof(void*)*2);
 	// Save Extended Control Registers...
 	vcpu->cvm_state.xcrs.xcr0=noir_xgetbv(0);
-	// Save x87 FPU and SSE State...
-	noir_xsave(vcpu->cvm_state.xsave_area,maxu64);
-	// Save Debug Registers...
-	vcpu->cvm_state.drs.dr0=noir_readdr0();
-	vcpu->cvm_state.drs.dr1=noir_readdr1();
-	vcpu->cvm_state.drs.dr2=noir_readdr2();
-	vcpu->cvm_state.drs.dr3=noir_readdr3();
 	// Step 2: Load Guest State.
 	if(cvcpu->vm->header.properties.nsv_guest)
 	{
+		// NSV-Guests do not support lazy switching.
+		// Save x87 FPU and SSE State...
+		noir_xsave(vcpu->cvm_state.xsave_area,maxu64);
+		// Save Debug Registers...
+		vcpu->cvm_state.drs.dr0=noir_readdr0();
+		vcpu->cvm_state.drs.dr1=noir_readdr1();
+		vcpu->cvm_state.drs.dr2=noir_readdr2();
+		vcpu->cvm_state.drs.dr3=noir_readdr3();
+		cvcpu->special_state.fpu_owned=true;
+		cvcpu->special_state.dr_owned=true;
 		// For NSV-Guests, do not load from vCPU structure.
 		// Instead, load from its protected page.
 		cvcpu->special_state.switch_success=nvc_svm_nsv_load_guest_vcpu(gpr_state,vcpu,cvcpu);
 	}
 	else
 	{
+		// Extended state can be switched lazily only if the guest and the host share the same XCR0.
+		// PKRU is managed by XCR0 but is not guarded by CR0.TS. The guest would run with the host's PKRU.
+		const bool lazy_fpu=cvcpu->header.xcrs.xcr0==vcpu->cvm_state.xcrs.xcr0 && !(cvcpu->header.xcrs.xcr0&amd64_xcr0_pkru_bit);
 		// Load General-Purpose Registers...
 		noir_movsp(gpr_state,&cvcpu->header.gpr,sizeof(void*)*2);
 		if(!cvcpu->header.state_cache.gprvalid)
@@ -134,15 +280,16 @@ void noir_hvcode nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_sv
 			noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_rflags,cvcpu->header.rflags);
 			cvcpu->header.state_cache.gprvalid=true;
 		}
-		// Load x87 FPU and SSE State...
-		noir_xrestore(cvcpu->header.xsave_area,maxu64);
+		if(!lazy_fpu)
+		{
+			// Save x87 FPU and SSE State...
+			noir_xsave(vcpu->cvm_state.xsave_area,maxu64);
+			// Load x87 FPU and SSE State...
+			noir_xrestore(cvcpu->header.xsave_area,maxu64);
+			cvcpu->special_state.fpu_owned=true;
+		}
 		// Load Extended Control Registers...
 		noir_xsetbv(0,cvcpu->header.xcrs.xcr0);
-		// Load Debug Registers...
-		noir_writedr0(cvcpu->header.drs.dr0);
-		noir_writedr1(cvcpu->header.drs.dr1);
-		noir_writedr2(cvcpu->header.drs.dr2);
-		noir_writedr3(cvcpu->header.drs.dr3);
 		if(!cvcpu->header.state_cache.dr_valid)
 		{
 			noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_dr6,cvcpu->header.drs.dr6);
@@ -150,6 +297,11 @@ void noir_hvcode nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_sv
 			noir_svm_vmcb_btr32(cvcpu->vmcb.virt,vmcb_clean_bits,noir_svm_clean_debug_reg);
 			cvcpu->header.state_cache.dr_valid=true;
 		}
+		// Load Debug Registers if breakpoints are enabled...
+		if(noir_svm_vmread64(cvcpu->vmcb.virt,guest_dr7)&0xff)
+			nvc_svm_acquire_guest_debug_registers(vcpu,cvcpu);
+		else
+			nvc_svm_arm_lazy_dr(cvcpu);
 		// Load Control Registers...
 		if(!cvcpu->header.state_cache.cr_valid)
 		{
@@ -161,6 +313,10 @@ void noir_hvcode nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_sv
 			// Changes made to control registers can cause TLBs to be invalid.
 			noir_svm_vmwrite8(cvcpu->vmcb.virt,tlb_control,nvc_svm_tlb_control_flush_guest);
 		}
+		// Arm lazy switching after CR0 is loaded so that the guest's TS bit could be shadowed.
+		if(lazy_fpu)nvc_svm_arm_lazy_fpu(cvcpu);
+		// Intercept TLB maintenance of the guest if the software TLB holds translations.
+		if(cvcpu->header.gva_tlb_filled && !cvcpu->header.gva_tlb_armed)nvc_svm_arm_gva_tlb(cvcpu);
 		if(!cvcpu->header.state_cache.cr2valid)
 		{
 			noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_cr2,cvcpu->header.crs.cr2);
@@ -332,12 +488,18 @@ void noir_hvcode nvc_svm_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_sv
 		// Note that the AVIC Control field is cached. Invalidate it.
 		noir_svm_vmcb_btr32(cvcpu->vmcb.virt,vmcb_clean_bits,noir_svm_clean_tpr);
 	}
-	// Flush TLB if the NPT is updated.
-	if(!cvcpu->header.state_cache.tl_valid)
+	// Flush TLB if the NPT is updated and this processor may have cached translations of the ASID.
+	// Processors that never ran this VM since the last invalidation do not need to flush.
+	if(!noir_bt(cvcpu->vm->tlb_tracker.ran,loader_stack->proc_id))
+		noir_locked_bts(cvcpu->vm->tlb_tracker.ran,loader_stack->proc_id);
+	if(noir_locked_btr(cvcpu->vm->tlb_tracker.stale,loader_stack->proc_id))
 	{
 		noir_svm_vmwrite8(cvcpu->vmcb.virt,tlb_control,nvc_svm_tlb_control_flush_guest);
-		cvcpu->header.state_cache.tl_valid=true;
+		cvcpu->header.statistics.tlb_flush.issued++;
 	}
+	else if(cvcpu->tlb_generation!=(u32)cvcpu->vm->tlb_tracker.generation)
+		cvcpu->header.statistics.tlb_flush.avoided++;
+	cvcpu->tlb_generation=(u32)cvcpu->vm->tlb_tracker.generation;
 	// If AVIC is supported, set the Physical APIC ID Entry to be running.
 	if(noir_bt(&hvm_p->relative_hvm->virt_cap.capabilities,amd64_cpuid_avic))
 	{
@@ -545,9 +707,12 @@ void noir_hvcode nvc_svm_initialize_cvm_vmcb(noir_svm_custom_vcpu_p vcpu)
 	// Initialize IOPM/MSRPM
 	noir_svm_vmwrite64(vmcb,iopm_physical_address,vcpu->vm->iopm.phys);
 	noir_svm_vmwrite64(vmcb,msrpm_physical_address,vcpu->vm->msrpm.phys);
-	// Set the NSV structure.
-	nsvcpu->parent.vcpu=&vcpu->header;
-	nsvcpu->parent.vmcb=vcpu->vmcb;
+	// Set the NSV structure. It is allocated only if NSV is enabled.
+	if(nsvcpu)
+	{
+		nsvcpu->parent.vcpu=&vcpu->header;
+		nsvcpu->parent.vmcb=vcpu->vmcb;
+	}
 }
 
 void noir_hvcode nvc_svm_set_guest_vcpu_options(noir_svm_custom_vcpu_p vcpu)
@@ -592,42 +757,82 @@ void noir_hvcode nvc_svm_set_guest_vcpu_options(noir_svm_custom_vcpu_p vcpu)
 		vcpu->shadowed_bits.tf=noir_svm_vmcb_bts32(vmcb,guest_rflags,amd64_rflags_tf);
 		noir_svm_vmcb_bts32(vmcb,intercept_exceptions,amd64_debug_exception);
 	}
+	// Interceptions for the software TLB are rewritten by the options above.
+	if(vcpu->header.gva_tlb_armed)nvc_svm_arm_gva_tlb(vcpu);
 	// Invalidate VMCB Cache.
 	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_interception);
 	noir_svm_vmcb_btr32(vmcb,vmcb_clean_bits,noir_svm_clean_iomsrpm);
 }
 
 #if !defined(_hv_type1)
+// The caller must be running the vCPU.
 void nvc_svmc_gain_exclusion(noir_svm_custom_vcpu_p vcpu)
 {
-	noir_svm_custom_vm_p vm=vcpu->vm;
-	noir_acquire_reslock_exclusive(vm->header.vcpu_list_lock);
-	for(u32 i=0;i<256;i++)
-		if(vm->vcpu[i]!=null && vm->vcpu[i]!=vcpu)
-			noir_acquire_pushlock_exclusive(&vm->vcpu[i]->header.vcpu_lock);
+	nvc_park_vcpu_run(&vcpu->header);
+	noir_acquire_reslock_shared(vcpu->vm->header.vcpu_list_lock);
+	nvc_acquire_vm_exclusion(&vcpu->vm->header);
 }
 
 void nvc_svmc_free_exclusion(noir_svm_custom_vcpu_p vcpu)
 {
-	noir_svm_custom_vm_p vm=vcpu->vm;
+	nvc_release_vm_exclusion(&vcpu->vm->header);
+	noir_release_reslock(vcpu->vm->header.vcpu_list_lock);
+	nvc_unpark_vcpu_run(&vcpu->header);
+}
+
+bool nvc_svmc_set_msr_passthrough(noir_svm_custom_vm_p vm,u32 first,u32 last,bool passthrough)
+{
+	// The caller must have locked all vCPUs. Only the read permission is updated.
+	u8 bitmap=0;
+	if(last<0x2000)
+		bitmap=1;
+	else if(first>=0xC0000000 && last<0xC0002000)
+		bitmap=2;
+	else if(first>=0xC0010000 && last<0xC0012000)
+		bitmap=3;
+	else
+		return false;
+	// Both permission maps are updated. Otherwise, reads would still be intercepted with the full map,
+	// and the Quick-Path would have to read an MSR that the host may not implement.
+	void* msrpm=(void*)((ulong_ptr)vm->msrpm.virt+(bitmap-1)*0x800);
+	void* msrpm_full=(void*)((ulong_ptr)vm->msrpm_full.virt+(bitmap-1)*0x800);
+	for(u32 i=first;i<=last;i++)
+	{
+		if(passthrough)
+		{
+			noir_reset_bitmap(msrpm,svm_msrpm_bit(bitmap,i,0));
+			noir_reset_bitmap(msrpm_full,svm_msrpm_bit(bitmap,i,0));
+		}
+		else
+		{
+			noir_set_bitmap(msrpm,svm_msrpm_bit(bitmap,i,0));
+			noir_set_bitmap(msrpm_full,svm_msrpm_bit(bitmap,i,0));
+		}
+	}
+	// Let the processor reload the permission map on next VMRUN.
 	for(u32 i=0;i<256;i++)
-		if(vm->vcpu[i]!=null && vm->vcpu[i]!=vcpu)
-			noir_release_pushlock_exclusive(&vm->vcpu[i]->header.vcpu_lock);
-	noir_release_reslock(vm->header.vcpu_list_lock);
+		if(vm->vcpu[i])
+			noir_svm_vmcb_btr32(vm->vcpu[i]->vmcb.virt,vmcb_clean_bits,noir_svm_clean_iomsrpm);
+	return true;
 }
 
 noir_status nvc_svmc_run_vcpu(noir_svm_custom_vcpu_p vcpu)
 {
 	noir_status st=noir_success;
-	noir_acquire_pushlock_exclusive(&vcpu->header.vcpu_lock);
+	u32 state=nvc_enter_vcpu_run(&vcpu->vm->header,&vcpu->header);
+	if(noir_bt(&state,noir_cvm_vcpu_running))return noir_vcpu_already_running;
 	// Abort execution if rescission is specified.
-	if(noir_locked_btr64(&vcpu->special_state,63))
+	if(noir_bt(&state,noir_cvm_vcpu_kicked))
 		vcpu->header.exit_context.intercept_code=cv_rescission;
 	else
 	{
-		if(vcpu->header.injected_event.attributes.valid && vcpu->header.injected_event.attributes.type==0)
-			vcpu->special_state.prev_virq=true;
-		noir_svm_vmmcall(noir_svm_run_custom_vcpu,(ulong_ptr)vcpu);
+		// Re-enter the guest if it was preempted by an exclusive operation only.
+		do
+		{
+			if(vcpu->header.injected_event.attributes.valid && vcpu->header.injected_event.attributes.type==0)
+				vcpu->special_state.prev_virq=true;
+			noir_svm_vmmcall(noir_svm_run_custom_vcpu,(ulong_ptr)vcpu);
+		}while(vcpu->special_state.switch_success && nvc_resume_preempted_vcpu_run(&vcpu->vm->header,&vcpu->header));
 		// Check if the world-switch is successful.
 		if(vcpu->special_state.switch_success==false)
 		{
@@ -711,18 +916,18 @@ noir_status nvc_svmc_run_vcpu(noir_svm_custom_vcpu_p vcpu)
 			}
 		}
 	}
-	noir_release_pushlock_exclusive(&vcpu->header.vcpu_lock);
+	nvc_leave_vcpu_run(&vcpu->header);
 	return st;
 }
 
-noir_status nvc_svmc_rescind_vcpu(noir_svm_custom_vcpu_p vcpu)
+u32 nvc_svmc_get_vm_asid(noir_svm_custom_vm_p vm)
 {
-	return noir_locked_bts64(&vcpu->special_state,63)?noir_already_rescinded:noir_success;
+	return vm->asid;
 }
 
-u32 nvc_svmc_get_vm_asid(noir_svm_custom_vm_p vm)
+u32 nvc_svmc_get_vcpu_processor(noir_svm_custom_vcpu_p vcpu)
 {
-	return vm->asid;
+	return vcpu->proc_id;
 }
 
 u64 nvc_svmc_get_vcpu_npt_base(noir_cvm_virtual_cpu_p vcpu)
@@ -731,141 +936,106 @@ u64 nvc_svmc_get_vcpu_npt_base(noir_cvm_virtual_cpu_p vcpu)
 	return cvcpu->vm->nptm.ncr3.phys;
 }
 
+void static nvc_svm_insert_vcpu_cpuid_quickpath(noir_svm_custom_vcpu_p vcpu,noir_cvm_cpuid_quickpath_info_p info)
+{
+	nvc_insert_cpuid_quickpath(vcpu->header.cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&vcpu->header.cpuid_quickpath_count,info);
+}
+
+void static nvc_svm_insert_vm_cpuid_quickpath(noir_svm_custom_vm_p vm,noir_cvm_cpuid_quickpath_info_p info)
+{
+	info->options.vm_wide=true;
+	nvc_insert_cpuid_quickpath(vm->header.cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vm,noir_cvm_cpuid_quickpath_limit_per_vm,&vm->header.cpuid_quickpath_count,info);
+}
+
 void nvc_svm_init_vcpu_cpuid_quickpath(noir_svm_custom_vcpu_p vcpu)
 {
-	u32 a,b,c,d;
-	u32 i=0;
+	noir_cvm_cpuid_quickpath_info qp={0};
+	qp.options.active=true;
 	// Standard Leaf 1 - Processor and Processor Feature Identifiers.
-	noir_cpuid(amd64_cpuid_std_proc_feature,0,&a,&b,&c,&d);
-	vcpu->header.cpuid_quickpath[i].leaf=amd64_cpuid_std_proc_feature;
-	vcpu->header.cpuid_quickpath[i].subleaf=0;
-	vcpu->header.cpuid_quickpath[i].options.value=0;
-	vcpu->header.cpuid_quickpath[i].options.active=true;
-	// Family, Model, Stepping.
-	vcpu->header.cpuid_quickpath[i].eax=a;
+	qp.leaf=amd64_cpuid_std_proc_feature;
+	noir_cpuid(qp.leaf,0,&qp.eax,&qp.ebx,&qp.ecx,&qp.edx);
+	// Family, Model, Stepping are retained in eax.
 	// Local APIC ID
-	vcpu->header.cpuid_quickpath[i].ebx=b&0xFFFF;		// Retain clflush and Brand ID info.
-	vcpu->header.cpuid_quickpath[i].ebx|=(vcpu->vcpu_id<<24)&0xff;
-	vcpu->header.cpuid_quickpath[i].ebx|=(vcpu->vm->vcpu_count<<16)&0xff;
+	qp.ebx&=0xFFFF;		// Retain clflush and Brand ID info.
+	qp.ebx|=(vcpu->vcpu_id&0xff)<<24;
+	qp.ebx|=(vcpu->vm->vcpu_count&0xff)<<16;
 	// Feature Identifier
-	vcpu->header.cpuid_quickpath[i].ecx=c&noir_svm_cpuid_cvmask0_ecx_fn0000_0001|noir_svm_cpuid_cvmask1_ecx_fn0000_0001;
-	vcpu->header.cpuid_quickpath[i++].edx=d&noir_svm_cpuid_cvmask0_ecx_fn0000_0001;
+	qp.ecx=qp.ecx&noir_svm_cpuid_cvmask0_ecx_fn0000_0001|noir_svm_cpuid_cvmask1_ecx_fn0000_0001;
+	qp.edx&=noir_svm_cpuid_cvmask0_edx_fn0000_0001;
+	nvc_svm_insert_vcpu_cpuid_quickpath(vcpu,&qp);
 	// Standard Leaf D - Processor Extended State Enumeration (Subleaf 0)
-	noir_cpuid(amd64_cpuid_std_pestate_enum,0,&a,&b,&c,&d);
-	vcpu->header.cpuid_quickpath[i].leaf=amd64_cpuid_std_pestate_enum;
-	vcpu->header.cpuid_quickpath[i].subleaf=0;
-	vcpu->header.cpuid_quickpath[i].options.value=0;
-	vcpu->header.cpuid_quickpath[i].options.active=true;
-	vcpu->header.cpuid_quickpath[i].options.has_subleaf=true;
-	vcpu->header.cpuid_quickpath[i].eax=3;		// Allow FPU and SSE.
-	vcpu->header.cpuid_quickpath[i].ebx=vcpu->header.cpuid_quickpath[i].ecx=sizeof(noir_fx_state);
-	vcpu->header.cpuid_quickpath[i].edx=0;		// No higher bits in mask.
+	qp.leaf=amd64_cpuid_std_pestate_enum;
+	qp.subleaf=0;
+	qp.options.has_subleaf=true;
+	qp.eax=3;		// Allow FPU and SSE.
+	qp.ebx=qp.ecx=sizeof(noir_fx_state);
+	qp.edx=0;		// No higher bits in mask.
+	nvc_svm_insert_vcpu_cpuid_quickpath(vcpu,&qp);
 	// Extended Leaf 8000_0002-8000_0004 Extended Processor Name String
 	// Note that this is changeable by MSRs (0xC001_0030-0xC0010035), so keep it per-vCPU.
-	vcpu->header.cpuid_quickpath[++i].leaf=amd64_cpuid_ext_brand_str_p1;
-	vcpu->header.cpuid_quickpath[i].subleaf=0;
-	vcpu->header.cpuid_quickpath[i].options.value=0;
-	vcpu->header.cpuid_quickpath[i].options.active=true;
-	noir_cpuid(amd64_cpuid_ext_brand_str_p1,0,&vcpu->header.cpuid_quickpath[i].eax,&vcpu->header.cpuid_quickpath[i].ebx,&vcpu->header.cpuid_quickpath[i].ecx,&vcpu->header.cpuid_quickpath[i].edx);
-	vcpu->header.cpuid_quickpath[++i].leaf=amd64_cpuid_ext_brand_str_p2;
-	vcpu->header.cpuid_quickpath[i].subleaf=0;
-	vcpu->header.cpuid_quickpath[i].options.value=0;
-	vcpu->header.cpuid_quickpath[i].options.active=true;
-	noir_cpuid(amd64_cpuid_ext_brand_str_p2,0,&vcpu->header.cpuid_quickpath[i].eax,&vcpu->header.cpuid_quickpath[i].ebx,&vcpu->header.cpuid_quickpath[i].ecx,&vcpu->header.cpuid_quickpath[i].edx);
-	vcpu->header.cpuid_quickpath[++i].leaf=amd64_cpuid_ext_brand_str_p3;
-	vcpu->header.cpuid_quickpath[i].subleaf=0;
-	vcpu->header.cpuid_quickpath[i].options.value=0;
-	vcpu->header.cpuid_quickpath[i].options.active=true;
-	noir_cpuid(amd64_cpuid_ext_brand_str_p3,0,&vcpu->header.cpuid_quickpath[i].eax,&vcpu->header.cpuid_quickpath[i].ebx,&vcpu->header.cpuid_quickpath[i].ecx,&vcpu->header.cpuid_quickpath[i].edx);
-	i++;
+	qp.options.has_subleaf=false;
+	for(qp.leaf=amd64_cpuid_ext_brand_str_p1;qp.leaf<=amd64_cpuid_ext_brand_str_p3;qp.leaf++)
+	{
+		noir_cpuid(qp.leaf,0,&qp.eax,&qp.ebx,&qp.ecx,&qp.edx);
+		nvc_svm_insert_vcpu_cpuid_quickpath(vcpu,&qp);
+	}
 }
 
 void nvc_svm_init_vm_cpuid_quickpath(noir_svm_custom_vm_p vm)
 {
-	u32 a,b,c,d;
-	u32 i=0;
+	noir_cvm_cpuid_quickpath_info qp={0};
+	qp.options.active=true;
 	// Standard Leaf 0 - Maximum Standard Leaf Number and Vendor String.
-	noir_cpuid(amd64_cpuid_std_max_num_vstr,0,null,&b,&c,&d);
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_std_max_num_vstr;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=0xD;	// Maximum leaf is 0xD - Processor Extended State Enumeration.
-	vm->header.cpuid_quickpath[i].ebx=b;
-	vm->header.cpuid_quickpath[i].ecx=c;
-	vm->header.cpuid_quickpath[i++].edx=d;
+	qp.leaf=amd64_cpuid_std_max_num_vstr;
+	noir_cpuid(qp.leaf,0,null,&qp.ebx,&qp.ecx,&qp.edx);
+	qp.eax=0xD;	// Maximum leaf is 0xD - Processor Extended State Enumeration.
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 	// Standard Leaf 7 - Structured Extended Feature Identifiers
-	noir_cpuid(amd64_cpuid_std_struct_extid,0,&a,&b,&c,&d);
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_std_struct_extid;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.has_subleaf=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=0;	// No supported subfunctions from NoirVisor.
-	vm->header.cpuid_quickpath[i].ebx=b&noir_svm_cpuid_cvmask0_ebx_fn0000_0007;
-	vm->header.cpuid_quickpath[i].ecx=c&noir_svm_cpuid_cvmask0_ecx_fn0000_0007;
-	vm->header.cpuid_quickpath[i++].edx=0;	// Reserved by AMD.
-	// Standard Leaf 7 - Structured Extended Feature Identifiers (Subleaf 1)
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_std_pestate_enum;
-	vm->header.cpuid_quickpath[i].subleaf=1;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.has_subleaf=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=0;		// No support to xsaves, xgetbv, xsavec, xsaveopt...
-	vm->header.cpuid_quickpath[i].ebx=0x240;	// Fix to 0x240. No AVX support yet.
-	vm->header.cpuid_quickpath[i].ecx=0;		// No CET support yet...
-	vm->header.cpuid_quickpath[i++].edx=0;		// Reserved by AMD...
+	qp.leaf=amd64_cpuid_std_struct_extid;
+	qp.subleaf=0;
+	qp.options.has_subleaf=true;
+	noir_cpuid(qp.leaf,0,&qp.eax,&qp.ebx,&qp.ecx,&qp.edx);
+	qp.eax=0;	// No supported subfunctions from NoirVisor.
+	qp.ebx&=noir_svm_cpuid_cvmask0_ebx_fn0000_0007;
+	qp.ecx&=noir_svm_cpuid_cvmask0_ecx_fn0000_0007;
+	qp.edx=0;	// Reserved by AMD.
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
+	// Standard Leaf D - Processor Extended State Enumeration (Subleaf 1)
+	qp.leaf=amd64_cpuid_std_pestate_enum;
+	qp.subleaf=1;
+	qp.eax=0;		// No support to xsaves, xgetbv, xsavec, xsaveopt...
+	qp.ebx=0x240;	// Fix to 0x240. No AVX support yet.
+	qp.ecx=0;		// No CET support yet...
+	qp.edx=0;		// Reserved by AMD...
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
+	qp.options.has_subleaf=false;
+	qp.subleaf=0;
 	// Extended Leaf 8000_0000 - Maximum Extended Leaf Number and Vendor String.
-	noir_cpuid(amd64_cpuid_ext_max_num_vstr,0,null,&b,&c,&d);
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_ext_max_num_vstr;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=amd64_cpuid_ext_pcap_prm_eid;	// Maximum leaf is 0x8000_0008
-	vm->header.cpuid_quickpath[i].ebx=b;
-	vm->header.cpuid_quickpath[i].ecx=c;
-	vm->header.cpuid_quickpath[i++].edx=d;
+	qp.leaf=amd64_cpuid_ext_max_num_vstr;
+	noir_cpuid(qp.leaf,0,null,&qp.ebx,&qp.ecx,&qp.edx);
+	qp.eax=amd64_cpuid_ext_pcap_prm_eid;	// Maximum leaf is 0x8000_0008
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 	// Extended Leaf 8000_0001 - Extended Processor and Processor Feature Identifiers
-	noir_cpuid(amd64_cpuid_ext_proc_feature,0,&a,&b,&c,&d);
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_ext_proc_feature;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=a;
-	vm->header.cpuid_quickpath[i].ebx=b;
-	vm->header.cpuid_quickpath[i].ecx=c&noir_svm_cpuid_cvmask0_ecx_fn8000_0001;
-	vm->header.cpuid_quickpath[i++].edx=d&noir_svm_cpuid_cvmask0_edx_fn8000_0001;
+	qp.leaf=amd64_cpuid_ext_proc_feature;
+	noir_cpuid(qp.leaf,0,&qp.eax,&qp.ebx,&qp.ecx,&qp.edx);
+	qp.ecx&=noir_svm_cpuid_cvmask0_ecx_fn8000_0001;
+	qp.edx&=noir_svm_cpuid_cvmask0_edx_fn8000_0001;
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 	// Extended Leaf 8000_0008 - Processor Capacity Parameters and Extended Feature Identification
-	vm->header.cpuid_quickpath[i].leaf=amd64_cpuid_ext_pcap_prm_eid;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=0x3030;	// 48-bit physical/linear addresses.
-	vm->header.cpuid_quickpath[i].ebx=0;
-	vm->header.cpuid_quickpath[i].ecx=0;
-	vm->header.cpuid_quickpath[i++].edx=0;
+	qp.leaf=amd64_cpuid_ext_pcap_prm_eid;
+	qp.eax=0x3030;	// 48-bit physical/linear addresses.
+	qp.ebx=qp.ecx=qp.edx=0;
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 	// Hypervisor Leaf 4000_0000 - Hypervisor Leaf Number and Vendor String
-	vm->header.cpuid_quickpath[i].leaf=ncvm_cpuid_leaf_range_and_vendor_string;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	vm->header.cpuid_quickpath[i].eax=ncvm_cpuid_leaf_limit;
-	noir_movsb(&vm->header.cpuid_quickpath[i].ebx,"NoirVisor ZT",12);
+	qp.leaf=ncvm_cpuid_leaf_range_and_vendor_string;
+	qp.eax=ncvm_cpuid_leaf_limit;
+	noir_movsb(&qp.ebx,"NoirVisor ZT",12);
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 	// Hypervisor Leaf 4000_0001 - Hypervisor Vendor-Neutral Interface ID
-	vm->header.cpuid_quickpath[i].leaf=ncvm_cpuid_vendor_neutral_interface_id;
-	vm->header.cpuid_quickpath[i].subleaf=0;
-	vm->header.cpuid_quickpath[i].options.value=0;
-	vm->header.cpuid_quickpath[i].options.active=true;
-	vm->header.cpuid_quickpath[i].options.vm_wide=true;
-	noir_movsb(&vm->header.cpuid_quickpath[i].eax,"Nv#1",4);
-	noir_stosd(&vm->header.cpuid_quickpath[i].ebx,0,3);
+	qp.leaf=ncvm_cpuid_vendor_neutral_interface_id;
+	noir_movsb(&qp.eax,"Nv#1",4);
+	qp.ebx=qp.ecx=qp.edx=0;
+	nvc_svm_insert_vm_cpuid_quickpath(vm,&qp);
 }
 
 noir_svm_custom_vcpu_p nvc_svmc_reference_vcpu(noir_svm_custom_vm_p vm,u32 vcpu_id)
@@ -873,13 +1043,16 @@ noir_svm_custom_vcpu_p nvc_svmc_reference_vcpu(noir_svm_custom_vm_p vm,u32 vcpu_
 	return vm->vcpu[vcpu_id];
 }
 
+noir_exit_profiler_p nvc_svmc_get_host_exit_profiler(u32 processor)
+{
+	return hvm_p->virtual_cpu[processor].cvm_state.profiler;
+}
+
 void nvc_svmc_release_vcpu(noir_svm_custom_vcpu_p vcpu)
 {
 	if(vcpu)
 	{
 		noir_acquire_reslock_exclusive(vcpu->vm->header.vcpu_list_lock);
-		// Acquire vCPU lock.
-		noir_acquire_pushlock_exclusive(&vcpu->header.vcpu_lock);
 		// Release VMCB.
 		if(vcpu->vmcb.virt)
 		{
@@ -890,6 +1063,7 @@ void nvc_svmc_release_vcpu(noir_svm_custom_vcpu_p vcpu)
 		}
 		// Release XSAVE State Area,
 		if(vcpu->header.xsave_area)noir_free_contd_memory(vcpu->header.xsave_area,hvm_p->xfeat.supported_size_max);
+		nvc_free_exit_profiler(vcpu->header.profiler);
 		if(hvm_p->options.enable_nsv)
 		{
 			// Release VMSA.
@@ -915,8 +1089,6 @@ void nvc_svmc_release_vcpu(noir_svm_custom_vcpu_p vcpu)
 		}
 		// Decrement the counter.
 		vcpu->vm->vcpu_count--;
-		// Release vCPU lock.
-		noir_release_pushlock_exclusive(&vcpu->header.vcpu_lock);
 		noir_free_nonpg_memory(vcpu);
 		noir_release_reslock(vcpu->vm->header.vcpu_list_lock);
 	}
@@ -928,11 +1100,13 @@ noir_status nvc_svmc_create_vcpu(noir_svm_custom_vcpu_p* virtual_cpu,noir_svm_cu
 	noir_acquire_reslock_exclusive(virtual_machine->header.vcpu_list_lock);
 	if(virtual_machine->vcpu[vcpu_id]==null)
 	{
-		noir_svm_custom_vcpu_p vcpu=noir_alloc_nonpg_memory(sizeof(noir_svm_custom_vcpu));
+		// The vCPU is most likely run by the thread creating it. Place its structures on the local NUMA node.
+		const u32 node=noir_get_processor_numa_node(noir_get_current_processor());
+		noir_svm_custom_vcpu_p vcpu=noir_alloc_nonpg_memory_for_numa(node,sizeof(noir_svm_custom_vcpu));
 		if(vcpu)
 		{
 			// Allocate VMCB
-			vcpu->vmcb.virt=noir_alloc_contd_memory(page_size);
+			vcpu->vmcb.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->vmcb.virt)
 				vcpu->vmcb.phys=noir_get_physical_address(vcpu->vmcb.virt);
 			else
@@ -947,7 +1121,7 @@ noir_status nvc_svmc_create_vcpu(noir_svm_custom_vcpu_p* virtual_cpu,noir_svm_cu
 				nvc_svm_avic_physical_apic_id_entry_p avic_physical=(nvc_svm_avic_physical_apic_id_entry_p)virtual_machine->avic_physical.virt;
 				nvc_svm_avic_logical_apic_id_entry_p avic_logical=(nvc_svm_avic_logical_apic_id_entry_p)virtual_machine->avic_logical.virt;
 				// Allocate APIC Backing Page
-				vcpu->apic_backing.virt=noir_alloc_contd_memory(page_size);
+				vcpu->apic_backing.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 				if(vcpu->apic_backing.virt)
 					vcpu->apic_backing.phys=noir_get_physical_address(vcpu->apic_backing.virt);
 				else
@@ -959,12 +1133,13 @@ noir_status nvc_svmc_create_vcpu(noir_svm_custom_vcpu_p* virtual_cpu,noir_svm_cu
 				avic_logical[vcpu_id].valid=true;
 			}
 			// Allocate XSAVE State Area
-			vcpu->header.xsave_area=noir_alloc_contd_memory(hvm_p->xfeat.supported_size_max);
+			vcpu->header.xsave_area=noir_alloc_contd_memory_for_numa(node,hvm_p->xfeat.supported_size_max);
 			if(vcpu->header.xsave_area==null)goto alloc_failure;
+			vcpu->header.profiler=nvc_alloc_exit_profiler(noir_svm_exit_profiler_reasons);
 			if(hvm_p->options.enable_nsv)
 			{
 				// Allocate NSV Area.
-				vcpu->header.vmsa.virt=noir_alloc_contd_memory(page_size);
+				vcpu->header.vmsa.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 				if(vcpu->header.vmsa.virt)
 					vcpu->header.vmsa.phys=noir_get_physical_address(vcpu->header.vmsa.virt);
 				else
@@ -983,6 +1158,7 @@ noir_status nvc_svmc_create_vcpu(noir_svm_custom_vcpu_p* virtual_cpu,noir_svm_cu
 			if(!vcpu_id)noir_bts64(&vcpu->header.msrs.apic.value,amd64_apic_bsc);
 			// Mark the owner VM of vCPU.
 			vcpu->vm=virtual_machine;
+			vcpu->header.gva_tlb_shootdown=&virtual_machine->header.gva_tlb_shootdown;
 			// Initialize vCPU CPUID-QuickPath
 			nvc_svm_init_vcpu_cpuid_quickpath(vcpu);
 			// Initialize the VMCB via hypercall. It is supposed that only hypervisor can operate VMCB.
@@ -1101,174 +1277,387 @@ void static nvc_svmc_set_pml4e_entry(amd64_npt_pml4e_p entry,u64 hpa)
 	entry->pdpte_base=page_4kb_count(hpa);
 }
 
-noir_status static nvc_svmc_create_1gb_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// Split the Large PDE into 512 PTEs which inherit its attributes.
+// Note that the PAT bit is located differently in Large PDE and PTE.
+void static nvc_svmc_split_large_pde(amd64_npt_pte_p pt,amd64_npt_large_pde_p large_pde)
 {
-	noir_status st=noir_insufficient_resources;
-	noir_npt_pdpte_descriptor_p pdpte_p=noir_alloc_nonpg_memory(sizeof(noir_npt_pdpte_descriptor));
+	for(u32 i=0;i<page_table_entries64;i++)
+	{
+		pt[i].value=0;
+		// Protection attributes...
+		pt[i].present=large_pde->present;
+		pt[i].write=large_pde->write;
+		pt[i].user=large_pde->user;
+		pt[i].no_execute=large_pde->no_execute;
+		// Caching attributes...
+		pt[i].pwt=large_pde->pwt;
+		pt[i].pcd=large_pde->pcd;
+		pt[i].pat=large_pde->pat;
+		// Accessing attributes...
+		pt[i].accessed=large_pde->accessed;
+		pt[i].dirty=large_pde->dirty;
+		// Address translation...
+		pt[i].page_base=page_4kb_count(page_2mb_mult(large_pde->page_base))+i;
+	}
+}
+
+// Merge 512 PTEs into the Large PDE. The PTEs must be checked by the caller.
+void static nvc_svmc_merge_ptes(amd64_npt_large_pde_p large_pde,amd64_npt_pte_p pt,u64 ad_bits)
+{
+	large_pde->value=0;
+	// Protection attributes...
+	large_pde->present=pt[0].present;
+	large_pde->write=pt[0].write;
+	large_pde->user=pt[0].user;
+	large_pde->no_execute=pt[0].no_execute;
+	// Caching attributes...
+	large_pde->pwt=pt[0].pwt;
+	large_pde->pcd=pt[0].pcd;
+	large_pde->pat=pt[0].pat;
+	// Address translation...
+	large_pde->page_base=page_2mb_count(page_4kb_mult(pt[0].page_base));
+	large_pde->large_pde=1;
+	// Accessing attributes are merged from all PTEs.
+	large_pde->value|=ad_bits;
+}
+
+// The 1GiB-page map is the PDPT. It is described by the PML4E.
+noir_npt_cvm_pdpte_descriptor_p static nvc_svmc_create_1gb_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa)
+{
+	noir_npt_cvm_pdpte_descriptor_p pdpte_p=noir_alloc_nonpg_memory(sizeof(noir_npt_cvm_pdpte_descriptor));
 	if(pdpte_p)
 	{
 		pdpte_p->virt=noir_alloc_contd_memory(page_size);
-		if(pdpte_p->virt==null)
-			noir_free_nonpg_memory(pdpte_p);
-		else
+		pdpte_p->pde=noir_alloc_nonpg_memory(sizeof(void*)*page_table_entries64);
+		if(pdpte_p->virt && pdpte_p->pde)
 		{
 			amd64_addr_translator gpa_t;
 			gpa_t.value=gpa;
 			// Setup PDPTE descriptor.
 			pdpte_p->phys=noir_get_physical_address(pdpte_p->virt);
 			pdpte_p->gpa_start=page_512gb_base(gpa);
-			// Do mapping - this level.
-			nvc_svmc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],hpa,map_attrib);
 			// Do mapping - prior level.
 			// Note that PML4E is already described.
 			nvc_svmc_set_pml4e_entry(&npt_manager->ncr3.virt[gpa_t.pml4e_offset],pdpte_p->phys);
-			// Add to the linked list.
-			if(npt_manager->pdpte.head)
-				npt_manager->pdpte.tail->next=pdpte_p;
-			else
-				npt_manager->pdpte.head=pdpte_p;
-			npt_manager->pdpte.tail=pdpte_p;
-			st=noir_success;
+			// Insert into the radix tree.
+			npt_manager->pdpte[gpa_t.pml4e_offset]=pdpte_p;
+			npt_manager->tables.pdpte++;
+		}
+		else
+		{
+			if(pdpte_p->virt)noir_free_contd_memory(pdpte_p->virt,page_size);
+			if(pdpte_p->pde)noir_free_nonpg_memory(pdpte_p->pde);
+			noir_free_nonpg_memory(pdpte_p);
+			pdpte_p=null;
 		}
 	}
-	return st;
+	return pdpte_p;
 }
 
-noir_status static nvc_svmc_create_2mb_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The 2MiB-page map is the PDT. It is described by the PDPTE.
+noir_npt_cvm_pde_descriptor_p static nvc_svmc_create_2mb_page_map(noir_svm_custom_npt_manager_p npt_manager,noir_npt_cvm_pdpte_descriptor_p pdpte_p,u64 gpa)
 {
-	noir_status st=noir_insufficient_resources;
-	noir_npt_pde_descriptor_p pde_p=noir_alloc_nonpg_memory(sizeof(noir_npt_pde_descriptor));
+	noir_npt_cvm_pde_descriptor_p pde_p=noir_alloc_nonpg_memory(sizeof(noir_npt_cvm_pde_descriptor));
 	if(pde_p)
 	{
 		pde_p->virt=noir_alloc_contd_memory(page_size);
-		if(pde_p->virt==null)
-			noir_free_nonpg_memory(pde_p);
-		else
+		pde_p->pte=noir_alloc_nonpg_memory(sizeof(void*)*page_table_entries64);
+		if(pde_p->virt && pde_p->pte)
 		{
-			noir_npt_pdpte_descriptor_p cur=npt_manager->pdpte.head;
+			noir_cvm_mapping_attributes null_map={0};
 			amd64_addr_translator gpa_t;
 			gpa_t.value=gpa;
-			// Setup PDE descriptor
+			// Setup PDE descriptor.
 			pde_p->phys=noir_get_physical_address(pde_p->virt);
 			pde_p->gpa_start=page_1gb_base(gpa);
-			// Do mapping
-			nvc_svmc_set_pde_entry(&pde_p->virt[gpa_t.pde_offset],hpa,map_attrib);
-			// Add to the linked list.
-			if(npt_manager->pde.head)
-				npt_manager->pde.tail->next=pde_p;
-			else
-				npt_manager->pde.head=pde_p;
-			npt_manager->pde.tail=pde_p;
-			// Search for existing PDPTEs and set up upper-level mapping.
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_512gb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
-			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 512GiB page is not yet described.
-				st=nvc_svmc_create_1gb_page_map(npt_manager,gpa,0,null_map);
-				if(st==noir_success)cur=npt_manager->pdpte.tail;
-			}
-			if(cur)
-			{
-				nvc_svmc_set_pdpte_entry(&cur->virt[gpa_t.pdpte_offset],pde_p->phys,map_attrib);
-				st=noir_success;
-			}
+			// If a 1GiB page is mapped here, split it into 2MiB pages.
+			// Huge PDPTE and Large PDE share the same layout.
+			if(pdpte_p->huge[gpa_t.pdpte_offset].present && pdpte_p->huge[gpa_t.pdpte_offset].huge_pdpte)
+				for(u32 i=0;i<page_table_entries64;i++)
+					pde_p->large[i].value=pdpte_p->huge[gpa_t.pdpte_offset].value+page_2mb_mult((u64)i);
+			// Do mapping - prior level.
+			nvc_svmc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],pde_p->phys,null_map);
+			// Insert into the radix tree.
+			pdpte_p->pde[gpa_t.pdpte_offset]=pde_p;
+			npt_manager->tables.pde++;
+		}
+		else
+		{
+			if(pde_p->virt)noir_free_contd_memory(pde_p->virt,page_size);
+			if(pde_p->pte)noir_free_nonpg_memory(pde_p->pte);
+			noir_free_nonpg_memory(pde_p);
+			pde_p=null;
 		}
 	}
-	return st;
+	return pde_p;
 }
 
-noir_status static nvc_svmc_create_4kb_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The 4KiB-page map is the PT. It is described by the PDE.
+noir_npt_cvm_pte_descriptor_p static nvc_svmc_create_4kb_page_map(noir_svm_custom_npt_manager_p npt_manager,noir_npt_cvm_pde_descriptor_p pde_p,u64 gpa)
 {
-	noir_status st=noir_insufficient_resources;
-	noir_npt_pte_descriptor_p pte_p=noir_alloc_nonpg_memory(sizeof(noir_npt_pte_descriptor));
+	noir_npt_cvm_pte_descriptor_p pte_p=noir_alloc_nonpg_memory(sizeof(noir_npt_cvm_pte_descriptor));
 	if(pte_p)
 	{
 		pte_p->virt=noir_alloc_contd_memory(page_size);
-		if(pte_p->virt==null)
-			noir_free_nonpg_memory(pte_p);
-		else
+		if(pte_p->virt)
 		{
-			noir_npt_pde_descriptor_p cur=npt_manager->pde.head;
+			noir_cvm_mapping_attributes null_map={0};
 			amd64_addr_translator gpa_t;
 			gpa_t.value=gpa;
-			// Setup PTE descriptor
+			// Setup PTE descriptor.
 			pte_p->phys=noir_get_physical_address(pte_p->virt);
 			pte_p->gpa_start=page_2mb_base(gpa);
-			// Do mapping
-			nvc_svmc_set_pte_entry(&pte_p->virt[gpa_t.pte_offset],0,map_attrib);
-			// Add to the linked list
-			if(npt_manager->pte.head)
-				npt_manager->pte.tail->next=pte_p;
-			else
-				npt_manager->pte.head=pte_p;
-			npt_manager->pte.tail=pte_p;
-			// Search for existing PDEs and set up upper-level mapping.
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_1gb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
-			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 1GiB page is not yet described.
-				st=nvc_svmc_create_2mb_page_map(npt_manager,gpa,0,null_map);
-				if(st==noir_success)cur=npt_manager->pde.tail;
-			}
-			if(cur)
+			// If a 2MiB page is mapped here, split it into 4KiB pages.
+			if(pde_p->large[gpa_t.pde_offset].present && pde_p->large[gpa_t.pde_offset].large_pde)
+				nvc_svmc_split_large_pde(pte_p->virt,&pde_p->large[gpa_t.pde_offset]);
+			// Do mapping - prior level.
+			nvc_svmc_set_pde_entry(&pde_p->virt[gpa_t.pde_offset],pte_p->phys,null_map);
+			// Insert into the radix tree.
+			pde_p->pte[gpa_t.pde_offset]=pte_p;
+			npt_manager->tables.pte++;
+		}
+		else
+		{
+			noir_free_nonpg_memory(pte_p);
+			pte_p=null;
+		}
+	}
+	return pte_p;
+}
+
+// The following functions locate the descriptors by indexing the radix tree with the GPA.
+// If the descriptor is absent and allocation is requested, the paging structure will be created.
+noir_npt_cvm_pdpte_descriptor_p static nvc_svmc_reference_pdpte_descriptor(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,bool alloc)
+{
+	amd64_addr_translator gpa_t;
+	gpa_t.value=gpa;
+	if(npt_manager->pdpte[gpa_t.pml4e_offset]==null && alloc)
+		return nvc_svmc_create_1gb_page_map(npt_manager,gpa);
+	return npt_manager->pdpte[gpa_t.pml4e_offset];
+}
+
+noir_npt_cvm_pde_descriptor_p static nvc_svmc_reference_pde_descriptor(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,bool alloc)
+{
+	noir_npt_cvm_pdpte_descriptor_p pdpte_p=nvc_svmc_reference_pdpte_descriptor(npt_manager,gpa,alloc);
+	if(pdpte_p)
+	{
+		amd64_addr_translator gpa_t;
+		gpa_t.value=gpa;
+		if(pdpte_p->pde[gpa_t.pdpte_offset]==null && alloc)
+			return nvc_svmc_create_2mb_page_map(npt_manager,pdpte_p,gpa);
+		return pdpte_p->pde[gpa_t.pdpte_offset];
+	}
+	return null;
+}
+
+noir_npt_cvm_pte_descriptor_p static nvc_svmc_reference_pte_descriptor(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,bool alloc)
+{
+	noir_npt_cvm_pde_descriptor_p pde_p=nvc_svmc_reference_pde_descriptor(npt_manager,gpa,alloc);
+	if(pde_p)
+	{
+		amd64_addr_translator gpa_t;
+		gpa_t.value=gpa;
+		if(pde_p->pte[gpa_t.pde_offset]==null && alloc)
+			return nvc_svmc_create_4kb_page_map(npt_manager,pde_p,gpa);
+		return pde_p->pte[gpa_t.pde_offset];
+	}
+	return null;
+}
+
+// Locate the leaf entry that translates the GPA. Null will be returned if the GPA is not translated.
+amd64_npt_general_entry_p static nvc_svmc_get_leaf_entry(noir_svm_custom_npt_manager_p npt_manager,u64 gpa)
+{
+	amd64_addr_translator trans;
+	noir_npt_cvm_pdpte_descriptor_p pdpte_p;
+	trans.value=gpa;
+	pdpte_p=npt_manager->pdpte[trans.pml4e_offset];
+	if(pdpte_p && pdpte_p->virt[trans.pdpte_offset].present)
+	{
+		if(pdpte_p->huge[trans.pdpte_offset].huge_pdpte)
+			return (amd64_npt_general_entry_p)&pdpte_p->huge[trans.pdpte_offset];
+		else
+		{
+			noir_npt_cvm_pde_descriptor_p pde_p=pdpte_p->pde[trans.pdpte_offset];
+			if(pde_p && pde_p->virt[trans.pde_offset].present)
 			{
-				nvc_svmc_set_pde_entry(&cur->virt[gpa_t.pde_offset],pte_p->phys,map_attrib);
-				st=noir_success;
+				if(pde_p->large[trans.pde_offset].large_pde)
+					return (amd64_npt_general_entry_p)&pde_p->large[trans.pde_offset];
+				else
+				{
+					noir_npt_cvm_pte_descriptor_p pte_p=pde_p->pte[trans.pde_offset];
+					if(pte_p && pte_p->virt[trans.pte_offset].present)
+						return (amd64_npt_general_entry_p)&pte_p->virt[trans.pte_offset];
+				}
 			}
 		}
 	}
-	return st;
+	return null;
+}
+
+// The following functions release the paging structures with all subordinates.
+// The entry in the prior level is not updated here.
+void static nvc_svmc_free_4kb_page_map(noir_svm_custom_npt_manager_p npt_manager,noir_npt_cvm_pde_descriptor_p pde_p,u32 index)
+{
+	noir_npt_cvm_pte_descriptor_p pte_p=pde_p->pte[index];
+	if(pte_p)
+	{
+		noir_free_contd_memory(pte_p->virt,page_size);
+		noir_free_nonpg_memory(pte_p);
+		pde_p->pte[index]=null;
+		npt_manager->tables.pte--;
+	}
+}
+
+void static nvc_svmc_free_2mb_page_map(noir_svm_custom_npt_manager_p npt_manager,noir_npt_cvm_pdpte_descriptor_p pdpte_p,u32 index)
+{
+	noir_npt_cvm_pde_descriptor_p pde_p=pdpte_p->pde[index];
+	if(pde_p)
+	{
+		for(u32 i=0;i<page_table_entries64;i++)
+			nvc_svmc_free_4kb_page_map(npt_manager,pde_p,i);
+		noir_free_nonpg_memory(pde_p->pte);
+		noir_free_contd_memory(pde_p->virt,page_size);
+		noir_free_nonpg_memory(pde_p);
+		pdpte_p->pde[index]=null;
+		npt_manager->tables.pde--;
+	}
+}
+
+void static nvc_svmc_free_1gb_page_map(noir_svm_custom_npt_manager_p npt_manager,u32 index)
+{
+	noir_npt_cvm_pdpte_descriptor_p pdpte_p=npt_manager->pdpte[index];
+	if(pdpte_p)
+	{
+		for(u32 i=0;i<page_table_entries64;i++)
+			nvc_svmc_free_2mb_page_map(npt_manager,pdpte_p,i);
+		noir_free_nonpg_memory(pdpte_p->pde);
+		noir_free_contd_memory(pdpte_p->virt,page_size);
+		noir_free_nonpg_memory(pdpte_p);
+		npt_manager->pdpte[index]=null;
+		npt_manager->tables.pdpte--;
+	}
 }
 
 noir_status static nvc_svmc_set_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
 {
-	noir_status st=noir_unsuccessful;
+	noir_status st=noir_invalid_parameter;
 	amd64_addr_translator gpa_t;
+	// Paging structures are unnecessary to be created for unmapping,
+	// unless a present larger page has to be split.
+	bool alloc=map_attrib.present || nvc_svmc_get_leaf_entry(npt_manager,gpa)!=null;
 	gpa_t.value=gpa;
 	switch(map_attrib.psize)
 	{
 		case 0:
 		{
-			// Search for existing PTEs.
-			noir_npt_pte_descriptor_p cur=npt_manager->pte.head;
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_2mb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
+			noir_npt_cvm_pte_descriptor_p pte_p=nvc_svmc_reference_pte_descriptor(npt_manager,gpa,alloc);
+			if(pte_p)
 			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 2MiB page is not described yet.
-				st=nvc_svmc_create_4kb_page_map(npt_manager,gpa,0,null_map);
-				if(st==noir_success)cur=npt_manager->pte.tail;
+				nvc_svmc_set_pte_entry(&pte_p->virt[gpa_t.pte_offset],hpa,map_attrib);
+				st=noir_success;
 			}
-			if(cur)
+			else
+				st=alloc?noir_insufficient_resources:noir_success;
+			break;
+		}
+		case 1:
+		{
+			noir_npt_cvm_pde_descriptor_p pde_p=nvc_svmc_reference_pde_descriptor(npt_manager,gpa,alloc);
+			if(pde_p)
 			{
-				nvc_svmc_set_pte_entry(&cur->virt[gpa_t.pte_offset],hpa,map_attrib);
+				// The 4KiB pages in this range are superseded by the 2MiB page.
+				nvc_svmc_free_4kb_page_map(npt_manager,pde_p,gpa_t.pde_offset);
+				if(map_attrib.present)
+					nvc_svmc_set_pde_entry(&pde_p->virt[gpa_t.pde_offset],hpa,map_attrib);
+				else
+					pde_p->virt[gpa_t.pde_offset].value=0;
 				st=noir_success;
 			}
+			else
+				st=alloc?noir_insufficient_resources:noir_success;
 			break;
 		}
-		default:
+		case 2:
 		{
-			st=noir_not_implemented;
+			noir_npt_cvm_pdpte_descriptor_p pdpte_p=nvc_svmc_reference_pdpte_descriptor(npt_manager,gpa,alloc);
+			if(pdpte_p)
+			{
+				// The 2MiB and 4KiB pages in this range are superseded by the 1GiB page.
+				nvc_svmc_free_2mb_page_map(npt_manager,pdpte_p,gpa_t.pdpte_offset);
+				if(map_attrib.present)
+					nvc_svmc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],hpa,map_attrib);
+				else
+					pdpte_p->virt[gpa_t.pdpte_offset].value=0;
+				st=noir_success;
+			}
+			else
+				st=alloc?noir_insufficient_resources:noir_success;
 			break;
 		}
 	}
 	return st;
 }
 
+// Coalesce the 4KiB pages of the 2MiB range into a 2MiB page if they are
+// mapped to a contiguous and aligned host range with identical attributes.
+bool static nvc_svmc_coalesce_2mb_page(noir_svm_custom_npt_manager_p npt_manager,u64 gpa)
+{
+	noir_npt_cvm_pde_descriptor_p pde_p=nvc_svmc_reference_pde_descriptor(npt_manager,gpa,false);
+	amd64_addr_translator gpa_t;
+	gpa_t.value=gpa;
+	if(pde_p && pde_p->pte[gpa_t.pde_offset])
+	{
+		amd64_npt_pte_p pt=pde_p->pte[gpa_t.pde_offset]->virt;
+		u64 ad_bits=0;
+		if(!pt[0].present || page_2mb_offset(page_4kb_mult(pt[0].page_base)))return false;
+		for(u32 i=0;i<page_table_entries64;i++)
+		{
+			if((pt[i].value&~amd64_npt_accessed_dirty_bits)!=(pt[0].value&~amd64_npt_accessed_dirty_bits)+page_4kb_mult((u64)i))return false;
+			ad_bits|=pt[i].value&amd64_npt_accessed_dirty_bits;
+		}
+		nvc_svmc_merge_ptes(&pde_p->large[gpa_t.pde_offset],pt,ad_bits);
+		nvc_svmc_free_4kb_page_map(npt_manager,pde_p,gpa_t.pde_offset);
+		return true;
+	}
+	return false;
+}
+
+// Coalesce the 2MiB pages of the 1GiB range into a 1GiB page in the same way.
+bool static nvc_svmc_coalesce_1gb_page(noir_svm_custom_npt_manager_p npt_manager,u64 gpa)
+{
+	noir_npt_cvm_pdpte_descriptor_p pdpte_p=nvc_svmc_reference_pdpte_descriptor(npt_manager,gpa,false);
+	amd64_addr_translator gpa_t;
+	gpa_t.value=gpa;
+	if(pdpte_p && pdpte_p->pde[gpa_t.pdpte_offset])
+	{
+		amd64_npt_large_pde_p pd=pdpte_p->pde[gpa_t.pdpte_offset]->large;
+		u64 ad_bits=0;
+		if(!pd[0].present || !pd[0].large_pde || page_1gb_offset(page_2mb_mult(pd[0].page_base)))return false;
+		for(u32 i=0;i<page_table_entries64;i++)
+		{
+			if((pd[i].value&~amd64_npt_accessed_dirty_bits)!=(pd[0].value&~amd64_npt_accessed_dirty_bits)+page_2mb_mult((u64)i))return false;
+			ad_bits|=pd[i].value&amd64_npt_accessed_dirty_bits;
+		}
+		// Large PDE and Huge PDPTE share the same layout.
+		pdpte_p->huge[gpa_t.pdpte_offset].value=(pd[0].value&~amd64_npt_accessed_dirty_bits)|ad_bits;
+		nvc_svmc_free_2mb_page_map(npt_manager,pdpte_p,gpa_t.pdpte_offset);
+		return true;
+	}
+	return false;
+}
+
+// Coalesce the ranges touched by a mapping operation, if the processor supports large pages.
+void static nvc_svmc_coalesce_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u32 pages)
+{
+	u64 gpa_end=gpa+page_4kb_mult((u64)pages);
+	if(hvm_p->cvm_cap.large_page)
+		for(u64 cur=page_2mb_base(gpa);cur<gpa_end;cur+=page_2mb_size)
+			nvc_svmc_coalesce_2mb_page(npt_manager,cur);
+	if(hvm_p->cvm_cap.huge_page)
+		for(u64 cur=page_1gb_base(gpa);cur<gpa_end;cur+=page_1gb_size)
+			nvc_svmc_coalesce_1gb_page(npt_manager,cur);
+}
+
 bool nvc_svmc_get_physical_mapping(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u64p hpa,bool r,bool w,bool x)
 {
 	bool result=false;
@@ -1279,203 +1668,363 @@ bool nvc_svmc_get_physical_mapping(noir_svm_custom_npt_manager_p npt_manager,u64
 	*hpa=0;
 	if(pml4e->present>=r && pml4e->write>=w && pml4e->no_execute<=x)
 	{
-		const u64 pdpte_phys=page_mult(pml4e->pdpte_base);
-		for(noir_npt_pdpte_descriptor_p pdpte_p=npt_manager->pdpte.head;pdpte_p;pdpte_p=pdpte_p->next)
+		noir_npt_cvm_pdpte_descriptor_p pdpte_p=npt_manager->pdpte[trans.pml4e_offset];
+		if(pdpte_p)
 		{
-			if(pdpte_p->phys==pdpte_phys)
+			amd64_npt_huge_pdpte_p pdpte=&pdpte_p->huge[trans.pdpte_offset];
+			if(pdpte->present>=r && pdpte->write>=w && pdpte->no_execute<=x)
 			{
-				amd64_npt_huge_pdpte_p pdpte=(amd64_npt_huge_pdpte_p)&pdpte_p->virt[trans.pdpte_offset];
-				if(pdpte->present>=r && pdpte->write>=w && pdpte->no_execute<=x)
+				if(pdpte->huge_pdpte)
 				{
-					if(pdpte->huge_pdpte)
-					{
-						result=true;
-						*hpa=page_1gb_mult(pdpte->page_base)|page_1gb_offset(gpa);
-					}
-					else
+					result=true;
+					*hpa=page_1gb_mult(pdpte->page_base)|page_1gb_offset(gpa);
+				}
+				else
+				{
+					noir_npt_cvm_pde_descriptor_p pde_p=pdpte_p->pde[trans.pdpte_offset];
+					if(pde_p)
 					{
-						const u64 pde_phys=page_mult(pdpte_p->virt[trans.pdpte_offset].pde_base);
-						for(noir_npt_pde_descriptor_p pde_p=npt_manager->pde.head;pde_p;pde_p=pde_p->next)
+						amd64_npt_large_pde_p pde=&pde_p->large[trans.pde_offset];
+						if(pde->present>=r && pde->write>=w && pde->no_execute<=x)
 						{
-							if(pde_p->phys==pde_phys)
+							if(pde->large_pde)
 							{
-								amd64_npt_large_pde_p pde=(amd64_npt_large_pde_p)&pde_p->virt[trans.pde_offset];
-								if(pde->present>=r && pde->write>=w && pde->no_execute<=x)
+								result=true;
+								*hpa=page_2mb_mult(pde->page_base)|page_2mb_offset(gpa);
+							}
+							else
+							{
+								noir_npt_cvm_pte_descriptor_p pte_p=pde_p->pte[trans.pde_offset];
+								if(pte_p)
 								{
-									if(pde->large_pde)
+									amd64_npt_pte_p pte=&pte_p->virt[trans.pte_offset];
+									if(pte->present>=r && pte->write>=w && pte->no_execute<=x)
 									{
 										result=true;
-										*hpa=page_2mb_mult(pde->page_base)|page_2mb_offset(gpa);
-									}
-									else
-									{
-										const u64 pte_phys=page_mult(pde_p->virt[trans.pde_offset].pte_base);
-										for(noir_npt_pte_descriptor_p pte_p=npt_manager->pte.head;pte_p;pte_p=pte_p->next)
-										{
-											if(pte_p->phys==pte_phys)
-											{
-												amd64_npt_pte_p pte=&pte_p->virt[trans.pte_offset];
-												if(pte->present>=r && pte->write>=w && pte->no_execute<=x)
-												{
-													result=true;
-													*hpa=page_4kb_mult(pte->page_base)|trans.page_offset;
-												}
-												break;
-											}
-										}
+										*hpa=page_4kb_mult(pte->page_base)|trans.page_offset;
 									}
 								}
-								break;
 							}
 						}
 					}
 				}
-				break;
 			}
 		}
 	}
 	return result;
 }
 
+// Move the processors that ran this VM into the stale set.
+// Each of them flushes the ASID upon its next entry to this VM. No IPIs are required.
+void static nvc_svmc_invalidate_vm_tlb(noir_svm_custom_vm_p vm)
+{
+	for(u32 i=0;i<vm->tlb_tracker.words;i++)
+	{
+		const i32 ran=noir_locked_xchg(&vm->tlb_tracker.ran[i],0);
+		if(ran)noir_locked_or(&vm->tlb_tracker.stale[i],ran);
+	}
+	noir_locked_inc(&vm->tlb_tracker.generation);
+}
+
 noir_status nvc_svmc_set_unmapping(noir_svm_custom_vm_p virtual_machine,u64 gpa,u32 pages)
 {
 	noir_status st=noir_insufficient_resources;
-	u64p hpa_list=noir_alloc_nonpg_memory(pages<<3);
+	u64p hpa_list=noir_alloc_nonpg_memory((size_t)pages<<3);
 	if(hpa_list)
 	{
 		bool nsv_ret=true;
 		for(u32 i=0;i<pages;i++)
-			nvc_svmc_get_physical_mapping(&virtual_machine->nptm,gpa+page_4kb_mult(i),&hpa_list[i],true,false,false);
+			nvc_svmc_get_physical_mapping(&virtual_machine->nptm,gpa+page_4kb_mult((u64)i),&hpa_list[i],true,false,false);
 		if(hvm_p->options.enable_nsv)
 		{
 			st=noir_nsv_violation;
 			nsv_ret=nvc_npt_reassign_page_ownership(hpa_list,hpa_list,pages,1,false,noir_nsv_rmt_subverted_host);
+			// The pages no longer belong to this VM. Shrink the ownership index.
+			if(nsv_ret)
+			{
+				noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
+				nvc_rmt_index_remove(&virtual_machine->rmt_index,hpa_list,pages);
+				noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
+			}
 		}
 		// FIXME: Encrypt the pages if these pages are secure.
 		if(nsv_ret)
 		{
 			noir_cvm_mapping_attributes map_attrib={0};
-			for(u32 i=0;i<pages;i++)
+			u32 i=0;
+			// Unmap with the largest aligned pages so that the paging structures beneath can be released.
+			while(i<pages)
 			{
-				st=nvc_svmc_set_page_map(&virtual_machine->nptm,gpa,0,map_attrib);
-				if(st!=noir_success)return st;
+				u64 cur=gpa+page_4kb_mult((u64)i);
+				if(page_1gb_offset(cur)==0 && pages-i>=noir_cvm_psize_pages(2))
+					map_attrib.psize=2;
+				else if(page_2mb_offset(cur)==0 && pages-i>=noir_cvm_psize_pages(1))
+					map_attrib.psize=1;
+				else
+					map_attrib.psize=0;
+				st=nvc_svmc_set_page_map(&virtual_machine->nptm,cur,0,map_attrib);
+				if(st!=noir_success)break;
+				i+=noir_cvm_psize_pages(map_attrib.psize);
 			}
+			// Invalidate the TLBs on processors that ran this VM and the software TLBs of all vCPUs.
+			nvc_svmc_invalidate_vm_tlb(virtual_machine);
+			for(u32 j=0;j<255;j++)
+				if(virtual_machine->vcpu[j])
+					virtual_machine->vcpu[j]->header.state_cache.gt_valid=false;
 		}
 		noir_free_nonpg_memory(hpa_list);
 	}
 	return st;
 }
 
-noir_status nvc_svmc_set_mapping(noir_svm_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u64p phys_array)
+// Capture the present translations of a range before a batch overwrites them, one record per leaf entry.
+// Missing paging structures are skipped as a whole, so capturing a range that is not mapped yet takes few lookups.
+bool static nvc_svmc_capture_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u32 pages,noir_cvm_prior_journal_p journal)
 {
-	noir_status st=noir_insufficient_resources;
-	u64p gpa_list=noir_alloc_nonpg_memory(mapping_info->pages<<3);
-	if(gpa_list)
+	const u64 limit=gpa+page_4kb_mult((u64)pages);
+	while(gpa<limit)
 	{
-		u8 ownership=mapping_info->attributes.nsv_secure?noir_nsv_rmt_secure_guest:noir_nsv_rmt_insecure_guest;
-		bool nsv_ret=true;
+		amd64_npt_general_entry_p entry=null;
+		noir_npt_cvm_pdpte_descriptor_p pdpte_p;
+		amd64_addr_translator gpa_t;
+		u64 leaf_size=page_512gb_size,end;
+		u8 pat_index=0;
+		gpa_t.value=gpa;
+		pdpte_p=npt_manager->pdpte[gpa_t.pml4e_offset];
+		if(pdpte_p)
+		{
+			leaf_size=page_1gb_size;
+			if(pdpte_p->virt[gpa_t.pdpte_offset].present)
+			{
+				if(pdpte_p->huge[gpa_t.pdpte_offset].huge_pdpte)
+					entry=(amd64_npt_general_entry_p)&pdpte_p->huge[gpa_t.pdpte_offset];
+				else if(pdpte_p->pde[gpa_t.pdpte_offset])
+				{
+					noir_npt_cvm_pde_descriptor_p pde_p=pdpte_p->pde[gpa_t.pdpte_offset];
+					leaf_size=page_2mb_size;
+					if(pde_p->virt[gpa_t.pde_offset].present)
+					{
+						if(pde_p->large[gpa_t.pde_offset].large_pde)
+							entry=(amd64_npt_general_entry_p)&pde_p->large[gpa_t.pde_offset];
+						else if(pde_p->pte[gpa_t.pde_offset])
+						{
+							noir_npt_cvm_pte_descriptor_p pte_p=pde_p->pte[gpa_t.pde_offset];
+							leaf_size=page_4kb_size;
+							if(pte_p->virt[gpa_t.pte_offset].present)
+							{
+								entry=(amd64_npt_general_entry_p)&pte_p->virt[gpa_t.pte_offset];
+								pat_index=(u8)(pte_p->virt[gpa_t.pte_offset].pat<<2);
+							}
+						}
+					}
+				}
+			}
+		}
+		// The end of the leaf wraps around at the top of the address space.
+		end=(gpa&~(leaf_size-1))+leaf_size;
+		if(end-gpa>limit-gpa)end=limit;
+		if(entry)
+		{
+			noir_cvm_mapping_attributes attributes={0};
+			u64 hpa;
+			// The PAT bit is bit 7 in PTEs, but bit 12 in larger pages.
+			if(leaf_size!=page_4kb_size)pat_index=(u8)(((amd64_npt_large_pde_p)entry)->pat<<2);
+			pat_index|=(u8)((entry->pwt<<0)|(entry->pcd<<1));
+			nvc_svmc_get_physical_mapping(npt_manager,gpa,&hpa,true,false,false);
+			attributes.present=true;
+			attributes.write=entry->write;
+			attributes.user=entry->user;
+			attributes.execute=!entry->no_execute;
+			attributes.caching=hvm_p->host_pat.list[pat_index];
+			if(!nvc_record_prior_mapping(journal,gpa,hpa,(u32)page_4kb_count(end-gpa),attributes))return false;
+		}
+		gpa=end;
+	}
+	return true;
+}
+
+// Restore a range overwritten by a failed batch. The pages are unmapped in the size they were mapped,
+// then the captured translations overlapping the range are mapped again in the largest aligned pages.
+void static nvc_svmc_restore_page_map(noir_svm_custom_npt_manager_p npt_manager,u64 gpa,u32 pages,u32 psize,noir_cvm_prior_journal_p journal)
+{
+	const u64 limit=gpa+page_4kb_mult((u64)pages);
+	noir_cvm_mapping_attributes null_map={0};
+	null_map.psize=psize;
+	for(u32 i=0;i<pages;i+=noir_cvm_psize_pages(psize))
+		nvc_svmc_set_page_map(npt_manager,gpa+page_4kb_mult((u64)i),0,null_map);
+	for(u32 i=0;i<journal->count;i++)
+	{
+		noir_cvm_prior_mapping_p prior=&journal->list[i];
+		u64 cur=prior->gpa>gpa?prior->gpa:gpa;
+		u64 end=prior->gpa+page_4kb_mult((u64)prior->pages);
+		if(end>limit)end=limit;
+		while(cur<end)
+		{
+			noir_cvm_mapping_attributes map_attrib=prior->attributes;
+			const u64 hpa=prior->hpa+(cur-prior->gpa);
+			if(hvm_p->cvm_cap.huge_page && page_1gb_offset(cur|hpa)==0 && end-cur>=page_1gb_size)
+				map_attrib.psize=2;
+			else if(hvm_p->cvm_cap.large_page && page_2mb_offset(cur|hpa)==0 && end-cur>=page_2mb_size)
+				map_attrib.psize=1;
+			nvc_svmc_set_page_map(npt_manager,cur,hpa,map_attrib);
+			cur+=page_4kb_mult((u64)noir_cvm_psize_pages(map_attrib.psize));
+		}
+	}
+	nvc_svmc_coalesce_page_map(npt_manager,gpa,pages);
+}
+
+// Return the host pages of the ranges to the subverted host.
+// Pages of secure ranges are encrypted again since they are no longer owned by a secure guest.
+void static nvc_svmc_revert_page_ownership(noir_svm_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array)
+{
+	u64p hpa_cur=phys_array;
+	for(u32 i=0;i<count;i++)
+	{
+		u32 pages=mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize);
 		if(hvm_p->options.enable_nsv)
-			nsv_ret=nvc_npt_reassign_page_ownership(phys_array,gpa_list,mapping_info->pages,virtual_machine->asid,false,ownership);
-		// First, reassign the reverse mapping.
-		for(u32 i=0;i<mapping_info->pages;i++)
-			gpa_list[i]=mapping_info->gpa+page_4kb_mult(i);
-		// FIXME: If the page is mapped as secure guest, decrypt the pages.
-		if(nsv_ret)
 		{
-			if(mapping_info->attributes.nsv_secure)
+			nvc_npt_reassign_page_ownership(hpa_cur,hpa_cur,pages,1,false,noir_nsv_rmt_subverted_host);
+			noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
+			nvc_rmt_index_remove(&virtual_machine->rmt_index,hpa_cur,pages);
+			noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
+		}
+		if(mapping_info[i].attributes.nsv_secure)
+		{
+			noir_rmt_crypto_context crypto;
+			crypto.vm=(noir_nsv_virtual_machine_p)virtual_machine->header.vmsa.virt;
+			crypto.hpa_list=hpa_cur;
+			crypto.pages=pages;
+			noir_svm_vmmcall(noir_svm_nsv_crypto_for_rmt,(ulong_ptr)&crypto);
+		}
+		hpa_cur+=pages;
+	}
+}
+
+// Map several ranges into the guest. The physical array lists all ranges in 4KiB granularity, one after another.
+// All ranges are installed under a single exclusion of the VM and committed with a single invalidation.
+noir_status nvc_svmc_set_mapping_batch(noir_svm_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array)
+{
+	noir_status st=noir_insufficient_resources;
+	u32 total=0;
+	u64p gpa_list=null;
+	noir_cvm_prior_journal journal={0};
+	// Physical addresses and reverse-mappings are listed in 4KiB granularity.
+	for(u32 i=0;i<count;i++)
+		total+=mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize);
+	// Only the Reverse-Mapping Table needs the guest addresses to be listed.
+	if(hvm_p->options.enable_nsv)gpa_list=noir_alloc_nonpg_memory((size_t)total<<3);
+	if(gpa_list || !hvm_p->options.enable_nsv)
+	{
+		u64p gpa_cur=gpa_list,hpa_cur=phys_array;
+		u32 reassigned=0,mapped=0,failed_page=0;
+		st=noir_success;
+		// First, reassign the reverse mapping of every range.
+		for(;reassigned<count;reassigned++)
+		{
+			noir_cvm_address_mapping_p range=&mapping_info[reassigned];
+			u32 pages=range->pages*noir_cvm_psize_pages(range->attributes.psize);
+			u8 ownership=range->attributes.nsv_secure?noir_nsv_rmt_secure_guest:noir_nsv_rmt_insecure_guest;
+			if(hvm_p->options.enable_nsv)
+			{
+				for(u32 i=0;i<pages;i++)
+					gpa_cur[i]=range->gpa+page_4kb_mult((u64)i);
+				if(!nvc_npt_reassign_page_ownership(hpa_cur,gpa_cur,pages,virtual_machine->asid,false,ownership))
+				{
+					nv_dprintf("Violations in Reverse-Mapping Table are detected in page-mapping!\n");
+					st=noir_nsv_violation;
+					break;
+				}
+				// Record the pages in the ownership index so that teardown only visits pages of this VM.
+				noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
+				nvc_rmt_index_insert(&virtual_machine->rmt_index,hpa_cur,pages);
+				noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
+				gpa_cur+=pages;
+			}
+			// FIXME: If the page is mapped as secure guest, decrypt the pages.
+			if(range->attributes.nsv_secure)
 			{
 				noir_rmt_crypto_context crypto;
 				crypto.vm=(noir_nsv_virtual_machine_p)virtual_machine->header.vmsa.virt;
-				crypto.hpa_list=phys_array;
-				crypto.pages=mapping_info->pages;
+				crypto.hpa_list=hpa_cur;
+				crypto.pages=pages;
 				noir_svm_vmmcall(noir_svm_nsv_crypto_for_rmt,(ulong_ptr)&crypto);
 			}
-			// u32 increment[4]={page_4kb_shift,page_2mb_shift,page_1gb_shift,page_512gb_shift};
-			if(mapping_info->attributes.psize)return noir_not_implemented;
+			hpa_cur+=pages;
+		}
+		if(st==noir_success)
+		{
 			// Gain Exclusion of VM.
-			for(u32 i=0;i<255;i++)
-				if(virtual_machine->vcpu[i])
-					noir_acquire_pushlock_exclusive(&virtual_machine->vcpu[i]->header.vcpu_lock);
-			for(u32 i=0;i<mapping_info->pages;i++)
+			nvc_acquire_vm_exclusion(&virtual_machine->header);
+			// Capture the prior translations of all ranges before any of them is overwritten.
+			for(u32 i=0;i<count;i++)
 			{
-				u64 gpa=mapping_info->gpa+page_4kb_mult(i);
-				u64 hpa=phys_array[i];
-				st=nvc_svmc_set_page_map(&virtual_machine->nptm,gpa,hpa,mapping_info->attributes);
+				u32 pages=mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize);
+				if(!nvc_svmc_capture_page_map(&virtual_machine->nptm,mapping_info[i].gpa,pages,&journal))
+				{
+					st=noir_insufficient_resources;
+					break;
+				}
+			}
+			hpa_cur=phys_array;
+			for(;mapped<count && st==noir_success;mapped++)
+			{
+				noir_cvm_address_mapping_p range=&mapping_info[mapped];
+				u32 increment=noir_cvm_psize_pages(range->attributes.psize);
+				u32 pages=range->pages*increment;
+				// The host range of a large page is validated to be contiguous and aligned by the caller.
+				for(failed_page=0;failed_page<pages;failed_page+=increment)
+				{
+					st=nvc_svmc_set_page_map(&virtual_machine->nptm,range->gpa+page_4kb_mult((u64)failed_page),hpa_cur[failed_page],range->attributes);
+					if(st!=noir_success)break;
+				}
 				if(st!=noir_success)break;
+				// Merge the touched ranges into larger pages where possible.
+				nvc_svmc_coalesce_page_map(&virtual_machine->nptm,range->gpa,pages);
+				hpa_cur+=pages;
 			}
-			// Broadcast to all vCPUs that the TLBs are invalid now.
+			// Failure of mapping will result in restoring the translations overwritten so far.
+			// The range that failed is restored only for the pages mapped before the failure.
+			if(st!=noir_success)
+			{
+				for(u32 i=0;i<mapped;i++)
+					nvc_svmc_restore_page_map(&virtual_machine->nptm,mapping_info[i].gpa,mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize),mapping_info[i].attributes.psize,&journal);
+				if(mapped<count && failed_page)
+					nvc_svmc_restore_page_map(&virtual_machine->nptm,mapping_info[mapped].gpa,failed_page,mapping_info[mapped].attributes.psize,&journal);
+			}
+			// Invalidate the TLBs on processors that ran this VM and the software TLBs of all vCPUs.
+			nvc_svmc_invalidate_vm_tlb(virtual_machine);
 			for(u32 i=0;i<255;i++)
 				if(virtual_machine->vcpu[i])
-					virtual_machine->vcpu[i]->header.state_cache.tl_valid=false;
+					virtual_machine->vcpu[i]->header.state_cache.gt_valid=false;
 			// Release Exclusion of VM.
-			for(u32 i=0;i<255;i++)
-				if(virtual_machine->vcpu[i])
-					noir_release_pushlock_exclusive(&virtual_machine->vcpu[i]->header.vcpu_lock);
-			// Failure of mapping will result in unmapping.
-			if(st!=noir_success)nvc_svmc_set_unmapping(virtual_machine,mapping_info->gpa,mapping_info->pages);
+			nvc_release_vm_exclusion(&virtual_machine->header);
+			// Every range, mapped or not, has been reassigned in the first pass.
+			if(st!=noir_success)
+				nvc_svmc_revert_page_ownership(virtual_machine,mapping_info,count,phys_array);
 		}
 		else
 		{
-			nv_dprintf("Violations in Reverse-Mapping Table are detected in page-mapping!\n");
-			st=noir_nsv_violation;
+			// Return the ranges reassigned before the violation to the subverted host.
+			nvc_svmc_revert_page_ownership(virtual_machine,mapping_info,reassigned,phys_array);
 		}
-		noir_free_nonpg_memory(gpa_list);
 	}
+	nvc_free_prior_journal(&journal);
+	if(gpa_list)noir_free_nonpg_memory(gpa_list);
 	return st;
 }
 
+noir_status nvc_svmc_set_mapping(noir_svm_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u64p phys_array)
+{
+	return nvc_svmc_set_mapping_batch(virtual_machine,mapping_info,1,phys_array);
+}
+
 bool static nvc_svmc_clear_gpa_accessing_bit(noir_svm_custom_npt_manager_p nptm,u64 gpa)
 {
-	// Start from PML4E.
-	amd64_addr_translator trans;
-	trans.value=gpa;
-	if(nptm->ncr3.virt[trans.pml4e_offset].present)
+	amd64_npt_general_entry_p entry=nvc_svmc_get_leaf_entry(nptm,gpa);
+	if(entry)
 	{
-		// Traverse the linked list to check the nested paging.
-		noir_npt_pdpte_descriptor_p pdpte_p=nptm->pdpte.head;
-		while(pdpte_p)
-		{
-			if(gpa>=pdpte_p->gpa_start && gpa<pdpte_p->gpa_start+page_512gb_size && pdpte_p->virt[trans.pdpte_offset].present)
-			{
-				amd64_npt_huge_pdpte_p pdpte_t=(amd64_npt_huge_pdpte_p)&pdpte_p->virt[trans.pdpte_offset];
-				if(pdpte_t->huge_pdpte)
-				{
-					pdpte_t->accessed=pdpte_t->dirty=false;
-					return true;
-				}
-				else
-				{
-					noir_npt_pde_descriptor_p pde_p=nptm->pde.head;
-					while(pde_p)
-					{
-						if(gpa>=pde_p->gpa_start && gpa<pde_p->gpa_start+page_1gb_size && pde_p->virt[trans.pde_offset].present)
-						{
-							amd64_npt_large_pde_p pde_t=(amd64_npt_large_pde_p)&pde_p->virt[trans.pde_offset];
-							if(pde_t->large_pde)
-							{
-								pde_t->accessed=pde_t->dirty=false;
-								return true;
-							}
-							else
-							{
-								noir_npt_pte_descriptor_p pte_p=nptm->pte.head;
-								while(pte_p)
-								{
-									if(gpa>=pte_p->gpa_start && gpa<pte_p->gpa_start+page_2mb_size && pte_p->virt[trans.pte_offset].present)
-									{
-										pte_p->virt[trans.pte_offset].accessed=pte_p->virt[trans.pte_offset].dirty=false;
-										return true;
-									}
-									pte_p=pte_p->next;
-								}
-							}
-						}
-						pde_p=pde_p->next;
-					}
-				}
-			}
-			pdpte_p=pdpte_p->next;
-		}
+		entry->accessed=entry->dirty=false;
+		return true;
 	}
 	return false;
 }
@@ -1495,50 +2044,110 @@ noir_status nvc_svmc_clear_gpa_accessing_bits(noir_svm_custom_vm_p virtual_machi
 	return st;
 }
 
-u8 static nvc_svmc_query_gpa_accessing_bit(noir_svm_custom_npt_manager_p nptm,u64 gpa)
+// Report the pages written since the last harvest, one bit per page, and re-arm their dirty bits.
+// The NPT is walked in a single pass, 2MiB at a time. A dirty large page reports all of its 4KiB pages.
+// The processor sets the accessed bit of a non-leaf entry when it walks through the entry. If a PDE
+// or PDPTE has been clear since the last harvest, nothing below it was written. Such entries are
+// skipped without reading their subordinate tables, provided the range covers them entirely.
+noir_status nvc_svmc_harvest_gpa_dirty_bitmap(noir_svm_custom_vm_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate)
 {
-	// Start from PML4E.
-	amd64_addr_translator trans;
-	trans.value=gpa;
-	if(nptm->ncr3.virt[trans.pml4e_offset].present)
+	noir_status st=noir_buffer_too_small;
+	if(page_count<=(bitmap_size<<3))
 	{
-		// Traverse the linked list to check the nested paging.
-		noir_npt_pdpte_descriptor_p pdpte_p=nptm->pdpte.head;
-		while(pdpte_p)
+		noir_svm_custom_npt_manager_p nptm=&virtual_machine->nptm;
+		bool flush=false;
+		u32 i=0;
+		while(i<page_count)
 		{
-			if(gpa>=pdpte_p->gpa_start && gpa<pdpte_p->gpa_start+page_512gb_size && pdpte_p->virt[trans.pdpte_offset].present)
+			u64 gpa=gpa_start+page_4kb_mult((u64)i);
+			u32 remainder=page_count-i;
+			// Number of pages to the end of the 1GiB page and the 2MiB page.
+			u32 gb_pages=(u32)page_4kb_count(page_1gb_size-page_1gb_offset(gpa));
+			u32 mb_pages=(u32)page_4kb_count(page_2mb_size-page_2mb_offset(gpa));
+			amd64_addr_translator trans;
+			noir_npt_cvm_pdpte_descriptor_p pdpte_p;
+			noir_npt_cvm_pde_descriptor_p pde_p;
+			noir_npt_cvm_pte_descriptor_p pte_p;
+			trans.value=gpa;
+			if(gb_pages>remainder)gb_pages=remainder;
+			if(mb_pages>remainder)mb_pages=remainder;
+			// Walk the PDPTE.
+			pdpte_p=nptm->pdpte[trans.pml4e_offset];
+			if(pdpte_p==null || !pdpte_p->virt[trans.pdpte_offset].present)
 			{
-				amd64_npt_huge_pdpte_p pdpte_t=(amd64_npt_huge_pdpte_p)&pdpte_p->virt[trans.pdpte_offset];
-				if(pdpte_t->huge_pdpte)
-					return (u8)((pdpte_t->dirty<<1)+pdpte_t->accessed);
-				else
+				nvc_report_dirty_pages(bitmap,i,gb_pages,false,accumulate);
+				i+=gb_pages;
+				continue;
+			}
+			if(pdpte_p->huge[trans.pdpte_offset].huge_pdpte)
+			{
+				bool dirty=noir_locked_btr64((i64v*)&pdpte_p->huge[trans.pdpte_offset].value,amd64_npt_dirty_bit);
+				nvc_report_dirty_pages(bitmap,i,gb_pages,dirty,accumulate);
+				flush|=dirty;
+				i+=gb_pages;
+				continue;
+			}
+			if(gb_pages==page_4kb_count(page_1gb_size))
+			{
+				if(!noir_locked_btr64((i64v*)&pdpte_p->virt[trans.pdpte_offset].value,amd64_npt_accessed_bit))
 				{
-					noir_npt_pde_descriptor_p pde_p=nptm->pde.head;
-					while(pde_p)
-					{
-						if(gpa>=pde_p->gpa_start && gpa<pde_p->gpa_start+page_1gb_size && pde_p->virt[trans.pde_offset].present)
-						{
-							amd64_npt_large_pde_p pde_t=(amd64_npt_large_pde_p)&pde_p->virt[trans.pde_offset];
-							if(pde_t->large_pde)
-								return (u8)((pde_t->dirty<<1)+pde_t->accessed);
-							else
-							{
-								noir_npt_pte_descriptor_p pte_p=nptm->pte.head;
-								while(pte_p)
-								{
-									if(gpa>=pte_p->gpa_start && gpa<pte_p->gpa_start+page_2mb_size && pte_p->virt[trans.pte_offset].present)
-										return (u8)((pte_p->virt[trans.pte_offset].dirty<<1)+pte_p->virt[trans.pte_offset].accessed);
-									pte_p=pte_p->next;
-								}
-							}
-						}
-					}
-					pde_p=pde_p->next;
+					nvc_report_dirty_pages(bitmap,i,gb_pages,false,accumulate);
+					i+=gb_pages;
+					continue;
 				}
+				flush=true;
+			}
+			// Walk the PDE.
+			pde_p=pdpte_p->pde[trans.pdpte_offset];
+			if(pde_p==null || !pde_p->virt[trans.pde_offset].present)
+			{
+				nvc_report_dirty_pages(bitmap,i,mb_pages,false,accumulate);
+				i+=mb_pages;
+				continue;
 			}
-			pdpte_p=pdpte_p->next;
+			if(pde_p->large[trans.pde_offset].large_pde)
+			{
+				bool dirty=noir_locked_btr64((i64v*)&pde_p->large[trans.pde_offset].value,amd64_npt_dirty_bit);
+				nvc_report_dirty_pages(bitmap,i,mb_pages,dirty,accumulate);
+				flush|=dirty;
+				i+=mb_pages;
+				continue;
+			}
+			pte_p=pde_p->pte[trans.pde_offset];
+			if(pte_p && mb_pages==page_table_entries64)
+			{
+				if(noir_locked_btr64((i64v*)&pde_p->virt[trans.pde_offset].value,amd64_npt_accessed_bit))
+					flush=true;
+				else
+					pte_p=null;
+			}
+			if(pte_p==null)
+			{
+				nvc_report_dirty_pages(bitmap,i,mb_pages,false,accumulate);
+				i+=mb_pages;
+				continue;
+			}
+			// Test and clear the dirty bits in the page table.
+			for(u32 j=0;j<mb_pages;j++)
+			{
+				amd64_npt_pte_p pte=&pte_p->virt[trans.pte_offset+j];
+				bool dirty=pte->present && noir_locked_btr64((i64v*)&pte->value,amd64_npt_dirty_bit);
+				nvc_report_dirty_pages(bitmap,i+j,1,dirty,accumulate);
+				flush|=dirty;
+			}
+			i+=mb_pages;
 		}
+		// Cached translations and paging structures would not set the bits again unless the TLB is flushed.
+		if(flush)nvc_svmc_invalidate_vm_tlb(virtual_machine);
+		st=noir_success;
 	}
+	return st;
+}
+
+u8 static nvc_svmc_query_gpa_accessing_bit(noir_svm_custom_npt_manager_p nptm,u64 gpa)
+{
+	amd64_npt_general_entry_p entry=nvc_svmc_get_leaf_entry(nptm,gpa);
+	if(entry)return (u8)((entry->dirty<<1)+entry->accessed);
 	return 0xff;
 }
 
@@ -1606,57 +2215,69 @@ void nvc_svmc_setup_msr_interception_exception(void* msrpm)
 	noir_reset_bitmap(bitmap1,svm_msrpm_bit(1,amd64_pat,1));
 }
 
+typedef struct _noir_svm_rmt_list_context
+{
+	u64p hpa_list;
+	u32 count;
+}noir_svm_rmt_list_context,*noir_svm_rmt_list_context_p;
+
+void static nvc_svmc_list_secure_guest_page(u64 hpa,noir_rmt_entry_p entry,void* context)
+{
+	noir_svm_rmt_list_context_p list=(noir_svm_rmt_list_context_p)context;
+	if(entry->low.ownership==noir_nsv_rmt_secure_guest)
+		list->hpa_list[list->count++]=hpa;
+}
+
 void nvc_svmc_release_all_guest_pages(noir_svm_custom_vm_p vm)
 {
-	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	u32 pages=0;
+	u32 pages;
 	// Lock the RMT
 	noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
-	// Stage I: Scan the Reverse-Mapping Table.
-	for(u64 i=0;i<hvm_p->rmd.dir_count;i++)
-	{
-		const u64 total_pages=page_count(rmt_dir[i].hpa_end-rmt_dir[i].hpa_start);
-		for(u64 j=0;j<total_pages;j++)
-		{
-			noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[i].table.virt;
-			if(rm_table[j].low.asid==vm->asid && rm_table[j].low.ownership==noir_nsv_rmt_secure_guest)
-				pages++;	// Count the number of pages in the VM.
-		}
-	}
-	// Stage II: Make the list.
+	// Stage I: Count the pages in the VM with the ownership index.
+	pages=nvc_enum_rmt_entries_by_asid(&vm->rmt_index,vm->asid,null,null);
+	// Stage II: Make the list of secure pages.
 	if(pages)
 	{
-		u64p hpa_list=noir_alloc_nonpg_memory(pages<<3);
-		u32 k=0;
-		if(hpa_list)
+		noir_svm_rmt_list_context list;
+		list.hpa_list=noir_alloc_nonpg_memory(pages<<3);
+		list.count=0;
+		if(list.hpa_list)
 		{
-			for(u64 i=0;i<hvm_p->rmd.dir_count;i++)
+			nvc_enum_rmt_entries_by_asid(&vm->rmt_index,vm->asid,nvc_svmc_list_secure_guest_page,&list);
+			// Stage III: Perform Crypto Operation
+			if(list.count)
 			{
-				const u64 total_pages=page_count(rmt_dir[i].hpa_end-rmt_dir[i].hpa_start);
-				for(u64 j=0;j<total_pages;j++)
-				{
-					noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[i].table.virt;
-					if(rm_table[j].low.asid==vm->asid && rm_table[j].low.ownership==noir_nsv_rmt_secure_guest)
-						hpa_list[k++]=page_4kb_mult(j)+rmt_dir[i].hpa_start;
-				}
+				noir_rmt_crypto_context crypto;
+				crypto.vm=(noir_nsv_virtual_machine_p)vm->header.vmsa.virt;
+				crypto.hpa_list=list.hpa_list;
+				crypto.pages=list.count;
+				noir_svm_vmmcall(noir_svm_nsv_crypto_for_rmt,(ulong_ptr)&crypto);
 			}
+			// Release list...
+			noir_free_nonpg_memory(list.hpa_list);
 		}
-		// Stage III: Perform Crypto Operation
-		if(k==pages)
-		{
-			noir_rmt_crypto_context crypto;
-			crypto.vm=(noir_nsv_virtual_machine_p)vm->header.vmsa.virt;
-			crypto.hpa_list=hpa_list;
-			crypto.pages=pages;
-			noir_svm_vmmcall(noir_svm_nsv_crypto_for_rmt,(ulong_ptr)&crypto);
-		}
-		// Release list...
-		if(hpa_list)noir_free_nonpg_memory(hpa_list);
 	}
 	// Unlock the RMT
 	noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
 }
 
+void static nvc_svmc_release_npt(noir_svm_custom_npt_manager_p nptm)
+{
+	// Traverse the radix tree to release descriptors and paging structures...
+	if(nptm->pdpte)
+	{
+		for(u32 i=0;i<page_table_entries64;i++)
+			nvc_svmc_free_1gb_page_map(nptm,i);
+		noir_free_nonpg_memory(nptm->pdpte);
+		nptm->pdpte=null;
+	}
+	if(nptm->ncr3.virt)
+	{
+		noir_free_contd_memory(nptm->ncr3.virt,page_size);
+		nptm->ncr3.virt=null;
+	}
+}
+
 void nvc_svmc_release_vm(noir_svm_custom_vm_p vm)
 {
 	if(vm)
@@ -1665,6 +2286,12 @@ void nvc_svmc_release_vm(noir_svm_custom_vm_p vm)
 		noir_acquire_reslock_exclusive(vm->header.vcpu_list_lock);
 		if(vm->vcpu)
 		{
+			// Kick all vCPUs so that preempted runs would leave rather than wait for the exclusion.
+			for(u32 i=0;i<255;i++)
+				if(vm->vcpu[i])
+					nvc_kick_vcpu(&vm->vcpu[i]->header);
+			// Wait for running vCPUs to leave. The exclusion is gone with the VM structure.
+			nvc_acquire_vm_exclusion(&vm->header);
 			for(u32 i=0;i<255;i++)
 				if(vm->vcpu[i])
 					nvc_svmc_release_vcpu(vm->vcpu[i]);
@@ -1673,44 +2300,7 @@ void nvc_svmc_release_vm(noir_svm_custom_vm_p vm)
 		}
 		noir_release_reslock(vm->header.vcpu_list_lock);
 		// Release Nested Paging Structure.
-		if(vm->nptm.ncr3.virt)
-			noir_free_contd_memory(vm->nptm.ncr3.virt,page_size);
-		// Release PDPTE descriptors and paging structures...
-		if(vm->nptm.pdpte.head)
-		{
-			noir_npt_pdpte_descriptor_p cur=vm->nptm.pdpte.head;
-			while(cur)
-			{
-				noir_npt_pdpte_descriptor_p next=cur->next;
-				if(cur->virt)noir_free_contd_memory(cur->virt,page_size);
-				noir_free_nonpg_memory(cur);
-				cur=next;
-			}
-		}
-		// Release PDE descriptors and paging structures...
-		if(vm->nptm.pde.head)
-		{
-			noir_npt_pde_descriptor_p cur=vm->nptm.pde.head;
-			while(cur)
-			{
-				noir_npt_pde_descriptor_p next=cur->next;
-				if(cur->virt)noir_free_contd_memory(cur->virt,page_size);
-				noir_free_nonpg_memory(cur);
-				cur=next;
-			}
-		}
-		// Release PTE descriptors and paging structures...
-		if(vm->nptm.pte.head)
-		{
-			noir_npt_pte_descriptor_p cur=vm->nptm.pte.head;
-			while(cur)
-			{
-				noir_npt_pte_descriptor_p next=cur->next;
-				if(cur->virt)noir_free_contd_memory(cur->virt,page_size);
-				noir_free_nonpg_memory(cur);
-				cur=next;
-			}
-		}
+		nvc_svmc_release_npt(&vm->nptm);
 		if(hvm_p->options.enable_nsv)
 		{
 			// Encrypt all secure pages in the VM.
@@ -1724,8 +2314,12 @@ void nvc_svmc_release_vm(noir_svm_custom_vm_p vm)
 				noir_free_contd_memory(vm->header.vmsa.virt,page_size);
 			}
 		}
+		// Release Ownership Index
+		nvc_rmt_index_release(&vm->rmt_index);
 		// Release ASID
 		if(vm->asid!=0xffffffff)nvc_svmc_free_asid(vm->asid);
+		// Release TLB Tracker
+		if(vm->tlb_tracker.ran)noir_free_nonpg_memory((void*)vm->tlb_tracker.ran);
 		// Release MSRPM & IOPM
 		if(vm->msrpm.virt)noir_free_contd_memory(vm->msrpm.virt,page_size*2);
 		if(vm->msrpm_full.virt)noir_free_contd_memory(vm->msrpm_full.virt,page_size*2);
@@ -1756,8 +2350,18 @@ noir_status nvc_svmc_create_vm(noir_svm_custom_vm_p* virtual_machine)
 				vm->nptm.ncr3.phys=noir_get_physical_address(vm->nptm.ncr3.virt);
 			else
 				goto alloc_failure;
+			// Create the root of the shadow radix tree for NPT descriptors.
+			vm->nptm.pdpte=noir_alloc_nonpg_memory(sizeof(void*)*page_table_entries64);
+			if(vm->nptm.pdpte==null)goto alloc_failure;
 			// Allocate ASID for CVM.
 			vm->asid=nvc_svmc_alloc_asid();
+			// Allocate TLB Tracker. Both bitmaps are placed in the same allocation.
+			// An ASID may be reused from a released VM, so all processors start with stale TLBs.
+			vm->tlb_tracker.words=(hvm_p->cpu_count+31)>>5;
+			vm->tlb_tracker.ran=noir_alloc_nonpg_memory(vm->tlb_tracker.words<<3);
+			if(vm->tlb_tracker.ran==null)goto alloc_failure;
+			vm->tlb_tracker.stale=&vm->tlb_tracker.ran[vm->tlb_tracker.words];
+			noir_stosd((u32*)vm->tlb_tracker.stale,0xffffffff,vm->tlb_tracker.words);
 			// Allocate IOPM.
 			vm->iopm.virt=noir_alloc_contd_memory(page_size*3);
 			if(vm->iopm.virt)
@@ -1770,8 +2374,8 @@ noir_status nvc_svmc_create_vm(noir_svm_custom_vm_p* virtual_machine)
 				vm->msrpm.phys=noir_get_physical_address(vm->msrpm.virt);
 			else
 				goto alloc_failure;
-			vm->msrpm_full.virt=noir_alloc_contd_memory(page_size*3);
-			if(vm->msrpm.virt)
+			vm->msrpm_full.virt=noir_alloc_contd_memory(page_size*2);
+			if(vm->msrpm_full.virt)
 				vm->msrpm_full.phys=noir_get_physical_address(vm->msrpm_full.virt);
 			else
 				goto alloc_failure;
@@ -1822,6 +2426,7 @@ noir_status nvc_svmc_create_vm(noir_svm_custom_vm_p* virtual_machine)
 			// Setup MSR & I/O Interceptions.
 			// We want mostly-unconditional exits.
 			noir_stosb(vm->msrpm.virt,0xff,noir_svm_msrpm_size);
+			noir_stosb(vm->msrpm_full.virt,0xff,noir_svm_msrpm_size);
 			noir_stosb(vm->iopm.virt,0xff,noir_svm_iopm_size);
 			// Some MSRs are unnessary to be intercepted. Rule them out of interception.
 			nvc_svmc_setup_msr_interception_exception(vm->msrpm.virt);
@@ -190,9 +190,45 @@ void static noir_hvcode fastcall nvc_svm_cr_access_cvexit_handler(noir_gpr_state
 	cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.cr;
 }
 
+// Expected Intercept Code: 0x00, 0x10
+void static noir_hvcode fastcall nvc_svm_cr0_access_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// Accesses to CR0 are intercepted if lazy switching of extended state is armed.
+	// Load the extended state of the guest. The instruction will be re-executed with the real TS bit.
+	if(!cvcpu->special_state.fpu_owned)
+	{
+		nvc_svm_acquire_guest_fpu(vcpu,cvcpu);
+		// Profiler: Classify the interception as hypervisor's emulation.
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+	}
+	else
+		nvc_svm_cr_access_cvexit_handler(gpr_state,vcpu,cvcpu);
+}
+
+// Expected Intercept Code: 0x13
+void static noir_hvcode fastcall nvc_svm_cr3_write_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// Writes to CR3 are intercepted if the software TLB holds translations or the subverted host specifies so.
+	// Discard the software TLB. The instruction will be re-executed without interception.
+	nvc_svm_release_gva_tlb(cvcpu);
+	if(cvcpu->header.vcpu_options.intercept_cr3)
+		nvc_svm_cr_access_cvexit_handler(gpr_state,vcpu,cvcpu);
+	else
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+}
+
 // Expected Intercept Code: 0x20~0x3F
 void static noir_hvcode fastcall nvc_svm_dr_access_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
 {
+	// Accesses to DR0-DR3 and DR7 are intercepted if lazy switching of debug registers is armed.
+	// Load the debug registers of the guest and let the guest re-execute the instruction.
+	if(!cvcpu->special_state.dr_owned && !cvcpu->header.vcpu_options.intercept_drx)
+	{
+		nvc_svm_acquire_guest_debug_registers(vcpu,cvcpu);
+		// Profiler: Classify the interception as hypervisor's emulation.
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+		return;
+	}
 	// Access to Debug Registers is intercepted.
 	// We don't have to determine whether Interception is subject to be delivered to subverted host,
 	// in that accesses to debug registers are only intercepted if the subverted host specifies so.
@@ -253,6 +289,22 @@ void static noir_hvcode fastcall nvc_svm_exception_cvexit_handler(noir_gpr_state
 	cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.exception;
 }
 
+// Expected Intercept Code: 0x47
+void static noir_hvcode fastcall nvc_svm_nm_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// Device-Not-Available Exception is intercepted.
+	// If lazy switching of extended state is armed, load the extended state of the guest.
+	// The instruction will be re-executed. If the TS bit of the guest is set, #NM will be raised again.
+	if(!cvcpu->special_state.fpu_owned)
+	{
+		nvc_svm_acquire_guest_fpu(vcpu,cvcpu);
+		// Profiler: Classify the interception as hypervisor's emulation.
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+	}
+	else
+		nvc_svm_exception_cvexit_handler(gpr_state,vcpu,cvcpu);
+}
+
 // Expected Intercept Code: 0x52
 void static noir_hvcode fastcall nvc_svm_mc_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
 {
@@ -390,51 +442,17 @@ void static noir_hvcode fastcall nvc_svm_cpuid_cvexit_handler(noir_gpr_state_p g
 	{
 		// NoirVisor will be handling CVM's CPUID Interception.
 		u32 leaf=(u32)gpr_state->rax,subleaf=(u32)gpr_state->rcx;
-		noir_cpuid_general_info info={0};
-		bool qp_hit=false;
+		noir_cpuid_general_info info;
 		// Use QuickPath to handle CPUID interception.
-		// Search per-vCPU QuickPath list.
-		for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vcpu;i++)
+		// If the host is updating QuickPath, resume the guest without advancing rip so that cpuid is retried.
+		if(nvc_resolve_cpuid_quickpath(&cvcpu->vm->header,&cvcpu->header,leaf,subleaf,&info))
 		{
-			noir_cvm_cpuid_quickpath_info_p qp=&cvcpu->header.cpuid_quickpath[i];
-			if(qp->leaf==leaf)
-			{
-				if(qp->options.has_subleaf==false || qp->subleaf==subleaf)
-				{
-					info.eax=qp->eax;
-					info.ebx=qp->ebx;
-					info.ecx=qp->ecx;
-					info.edx=qp->edx;
-					qp_hit=true;
-					break;
-				}
-			}
-		}
-		if(!qp_hit)
-		{
-			// Search per-VM QuickPath list.
-			for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vm;i++)
-			{
-				noir_cvm_cpuid_quickpath_info_p qp=&cvcpu->vm->header.cpuid_quickpath[i];
-				if(qp->leaf==leaf)
-				{
-					if(qp->options.has_subleaf==false || qp->subleaf==subleaf)
-					{
-						info.eax=qp->eax;
-						info.ebx=qp->ebx;
-						info.ecx=qp->ecx;
-						info.edx=qp->edx;
-						qp_hit=true;
-						break;
-					}
-				}
-			}
+			*(u32*)&gpr_state->rax=info.eax;
+			*(u32*)&gpr_state->rbx=info.ebx;
+			*(u32*)&gpr_state->rcx=info.ecx;
+			*(u32*)&gpr_state->rdx=info.edx;
+			noir_svm_advance_rip(cvcpu->vmcb.virt);
 		}
-		*(u32*)&gpr_state->rax=info.eax;
-		*(u32*)&gpr_state->rbx=info.ebx;
-		*(u32*)&gpr_state->rcx=info.ecx;
-		*(u32*)&gpr_state->rdx=info.edx;
-		noir_svm_advance_rip(cvcpu->vmcb.virt);
 		// Profiler: Classify the interception.
 		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
 	}
@@ -499,6 +517,28 @@ void static noir_hvcode fastcall nvc_svm_hlt_cvexit_handler(noir_gpr_state_p gpr
 	if(cvcpu->vm->header.properties.nsv_guest)noir_svm_advance_rip(cvcpu->vmcb.virt);
 }
 
+// Expected Intercept Code: 0x79, 0xA2
+void static noir_hvcode fastcall nvc_svm_invlpg_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// The invlpg and invpcid instructions are intercepted only if the software TLB holds translations.
+	// Discard the software TLB. The instruction will be re-executed without interception.
+	nvc_svm_release_gva_tlb(cvcpu);
+	// Profiler: Classify the interception.
+	cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+}
+
+// Expected Intercept Code: 0xA0
+void static noir_hvcode fastcall nvc_svm_invlpgb_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// The invlpgb instruction is intercepted only if the software TLB holds translations.
+	// It invalidates translations on all processors, so discard the software TLBs of all vCPUs.
+	// The instruction will be re-executed without interception.
+	nvc_shootdown_gva_tlb(&cvcpu->vm->header);
+	nvc_svm_release_gva_tlb(cvcpu);
+	// Profiler: Classify the interception.
+	cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+}
+
 // Expected Intercept Code: 0x7A
 void static noir_hvcode fastcall nvc_svm_invlpga_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
 {
@@ -552,7 +592,7 @@ bool static fastcall nvc_svm_rdmsr_cvexit_handler(noir_gpr_state_p gpr_state,noi
 	u32 index=(u32)gpr_state->rcx;
 	large_integer val;
 	bool advance=true;
-	nvd_printf("Intercepted MSR-read for Index=0x%X!\n",index);
+	nvd_trace1(noir_trace_event_msr_read,index);
 	switch(index)
 	{
 		case amd64_tsc:
@@ -659,7 +699,7 @@ bool static fastcall nvc_svm_wrmsr_cvexit_handler(noir_gpr_state_p gpr_state,noi
 	bool advance=true;
 	val.low=(u32)gpr_state->rax;
 	val.high=(u32)gpr_state->rdx;
-	nvd_printf("Intercepted MSR-write to Index=0x%X! Incoming Value: 0x%016llX\n",index,val.value);
+	nvd_trace2(noir_trace_event_msr_write,index,val.value);
 	switch(index)
 	{
 		case amd64_tsc:
@@ -760,12 +800,33 @@ void static noir_hvcode fastcall nvc_svm_msr_cvexit_handler(noir_gpr_state_p gpr
 	bool op_write=noir_svm_vmread8(cvcpu->vmcb.virt,exit_info1);
 	const u32 index=(const u32)gpr_state->rcx;
 	bool emulate=false;
+	noir_cvm_msr_quickpath_result qp_result;
+	large_integer val;
+	val.low=(u32)gpr_state->rax;
+	val.high=(u32)gpr_state->rdx;
 	if(index>=0x40000000 && index<0x80000000)
 	{
 		// These are MSRs reserved by NoirVisor. User hypervisors cannot intercept them.
 		bool no_exit=op_write?nvc_svm_wrmsr_nsvexit_handler(gpr_state,vcpu,cvcpu):nvc_svm_rdmsr_nsvexit_handler(gpr_state,vcpu,cvcpu);
 		if(!no_exit)nvc_svm_switch_to_host_vcpu(gpr_state,vcpu);
 	}
+	else if((qp_result=nvc_handle_msr_quickpath(&cvcpu->vm->header,index,op_write,&val.value))!=noir_cvm_msr_quickpath_miss)
+	{
+		// User Hypervisor registered this MSR into the Quick-Path. Handle it without leaving the hypervisor.
+		if(qp_result==noir_cvm_msr_quickpath_fault)
+			nvc_svm_inject_cvm_exception(gpr_state,vcpu,cvcpu,amd64_general_protection,true,0,0,0,null);
+		else
+		{
+			if(!op_write)
+			{
+				*(u32*)&gpr_state->rax=val.low;
+				*(u32*)&gpr_state->rdx=val.high;
+			}
+			noir_svm_advance_rip(cvcpu->vmcb.virt);
+		}
+		// Profiler: Classify the interception.
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+	}
 	else if(cvcpu->header.vcpu_options.intercept_msr)
 	{
 		bool intercept=true;
@@ -886,10 +947,10 @@ void static noir_hvcode fastcall nvc_svm_msr_cvexit_handler(noir_gpr_state_p gpr
 		// Profiler: Classify the interception as hypervisor's emulation.
 		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
 		if(advance)
-			noir_svm_advance_rip(cvcpu);
+			noir_svm_advance_rip(cvcpu->vmcb.virt);
 		else
 		{
-			nvd_printf("Intercepted unknown MSR access! (Index=%u, Op=%s)\n",index,op_write?"Write":"Read");
+			nvd_trace2(noir_trace_event_msr_unknown,index,op_write);
 			nvc_svm_inject_cvm_exception(gpr_state,vcpu,cvcpu,amd64_invalid_opcode,false,0,0,0,null);
 		}
 	}
@@ -973,6 +1034,21 @@ void static noir_hvcode fastcall nvc_svm_skinit_cvexit_handler(noir_gpr_state_p
 	cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
 }
 
+// Expected Intercept Code: 0x8D
+void static noir_hvcode fastcall nvc_svm_xsetbv_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
+{
+	// The xsetbv instruction is intercepted if lazy switching of extended state is armed.
+	// Load the extended state of the guest under the same XCR0. The instruction will be re-executed without interception.
+	if(!cvcpu->special_state.fpu_owned)
+	{
+		nvc_svm_acquire_guest_fpu(vcpu,cvcpu);
+		// Profiler: Classify the interception as hypervisor's emulation.
+		cvcpu->header.statistics_internal.selector=&cvcpu->header.statistics.interceptions.emulation;
+	}
+	else
+		nvc_svm_default_cvexit_handler(gpr_state,vcpu,cvcpu);
+}
+
 // Expected Intercept Code: 0x400
 void static noir_hvcode fastcall nvc_svm_nested_pf_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu)
 {
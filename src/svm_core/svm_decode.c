@@ -37,7 +37,7 @@ bool nvc_svm_translate_custom_gpa(u64 pt,u32 level,u64 gpa,u32 access,u64p hpa,n
 	err_code->value=0;
 	err_code->present=table[index].present<noir_bt(&access,noir_cvm_map_gpa_read);
 	err_code->write=table[index].write<noir_bt(&access,noir_cvm_map_gpa_write);
-	err_code->execute=table[index].no_execute>noir_bt(&access,noir_cvm_map_gpa_execute);
+	err_code->execute=table[index].no_execute && noir_bt(&access,noir_cvm_map_gpa_execute);
 	if(err_code->value)
 	{
 		nvd_printf("[SVM-GPA Translation] Permission is not granted at level %u! #PF Error: 0x%X\n",level,err_code->value);
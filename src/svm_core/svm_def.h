@@ -20,6 +20,9 @@
 #define noir_svm_iopm_size		0x2001
 #define noir_svm_msrpm_size		0x1800
 
+// Exit profiler slots: 0xA5 codes in group 1, 4 codes in group 2 and 3 negative codes.
+#define noir_svm_exit_profiler_reasons	0xAC
+
 typedef union _svm_segment_access_rights
 {
 	struct
@@ -71,6 +74,17 @@ typedef union _nvc_svm_cra_intercept
 	u32 value;
 }nvc_svm_cra_intercept,*nvc_svm_cra_intercept_p;
 
+// Intercepts armed for lazy switching of extended state and debug registers.
+#define nvc_svm_lazy_cr0_read_intercept		0
+#define nvc_svm_lazy_cr0_write_intercept	16
+#define nvc_svm_lazy_dr_intercepts			0x008F008F		// Reads and writes to DR0-DR3 and DR7.
+#define nvc_svm_lazy_xsetbv_intercept		nvc_svm_intercept_vector2_xsetbv
+
+// Intercepts armed while the software TLB of guest-virtual translations holds entries.
+#define nvc_svm_gva_tlb_cr3_write_intercept	19
+#define nvc_svm_gva_tlb_invpcid_intercept	2
+#define nvc_svm_gva_tlb_invlpgb_intercept	0
+
 typedef union _nvc_svm_dr_intercept
 {
 	struct
@@ -238,6 +252,12 @@ typedef union _nvc_svm_instruction_interception3
 #define nvc_svm_tlb_control_flush_guest			3
 #define nvc_svm_tlb_control_flush_non_global	7
 
+// INVLPGB Operand Flags in rAX
+#define noir_svm_invlpgb_va_valid			0x1
+#define noir_svm_invlpgb_pcid_valid			0x2
+#define noir_svm_invlpgb_asid_valid			0x4
+#define noir_svm_invlpgb_include_global		0x8
+
 typedef union _nvc_svm_asid_control
 {
 	struct
@@ -1130,6 +1130,19 @@ void static noir_hvcode fastcall nvc_svm_vmmcall_handler(noir_gpr_state_p gpr_st
 	ulong_ptr gip=noir_svm_vmread(vcpu->vmcb.virt,guest_rip);
 	ulong_ptr gcr3=noir_svm_vmread(vcpu->vmcb.virt,guest_cr3);
 	unref_var(context);
+	// Hv#1 hypercalls are issued from the hypercall page with a signature in eax.
+	if((u32)gpr_state->rax==noir_mshv_hypercall_signature && hvm_p->options.cpuid_hv_presence)
+	{
+		if(noir_svm_vmread8(vcpu->vmcb.virt,guest_cpl)==0)
+		{
+			// The rax in GPR state is saved to VMCB after the handler returns.
+			gpr_state->rax=nvc_mshv_hypercall_handler(&vcpu->mshvcpu,gpr_state->rcx,gpr_state->rdx,gpr_state->r8);
+			noir_svm_advance_rip(vcpu->vmcb.virt);
+		}
+		else
+			noir_svm_inject_event(vcpu->vmcb.virt,amd64_invalid_opcode,amd64_fault_trap_exception,false,false,0);
+		return;
+	}
 	switch(vmmcall_func)
 	{
 		case noir_svm_callexit:
@@ -1225,8 +1238,22 @@ void static noir_hvcode fastcall nvc_svm_vmmcall_handler(noir_gpr_state_p gpr_st
 #else
 				noir_svm_custom_vcpu_p cvcpu=(noir_svm_custom_vcpu_p)context;
 #endif
+				u32 run_state;
 				cvcpu->header.statistics_internal.runtime_start=noir_get_system_time();
 				nvc_svm_switch_to_guest_vcpu(gpr_state,vcpu,cvcpu);
+				// Publish that the vCPU is in guest mode so that kickers would interrupt this processor.
+				// A kick or preemption published earlier did not interrupt this processor. Return to the host at once.
+				run_state=noir_locked_or(&cvcpu->header.run_state,1<<noir_cvm_vcpu_in_guest);
+				if(noir_bt(&run_state,noir_cvm_vcpu_kicked))
+				{
+					nvc_svm_switch_to_host_vcpu(gpr_state,vcpu);
+					cvcpu->header.exit_context.intercept_code=cv_rescission;
+				}
+				else if(noir_bt(&run_state,noir_cvm_vcpu_preempted))
+				{
+					nvc_svm_switch_to_host_vcpu(gpr_state,vcpu);
+					cvcpu->header.exit_context.intercept_code=cv_scheduler_exit;
+				}
 			}
 			else
 				noir_svm_inject_event(vcpu->vmcb.virt,amd64_invalid_opcode,amd64_fault_trap_exception,false,false,0);
@@ -1276,8 +1303,7 @@ void static noir_hvcode fastcall nvc_svm_vmmcall_handler(noir_gpr_state_p gpr_st
 #endif
 				reassignment->result=nvc_validate_rmt_reassignment(reassignment->hpa_list,reassignment->gpa_list,reassignment->pages,reassignment->asid,reassignment->shared,reassignment->ownership);
 				if(reassignment->result)	// If validation fails, do not reconfigure the reverse mapping.
-					for(u32 i=0;i<reassignment->pages;i++)
-						nvc_configure_reverse_mapping(reassignment->hpa_list[i],reassignment->gpa_list[i],reassignment->asid,reassignment->shared,reassignment->ownership);
+					nvc_configure_reverse_mapping_list(reassignment->hpa_list,reassignment->gpa_list,reassignment->pages,reassignment->asid,reassignment->shared,reassignment->ownership);
 			}
 			break;
 		}
@@ -1310,10 +1336,11 @@ void static noir_hvcode fastcall nvc_svm_vmmcall_handler(noir_gpr_state_p gpr_st
 					noir_rmt_entry_p rm_table=nvc_get_rmt_entry(crypto->hpa_list[i]);
 					void* page=(void*)crypto->hpa_list[i];
 					// If the page is assigned to a secure guest, then decryption is required.
+					// The physical address is the tweak so that identical pages are encrypted differently.
 					if(rm_table->low.ownership==noir_nsv_rmt_secure_guest)
-						noir_aes128_decrypt_pages(page,vm->expanded_decryption_keys,1,vm->aes_key);
+						noir_aes128_decrypt_pages(page,vm->expanded_decryption_keys,1,vm->aes_key,crypto->hpa_list[i],vm->expanded_encryption_keys);
 					else
-						noir_aes128_encrypt_pages(page,vm->expanded_encryption_keys,1,vm->aes_key);
+						noir_aes128_encrypt_pages(page,vm->expanded_encryption_keys,1,vm->aes_key,crypto->hpa_list[i]);
 				}
 			}
 			break;
@@ -1744,6 +1771,16 @@ void static noir_hvcode fastcall nvc_svm_nested_pf_handler(noir_gpr_state_p gpr_
 	}
 }
 
+// Map the intercept code to the slot in the exit profiler.
+u32 noir_hvcode nvc_svm_get_exit_profiler_reason(i32 intercept_code)
+{
+	if(intercept_code<0)
+		return noir_svm_maximum_code1+noir_svm_maximum_code2+(~intercept_code);
+	else if(intercept_code&0xC00)
+		return noir_svm_maximum_code1+(intercept_code&0x3FF);
+	return intercept_code;
+}
+
 void noir_hvcode fastcall nvc_svm_exit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu)
 {
 	// Get the linear address of VMCB.
@@ -1753,9 +1790,14 @@ void noir_hvcode fastcall nvc_svm_exit_handler(noir_gpr_state_p gpr_state,noir_s
 	{
 		// Subverted Host is exiting...
 		const void* vmcb_va=vcpu->vmcb.virt;
+		// Profiler: Timestamp the VM-Exit only if the exit profiler is enabled.
+		noir_exit_profiler_p profiler=vcpu->cvm_state.profiler;
+		u64 profiler_tsc=0;
+		u32 profiler_aux;
 		// Read the Intercept Code.
 		// KVM has a bug that intercept-codes are treated as 32-bit integers.
 		i32 intercept_code=noir_svm_vmread32(vmcb_va,exit_code);
+		if(unlikely(profiler!=null))profiler_tsc=noir_rdtscp(&profiler_aux);
 		// Determine the group and number of interception.
 		u8 code_group=(u8)((intercept_code&0xC00)>>10);
 		u16 code_num=(u16)(intercept_code&0x3FF);
@@ -1781,6 +1823,8 @@ void noir_hvcode fastcall nvc_svm_exit_handler(noir_gpr_state_p gpr_state,noir_s
 		// Since rax register is operated, save to VMCB.
 		// If world is switched, do not write to VMCB.
 		if(loader_stack->guest_vmcb_pa==vcpu->vmcb.phys)noir_svm_vmwrite(vmcb_va,guest_rax,gpr_state->rax);
+		// Profiler: Record the cycles spent in the handler.
+		if(unlikely(profiler!=null))nvc_record_exit_latency(profiler,nvc_svm_get_exit_profiler_reason(intercept_code),noir_rdtscp(&profiler_aux)-profiler_tsc);
 	}
 	else if(gpr_state->rax==loader_stack->custom_vcpu->vmcb.phys)
 	{
@@ -1788,6 +1832,10 @@ void noir_hvcode fastcall nvc_svm_exit_handler(noir_gpr_state_p gpr_state,noir_s
 		// Customizable VM is exiting...
 		noir_svm_custom_vcpu_p cvcpu=loader_stack->custom_vcpu;
 		const void* vmcb_va=cvcpu->vmcb.virt;
+		noir_exit_profiler_p profiler=cvcpu->header.profiler;
+		u64 profiler_tsc=0;
+		u32 profiler_aux;
+		if(unlikely(profiler!=null))profiler_tsc=noir_rdtscp(&profiler_aux);
 		// Read the Intercept Code.
 		// KVM has a bug that intercept-codes are treated as 32-bit integers.
 		i32 intercept_code=noir_svm_vmread32(vmcb_va,exit_code);
@@ -1830,15 +1878,15 @@ void noir_hvcode fastcall nvc_svm_exit_handler(noir_gpr_state_p gpr_state,noir_s
 			if(!cvcpu->vm->header.properties.nsv_guest)
 			{
 				// If the exit is due to the scheduler, saving exit context is utterly meaningless.
+				// Scheduler exits caused by kicks are reported as rescissions when the run path leaves.
 				if(cvcpu->header.exit_context.intercept_code!=cv_scheduler_exit && cvcpu->header.exit_context.vcpu_state.loaded==false)
 					nvc_svm_load_basic_exit_context(cvcpu);
-				else if(noir_locked_btr64(&cvcpu->special_state,63))		// User Hypervisor rescinded execution of vCPU.
-					cvcpu->header.exit_context.intercept_code=cv_rescission;
 			}
 		}
 		// Profiler: accumulate the Hypervisor runtime.
 		cvcpu->header.statistics_internal.selector->time+=noir_get_system_time()-profiler_time;
 		cvcpu->header.statistics_internal.selector->count++;
+		if(unlikely(profiler!=null))nvc_record_exit_latency(profiler,nvc_svm_get_exit_profiler_reason(intercept_code),noir_rdtscp(&profiler_aux)-profiler_tsc);
 	}
 	else if(gpr_state->rax==loader_stack->nested_vcpu->vmcb_t.phys)
 	{
@@ -1881,6 +1929,54 @@ void nvc_svm_set_mshv_handler(bool option)
 	nvcp_svm_cpuid_handler=option?nvc_svm_cpuid_hvp_handler:nvc_svm_cpuid_hvs_handler;
 }
 
+// Invalidate the guest's TLB on behalf of Hv#1 flush hypercalls.
+// The return value indicates whether the requested processors are all flushed.
+bool noir_hvcode nvc_svm_mshv_flush_guest_tlb(noir_svm_vcpu_p vcpu,u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	void* vmcb=vcpu->vmcb.virt;
+	u32 asid=noir_svm_vmread32(vmcb,guest_asid);
+	if(nvc_svm_is_broadcast_tlb_flush_supported())
+	{
+		// Broadcast the invalidation to all processors. The guest uses the same ASID everywhere.
+		u64 flags=noir_svm_invlpgb_asid_valid;
+		if(!non_global)flags|=noir_svm_invlpgb_include_global;
+		if(gva_list)
+		{
+			const u32 stride=(u32)hvm_p->relative_hvm->ext_cap.invlpgb_count_max+1;
+			for(u32 i=0;i<count;i++)
+			{
+				u64 va=page_base(gva_list[i]);
+				u32 pages=(u32)page_offset(gva_list[i])+1;
+				while(pages)
+				{
+					u32 n=pages>stride?stride:pages;
+					noir_svm_invlpgb(va|flags|noir_svm_invlpgb_va_valid,asid<<16,n-1);
+					va+=page_mult((u64)n);
+					pages-=n;
+				}
+			}
+		}
+		else
+			noir_svm_invlpgb(flags,asid<<16,0);
+		noir_svm_tlbsync();
+		return true;
+	}
+	// Without INVLPGB, remote processors cannot be flushed without IPIs.
+	if(remote)return false;
+	if(gva_list)
+	{
+		for(u32 i=0;i<count;i++)
+		{
+			u64 va=page_base(gva_list[i]);
+			for(u32 j=0;j<=(u32)page_offset(gva_list[i]);j++)
+				noir_svm_invlpga((ulong_ptr)(va+page_mult((u64)j)),asid);
+		}
+	}
+	else
+		noir_svm_vmwrite8(vmcb,tlb_control,non_global?nvc_svm_tlb_control_flush_non_global:nvc_svm_tlb_control_flush_guest);
+	return true;
+}
+
 // Prior to calling this function, it is required to setup guest state fields.
 void noir_hvcode nvc_svm_reconfigure_npiep_interceptions(noir_svm_vcpu_p vcpu)
 {
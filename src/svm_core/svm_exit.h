@@ -303,9 +303,12 @@ void static fastcall nvc_svm_default_cvexit_handler(noir_gpr_state_p gpr_state,n
 void static fastcall nvc_svm_invalid_state_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_cr4_read_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_cr4_write_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_cr0_access_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_cr_access_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_cr3_write_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_dr_access_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_exception_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_nm_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_mc_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_sx_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_extint_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
@@ -316,6 +319,8 @@ void static fastcall nvc_svm_cpuid_cvexit_handler(noir_gpr_state_p gpr_state,noi
 void static fastcall nvc_svm_iret_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_invd_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_hlt_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_invlpg_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_invlpgb_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_invlpga_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_io_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_msr_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
@@ -327,6 +332,7 @@ void static fastcall nvc_svm_vmsave_cvexit_handler(noir_gpr_state_p gpr_state,no
 void static fastcall nvc_svm_stgi_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_clgi_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_skinit_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
+void static fastcall nvc_svm_xsetbv_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_nested_pf_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_incomplete_ipi_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
 void static fastcall nvc_svm_unaccelerated_avic_cvexit_handler(noir_gpr_state_p gpr_state,noir_svm_vcpu_p vcpu,noir_svm_custom_vcpu_p cvcpu);
@@ -334,11 +340,11 @@ void static fastcall nvc_svm_unaccelerated_avic_cvexit_handler(noir_gpr_state_p
 noir_hvdata noir_svm_cvexit_handler_routine svm_cvexit_handler_group1[noir_svm_maximum_code1]=
 {
 	// 16 Control-Register Read & Write Handlers.
-	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
+	nvc_svm_cr0_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
 	nvc_svm_cr4_read_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
 	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
 	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
-	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
+	nvc_svm_cr0_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr3_write_cvexit_handler,
 	nvc_svm_cr4_write_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
 	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
 	nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,nvc_svm_cr_access_cvexit_handler,
@@ -353,7 +359,7 @@ noir_hvdata noir_svm_cvexit_handler_routine svm_cvexit_handler_group1[noir_svm_m
 	nvc_svm_dr_access_cvexit_handler,nvc_svm_dr_access_cvexit_handler,nvc_svm_dr_access_cvexit_handler,nvc_svm_dr_access_cvexit_handler,
 	// 32 Exception Handlers.
 	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,
-	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,
+	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_nm_cvexit_handler,
 	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,
 	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,
 	nvc_svm_exception_cvexit_handler,nvc_svm_exception_cvexit_handler,nvc_svm_mc_cvexit_handler,nvc_svm_exception_cvexit_handler,
@@ -386,7 +392,7 @@ noir_hvdata noir_svm_cvexit_handler_routine svm_cvexit_handler_group1[noir_svm_m
 	nvc_svm_invd_cvexit_handler,		// invd Instruction
 	nvc_svm_default_cvexit_handler,		// pause Instruction	
 	nvc_svm_hlt_cvexit_handler,			// hlt Instruction
-	nvc_svm_default_cvexit_handler,		// invlpg Instruction
+	nvc_svm_invlpg_cvexit_handler,		// invlpg Instruction
 	nvc_svm_invlpga_cvexit_handler,		// invlpga Instruction
 	nvc_svm_io_cvexit_handler,			// in/out Instruction
 	nvc_svm_msr_cvexit_handler,			// rdmsr/wrmsr Instruction
@@ -408,7 +414,7 @@ noir_hvdata noir_svm_cvexit_handler_routine svm_cvexit_handler_group1[noir_svm_m
 	nvc_svm_default_cvexit_handler,		// mwait(x) Instruction
 	nvc_svm_default_cvexit_handler,		// mwait(x) Instruction if Armed
 	nvc_svm_default_cvexit_handler,		// rdpru Instruction
-	nvc_svm_default_cvexit_handler,		// xsetbv Instruction
+	nvc_svm_xsetbv_cvexit_handler,		// xsetbv Instruction
 	nvc_svm_default_cvexit_handler,		// Post EFER MSR Write Trap
 	// 16 Control-Register Post-Write Exit Handler
 	nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,
@@ -416,9 +422,9 @@ noir_hvdata noir_svm_cvexit_handler_routine svm_cvexit_handler_group1[noir_svm_m
 	nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,
 	nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,nvc_svm_default_cvexit_handler,
 	// 5 Interception Handlers from Vector 3
-	nvc_svm_default_cvexit_handler,		// invlpgb Instruction
+	nvc_svm_invlpgb_cvexit_handler,		// invlpgb Instruction
 	nvc_svm_default_cvexit_handler,		// Illegal invlpgb Instruction
-	nvc_svm_default_cvexit_handler,		// invpcid Instruction
+	nvc_svm_invlpg_cvexit_handler,		// invpcid Instruction
 	nvc_svm_default_cvexit_handler,		// mcommit Instruction
 	nvc_svm_default_cvexit_handler		// tlbsync Instruction
 };
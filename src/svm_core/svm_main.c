@@ -26,8 +26,16 @@
 void nvc_query_svm_capability()
 {
 	noir_svm_hvm_p rhvm=hvm_p->relative_hvm;
+	u32 d;
 	noir_cpuid(amd64_cpuid_ext_svm_features,0,null,&rhvm->virt_cap.asid_limit,null,&rhvm->virt_cap.capabilities);
 	noir_cpuid(amd64_cpuid_ext_mem_crypting,0,&rhvm->sev_cap.capabilities,&rhvm->sev_cap.mem_virt_cap,&rhvm->sev_cap.simultaneous,&rhvm->sev_cap.minimum_asid);
+	noir_cpuid(amd64_cpuid_ext_pcap_prm_eid,0,null,&rhvm->ext_cap.capabilities,null,&d);
+	rhvm->ext_cap.invlpgb_count_max=(u16)d;
+}
+
+bool nvc_svm_is_broadcast_tlb_flush_supported()
+{
+	return noir_bt(&hvm_p->relative_hvm->ext_cap.capabilities,amd64_cpuid_invlpgb);
 }
 
 bool nvc_is_svm_supported()
@@ -54,6 +62,13 @@ bool nvc_is_npt_supported()
 	return npt_support;
 }
 
+bool nvc_is_npt_1gb_page_supported()
+{
+	u32 a,b,c,d;
+	noir_cpuid(amd64_cpuid_ext_proc_feature,0,&a,&b,&c,&d);
+	return noir_bt(&d,amd64_cpuid_page1gb);
+}
+
 bool nvc_is_acnested_svm_supported()
 {
 	u32 a,b,c,d;
@@ -562,6 +577,7 @@ void nvc_svm_cleanup(noir_hypervisor_p hvm_p)
 				noir_free_nonpg_memory(vcpu->hv_stack);
 			if(vcpu->cvm_state.xsave_area)
 				noir_free_contd_memory(vcpu->cvm_state.xsave_area,page_size);
+			nvc_free_exit_profiler(vcpu->cvm_state.profiler);
 			for(u32 j=0;j<noir_svm_cached_nested_vmcb;j++)
 				if(vcpu->nested_hvm.node_pool[j].vmcb_t.virt)
 					noir_free_contd_memory(vcpu->nested_hvm.node_pool[j].vmcb_t.virt,page_size);
@@ -599,6 +615,9 @@ void nvc_svm_cleanup(noir_hypervisor_p hvm_p)
 			noir_free_contd_memory(entry[i].table.virt,size);
 		}
 		noir_free_contd_memory(hvm_p->rmd.directory.virt,page_size);
+		// Memory hot-add does not extend the released table.
+		hvm_p->rmd.directory.virt=null;
+		hvm_p->rmd.dir_count=0;
 	}
 }
 
@@ -626,31 +645,35 @@ noir_status nvc_svm_subvert_system(noir_hypervisor_p hvm_p)
 		for(u32 i=0;i<hvm_p->cpu_count;i++)
 		{
 			noir_svm_vcpu_p vcpu=&hvm_p->virtual_cpu[i];
-			vcpu->vmcb.virt=noir_alloc_contd_memory(page_size);
+			// Place per-processor structures on the processor's local NUMA node, so VM-Exits would not touch remote memory.
+			const u32 node=noir_get_processor_numa_node(i);
+			nv_dprintf("Processor %u: hypervisor structures are placed on NUMA node %u.\n",i,node);
+			vcpu->vmcb.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->vmcb.virt)
 				vcpu->vmcb.phys=noir_get_physical_address(vcpu->vmcb.virt);
 			else
 				goto alloc_failure;
-			vcpu->hsave.virt=noir_alloc_contd_memory(page_size);
+			vcpu->hsave.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->hsave.virt)
 				vcpu->hsave.phys=noir_get_physical_address(vcpu->hsave.virt);
 			else
 				goto alloc_failure;
-			vcpu->hvmcb.virt=noir_alloc_contd_memory(page_size);
+			vcpu->hvmcb.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->hvmcb.virt)
 				vcpu->hvmcb.phys=noir_get_physical_address(vcpu->hvmcb.virt);
 			else
 				goto alloc_failure;
-			vcpu->hv_stack=noir_alloc_nonpg_memory(nvc_stack_size);
+			vcpu->hv_stack=noir_alloc_nonpg_memory_for_numa(node,nvc_stack_size);
 			if(vcpu->hv_stack==null)goto alloc_failure;
-			vcpu->cvm_state.xsave_area=noir_alloc_contd_memory(hvm_p->xfeat.supported_size_max);
+			vcpu->cvm_state.xsave_area=noir_alloc_contd_memory_for_numa(node,hvm_p->xfeat.supported_size_max);
 			if(vcpu->cvm_state.xsave_area==null)goto alloc_failure;
+			vcpu->cvm_state.profiler=nvc_alloc_exit_profiler(noir_svm_exit_profiler_reasons);
 			vcpu->relative_hvm=(noir_svm_hvm_p)hvm_p->reserved;
 			if(hvm_p->options.nested_virtualization)		// Setup Nested Hypervisor
 			{
 				for(u32 j=0;j<noir_svm_cached_nested_vmcb;j++)
 				{
-					vcpu->nested_hvm.node_pool[j].vmcb_t.virt=noir_alloc_contd_memory(page_size);
+					vcpu->nested_hvm.node_pool[j].vmcb_t.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 					if(vcpu->nested_hvm.node_pool[j].vmcb_t.virt)
 						vcpu->nested_hvm.node_pool[j].vmcb_t.phys=noir_get_physical_address(vcpu->nested_hvm.node_pool[j].vmcb_t.virt);
 					else
@@ -688,6 +711,7 @@ noir_status nvc_svm_subvert_system(noir_hypervisor_p hvm_p)
 	if(nvc_npt_initialize_ci(hvm_p->relative_hvm->primary_nptm)==false)goto alloc_failure;
 	hvm_p->host_pat.value=noir_rdmsr(amd64_pat);
 	hvm_p->relative_hvm->hvm_cpuid_leaf_max=nvc_mshv_build_cpuid_handlers();
+	nvc_mshv_initialize_reference_time();
 	if(hvm_p->relative_hvm->hvm_cpuid_leaf_max==0)goto alloc_failure;
 	hvm_p->relative_hvm->msrpm.virt=noir_alloc_contd_memory(2*page_size);
 	if(hvm_p->relative_hvm->msrpm.virt)
@@ -702,6 +726,10 @@ noir_status nvc_svm_subvert_system(noir_hypervisor_p hvm_p)
 #if !defined(_hv_type1)
 	// Initialize CVM Module.
 	if(nvc_svmc_initialize_cvm_module()!=noir_success)goto alloc_failure;
+	// NPT always supports 2MiB pages. 1GiB pages are supported in accordance to host paging.
+	hvm_p->cvm_cap.large_page=true;
+	hvm_p->cvm_cap.huge_page=nvc_is_npt_1gb_page_supported();
+	hvm_p->cvm_cap.msr_quick_path=true;
 	// If nested virtualization is disabled, reserve all available ASIDs to CVMs.
 	// Otherwise, reserve half of ASIDs to CVMs.
 	if(hvm_p->options.nested_virtualization)
@@ -785,5 +813,6 @@ void nvc_svm_restore_system(noir_hypervisor_p hvm_p)
 		nvc_svmc_finalize_cvm_module();
 #endif
 		nvc_mshv_teardown_cpuid_handlers();
+		nvc_mshv_finalize_reference_time();
 	}
 }
\ No newline at end of file
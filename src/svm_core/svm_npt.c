@@ -627,7 +627,13 @@ bool static nvc_npt_reassign_page_ownership_unsafe(u64p hpa,u64p gpa,u32 pages,u
 		remap.pages=pages;
 		noir_svm_vmmcall(noir_svm_nsv_remap_by_rmt,(ulong_ptr)&remap);
 		result=remap.status==noir_success;
-		if(result)		// Flush TLBs on all processors.
+		// Flush TLBs on all processors.
+		// The remapping is done in the primary NPT, which is shared by the subverted host on every processor.
+		// Unlike the ASIDs of CVMs, the ASID of the subverted host runs everywhere all the time.
+		// Hence the per-processor tracking of CVM TLBs (ran and stale sets) does not apply here:
+		// every processor may cache the old mapping. The host must lose access to the reassigned pages
+		// on all processors before they are handed over, so the broadcast is unavoidable.
+		if(result)
 			noir_generic_call(nvc_npt_flush_tlb_generic_worker,null);
 		else
 		{
@@ -671,53 +677,63 @@ bool nvc_npt_reassign_page_ownership(u64p hpa,u64p gpa,u32 pages,u32 asid,bool s
 	return result;
 }
 
+// Protect the Reverse-Mapping Table of hot-added memory by assigning its pages to NoirVisor.
+bool nvc_npt_protect_reverse_mapping_table(u64 table_phys,u64 size)
+{
+	const u32 pages=(u32)page_count(size);
+	u64p hpa_list=noir_alloc_nonpg_memory(pages*sizeof(u64));
+	bool result=false;
+	if(hpa_list)
+	{
+		for(u32 i=0;i<pages;i++)hpa_list[i]=table_phys+page_mult(i);
+		result=nvc_npt_reassign_page_ownership(hpa_list,hpa_list,pages,0,true,noir_nsv_rmt_noirvisor);
+		noir_free_nonpg_memory(hpa_list);
+	}
+	return result;
+}
+
+typedef struct _noir_npt_rmt_list_context
+{
+	u64p hpa_list;
+	u64p gpa_list;
+	u32 count;
+}noir_npt_rmt_list_context,*noir_npt_rmt_list_context_p;
+
+void static nvc_npt_list_cvm_page(u64 hpa,noir_rmt_entry_p entry,void* context)
+{
+	noir_npt_rmt_list_context_p list=(noir_npt_rmt_list_context_p)context;
+	list->gpa_list[list->count]=page_4kb_mult(entry->high.guest_pfn);
+	list->hpa_list[list->count]=hpa;
+	list->count++;
+}
+
 // Warning: this procedure does not gain exclusion of the VM!
 // Schedule out all vCPUs from execution before reassignment!
 bool nvc_npt_reassign_cvm_all_pages_ownership(noir_svm_custom_vm_p vm,u32 asid,bool shared,u8 ownership)
 {
 	bool result=false;
-	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	u32 pages=0;
+	u32 pages;
 	// Lock everything we need here in order to circumvent race condition and reentrance of locks.
 	noir_acquire_pushlock_exclusive(&hvm_p->relative_hvm->primary_nptm->nptm_lock);
 	noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
-	// Stage I: Scan the Reverse-Mapping Table.
-	for(u64 i=0;i<hvm_p->rmd.dir_count;i++)
-	{
-		noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[i].table.virt;
-		const u64 total_pages=page_4kb_count(rmt_dir[i].hpa_end-rmt_dir[i].hpa_start);
-		for(u64 j=0;j<total_pages;j++)
-			if(rm_table[j].low.asid==vm->asid)
-				pages++;
-	}
+	// Stage I: Count the pages in the VM with the ownership index.
+	pages=nvc_enum_rmt_entries_by_asid(&vm->rmt_index,vm->asid,null,null);
 	// Stage II: Construct the list.
 	if(pages)
 	{
-		u64p gpa_list=noir_alloc_nonpg_memory(pages<<3);
-		u64p hpa_list=noir_alloc_nonpg_memory(pages<<3);
-		u32 k=0;
-		if(gpa_list && hpa_list)
+		noir_npt_rmt_list_context list;
+		list.gpa_list=noir_alloc_nonpg_memory(pages<<3);
+		list.hpa_list=noir_alloc_nonpg_memory(pages<<3);
+		list.count=0;
+		if(list.gpa_list && list.hpa_list)
 		{
-			for(u64 i=0;i<hvm_p->rmd.dir_count;i++)
-			{
-				noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[i].table.virt;
-				const u64 total_pages=page_4kb_count(rmt_dir[i].hpa_end-rmt_dir[i].hpa_start);
-				for(u64 j=0;j<total_pages;j++)
-				{
-					if(rm_table[j].low.asid==vm->asid)
-					{
-						gpa_list[k]=page_4kb_mult(rm_table[j].high.guest_pfn);
-						hpa_list[k]=page_4kb_mult(j)+rmt_dir[i].hpa_start;
-						k++;
-					}
-				}
-			}
+			nvc_enum_rmt_entries_by_asid(&vm->rmt_index,vm->asid,nvc_npt_list_cvm_page,&list);
+			// Stage III: Perform reassignment.
+			if(list.count==pages)result=nvc_npt_reassign_page_ownership_unsafe(list.hpa_list,list.gpa_list,pages,asid,shared,ownership);
 		}
-		// Stage III: Perform reassignment.
-		if(k==pages)result=nvc_npt_reassign_page_ownership_unsafe(hpa_list,gpa_list,pages,asid,shared,ownership);
 		// Release list...
-		if(gpa_list)noir_free_nonpg_memory(gpa_list);
-		if(hpa_list)noir_free_nonpg_memory(hpa_list);
+		if(list.gpa_list)noir_free_nonpg_memory(list.gpa_list);
+		if(list.hpa_list)noir_free_nonpg_memory(list.hpa_list);
 	}
 	// Unlock everything we locked.
 	noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
@@ -14,6 +14,11 @@
 
 #include <nvdef.h>
 
+// Accessed and Dirty bits are located identically in all leaf entries.
+#define amd64_npt_accessed_dirty_bits	0x60
+#define amd64_npt_accessed_bit			5
+#define amd64_npt_dirty_bit				6
+
 typedef union _amd64_npt_pml4e
 {
 	struct
@@ -194,6 +199,49 @@ typedef struct _noir_npt_pte_descriptor
 	u64 gpa_start;
 }noir_npt_pte_descriptor,*noir_npt_pte_descriptor_p;
 
+// Descriptors of NPT for Customizable VMs are organized as a shadow radix tree.
+// The tree mirrors the hardware paging structure, so that the descriptor of the
+// paging structure translating any GPA can be located by the offsets in the GPA.
+
+// Notice that CVM NPT PTE Descriptor is describing
+// 512 4KiB-Pages in a 2MiB Page.
+typedef struct _noir_npt_cvm_pte_descriptor
+{
+	amd64_npt_pte_p virt;
+	u64 phys;
+	u64 gpa_start;
+}noir_npt_cvm_pte_descriptor,*noir_npt_cvm_pte_descriptor_p;
+
+// Notice that CVM NPT PDE Descriptor is describing
+// 512 2MiB-Pages in a 1GiB Page.
+typedef struct _noir_npt_cvm_pde_descriptor
+{
+	union
+	{
+		amd64_npt_pde_p virt;
+		amd64_npt_large_pde_p large;
+	};
+	u64 phys;
+	u64 gpa_start;
+	// Sub-level descriptors indexed by PDE offset.
+	noir_npt_cvm_pte_descriptor_p *pte;
+}noir_npt_cvm_pde_descriptor,*noir_npt_cvm_pde_descriptor_p;
+
+// Notice that CVM NPT PDPTE Descriptor is describing
+// 512 1GiB-Pages in a 512GiB Page.
+typedef struct _noir_npt_cvm_pdpte_descriptor
+{
+	union
+	{
+		amd64_npt_pdpte_p virt;
+		amd64_npt_huge_pdpte_p huge;
+	};
+	u64 phys;
+	u64 gpa_start;
+	// Sub-level descriptors indexed by PDPTE offset.
+	noir_npt_cvm_pde_descriptor_p *pde;
+}noir_npt_cvm_pdpte_descriptor,*noir_npt_cvm_pdpte_descriptor_p;
+
 typedef struct _noir_npt_manager
 {
 	struct
@@ -62,11 +62,56 @@ void noir_hvcode nvc_vt_switch_to_host_vcpu(noir_gpr_state_p gpr_state,noir_vt_v
 	// Load Control Registers
 	noir_writecr2(vcpu->cvm_state.crs.cr2);
 	// Step 3: Switch the vCPU to Host.
+	noir_locked_btr(&cvcpu->header.run_state,noir_cvm_vcpu_in_guest);
 	loader_stack->custom_vcpu=&nvc_vt_idle_cvcpu;
 	noir_vt_vmptrld(&vcpu->vmcs.phys);
 	// The context will go to the host when vmresume is executed.
 }
 
+// Software TLB of guest-virtual translations.
+// While the software TLB holds translations, writes to CR3 and invalidations of TLB by the guest are intercepted.
+// The first interception discards the software TLB, disarms the interceptions and re-executes the instruction.
+// The invpcid instruction is intercepted as well if INVLPG-exiting is set.
+void static noir_hvcode nvc_vt_arm_gva_tlb(noir_vt_custom_vcpu_p cvcpu)
+{
+	ia32_vmx_priproc_controls proc_ctrl1;
+	noir_vt_vmread(primary_processor_based_vm_execution_controls,&proc_ctrl1.value);
+	proc_ctrl1.invlpg_exiting=1;
+	proc_ctrl1.cr3_load_exiting=1;
+	noir_vt_vmwrite(primary_processor_based_vm_execution_controls,proc_ctrl1.value);
+	cvcpu->header.gva_tlb_armed=true;
+}
+
+// This function is called when the guest is about to invalidate its TLB.
+void noir_hvcode nvc_vt_release_gva_tlb(noir_vt_custom_vcpu_p cvcpu)
+{
+	ia32_vmx_priproc_controls proc_ctrl1;
+	cvcpu->header.state_cache.gt_valid=false;
+	cvcpu->header.gva_tlb_filled=0;
+	cvcpu->header.gva_tlb_armed=false;
+	noir_vt_vmread(primary_processor_based_vm_execution_controls,&proc_ctrl1.value);
+	proc_ctrl1.invlpg_exiting=0;
+	// Keep writes to CR3 intercepted if the subverted host specifies so.
+	proc_ctrl1.cr3_load_exiting=cvcpu->header.vcpu_options.intercept_cr3;
+	noir_vt_vmwrite(primary_processor_based_vm_execution_controls,proc_ctrl1.value);
+}
+
+// Invalidate the EPT if it is updated and this processor may have cached translations of the VM.
+void noir_hvcode nvc_vt_invalidate_stale_ept(noir_vt_custom_vcpu_p cvcpu,u32 proc_id)
+{
+	if(!noir_bt(cvcpu->vm->tlb_tracker.ran,proc_id))
+		noir_locked_bts(cvcpu->vm->tlb_tracker.ran,proc_id);
+	if(noir_locked_btr(cvcpu->vm->tlb_tracker.stale,proc_id))
+	{
+		noir_vt_hvm_p relative_hvm=hvm_p->relative_hvm;
+		invept_descriptor ied;
+		ied.eptp=cvcpu->vm->eptm.eptp.phys;
+		ied.reserved=0;
+		noir_vt_invept(relative_hvm->cvm_invept_type,&ied);
+		cvcpu->header.statistics.tlb_flush.issued++;
+	}
+}
+
 void noir_hvcode nvc_vt_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu)
 {
 	noir_vt_initial_stack_p loader_stack=(noir_vt_initial_stack_p)((ulong_ptr)vcpu->hv_stack+nvc_stack_size-sizeof(noir_vt_initial_stack));
@@ -98,6 +143,7 @@ void noir_hvcode nvc_vt_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_vt_
 	// Step 2: Switch vCPU to Guest.
 	loader_stack->custom_vcpu=cvcpu;
 	noir_vt_vmptrld(&cvcpu->vmcs.phys);
+	nvc_vt_invalidate_stale_ept(cvcpu,loader_stack->proc_id);
 	// Step 3: Load Guest State.
 	// Load General-Purpose Registers...
 	noir_movsp(gpr_state,&cvcpu->header.gpr,sizeof(void*)*2);
@@ -139,6 +185,8 @@ void noir_hvcode nvc_vt_switch_to_guest_vcpu(noir_gpr_state_p gpr_state,noir_vt_
 		noir_vt_vmwrite(cr4_read_shadow,cvcpu->header.crs.cr4);
 		cvcpu->header.state_cache.cr_valid=true;
 	}
+	// Intercept TLB maintenance of the guest if the software TLB holds translations.
+	if(cvcpu->header.gva_tlb_filled && !cvcpu->header.gva_tlb_armed)nvc_vt_arm_gva_tlb(cvcpu);
 	// Do not write to CR8 because it is subject to be virtualized.
 	// Load Segment Registers...
 	if(!cvcpu->header.state_cache.sr_valid)
@@ -597,12 +645,13 @@ void noir_hvcode nvc_vt_set_guest_vcpu_options(noir_vt_vcpu_p vcpu,noir_vt_custo
 	else
 		noir_vt_vmwrite(exception_bitmap,1<<ia32_machine_check);
 	// CR3
-	proc_ctrl1.cr3_load_exiting=cvcpu->header.vcpu_options.intercept_cr3;
+	// Writes to CR3 are intercepted for the software TLB as well if it is armed.
+	proc_ctrl1.cr3_load_exiting=cvcpu->header.vcpu_options.intercept_cr3 || cvcpu->header.gva_tlb_armed;
 	proc_ctrl1.cr3_store_exiting=cvcpu->header.vcpu_options.intercept_cr3;
 	// Debug Registers
 	proc_ctrl1.mov_dr_exiting=cvcpu->header.vcpu_options.intercept_drx;
-	// MSR Interceptions
-	proc_ctrl1.use_msr_bitmap=!cvcpu->header.vcpu_options.intercept_msr;
+	// MSR Interceptions are decided by the exit handler. The bitmap only carries Quick-Path passthrough.
+	proc_ctrl1.use_msr_bitmap=1;
 	// Write to VMCS.
 	noir_vt_vmwrite(primary_processor_based_vm_execution_controls,proc_ctrl1.value);
 	// Load Host's VMCS.
@@ -613,23 +662,46 @@ void noir_hvcode nvc_vt_set_guest_vcpu_options(noir_vt_vcpu_p vcpu,noir_vt_custo
 noir_status nvc_vtc_run_vcpu(noir_vt_custom_vcpu_p vcpu)
 {
 	noir_status st=noir_success;
-	noir_acquire_reslock_shared(vcpu->vm->header.vcpu_list_lock);
+	u32 state=nvc_enter_vcpu_run(&vcpu->vm->header,&vcpu->header);
+	if(noir_bt(&state,noir_cvm_vcpu_running))return noir_vcpu_already_running;
 	// Abort execution if rescission is specified.
-	if(noir_locked_btr64(&vcpu->special_state,63))
+	if(noir_bt(&state,noir_cvm_vcpu_kicked))
 		vcpu->header.exit_context.intercept_code=cv_rescission;
 	else
-		noir_vt_vmcall(noir_vt_run_custom_vcpu,(ulong_ptr)vcpu);
-	noir_release_reslock(vcpu->vm->header.vcpu_list_lock);
+	{
+		// Re-enter the guest if it was preempted by an exclusive operation only.
+		do noir_vt_vmcall(noir_vt_run_custom_vcpu,(ulong_ptr)vcpu);
+		while(nvc_resume_preempted_vcpu_run(&vcpu->vm->header,&vcpu->header));
+	}
+	nvc_leave_vcpu_run(&vcpu->header);
 	return st;
 }
 
-noir_status nvc_vtc_rescind_vcpu(noir_vt_custom_vcpu_p vcpu)
+bool nvc_vtc_set_msr_passthrough(noir_vt_custom_vm_p vm,u32 first,u32 last,bool passthrough)
 {
-	noir_status st=noir_success;
-	noir_acquire_reslock_shared(vcpu->vm->header.vcpu_list_lock);
-	st=noir_locked_bts64(&vcpu->special_state,63)?noir_already_rescinded:noir_success;
-	noir_release_reslock(vcpu->vm->header.vcpu_list_lock);
-	return st;
+	// The caller must have excluded all vCPUs. Only the read bitmaps are updated.
+	void* bitmap;
+	u32 base;
+	if(last<0x2000)
+	{
+		bitmap=(void*)((ulong_ptr)vm->msr_bitmap.virt+0);
+		base=0;
+	}
+	else if(first>=0xC0000000 && last<0xC0002000)
+	{
+		bitmap=(void*)((ulong_ptr)vm->msr_bitmap.virt+0x400);
+		base=0xC0000000;
+	}
+	else
+		return false;
+	for(u32 i=first;i<=last;i++)
+	{
+		if(passthrough)
+			noir_reset_bitmap(bitmap,i-base);
+		else
+			noir_set_bitmap(bitmap,i-base);
+	}
+	return true;
 }
 
 u32 nvc_vtc_get_vm_asid(noir_vt_custom_vm_p vm)
@@ -637,11 +709,21 @@ u32 nvc_vtc_get_vm_asid(noir_vt_custom_vm_p vm)
 	return vm->vpid;
 }
 
+u32 nvc_vtc_get_vcpu_processor(noir_vt_custom_vcpu_p vcpu)
+{
+	return vcpu->proc_id;
+}
+
 noir_vt_custom_vcpu_p nvc_vtc_reference_vcpu(noir_vt_custom_vm_p vm,u32 vcpu_id)
 {
 	return vm->vcpu[vcpu_id];
 }
 
+noir_exit_profiler_p nvc_vtc_get_host_exit_profiler(u32 processor)
+{
+	return hvm_p->virtual_cpu[processor].cvm_state.profiler;
+}
+
 u16 nvc_vtc_alloc_vpid()
 {
 	u32 asid;
@@ -722,15 +804,52 @@ void static nvc_vtc_set_pml4e_entry(ia32_ept_pml4e_p entry,u64 hpa)
 	entry->pdpte_offset=page_4kb_count(hpa);
 }
 
-noir_status static nvc_vtc_create_1gb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The following functions search for the descriptors that describe the GPA.
+noir_ept_pdpte_descriptor_p static nvc_vtc_find_pdpte_descriptor(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
+{
+	noir_ept_pdpte_descriptor_p cur=ept_manager->pdpte.head;
+	while(cur)
+	{
+		if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_512gb_size)break;
+		cur=cur->next;
+	}
+	return cur;
+}
+
+noir_ept_pde_descriptor_p static nvc_vtc_find_pde_descriptor(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
+{
+	noir_ept_pde_descriptor_p cur=ept_manager->pde.head;
+	while(cur)
+	{
+		if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_1gb_size)break;
+		cur=cur->next;
+	}
+	return cur;
+}
+
+noir_ept_pte_descriptor_p static nvc_vtc_find_pte_descriptor(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
+{
+	noir_ept_pte_descriptor_p cur=ept_manager->pte.head;
+	while(cur)
+	{
+		if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_2mb_size)break;
+		cur=cur->next;
+	}
+	return cur;
+}
+
+// The 1GiB-page map is the PDPT. It is described by the PML4E.
+noir_ept_pdpte_descriptor_p static nvc_vtc_create_1gb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
 {
-	noir_status st=noir_insufficient_resources;
 	noir_ept_pdpte_descriptor_p pdpte_p=noir_alloc_nonpg_memory(sizeof(noir_ept_pdpte_descriptor));
 	if(pdpte_p)
 	{
 		pdpte_p->virt=noir_alloc_contd_memory(page_size);
 		if(pdpte_p->virt==null)
+		{
 			noir_free_nonpg_memory(pdpte_p);
+			pdpte_p=null;
+		}
 		else
 		{
 			ia32_addr_translator gpa_t;
@@ -738,8 +857,6 @@ noir_status static nvc_vtc_create_1gb_page_map(noir_vt_custom_ept_manager_p ept_
 			// Setup PDPTE descriptor.
 			pdpte_p->phys=noir_get_physical_address(pdpte_p->virt);
 			pdpte_p->gpa_start=page_512gb_base(gpa);
-			// Do mapping - this level.
-			nvc_vtc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],hpa,map_attrib);
 			// Do mapping - prior level.
 			// Note that PML4E is already described.
 			nvc_vtc_set_pml4e_entry(&ept_manager->eptp.virt[gpa_t.pml4e_offset],pdpte_p->phys);
@@ -749,170 +866,584 @@ noir_status static nvc_vtc_create_1gb_page_map(noir_vt_custom_ept_manager_p ept_
 			else
 				ept_manager->pdpte.head=pdpte_p;
 			ept_manager->pdpte.tail=pdpte_p;
-			st=noir_success;
 		}
 	}
-	return st;
+	return pdpte_p;
 }
 
-noir_status static nvc_vtc_create_2mb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The 2MiB-page map is the PDT. It is described by the PDPTE.
+noir_ept_pde_descriptor_p static nvc_vtc_create_2mb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
 {
-	noir_status st=noir_insufficient_resources;
-	noir_ept_pde_descriptor_p pde_p=noir_alloc_nonpg_memory(sizeof(noir_ept_pde_descriptor));
+	noir_ept_pde_descriptor_p pde_p=null;
+	noir_ept_pdpte_descriptor_p pdpte_p=nvc_vtc_find_pdpte_descriptor(ept_manager,gpa);
+	// This 512GiB page is not described yet.
+	if(!pdpte_p)pdpte_p=nvc_vtc_create_1gb_page_map(ept_manager,gpa);
+	if(pdpte_p)pde_p=noir_alloc_nonpg_memory(sizeof(noir_ept_pde_descriptor));
 	if(pde_p)
 	{
 		pde_p->virt=noir_alloc_contd_memory(page_size);
 		if(pde_p->virt==null)
+		{
 			noir_free_nonpg_memory(pde_p);
+			pde_p=null;
+		}
 		else
 		{
-			noir_ept_pdpte_descriptor_p cur=ept_manager->pdpte.head;
+			noir_cvm_mapping_attributes null_map={0};
+			ia32_ept_huge_pdpte_p huge_pdpte;
 			ia32_addr_translator gpa_t;
 			gpa_t.value=gpa;
+			huge_pdpte=&pdpte_p->huge[gpa_t.pdpte_offset];
 			// Setup PDE descriptor
 			pde_p->phys=noir_get_physical_address(pde_p->virt);
 			pde_p->gpa_start=page_1gb_base(gpa);
-			// Do mapping
-			nvc_vtc_set_pde_entry(&pde_p->virt[gpa_t.pte_offset],hpa,map_attrib);
+			// If a 1GiB page is mapped here, split it into 2MiB pages.
+			// Huge PDPTE and Large PDE share the same layout.
+			if(huge_pdpte->huge_pdpte && (huge_pdpte->read || huge_pdpte->write || huge_pdpte->execute))
+				for(u32 i=0;i<page_table_entries64;i++)
+					pde_p->large[i].value=huge_pdpte->value+page_2mb_mult((u64)i);
+			// Do mapping - prior level.
+			nvc_vtc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],pde_p->phys,null_map);
 			// Add to the linked list.
 			if(ept_manager->pde.head)
 				ept_manager->pde.tail->next=pde_p;
 			else
 				ept_manager->pde.head=pde_p;
 			ept_manager->pde.tail=pde_p;
-			// Search for existing PDPTEs and set up upper-level mapping.
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_512gb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
-			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 512GiB page is not yet described.
-				st=nvc_vtc_create_1gb_page_map(ept_manager,gpa,0,null_map);
-				if(st==noir_success)cur=ept_manager->pdpte.tail;
-			}
-			if(cur)
-			{
-				nvc_vtc_set_pdpte_entry(&cur->virt[gpa_t.pde_offset],pde_p->phys,map_attrib);
-				st=noir_success;
-			}
 		}
 	}
-	return st;
+	return pde_p;
 }
 
-noir_status static nvc_vtc_create_4kb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The 4KiB-page map is the PT. It is described by the PDE.
+noir_ept_pte_descriptor_p static nvc_vtc_create_4kb_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
 {
-	noir_status st=noir_insufficient_resources;
-	noir_ept_pte_descriptor_p pte_p=noir_alloc_nonpg_memory(sizeof(noir_ept_pte_descriptor));
+	noir_ept_pte_descriptor_p pte_p=null;
+	noir_ept_pde_descriptor_p pde_p=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+	// This 1GiB page is not described yet.
+	if(!pde_p)pde_p=nvc_vtc_create_2mb_page_map(ept_manager,gpa);
+	if(pde_p)pte_p=noir_alloc_nonpg_memory(sizeof(noir_ept_pte_descriptor));
 	if(pte_p)
 	{
 		pte_p->virt=noir_alloc_contd_memory(page_size);
 		if(pte_p->virt==null)
+		{
 			noir_free_nonpg_memory(pte_p);
+			pte_p=null;
+		}
 		else
 		{
-			noir_ept_pde_descriptor_p cur=ept_manager->pde.head;
+			noir_cvm_mapping_attributes null_map={0};
+			ia32_ept_large_pde_p large_pde;
 			ia32_addr_translator gpa_t;
 			gpa_t.value=gpa;
+			large_pde=&pde_p->large[gpa_t.pde_offset];
 			// Setup PTE descriptor
 			pte_p->phys=noir_get_physical_address(pte_p->virt);
 			pte_p->gpa_start=page_2mb_base(gpa);
-			// Do mapping
-			nvc_vtc_set_pte_entry(&pte_p->virt[gpa_t.pte_offset],0,map_attrib);
+			// If a 2MiB page is mapped here, split it into 4KiB pages.
+			// Large PDE and PTE share the same layout except for the large-page bit.
+			if(large_pde->large_pde && (large_pde->read || large_pde->write || large_pde->execute))
+			{
+				for(u32 i=0;i<page_table_entries64;i++)
+				{
+					pte_p->virt[i].value=large_pde->value+page_4kb_mult((u64)i);
+					pte_p->virt[i].ignored0=0;
+				}
+			}
+			// Do mapping - prior level.
+			nvc_vtc_set_pde_entry(&pde_p->virt[gpa_t.pde_offset],pte_p->phys,null_map);
 			// Add to the linked list
 			if(ept_manager->pte.head)
 				ept_manager->pte.tail->next=pte_p;
 			else
 				ept_manager->pte.head=pte_p;
 			ept_manager->pte.tail=pte_p;
-			// Search for existing PDEs and set up upper-level mapping.
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_1gb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
-			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 1GiB page is not yet described yet.
-				st=nvc_vtc_create_2mb_page_map(ept_manager,gpa,0,null_map);
-				if(st==noir_success)cur=ept_manager->pde.tail;
-			}
-			if(cur)
-			{
-				nvc_vtc_set_pde_entry(&cur->virt[gpa_t.pde_offset],pte_p->phys,map_attrib);
-				st=noir_success;
-			}
 		}
 	}
-	return st;
+	return pte_p;
 }
 
-noir_status static nvc_vtc_set_page_map(noir_vt_custom_ept_manager_p npt_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+// The following functions remove the paging structures describing the specified range from the list.
+// The entry in the prior level is not updated here.
+void static nvc_vtc_free_4kb_page_maps(noir_vt_custom_ept_manager_p ept_manager,u64 gpa_start,u64 gpa_end)
 {
-	noir_status st=noir_unsuccessful;
+	noir_ept_pte_descriptor_p cur=ept_manager->pte.head,prev=null;
+	while(cur)
+	{
+		noir_ept_pte_descriptor_p next=cur->next;
+		if(cur->gpa_start>=gpa_start && cur->gpa_start<gpa_end)
+		{
+			if(prev)
+				prev->next=next;
+			else
+				ept_manager->pte.head=next;
+			if(ept_manager->pte.tail==cur)ept_manager->pte.tail=prev;
+			noir_free_contd_memory(cur->virt,page_size);
+			noir_free_nonpg_memory(cur);
+		}
+		else
+			prev=cur;
+		cur=next;
+	}
+}
+
+void static nvc_vtc_free_2mb_page_maps(noir_vt_custom_ept_manager_p ept_manager,u64 gpa_start,u64 gpa_end)
+{
+	noir_ept_pde_descriptor_p cur=ept_manager->pde.head,prev=null;
+	while(cur)
+	{
+		noir_ept_pde_descriptor_p next=cur->next;
+		if(cur->gpa_start>=gpa_start && cur->gpa_start<gpa_end)
+		{
+			if(prev)
+				prev->next=next;
+			else
+				ept_manager->pde.head=next;
+			if(ept_manager->pde.tail==cur)ept_manager->pde.tail=prev;
+			noir_free_contd_memory(cur->virt,page_size);
+			noir_free_nonpg_memory(cur);
+		}
+		else
+			prev=cur;
+		cur=next;
+	}
+}
+
+noir_status static nvc_vtc_set_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u64 hpa,noir_cvm_mapping_attributes map_attrib)
+{
+	noir_status st=noir_invalid_parameter;
 	ia32_addr_translator gpa_t;
 	gpa_t.value=gpa;
 	switch(map_attrib.psize)
 	{
 		case 0:
 		{
-			// Search for existing PTEs.
-			noir_ept_pte_descriptor_p cur=npt_manager->pte.head;
-			while(cur)
-			{
-				if(gpa>=cur->gpa_start && gpa<cur->gpa_start+page_2mb_size)break;
-				cur=cur->next;
-			}
-			if(!cur)
+			noir_ept_pte_descriptor_p pte_p=nvc_vtc_find_pte_descriptor(ept_manager,gpa);
+			// This 2MiB page is not described yet.
+			if(!pte_p)pte_p=nvc_vtc_create_4kb_page_map(ept_manager,gpa);
+			if(pte_p)
 			{
-				noir_cvm_mapping_attributes null_map={0};
-				// This 2MiB page is not described yet.
-				st=nvc_vtc_create_4kb_page_map(npt_manager,gpa,0,null_map);
-				if(st==noir_success)cur=npt_manager->pte.tail;
+				nvc_vtc_set_pte_entry(&pte_p->virt[gpa_t.pte_offset],hpa,map_attrib);
+				st=noir_success;
 			}
-			if(cur)
+			else
+				st=noir_insufficient_resources;
+			break;
+		}
+		case 1:
+		{
+			noir_ept_pde_descriptor_p pde_p=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+			// This 1GiB page is not described yet.
+			if(!pde_p)pde_p=nvc_vtc_create_2mb_page_map(ept_manager,gpa);
+			if(pde_p)
 			{
-				nvc_vtc_set_pte_entry(&cur->virt[gpa_t.pte_offset],hpa,map_attrib);
+				// The 4KiB pages in this range are superseded by the 2MiB page.
+				nvc_vtc_free_4kb_page_maps(ept_manager,page_2mb_base(gpa),page_2mb_base(gpa)+page_2mb_size);
+				nvc_vtc_set_pde_entry(&pde_p->virt[gpa_t.pde_offset],hpa,map_attrib);
 				st=noir_success;
 			}
+			else
+				st=noir_insufficient_resources;
 			break;
 		}
-		default:
+		case 2:
 		{
-			// By default, large-page mapping is not implemented.
-			st=noir_not_implemented;
+			noir_ept_pdpte_descriptor_p pdpte_p=nvc_vtc_find_pdpte_descriptor(ept_manager,gpa);
+			// This 512GiB page is not described yet.
+			if(!pdpte_p)pdpte_p=nvc_vtc_create_1gb_page_map(ept_manager,gpa);
+			if(pdpte_p)
+			{
+				// The 2MiB and 4KiB pages in this range are superseded by the 1GiB page.
+				nvc_vtc_free_4kb_page_maps(ept_manager,page_1gb_base(gpa),page_1gb_base(gpa)+page_1gb_size);
+				nvc_vtc_free_2mb_page_maps(ept_manager,page_1gb_base(gpa),page_1gb_base(gpa)+page_1gb_size);
+				nvc_vtc_set_pdpte_entry(&pdpte_p->virt[gpa_t.pdpte_offset],hpa,map_attrib);
+				st=noir_success;
+			}
+			else
+				st=noir_insufficient_resources;
 			break;
 		}
 	}
 	return st;
 }
 
+// Coalesce the 4KiB pages of the 2MiB range into a 2MiB page if they are
+// mapped to a contiguous and aligned host range with identical attributes.
+bool static nvc_vtc_coalesce_2mb_page(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
+{
+	noir_ept_pde_descriptor_p pde_p=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+	noir_ept_pte_descriptor_p pte_p=nvc_vtc_find_pte_descriptor(ept_manager,gpa);
+	if(pde_p && pte_p)
+	{
+		ia32_ept_pte_p pt=pte_p->virt;
+		ia32_addr_translator gpa_t;
+		u64 ad_bits=0;
+		gpa_t.value=gpa;
+		if(!(pt[0].read || pt[0].write || pt[0].execute) || page_2mb_offset(page_4kb_mult(pt[0].page_offset)))return false;
+		for(u32 i=0;i<page_table_entries64;i++)
+		{
+			if((pt[i].value&~ia32_ept_accessed_dirty_bits)!=(pt[0].value&~ia32_ept_accessed_dirty_bits)+page_4kb_mult((u64)i))return false;
+			ad_bits|=pt[i].value&ia32_ept_accessed_dirty_bits;
+		}
+		// Large PDE and PTE share the same layout except for the large-page bit.
+		pde_p->large[gpa_t.pde_offset].value=(pt[0].value&~ia32_ept_accessed_dirty_bits)|ad_bits;
+		pde_p->large[gpa_t.pde_offset].large_pde=1;
+		nvc_vtc_free_4kb_page_maps(ept_manager,page_2mb_base(gpa),page_2mb_base(gpa)+page_2mb_size);
+		return true;
+	}
+	return false;
+}
+
+// Coalesce the 2MiB pages of the 1GiB range into a 1GiB page in the same way.
+bool static nvc_vtc_coalesce_1gb_page(noir_vt_custom_ept_manager_p ept_manager,u64 gpa)
+{
+	noir_ept_pdpte_descriptor_p pdpte_p=nvc_vtc_find_pdpte_descriptor(ept_manager,gpa);
+	noir_ept_pde_descriptor_p pde_p=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+	if(pdpte_p && pde_p)
+	{
+		ia32_ept_large_pde_p pd=pde_p->large;
+		ia32_addr_translator gpa_t;
+		u64 ad_bits=0;
+		gpa_t.value=gpa;
+		if(!(pd[0].read || pd[0].write || pd[0].execute) || !pd[0].large_pde || page_1gb_offset(page_2mb_mult(pd[0].page_offset)))return false;
+		for(u32 i=0;i<page_table_entries64;i++)
+		{
+			if((pd[i].value&~ia32_ept_accessed_dirty_bits)!=(pd[0].value&~ia32_ept_accessed_dirty_bits)+page_2mb_mult((u64)i))return false;
+			ad_bits|=pd[i].value&ia32_ept_accessed_dirty_bits;
+		}
+		// Large PDE and Huge PDPTE share the same layout.
+		pdpte_p->huge[gpa_t.pdpte_offset].value=(pd[0].value&~ia32_ept_accessed_dirty_bits)|ad_bits;
+		nvc_vtc_free_2mb_page_maps(ept_manager,page_1gb_base(gpa),page_1gb_base(gpa)+page_1gb_size);
+		return true;
+	}
+	return false;
+}
+
+// Coalesce the ranges touched by a mapping operation, if the processor supports large pages.
+void static nvc_vtc_coalesce_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u64 size)
+{
+	if(hvm_p->cvm_cap.large_page)
+		for(u64 cur=page_2mb_base(gpa);cur<gpa+size;cur+=page_2mb_size)
+			nvc_vtc_coalesce_2mb_page(ept_manager,cur);
+	if(hvm_p->cvm_cap.huge_page)
+		for(u64 cur=page_1gb_base(gpa);cur<gpa+size;cur+=page_1gb_size)
+			nvc_vtc_coalesce_1gb_page(ept_manager,cur);
+}
+
+// Mark the EPT as stale on processors that ran this VM since the last invalidation.
+// The invalidation is performed when a vCPU of this VM is switched in on that processor.
+void static nvc_vtc_invalidate_vm_tlb(noir_vt_custom_vm_p vm)
+{
+	for(u32 i=0;i<vm->tlb_tracker.words;i++)
+	{
+		const i32 ran=noir_locked_xchg(&vm->tlb_tracker.ran[i],0);
+		if(ran)noir_locked_or(&vm->tlb_tracker.stale[i],ran);
+	}
+}
+
+// Locate the leaf entry translating the GPA. PTE, Large PDE and Huge PDPTE share the same A/D bits.
+// The descriptors are cached so that walking consecutive pages does not search the lists every time.
+ia32_ept_pte_p static nvc_vtc_get_leaf_entry(noir_vt_custom_ept_manager_p ept_manager,noir_ept_leaf_cache_p cache,u64 gpa)
+{
+	ia32_addr_translator gpa_t;
+	gpa_t.value=gpa;
+	if(cache->pdpte==null || gpa-cache->pdpte->gpa_start>=page_512gb_size)
+		cache->pdpte=nvc_vtc_find_pdpte_descriptor(ept_manager,gpa);
+	if(cache->pdpte)
+	{
+		ia32_ept_huge_pdpte_p huge_pdpte=&cache->pdpte->huge[gpa_t.pdpte_offset];
+		if(huge_pdpte->huge_pdpte)
+			return huge_pdpte->read || huge_pdpte->write || huge_pdpte->execute?(ia32_ept_pte_p)huge_pdpte:null;
+		if(cache->pde==null || gpa-cache->pde->gpa_start>=page_1gb_size)
+			cache->pde=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+		if(cache->pde)
+		{
+			ia32_ept_large_pde_p large_pde=&cache->pde->large[gpa_t.pde_offset];
+			if(large_pde->large_pde)
+				return large_pde->read || large_pde->write || large_pde->execute?(ia32_ept_pte_p)large_pde:null;
+			if(cache->pte==null || gpa-cache->pte->gpa_start>=page_2mb_size)
+				cache->pte=nvc_vtc_find_pte_descriptor(ept_manager,gpa);
+			if(cache->pte)
+			{
+				ia32_ept_pte_p pte=&cache->pte->virt[gpa_t.pte_offset];
+				if(pte->read || pte->write || pte->execute)return pte;
+			}
+		}
+	}
+	return null;
+}
+
 noir_status nvc_vtc_set_mapping(noir_vt_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info)
 {
 	noir_status st=noir_unsuccessful;
-	ia32_addr_translator gpa;
 	u32 increment[4]={page_4kb_shift,page_2mb_shift,page_1gb_shift,page_512gb_shift};
-	gpa.value=mapping_info->gpa;
+	u32 shift=increment[mapping_info->attributes.psize];
 	for(u32 i=0;i<mapping_info->pages;i++)
 	{
-		u64 hva=mapping_info->hva+(i<<increment[mapping_info->attributes.psize]);
+		u64 hva=mapping_info->hva+((u64)i<<shift);
 		bool valid,locked,large_page;
 		if(noir_query_page_attributes((void*)hva,&valid,&locked,&large_page))
 		{
 			st=noir_user_page_violation;
 			if(valid && locked || !mapping_info->attributes.present)
 			{
-				u64 gpa=mapping_info->gpa+(i<<increment[mapping_info->attributes.psize]);
+				// The host range of a large page is validated to be contiguous and aligned by the caller.
+				u64 gpa=mapping_info->gpa+((u64)i<<shift);
 				u64 hpa=noir_get_user_physical_address((void*)hva);
 				st=nvc_vtc_set_page_map(&virtual_machine->eptm,gpa,hpa,mapping_info->attributes);
 			}
 		}
 		if(st!=noir_success)break;
 	}
+	// Merge the touched ranges into larger pages where possible.
+	if(st==noir_success && mapping_info->attributes.present)
+		nvc_vtc_coalesce_page_map(&virtual_machine->eptm,mapping_info->gpa,(u64)mapping_info->pages<<shift);
+	// Invalidate the EPT on processors that ran this VM and the software TLBs of all vCPUs.
+	nvc_vtc_invalidate_vm_tlb(virtual_machine);
+	for(u32 i=0;i<255;i++)
+		if(virtual_machine->vcpu[i])
+			virtual_machine->vcpu[i]->header.state_cache.gt_valid=false;
+	return st;
+}
+
+// Capture the present translations of a range before a batch overwrites them, one record per leaf entry.
+// Missing paging structures are skipped as a whole, so capturing a range that is not mapped yet takes few lookups.
+bool static nvc_vtc_capture_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u32 pages,noir_cvm_prior_journal_p journal)
+{
+	const u64 limit=gpa+page_4kb_mult((u64)pages);
+	noir_ept_leaf_cache cache={0};
+	while(gpa<limit)
+	{
+		ia32_ept_pte_p entry=null;
+		ia32_addr_translator gpa_t;
+		u64 leaf_size=page_512gb_size,hpa=0,end;
+		gpa_t.value=gpa;
+		if(cache.pdpte==null || gpa-cache.pdpte->gpa_start>=page_512gb_size)
+			cache.pdpte=nvc_vtc_find_pdpte_descriptor(ept_manager,gpa);
+		if(cache.pdpte)
+		{
+			ia32_ept_huge_pdpte_p huge_pdpte=&cache.pdpte->huge[gpa_t.pdpte_offset];
+			leaf_size=page_1gb_size;
+			if(huge_pdpte->huge_pdpte)
+			{
+				entry=(ia32_ept_pte_p)huge_pdpte;
+				hpa=page_1gb_mult((u64)huge_pdpte->page_offset);
+			}
+			else
+			{
+				if(cache.pde==null || gpa-cache.pde->gpa_start>=page_1gb_size)
+					cache.pde=nvc_vtc_find_pde_descriptor(ept_manager,gpa);
+				if(cache.pde)
+				{
+					ia32_ept_large_pde_p large_pde=&cache.pde->large[gpa_t.pde_offset];
+					leaf_size=page_2mb_size;
+					if(large_pde->large_pde)
+					{
+						entry=(ia32_ept_pte_p)large_pde;
+						hpa=page_2mb_mult((u64)large_pde->page_offset);
+					}
+					else
+					{
+						if(cache.pte==null || gpa-cache.pte->gpa_start>=page_2mb_size)
+							cache.pte=nvc_vtc_find_pte_descriptor(ept_manager,gpa);
+						if(cache.pte)
+						{
+							entry=&cache.pte->virt[gpa_t.pte_offset];
+							leaf_size=page_4kb_size;
+							hpa=page_4kb_mult((u64)entry->page_offset);
+						}
+					}
+				}
+			}
+		}
+		// The end of the leaf wraps around at the top of the address space.
+		end=(gpa&~(leaf_size-1))+leaf_size;
+		if(end-gpa>limit-gpa)end=limit;
+		if(entry && (entry->read || entry->write || entry->execute))
+		{
+			noir_cvm_mapping_attributes attributes={0};
+			attributes.present=entry->read;
+			attributes.write=entry->write;
+			attributes.execute=entry->execute;
+			attributes.caching=(u32)entry->memory_type;
+			if(!nvc_record_prior_mapping(journal,gpa,hpa+(gpa&(leaf_size-1)),(u32)page_4kb_count(end-gpa),attributes))return false;
+		}
+		gpa=end;
+	}
+	return true;
+}
+
+// Restore a range overwritten by a failed batch. The pages are unmapped in the size they were mapped,
+// then the captured translations overlapping the range are mapped again in the largest aligned pages.
+void static nvc_vtc_restore_page_map(noir_vt_custom_ept_manager_p ept_manager,u64 gpa,u32 pages,u32 psize,noir_cvm_prior_journal_p journal)
+{
+	const u64 limit=gpa+page_4kb_mult((u64)pages);
+	noir_cvm_mapping_attributes null_map={0};
+	null_map.psize=psize;
+	for(u32 i=0;i<pages;i+=noir_cvm_psize_pages(psize))
+		nvc_vtc_set_page_map(ept_manager,gpa+page_4kb_mult((u64)i),0,null_map);
+	for(u32 i=0;i<journal->count;i++)
+	{
+		noir_cvm_prior_mapping_p prior=&journal->list[i];
+		u64 cur=prior->gpa>gpa?prior->gpa:gpa;
+		u64 end=prior->gpa+page_4kb_mult((u64)prior->pages);
+		if(end>limit)end=limit;
+		while(cur<end)
+		{
+			noir_cvm_mapping_attributes map_attrib=prior->attributes;
+			const u64 hpa=prior->hpa+(cur-prior->gpa);
+			if(hvm_p->cvm_cap.huge_page && page_1gb_offset(cur|hpa)==0 && end-cur>=page_1gb_size)
+				map_attrib.psize=2;
+			else if(hvm_p->cvm_cap.large_page && page_2mb_offset(cur|hpa)==0 && end-cur>=page_2mb_size)
+				map_attrib.psize=1;
+			nvc_vtc_set_page_map(ept_manager,cur,hpa,map_attrib);
+			cur+=page_4kb_mult((u64)noir_cvm_psize_pages(map_attrib.psize));
+		}
+	}
+	nvc_vtc_coalesce_page_map(ept_manager,gpa,page_4kb_mult((u64)pages));
+}
+
+// Map several ranges into the guest. The physical array lists all ranges in 4KiB granularity, one after another.
+// Host pages are already pinned and translated by the caller, so the per-page queries are unnecessary.
+noir_status nvc_vtc_set_mapping_batch(noir_vt_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array)
+{
+	noir_status st=noir_success;
+	u64p hpa_cur=phys_array;
+	u32 mapped=0,failed_page=0;
+	noir_cvm_prior_journal journal={0};
+	// Capture the prior translations of all ranges before any of them is overwritten.
+	for(u32 i=0;i<count;i++)
+	{
+		u32 pages=mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize);
+		if(!nvc_vtc_capture_page_map(&virtual_machine->eptm,mapping_info[i].gpa,pages,&journal))
+		{
+			nvc_free_prior_journal(&journal);
+			return noir_insufficient_resources;
+		}
+	}
+	for(;mapped<count;mapped++)
+	{
+		noir_cvm_address_mapping_p range=&mapping_info[mapped];
+		u32 increment=noir_cvm_psize_pages(range->attributes.psize);
+		u32 pages=range->pages*increment;
+		// The host range of a large page is validated to be contiguous and aligned by the caller.
+		for(failed_page=0;failed_page<pages;failed_page+=increment)
+		{
+			st=nvc_vtc_set_page_map(&virtual_machine->eptm,range->gpa+page_4kb_mult((u64)failed_page),hpa_cur[failed_page],range->attributes);
+			if(st!=noir_success)break;
+		}
+		if(st!=noir_success)break;
+		// Merge the touched ranges into larger pages where possible.
+		nvc_vtc_coalesce_page_map(&virtual_machine->eptm,range->gpa,page_4kb_mult((u64)pages));
+		hpa_cur+=pages;
+	}
+	// Failure of mapping will result in restoring the translations overwritten so far.
+	// The range that failed is restored only for the pages mapped before the failure.
+	if(st!=noir_success)
+	{
+		for(u32 i=0;i<mapped;i++)
+			nvc_vtc_restore_page_map(&virtual_machine->eptm,mapping_info[i].gpa,mapping_info[i].pages*noir_cvm_psize_pages(mapping_info[i].attributes.psize),mapping_info[i].attributes.psize,&journal);
+		if(failed_page)
+			nvc_vtc_restore_page_map(&virtual_machine->eptm,mapping_info[mapped].gpa,failed_page,mapping_info[mapped].attributes.psize,&journal);
+	}
+	// Invalidate the EPT on processors that ran this VM and the software TLBs of all vCPUs.
+	nvc_vtc_invalidate_vm_tlb(virtual_machine);
+	for(u32 i=0;i<255;i++)
+		if(virtual_machine->vcpu[i])
+			virtual_machine->vcpu[i]->header.state_cache.gt_valid=false;
+	nvc_free_prior_journal(&journal);
+	return st;
+}
+
+noir_status nvc_vtc_query_gpa_accessing_bitmap(noir_vt_custom_vm_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size)
+{
+	noir_status st=noir_not_implemented;
+	if(hvm_p->cvm_cap.accessed_dirty)
+	{
+		st=noir_buffer_too_small;
+		if(page_count<=(bitmap_size<<2))
+		{
+			noir_ept_leaf_cache cache={0};
+			st=noir_success;
+			for(u32 i=0;i<page_count;i++)
+			{
+				ia32_ept_pte_p entry=nvc_vtc_get_leaf_entry(&virtual_machine->eptm,&cache,gpa_start+page_4kb_mult((u64)i));
+				if(entry==null)
+				{
+					st=noir_guest_page_absent;
+					break;
+				}
+				if(entry->accessed)
+					noir_set_bitmap(bitmap,i<<1);
+				else
+					noir_reset_bitmap(bitmap,i<<1);
+				if(entry->dirty)
+					noir_set_bitmap(bitmap,(i<<1)+1);
+				else
+					noir_reset_bitmap(bitmap,(i<<1)+1);
+			}
+		}
+	}
+	return st;
+}
+
+noir_status nvc_vtc_clear_gpa_accessing_bits(noir_vt_custom_vm_p virtual_machine,u64 gpa_start,u32 page_count)
+{
+	noir_status st=noir_not_implemented;
+	if(hvm_p->cvm_cap.accessed_dirty)
+	{
+		noir_ept_leaf_cache cache={0};
+		st=noir_success;
+		for(u32 i=0;i<page_count;i++)
+		{
+			ia32_ept_pte_p entry=nvc_vtc_get_leaf_entry(&virtual_machine->eptm,&cache,gpa_start+page_4kb_mult((u64)i));
+			if(entry==null)
+			{
+				st=noir_guest_page_absent;
+				break;
+			}
+			// The processor may set the bits concurrently. Clear them atomically.
+			noir_locked_and64((i64v*)&entry->value,~(i64)ia32_ept_accessed_dirty_bits);
+		}
+		// Cached translations would not set the bits again unless the EPT is invalidated.
+		nvc_vtc_invalidate_vm_tlb(virtual_machine);
+	}
+	return st;
+}
+
+// Report the pages written since the last harvest, one bit per page, and re-arm their dirty bits.
+// A dirty large page reports all of its 4KiB pages to be dirty. Unmapped pages are reported clean.
+noir_status nvc_vtc_harvest_gpa_dirty_bitmap(noir_vt_custom_vm_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate)
+{
+	noir_status st=noir_not_implemented;
+	if(hvm_p->cvm_cap.accessed_dirty)
+	{
+		st=noir_buffer_too_small;
+		if(page_count<=(bitmap_size<<3))
+		{
+			noir_ept_leaf_cache cache={0};
+			ia32_ept_pte_p last_entry=null;
+			bool last_dirty=false,harvested=false;
+			st=noir_success;
+			for(u32 i=0;i<page_count;i++)
+			{
+				ia32_ept_pte_p entry=nvc_vtc_get_leaf_entry(&virtual_machine->eptm,&cache,gpa_start+page_4kb_mult((u64)i));
+				// Pages in the same large page share the entry. Test-and-clear it only once.
+				if(entry==null)
+					last_dirty=false;
+				else if(entry!=last_entry)
+				{
+					last_dirty=noir_locked_btr64((i64v*)&entry->value,ia32_ept_dirty_bit);
+					harvested|=last_dirty;
+				}
+				last_entry=entry;
+				nvc_report_dirty_pages(bitmap,i,1,last_dirty,accumulate);
+			}
+			// Cached translations would not set the dirty bits again unless the EPT is invalidated.
+			if(harvested)nvc_vtc_invalidate_vm_tlb(virtual_machine);
+		}
+	}
 	return st;
 }
 
@@ -929,10 +1460,50 @@ void nvc_vtc_release_vcpu(noir_vt_custom_vcpu_p virtual_processor)
 		// Release Extended State.
 		if(virtual_processor->header.xsave_area)
 			noir_free_contd_memory(virtual_processor->header.xsave_area,page_size);
+		nvc_free_exit_profiler(virtual_processor->header.profiler);
 		noir_free_nonpg_memory(virtual_processor);
 	}
 }
 
+void nvc_vt_init_vcpu_cpuid_quickpath(noir_vt_custom_vcpu_p vcpu)
+{
+	noir_cvm_cpuid_quickpath_info qp={0};
+	qp.options.active=true;
+	// Standard Leaf 1 - Basic Processor Feature Identifiers.
+	qp.leaf=ia32_cpuid_std_proc_feature;
+	noir_cpuid(qp.leaf,0,&qp.eax,&qp.ebx,&qp.ecx,&qp.edx);
+	// Initial APIC ID
+	qp.ebx&=0xFFFFFF;
+	qp.ebx|=(vcpu->vcpu_id&0xff)<<24;
+	// Indicate Hypervisor Presence.
+	noir_bts(&qp.ecx,ia32_cpuid_hv_presence);
+	// Indicate no support to Intel VT-x.
+	noir_btr(&qp.ecx,ia32_cpuid_vmx);
+	nvc_insert_cpuid_quickpath(vcpu->header.cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&vcpu->header.cpuid_quickpath_count,&qp);
+}
+
+void nvc_vt_init_vm_cpuid_quickpath(noir_vt_custom_vm_p vm)
+{
+	noir_cvm_cpuid_quickpath_info qp={0};
+	qp.options.active=true;
+	qp.options.vm_wide=true;
+	// The first two fields will be compliant with Microsoft Hypervisor Top-Level Functionality Specification
+	// even though NoirVisor CVM is running with different set of Hypervisor functionalities.
+	qp.leaf=ncvm_cpuid_leaf_range_and_vendor_string;
+	qp.eax=ncvm_cpuid_leaf_limit;				// NoirVisor CVM CPUID Leaf Limit.
+	noir_movsb(&qp.ebx,"NoirVisor ZT",12);		// The Vendor String is "NoirVisor ZT"
+	nvc_insert_cpuid_quickpath(vm->header.cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vm,noir_cvm_cpuid_quickpath_limit_per_vm,&vm->header.cpuid_quickpath_count,&qp);
+	qp.leaf=ncvm_cpuid_vendor_neutral_interface_id;
+	noir_movsb(&qp.eax,"Hv#0",4);		// Interface Signature is "Hv#0". Indicate Non-Compliance to MSHV-TLFS.
+	qp.ebx=qp.ecx=qp.edx=0;				// Clear the Reserved CPUID fields.
+	nvc_insert_cpuid_quickpath(vm->header.cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vm,noir_cvm_cpuid_quickpath_limit_per_vm,&vm->header.cpuid_quickpath_count,&qp);
+	// Other leaves are passed through from host without masking.
+	vm->header.cpuid_fallback.options.active=true;
+	vm->header.cpuid_fallback.options.host_masked=true;
+	vm->header.cpuid_fallback.options.vm_wide=true;
+	noir_stosd(&vm->header.cpuid_fallback.eax,0xffffffff,4);
+}
+
 noir_status nvc_vtc_create_vcpu(noir_vt_custom_vcpu_p *virtual_processor,noir_vt_custom_vm_p virtual_machine,u32 vcpu_id)
 {
 	noir_status st=noir_invalid_parameter;
@@ -942,29 +1513,35 @@ noir_status nvc_vtc_create_vcpu(noir_vt_custom_vcpu_p *virtual_processor,noir_vt
 		noir_acquire_reslock_exclusive(virtual_machine->header.vcpu_list_lock);
 		if(virtual_machine->vcpu[vcpu_id]==null)
 		{
-			noir_vt_custom_vcpu_p vcpu=noir_alloc_nonpg_memory(sizeof(noir_vt_custom_vcpu));
+			// The vCPU is most likely run by the thread creating it. Place its structures on the local NUMA node.
+			const u32 node=noir_get_processor_numa_node(noir_get_current_processor());
+			noir_vt_custom_vcpu_p vcpu=noir_alloc_nonpg_memory_for_numa(node,sizeof(noir_vt_custom_vcpu));
 			if(vcpu)
 			{
 				*virtual_processor=vcpu;
-				vcpu->vmcs.virt=noir_alloc_contd_memory(page_size);
+				vcpu->vmcs.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 				if(vcpu->vmcs.virt)
 					vcpu->vmcs.phys=noir_get_physical_address(vcpu->vmcs.virt);
 				else
 					goto alloc_failure;
-				vcpu->msr_auto.virt=noir_alloc_contd_memory(page_size);
+				vcpu->msr_auto.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 				if(vcpu->msr_auto.virt)
 					vcpu->msr_auto.phys=noir_get_physical_address(vcpu->msr_auto.virt);
 				else
 					goto alloc_failure;
 				// Allocate XSAVE State Area
-				vcpu->header.xsave_area=noir_alloc_contd_memory(hvm_p->xfeat.supported_size_max);
+				vcpu->header.xsave_area=noir_alloc_contd_memory_for_numa(node,hvm_p->xfeat.supported_size_max);
 				if(vcpu->header.xsave_area==null)goto alloc_failure;
+				vcpu->header.profiler=nvc_alloc_exit_profiler(noir_vt_exit_profiler_reasons);
 				// Set the parent VM.
 				vcpu->vm=virtual_machine;
+				vcpu->header.gva_tlb_shootdown=&virtual_machine->header.gva_tlb_shootdown;
 				virtual_machine->vcpu[vcpu_id]=vcpu;
 				// vCPU basic info
 				vcpu->vcpu_id=vcpu_id;
 				vcpu->proc_id=0xffffffff;
+				// Initialize vCPU CPUID-QuickPath
+				nvc_vt_init_vcpu_cpuid_quickpath(vcpu);
 				// Initialize VMCS via a hypercall.
 				noir_vt_vmcall(noir_vt_init_custom_vmcs,(ulong_ptr)vcpu);
 				st=noir_success;
@@ -983,12 +1560,16 @@ void nvc_vtc_release_vm(noir_vt_custom_vm_p virtual_machine)
 {
 	if(virtual_machine)
 	{
-		if(virtual_machine->msr_bitmap.virt)
-			noir_free_contd_memory(virtual_machine->msr_bitmap.virt,page_size);
 		// Release vCPU List...
 		noir_acquire_reslock_exclusive(virtual_machine->header.vcpu_list_lock);
 		if(virtual_machine->vcpu)
 		{
+			// Kick all vCPUs so that preempted runs would leave rather than wait for the exclusion.
+			for(u32 i=0;i<255;i++)
+				if(virtual_machine->vcpu[i])
+					nvc_kick_vcpu(&virtual_machine->vcpu[i]->header);
+			// Wait for running vCPUs to leave. The exclusion is gone with the VM structure.
+			nvc_acquire_vm_exclusion(&virtual_machine->header);
 			// Traverse vCPU List and free them...
 			for(u32 i=0;i<255;i++)
 				if(virtual_machine->vcpu[i])
@@ -996,6 +1577,11 @@ void nvc_vtc_release_vm(noir_vt_custom_vm_p virtual_machine)
 			noir_free_nonpg_memory(virtual_machine->vcpu);
 		}
 		noir_release_reslock(virtual_machine->header.vcpu_list_lock);
+		// Running vCPUs use the MSR bitmap and the TLB tracker. Release them after the vCPUs.
+		if(virtual_machine->msr_bitmap.virt)
+			noir_free_contd_memory(virtual_machine->msr_bitmap.virt,page_size);
+		if(virtual_machine->tlb_tracker.ran)
+			noir_free_nonpg_memory((void*)virtual_machine->tlb_tracker.ran);
 		// Release Extended Paging Structure...
 		if(virtual_machine->eptm.eptp.virt)
 			noir_free_contd_memory(virtual_machine->eptm.eptp.virt,page_size);
@@ -1036,8 +1622,6 @@ void nvc_vtc_release_vm(noir_vt_custom_vm_p virtual_machine)
 		noir_acquire_reslock_exclusive(hvm_p->tlb_tagging.vpid_pool_lock);
 		noir_reset_bitmap(hvm_p->tlb_tagging.vpid_pool,virtual_machine->vpid-hvm_p->tlb_tagging.start);
 		noir_release_reslock(hvm_p->tlb_tagging.vpid_pool_lock);
-		// Free VM Structure.
-		noir_free_nonpg_memory(virtual_machine);
 	}
 }
 
@@ -1069,6 +1653,7 @@ noir_status nvc_vtc_create_vm(noir_vt_custom_vm_p *virtual_machine)
 				eptp.value=noir_get_physical_address(vm->eptm.eptp.virt);
 				eptp.memory_type=ia32_write_back;
 				eptp.walk_length=3;
+				eptp.dirty_flag=hvm_p->cvm_cap.accessed_dirty;
 				vm->eptm.eptp.phys=eptp.value;
 			}
 			else
@@ -1076,15 +1661,25 @@ noir_status nvc_vtc_create_vm(noir_vt_custom_vm_p *virtual_machine)
 			// Allocate VPID
 			vm->vpid=nvc_vtc_alloc_vpid();
 			if(vm->vpid==0xffffffff)goto alloc_failure;
+			// Allocate EPT Invalidation Tracker. Every processor must invalidate the EPT before its first entry.
+			vm->tlb_tracker.words=(hvm_p->cpu_count+31)>>5;
+			vm->tlb_tracker.ran=noir_alloc_nonpg_memory(vm->tlb_tracker.words<<3);
+			if(vm->tlb_tracker.ran==null)goto alloc_failure;
+			vm->tlb_tracker.stale=&vm->tlb_tracker.ran[vm->tlb_tracker.words];
+			noir_stosd((u32*)vm->tlb_tracker.stale,0xffffffff,vm->tlb_tracker.words);
 			// Setup MSR Bitmap.
 			noir_stosb(vm->msr_bitmap.virt,0xff,page_size);
 			// Some MSRs are unnecessary to be intercepted. Rule them out from the bitmap.
+			// Initialize CPUID Quick-Path
+			nvc_vt_init_vm_cpuid_quickpath(vm);
 			st=noir_success;
 		}
 	}
 	return st;
 alloc_failure:
+	// The VM structure is freed by the caller of nvc_vtc_release_vm after the lockers are released.
 	nvc_vtc_release_vm(*virtual_machine);
+	noir_free_nonpg_memory(*virtual_machine);
 	*virtual_machine=null;
 	return noir_insufficient_resources;
 }
@@ -212,49 +212,17 @@ void static noir_hvcode fastcall nvc_vt_cpuid_cvexit_handler(noir_gpr_state_p gp
 	{
 		// NoirVisor will be handling CVM's CPUID Interception.
 		u32 leaf=(u32)gpr_state->rax,subleaf=(u32)gpr_state->rcx;
-		u32 leaf_class=noir_cpuid_class(leaf);
 		noir_cpuid_general_info info;
-		if(leaf_class==hvm_leaf_index)
+		// Use QuickPath to handle CPUID interception.
+		// If the host is updating QuickPath, resume the guest without advancing rip so that cpuid is retried.
+		if(nvc_resolve_cpuid_quickpath(&cvcpu->vm->header,&cvcpu->header,leaf,subleaf,&info))
 		{
-			// The first two fields will be compliant with Microsoft Hypervisor Top-Level Functionality Specification
-			// even though NoirVisor CVM is running with different set of Hypervisor functionalities.
-			switch(leaf)
-			{
-				case ncvm_cpuid_leaf_range_and_vendor_string:
-				{
-					info.eax=ncvm_cpuid_leaf_limit;					// NoirVisor CVM CPUID Leaf Limit.
-					noir_movsb(&info.ebx,"NoirVisor ZT",12);		// The Vendor String is "NoirVisor ZT"
-					break;
-				}
-				case ncvm_cpuid_vendor_neutral_interface_id:
-				{
-					noir_movsb(&info.eax,"Hv#0",4);		// Interface Signature is "Hv#0". Indicate Non-Compliance to MSHV-TLFS.
-					info.eax=info.ebx=info.ecx=0;		// Clear the Reserved CPUID fields.
-					break;
-				}
-				default:
-				{
-					noir_movsd((u32*)&info,0,4);
-					break;
-				}
-			}
-		}
-		else
-		{
-			noir_cpuid(leaf,subleaf,&info.eax,&info.ebx,&info.ecx,&info.edx);
-			switch(leaf)
-			{
-				case ia32_cpuid_std_proc_feature:
-				{
-					// Indicate Hypervisor Presence.
-					noir_bts(&info.ecx,ia32_cpuid_hv_presence);
-					// Indicate no support to Intel VT-x.
-					noir_btr(&info.ecx,ia32_cpuid_vmx);
-					break;
-				}
-			}
+			*(u32*)&gpr_state->rax=info.eax;
+			*(u32*)&gpr_state->rbx=info.ebx;
+			*(u32*)&gpr_state->rcx=info.ecx;
+			*(u32*)&gpr_state->rdx=info.edx;
+			noir_vt_advance_rip();
 		}
-		noir_vt_advance_rip();
 	}
 }
 
@@ -275,6 +243,14 @@ void static noir_hvcode fastcall nvc_vt_invd_cvexit_handler(noir_gpr_state_p gpr
 	noir_vt_advance_rip();
 }
 
+// Expected Exit Reason: 14, 58
+void static noir_hvcode fastcall nvc_vt_invlpg_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu)
+{
+	// The invlpg and invpcid instructions are intercepted only if the software TLB holds translations.
+	// Discard the software TLB. The instruction will be re-executed without interception.
+	nvc_vt_release_gva_tlb(cvcpu);
+}
+
 void static noir_hvcode fastcall nvc_vt_vmcall_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu)
 {
 	// The Guest invoked a hypercall. Deliver to the subverted host.
@@ -441,8 +417,10 @@ void static noir_hvcode fastcall nvc_vt_cr_access_cvexit_handler(noir_gpr_state_
 			{
 				case 3:
 				{
-					// Write to CR3 is intercepted...
-					if(cvcpu->header.vcpu_options.intercept_cr3 && info.cr_num==3)
+					// Write to CR3 is intercepted if the software TLB holds translations or the subverted host specifies so.
+					// Discard the software TLB.
+					nvc_vt_release_gva_tlb(cvcpu);
+					if(cvcpu->header.vcpu_options.intercept_cr3)
 					{
 						nvc_vt_save_generic_cvexit_context(cvcpu);
 						nvc_vt_switch_to_host_vcpu(gpr_state,vcpu);
@@ -453,15 +431,7 @@ void static noir_hvcode fastcall nvc_vt_cr_access_cvexit_handler(noir_gpr_state_
 						cvcpu->header.exit_context.cr_access.write=0;
 						cvcpu->header.exit_context.cr_access.reserved0=0;
 					}
-					else
-					{
-						invvpid_descriptor ivd={0};
-						if(info.gpr_num==4)noir_vt_vmread(guest_rsp,&gpr_state->rsp);
-						noir_vt_vmwrite(guest_cr3,gpr_array[info.gpr_num]);
-						ivd.vpid=cvcpu->vm->vpid;
-						noir_vt_invvpid(vpid_sicrgb_invd,&ivd);
-						noir_vt_advance_rip();
-					}
+					// Otherwise, the instruction will be re-executed without interception.
 					break;
 				}
 				case 4:
@@ -625,7 +595,21 @@ void static noir_hvcode fastcall nvc_vt_io_cvexit_handler(noir_gpr_state_p gpr_s
 
 void static noir_hvcode fastcall nvc_vt_rdmsr_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu)
 {
-	if(cvcpu->header.vcpu_options.intercept_msr)
+	noir_cvm_msr_quickpath_result qp_result;
+	large_integer val;
+	val.low=(u32)gpr_state->rax;
+	val.high=(u32)gpr_state->rdx;
+	// MSR Quick-Path is shared with SVM-Core.
+	qp_result=nvc_handle_msr_quickpath(&cvcpu->vm->header,(u32)gpr_state->rcx,false,&val.value);
+	if(qp_result==noir_cvm_msr_quickpath_handled)
+	{
+		*(u32*)&gpr_state->rax=val.low;
+		*(u32*)&gpr_state->rdx=val.high;
+		noir_vt_advance_rip();
+	}
+	else if(qp_result==noir_cvm_msr_quickpath_fault)
+		noir_vt_inject_event(ia32_general_protection,ia32_hardware_exception,true,0,0);
+	else if(cvcpu->header.vcpu_options.intercept_msr)
 	{
 		// Switch to subverted host in order to handle rdmsr instruction.
 		nvc_vt_save_generic_cvexit_context(cvcpu);
@@ -654,7 +638,19 @@ void static noir_hvcode fastcall nvc_vt_rdmsr_cvexit_handler(noir_gpr_state_p gp
 
 void static noir_hvcode fastcall nvc_vt_wrmsr_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu)
 {
-	if(cvcpu->header.vcpu_options.intercept_msr)
+	noir_cvm_msr_quickpath_result qp_result;
+	large_integer val;
+	val.low=(u32)gpr_state->rax;
+	val.high=(u32)gpr_state->rdx;
+	// MSR Quick-Path is shared with SVM-Core.
+	qp_result=nvc_handle_msr_quickpath(&cvcpu->vm->header,(u32)gpr_state->rcx,true,&val.value);
+	if(qp_result==noir_cvm_msr_quickpath_handled)
+	{
+		noir_vt_advance_rip();
+	}
+	else if(qp_result==noir_cvm_msr_quickpath_fault)
+		noir_vt_inject_event(ia32_general_protection,ia32_hardware_exception,true,0,0);
+	else if(cvcpu->header.vcpu_options.intercept_msr)
 	{
 		// Switch to subverted host in order to handle wrmsr instruction.
 		nvc_vt_save_generic_cvexit_context(cvcpu);
@@ -21,6 +21,9 @@
 
 #define vt_attrib(s,a)				(u32)(a|(s==0?0x10000:0))
 
+// Exit profiler slots: One for each basic exit reason and one for the unknown reasons.
+#define noir_vt_exit_profiler_reasons	71
+
 typedef union _ia32_vmx_basic_msr
 {
 	struct
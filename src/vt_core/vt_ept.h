@@ -22,6 +22,10 @@
 // Specify the top address of mapped GPA.
 #define noir_ept_top_address				0x7FFFFFFFFF
 
+// Accessed and Dirty bits are located identically in all leaf entries.
+#define ia32_ept_accessed_dirty_bits		0x300
+#define ia32_ept_dirty_bit					9
+
 typedef union _ia32_addr_translator
 {
 	struct
@@ -227,6 +231,15 @@ typedef struct _noir_ept_pte_descriptor
 	u64 gpa_start;
 }noir_ept_pte_descriptor,*noir_ept_pte_descriptor_p;
 
+// Descriptors found by the previous leaf lookup.
+// Consecutive pages are usually described by the same descriptors.
+typedef struct _noir_ept_leaf_cache
+{
+	noir_ept_pdpte_descriptor_p pdpte;
+	noir_ept_pde_descriptor_p pde;
+	noir_ept_pte_descriptor_p pte;
+}noir_ept_leaf_cache,*noir_ept_leaf_cache_p;
+
 typedef struct _noir_ept_manager
 {
 	struct
@@ -405,6 +405,20 @@ void static noir_hvcode fastcall nvc_vt_vmcall_handler(noir_gpr_state_p gpr_stat
 	u32 index=(u32)gpr_state->rcx;
 	noir_vt_vmread(guest_rip,&gip);
 	noir_vt_vmread(guest_cr3,&gcr3);
+	// Hv#1 hypercalls are issued from the hypercall page with a signature in eax.
+	if((u32)gpr_state->rax==noir_mshv_hypercall_signature && hvm_p->options.cpuid_hv_presence)
+	{
+		vmx_segment_access_right ss_attrib;
+		noir_vt_vmread(guest_ss_access_rights,&ss_attrib.value);
+		if(ss_attrib.dpl==0)
+		{
+			gpr_state->rax=nvc_mshv_hypercall_handler(&vcpu->mshvcpu,gpr_state->rcx,gpr_state->rdx,gpr_state->r8);
+			noir_vt_advance_rip();
+		}
+		else
+			noir_vt_inject_event(ia32_invalid_opcode,ia32_hardware_exception,false,0,0);
+		return;
+	}
 	switch(index)
 	{
 		case noir_vt_callexit:
@@ -489,8 +503,24 @@ void static noir_hvcode fastcall nvc_vt_vmcall_handler(noir_gpr_state_p gpr_stat
 #else
 				noir_vt_custom_vcpu_p cvcpu=(noir_vt_custom_vcpu_p)gpr_state->rdx;
 #endif
+				u32 run_state;
 				noir_vt_advance_rip();
 				nvc_vt_switch_to_guest_vcpu(gpr_state,vcpu,cvcpu);
+				// Publish that the vCPU is in guest mode so that kickers would interrupt this processor.
+				// A kick or preemption published earlier did not interrupt this processor. Return to the host at once.
+				run_state=noir_locked_or(&cvcpu->header.run_state,1<<noir_cvm_vcpu_in_guest);
+				if(noir_bt(&run_state,noir_cvm_vcpu_kicked) || noir_bt(&run_state,noir_cvm_vcpu_preempted))
+				{
+					noir_vt_initial_stack_p loader_stack=(noir_vt_initial_stack_p)((ulong_ptr)vcpu->hv_stack+nvc_stack_size-sizeof(noir_vt_initial_stack));
+					// The VMCS of the vCPU is not launched. Make sure it is cleared again on the next run.
+					if(loader_stack->flags.initial_vmcs)
+					{
+						loader_stack->flags.initial_vmcs=false;
+						cvcpu->proc_id=0xffffffff;
+					}
+					nvc_vt_switch_to_host_vcpu(gpr_state,vcpu);
+					cvcpu->header.exit_context.intercept_code=noir_bt(&run_state,noir_cvm_vcpu_kicked)?cv_rescission:cv_scheduler_exit;
+				}
 			}
 			break;
 		}
@@ -1440,18 +1470,30 @@ void noir_hvcode fastcall nvc_vt_exit_handler(noir_gpr_state_p gpr_state,noir_vt
 	// Confirm which vCPU is exiting so that the correct handler is to be invoked...
 	if(likely(vmcs_phys==vcpu->vmcs.phys))
 	{
+		// Profiler: Timestamp the VM-Exit only if the exit profiler is enabled.
+		noir_exit_profiler_p profiler=vcpu->cvm_state.profiler;
+		u64 profiler_tsc=0;
+		u32 profiler_aux;
+		if(unlikely(profiler!=null))profiler_tsc=noir_rdtscp(&profiler_aux);
 		if(exit_reason<vmx_maximum_exit_reason)
 			vt_exit_handlers[exit_reason](gpr_state,vcpu);
 		else
 			nvc_vt_default_handler(gpr_state,vcpu);
+		// Profiler: Unknown exit reasons share the last slot.
+		if(unlikely(profiler!=null))nvc_record_exit_latency(profiler,exit_reason<vmx_maximum_exit_reason?exit_reason:vmx_maximum_exit_reason,noir_rdtscp(&profiler_aux)-profiler_tsc);
 	}
 	else if(vmcs_phys==loader_stack->custom_vcpu->vmcs.phys)
 	{
 		noir_vt_custom_vcpu_p cvcpu=loader_stack->custom_vcpu;
+		noir_exit_profiler_p profiler=cvcpu->header.profiler;
+		u64 profiler_tsc=0;
+		u32 profiler_aux;
+		if(unlikely(profiler!=null))profiler_tsc=noir_rdtscp(&profiler_aux);
 		if(exit_reason<vmx_maximum_exit_reason)
 			vt_cvexit_handlers[exit_reason](gpr_state,vcpu,cvcpu);
 		else
 			nvc_vt_default_cvexit_handler(gpr_state,vcpu,cvcpu);
+		if(unlikely(profiler!=null))nvc_record_exit_latency(profiler,exit_reason<vmx_maximum_exit_reason?exit_reason:vmx_maximum_exit_reason,noir_rdtscp(&profiler_aux)-profiler_tsc);
 	}
 	else
 	{
@@ -1553,6 +1595,40 @@ void noir_hvcode nvc_vt_inject_nmi_to_subverted_host()
 	noir_vt_vmptrld(&vmcs_phys);
 }
 
+// Invalidate the guest's TLB on behalf of Hv#1 flush hypercalls.
+// Intel VT-x cannot broadcast invalidations. Remote flushes are left to the guest.
+bool noir_hvcode nvc_vt_mshv_flush_guest_tlb(noir_vt_vcpu_p vcpu,u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	if(remote)return false;
+	// Without VPID, TLBs are flushed upon every VM-Entry anyway.
+	if(vcpu->enabled_feature & noir_vt_vpid_tagged_tlb)
+	{
+		ia32_vmx_ept_vpid_cap_msr ev_cap;
+		invvpid_descriptor ivd;
+		ev_cap.value=noir_rdmsr(ia32_vmx_ept_vpid_cap);
+		ivd.vpid=1;
+		ivd.reserved[0]=ivd.reserved[1]=ivd.reserved[2]=0;
+		ivd.linear_address=0;
+		if(gva_list && ev_cap.support_ia_invvpid)
+		{
+			for(u32 i=0;i<count;i++)
+			{
+				u64 va=page_base(gva_list[i]);
+				for(u32 j=0;j<=(u32)page_offset(gva_list[i]);j++)
+				{
+					ivd.linear_address=va+page_mult((u64)j);
+					noir_vt_invvpid(vpid_indiva_invd,&ivd);
+				}
+			}
+		}
+		else if(non_global && ev_cap.support_scrg_invvpid)
+			noir_vt_invvpid(vpid_sicrgb_invd,&ivd);
+		else
+			noir_vt_invvpid(vpid_single_invd,&ivd);
+	}
+	return true;
+}
+
 void noir_hvcode nvc_vt_reconfigure_npiep_interceptions(noir_vt_vcpu_p vcpu)
 {
 	ulong_ptr gcr4;
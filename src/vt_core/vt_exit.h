@@ -555,6 +555,7 @@ void static fastcall nvc_vt_task_switch_cvexit_handler(noir_gpr_state_p gpr_stat
 void static fastcall nvc_vt_cpuid_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void static fastcall nvc_vt_hlt_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void static fastcall nvc_vt_invd_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
+void static fastcall nvc_vt_invlpg_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void static fastcall nvc_vt_vmcall_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void static fastcall nvc_vt_vmclear_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
 void static fastcall nvc_vt_vmlaunch_cvexit_handler(noir_gpr_state_p gpr_state,noir_vt_vcpu_p vcpu,noir_vt_custom_vcpu_p cvcpu);
@@ -593,7 +594,7 @@ noir_hvdata noir_vt_cvexit_handler_routine vt_cvexit_handlers[vmx_maximum_exit_r
 	nvc_vt_default_cvexit_handler,			// GETSEC Instruction
 	nvc_vt_hlt_cvexit_handler,				// HLT Instruction
 	nvc_vt_invd_cvexit_handler,				// INVD Instruction
-	nvc_vt_default_cvexit_handler,			// INVLPG Instruction
+	nvc_vt_invlpg_cvexit_handler,			// INVLPG Instruction
 	nvc_vt_default_cvexit_handler,			// RDPMC Instruction
 	nvc_vt_default_cvexit_handler,			// RDTSC Instruction
 	nvc_vt_default_cvexit_handler,			// RSM Instruction
@@ -637,7 +638,7 @@ noir_hvdata noir_vt_cvexit_handler_routine vt_cvexit_handlers[vmx_maximum_exit_r
 	nvc_vt_xsetbv_cvexit_handler,			// XSETBV Instruction
 	nvc_vt_default_cvexit_handler,			// APIC Write
 	nvc_vt_default_cvexit_handler,			// RDRAND Instruction
-	nvc_vt_default_cvexit_handler,			// INVPCID Instruction
+	nvc_vt_invlpg_cvexit_handler,			// INVPCID Instruction
 	nvc_vt_default_cvexit_handler,			// VMFUNC Instruction
 	nvc_vt_default_cvexit_handler,			// ENCLS Instruction
 	nvc_vt_default_cvexit_handler,			// RDSEED Instruction
@@ -91,6 +91,18 @@ bool nvc_is_ept_supported()
 	return false;
 }
 
+void nvc_vt_query_cvm_paging_capability(noir_hypervisor_p hvm)
+{
+	ia32_vmx_ept_vpid_cap_msr ev_cap;
+	ev_cap.value=noir_rdmsr(ia32_vmx_ept_vpid_cap);
+	hvm->cvm_cap.large_page=ev_cap.support_2mb_paging;
+	hvm->cvm_cap.huge_page=ev_cap.support_1gb_paging;
+	hvm->cvm_cap.accessed_dirty=ev_cap.support_accessed_dirty_flags;
+	hvm->cvm_cap.msr_quick_path=true;
+	// Single-context invalidation does not flush other VMs. Fall back to all-context if it is unsupported.
+	((noir_vt_hvm_p)hvm->relative_hvm)->cvm_invept_type=ev_cap.support_single_context_invept?ept_single_invd:ept_global_invd;
+}
+
 bool nvc_is_vt_enabled()
 {
 	ia32_feature_control_msr feat_ctrl;
@@ -131,6 +143,7 @@ void static nvc_vt_cleanup(noir_hypervisor_p hvm)
 					noir_free_nonpg_memory(vcpu->hv_stack);
 				if(vcpu->cvm_state.xsave_area)
 					noir_free_contd_memory(vcpu->cvm_state.xsave_area,page_size);
+				nvc_free_exit_profiler(vcpu->cvm_state.profiler);
 				nvc_ept_cleanup(vcpu->ept_manager);
 			}
 			noir_free_nonpg_memory(hvm->virtual_cpu);
@@ -920,35 +933,39 @@ noir_status nvc_vt_subvert_system(noir_hypervisor_p hvm)
 		for(u32 i=0;i<hvm->cpu_count;i++)
 		{
 			noir_vt_vcpu_p vcpu=&hvm->virtual_cpu[i];
-			vcpu->vmcs.virt=noir_alloc_contd_memory(page_size);
+			// Place per-processor structures on the processor's local NUMA node, so VM-Exits would not touch remote memory.
+			const u32 node=noir_get_processor_numa_node(i);
+			nv_dprintf("Processor %u: hypervisor structures are placed on NUMA node %u.\n",i,node);
+			vcpu->vmcs.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->vmcs.virt)
 				vcpu->vmcs.phys=noir_get_physical_address(vcpu->vmcs.virt);
 			else
 				goto alloc_failure;
-			vcpu->vmxon.virt=noir_alloc_contd_memory(page_size);
+			vcpu->vmxon.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->vmxon.virt)
 				vcpu->vmxon.phys=noir_get_physical_address(vcpu->vmxon.virt);
 			else
 				goto alloc_failure;
-			vcpu->msr_auto.virt=noir_alloc_contd_memory(page_size);
+			vcpu->msr_auto.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->msr_auto.virt)
 				vcpu->msr_auto.phys=noir_get_physical_address(vcpu->msr_auto.virt);
 			else
 				goto alloc_failure;
-			vcpu->nested_vcpu.vmcs_t.virt=noir_alloc_contd_memory(page_size);
+			vcpu->nested_vcpu.vmcs_t.virt=noir_alloc_contd_memory_for_numa(node,page_size);
 			if(vcpu->nested_vcpu.vmcs_t.virt)
 				vcpu->nested_vcpu.vmcs_t.phys=noir_get_physical_address(vcpu->nested_vcpu.vmcs_t.virt);
 			else
 				goto alloc_failure;
-			vcpu->hv_stack=noir_alloc_nonpg_memory(nvc_stack_size);
+			vcpu->hv_stack=noir_alloc_nonpg_memory_for_numa(node,nvc_stack_size);
 			if(vcpu->hv_stack==null)
 				goto alloc_failure;
 			vcpu->ept_manager=(void*)nvc_ept_build_identity_map();
 			if(vcpu->ept_manager==null)
 				goto alloc_failure;
-			vcpu->cvm_state.xsave_area=noir_alloc_contd_memory(hvm->xfeat.supported_size_max);
+			vcpu->cvm_state.xsave_area=noir_alloc_contd_memory_for_numa(node,hvm->xfeat.supported_size_max);
 			if(vcpu->cvm_state.xsave_area==null)
 				goto alloc_failure;
+			vcpu->cvm_state.profiler=nvc_alloc_exit_profiler(noir_vt_exit_profiler_reasons);
 			if(hvm_p->options.stealth_msr_hook)
 			{
 				if(hvm_p->options.kva_shadow_presence)
@@ -988,6 +1005,7 @@ noir_status nvc_vt_subvert_system(noir_hypervisor_p hvm)
 	}
 	nvc_vt_set_mshv_handler(hvm->options.tlfs_passthrough?false:hvm_p->options.cpuid_hv_presence);
 	hvm->relative_hvm->hvm_cpuid_leaf_max=nvc_mshv_build_cpuid_handlers();
+	nvc_mshv_initialize_reference_time();
 	if(hvm->relative_hvm->hvm_cpuid_leaf_max==0)goto alloc_failure;
 	if(hvm->virtual_cpu==null)goto alloc_failure;
 	// Build Host CR3 in order to operate physical addresses directly.
@@ -1002,6 +1020,8 @@ noir_status nvc_vt_subvert_system(noir_hypervisor_p hvm)
 			goto alloc_failure;
 #if !defined(_hv_type1)
 	if(nvc_vtc_initialize_cvm_module()!=noir_success)goto alloc_failure;
+	// Report large-page supportability of Intel EPT for Customizable VMs.
+	nvc_vt_query_cvm_paging_capability(hvm);
 	// Initialize VPID Pool for Customizable VMs.
 	if(hvm->options.nested_virtualization)
 	{
@@ -1055,5 +1075,6 @@ void nvc_vt_restore_system(noir_hypervisor_p hvm)
 		noir_generic_call(nvc_vt_restore_processor_thunk,hvm->virtual_cpu);
 		nvc_vt_cleanup(hvm);
 		nvc_mshv_teardown_cpuid_handlers();
+		nvc_mshv_finalize_reference_time();
 	}
 }
\ No newline at end of file
@@ -108,35 +108,103 @@ bool noir_hvcode fastcall noir_ci_is_ci_phys_page(u64 phys,void** virt)
 }
 
 #if !defined(_hv_type1)
+// Pages are partitioned across the workers in a strided way.
+// Each worker scans its partition in time-bounded slices.
 u32 static noir_hvcode stdcall noir_ci_enforcement_worker(void* context)
 {
 	// Retrieve Thread Context
-	noir_ci_context_p ncie=(noir_ci_context_p)context;
+	noir_ci_worker_p worker=(noir_ci_worker_p)context;
+	noir_ci_context_p ncie=noir_ci;
+	// Workers are pinned so that scanning is spread over processors.
+	noir_set_thread_affinity(worker->processor);
+	worker->sweep_start=noir_get_system_time();
 	// Check exit signal.
 	while(noir_locked_cmpxchg(&noir_ci_stop_signal,1,1)==0)
 	{
-		// Select a page to enforce CI.
-		u32 i=noir_ci_selected_page++;
-		// Skip pages that software CI was disabled.
-		if(!ncie->page_ci[i].options.soft_ci)goto skip_page;
-		void* page=ncie->page_ci[i].virt;
-		// Perform Enforcement.
-		u32 crc=noir_crc32_page(page);
-		if(crc!=ncie->page_ci[i].crc)
-			nvci_panicf("CI detected corruption in Page 0x%p!\n",page);
-		else
-			nvci_tracef("Page 0x%p scanned. CRC32C=0x%08X - No Anomaly.\n",page,crc);
+		u64 slice_start=noir_get_system_time(),now;
+		do
+		{
+			noir_ci_page_p ci_page=&ncie->page_ci[worker->selected_page];
+			// Skip pages that software CI was disabled.
+			if(ci_page->options.soft_ci)
+			{
+				// Perform Enforcement.
+				u32 crc=noir_crc32_page(ci_page->virt);
+				if(crc!=ci_page->crc)nvci_panicf("CI detected corruption in Page 0x%p!\n",ci_page->virt);
+			}
+			now=noir_get_system_time();
+			// Advance the CI page.
+			worker->selected_page+=ncie->workers;
+			if(worker->selected_page>=ncie->pages)
+			{
+				// A full sweep over the partition is completed.
+				worker->sweep_latency=now-worker->sweep_start;
+				worker->sweep_start=now;
+				worker->selected_page=worker->index;
+				nvci_tracef("CI Worker %u completed a sweep in %llu ms. No Anomaly.\n",worker->index,worker->sweep_latency/10000);
+				break;
+			}
+		}while(now-slice_start<ci_enforcement_slice);
 		// Clock.
 		noir_sleep(ci_enforcement_delay);
-skip_page:
-		// Advance the CI page.
-		if(noir_ci_selected_page==ncie->pages)noir_ci_selected_page=0;
 	}
 	// Thread is about to exit.
 	noir_exit_thread(0);
 	return 0;
 }
+
+void static noir_ci_stop_workers()
+{
+	// Set the signal.
+	noir_locked_inc(&noir_ci_stop_signal);
+	for(u32 i=0;i<noir_ci->workers;i++)
+	{
+		if(noir_ci->worker[i].thread)
+		{
+			// Wake up thread if sleeping.
+			noir_alert_thread(noir_ci->worker[i].thread);
+			// Wait for exit.
+			noir_join_thread(noir_ci->worker[i].thread);
+		}
+	}
+}
+
+bool static noir_ci_start_workers()
+{
+	const u32 processors=noir_get_processor_count();
+	u32 workers=processors;
+	if(workers>ci_max_workers)workers=ci_max_workers;
+	if(workers>noir_ci->pages)workers=noir_ci->pages;
+	// The number of workers must be determined before any worker starts.
+	noir_ci->workers=workers;
+	for(u32 i=0;i<workers;i++)
+	{
+		noir_ci->worker[i].index=i;
+		noir_ci->worker[i].processor=i*processors/workers;
+		noir_ci->worker[i].selected_page=i;
+		noir_ci->worker[i].thread=noir_create_thread(noir_ci_enforcement_worker,&noir_ci->worker[i]);
+		if(noir_ci->worker[i].thread==null)
+		{
+			noir_ci_stop_workers();
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+// Returns the latency of the slowest full sweep, in units of 100ns.
+u64 noir_ci_query_sweep_latency()
+{
+	u64 latency=0;
+#if !defined(_hv_type1)
+	if(noir_ci)
+		for(u32 i=0;i<noir_ci->workers;i++)
+			if(noir_ci->worker[i].sweep_latency>latency)
+				latency=noir_ci->worker[i].sweep_latency;
 #endif
+	return latency;
+}
 
 i32 static cdecl noir_ci_sorting_comparator(const void* a,const void*b)
 {
@@ -177,9 +245,8 @@ bool noir_activate_ci()
 		nvci_tracef("Number of pages protected by CI: %u\n",noir_ci->pages);
 		for(u32 i=0;i<noir_ci->pages;i++)
 			nvci_tracef("Physical: 0x%llX\t CRC32C: 0x%08X\t Virtual: 0x%p\n",noir_ci->page_ci[i].phys,noir_ci->page_ci[i].crc,noir_ci->page_ci[i].virt);
-		// Create Worker Thread.
-		if(noir_ci->options.soft_ci)noir_ci->ci_thread=noir_create_thread(noir_ci_enforcement_worker,noir_ci);
-		if(noir_ci->ci_thread || noir_ci->options.soft_ci==false)
+		// Create Worker Threads.
+		if(noir_ci->options.soft_ci==false || noir_ci_start_workers())
 			goto activation;
 		else
 		{
@@ -203,8 +270,14 @@ bool noir_initialize_ci(bool soft_ci,bool hard_ci)
 	// If both are disabled, fail the Code Integrity initialization.
 	if(use_hard || soft_ci)
 	{
-		// Check supportability of SSE4.2.
+		// Check supportability of SSE4.2 and PCLMULQDQ.
+#if defined(_amd64)
+		if(noir_check_sse42() && noir_check_pclmulqdq())
+			noir_crc32_page=noir_crc32_page_clmul;
+		else if(noir_check_sse42())
+#else
 		if(noir_check_sse42())
+#endif
 			noir_crc32_page=noir_crc32_page_sse;
 		else
 			noir_crc32_page=noir_crc32_page_std;
@@ -229,12 +302,7 @@ void noir_finalize_ci()
 	if(noir_ci)
 	{
 #if !defined(_hv_type1)
-		// Set the signal.
-		noir_locked_inc(&noir_ci_stop_signal);
-		// Wake up thread if sleeping.
-		noir_alert_thread(noir_ci->ci_thread);
-		// Wait for exit.
-		noir_join_thread(noir_ci->ci_thread);
+		noir_ci_stop_workers();
 #endif
 		// Finalization.
 		noir_free_contd_memory(noir_ci,page_size);
@@ -17,6 +17,7 @@
 #include <nvstatus.h>
 #include <noirhvm.h>
 #include <nv_intrin.h>
+#include <amd64.h>
 
 noir_status nvc_hax_get_version_info(void* buffer,u32 size,u32p return_size)
 {
@@ -409,8 +410,11 @@ noir_status nvc_hax_run_vcpu(noir_cvm_virtual_cpu_p vcpu)
 		// Input operation has post-processing procedures...
 		if(htun->io.flags.string)
 		{
-			// FIXME: For ins instructions, I/O buffer must be copied to input buffer.
-			;
+			// For ins instructions, I/O buffer must be copied to the guest buffer.
+			u32 error_code;
+			const size_t length=(size_t)htun->io.count*htun->io.size;
+			if(nvc_copy_guest_virtual_memory(vcpu,htun->io.gva,vcpu->iobuff,length,true,&error_code)<length)
+				nv_dprintf("Failed to write the buffer of string I/O! Error Code: 0x%X\n",error_code);
 		}
 		else
 		{
@@ -462,25 +466,62 @@ noir_status nvc_hax_run_vcpu(noir_cvm_virtual_cpu_p vcpu)
 				nv_dprintf("PIO on Port=0x%04X! Size=%u, (%s, %s)\n",htun->io.port,htun->io.size,htun->io.direction?"in":"out",htun->io.flags.string?"string":"value");
 				if(htun->io.flags.string)
 				{
-					u64 mask_a=(u64)-1;
-					u64 mask_b=0;
-					if(htun->io.direction)	// The ins instruction uses rdi.
-						htun->io.gva=vcpu->exit_context.io.rdi;
-					else					// The outs instruction uses rsi.
-						htun->io.gva=vcpu->exit_context.io.rsi;
-					// Append the base address.
-					htun->io.gva+=vcpu->exit_context.io.segment.base;
-					// Truncate the linear address by the width.
-					noir_copy_memory(&mask_b,&mask_a,vcpu->exit_context.io.access.address_width);
-					htun->io.gva&=mask_b;
+					// Handle the REP string I/O in bulk. As many elements as the I/O buffer can hold are transferred at once.
+					noir_cvm_io_context_p io=&vcpu->exit_context.io;
+					const u64 mask=io->access.address_width>=8?0xffffffffffffffff:(1ull<<(io->access.address_width<<3))-1;
+					const bool df=noir_bt((u32*)&vcpu->exit_context.rflags,amd64_rflags_df);
+					u64 count=io->access.repeat?io->rcx&mask:1;
+					u64 delta;
+					noir_gpr_state gpr;
+					if(count==0)
+					{
+						// With a zero count, the rep-prefixed instruction transfers nothing but retires.
+						nvc_edit_vcpu_registers(vcpu,noir_cvm_instruction_pointer,&vcpu->exit_context.next_rip,sizeof(u64));
+						resumption=true;
+						break;
+					}
+					if(count>page_size/htun->io.size)count=page_size/htun->io.size;
+					htun->io.df=(u8)df;
+					htun->io.count=(u16)count;
+					// The ins instruction uses rdi, and the outs instruction uses rsi.
+					htun->io.gva=io->segment.base+((htun->io.direction?io->rdi:io->rsi)&mask);
+					// The I/O buffer is in ascending order. If the direction flag is set, the first element is at the highest address.
+					if(df)htun->io.gva-=(count-1)*htun->io.size;
 					if(!htun->io.direction)
 					{
-						u16 size=htun->io.size;
-						// FIXME: For outs instruction. Output buffer must be copied to I/O Buffer.
-						if(vcpu->exit_context.io.access.repeat)size*=(u16)vcpu->exit_context.io.rcx;
+						// For outs instruction, Output buffer must be copied to I/O Buffer.
+						u32 error_code;
+						const size_t length=(size_t)count*htun->io.size;
+						const size_t copied=nvc_copy_guest_virtual_memory(vcpu,htun->io.gva,vcpu->iobuff,length,false,&error_code);
+						if(copied<length)
+						{
+							// The buffer is not readable. Deliver the #PF to the guest without transferring any elements.
+							noir_cvm_event_injection page_fault;
+							const u64 fault_va=htun->io.gva+copied;
+							nv_dprintf("Failed to read the buffer of string I/O! Error Code: 0x%X\n",error_code);
+							page_fault.attributes.value=0;
+							page_fault.attributes.vector=amd64_page_fault;
+							page_fault.attributes.type=3;		// Hardware Exception
+							page_fault.attributes.ec_valid=true;
+							page_fault.attributes.valid=true;
+							page_fault.error_code=error_code;
+							nvc_edit_vcpu_registers(vcpu,noir_cvm_cr2_register,(void*)&fault_va,sizeof(u64));
+							nvc_set_event_injection(vcpu,page_fault);
+							resumption=true;
+							break;
+						}
 					}
-					nv_dprintf("String I/O is unsupported!\n");
-					noir_int3();
+					// Retire the elements in this batch.
+					delta=count*htun->io.size;
+					nvc_view_vcpu_registers(vcpu,noir_cvm_general_purpose_register,&gpr,sizeof(gpr));
+					if(htun->io.direction)
+						gpr.rdi=(gpr.rdi&~mask)|((df?gpr.rdi-delta:gpr.rdi+delta)&mask);
+					else
+						gpr.rsi=(gpr.rsi&~mask)|((df?gpr.rsi-delta:gpr.rsi+delta)&mask);
+					if(io->access.repeat)gpr.rcx=(gpr.rcx&~mask)|((gpr.rcx-count)&mask);
+					nvc_edit_vcpu_registers(vcpu,noir_cvm_general_purpose_register,&gpr,sizeof(gpr));
+					// If elements remain, do not advance rip so that the instruction is re-executed.
+					if(io->access.repeat && (gpr.rcx&mask))break;
 				}
 				else if(!htun->io.direction)
 				{
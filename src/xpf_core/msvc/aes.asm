@@ -55,6 +55,8 @@ noir_aes128_expand_key proc
 	movaps xmmword ptr[rsp+30h],xmm3
 	; Load the key
 	movaps xmm0,xmmword ptr[rcx]
+	; The low dword of the shuffling register must be zero for key combination.
+	pxor xmm2,xmm2
 	test rdx,rdx
 	jz expand_decryption
 	noir_aes128_key_expand xmm3,1,xmm0,0,xmm2,xmm1
@@ -117,7 +119,7 @@ save_crypto_xmm macro
 	push rbp
 	mov rbp,rsp
 	and rsp,0fffffffffffffff0h
-	sub rsp,0c0h
+	sub rsp,140h
 	; Save XMM registers...
 	movaps xmmword ptr[rsp+000h],xmm0
 	movaps xmmword ptr[rsp+010h],xmm1
@@ -131,6 +133,11 @@ save_crypto_xmm macro
 	movaps xmmword ptr[rsp+090h],xmm9
 	movaps xmmword ptr[rsp+0A0h],xmm10
 	movaps xmmword ptr[rsp+0B0h],xmm11
+	movaps xmmword ptr[rsp+0C0h],xmm12
+	movaps xmmword ptr[rsp+0D0h],xmm13
+	movaps xmmword ptr[rsp+0E0h],xmm14
+	movaps xmmword ptr[rsp+0F0h],xmm15
+	; The remaining 40h bytes are for the tweaks of four blocks.
 
 endm
 
@@ -148,6 +155,10 @@ restore_crypto_xmm macro
 	movaps xmm9,xmmword ptr[rsp+090h]
 	movaps xmm10,xmmword ptr[rsp+0A0h]
 	movaps xmm11,xmmword ptr[rsp+0B0h]
+	movaps xmm12,xmmword ptr[rsp+0C0h]
+	movaps xmm13,xmmword ptr[rsp+0D0h]
+	movaps xmm14,xmmword ptr[rsp+0E0h]
+	movaps xmm15,xmmword ptr[rsp+0F0h]
 	; Restore the stack and return.
 	mov rsp,rbp
 	pop rbp
@@ -169,6 +180,64 @@ load_expanded_keys macro source
 
 endm
 
+; Derive the tweak of a page by encrypting the page tweak (in r11) with the encryption keys.
+; The tweak is held in r10 (low) and r11 (high) for the blocks.
+derive_page_tweak macro keys
+
+	movq xmm15,r11
+	pxor xmm15,xmm11
+	aesenc xmm15,xmmword ptr[keys+00h]
+	aesenc xmm15,xmmword ptr[keys+10h]
+	aesenc xmm15,xmmword ptr[keys+20h]
+	aesenc xmm15,xmmword ptr[keys+30h]
+	aesenc xmm15,xmmword ptr[keys+40h]
+	aesenc xmm15,xmmword ptr[keys+50h]
+	aesenc xmm15,xmmword ptr[keys+60h]
+	aesenc xmm15,xmmword ptr[keys+70h]
+	aesenc xmm15,xmmword ptr[keys+80h]
+	aesenclast xmm15,xmmword ptr[keys+90h]
+	movq r10,xmm15
+	pextrq r11,xmm15,1
+
+endm
+
+; Multiply the tweak by x in GF(2^128) and save it to the stack.
+next_block_tweak macro slot
+
+	mov rax,r11
+	sar rax,63
+	and eax,87h
+	shld r11,r10,1
+	add r10,r10
+	xor r10,rax
+	mov qword ptr[rsp+slot],r10
+	mov qword ptr[rsp+slot+8],r11
+
+endm
+
+; Apply the tweaks of four blocks.
+xor_block_tweaks macro
+
+	pxor xmm0,xmmword ptr[rsp+100h]
+	pxor xmm12,xmmword ptr[rsp+110h]
+	pxor xmm13,xmmword ptr[rsp+120h]
+	pxor xmm14,xmmword ptr[rsp+130h]
+
+endm
+
+; Perform a round on four blocks so that the latency of each round is hidden.
+aes_round4 macro ins,round_key
+
+	ins xmm0,round_key
+	ins xmm12,round_key
+	ins xmm13,round_key
+	ins xmm14,round_key
+
+endm
+
+; The pages are encrypted in XEX mode with four blocks interleaved.
+; The tweak of a page is derived from the page tweak (e.g.: physical address) so that
+; identical plaintext pages will not produce identical ciphertext.
 noir_aes128_encrypt_pages proc
 
 	;  Input Registers:
@@ -176,35 +245,57 @@ noir_aes128_encrypt_pages proc
 	; rdx: Expanded Keys
 	; r8: Number of Pages
 	; r9: The key
-	shl r8,12	; Get the size of encryption
-	xor eax,eax	; Offset to base.
+	; [rsp+28h]: Tweak of the first page. Tweak of subsequent pages increment by 4096.
 	; Save XMM registers...
 	save_crypto_xmm
 	; Load Keys...
 	load_expanded_keys rdx
 	movaps xmm11,xmmword ptr[r9]
+	shl r8,12	; Get the size of encryption
+	add r8,rcx	; Get the end of encryption
 	; Perform Encryption...
+encrypt_page_loop:
+	mov r11,qword ptr[rbp+30h]
+	derive_page_tweak rdx
+	lea r9,[rcx+1000h]
 encrypt_loop:
-	; Load a 16-byte block
-	movaps xmm0,xmmword ptr[rcx+rax]
-	; Encrypt the block. Note that AES-128 takes 10 rounds.
-	pxor xmm0,xmm11
-	aesenc xmm0,xmm1
-	aesenc xmm0,xmm2
-	aesenc xmm0,xmm3
-	aesenc xmm0,xmm4
-	aesenc xmm0,xmm5
-	aesenc xmm0,xmm6
-	aesenc xmm0,xmm7
-	aesenc xmm0,xmm8
-	aesenc xmm0,xmm9
-	aesenclast xmm0,xmm10
+	; Load four 16-byte blocks
+	movaps xmm0,xmmword ptr[rcx]
+	movaps xmm12,xmmword ptr[rcx+10h]
+	movaps xmm13,xmmword ptr[rcx+20h]
+	movaps xmm14,xmmword ptr[rcx+30h]
+	; Compute the tweaks.
+	next_block_tweak 100h
+	next_block_tweak 110h
+	next_block_tweak 120h
+	next_block_tweak 130h
+	xor_block_tweaks
+	; Encrypt the blocks. Note that AES-128 takes 10 rounds.
+	aes_round4 pxor,xmm11
+	aes_round4 aesenc,xmm1
+	aes_round4 aesenc,xmm2
+	aes_round4 aesenc,xmm3
+	aes_round4 aesenc,xmm4
+	aes_round4 aesenc,xmm5
+	aes_round4 aesenc,xmm6
+	aes_round4 aesenc,xmm7
+	aes_round4 aesenc,xmm8
+	aes_round4 aesenc,xmm9
+	aes_round4 aesenclast,xmm10
+	xor_block_tweaks
 	; Store the ciphertext
-	movaps xmmword ptr[rcx+rax],xmm0
-	; Increment the counter.
-	add rax,10h
-	cmp rax,r8
+	movaps xmmword ptr[rcx],xmm0
+	movaps xmmword ptr[rcx+10h],xmm12
+	movaps xmmword ptr[rcx+20h],xmm13
+	movaps xmmword ptr[rcx+30h],xmm14
+	; Increment the pointer.
+	add rcx,40h
+	cmp rcx,r9
 	jne encrypt_loop
+	; Go to the next page.
+	add qword ptr[rbp+30h],1000h
+	cmp rcx,r8
+	jne encrypt_page_loop
 	; Restore XMM registers...
 	restore_crypto_xmm
 	ret
@@ -218,39 +309,63 @@ noir_aes128_decrypt_pages proc
 	; rdx: Expanded Keys
 	; r8: Number of Pages
 	; r9: The key
-	shl r8,12	; Get the size of decryption
-	xor eax,eax	; Offset to base.
+	; [rsp+28h]: Tweak of the first page. Tweak of subsequent pages increment by 4096.
+	; [rsp+30h]: Expanded Keys for Encryption. They are required to derive the tweaks.
 	; Save XMM registers...
 	save_crypto_xmm
 	; Load Keys...
 	load_expanded_keys rdx
 	movaps xmm11,xmmword ptr[r9]
+	mov rdx,qword ptr[rbp+38h]
+	shl r8,12	; Get the size of decryption
+	add r8,rcx	; Get the end of decryption
 	; Perform Decryption...
+decrypt_page_loop:
+	mov r11,qword ptr[rbp+30h]
+	derive_page_tweak rdx
+	lea r9,[rcx+1000h]
 decrypt_loop:
-	; Load a 16-byte block
-	movaps xmm0,xmmword ptr[rcx+rax]
-	; Decrypt the block. Note that AES-128 takes 10 rounds.
-	pxor xmm0,xmm10
-	aesdec xmm0,xmm9
-	aesdec xmm0,xmm8
-	aesdec xmm0,xmm7
-	aesdec xmm0,xmm6
-	aesdec xmm0,xmm5
-	aesdec xmm0,xmm4
-	aesdec xmm0,xmm3
-	aesdec xmm0,xmm2
-	aesdec xmm0,xmm1
-	aesdeclast xmm0,xmm11
+	; Load four 16-byte blocks
+	movaps xmm0,xmmword ptr[rcx]
+	movaps xmm12,xmmword ptr[rcx+10h]
+	movaps xmm13,xmmword ptr[rcx+20h]
+	movaps xmm14,xmmword ptr[rcx+30h]
+	; Compute the tweaks.
+	next_block_tweak 100h
+	next_block_tweak 110h
+	next_block_tweak 120h
+	next_block_tweak 130h
+	xor_block_tweaks
+	; Decrypt the blocks. Note that AES-128 takes 10 rounds.
+	aes_round4 pxor,xmm10
+	aes_round4 aesdec,xmm9
+	aes_round4 aesdec,xmm8
+	aes_round4 aesdec,xmm7
+	aes_round4 aesdec,xmm6
+	aes_round4 aesdec,xmm5
+	aes_round4 aesdec,xmm4
+	aes_round4 aesdec,xmm3
+	aes_round4 aesdec,xmm2
+	aes_round4 aesdec,xmm1
+	aes_round4 aesdeclast,xmm11
+	xor_block_tweaks
 	; Store the plaintext
-	movaps xmmword ptr[rcx+rax],xmm0
-	; Increment the counter.
-	add rax,10h
-	cmp rax,r8
+	movaps xmmword ptr[rcx],xmm0
+	movaps xmmword ptr[rcx+10h],xmm12
+	movaps xmmword ptr[rcx+20h],xmm13
+	movaps xmmword ptr[rcx+30h],xmm14
+	; Increment the pointer.
+	add rcx,40h
+	cmp rcx,r9
 	jne decrypt_loop
+	; Go to the next page.
+	add qword ptr[rbp+30h],1000h
+	cmp rcx,r8
+	jne decrypt_page_loop
 	; Restore XMM registers...
 	restore_crypto_xmm
 	ret
 
 noir_aes128_decrypt_pages endp
 
-end
\ No newline at end of file
+end
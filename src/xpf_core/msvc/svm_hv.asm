@@ -132,6 +132,24 @@ nvc_svm_guest_start proc
 
 nvc_svm_guest_start endp
 
+; MASM does not recognize invlpgb and tlbsync instructions.
+noir_svm_invlpgb proc
+
+	mov rax,rcx
+	; The edx register is already in position.
+	mov ecx,r8d
+	db 0fh,01h,0feh		; invlpgb
+	ret
+
+noir_svm_invlpgb endp
+
+noir_svm_tlbsync proc
+
+	db 0fh,01h,0ffh		; tlbsync
+	ret
+
+noir_svm_tlbsync endp
+
 else
 
 assume fs:nothing
@@ -224,6 +242,23 @@ svm_launched:
 
 nvc_svm_subvert_processor_a endp
 
+noir_svm_invlpgb proc va_lo:dword,va_hi:dword,asid_pcid:dword,count:dword
+
+	mov eax,dword ptr [va_lo]
+	mov edx,dword ptr [asid_pcid]
+	mov ecx,dword ptr [count]
+	db 0fh,01h,0feh		; invlpgb
+	ret
+
+noir_svm_invlpgb endp
+
+noir_svm_tlbsync proc
+
+	db 0fh,01h,0ffh		; tlbsync
+	ret
+
+noir_svm_tlbsync endp
+
 endif
 
 hvtext ends
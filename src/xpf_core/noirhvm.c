@@ -181,6 +181,617 @@ noir_status nvc_set_guest_vcpu_options(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu
 	return st;
 }
 
+void static nvc_record_histogram(noir_exit_histogram_p histogram,u64 cycles)
+{
+	u32 bucket=0;
+	// Samples taking more than 2^32 cycles fall into the last bucket.
+	if(cycles>>32)
+		bucket=noir_exit_profiler_buckets-1;
+	else if(cycles)
+		noir_bsr(&bucket,(u32)cycles);
+	histogram->count++;
+	histogram->cycles+=cycles;
+	if(cycles>histogram->max_cycles)histogram->max_cycles=cycles;
+	histogram->buckets[bucket]++;
+}
+
+// Exclusive operations may take milliseconds (e.g.: NSV page reassignment).
+// Spin for a short while, then yield the processor to the holder.
+void static nvc_backoff_exclusion(u32p spins)
+{
+	if(*spins<noir_cvm_exclusion_spin_limit)
+	{
+		(*spins)++;
+		noir_pause();
+	}
+	else
+		noir_sleep(1);
+}
+
+// The run path publishes the running bit by an interlocked operation before it checks the exclusion generation.
+// Exclusive operations make the generation odd before they check the running bits.
+// Hence, either the vCPU backs off, or the exclusive operation waits for the vCPU.
+// The returned value is the run-state prior to entering. If the running bit is set, the vCPU is not entered.
+u32 nvc_enter_vcpu_run(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu)
+{
+	u32 spins=0;
+	while(1)
+	{
+		u32 state=vcpu->run_state;
+		if(noir_bt(&state,noir_cvm_vcpu_running))
+			return state;		// Another thread is running this vCPU.
+		else if(noir_bt(&state,noir_cvm_vcpu_resuming))
+			return state|(1<<noir_cvm_vcpu_running);		// A preempted run still owns this vCPU.
+		else if(noir_bt(&state,noir_cvm_vcpu_excluded) || (vm->exclusion_gen&1))
+			nvc_backoff_exclusion(&spins);
+		else if((u32)noir_locked_cmpxchg(&vcpu->run_state,state|(1<<noir_cvm_vcpu_running),state)==state)
+		{
+			if((vm->exclusion_gen&1)==0)
+			{
+				// Kicks are rare. Consume it only if there is one. The run is rescinded at once.
+				if(noir_bt(&state,noir_cvm_vcpu_kicked))
+				{
+					noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_kicked);
+					nvc_record_histogram(&vcpu->statistics.kick.latency,noir_rdtsc()-vcpu->kick_tsc);
+				}
+				return state;
+			}
+			// An exclusive operation began in the meantime. Back off.
+			noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_running);
+		}
+	}
+}
+
+// If the vCPU is kicked, the kick is delivered by the exit that brought it back here.
+// An exit due to the scheduler is reported as a rescission. Any other exit leaves the kick pending for the next run.
+void nvc_leave_vcpu_run(noir_cvm_virtual_cpu_p vcpu)
+{
+	u32 state=vcpu->run_state;
+	// Kicks are rare. Check it without an interlocked operation first.
+	if(noir_bt(&state,noir_cvm_vcpu_kicked))
+	{
+		const u64 latency=noir_rdtsc()-vcpu->kick_tsc;
+		const bool scheduled=vcpu->exit_context.intercept_code==cv_scheduler_exit || vcpu->exit_context.intercept_code==cv_rescission;
+		u32 consumed=1<<noir_cvm_vcpu_kick_ipi;
+		if(scheduled)
+		{
+			vcpu->exit_context.intercept_code=cv_rescission;
+			consumed|=1<<noir_cvm_vcpu_kicked;
+		}
+		state=noir_locked_and(&vcpu->run_state,~consumed);
+		// The processor was interrupted, but the vCPU had left guest mode for another reason.
+		if(noir_bt(&state,noir_cvm_vcpu_kick_ipi) && !scheduled)vcpu->statistics.kick.ipi_redundant++;
+		// The latency is recorded once per kick, by whoever consumes it.
+		if(scheduled)nvc_record_histogram(&vcpu->statistics.kick.latency,latency);
+	}
+	// A preemption not resumed by the run path is outdated once the run has left.
+	noir_locked_and(&vcpu->run_state,~((1<<noir_cvm_vcpu_running)|(1<<noir_cvm_vcpu_preempted)));
+}
+
+// Kicking a vCPU forces it out of guest mode. If it is not in guest mode, its next run is rescinded.
+// The processor is interrupted only if the vCPU is in guest mode. Otherwise, the kick returns immediately.
+noir_status nvc_kick_vcpu(noir_cvm_virtual_cpu_p vcpu)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		const u64 t=noir_rdtsc();
+		u32 state;
+		noir_locked_inc64(&vcpu->statistics.kick.requested);
+		while(1)
+		{
+			u32 new_state;
+			state=vcpu->run_state;
+			if(noir_bt(&state,noir_cvm_vcpu_kicked))break;
+			// Whether the processor is interrupted is decided by the same operation that publishes the kick.
+			new_state=state|(1<<noir_cvm_vcpu_kicked);
+			if(noir_bt(&state,noir_cvm_vcpu_in_guest))new_state|=1<<noir_cvm_vcpu_kick_ipi;
+			vcpu->kick_tsc=t;
+			if((u32)noir_locked_cmpxchg(&vcpu->run_state,new_state,state)==state)break;
+		}
+		if(noir_bt(&state,noir_cvm_vcpu_kicked))
+		{
+			noir_locked_inc64(&vcpu->statistics.kick.coalesced);
+			st=noir_already_rescinded;
+		}
+		else
+		{
+			if(noir_bt(&state,noir_cvm_vcpu_in_guest))
+			{
+				u32 proc_id=0xffffffff;
+				if(hvm_p->selected_core==use_svm_core)
+					proc_id=nvc_svmc_get_vcpu_processor(vcpu);
+				else if(hvm_p->selected_core==use_vt_core)
+					proc_id=nvc_vtc_get_vcpu_processor(vcpu);
+				if(proc_id!=0xffffffff)
+				{
+					noir_kick_processor(proc_id);
+					noir_locked_inc64(&vcpu->statistics.kick.ipi_sent);
+				}
+			}
+			st=noir_success;
+		}
+	}
+	return st;
+}
+
+// Preempting a vCPU forces it out of guest mode on behalf of an exclusive operation.
+// Unlike kicks, preemptions are not reported to the User Hypervisor.
+void static nvc_preempt_vcpu(noir_cvm_virtual_cpu_p vcpu)
+{
+	const u32 state=noir_locked_or(&vcpu->run_state,1<<noir_cvm_vcpu_preempted);
+	if(noir_bt(&state,noir_cvm_vcpu_in_guest) && !noir_bt(&state,noir_cvm_vcpu_preempted))
+	{
+		u32 proc_id=0xffffffff;
+		if(hvm_p->selected_core==use_svm_core)
+			proc_id=nvc_svmc_get_vcpu_processor(vcpu);
+		else if(hvm_p->selected_core==use_vt_core)
+			proc_id=nvc_vtc_get_vcpu_processor(vcpu);
+		if(proc_id!=0xffffffff)noir_kick_processor(proc_id);
+	}
+}
+
+// Wait for the vCPU to leave the run path. A vCPU in guest mode may stay there until the next timer
+// interrupt, so it is preempted. Its run path waits for the exclusion, then re-enters the guest.
+// A resuming run that is kicked will take the running bit back in order to leave. Wait for it as well.
+void static nvc_wait_for_vcpu_run(noir_cvm_virtual_cpu_p vcpu)
+{
+	u32 spins=0;
+	bool preempted=false;
+	while(1)
+	{
+		u32 state=vcpu->run_state;
+		if(!noir_bt(&state,noir_cvm_vcpu_running) && !(noir_bt(&state,noir_cvm_vcpu_resuming) && noir_bt(&state,noir_cvm_vcpu_kicked)))break;
+		if(noir_bt(&state,noir_cvm_vcpu_in_guest) && !preempted)
+		{
+			nvc_preempt_vcpu(vcpu);
+			preempted=true;
+		}
+		nvc_backoff_exclusion(&spins);
+	}
+}
+
+// Exclusive operations on a single vCPU wait for this vCPU only.
+// Exclusions of the same vCPU are serialized.
+void nvc_acquire_vcpu_exclusion(noir_cvm_virtual_cpu_p vcpu)
+{
+	u32 spins=0;
+	while(noir_locked_bts(&vcpu->run_state,noir_cvm_vcpu_excluded))nvc_backoff_exclusion(&spins);
+	nvc_wait_for_vcpu_run(vcpu);
+}
+
+void nvc_release_vcpu_exclusion(noir_cvm_virtual_cpu_p vcpu)
+{
+	noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_excluded);
+}
+
+// A thread in the run path trades its running bit for the exclusion of its own vCPU before it waits for
+// any exclusive operations. Hence, exclusive operations will not wait for a vCPU that is waiting for them.
+void nvc_park_vcpu_run(noir_cvm_virtual_cpu_p vcpu)
+{
+	const u32 swap_mask=(1<<noir_cvm_vcpu_running)|(1<<noir_cvm_vcpu_excluded);
+	while(1)
+	{
+		u32 state=vcpu->run_state;
+		if(noir_bt(&state,noir_cvm_vcpu_excluded))
+		{
+			// Someone is waiting for this vCPU. Let it go first.
+			noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_running);
+			nvc_acquire_vcpu_exclusion(vcpu);
+			return;
+		}
+		if((u32)noir_locked_cmpxchg(&vcpu->run_state,state^swap_mask,state)==state)return;
+	}
+}
+
+void nvc_unpark_vcpu_run(noir_cvm_virtual_cpu_p vcpu)
+{
+	// Nobody else may set the running bit while the vCPU is excluded.
+	noir_locked_xor(&vcpu->run_state,(1<<noir_cvm_vcpu_running)|(1<<noir_cvm_vcpu_excluded));
+}
+
+// The run path calls this function after the vCPU has left guest mode.
+// If the vCPU left only because an exclusive operation preempted it, the exit is not reported.
+// Instead, the run trades its running bit for the resuming bit, so that exclusive operations may
+// proceed while nobody else can run this vCPU. The run takes the running bit back once the
+// exclusions end, or once it is kicked. The returned value indicates whether to re-enter the guest.
+bool nvc_resume_preempted_vcpu_run(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu)
+{
+	const u32 swap_mask=(1<<noir_cvm_vcpu_running)|(1<<noir_cvm_vcpu_resuming);
+	u32 spins=0;
+	u32 state=vcpu->run_state;
+	if(!noir_bt(&state,noir_cvm_vcpu_preempted))return false;
+	state=noir_locked_and(&vcpu->run_state,~(1<<noir_cvm_vcpu_preempted));
+	// Kicks and exits for other reasons are reported as usual.
+	if(noir_bt(&state,noir_cvm_vcpu_kicked) || vcpu->exit_context.intercept_code!=cv_scheduler_exit)return false;
+	noir_locked_xor(&vcpu->run_state,swap_mask);
+	while(1)
+	{
+		state=vcpu->run_state;
+		if(noir_bt(&state,noir_cvm_vcpu_excluded) || ((vm->exclusion_gen&1) && !noir_bt(&state,noir_cvm_vcpu_kicked)))
+			nvc_backoff_exclusion(&spins);
+		else if((u32)noir_locked_cmpxchg(&vcpu->run_state,state^swap_mask,state)==state)
+		{
+			// The kicked run leaves at once without touching the guest state.
+			if(noir_bt(&state,noir_cvm_vcpu_kicked))return false;
+			// The running bit is published before the generation is checked, as is done by nvc_enter_vcpu_run.
+			if((vm->exclusion_gen&1)==0)return true;
+			noir_locked_xor(&vcpu->run_state,swap_mask);
+		}
+	}
+}
+
+// Exclusive operations on the VM are serialized by the generation. They wait for running vCPUs only.
+// The caller must hold the vCPU list lock so that vCPUs are neither created nor released meanwhile.
+void nvc_acquire_vm_exclusion(noir_cvm_virtual_machine_p vm)
+{
+	u32 spins=0;
+	while(1)
+	{
+		u32 gen=vm->exclusion_gen;
+		if(gen&1)
+			nvc_backoff_exclusion(&spins);
+		else if((u32)noir_locked_cmpxchg(&vm->exclusion_gen,gen+1,gen)==gen)
+			break;
+	}
+	for(u32 i=0;i<256;i++)
+	{
+		noir_cvm_virtual_cpu_p vcpu=null;
+		if(hvm_p->selected_core==use_svm_core)
+			vcpu=nvc_svmc_reference_vcpu(vm,i);
+		else if(hvm_p->selected_core==use_vt_core)
+			vcpu=nvc_vtc_reference_vcpu(vm,i);
+		if(vcpu)nvc_wait_for_vcpu_run(vcpu);
+	}
+}
+
+void nvc_release_vm_exclusion(noir_cvm_virtual_machine_p vm)
+{
+	noir_locked_inc(&vm->exclusion_gen);
+}
+
+u32 static nvc_hash_cpuid_quickpath(u32 leaf,u32 subleaf,u32 slots)
+{
+	// Fold the leaf class into low bits so that 0x0000xxxx, 0x4000xxxx and 0x8000xxxx leaves spread evenly.
+	u32 h=(leaf^(leaf>>20)^(subleaf<<8)^subleaf)*0x9E3779B1;
+	return (h^(h>>16))&(slots-1);
+}
+
+noir_cvm_cpuid_quickpath_info_p static nvc_probe_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32 leaf,u32 subleaf,bool has_subleaf)
+{
+	// Entries without subleaf are keyed by subleaf zero.
+	u32 i=nvc_hash_cpuid_quickpath(leaf,has_subleaf?subleaf:0,slots);
+	for(u32 j=0;j<slots;j++)
+	{
+		noir_cvm_cpuid_quickpath_info_p qp=&table[i];
+		// An empty slot terminates the probe sequence.
+		if(qp->options.value==0)break;
+		if(qp->options.active && qp->leaf==leaf && qp->options.has_subleaf==has_subleaf)
+			if(has_subleaf==false || qp->subleaf==subleaf)
+				return qp;
+		i=(i+1)&(slots-1);
+	}
+	return null;
+}
+
+noir_cvm_cpuid_quickpath_info_p static nvc_lookup_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32 leaf,u32 subleaf)
+{
+	// Subleaf-specific entries take precedence over entries covering all subleaves.
+	noir_cvm_cpuid_quickpath_info_p qp=nvc_probe_cpuid_quickpath(table,slots,leaf,subleaf,true);
+	if(qp==null)qp=nvc_probe_cpuid_quickpath(table,slots,leaf,subleaf,false);
+	return qp;
+}
+
+void static nvc_fetch_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p qp,u32 leaf,u32 subleaf,noir_cpuid_general_info_p info)
+{
+	if(qp->options.host_masked)
+	{
+		noir_cpuid(leaf,subleaf,&info->eax,&info->ebx,&info->ecx,&info->edx);
+		info->eax&=qp->eax;
+		info->ebx&=qp->ebx;
+		info->ecx&=qp->ecx;
+		info->edx&=qp->edx;
+	}
+	else
+	{
+		info->eax=qp->eax;
+		info->ebx=qp->ebx;
+		info->ecx=qp->ecx;
+		info->edx=qp->edx;
+	}
+}
+
+// Retired slots may lie on probe sequences of other keys, so they are reclaimed only by rebuilding the table.
+bool static nvc_purge_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32p count)
+{
+	const size_t size=slots*sizeof(noir_cvm_cpuid_quickpath_info);
+	noir_cvm_cpuid_quickpath_info_p copy=noir_alloc_nonpg_memory(size);
+	if(copy==null)return false;
+	noir_copy_memory(copy,table,size);
+	noir_stosb(table,0,size);
+	*count=0;
+	for(u32 i=0;i<slots;i++)
+	{
+		if(copy[i].options.active)
+		{
+			u32 j=nvc_hash_cpuid_quickpath(copy[i].leaf,copy[i].subleaf,slots);
+			while(table[j].options.value)j=(j+1)&(slots-1);
+			table[j]=copy[i];
+			(*count)++;
+		}
+	}
+	noir_free_nonpg_memory(copy);
+	return true;
+}
+
+noir_status nvc_insert_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32 limit,u32p count,noir_cvm_cpuid_quickpath_info_p info)
+{
+	// The caller must keep guests away from the table, either by the VM not being runnable yet or by the sequence.
+	bool has_subleaf=info->options.has_subleaf;
+	u32 subleaf=has_subleaf?info->subleaf:0;
+	u32 i=nvc_hash_cpuid_quickpath(info->leaf,subleaf,slots);
+	noir_cvm_cpuid_quickpath_info_p found=null,retired=null,empty=null;
+	for(u32 j=0;j<slots;j++)
+	{
+		noir_cvm_cpuid_quickpath_info_p qp=&table[i];
+		if(qp->options.value==0)
+		{
+			// Reaching an empty slot means the key is absent.
+			empty=qp;
+			break;
+		}
+		if(qp->leaf==info->leaf && qp->options.has_subleaf==has_subleaf && qp->subleaf==subleaf)
+		{
+			found=qp;
+			break;
+		}
+		if(qp->options.retired && retired==null)retired=qp;
+		i=(i+1)&(slots-1);
+	}
+	if(info->options.active==false)
+	{
+		// Removal keeps the slot occupied so that probe sequences passing it stay intact.
+		if(found==null || found->options.retired)return noir_unsuccessful;
+		found->options.active=false;
+		found->options.retired=true;
+		return noir_success;
+	}
+	if(found==null)
+	{
+		// Prefer reusing a retired slot over consuming an empty one.
+		if(retired)
+			found=retired;
+		else if(empty && *count<limit)
+		{
+			found=empty;
+			(*count)++;
+		}
+		else if(*count>=limit && nvc_purge_cpuid_quickpath(table,slots,count) && *count<limit)
+			return nvc_insert_cpuid_quickpath(table,slots,limit,count,info);
+		else
+			return noir_insufficient_resources;
+	}
+	*found=*info;
+	found->subleaf=subleaf;
+	found->options.retired=false;
+	return noir_success;
+}
+
+// The sequence is odd while the host is updating Quick-Path. Writers can be preempted amid the update,
+// so the exit handler must not wait for them. If an update is in progress or has intervened,
+// false is returned and the guest should re-execute the cpuid instruction.
+bool nvc_resolve_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,noir_cpuid_general_info_p info)
+{
+	const u32 seq=vm->cpuid_quickpath_seq;
+	noir_cvm_cpuid_quickpath_info_p qp;
+	if(seq&1)return false;
+	// Search per-vCPU Quick-Path, then per-VM Quick-Path.
+	qp=nvc_lookup_cpuid_quickpath(vcpu->cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vcpu,leaf,subleaf);
+	if(qp==null)qp=nvc_lookup_cpuid_quickpath(vm->cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vm,leaf,subleaf);
+	if(qp)
+		nvc_fetch_cpuid_quickpath(qp,leaf,subleaf,info);
+	else if(vm->cpuid_fallback.options.active && noir_cpuid_class(leaf)!=hvm_leaf_index)
+		nvc_fetch_cpuid_quickpath(&vm->cpuid_fallback,leaf,subleaf,info);
+	else
+		noir_stosd((u32*)info,0,4);
+	return seq==vm->cpuid_quickpath_seq;
+}
+
+noir_status nvc_set_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,noir_cvm_cpuid_quickpath_info_p info)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		noir_cvm_cpuid_quickpath_info entry=*info;
+		// Writers are serialized by the vCPU list lock. Guests see the sequence.
+		noir_acquire_reslock_exclusive(vm->vcpu_list_lock);
+		noir_locked_inc(&vm->cpuid_quickpath_seq);
+		entry.options.vm_wide=(vcpu==null);
+		entry.options.retired=false;
+		if(noir_cpuid_class(entry.leaf)==hvm_leaf_index && entry.options.host_masked)
+			st=noir_invalid_parameter;		// Host's hypervisor leaves are NoirVisor's own. Never expose them.
+		else if(vcpu)
+			st=nvc_insert_cpuid_quickpath(vcpu->cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&vcpu->cpuid_quickpath_count,&entry);
+		else
+			st=nvc_insert_cpuid_quickpath(vm->cpuid_quickpath,noir_cvm_cpuid_quickpath_slots_per_vm,noir_cvm_cpuid_quickpath_limit_per_vm,&vm->cpuid_quickpath_count,&entry);
+		noir_locked_inc(&vm->cpuid_quickpath_seq);
+		noir_release_reslock(vm->vcpu_list_lock);
+	}
+	return st;
+}
+
+noir_status nvc_set_cpuid_fallback(noir_cvm_virtual_machine_p vm,bool enabled,u32 eax_mask,u32 ebx_mask,u32 ecx_mask,u32 edx_mask)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		noir_acquire_reslock_exclusive(vm->vcpu_list_lock);
+		noir_locked_inc(&vm->cpuid_quickpath_seq);
+		vm->cpuid_fallback.eax=eax_mask;
+		vm->cpuid_fallback.ebx=ebx_mask;
+		vm->cpuid_fallback.ecx=ecx_mask;
+		vm->cpuid_fallback.edx=edx_mask;
+		vm->cpuid_fallback.options.value=0;
+		vm->cpuid_fallback.options.active=enabled;
+		vm->cpuid_fallback.options.host_masked=true;
+		vm->cpuid_fallback.options.vm_wide=true;
+		noir_locked_inc(&vm->cpuid_quickpath_seq);
+		noir_release_reslock(vm->vcpu_list_lock);
+		st=noir_success;
+	}
+	return st;
+}
+
+// MSRs whose state NoirVisor keeps in VMCB/VMCS or emulates by itself. Quick-Path rules must not cover them.
+const u32 static noir_cvm_msr_quickpath_protected[][2]=
+{
+	{amd64_tsc,amd64_tsc},
+	{amd64_apic_base,amd64_apic_base},
+	{amd64_mtrr_cap,amd64_mtrr_cap},
+	{amd64_sysenter_cs,amd64_sysenter_eip},
+	{amd64_pat,amd64_pat},
+	{amd64_mtrr_def_type,amd64_mtrr_def_type},
+	{0x40000000,0x7FFFFFFF},		// Reserved by NoirVisor.
+	{amd64_efer,amd64_sfmask},
+	{amd64_fs_base,amd64_kernel_gs_base}
+};
+
+noir_cvm_msr_quickpath_rule_p static nvc_find_msr_quickpath(noir_cvm_virtual_machine_p vm,u32 index)
+{
+	u32 lo=0,hi=vm->msr_quickpath_count;
+	while(hi>lo)
+	{
+		u32 mid=(lo+hi)>>1;
+		noir_cvm_msr_quickpath_rule_p rule=&vm->msr_quickpath[mid];
+		if(index<rule->first)
+			hi=mid;
+		else if(index>rule->last)
+			lo=mid+1;
+		else
+			return rule;
+	}
+	return null;
+}
+
+noir_cvm_msr_quickpath_result nvc_handle_msr_quickpath(noir_cvm_virtual_machine_p vm,u32 index,bool write,u64p value)
+{
+	// The caller is running a vCPU of this VM, so the table cannot change underneath.
+	noir_cvm_msr_quickpath_rule_p rule=nvc_find_msr_quickpath(vm,index);
+	if(rule==null)return noir_cvm_msr_quickpath_miss;
+	noir_locked_inc64(&rule->hits);
+	if(write)
+	{
+		u64 old=rule->value;
+		if(rule->options.passthrough || ((*value^old)&rule->readonly_mask))
+			return noir_cvm_msr_quickpath_fault;
+		// Other vCPUs may write to the same rule.
+		noir_locked_xchg64(&rule->value,*value);
+	}
+	else if(rule->options.passthrough)
+		*value=noir_rdmsr(index);
+	else
+		*value=rule->value;
+	return noir_cvm_msr_quickpath_handled;
+}
+
+bool static nvc_is_msr_quickpath_range_protected(u32 first,u32 last)
+{
+	for(u32 i=0;i<sizeof(noir_cvm_msr_quickpath_protected)/sizeof(noir_cvm_msr_quickpath_protected[0]);i++)
+		if(first<=noir_cvm_msr_quickpath_protected[i][1] && last>=noir_cvm_msr_quickpath_protected[i][0])
+			return true;
+	return false;
+}
+
+bool static nvc_set_msr_passthrough(noir_cvm_virtual_machine_p vm,u32 first,u32 last,bool passthrough)
+{
+	if(hvm_p->selected_core==use_svm_core)
+		return nvc_svmc_set_msr_passthrough(vm,first,last,passthrough);
+	else if(hvm_p->selected_core==use_vt_core)
+		return nvc_vtc_set_msr_passthrough(vm,first,last,passthrough);
+	return false;
+}
+
+noir_status nvc_set_msr_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_msr_quickpath_rule_p rule)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		u32 i=0;
+		if(rule->first>rule->last || nvc_is_msr_quickpath_range_protected(rule->first,rule->last))
+			return noir_invalid_parameter;
+		// No guest may be running while rules and permission bitmaps change.
+		noir_acquire_reslock_exclusive(vm->vcpu_list_lock);
+		nvc_acquire_vm_exclusion(vm);
+		// Locate the first rule not below the new range.
+		while(i<vm->msr_quickpath_count && vm->msr_quickpath[i].last<rule->first)i++;
+		if(i<vm->msr_quickpath_count && vm->msr_quickpath[i].first==rule->first && vm->msr_quickpath[i].last==rule->last)
+		{
+			// Same range. Replace or remove the rule.
+			noir_cvm_msr_quickpath_rule_p cur=&vm->msr_quickpath[i];
+			st=noir_success;
+			if(cur->options.passthrough!=(rule->options.active && rule->options.passthrough))
+				if(!nvc_set_msr_passthrough(vm,rule->first,rule->last,!cur->options.passthrough))
+					st=noir_invalid_parameter;
+			if(st==noir_success)
+			{
+				if(rule->options.active)
+				{
+					cur->options=rule->options;
+					cur->value=rule->value;
+					cur->readonly_mask=rule->readonly_mask;
+				}
+				else
+				{
+					for(u32 j=i+1;j<vm->msr_quickpath_count;j++)
+						vm->msr_quickpath[j-1]=vm->msr_quickpath[j];
+					vm->msr_quickpath_count--;
+				}
+			}
+		}
+		else if(rule->options.active==false)
+			st=noir_unsuccessful;
+		else if(i<vm->msr_quickpath_count && vm->msr_quickpath[i].first<=rule->last)
+			st=noir_invalid_parameter;		// Overlapping ranges are not allowed.
+		else if(vm->msr_quickpath_count>=noir_cvm_msr_quickpath_limit)
+			st=noir_insufficient_resources;
+		else if(rule->options.passthrough && !nvc_set_msr_passthrough(vm,rule->first,rule->last,true))
+			st=noir_invalid_parameter;		// Passthrough requires the range to be in the permission bitmap.
+		else
+		{
+			for(u32 j=vm->msr_quickpath_count;j>i;j--)
+				vm->msr_quickpath[j]=vm->msr_quickpath[j-1];
+			vm->msr_quickpath[i]=*rule;
+			vm->msr_quickpath[i].reserved=0;
+			vm->msr_quickpath[i].hits=0;
+			vm->msr_quickpath_count++;
+			st=noir_success;
+		}
+		nvc_release_vm_exclusion(vm);
+		noir_release_reslock(vm->vcpu_list_lock);
+	}
+	return st;
+}
+
+noir_status nvc_query_msr_quickpath(noir_cvm_virtual_machine_p vm,u32 index,noir_cvm_msr_quickpath_rule_p rule)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		noir_cvm_msr_quickpath_rule_p cur;
+		st=noir_unsuccessful;
+		noir_acquire_reslock_shared(vm->vcpu_list_lock);
+		cur=nvc_find_msr_quickpath(vm,index);
+		if(cur)
+		{
+			// Counters and values are read without stopping the guest.
+			*rule=*cur;
+			st=noir_success;
+		}
+		noir_release_reslock(vm->vcpu_list_lock);
+	}
+	return st;
+}
+
 void nvc_synchronize_vcpu_state(noir_cvm_virtual_cpu_p vcpu)
 {
 	if(hvm_p->selected_core==use_svm_core)
@@ -254,6 +865,7 @@ noir_status nvc_edit_vcpu_registers2(noir_cvm_virtual_cpu_p vcpu,noir_cvm_regist
 				case noir_cvm_register_cr0:
 					vcpu->crs.cr0=*(u64p)reg_buff;
 					vcpu->state_cache.cr_valid=0;
+					vcpu->state_cache.gt_valid=0;
 					break;
 				case noir_cvm_register_cr2:
 					vcpu->crs.cr2=*(u64p)reg_buff;
@@ -262,10 +874,12 @@ noir_status nvc_edit_vcpu_registers2(noir_cvm_virtual_cpu_p vcpu,noir_cvm_regist
 				case noir_cvm_register_cr3:
 					vcpu->crs.cr3=*(u64p)reg_buff;
 					vcpu->state_cache.cr_valid=0;
+					vcpu->state_cache.gt_valid=0;
 					break;
 				case noir_cvm_register_cr4:
 					vcpu->crs.cr4=*(u64p)reg_buff;
 					vcpu->state_cache.cr_valid=0;
+					vcpu->state_cache.gt_valid=0;
 					break;
 				case noir_cvm_register_cr8:
 					vcpu->crs.cr8=*(u64p)reg_buff;
@@ -307,6 +921,7 @@ noir_status nvc_edit_vcpu_registers2(noir_cvm_virtual_cpu_p vcpu,noir_cvm_regist
 				case noir_cvm_register_efer:
 					vcpu->msrs.efer=*(u64p)reg_buff;
 					vcpu->state_cache.ef_valid=0;
+					vcpu->state_cache.gt_valid=0;
 					break;
 				case noir_cvm_register_kgs_base:
 					vcpu->msrs.gsswap=*(u64p)reg_buff;
@@ -514,6 +1129,7 @@ noir_status nvc_edit_vcpu_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_registe
 				vcpu->crs.cr3=cr_list[1];
 				vcpu->crs.cr4=cr_list[2];
 				vcpu->state_cache.cr_valid=0;
+				vcpu->state_cache.gt_valid=0;
 				break;
 			}
 			case noir_cvm_cr2_register:
@@ -612,6 +1228,7 @@ noir_status nvc_edit_vcpu_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_registe
 			{
 				vcpu->msrs.efer=*(u64*)buffer;
 				vcpu->state_cache.ef_valid=0;
+				vcpu->state_cache.gt_valid=0;
 				break;
 			}
 			case noir_cvm_pat_register:
@@ -851,35 +1468,171 @@ noir_status nvc_query_vcpu_statistics(noir_cvm_virtual_cpu_p vcpu,void* buffer,u
 	return st;
 }
 
-bool nvc_validate_vcpu_state(noir_cvm_virtual_cpu_p vcpu)
+// The exit profiler is allocated only if it is enabled.
+// Otherwise, the cost on the VM-Exit path is a null check.
+noir_exit_profiler_p nvc_alloc_exit_profiler(u32 reasons)
 {
-	// Check Extended CRs.
-	// Bit 0 of XCR0 (FPU Enabled) must be set.
-	if(!noir_bt(&vcpu->xcrs.xcr0,0))
-		goto invalid_state;
-	// Bit 1 of XCR0 (SSE Enabled) cannot be reset if Bit 2 of XCR0 (AVX Enabled) is set.
-	if(!noir_bt(&vcpu->xcrs.xcr0,1) && noir_bt(&vcpu->xcrs.xcr0,2))
-		goto invalid_state;
-	// Reserved bits of XCR0 must be reset.
-	if((vcpu->xcrs.xcr0&hvm_p->xfeat.support_mask.value)!=vcpu->xcrs.xcr0)
-		goto invalid_state;
-	// Check vCPU Tunnel Pointer.
-	if(vcpu->vcpu_options.use_tunnel && vcpu->tunnel==null)
-		goto invalid_state;
-	return true;
-invalid_state:
-	vcpu->exit_context.intercept_code=cv_invalid_state;
-	return false;
+	noir_exit_profiler_p profiler=null;
+	if(hvm_p->options.exit_profiler)
+	{
+		profiler=noir_alloc_nonpg_memory(noir_exit_profiler_size(reasons));
+		if(profiler)profiler->reasons=reasons;
+	}
+	return profiler;
 }
 
-noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context)
+void nvc_free_exit_profiler(noir_exit_profiler_p profiler)
 {
-	noir_status st=noir_hypervision_absent;
-	if(hvm_p)
-	{
-		// Some processor state is not checked and loaded by Intel VT-x/AMD-V. (e.g: x87 FPU State)
+	if(profiler)noir_free_nonpg_memory(profiler);
+}
+
+void nvc_record_exit_latency(noir_exit_profiler_p profiler,u32 reason,u64 cycles)
+{
+	if(reason<profiler->reasons)nvc_record_histogram(&profiler->histogram[reason],cycles);
+}
+
+noir_status static nvc_copy_exit_profile(noir_exit_profiler_p profiler,void* buffer,u32 buffer_size)
+{
+	noir_status st=noir_not_implemented;
+	if(profiler)
+	{
+		const u32 profile_size=(u32)noir_exit_profiler_size(profiler->reasons);
+		if(buffer_size<sizeof(noir_exit_profiler))
+			st=noir_buffer_too_small;
+		else
+		{
+			// Copy as many histograms as the buffer can hold.
+			noir_copy_memory(buffer,profiler,buffer_size<profile_size?buffer_size:profile_size);
+			st=noir_success;
+		}
+	}
+	return st;
+}
+
+noir_status nvc_query_vcpu_exit_profile(noir_cvm_virtual_cpu_p vcpu,void* buffer,u32 buffer_size)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)st=nvc_copy_exit_profile(vcpu->profiler,buffer,buffer_size);
+	return st;
+}
+
+// The histograms of the host processor are copied while its exit handler keeps updating them,
+// without any synchronization. A histogram may be torn: its count, cycles and buckets may not
+// agree with each other, and 64-bit fields may be torn on 32-bit hosts. Use them as estimates.
+noir_status nvc_query_host_exit_profile(u32 processor,void* buffer,u32 buffer_size)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		st=noir_invalid_parameter;
+		if(processor<hvm_p->cpu_count)
+		{
+			if(hvm_p->selected_core==use_svm_core)
+				st=nvc_copy_exit_profile(nvc_svmc_get_host_exit_profiler(processor),buffer,buffer_size);
+			else if(hvm_p->selected_core==use_vt_core)
+				st=nvc_copy_exit_profile(nvc_vtc_get_host_exit_profiler(processor),buffer,buffer_size);
+			else
+				st=noir_unknown_processor;
+		}
+	}
+	return st;
+}
+
+bool nvc_validate_vcpu_state(noir_cvm_virtual_cpu_p vcpu)
+{
+	// Check Extended CRs.
+	// Bit 0 of XCR0 (FPU Enabled) must be set.
+	if(!noir_bt(&vcpu->xcrs.xcr0,0))
+		goto invalid_state;
+	// Bit 1 of XCR0 (SSE Enabled) cannot be reset if Bit 2 of XCR0 (AVX Enabled) is set.
+	if(!noir_bt(&vcpu->xcrs.xcr0,1) && noir_bt(&vcpu->xcrs.xcr0,2))
+		goto invalid_state;
+	// Reserved bits of XCR0 must be reset.
+	if((vcpu->xcrs.xcr0&hvm_p->xfeat.support_mask.value)!=vcpu->xcrs.xcr0)
+		goto invalid_state;
+	// Check vCPU Tunnel Pointer.
+	if(vcpu->vcpu_options.use_tunnel && vcpu->tunnel==null)
+		goto invalid_state;
+	return true;
+invalid_state:
+	vcpu->exit_context.intercept_code=cv_invalid_state;
+	return false;
+}
+
+// Load the register groups that the User Hypervisor edited in VPCB.
+// General Rule: If the state is to be cached, invalidate the cache.
+void static nvc_load_vpcb_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb)
+{
+	u32 dirty=vpcb->registers.dirty&noir_cvm_vpcb_group_mask;
+	if(noir_bt(&dirty,noir_cvm_vpcb_group_gpr))
+	{
+		noir_copy_memory(&vcpu->gpr,&vpcb->registers.gpr,sizeof(noir_gpr_state));
+		vcpu->rflags=vpcb->registers.rflags;
+		vcpu->rip=vpcb->registers.rip;
+		vcpu->state_cache.gprvalid=0;
+	}
+	if(noir_bt(&dirty,noir_cvm_vpcb_group_seg))
+	{
+		noir_copy_memory(&vcpu->seg,&vpcb->registers.seg,sizeof(noir_seg_state));
+		vcpu->state_cache.sr_valid=0;
+		vcpu->state_cache.fg_valid=0;
+		vcpu->state_cache.dt_valid=0;
+		vcpu->state_cache.lt_valid=0;
+	}
+	if(noir_bt(&dirty,noir_cvm_vpcb_group_cr))
+	{
+		noir_copy_memory(&vcpu->crs,&vpcb->registers.crs,sizeof(noir_cr_state));
+		vcpu->state_cache.cr_valid=0;
+		vcpu->state_cache.cr2valid=0;
+		vcpu->state_cache.tp_valid=0;
+		vcpu->state_cache.gt_valid=0;
+	}
+	if(noir_bt(&dirty,noir_cvm_vpcb_group_fpu))
+		noir_copy_memory(vcpu->xsave_area,&vpcb->registers.fx,sizeof(noir_fx_state));
+	vpcb->registers.dirty=0;
+}
+
+// Publish the requested register groups to VPCB so that the User Hypervisor
+// does not have to issue a view-register request for each of them.
+void static nvc_publish_vpcb_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb)
+{
+	u32 publish=vpcb->registers.publish&noir_cvm_vpcb_group_mask;
+	if(!vcpu->state_cache.synchronized)
+	{
+		// Synchronize only if any published state is cached in VMCB/VMCS.
+		noir_cvm_vcpu_state_cache cache=vcpu->state_cache;
+		bool seg_cached=cache.sr_valid || cache.fg_valid || cache.dt_valid || cache.lt_valid;
+		bool cr_cached=cache.cr_valid || cache.cr2valid || cache.tp_valid;
+		if((noir_bt(&publish,noir_cvm_vpcb_group_seg) && seg_cached) || (noir_bt(&publish,noir_cvm_vpcb_group_cr) && cr_cached))
+			nvc_synchronize_vcpu_state(vcpu);
+	}
+	if(noir_bt(&publish,noir_cvm_vpcb_group_gpr))
+	{
+		noir_copy_memory(&vpcb->registers.gpr,&vcpu->gpr,sizeof(noir_gpr_state));
+		vpcb->registers.rflags=vcpu->rflags;
+		vpcb->registers.rip=vcpu->rip;
+	}
+	if(noir_bt(&publish,noir_cvm_vpcb_group_seg))
+		noir_copy_memory(&vpcb->registers.seg,&vcpu->seg,sizeof(noir_seg_state));
+	if(noir_bt(&publish,noir_cvm_vpcb_group_cr))
+		noir_copy_memory(&vpcb->registers.crs,&vcpu->crs,sizeof(noir_cr_state));
+	if(noir_bt(&publish,noir_cvm_vpcb_group_fpu))
+		noir_copy_memory(&vpcb->registers.fx,vcpu->xsave_area,sizeof(noir_fx_state));
+	vpcb->registers.valid=publish;
+}
+
+noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		bool valid_state;
+		// Registers edited in VPCB must be loaded before the state is validated.
+		if(vcpu->vcpu_options.use_tunnel && vcpu->vcpu_options.tunnel_format==noir_cvm_tunnel_format_nvc && vcpu->tunnel)
+			nvc_load_vpcb_registers(vcpu,vcpu->tunnel);
+		// Some processor state is not checked and loaded by Intel VT-x/AMD-V. (e.g: x87 FPU State)
 		// Check their consistency manually.
-		bool valid_state=nvc_validate_vcpu_state(vcpu);
+		valid_state=nvc_validate_vcpu_state(vcpu);
 		st=noir_success;
 		if(valid_state)
 		{
@@ -904,6 +1657,33 @@ noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context)
 						// The NoirVisor's Virtual-Processor Control Block format.
 						noir_cvm_vcpu_control_block_p vpcb=vcpu->tunnel;
 						vpcb->intercept_code=vcpu->exit_context.intercept_code;
+						vpcb->rflags=vcpu->exit_context.rflags;
+						vpcb->rip=vcpu->exit_context.rip;
+						vpcb->next_rip=vcpu->exit_context.next_rip;
+						if(vcpu->exit_context.intercept_code==cv_io_instruction)
+						{
+							noir_cvm_io_context_p io=&vcpu->exit_context.io;
+							vpcb->io.pio.port=io->port;
+							vpcb->io.pio.size=(u8)io->access.operand_size;
+							vpcb->io.pio.direction=(u8)io->access.io_type;
+							vpcb->io.pio.string=(u8)io->access.string;
+							vpcb->io.pio.df=(u8)noir_bt((u32*)&vcpu->exit_context.rflags,amd64_rflags_df);
+							vpcb->io.pio.scatter_count=0;
+							if(io->access.string)
+							{
+								// Hand over the whole REP string operation in one exit.
+								u32 entries;
+								vpcb->io.pio.count=nvc_build_pio_scatter_list(vcpu,(noir_cvm_pio_scatter_entry_p)vpcb->io_buff,noir_cvm_pio_scatter_limit,&entries);
+								vpcb->io.pio.scatter_count=(u8)entries;
+							}
+							else
+							{
+								vpcb->io.pio.count=1;
+								// For out instruction, Output register must be copied to I/O Buffer.
+								if(!io->access.io_type)noir_movsb(vpcb->io_buff,&io->rax,io->access.operand_size);
+							}
+						}
+						nvc_publish_vpcb_registers(vcpu,vpcb);
 						break;
 					}
 				}
@@ -916,16 +1696,8 @@ noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context)
 noir_status nvc_rescind_vcpu(noir_cvm_virtual_cpu_p vcpu)
 {
 	noir_status st=noir_hypervision_absent;
-	if(hvm_p)
-	{
-		st=noir_success;
-		if(hvm_p->selected_core==use_vt_core)
-			st=nvc_vtc_rescind_vcpu(vcpu);
-		else if(hvm_p->selected_core==use_svm_core)
-			st=nvc_svmc_rescind_vcpu(vcpu);
-		else
-			st=noir_unknown_processor;
-	}
+	// Rescission is a kick. If the vCPU is in guest mode, it is forced to exit.
+	if(hvm_p)st=nvc_kick_vcpu(vcpu);
 	return st;
 }
 
@@ -937,6 +1709,36 @@ noir_status nvc_set_tunnel(noir_cvm_virtual_cpu_p vcpu,void* tunnel)
 	return noir_success;
 }
 
+// Share a page of the User Hypervisor as the VPCB of the vCPU.
+// The vCPU must not be running when its VPCB is being switched.
+noir_status nvc_set_vpcb(noir_cvm_virtual_cpu_p vcpu,void* vpcb)
+{
+	noir_status st=noir_invalid_parameter;
+	if(page_offset((ulong_ptr)vpcb)==0)
+	{
+		u64 phys;
+		void* locker=noir_lock_pages(vpcb,page_size,&phys);
+		st=noir_insufficient_resources;
+		if(locker)
+		{
+			void* tunnel=noir_map_locked_pages(locker);
+			if(tunnel==null)
+				noir_unlock_pages(locker);
+			else
+			{
+				void* old_locker;
+				nvc_acquire_vcpu_exclusion(vcpu);
+				old_locker=vcpu->tunnel_locker;
+				vcpu->tunnel_locker=locker;
+				st=nvc_set_tunnel(vcpu,tunnel);
+				nvc_release_vcpu_exclusion(vcpu);
+				if(old_locker)noir_unlock_pages(old_locker);
+			}
+		}
+	}
+	return st;
+}
+
 noir_cvm_virtual_cpu_p nvc_reference_vcpu(noir_cvm_virtual_machine_p vm,u32 vcpu_id)
 {
 	noir_cvm_virtual_cpu_p vcpu=null;
@@ -957,15 +1759,20 @@ noir_status nvc_release_vcpu(noir_cvm_virtual_cpu_p vcpu)
 	noir_status st=noir_hypervision_absent;
 	if(hvm_p)
 	{
+		// The vCPU structure is freed by the core. Keep the VPCB locker.
+		void* locker=vcpu->tunnel_locker;
 		st=noir_success;
 		if(vcpu->ref_count)
 			nv_dprintf("Deleting vCPU 0x%p with uncleared reference (%u)!",vcpu,vcpu->ref_count);
+		// Wait for the vCPU to stop running. The exclusion is gone with the vCPU structure.
+		nvc_acquire_vcpu_exclusion(vcpu);
 		if(hvm_p->selected_core==use_vt_core)
 			nvc_vtc_release_vcpu(vcpu);
 		else if(hvm_p->selected_core==use_svm_core)
 			nvc_svmc_release_vcpu(vcpu);
 		else
 			st=noir_unknown_processor;
+		if(locker)noir_unlock_pages(locker);
 	}
 	return st;
 }
@@ -1044,7 +1851,7 @@ void nvc_release_lockers(noir_cvm_virtual_machine_p virtual_machine)
 	{
 		noir_cvm_lockers_list_p next=cur->next;
 		for(u32 i=0;i<noir_cvm_lockers_per_array;i++)
-			if(cur->lockers[i])
+			if(cur->lockers[i] && !((ulong_ptr)cur->lockers[i]&noir_cvm_free_locker_tag))
 				noir_unlock_pages(cur->lockers[i]);
 		noir_free_nonpg_memory(cur);
 		cur=next;
@@ -1053,43 +1860,57 @@ void nvc_release_lockers(noir_cvm_virtual_machine_p virtual_machine)
 
 // Warning: this function erases the slot!
 // Unlock the page before releasing the slot.
-void nvc_free_locker_slot(void** locker_slot)
+void nvc_free_locker_slot(noir_cvm_virtual_machine_p virtual_machine,void** locker_slot)
 {
-	noir_cvm_lockers_list_p locker_list=(noir_cvm_lockers_list_p)page_4kb_base((ulong_ptr)locker_slot);
-	if(locker_list)
-	{
-#if defined(_amd64)
-		u32 index=(u32)page_4kb_offset((u64)locker_slot)>>3;
-#else
-		u32 index=(u32)page_4kb_offset((u32)locker_slot)>>2;
-#endif
-		noir_reset_bitmap(locker_list,index);
-		*locker_slot=null;
-	}
+	noir_acquire_pushlock_exclusive(&virtual_machine->locker_lock);
+	*locker_slot=(void*)((ulong_ptr)virtual_machine->locker_free|noir_cvm_free_locker_tag);
+	virtual_machine->locker_free=locker_slot;
+	noir_release_pushlock_exclusive(&virtual_machine->locker_lock);
+}
+
+// Link all slots of a new list to the free list.
+void static nvc_insert_locker_list(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_lockers_list_p locker_list)
+{
+	for(u32 i=0;i<noir_cvm_lockers_per_array-1;i++)
+		locker_list->lockers[i]=(void*)((ulong_ptr)&locker_list->lockers[i+1]|noir_cvm_free_locker_tag);
+	locker_list->lockers[noir_cvm_lockers_per_array-1]=(void*)((ulong_ptr)virtual_machine->locker_free|noir_cvm_free_locker_tag);
+	locker_list->next=virtual_machine->locker_head;
+	virtual_machine->locker_head=locker_list;
+	virtual_machine->locker_free=locker_list->lockers;
 }
 
 void** nvc_alloc_locker_slot(noir_cvm_virtual_machine_p virtual_machine)
 {
-	for(noir_cvm_lockers_list_p cur=virtual_machine->locker_head;cur;cur=cur->next)
+	void** locker_slot;
+	noir_acquire_pushlock_exclusive(&virtual_machine->locker_lock);
+	// At this point, all lockers are allocated.
+	if(virtual_machine->locker_free==null)
 	{
-		u32 index=noir_find_clear_bit(cur->bitmap,noir_cvm_lockers_per_array);
-		if(index!=0xffffffff)
-		{
-			noir_set_bitmap(cur->bitmap,index);
-			return &cur->lockers[index];
-		}
+		noir_cvm_lockers_list_p locker_list=noir_alloc_nonpg_memory(page_size);
+		if(locker_list)nvc_insert_locker_list(virtual_machine,locker_list);
 	}
-	// At this point, all lockers are allocated.
-	virtual_machine->locker_tail->next=noir_alloc_nonpg_memory(page_size);
-	if(virtual_machine->locker_tail->next)
+	// Pop the first free slot. It is null if system resources are insufficient.
+	locker_slot=virtual_machine->locker_free;
+	if(locker_slot)
 	{
-		noir_cvm_lockers_list_p locker_list=virtual_machine->locker_tail->next;
-		// Return the first entry.
-		locker_list->bitmap[0]=1;
-		return locker_list->lockers;
+		virtual_machine->locker_free=(void**)((ulong_ptr)*locker_slot&~(ulong_ptr)noir_cvm_free_locker_tag);
+		*locker_slot=null;
 	}
-	// Insufficient system resources.
-	return null;
+	noir_release_pushlock_exclusive(&virtual_machine->locker_lock);
+	return locker_slot;
+}
+
+// Check if every large page in the list is backed by a contiguous and aligned host range.
+bool static nvc_is_host_range_contiguous(u64p phys_array,u32 pages,u32 increment)
+{
+	for(u32 i=0;i<pages;i+=increment)
+	{
+		if(phys_array[i]&(page_4kb_mult((u64)increment)-1))return false;
+		for(u32 j=1;j<increment;j++)
+			if(phys_array[i+j]!=phys_array[i]+page_4kb_mult((u64)j))
+				return false;
+	}
+	return true;
 }
 
 noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info)
@@ -1097,33 +1918,49 @@ noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_
 	noir_status st=noir_hypervision_absent;
 	if(hvm_p)
 	{
+		noir_cvm_address_mapping map_info=*mapping_info;
+		u32 increment=noir_cvm_psize_pages(map_info.attributes.psize);
+		// Count of 4KiB pages to be mapped.
+		u64 pages=(u64)map_info.pages*increment;
+		bool mapping=map_info.attributes.present || map_info.attributes.write || map_info.attributes.execute;
+		// Large pages must be aligned in the guest. 512GiB pages are not supported.
+		// The length of pages to be locked for mapping cannot exceed 4GiB.
+		if(map_info.attributes.psize>2 || map_info.gpa&(page_4kb_mult((u64)increment)-1))return noir_invalid_parameter;
+		if(pages>(mapping?page_4kb_count(0xffffffff):0xffffffff))return noir_invalid_parameter;
 		// Exclusive acquirement is unnecessary.
 		noir_acquire_reslock_shared(virtual_machine->vcpu_list_lock);
-		if(mapping_info->attributes.present || mapping_info->attributes.write || mapping_info->attributes.execute)
+		if(mapping)
 		{
 			// This is mapping memories to the guest.
 			void** locker_slot=nvc_alloc_locker_slot(virtual_machine);
-			u64p phys_array=noir_alloc_nonpg_memory(mapping_info->pages<<3);
+			u64p phys_array=noir_alloc_nonpg_memory((size_t)pages<<3);
 			if(locker_slot && phys_array)
 			{
-				*locker_slot=noir_lock_pages((void*)mapping_info->hva,page_4kb_mult(mapping_info->pages),phys_array);
+				*locker_slot=noir_lock_pages((void*)map_info.hva,(u32)page_4kb_mult(pages),phys_array);
 				if(!*locker_slot)goto alloc_failure;
+				// Large pages require contiguous and aligned host ranges, and processor support as well.
+				// Otherwise, fall back to 4KiB pages. The core would merge the ranges that qualify.
+				if(map_info.attributes.psize==1 && !hvm_p->cvm_cap.large_page || map_info.attributes.psize==2 && !hvm_p->cvm_cap.huge_page || !nvc_is_host_range_contiguous(phys_array,(u32)pages,increment))
+				{
+					map_info.attributes.psize=0;
+					map_info.pages=(u32)pages;
+				}
 				st=noir_unknown_processor;
 				if(hvm_p->selected_core==use_vt_core)
-					st=nvc_vtc_set_mapping(virtual_machine,mapping_info);
+					st=nvc_vtc_set_mapping_batch(virtual_machine,&map_info,1,phys_array);
 				else if(hvm_p->selected_core==use_svm_core)
-					st=nvc_svmc_set_mapping(virtual_machine,mapping_info,phys_array);
+					st=nvc_svmc_set_mapping(virtual_machine,&map_info,phys_array);
 				if(st!=noir_success)
 				{
 					noir_unlock_pages(*locker_slot);
-					nvc_free_locker_slot(locker_slot);
+					nvc_free_locker_slot(virtual_machine,locker_slot);
 				}
 				noir_free_nonpg_memory(phys_array);
 			}
 			else
 			{
 alloc_failure:
-				if(locker_slot)nvc_free_locker_slot(locker_slot);
+				if(locker_slot)nvc_free_locker_slot(virtual_machine,locker_slot);
 				if(phys_array)noir_free_nonpg_memory(phys_array);
 				st=noir_insufficient_resources;
 			}
@@ -1132,9 +1969,9 @@ alloc_failure:
 		{
 			// This is unmapping memories from the guest.
 			if(hvm_p->selected_core==use_vt_core)
-				st=nvc_vtc_set_mapping(virtual_machine,mapping_info);
+				st=nvc_vtc_set_mapping(virtual_machine,&map_info);
 			else if(hvm_p->selected_core==use_svm_core)
-				st=nvc_svmc_set_unmapping(virtual_machine,mapping_info->gpa,mapping_info->pages);
+				st=nvc_svmc_set_unmapping(virtual_machine,map_info.gpa,(u32)pages);
 			else
 				st=noir_unknown_processor;
 		}
@@ -1143,6 +1980,141 @@ alloc_failure:
 	return st;
 }
 
+// Record a present translation captured before a batched mapping.
+// The record is merged into the last one if both the guest and the host ranges continue it with the same attributes.
+// The journal grows by doubling, so ranges overwriting large mappings take only a few records.
+bool nvc_record_prior_mapping(noir_cvm_prior_journal_p journal,u64 gpa,u64 hpa,u32 pages,noir_cvm_mapping_attributes attributes)
+{
+	noir_cvm_prior_mapping_p prior;
+	if(journal->count)
+	{
+		prior=&journal->list[journal->count-1];
+		if(prior->gpa+page_4kb_mult((u64)prior->pages)==gpa && prior->hpa+page_4kb_mult((u64)prior->pages)==hpa && prior->attributes.value==attributes.value)
+		{
+			prior->pages+=pages;
+			return true;
+		}
+	}
+	if(journal->count==journal->limit)
+	{
+		const u32 limit=journal->limit?journal->limit<<1:page_size/sizeof(noir_cvm_prior_mapping);
+		noir_cvm_prior_mapping_p list=noir_alloc_nonpg_memory((size_t)limit*sizeof(noir_cvm_prior_mapping));
+		if(list==null)return false;
+		if(journal->list)
+		{
+			noir_copy_memory(list,journal->list,journal->count*sizeof(noir_cvm_prior_mapping));
+			noir_free_nonpg_memory(journal->list);
+		}
+		journal->list=list;
+		journal->limit=limit;
+	}
+	prior=&journal->list[journal->count++];
+	prior->gpa=gpa;
+	prior->hpa=hpa;
+	prior->pages=pages;
+	prior->attributes=attributes;
+	return true;
+}
+
+void nvc_free_prior_journal(noir_cvm_prior_journal_p journal)
+{
+	if(journal->list)noir_free_nonpg_memory(journal->list);
+	journal->list=null;
+	journal->count=journal->limit=0;
+}
+
+// Map several ranges to the guest at once. Unmapping is not accepted here.
+// All ranges are pinned and translated first, then installed by the core under a single exclusion of the VM.
+// If any range fails, none of the ranges remain mapped.
+noir_status nvc_set_mapping_batch(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		noir_cvm_address_mapping_p ranges;
+		void*** locker_slots;
+		u64p phys_array;
+		u64 total=0;
+		if(count==0 || count>noir_cvm_mapping_batch_limit)return noir_invalid_parameter;
+		// Validate all ranges before pinning anything.
+		for(u32 i=0;i<count;i++)
+		{
+			u32 increment=noir_cvm_psize_pages(mapping_info[i].attributes.psize);
+			u64 pages=(u64)mapping_info[i].pages*increment;
+			if(!(mapping_info[i].attributes.present || mapping_info[i].attributes.write || mapping_info[i].attributes.execute))return noir_invalid_parameter;
+			if(mapping_info[i].attributes.psize>2 || mapping_info[i].gpa&(page_4kb_mult((u64)increment)-1))return noir_invalid_parameter;
+			if(pages==0 || pages>page_4kb_count(0xffffffff))return noir_invalid_parameter;
+			total+=pages;
+		}
+		if(total>0xffffffff)return noir_invalid_parameter;
+		ranges=noir_alloc_nonpg_memory(sizeof(noir_cvm_address_mapping)*count);
+		locker_slots=noir_alloc_nonpg_memory(sizeof(void**)*count);
+		phys_array=noir_alloc_nonpg_memory((size_t)total<<3);
+		// Exclusive acquirement is unnecessary.
+		noir_acquire_reslock_shared(virtual_machine->vcpu_list_lock);
+		if(ranges && locker_slots && phys_array)
+		{
+			u64p phys_cur=phys_array;
+			u32 pinned=0;
+			st=noir_success;
+			// Pin and translate every range.
+			for(;pinned<count;pinned++)
+			{
+				u32 increment=noir_cvm_psize_pages(mapping_info[pinned].attributes.psize);
+				u32 pages=mapping_info[pinned].pages*increment;
+				ranges[pinned]=mapping_info[pinned];
+				locker_slots[pinned]=nvc_alloc_locker_slot(virtual_machine);
+				if(locker_slots[pinned]==null)
+				{
+					st=noir_insufficient_resources;
+					break;
+				}
+				*locker_slots[pinned]=noir_lock_pages((void*)ranges[pinned].hva,(u32)page_4kb_mult((u64)pages),phys_cur);
+				if(*locker_slots[pinned]==null)
+				{
+					nvc_free_locker_slot(virtual_machine,locker_slots[pinned]);
+					st=noir_insufficient_resources;
+					break;
+				}
+				// Large pages require contiguous and aligned host ranges, and processor support as well.
+				// Otherwise, fall back to 4KiB pages. The core would merge the ranges that qualify.
+				if(ranges[pinned].attributes.psize==1 && !hvm_p->cvm_cap.large_page || ranges[pinned].attributes.psize==2 && !hvm_p->cvm_cap.huge_page || !nvc_is_host_range_contiguous(phys_cur,pages,increment))
+				{
+					ranges[pinned].attributes.psize=0;
+					ranges[pinned].pages=pages;
+				}
+				phys_cur+=pages;
+			}
+			// Install all ranges at once.
+			if(st==noir_success)
+			{
+				if(hvm_p->selected_core==use_vt_core)
+					st=nvc_vtc_set_mapping_batch(virtual_machine,ranges,count,phys_array);
+				else if(hvm_p->selected_core==use_svm_core)
+					st=nvc_svmc_set_mapping_batch(virtual_machine,ranges,count,phys_array);
+				else
+					st=noir_unknown_processor;
+			}
+			// Unpin the ranges if the batch failed.
+			if(st!=noir_success)
+			{
+				for(u32 i=0;i<pinned;i++)
+				{
+					noir_unlock_pages(*locker_slots[i]);
+					nvc_free_locker_slot(virtual_machine,locker_slots[i]);
+				}
+			}
+		}
+		else
+			st=noir_insufficient_resources;
+		noir_release_reslock(virtual_machine->vcpu_list_lock);
+		if(ranges)noir_free_nonpg_memory(ranges);
+		if(locker_slots)noir_free_nonpg_memory(locker_slots);
+		if(phys_array)noir_free_nonpg_memory(phys_array);
+	}
+	return st;
+}
+
 noir_status nvc_query_gpa_accessing_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size)
 {
 	noir_status st=noir_hypervision_absent;
@@ -1151,7 +2123,7 @@ noir_status nvc_query_gpa_accessing_bitmap(noir_cvm_virtual_machine_p virtual_ma
 		st=noir_invalid_parameter;
 		noir_acquire_reslock_shared(virtual_machine->vcpu_list_lock);
 		if(hvm_p->selected_core==use_vt_core)
-			st=noir_not_implemented;
+			st=nvc_vtc_query_gpa_accessing_bitmap(virtual_machine,gpa_start,page_count,bitmap,bitmap_size);
 		else if(hvm_p->selected_core==use_svm_core)
 			st=nvc_svmc_query_gpa_accessing_bitmap(virtual_machine,gpa_start,page_count,bitmap,bitmap_size);
 		else
@@ -1169,7 +2141,7 @@ noir_status nvc_clear_gpa_accessing_bits(noir_cvm_virtual_machine_p virtual_mach
 		// Preventing any vCPUs to be launched is good enough. Exclusive acquirement is unnecessary.
 		noir_acquire_reslock_shared(virtual_machine->vcpu_list_lock);
 		if(hvm_p->selected_core==use_vt_core)
-			st=noir_not_implemented;
+			st=nvc_vtc_clear_gpa_accessing_bits(virtual_machine,gpa_start,page_count);
 		else if(hvm_p->selected_core==use_svm_core)
 			st=nvc_svmc_clear_gpa_accessing_bits(virtual_machine,gpa_start,page_count);
 		else
@@ -1179,6 +2151,46 @@ noir_status nvc_clear_gpa_accessing_bits(noir_cvm_virtual_machine_p virtual_mach
 	return st;
 }
 
+// Report the dirty state of a run of pages in the bitmap. Whole bytes are filled at once.
+// In accumulation, clean pages leave the bits untouched so that dirty pages of previous queries are preserved.
+void nvc_report_dirty_pages(void* bitmap,u32 start,u32 count,bool dirty,bool accumulate)
+{
+	u8p bytes=(u8p)bitmap;
+	u32 end=start+count;
+	if(accumulate && !dirty)return;
+	for(;start<end && (start&7);start++)
+		dirty?noir_set_bitmap(bitmap,start):noir_reset_bitmap(bitmap,start);
+	if(end-start>=8)
+	{
+		u32 n=(end-start)>>3;
+		noir_stosb(&bytes[start>>3],dirty?0xff:0,n);
+		start+=n<<3;
+	}
+	for(;start<end;start++)
+		dirty?noir_set_bitmap(bitmap,start):noir_reset_bitmap(bitmap,start);
+}
+
+// Query the pages written since the previous query, one bit per page. Unmapped pages are reported clean.
+// The dirty bits are cleared atomically. Pause the vCPUs for an exact result, because a running vCPU
+// may keep writing through translations it cached before the query without setting the dirty bits.
+// If accumulation is requested, dirty pages are merged into the bitmap instead of overwriting it.
+noir_status nvc_query_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate)
+{
+	noir_status st=noir_hypervision_absent;
+	if(hvm_p)
+	{
+		noir_acquire_reslock_shared(virtual_machine->vcpu_list_lock);
+		if(hvm_p->selected_core==use_vt_core)
+			st=nvc_vtc_harvest_gpa_dirty_bitmap(virtual_machine,gpa_start,page_count,bitmap,bitmap_size,accumulate);
+		else if(hvm_p->selected_core==use_svm_core)
+			st=nvc_svmc_harvest_gpa_dirty_bitmap(virtual_machine,gpa_start,page_count,bitmap,bitmap_size,accumulate);
+		else
+			st=noir_unknown_processor;
+		noir_release_reslock(virtual_machine->vcpu_list_lock);
+	}
+	return st;
+}
+
 noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm)
 {
 	noir_status st=noir_hypervision_absent;
@@ -1240,8 +2252,12 @@ noir_status nvc_create_vm_ex(noir_cvm_virtual_machine_p* vm,u32 process_id,noir_
 				noir_insert_to_prev(&noir_idle_vm.active_vm_list,&(*vm)->active_vm_list);
 				noir_release_reslock(noir_vm_list_lock);
 				// Allocate Locker list.
-				(*vm)->locker_head=(*vm)->locker_tail=noir_alloc_nonpg_memory(page_size);
-				if((*vm)->locker_head)st=noir_success;
+				noir_cvm_lockers_list_p locker_list=noir_alloc_nonpg_memory(page_size);
+				if(locker_list)
+				{
+					nvc_insert_locker_list(*vm,locker_list);
+					st=noir_success;
+				}
 			}
 			if(st!=noir_success)
 				nvc_release_vm(*vm);
@@ -1381,116 +2397,409 @@ void nvc_print_vm_list()
 }
 #endif
 
-void nvc_configure_reverse_mapping(u64 hpa,u64 gpa,u32 asid,bool shared,u8 ownership)
+// Locate the directory entry that describes the HPA and copy it into the snapshot.
+// Memory hot-add may extend the directory at any time. Search again if the sequence changes.
+bool static nvc_find_rmt_directory(u64 hpa,noir_rmt_directory_entry_p snapshot)
 {
 	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	u64 hi=hvm_p->rmd.dir_count,lo=0;
-	// Use binary search to reduce time complexity.
-	while(hi>=lo)
-	{
-		const u64 mid=(hi+lo)>>1;
-		if(hpa<rmt_dir[mid].hpa_start)		// If HPA is lower than median range,
-			hi=mid-1;						// Reduce the higher bound.
-		else if(hpa>=rmt_dir[mid].hpa_end)	// If HPA is higher than median range,
-			lo=mid+1;						// Raise the lower bound.
-		else
+	while(1)
+	{
+		const u32 seq=hvm_p->rmd.sequence;
+		u64 hi=hvm_p->rmd.dir_count,lo=0;
+		bool found=false;
+		if(seq&1)
 		{
-			noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[mid].table.virt;
-			const u64 i=page_4kb_count(hpa-rmt_dir[mid].hpa_start);
-			rm_table[i].low.asid=asid;
-			rm_table[i].low.shared=shared;
-			rm_table[i].low.ownership=ownership;
-			rm_table[i].low.reserved=0;
-			rm_table[i].high.value=gpa;
-			rm_table[i].high.reserved=0;
-			break;
+			noir_pause();
+			continue;
 		}
+		// Use binary search to reduce time complexity.
+		while(hi>lo)
+		{
+			const u64 mid=(hi+lo)>>1;
+			if(hpa<rmt_dir[mid].hpa_start)		// If HPA is lower than median range,
+				hi=mid;							// Reduce the higher bound.
+			else if(hpa>=rmt_dir[mid].hpa_end)	// If HPA is higher than median range,
+				lo=mid+1;						// Raise the lower bound.
+			else
+			{
+				*snapshot=rmt_dir[mid];
+				found=true;
+				break;
+			}
+		}
+		// If not found, this HPA is not pointing to physical RAM.
+		if(seq==hvm_p->rmd.sequence)return found;
 	}
 }
 
-bool nvc_validate_single_rmt_reassignment(u64 hpa,u64 gpa,u32 asid,bool shared,u8 ownership)
+noir_rmt_entry_p nvc_get_rmt_entry(u64 hpa)
 {
-	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	u64 hi=hvm_p->rmd.dir_count,lo=0;
-	// Use binary search to reduce time complexity.
-	while(hi>=lo)
-	{
-		const u64 mid=(hi+lo)>>1;
-		if(hpa<rmt_dir[mid].hpa_start)		// If HPA is lower than median range,
-			hi=mid-1;						// Reduce the higher bound.
-		else if(hpa>=rmt_dir[mid].hpa_end)	// If HPA is higher than median range,
-			lo=mid+1;						// Raise the lower bound.
-		else
-		{
-			noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[mid].table.virt;
-			const u64 i=page_4kb_count(hpa-rmt_dir[mid].hpa_start);
-			if(rm_table[i].low.ownership==noir_nsv_rmt_noirvisor)
-				return false;	// If the page was assigned to NoirVisor, fail the validation.
-			else if(rm_table[i].low.ownership==noir_nsv_rmt_secure_guest && ownership==noir_nsv_rmt_secure_guest)
-				return false;	// Secure Memory are not allowed to be remapped in one shot.
-			else if(ownership==noir_nsv_rmt_secure_guest && shared)
-				return false;	// Secure Memory are not allowed to be shared.
-			return true;
-		}
+	noir_rmt_directory_entry dir;
+	if(nvc_find_rmt_directory(hpa,&dir))return &((noir_rmt_entry_p)dir.table.virt)[page_4kb_count(hpa-dir.hpa_start)];
+	return null;
+}
+
+// Locate the RMT entry of the HPA. The directory is only searched if the HPA is outside the cached directory entry.
+// Tables are never moved once allocated, so the cached copy remains valid even if the directory is extended.
+noir_rmt_entry_p static nvc_get_rmt_entry_cached(u64 hpa,noir_rmt_directory_entry_p cache)
+{
+	if(cache->table.virt==null || hpa<cache->hpa_start || hpa>=cache->hpa_end)
+		if(!nvc_find_rmt_directory(hpa,cache))
+			return null;
+	return &((noir_rmt_entry_p)cache->table.virt)[page_4kb_count(hpa-cache->hpa_start)];
+}
+
+void static nvc_set_rmt_entry(noir_rmt_entry_p entry,u64 gpa,u32 asid,bool shared,u8 ownership)
+{
+	entry->low.asid=asid;
+	entry->low.shared=shared;
+	entry->low.ownership=ownership;
+	entry->low.reserved=0;
+	entry->high.value=gpa;
+	entry->high.reserved=0;
+}
+
+void nvc_configure_reverse_mapping(u64 hpa,u64 gpa,u32 asid,bool shared,u8 ownership)
+{
+	noir_rmt_entry_p entry=nvc_get_rmt_entry(hpa);
+	if(entry)nvc_set_rmt_entry(entry,gpa,asid,shared,ownership);
+}
+
+void nvc_configure_reverse_mapping_list(u64p hpa,u64p gpa,u32 pages,u32 asid,bool shared,u8 ownership)
+{
+	noir_rmt_directory_entry cache={0};
+	for(u32 i=0;i<pages;i++)
+	{
+		noir_rmt_entry_p entry=nvc_get_rmt_entry_cached(hpa[i],&cache);
+		if(entry)nvc_set_rmt_entry(entry,gpa[i],asid,shared,ownership);
 	}
-	// This HPA is not pointing to physical RAM.
-	return false;
+}
+
+bool static nvc_validate_rmt_entry(noir_rmt_entry_p entry,bool shared,u8 ownership)
+{
+	if(entry->low.ownership==noir_nsv_rmt_noirvisor)
+		return false;	// If the page was assigned to NoirVisor, fail the validation.
+	else if(entry->low.ownership==noir_nsv_rmt_secure_guest && ownership==noir_nsv_rmt_secure_guest)
+		return false;	// Secure Memory are not allowed to be remapped in one shot.
+	else if(ownership==noir_nsv_rmt_secure_guest && shared)
+		return false;	// Secure Memory are not allowed to be shared.
+	return true;
+}
+
+bool nvc_validate_single_rmt_reassignment(u64 hpa,u64 gpa,u32 asid,bool shared,u8 ownership)
+{
+	noir_rmt_entry_p entry=nvc_get_rmt_entry(hpa);
+	// If this HPA is not pointing to physical RAM, fail the validation.
+	return entry?nvc_validate_rmt_entry(entry,shared,ownership):false;
 }
 
 bool nvc_validate_rmt_reassignment(u64p hpa,u64p gpa,u32 pages,u32 asid,bool shared,u8 ownership)
 {
+	noir_rmt_directory_entry cache={0};
 	for(u32 i=0;i<pages;i++)
 	{
-		bool result=nvc_validate_single_rmt_reassignment(hpa[i],gpa[i],asid,shared,ownership);
-		if(!result)return false;
+		noir_rmt_entry_p entry=nvc_get_rmt_entry_cached(hpa[i],&cache);
+		if(entry==null)return false;
+		if(!nvc_validate_rmt_entry(entry,shared,ownership))return false;
 	}
 	return true;
 }
 
-noir_rmt_entry_p nvc_get_rmt_entry(u64 hpa)
+// Get the RMT entries from the HPA to the end of the physical range containing it.
+// The number of contiguous entries is returned via the pages parameter.
+noir_rmt_entry_p nvc_get_rmt_range(u64 hpa,u64p pages)
 {
-	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	u64 hi=hvm_p->rmd.dir_count,lo=0;
-	// Use binary search to reduce time complexity.
-	while(hi>=lo)
-	{
-		const u64 mid=(hi+lo)>>1;
-		if(hpa<rmt_dir[mid].hpa_start)		// If HPA is lower than median range,
-			hi=mid-1;						// Reduce the higher bound.
-		else if(hpa>=rmt_dir[mid].hpa_end)	// If HPA is higher than median range,
-			lo=mid+1;						// Raise the lower bound.
+	noir_rmt_directory_entry dir;
+	if(nvc_find_rmt_directory(hpa,&dir))
+	{
+		*pages=page_4kb_count(dir.hpa_end-page_4kb_base(hpa));
+		return &((noir_rmt_entry_p)dir.table.virt)[page_4kb_count(hpa-dir.hpa_start)];
+	}
+	*pages=0;
+	return null;
+}
+
+// Make room for one more extent in the ownership index.
+bool static nvc_rmt_index_grow(noir_rmt_ownership_index_p index)
+{
+	if(index->count==index->limit)
+	{
+		const u32 new_limit=index->limit?index->limit<<1:noir_rmt_index_initial_extents;
+		noir_rmt_extent_p new_extents=noir_alloc_nonpg_memory(sizeof(noir_rmt_extent)*new_limit);
+		if(new_extents==null)return false;
+		if(index->extents)
+		{
+			noir_movsb(new_extents,index->extents,sizeof(noir_rmt_extent)*index->count);
+			noir_free_nonpg_memory(index->extents);
+		}
+		index->extents=new_extents;
+		index->limit=new_limit;
+	}
+	return true;
+}
+
+// Record the host pages in the ownership index. Consecutive pages are merged into one extent.
+// If the index cannot grow, it is marked as overflown so that enumerations fall back to a full scan.
+void nvc_rmt_index_insert(noir_rmt_ownership_index_p index,u64p hpa_list,u32 pages)
+{
+	for(u32 i=0;i<pages && !index->overflow;)
+	{
+		const u64 start=page_4kb_base(hpa_list[i]);
+		u64 run=1;
+		while(i+run<pages && page_4kb_base(hpa_list[i+run])==start+page_4kb_mult(run))run++;
+		i+=(u32)run;
+		// Extend the last extent if this run follows it.
+		if(index->count && index->extents[index->count-1].hpa_start+page_4kb_mult(index->extents[index->count-1].pages)==start)
+			index->extents[index->count-1].pages+=run;
 		else
 		{
-			const u64 index=page_4kb_count(hpa-rmt_dir[mid].hpa_start);
-			noir_rmt_entry_p rm_table=rmt_dir[mid].table.virt;
-			return &rm_table[index];
+			if(!nvc_rmt_index_grow(index))
+			{
+				index->overflow=true;
+				break;
+			}
+			index->extents[index->count].hpa_start=start;
+			index->extents[index->count].pages=run;
+			index->count++;
 		}
 	}
-	return null;
 }
 
-void static nvc_enum_physical_range_callback(u64 start,u64 length,void* context)
+// Sort the extents and merge the overlapping ones so that no page is enumerated twice.
+// Extents are mostly appended in ascending order, so insertion sort is close to linear here.
+void static nvc_rmt_index_normalize(noir_rmt_ownership_index_p index)
 {
-	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
-	const u64 index=hvm_p->rmd.dir_count++;
-	u32p alloc_count=(u32p)context;
-	rmt_dir[index].hpa_start=start;
-	rmt_dir[index].hpa_end=start+length;
-	rmt_dir[index].table.virt=noir_alloc_contd_memory(page_count(length)<<4);
-	if(rmt_dir[index].table.virt)
+	noir_rmt_extent_p ext=index->extents;
+	u32 j=0;
+	for(u32 i=1;i<index->count;i++)
 	{
-		const u64 pages=page_count(length);
-		noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[index].table.virt;
-		rmt_dir[index].table.phys=noir_get_physical_address(rm_table);
-		(*alloc_count)++;
-		for(u64 i=0;i<pages;i++)
+		noir_rmt_extent cur=ext[i];
+		u32 k=i;
+		for(;k && ext[k-1].hpa_start>cur.hpa_start;k--)ext[k]=ext[k-1];
+		ext[k]=cur;
+	}
+	for(u32 i=1;i<index->count;i++)
+	{
+		const u64 end=ext[j].hpa_start+page_4kb_mult(ext[j].pages);
+		if(ext[i].hpa_start<=end)
+		{
+			const u64 new_end=ext[i].hpa_start+page_4kb_mult(ext[i].pages);
+			if(new_end>end)ext[j].pages=page_4kb_count(new_end-ext[j].hpa_start);
+		}
+		else
+			ext[++j]=ext[i];
+	}
+	if(index->count)index->count=j+1;
+}
+
+void nvc_rmt_index_release(noir_rmt_ownership_index_p index)
+{
+	if(index->extents)noir_free_nonpg_memory(index->extents);
+	index->extents=null;
+	index->count=index->limit=0;
+	index->overflow=false;
+}
+
+// Remove the host pages from the ownership index. Extents are trimmed, split or deleted.
+// Emptied extents are compacted at the end, and the storage is shrunk if it is mostly unused.
+// If an extent cannot be split for lack of memory, it is kept: enumerations check the ASID anyway.
+void nvc_rmt_index_remove(noir_rmt_ownership_index_p index,u64p hpa_list,u32 pages)
+{
+	noir_rmt_extent_p ext;
+	u32 j=0;
+	// An overflown index is not consulted by enumerations.
+	if(index->overflow || index->count==0)return;
+	nvc_rmt_index_normalize(index);
+	for(u32 i=0;i<pages;)
+	{
+		const u64 start=page_4kb_base(hpa_list[i]);
+		u64 run=1,end;
+		u32 lo=0,hi=index->count;
+		while(i+run<pages && page_4kb_base(hpa_list[i+run])==start+page_4kb_mult(run))run++;
+		i+=(u32)run;
+		end=start+page_4kb_mult(run);
+		ext=index->extents;
+		// Locate the first extent ending beyond the run. Emptied extents keep the order.
+		while(lo<hi)
+		{
+			const u32 mid=(lo+hi)>>1;
+			if(ext[mid].hpa_start+page_4kb_mult(ext[mid].pages)<=start)
+				lo=mid+1;
+			else
+				hi=mid;
+		}
+		for(;lo<index->count && ext[lo].hpa_start<end;lo++)
+		{
+			const u64 ext_start=ext[lo].hpa_start;
+			const u64 ext_end=ext_start+page_4kb_mult(ext[lo].pages);
+			if(start<=ext_start && end>=ext_end)
+				ext[lo].pages=0;
+			else if(start<=ext_start)
+			{
+				ext[lo].hpa_start=end;
+				ext[lo].pages=page_4kb_count(ext_end-end);
+			}
+			else if(end>=ext_end)
+				ext[lo].pages=page_4kb_count(start-ext_start);
+			else if(nvc_rmt_index_grow(index))
+			{
+				// Split the extent. The tail is inserted right after the head.
+				ext=index->extents;
+				for(u32 k=index->count;k>lo+1;k--)ext[k]=ext[k-1];
+				ext[lo+1].hpa_start=end;
+				ext[lo+1].pages=page_4kb_count(ext_end-end);
+				ext[lo].pages=page_4kb_count(start-ext_start);
+				index->count++;
+				break;
+			}
+		}
+	}
+	// Compact the emptied extents.
+	ext=index->extents;
+	for(u32 i=0;i<index->count;i++)
+		if(ext[i].pages)
+			ext[j++]=ext[i];
+	index->count=j;
+	if(j==0)
+		nvc_rmt_index_release(index);
+	else if(index->limit>noir_rmt_index_initial_extents && j<=(index->limit>>2))
+	{
+		const u32 new_limit=index->limit>>1;
+		noir_rmt_extent_p new_extents=noir_alloc_nonpg_memory(sizeof(noir_rmt_extent)*new_limit);
+		if(new_extents)
+		{
+			noir_movsb(new_extents,ext,sizeof(noir_rmt_extent)*j);
+			noir_free_nonpg_memory(ext);
+			index->extents=new_extents;
+			index->limit=new_limit;
+		}
+	}
+}
+
+// Enumerate the RMT entries assigned to the ASID. Only the ranges recorded in the index are scanned.
+// If the callback is absent, the entries are only counted. The RMT lock must be held by the caller.
+u32 nvc_enum_rmt_entries_by_asid(noir_rmt_ownership_index_p index,u32 asid,noir_rmt_enum_callback callback,void* context)
+{
+	u32 count=0;
+	if(index->overflow)
+	{
+		// The index is incomplete. Scan the entire Reverse-Mapping Table.
+		noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
+		for(u64 i=0;i<hvm_p->rmd.dir_count;i++)
 		{
-			rm_table[i].low.asid=1;
-			rm_table[i].low.shared=false;
-			rm_table[i].low.ownership=noir_nsv_rmt_subverted_host;
-			rm_table[i].high.value=page_mult(i)+start;
+			noir_rmt_entry_p rm_table=(noir_rmt_entry_p)rmt_dir[i].table.virt;
+			const u64 total_pages=page_4kb_count(rmt_dir[i].hpa_end-rmt_dir[i].hpa_start);
+			for(u64 j=0;j<total_pages;j++)
+			{
+				if(rm_table[j].low.asid==asid)
+				{
+					if(callback)callback(page_4kb_mult(j)+rmt_dir[i].hpa_start,&rm_table[j],context);
+					count++;
+				}
+			}
+		}
+	}
+	else
+	{
+		nvc_rmt_index_normalize(index);
+		for(u32 i=0;i<index->count;i++)
+		{
+			u64 hpa=index->extents[i].hpa_start;
+			u64 remainder=index->extents[i].pages;
+			while(remainder)
+			{
+				u64 run;
+				noir_rmt_entry_p rm_table=nvc_get_rmt_range(hpa,&run);
+				if(rm_table==null)
+					run=1;		// Skip the page if it is not physical RAM.
+				else
+				{
+					if(run>remainder)run=remainder;
+					for(u64 j=0;j<run;j++)
+					{
+						// Pages in the index might have been returned to the host. Filter them by the ASID.
+						if(rm_table[j].low.asid==asid)
+						{
+							if(callback)callback(hpa+page_4kb_mult(j),&rm_table[j],context);
+							count++;
+						}
+					}
+				}
+				hpa+=page_4kb_mult(run);
+				remainder-=run;
+			}
 		}
 	}
+	return count;
+}
+
+void static nvc_capture_physical_range_callback(u64 start,u64 length,void* context)
+{
+	noir_physical_memory_map_p map=(noir_physical_memory_map_p)context;
+	u32 i=map->count;
+	if(length==0)return;
+	if(map->count>=noir_physical_range_limit)
+	{
+		map->dropped++;
+		return;
+	}
+	// Firmware and the registry usually report the ranges in ascending order,
+	// so the insertion sort does not move anything in most cases.
+	for(;i && map->ranges[i-1].start>start;i--)map->ranges[i]=map->ranges[i-1];
+	map->ranges[i].start=start;
+	map->ranges[i].end=start+length;
+	map->count++;
+}
+
+void nvc_release_physical_memory_map()
+{
+	noir_physical_range_p old_ranges;
+	noir_acquire_pushlock_exclusive(&hvm_p->phys_map.lock);
+	old_ranges=hvm_p->phys_map.ranges;
+	hvm_p->phys_map.ranges=null;
+	hvm_p->phys_map.count=0;
+	noir_release_pushlock_exclusive(&hvm_p->phys_map.lock);
+	if(old_ranges)noir_free_nonpg_memory(old_ranges);
+}
+
+u32 nvc_enum_physical_memory_map(noir_physical_range_callback callback,void* context)
+{
+	u32 count;
+	noir_acquire_pushlock_shared(&hvm_p->phys_map.lock);
+	count=hvm_p->phys_map.count;
+	for(u32 i=0;i<count;i++)callback(hvm_p->phys_map.ranges[i].start,hvm_p->phys_map.ranges[i].end-hvm_p->phys_map.ranges[i].start,context);
+	noir_release_pushlock_shared(&hvm_p->phys_map.lock);
+	return count;
+}
+
+// Allocate the Reverse-Mapping Table for the range of the directory entry. All pages belong to the subverted host.
+bool static nvc_allocate_rmt_table(noir_rmt_directory_entry_p entry)
+{
+	const u64 pages=page_count(entry->hpa_end-entry->hpa_start);
+	noir_rmt_entry_p rm_table=noir_alloc_contd_memory(pages<<4);
+	entry->table.virt=rm_table;
+	if(rm_table==null)return false;
+	entry->table.phys=noir_get_physical_address(rm_table);
+	for(u64 i=0;i<pages;i++)
+	{
+		rm_table[i].low.asid=1;
+		rm_table[i].low.shared=false;
+		rm_table[i].low.ownership=noir_nsv_rmt_subverted_host;
+		rm_table[i].high.value=page_mult(i)+entry->hpa_start;
+	}
+	return true;
+}
+
+void static nvc_enum_physical_range_callback(u64 start,u64 length,void* context)
+{
+	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
+	const u64 index=hvm_p->rmd.dir_count;
+	// The directory occupies a single page. Excessive ranges fail the construction.
+	if(index>=noir_rmt_directory_limit)return;
+	hvm_p->rmd.dir_count++;
+	rmt_dir[index].hpa_start=start;
+	rmt_dir[index].hpa_end=start+length;
+	if(nvc_allocate_rmt_table(&rmt_dir[index]))(*(u32p)context)++;
 }
 
 bool nvc_build_reverse_mapping_table()
@@ -1499,9 +2808,20 @@ bool nvc_build_reverse_mapping_table()
 	hvm_p->rmd.directory.virt=noir_alloc_contd_memory(page_size);
 	if(hvm_p->rmd.directory.virt)
 	{
-		u32 alloc_count=0;
+		u32 alloc_count=0,range_count;
 		hvm_p->rmd.directory.phys=noir_get_physical_address(hvm_p->rmd.directory.virt);
-		noir_enum_physical_memory_ranges(nvc_enum_physical_range_callback,&alloc_count);
+		// The cached map is already sorted, so the directory remains searchable by nvc_get_rmt_entry.
+		range_count=nvc_enum_physical_memory_map(nvc_enum_physical_range_callback,&alloc_count);
+		if(range_count==0)
+		{
+			nv_dprintf("Physical memory map is not captured! Reverse-mapping table cannot be built!\n");
+			return false;
+		}
+		if(range_count>noir_rmt_directory_limit)
+		{
+			nv_dprintf("[Memory Map] %u physical memory ranges exceed the limit of %u directory entries! Reverse-mapping table cannot be built!\n",range_count,noir_rmt_directory_limit);
+			return false;
+		}
 		if(alloc_count==hvm_p->rmd.dir_count)
 		{
 			noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
@@ -1513,6 +2833,127 @@ bool nvc_build_reverse_mapping_table()
 	return false;
 }
 
+#if !defined(_hv_type1)
+// Find the first part of the cached map that is not covered by the Reverse-Mapping Directory.
+// The RMT lock must be held by the caller.
+bool static nvc_find_uncovered_physical_range(u64p start,u64p end)
+{
+	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
+	bool found=false;
+	noir_acquire_pushlock_shared(&hvm_p->phys_map.lock);
+	for(u32 i=0;i<hvm_p->phys_map.count && !found;i++)
+	{
+		u64 cur=hvm_p->phys_map.ranges[i].start;
+		const u64 limit=hvm_p->phys_map.ranges[i].end;
+		noir_rmt_directory_entry dir;
+		// Skip the covered parts of the range.
+		while(cur<limit && nvc_find_rmt_directory(cur,&dir))cur=dir.hpa_end;
+		if(cur<limit)
+		{
+			// The uncovered part ends at the next directory entry, or at the end of the range.
+			*start=cur;
+			*end=limit;
+			for(u64 j=0;j<hvm_p->rmd.dir_count;j++)
+				if(rmt_dir[j].hpa_start>cur && rmt_dir[j].hpa_start<*end)
+					*end=rmt_dir[j].hpa_start;
+			found=true;
+		}
+	}
+	noir_release_pushlock_shared(&hvm_p->phys_map.lock);
+	return found;
+}
+
+// Insert the entry and keep the directory sorted. The RMT lock must be held by the caller.
+// Readers in hypervisor context do not acquire the lock. They wait while the sequence is odd.
+void static nvc_insert_rmt_directory(noir_rmt_directory_entry_p entry)
+{
+	noir_rmt_directory_entry_p rmt_dir=(noir_rmt_directory_entry_p)hvm_p->rmd.directory.virt;
+	u64 i=hvm_p->rmd.dir_count;
+	// Do not get preempted while readers are waiting.
+	noir_cli();
+	noir_locked_inc(&hvm_p->rmd.sequence);
+	for(;i && rmt_dir[i-1].hpa_start>entry->hpa_start;i--)rmt_dir[i]=rmt_dir[i-1];
+	rmt_dir[i]=*entry;
+	hvm_p->rmd.dir_count++;
+	noir_locked_inc(&hvm_p->rmd.sequence);
+	noir_sti();
+}
+
+// Extend the Reverse-Mapping Table with the ranges that are not covered yet, e.g.: hot-added memory.
+noir_status static nvc_extend_reverse_mapping_table()
+{
+	noir_status st=noir_success;
+	u32 extended=0;
+	while(st==noir_success)
+	{
+		noir_rmt_directory_entry entry={0};
+		bool found;
+		noir_acquire_pushlock_exclusive(&hvm_p->rmd.lock);
+		found=nvc_find_uncovered_physical_range(&entry.hpa_start,&entry.hpa_end);
+		if(found)
+		{
+			if(hvm_p->rmd.dir_count>=noir_rmt_directory_limit)
+			{
+				nv_dprintf("[Memory Map] Range 0x%016llX-0x%016llX exceeds the limit of %u directory entries! It is not reverse-mapped!\n",entry.hpa_start,entry.hpa_end,noir_rmt_directory_limit);
+				st=noir_insufficient_resources;
+			}
+			else if(nvc_allocate_rmt_table(&entry))
+				nvc_insert_rmt_directory(&entry);
+			else
+			{
+				nv_dprintf("[Memory Map] Failed to allocate the reverse-mapping table for 0x%016llX-0x%016llX!\n",entry.hpa_start,entry.hpa_end);
+				st=noir_insufficient_resources;
+			}
+		}
+		noir_release_pushlock_exclusive(&hvm_p->rmd.lock);
+		if(!found)break;
+		if(st==noir_success)
+		{
+			// The new table must be protected from the subverted host, like any other table.
+			if(nvc_npt_protect_reverse_mapping_table(entry.table.phys,page_count(entry.hpa_end-entry.hpa_start)<<4)==false)
+			{
+				nv_dprintf("[Memory Map] Failed to protect the reverse-mapping table for 0x%016llX-0x%016llX!\n",entry.hpa_start,entry.hpa_end);
+				st=noir_unsuccessful;
+			}
+			else
+				nv_dprintf("[Memory Map] Reverse-mapped 0x%016llX-0x%016llX!\n",entry.hpa_start,entry.hpa_end);
+			extended++;
+		}
+	}
+	if(extended)nv_dprintf("[Memory Map] Reverse-mapping table is extended by %u range(s)!\n",extended);
+	return st;
+}
+#endif
+
+noir_status nvc_refresh_physical_memory_map()
+{
+	// The underlying enumeration may touch paged memory and registry. Capture without holding the lock.
+	noir_physical_memory_map map={0};
+	noir_physical_range_p old_ranges;
+	map.ranges=noir_alloc_nonpg_memory(page_size);
+	if(map.ranges==null)return noir_insufficient_resources;
+	noir_enum_physical_memory_ranges(nvc_capture_physical_range_callback,&map);
+	if(map.dropped)
+	{
+		// An incomplete map would leave the exceeding ranges without reverse-mapping. Keep the current map.
+		nv_dprintf("[Memory Map] %u physical memory ranges exceed the limit of %u ranges! Memory map is not captured!\n",map.count+map.dropped,noir_physical_range_limit);
+		noir_free_nonpg_memory(map.ranges);
+		return noir_insufficient_resources;
+	}
+	noir_acquire_pushlock_exclusive(&hvm_p->phys_map.lock);
+	old_ranges=hvm_p->phys_map.ranges;
+	hvm_p->phys_map.ranges=map.ranges;
+	hvm_p->phys_map.count=map.count;
+	noir_release_pushlock_exclusive(&hvm_p->phys_map.lock);
+	if(old_ranges)noir_free_nonpg_memory(old_ranges);
+	nv_dprintf("[Memory Map] Captured %u physical memory ranges!\n",map.count);
+#if !defined(_hv_type1)
+	// Reverse-Mapping Table is only built with NSV enabled.
+	if(hvm_p->rmd.directory.virt)return nvc_extend_reverse_mapping_table();
+#endif
+	return noir_success;
+}
+
 bool static nvc_translate_guest_virtual_address_routine32(u64 np_base,u64 pt,u64 gva,u32 access,u64p gpa,u32p error_code)
 {
 	// It's not viable to translate legacy paging with recursive algorithm because the large-page mechanism in legacy paging is special.
@@ -1520,10 +2961,10 @@ bool static nvc_translate_guest_virtual_address_routine32(u64 np_base,u64 pt,u64
 	// We need to translate GPA to HPA for the page table.
 	noir_paging32_general_entry_p table=null;
 	noir_page_fault_error_code np_err;
-	bool np_ret=noir_translate_custom_gpa(np_base,4,pt,noir_cvm_map_gpa_read_bit,(u64p)table,&np_err);
+	bool np_ret=noir_translate_custom_gpa(np_base,4,pt,noir_cvm_map_gpa_read_bit,(u64p)&table,&np_err);
 	if(!np_ret)
 	{
-		nvd_printf("[GVA Translate] Failed to translate GVA 0x%016llX during page-walking on page-directory 0x%llX! Error Code: 0x%X\n",gva,pt,np_err.value);
+		nvd_trace3(noir_trace_event_gva_walk_failed,gva,pt,np_err.value);
 		noir_int3();
 		return false;
 	}
@@ -1538,7 +2979,7 @@ bool static nvc_translate_guest_virtual_address_routine32(u64 np_base,u64 pt,u64
 		pf_err->user=table[trans.pde].pde.user<noir_bt(&access,noir_cvm_map_va_user);
 		if(pf_err->value)
 		{
-			nvd_printf("[GVA Translate] Permission is not granted at page directory! #PF Error: 0x%X\n",pf_err->value);
+			nvd_trace3(noir_trace_event_gva_denied,gva,2,pf_err->value);
 			return false;
 		}
 		else
@@ -1553,10 +2994,10 @@ bool static nvc_translate_guest_virtual_address_routine32(u64 np_base,u64 pt,u64
 			else
 			{
 				const u64 pt_base=page_4kb_mult(table[trans.pde].pde.pte_base);
-				np_ret=noir_translate_custom_gpa(np_base,4,pt_base,noir_cvm_map_gpa_read_bit,(u64p)table,&np_err);
+				np_ret=noir_translate_custom_gpa(np_base,4,pt_base,noir_cvm_map_gpa_read_bit,(u64p)&table,&np_err);
 				if(!np_ret)
 				{
-					nvd_printf("[GVA Translate] Failed to translate GVA 0x%016llX during page-walking on page-table 0x%llX! Error Code: 0x%X\n",gva,pt_base,np_err.value);
+					nvd_trace3(noir_trace_event_gva_walk_failed,gva,pt_base,np_err.value);
 					noir_int3();
 					return false;
 				}
@@ -1568,7 +3009,7 @@ bool static nvc_translate_guest_virtual_address_routine32(u64 np_base,u64 pt,u64
 					pf_err->user=table[trans.pte].pte.write<noir_bt(&access,noir_cvm_map_va_user);
 					if(pf_err->value)
 					{
-						nvd_printf("[GVA Translate] Permission is not granted at page table! #PF Error: 0x%X\n",pf_err->value);
+						nvd_trace3(noir_trace_event_gva_denied,gva,1,pf_err->value);
 						return false;
 					}
 					else
@@ -1593,10 +3034,10 @@ bool static nvc_translate_guest_virtual_address_routine64(u64 np_base,u64 pt,u32
 	// We need to translate GPA to HPA for the page table.
 	noir_paging64_general_entry_p table=null;
 	noir_page_fault_error_code np_err;
-	bool np_ret=noir_translate_custom_gpa(np_base,4,pt,noir_cvm_map_gpa_read_bit,(u64p)table,&np_err);
+	bool np_ret=noir_translate_custom_gpa(np_base,4,pt,noir_cvm_map_gpa_read_bit,(u64p)&table,&np_err);
 	if(!np_ret)
 	{
-		nvd_printf("[GVA Translate] Failed to translate GVA 0x%016llX during page-walking! Error Code: 0x%X\n",gva,np_err.value);
+		nvd_trace3(noir_trace_event_gva_walk_failed,gva,pt,np_err.value);
 		noir_int3();
 		return false;
 	}
@@ -1606,11 +3047,11 @@ bool static nvc_translate_guest_virtual_address_routine64(u64 np_base,u64 pt,u32
 		pf_err->value=0;
 		pf_err->present=table[index].present<noir_bt(&access,noir_cvm_map_va_read);
 		pf_err->write=table[index].write<noir_bt(&access,noir_cvm_map_va_write);
-		pf_err->execute=table[index].no_execute>noir_bt(&access,noir_cvm_map_va_execute);
+		pf_err->execute=table[index].no_execute && noir_bt(&access,noir_cvm_map_va_execute);
 		pf_err->user=table[index].user<noir_bt(&access,noir_cvm_map_va_user);
 		if(pf_err->value)
 		{
-			nvd_printf("[GVA Translate] Permission is not granted at level %u! #PF Error: 0x%X\n",level,pf_err->value);
+			nvd_trace3(noir_trace_event_gva_denied,gva,level,pf_err->value);
 			return false;
 		}
 		else
@@ -1624,7 +3065,6 @@ bool static nvc_translate_guest_virtual_address_routine64(u64 np_base,u64 pt,u32
 					const u64 offset_mask=(1<<(shift_diff+page_4kb_shift))-1;
 					const u64 base=(table[index].base>>shift_diff)<<(shift_diff+page_4kb_shift);
 					*gpa=base+(gva&offset_mask);
-					nvd_printf("[GVA Translate] GVA 0x%016llX is translated into GPA 0x%016llX at level %u in Long-Mode!\n",gva,*gpa,level);
 					return true;
 				}
 				else
@@ -1638,13 +3078,39 @@ bool static nvc_translate_guest_virtual_address_routine64(u64 np_base,u64 pt,u32
 				// Final Level
 				const u64 base=page_4kb_mult(table[index].base);
 				*gpa=base+page_offset(gva);
-				nvd_printf("[GVA Translate] GVA 0x%016llX is translated into GPA 0x%016llX in Long-Mode!\n",gva,*gpa);
 				return true;
 			}
 		}
 	}
 }
 
+// Paging controls that affect translations. The software TLB is discarded if any of them is changed.
+u64 static nvc_query_gva_tlb_paging_controls(noir_cvm_virtual_cpu_p vcpu)
+{
+	const u64 cr0=vcpu->crs.cr0&(amd64_cr0_pg_bit|amd64_cr0_wp_bit);
+	const u64 cr4=vcpu->crs.cr4&(amd64_cr4_pse_bit|amd64_cr4_pae_bit|amd64_cr4_pge_bit|amd64_cr4_la57_bit|amd64_cr4_pcide_bit|amd64_cr4_smep_bit|amd64_cr4_smap_bit);
+	const u64 efer=vcpu->msrs.efer&(amd64_efer_lma_bit|amd64_efer_nxe_bit);
+	return cr0|cr4|(efer<<32);
+}
+
+void nvc_flush_gva_tlb(noir_cvm_virtual_cpu_p vcpu)
+{
+	for(u32 i=0;i<noir_cvm_gva_tlb_entries;i++)
+		vcpu->gva_tlb[i].valid=false;
+	vcpu->gva_tlb_paging=nvc_query_gva_tlb_paging_controls(vcpu);
+	vcpu->gva_tlb_shootdown_seen=*vcpu->gva_tlb_shootdown;
+	vcpu->gva_tlb_filled=0;
+	vcpu->state_cache.gt_valid=1;
+	vcpu->statistics.gva_tlb.flushes++;
+}
+
+// Discard the software TLBs of all vCPUs in the VM without touching the vCPUs.
+// Each vCPU discards its own software TLB upon its next translation.
+void nvc_shootdown_gva_tlb(noir_cvm_virtual_machine_p vm)
+{
+	noir_locked_inc(&vm->gva_tlb_shootdown);
+}
+
 bool nvc_translate_guest_virtual_address(noir_cvm_virtual_cpu_p vcpu,u64 gva,u32 access,u64p gpa,u32p error_code)
 {
 	// Check if paging is enabled
@@ -1653,23 +3119,54 @@ bool nvc_translate_guest_virtual_address(noir_cvm_virtual_cpu_p vcpu,u64 gva,u32
 		// Paging is enabled.
 		const u64 np_base=noir_get_custom_vcpu_np_base(vcpu);
 		const u64 cr3=vcpu->crs.cr3;
+		noir_cvm_gva_tlb_entry_p entry=&vcpu->gva_tlb[page_count(gva)&(noir_cvm_gva_tlb_entries-1)];
+		bool result;
+		// Look up the software TLB first. It is invalidated by writes to CR3, invalidations of
+		// the guest's TLB, broadcast invalidations by any vCPU of the VM, changes to paging
+		// controls and changes to guest memory mappings.
+		if(!vcpu->state_cache.gt_valid || vcpu->gva_tlb_paging!=nvc_query_gva_tlb_paging_controls(vcpu) || vcpu->gva_tlb_shootdown_seen!=*vcpu->gva_tlb_shootdown)
+			nvc_flush_gva_tlb(vcpu);
+		if(entry->valid && entry->cr3==cr3 && entry->gva==page_base(gva) && (entry->access&access)==access)
+		{
+			vcpu->statistics.gva_tlb.hits++;
+			*gpa=entry->gpa+page_offset(gva);
+			*error_code=0;
+			return true;
+		}
+		vcpu->statistics.gva_tlb.misses++;
 		// Check if Long-Mode Paging is active.
 		if(vcpu->msrs.efer&amd64_efer_lma_bit)
 		{
 			// Long-Mode Paging is active.
 			// Check number of levels.
-			const u32 levels=noir_bt64(vcpu->crs.cr4,amd64_cr4_la57)+4;
-			return nvc_translate_guest_virtual_address_routine64(np_base,page_base(cr3),levels,gva,access,gpa,error_code);
+			const u32 levels=noir_bt64(&vcpu->crs.cr4,amd64_cr4_la57)+4;
+			result=nvc_translate_guest_virtual_address_routine64(np_base,page_base(cr3),levels,gva,access,gpa,error_code);
 		}
 		else
 		{
 			// Long-Mode Paging is inactive.
 			// Check if PAE.
 			if(vcpu->crs.cr4&amd64_cr4_pae_bit)
-				return nvc_translate_guest_virtual_address_routine64(np_base,page_pae_base(cr3),3,gva,access,gpa,error_code);
+				result=nvc_translate_guest_virtual_address_routine64(np_base,page_pae_base(cr3),3,gva,access,gpa,error_code);
 			else
-				return nvc_translate_guest_virtual_address_routine32(np_base,page_base(cr3),gva,access,gpa,error_code);
+				result=nvc_translate_guest_virtual_address_routine32(np_base,page_base(cr3),gva,access,gpa,error_code);
+		}
+		if(result)
+		{
+			// Fill the software TLB. Accesses granted to the same page are accumulated.
+			if(!entry->valid || entry->cr3!=cr3 || entry->gva!=page_base(gva))
+			{
+				// The core intercepts TLB maintenance of the guest on the next run.
+				vcpu->gva_tlb_filled++;
+				entry->cr3=cr3;
+				entry->gva=page_base(gva);
+				entry->access=0;
+			}
+			entry->gpa=page_base(*gpa);
+			entry->access|=access;
+			entry->valid=true;
 		}
+		return result;
 	}
 	else
 	{
@@ -1695,7 +3192,7 @@ size_t static nvc_copy_guest_virtual_memory_in_page(noir_cvm_virtual_cpu_p vcpu,
 		success=noir_translate_custom_gpa(np_base,4,gpa,flags,&hpa,&np_err);
 		if(!success)
 		{
-			nvd_printf("Failed to translate GPA 0x%016llX! Error Code: 0x%X\n",gpa,np_err.value);
+			nvd_trace2(noir_trace_event_gpa_failed,gpa,np_err.value);
 			noir_int3();
 		}
 		else
@@ -1716,10 +3213,9 @@ size_t nvc_copy_guest_virtual_memory(noir_cvm_virtual_cpu_p vcpu,u64 gva,void* b
 	u64 copy_size=0,copied_size=0,real_size=0;
 	for(u64 cur_va=gva;cur_va<end_va;cur_va+=copy_size)
 	{
-		const u64 end_len=page_size-page_offset(gva);
+		const u64 end_len=page_size-page_offset(cur_va);
 		const u64 rem_len=end_va-cur_va;
 		copy_size=end_len<rem_len?end_len:rem_len;
-		nvd_printf("[Copy] Copying %u bytes at VA 0x%016llX!\n",copy_size,cur_va);
 		real_size+=nvc_copy_guest_virtual_memory_in_page(vcpu,cur_va,(void*)((ulong_ptr)buffer+copied_size),copy_size,write,error_code);
 		copied_size+=copy_size;
 		// Let hypervisor know which address caused page fault!
@@ -1728,6 +3224,94 @@ size_t nvc_copy_guest_virtual_memory(noir_cvm_virtual_cpu_p vcpu,u64 gva,void* b
 	return real_size;
 }
 
+// Describe the guest buffer of the intercepted string I/O instruction as guest-physical ranges.
+// Each guest page is translated once. Ranges are listed in ascending order of address.
+// The return value is the number of elements covered by the list. It can be less than the rcx
+// if the list is full or if a page cannot be translated. Zero means the guest must be emulated per element.
+u32 nvc_build_pio_scatter_list(noir_cvm_virtual_cpu_p vcpu,noir_cvm_pio_scatter_entry_p list,u32 limit,u32p entries)
+{
+	noir_cvm_io_context_p io=&vcpu->exit_context.io;
+	const u64 mask=io->access.address_width>=8?0xffffffffffffffff:(1ull<<(io->access.address_width<<3))-1;
+	const u32 size=io->access.operand_size;
+	const bool df=noir_bt((u32*)&vcpu->exit_context.rflags,amd64_rflags_df);
+	const u32 access=io->access.io_type?noir_cvm_map_va_read_bit|noir_cvm_map_va_write_bit:noir_cvm_map_va_read_bit;
+	u64 count=io->access.repeat?io->rcx&mask:1;
+	u64 start,end,total,covered=0;
+	u32 n=0;
+	*entries=0;
+	if(count==0 || size==0)return 0;
+	if(count>noir_cvm_pio_element_limit)count=noir_cvm_pio_element_limit;
+	total=count*size;
+	// The ins instruction uses rdi, and the outs instruction uses rsi.
+	start=io->segment.base+((io->access.io_type?io->rdi:io->rsi)&mask);
+	// If the direction flag is set, the first element is at the highest address.
+	if(df)start-=total-size;
+	end=start+total;
+	if(vcpu->state_cache.cr_valid && !vcpu->state_cache.synchronized)
+		nvc_synchronize_vcpu_state(vcpu);
+	// Walk the buffer page by page, in the order that elements are transferred.
+	while(covered<total && n<limit)
+	{
+		u64 cur,len,gpa;
+		u32 error_code;
+		if(df)
+		{
+			const u64 cur_end=end-covered;
+			cur=page_base(cur_end-1);
+			if(cur<start)cur=start;
+			len=cur_end-cur;
+		}
+		else
+		{
+			cur=start+covered;
+			len=page_size-page_offset(cur);
+			if(len>total-covered)len=total-covered;
+		}
+		if(!nvc_translate_guest_virtual_address(vcpu,cur,access,&gpa,&error_code))break;
+		// Merge the range with the previous one if they are physically contiguous.
+		if(n && !df && list[n-1].gpa+list[n-1].length==gpa)
+			list[n-1].length+=(u32)len;
+		else if(n && df && gpa+len==list[n-1].gpa)
+		{
+			list[n-1].gpa=gpa;
+			list[n-1].length+=(u32)len;
+		}
+		else
+		{
+			list[n].gpa=gpa;
+			list[n].length=(u32)len;
+			list[n].reserved=0;
+			n++;
+		}
+		covered+=len;
+	}
+	count=covered/size;
+	// Drop the partial element at the tail.
+	for(u64 excess=covered-count*size;excess && n;)
+	{
+		if(list[n-1].length<=excess)
+			excess-=list[--n].length;
+		else
+		{
+			list[n-1].length-=(u32)excess;
+			if(df)list[n-1].gpa+=excess;
+			excess=0;
+		}
+	}
+	// Ranges are collected from the highest address if the direction flag is set. Reverse them.
+	if(df)
+	{
+		for(u32 i=0;i<n>>1;i++)
+		{
+			noir_cvm_pio_scatter_entry t=list[i];
+			list[i]=list[n-1-i];
+			list[n-1-i]=t;
+		}
+	}
+	*entries=n;
+	return (u32)count;
+}
+
 // Caveat: this routine currently does not consider shadow-stack and protection-key.
 // Use this routine only when Identity-Mapping is enabled.
 // Use recursive logic to reduce code size.
@@ -1743,10 +3327,10 @@ bool nvc_translate_host_virtual_address_routine64(u64 pt,u64 va,u32 level,u64p p
 	pf_err->present=table[index].present<r;
 	pf_err->write=table[index].write<w;
 	pf_err->user=table[index].user<u;
-	pf_err->execute=table[index].no_execute>x;
+	pf_err->execute=table[index].no_execute && x;
 	if(pf_err->value && level==1)
 	{
-		nvd_printf("[Translate] Permission is not granted at level %u! #PF Error: 0x%X\n",level,pf_err->value);
+		nvd_trace3(noir_trace_event_hva_denied,va,level,pf_err->value);
 		return false;
 	}
 	else
@@ -1795,7 +3379,7 @@ size_t nvc_copy_host_virtual_memory64(u64 pt,u64 va,void* buffer,size_t length,b
 			const u64 end_len=page_size-page_offset(va);
 			const u64 rem_len=end_va-cur_va;
 			copy_size=end_len<rem_len?end_len:rem_len;
-			nvd_printf("[Fetch] Copying %u bytes from VA 0x%016llX\n",copy_size,cur_va);
+			nvd_trace2(noir_trace_event_fetch_span,copy_size,cur_va);
 			real_size+=nvc_copy_host_virtual_memory64(pt,cur_va,(void*)((ulong_ptr)buffer+copied_size),copy_size,write,la57,error_code);
 			copied_size+=copy_size;
 			// Let hypervisor know which address caused page fault!
@@ -1824,10 +3408,17 @@ size_t nvc_copy_host_virtual_memory64(u64 pt,u64 va,void* buffer,size_t length,b
 
 noir_status nvc_build_hypervisor()
 {
+	noir_status st;
 	noir_get_vendor_string(hvm_p->vendor_string);
 	hvm_p->cpu_manuf=nvc_confirm_cpu_manufacturer(hvm_p->vendor_string);
 	hvm_p->options.value=noir_query_enabled_features_in_system();
 	nvc_store_image_info(&hvm_p->hv_image.base,&hvm_p->hv_image.size);
+	st=nvc_refresh_physical_memory_map();
+	if(st!=noir_success)
+	{
+		nv_dprintf("Failed to capture the physical memory map! Status=0x%X\n",st);
+		return st;
+	}
 	nv_dprintf("Note: If you are using GDB over QEMU/KVM, you may set a hardware breakpoint at 0x%p! (e.g.: hb *0x%p)\n",noir_hbreak,noir_hbreak);
 	switch(hvm_p->cpu_manuf)
 	{
@@ -1907,6 +3498,7 @@ svm_restoration:
 		nvc_svm_restore_system(hvm_p);
 		goto end_restoration;
 end_restoration:
+		nvc_release_physical_memory_map();
 		nv_dprintf("Restoration Complete...\n");
 	}
 }
\ No newline at end of file
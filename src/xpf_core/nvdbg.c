@@ -148,6 +148,135 @@ void cdecl nvd_panicf(const char* format,...)
 	noir_dbgport_release_lock();
 }
 
+// Binary Tracing Facility
+// Tracing only writes event IDs and raw arguments into per-processor rings.
+// Formatting is deferred to the drainer (e.g.: Asynchronous Logger on Windows) or host-side decoder.
+const char* nvd_trace_format_strings[noir_trace_event_maximum]=
+{
+	"Null Event\n",											// noir_trace_event_none
+	"Intercepted MSR-read for Index=0x%llX!\n",				// noir_trace_event_msr_read
+	"Intercepted MSR-write to Index=0x%llX! Incoming Value: 0x%016llX\n",	// noir_trace_event_msr_write
+	"Intercepted unknown MSR access! (Index=0x%llX, Write=%llu)\n",			// noir_trace_event_msr_unknown
+	"[GVA Translate] Failed to translate GVA 0x%016llX during page-walking on table 0x%llX! Error Code: 0x%llX\n",	// noir_trace_event_gva_walk_failed
+	"[GVA Translate] Permission is not granted for GVA 0x%016llX at level %llu! #PF Error: 0x%llX\n",	// noir_trace_event_gva_denied
+	"Failed to translate GPA 0x%016llX! Error Code: 0x%llX\n",				// noir_trace_event_gpa_failed
+	"[Translate] Permission is not granted for VA 0x%016llX at level %llu! #PF Error: 0x%llX\n",	// noir_trace_event_hva_denied
+	"[Fetch] Copying %llu bytes from VA 0x%016llX\n"						// noir_trace_event_fetch_span
+};
+
+void nvd_trace_fn(u32 event_id,u64 arg0,u64 arg1,u64 arg2,u64 arg3)
+{
+	// Tracing is disabled if rings are not allocated.
+	if(nvdbg.trace.rings)
+	{
+		u32 proc_id=noir_get_current_processor();
+		noir_trace_ring_p ring=&nvdbg.trace.rings[proc_id];
+		noir_trace_record_p record;
+		i64 head;
+		// Reserve a slot. Retry only if another producer on this processor won the race.
+		do
+		{
+			head=ring->head;
+			if(head-ring->tail>=noir_trace_ring_size)
+			{
+				// Ring is full. Count the drop instead of waiting for the drainer.
+				noir_locked_inc64(&ring->dropped);
+				return;
+			}
+		}while(noir_locked_cmpxchg64(&ring->head,head+1,head)!=head);
+		record=&ring->records[head&(noir_trace_ring_size-1)];
+		record->timestamp=noir_rdtsc();
+		record->event_id=event_id;
+		record->proc_id=proc_id;
+		record->args[0]=arg0;
+		record->args[1]=arg1;
+		record->args[2]=arg2;
+		record->args[3]=arg3;
+		// Publish the record after its contents are visible.
+		noir_store_fence();
+		record->sequence=head+1;
+	}
+}
+
+// Copies committed records from the ring to the buffer. Returns the number of records copied.
+u32 nvd_trace_drain(u32 proc_id,noir_trace_record_p buffer,u32 limit)
+{
+	u32 count=0;
+	if(nvdbg.trace.rings && proc_id<nvdbg.trace.processors)
+	{
+		noir_trace_ring_p ring=&nvdbg.trace.rings[proc_id];
+		i64 tail=ring->tail;
+		while(count<limit && tail<ring->head)
+		{
+			noir_trace_record_p record=&ring->records[tail&(noir_trace_ring_size-1)];
+			// Stop at the record that is reserved but not yet committed.
+			if(record->sequence!=(u64)tail+1)break;
+			noir_load_fence();
+			noir_copy_memory(&buffer[count++],record,sizeof(noir_trace_record));
+			tail++;
+		}
+		// Release the slots to producers.
+		noir_locked_xchg64(&ring->tail,tail);
+	}
+	return count;
+}
+
+// Returns the number of dropped records since last query.
+u64 nvd_trace_query_dropped(u32 proc_id)
+{
+	if(nvdbg.trace.rings && proc_id<nvdbg.trace.processors)
+		return (u64)noir_locked_xchg64(&nvdbg.trace.rings[proc_id].dropped,0);
+	return 0;
+}
+
+i32 nvd_trace_format(noir_trace_record_p record,char* buffer,size_t limit)
+{
+	if(record->event_id>=noir_trace_event_maximum)
+		return nv_snprintf(buffer,limit,"Unknown Trace Event %u! Args: 0x%llX, 0x%llX, 0x%llX, 0x%llX\n",record->event_id,record->args[0],record->args[1],record->args[2],record->args[3]);
+	return nv_snprintf(buffer,limit,nvd_trace_format_strings[record->event_id],record->args[0],record->args[1],record->args[2],record->args[3]);
+}
+
+// Drains all committed records of the processor and passes them to the output routine.
+// Returns the number of records flushed.
+u32 nvd_trace_flush(u32 proc_id,noir_trace_output_routine output)
+{
+	noir_trace_record records[noir_trace_drain_batch];
+	u32 count,total=0;
+	while((count=nvd_trace_drain(proc_id,records,noir_trace_drain_batch))!=0)
+	{
+		for(u32 i=0;i<count;i++)
+		{
+			char text[256];
+			nvd_trace_format(&records[i],text,sizeof(text));
+			output(records[i].proc_id,records[i].timestamp,text);
+		}
+		total+=count;
+		if(count<noir_trace_drain_batch)break;
+	}
+	return total;
+}
+
+void nvd_trace_finalize()
+{
+	if(nvdbg.trace.rings)
+	{
+		noir_trace_ring_p rings=nvdbg.trace.rings;
+		nvdbg.trace.rings=null;
+		nvdbg.trace.processors=0;
+		noir_free_nonpg_memory(rings);
+	}
+}
+
+noir_status nvd_trace_initialize()
+{
+	u32 processors=noir_get_processor_count();
+	noir_trace_ring_p rings=noir_alloc_nonpg_memory(sizeof(noir_trace_ring)*processors);
+	if(rings==null)return noir_insufficient_resources;
+	nvdbg.trace.processors=processors;
+	nvdbg.trace.rings=rings;
+	return noir_success;
+}
+
 // Dead
 void nvd_deadloop()
 {
@@ -143,6 +143,30 @@ void* noir_alloc_2mb_page()
 	return p;
 }
 
+// UEFI does not expose memory affinity. Fall back to ordinary allocations.
+void* noir_alloc_contd_memory_for_numa(IN UINT32 NumaNode,IN UINTN Length)
+{
+	return noir_alloc_contd_memory(Length);
+}
+
+void* noir_alloc_nonpg_memory_for_numa(IN UINT32 NumaNode,IN UINTN Length)
+{
+	return noir_alloc_nonpg_memory(Length);
+}
+
+UINT32 noir_get_processor_numa_node(IN UINT32 ProcessorNumber)
+{
+	return 0;
+}
+
+// Calibrate TSC frequency against the Boot Services stall.
+UINT64 noir_query_tsc_frequency()
+{
+	UINT64 TscStart=AsmReadTsc();
+	gBS->Stall(10000);
+	return (AsmReadTsc()-TscStart)*100;
+}
+
 void noir_free_nonpg_memory(IN VOID* VirtualAddress)
 {
 	FreePool(VirtualAddress);
@@ -220,6 +244,12 @@ void noir_generic_call(noir_broadcast_worker worker,void* context)
 	}
 }
 
+BOOLEAN noir_kick_processor(IN UINT32 ProcessorNumber)
+{
+	// UEFI does not host Customizable VMs. There is nobody to kick.
+	return FALSE;
+}
+
 INTN EFIAPI NoirMemoryRangeComparator(IN CONST VOID *Buffer1,IN CONST VOID* Buffer2)
 {
 	PMEMORY_RANGE a=(PMEMORY_RANGE)Buffer1,b=(PMEMORY_RANGE)Buffer2;
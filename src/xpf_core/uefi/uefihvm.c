@@ -45,8 +45,49 @@ void NoirTestCpuid()
 	}
 }
 
+void NoirPrintTraceRecord(IN UINT32 ProcessorId,IN UINT64 Timestamp,IN CONST CHAR8* Text)
+{
+	NoirDebugPrint("[Trace | Core %03u | TSC %llu] %s",ProcessorId,Timestamp,Text);
+}
+
+void EFIAPI NoirDrainTraceRings(IN EFI_EVENT Event,IN VOID* Context)
+{
+	// There are no logger threads in UEFI. Drain rings of all processors on the timer.
+	for(UINT32 i=0;i<noir_get_processor_count();i++)
+	{
+		UINT64 DroppedCount;
+		nvd_trace_flush(i,NoirPrintTraceRecord);
+		DroppedCount=nvd_trace_query_dropped(i);
+		if(DroppedCount)NoirDebugPrint("[Trace | Core %03u | Panic] There are %llu trace records dropped!\n",i,DroppedCount);
+	}
+}
+
+void NoirInitializeTraceDrainer()
+{
+	if(nvd_trace_initialize()==0)
+	{
+		EFI_STATUS st=gBS->CreateEvent(EVT_TIMER|EVT_NOTIFY_SIGNAL,TPL_CALLBACK,NoirDrainTraceRings,NULL,&NoirTraceDrainerEvent);
+		if(st==EFI_SUCCESS)st=gBS->SetTimer(NoirTraceDrainerEvent,TimerPeriodic,NOIR_TRACE_DRAIN_PERIOD);
+		if(st!=EFI_SUCCESS)NoirDebugPrint("Failed to start the trace drainer! Status=0x%X\n",st);
+	}
+}
+
+// Timers are gone when UEFI enters Runtime Stage. Flush the rings for the last time.
+// Rings are not released here because memory cannot be freed at this moment and
+// producers simply count dropped records once rings are full.
+void NoirStopTraceDrainer()
+{
+	if(NoirTraceDrainerEvent)
+	{
+		gBS->CloseEvent(NoirTraceDrainerEvent);
+		NoirTraceDrainerEvent=NULL;
+		NoirDrainTraceRings(NULL,NULL);
+	}
+}
+
 UINT32 NoirBuildHypervisor()
 {
+	NoirInitializeTraceDrainer();
 	DisableInterrupts();
 	UINT32 st=nvc_build_hypervisor();
 	EnableInterrupts();
@@ -57,6 +98,8 @@ UINT32 NoirBuildHypervisor()
 void NoirTeardownHypervisor()
 {
 	nvc_teardown_hypervisor();
+	NoirStopTraceDrainer();
+	nvd_trace_finalize();
 }
 
 UINT64 noir_query_enabled_features_in_system()
@@ -47,6 +47,13 @@ EFI_HANDLE NvImageDeviceHandle;
 VOID* NvImageBase=NULL;
 UINT32 NvImageSize=0;
 
+// Drain the trace rings every 100ms.
+#define NOIR_TRACE_DRAIN_PERIOD		1000000
+
+typedef void(*NOIR_TRACE_OUTPUT_ROUTINE)(IN UINT32 ProcessorId,IN UINT64 Timestamp,IN CONST CHAR8* Text);
+
+EFI_EVENT NoirTraceDrainerEvent=NULL;
+
 void __cdecl NoirDebugPrint(IN CONST CHAR8 *Format,...);
 EFI_STATUS NoirGetConfigurationRecord(IN CHAR8* RecordName,OUT UINT32* RecordType,OUT VOID* RecordData,IN UINT32 RecordLength,OUT UINT32* OutputLength);
 
@@ -61,4 +68,9 @@ void nvc_teardown_hypervisor();
 UINT32 nvc_acpi_initialize();
 UINT32 nvc_hpet_initialize();
 UINT32 noir_configure_serial_port_debugger(UINT8 PortNumber,UINT16 PortBase,UINT32 BaudRate);
-UINT32 noir_configure_qemu_debug_console(UINT16 port);
\ No newline at end of file
+UINT32 noir_configure_qemu_debug_console(UINT16 port);
+UINT32 noir_get_processor_count();
+UINT32 nvd_trace_initialize();
+void nvd_trace_finalize();
+UINT32 nvd_trace_flush(IN UINT32 ProcessorId,IN NOIR_TRACE_OUTPUT_ROUTINE OutputRoutine);
+UINT64 nvd_trace_query_dropped(IN UINT32 ProcessorId);
@@ -196,6 +196,51 @@ typedef struct _NOIR_ADDRESS_MAPPING
 	}Attributes;
 }NOIR_ADDRESS_MAPPING,*PNOIR_ADDRESS_MAPPING;
 
+typedef struct _NOIR_CPUID_QUICKPATH
+{
+	ULONG32 Leaf;
+	ULONG32 Subleaf;
+	union
+	{
+		struct
+		{
+			ULONG64 Active:1;
+			ULONG64 HasSubleaf:1;
+			ULONG64 VmWide:1;
+			ULONG64 HostMasked:1;		// Eax-Edx are masks applied to host CPUID result.
+			ULONG64 Reserved:60;
+		};
+		ULONG64 Value;
+	}Options;
+	ULONG32 Eax;
+	ULONG32 Ebx;
+	ULONG32 Ecx;
+	ULONG32 Edx;
+}NOIR_CPUID_QUICKPATH,*PNOIR_CPUID_QUICKPATH;
+
+#define NOIR_CPUID_QUICKPATH_VM_WIDE		0xFFFFFFFF
+#define NOIR_CPUID_QUICKPATH_FALLBACK		0xFFFFFFFE
+
+typedef struct _NOIR_MSR_QUICKPATH
+{
+	ULONG32 First;
+	ULONG32 Last;
+	union
+	{
+		struct
+		{
+			ULONG32 Active:1;
+			ULONG32 Passthrough:1;		// Reads go to hardware without exits. Writes raise #GP.
+			ULONG32 Reserved:30;
+		};
+		ULONG32 Value;
+	}Options;
+	ULONG32 Reserved;
+	ULONG64 Value;
+	ULONG64 ReadOnlyMask;
+	ULONG64 Hits;
+}NOIR_MSR_QUICKPATH,*PNOIR_MSR_QUICKPATH;
+
 #define MemoryWorkingSetExInformation		4
 
 typedef NTSTATUS (*ZWQUERYVIRTUALMEMORY)
@@ -238,28 +283,40 @@ typedef struct _MEMORY_WORKING_SET_EX_INFORMATION
 }MEMORY_WORKING_SET_EX_INFORMATION,*PMEMORY_WORKING_SET_EX_INFORMATION;
 
 /*
-  NoirVisor chooses the similar data structure to Windows' handle table.
+  NoirVisor keeps the handles of VMs in a slab of pages.
 
-  Multi-level table is supported. Each table has a size of a page.
   Each handle of a VM is defined as 64-bit for any systems.
-  Therefore, there are 512 entries, 9 bits per level.
-
-  To be honest, multi-level table is actually a multi-branching tree.
-  This design supports 4096 levels of tree depth at most, though 7 levels
-  should have covered all possible values of 64-bit handles.
+  The low 32 bits are the index of the entry, whilst the high 32 bits
+  are the sequence of the entry when the handle is created.
+  The sequence of an entry increments on deletion so that a stale
+  handle never references the VM that reuses the entry.
+
+  Free entries are linked in a list so that creation and deletion take
+  constant time under the table lock. Pages are never released before
+  the module is finalized, so referencing a handle is lock-free.
 */
 
-#define HandleTableCapacity		512
-#define HandleTableShiftBits	9
+#define HandleEntriesPerPage	256
+#define HandleEntryShiftBits	8
+#define HandleTablePageLimit	512
+#define HandleNullIndex			0xFFFFFFFF
 
 typedef ULONG64 CVM_HANDLE;
 typedef PULONG64 PCVM_HANDLE;
 
+typedef struct _NOIR_CVM_HANDLE_ENTRY
+{
+	PVOID volatile Object;
+	LONG volatile Sequence;
+	ULONG32 NextFree;
+}NOIR_CVM_HANDLE_ENTRY,*PNOIR_CVM_HANDLE_ENTRY;
+
 typedef struct _NOIR_CVM_HANDLE_TABLE
 {
-	ULONG_PTR TableCode;
+	PNOIR_CVM_HANDLE_ENTRY volatile Pages[HandleTablePageLimit];
 	EX_PUSH_LOCK HandleTableLock;
-	CVM_HANDLE MaximumHandleValue;
+	ULONG32 PageCount;
+	ULONG32 FreeHead;
 	SIZE_T HandleCount;
 }NOIR_CVM_HANDLE_TABLE,*PNOIR_CVM_HANDLE_TABLE;
 
@@ -285,14 +342,21 @@ NTSTATUS NoirHaxRemoveVirtualMachineNotification(IN CVM_HANDLE VmHandle);
 ULONG32 nvc_query_physical_asid_limit(IN PSTR vendor_string);
 void noir_get_vendor_string(OUT PSTR vendor_string);
 NOIR_STATUS nvc_query_hypervisor_status(IN ULONG64 StatusType,OUT PVOID Status);
+NOIR_STATUS nvc_query_host_exit_profile(IN ULONG32 Processor,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS nvc_create_vm(OUT PVOID *VirtualMachine,IN HANDLE ProcessId);
 NOIR_STATUS nvc_create_vm_ex(OUT PVOID *VirtualMachine,IN HANDLE ProcessId,IN ULONG32 Properties);
 NOIR_STATUS nvc_release_vm(IN PVOID VirtualMachine);
 NOIR_STATUS nvc_ref_vm(IN PVOID VirtualMachine);
 NOIR_STATUS nvc_deref_vm(IN PVOID VirtualMachine);
 NOIR_STATUS nvc_set_mapping(IN PVOID VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation);
+NOIR_STATUS nvc_set_mapping_batch(IN PVOID VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation,IN ULONG32 NumberOfRanges);
+NOIR_STATUS nvc_set_cpuid_quickpath(IN PVOID VirtualMachine,IN PVOID VirtualProcessor OPTIONAL,IN PNOIR_CPUID_QUICKPATH QuickPath);
+NOIR_STATUS nvc_set_cpuid_fallback(IN PVOID VirtualMachine,IN BOOLEAN Enabled,IN ULONG32 EaxMask,IN ULONG32 EbxMask,IN ULONG32 EcxMask,IN ULONG32 EdxMask);
+NOIR_STATUS nvc_set_msr_quickpath(IN PVOID VirtualMachine,IN PNOIR_MSR_QUICKPATH QuickPath);
+NOIR_STATUS nvc_query_msr_quickpath(IN PVOID VirtualMachine,IN ULONG32 Index,OUT PNOIR_MSR_QUICKPATH QuickPath);
 NOIR_STATUS nvc_query_gpa_accessing_bitmap(IN PVOID VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,OUT PVOID Bitmap,IN ULONG32 BitmapSize);
 NOIR_STATUS nvc_clear_gpa_accessing_bits(IN PVOID VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages);
+NOIR_STATUS nvc_query_gpa_dirty_bitmap(IN PVOID VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,IN OUT PVOID Bitmap,IN ULONG32 BitmapSize,IN BOOLEAN Accumulate);
 NOIR_STATUS nvc_create_vcpu(IN PVOID VirtualMachine,OUT PVOID *VirtualProcessor,IN ULONG32 VpIndex);
 NOIR_STATUS nvc_release_vcpu(IN PVOID VirtualProcessor);
 NOIR_STATUS nvc_ref_vcpu(IN PVOID VirtualProcessor);
@@ -300,12 +364,14 @@ NOIR_STATUS nvc_deref_vcpu(IN PVOID VirtualProcessor);
 NOIR_STATUS nvc_run_vcpu(IN PVOID VirtualProcessor,OUT PVOID ExitContext);
 NOIR_STATUS nvc_rescind_vcpu(IN PVOID VirtualProcessor);
 NOIR_STATUS nvc_query_vcpu_statistics(IN PVOID VirtualProcessor,OUT PVOID Buffer,IN ULONG32 BufferSize);
+NOIR_STATUS nvc_query_vcpu_exit_profile(IN PVOID VirtualProcessor,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS nvc_view_vcpu_registers(IN PVOID VirtualProcessor,IN NOIR_CVM_REGISTER_TYPE RegisterType,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS nvc_edit_vcpu_registers(IN PVOID VirtualProcessor,IN NOIR_CVM_REGISTER_TYPE RegisterType,IN PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS nvc_view_vcpu_registers2(IN PVOID VirtualProcessor,IN PULONG32 RegisterNames,IN ULONG32 RegisterCount,IN ULONG32 RegisterSize,OUT PVOID Buffer);
 NOIR_STATUS nvc_edit_vcpu_registers2(IN PVOID VirtualProcessor,IN PULONG32 RegisterNames,IN ULONG32 RegisterCount,IN ULONG32 RegisterSize,IN PVOID Buffer);
 NOIR_STATUS nvc_set_event_injection(IN PVOID VirtualProcessor,IN ULONG64 InjectedEvent);
 NOIR_STATUS nvc_set_guest_vcpu_options(IN PVOID VirtualProcessor,IN ULONG32 OptionType,IN ULONG32 Options);
+NOIR_STATUS nvc_set_vpcb(IN PVOID VirtualProcessor,IN PVOID Vpcb);
 PVOID nvc_reference_vcpu(IN PVOID VirtualMachine,IN ULONG32 VpIndex);
 HANDLE nvc_get_vm_pid(IN PVOID VirtualMachine);
 
@@ -328,12 +394,19 @@ NOIR_STATUS NoirIncrementVirtualMachineReference(IN CVM_HANDLE VirtualMachine);
 NOIR_STATUS NoirDecrementVirtualMachineReference(IN CVM_HANDLE VirtualMachine);
 NOIR_STATUS NoirQueryGpaAccessingBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,OUT PVOID Bitmap,IN ULONG32 BitmapSize);
 NOIR_STATUS NoirClearGpaAccessingBits(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages);
+NOIR_STATUS NoirQueryGpaDirtyBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,IN OUT PVOID Bitmap,IN ULONG32 BitmapSize,IN BOOLEAN Accumulate);
 NOIR_STATUS NoirSetMapping(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation);
+NOIR_STATUS NoirSetMappingBatch(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation,IN ULONG32 NumberOfRanges);
+NOIR_STATUS NoirSetCpuidQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PNOIR_CPUID_QUICKPATH QuickPath);
+NOIR_STATUS NoirSetMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN PNOIR_MSR_QUICKPATH QuickPath);
+NOIR_STATUS NoirQueryMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 Index,OUT PNOIR_MSR_QUICKPATH QuickPath);
 NOIR_STATUS NoirQueryVirtualProcessorStatistics(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize);
+NOIR_STATUS NoirQueryVirtualProcessorExitProfile(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirViewVirtualProcessorRegisters(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN NOIR_CVM_REGISTER_TYPE RegisterType,OUT PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirEditVirtualProcessorRegisters(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN NOIR_CVM_REGISTER_TYPE RegisterType,IN PVOID Buffer,IN ULONG32 BufferSize);
 NOIR_STATUS NoirSetEventInjection(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN ULONG64 InjectedEvent);
 NOIR_STATUS NoirSetVirtualProcessorOptions(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN ULONG32 OptionType,IN ULONG32 Options);
+NOIR_STATUS NoirSetVirtualProcessorControlBlock(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PVOID Vpcb);
 NOIR_STATUS NoirRunVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID ExitContext);
 NOIR_STATUS NoirRescindVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 NOIR_STATUS NoirCreateVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
@@ -341,4 +414,5 @@ NOIR_STATUS NoirReleaseVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32
 NOIR_STATUS NoirIncrementVirtualProcessorReference(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 NOIR_STATUS NoirDecrementVirtualProcessorReference(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex);
 NOIR_STATUS NoirQueryHypervisorStatus(IN ULONG64 StatusType,OUT PVOID Status);
+NOIR_STATUS NoirQueryHostExitProfile(IN ULONG32 ProcessorNumber,OUT PVOID Buffer,IN ULONG32 BufferSize);
 PVOID NoirReferenceVirtualMachineByHandle(IN CVM_HANDLE Handle);
\ No newline at end of file
@@ -51,155 +51,102 @@ NTSTATUS NoirGetPageInformation(IN PVOID PageAddress,OUT PMEMORY_WORKING_SET_EX_
 	return st;
 }
 
-// Lock the table with at least Shared Access before invoking this function!
-PVOID NoirReferenceVirtualMachineByHandleUnsafe(IN CVM_HANDLE Handle,IN ULONG_PTR TableCode)
+// Get the entry of the handle. Return NULL if the index is out of the table.
+PNOIR_CVM_HANDLE_ENTRY NoirGetHandleEntry(IN CVM_HANDLE Handle)
 {
-	PULONG_PTR Base=(PULONG_PTR)PAGE_ALIGN(TableCode);	// Get the base of current table.
-	ULONG32 Levels=BYTE_OFFSET(TableCode);				// Get the level of current table.
-	// Get the index that should be used on referencing this table.
-	ULONG_PTR RefIndex=(Handle>>(Levels*HandleTableShiftBits))&(HandleTableCapacity-1);
-	// Recurse until we are referencing the lowest level of table.
-	if(!Levels)return (PVOID)Base[RefIndex];
-	return NoirReferenceVirtualMachineByHandleUnsafe(Handle,Base[RefIndex]);
+	ULONG32 Index=(ULONG32)Handle;
+	ULONG32 PageIndex=Index>>HandleEntryShiftBits;
+	if(PageIndex<HandleTablePageLimit)
+	{
+		PNOIR_CVM_HANDLE_ENTRY Page=NoirCvmHandleTable.Pages[PageIndex];
+		if(Page)return &Page[Index&(HandleEntriesPerPage-1)];
+	}
+	return NULL;
 }
 
+// This function is lock-free.
 PVOID NoirReferenceVirtualMachineByHandle(IN CVM_HANDLE Handle)
 {
-	PVOID VM=NULL;
-	KeEnterCriticalRegion();
-	ExfAcquirePushLockShared(&NoirCvmHandleTable.HandleTableLock);
-	VM=NoirReferenceVirtualMachineByHandleUnsafe(Handle,NoirCvmHandleTable.TableCode);
-	ExfReleasePushLockShared(&NoirCvmHandleTable.HandleTableLock);
-	KeLeaveCriticalRegion();
-	return VM;
+	PNOIR_CVM_HANDLE_ENTRY Entry=NoirGetHandleEntry(Handle);
+	if(Entry)
+	{
+		// Read the object before the sequence. The sequence is incremented
+		// before the object is cleared, so a stale handle would be caught.
+		PVOID VM=Entry->Object;
+		KeMemoryBarrier();
+		if((ULONG32)Entry->Sequence==(ULONG32)(Handle>>32))return VM;
+	}
+	return NULL;
 }
 
-// This function does not acquire lock itself.
-// Therefore, acquire the table lock with Exclusive Access prior to invoking this function!
-NOIR_STATUS NoirCreateHandleUnsafe(IN ULONG_PTR TableCode,OUT PCVM_HANDLE Handle,IN PVOID ReferencedEntry)
+// Allocate a page of entries and link them to the free list.
+// Acquire the table lock with Exclusive Access prior to invoking this function!
+NOIR_STATUS NoirExpandHandleTableUnsafe()
 {
-	// Check if this is a multi-level table.
-	ULONG Levels=BYTE_OFFSET((PVOID)TableCode);
-	if(Levels)
-	{
-		// This is not the lowest table entry. Search underlying levels of tables.
-		PULONG_PTR Base=PAGE_ALIGN((PVOID)TableCode);
-		for(ULONG i=0;i<HandleTableCapacity;i++)
-		{
-			NOIR_STATUS st;
-			if(Base[i])
-			{
-				// Search this available table.
-				st=NoirCreateHandleUnsafe(Base[i],Handle,ReferencedEntry);
-				// Check if creation is successful.
-				if(st==NOIR_SUCCESS)
-				{
-					// Adjust the handle value by current table level.
-					*Handle+=i<<(HandleTableShiftBits*Levels);
-					// Return.
-					return st;
-				}
-				// Creation failed, check the next table entry.
-			}
-			else
-			{
-				// At this moment, all already-allocated tables are full.
-				// Allocate a new table and insert to table.
-				Base[i]=(ULONG_PTR)NoirAllocateNonPagedMemory(PAGE_SIZE);
-				if(Base[i]==0)return NOIR_INSUFFICIENT_RESOURCES;
-				// Initialize the table.
-				RtlZeroMemory((PVOID)Base[i],PAGE_SIZE);
-				Base[i]|=Levels-1;	// Set the level of the underlying table.
-				// Create handle based on this new table.
-				st=NoirCreateHandleUnsafe(Base[i],Handle,ReferencedEntry);
-				// Usually, if creation fails, there is insufficient resources to allocate.
-				if(st!=NOIR_SUCCESS)return st;
-				// Adjust the handle value by current table level.
-				*Handle+=i<<(HandleTableShiftBits*Levels);
-				return NOIR_SUCCESS;
-			}
-		}
-		// If the code reaches here, this whole table is full.
-		// Invoker of this function should increase the table level itself.
-		return NOIR_UNSUCCESSFUL;
-	}
-	else
+	PNOIR_CVM_HANDLE_ENTRY Page;
+	ULONG32 BaseIndex=NoirCvmHandleTable.PageCount<<HandleEntryShiftBits;
+	if(NoirCvmHandleTable.PageCount>=HandleTablePageLimit)
 	{
-		// This is the lowest table entry. Search for an available entry.
-		PVOID *Base=(PVOID*)TableCode;
-		for(ULONG i=0;i<HandleTableCapacity;i++)
-		{
-			if(Base[i]==NULL)
-			{
-				Base[i]=ReferencedEntry;
-				*Handle=i;
-				return NOIR_SUCCESS;
-			}
-		}
-		// At this moment, the table is out of entry.
-		*Handle=0;
-		return NOIR_UNSUCCESSFUL;
+		NoirCvmTracePrint("The handle table is full!\n");
+		return NOIR_INSUFFICIENT_RESOURCES;
 	}
+	Page=NoirAllocateNonPagedMemory(PAGE_SIZE);
+	if(Page==NULL)return NOIR_INSUFFICIENT_RESOURCES;
+	RtlZeroMemory(Page,PAGE_SIZE);
+	for(ULONG32 i=0;i<HandleEntriesPerPage;i++)
+		Page[i].NextFree=BaseIndex+i+1;
+	Page[HandleEntriesPerPage-1].NextFree=NoirCvmHandleTable.FreeHead;
+	NoirCvmHandleTable.FreeHead=BaseIndex;
+	// Publish the page for lock-free references.
+	InterlockedExchangePointer((PVOID*)&NoirCvmHandleTable.Pages[NoirCvmHandleTable.PageCount++],Page);
+	return NOIR_SUCCESS;
 }
 
 // Note that this function acquires the lock, so do what you should do to circumvent deadlocking.
 NOIR_STATUS NoirCreateHandle(OUT PCVM_HANDLE Handle,IN PVOID ReferencedEntry)
 {
-	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	NOIR_STATUS st=NOIR_SUCCESS;
 	// Acquire the resource lock in order to add the entry
 	KeEnterCriticalRegion();
 	ExfAcquirePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
-	// Create Handle.
-	st=NoirCreateHandleUnsafe(NoirCvmHandleTable.TableCode,Handle,ReferencedEntry);
-	if(st==NOIR_UNSUCCESSFUL)
-	{
-		// The handle table is full. Increase the table level and retry.
-		ULONG Levels=BYTE_OFFSET((PVOID)NoirCvmHandleTable.TableCode);
-		ULONG_PTR NewBase=(ULONG_PTR)NoirAllocateNonPagedMemory(PAGE_SIZE);
-		if(NewBase)
-		{
-			NoirCvmTracePrint("Adding the level %u table...\n",++Levels);
-			RtlZeroMemory((PVOID)NewBase,PAGE_SIZE);
-			// Make the top-level table to be underlain.
-			*(PULONG_PTR)NewBase=NoirCvmHandleTable.TableCode;
-			NoirCvmHandleTable.TableCode=NewBase|Levels;
-			// Retry creation.
-			st=NoirCreateHandleUnsafe(NoirCvmHandleTable.TableCode,Handle,ReferencedEntry);
-		}
-		else
-		{
-			NoirCvmTracePrint("Failed to increase the level of tables!\n");
-			st=NOIR_INSUFFICIENT_RESOURCES;
-		}
-	}
-	if(st==NOIR_SUCCESS)	// Increment the handle counter if success.
+	// The free list is empty. Expand the table.
+	if(NoirCvmHandleTable.FreeHead==HandleNullIndex)st=NoirExpandHandleTableUnsafe();
+	if(st==NOIR_SUCCESS)
 	{
+		// Pop the first free entry.
+		ULONG32 Index=NoirCvmHandleTable.FreeHead;
+		PNOIR_CVM_HANDLE_ENTRY Entry=NoirGetHandleEntry(Index);
+		NoirCvmHandleTable.FreeHead=Entry->NextFree;
+		InterlockedExchangePointer(&Entry->Object,ReferencedEntry);
+		*Handle=((ULONG64)(ULONG32)Entry->Sequence<<32)|Index;
+		// Increment the handle counter if success.
 		NoirCvmHandleTable.HandleCount++;
 		NoirCvmTracePrint("New VM is created successfully! Handle=0x%p\t Object=0x%p\n",*Handle,ReferencedEntry);
 	}
-	if(*Handle>NoirCvmHandleTable.MaximumHandleValue)
-		NoirCvmHandleTable.MaximumHandleValue=*Handle;
+	else
+		*Handle=0;
 	// Release the resource lock for other accesses.
 	ExfReleasePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
 	KeLeaveCriticalRegion();
 	// Finally, return the status.
 	return st;
 }
-	
 
 // This function does not acquire lock itself.
 // Therefore, acquire the table lock with Exclusive Access prior to invoking this function!
-void NoirDeleteHandleUnsafe(IN CVM_HANDLE Handle,IN ULONG_PTR TableCode)
-{
-	PULONG_PTR Base=(PULONG_PTR)PAGE_ALIGN(TableCode);	// Get the base of current table.
-	ULONG32 Levels=BYTE_OFFSET(TableCode);				// Get the level of current table.
-	// Get the index that should be used on referencing this table.
-	ULONG_PTR RefIndex=(Handle>>(Levels*HandleTableShiftBits))&(HandleTableCapacity-1);
-	// Recurse until we are referencing the lowest level of table.
-	if(!Levels)
-		Base[RefIndex]=0;
-	else
-		NoirDeleteHandleUnsafe(Handle,Base[RefIndex]);
+void NoirDeleteHandleUnsafe(IN CVM_HANDLE Handle)
+{
+	PNOIR_CVM_HANDLE_ENTRY Entry=NoirGetHandleEntry(Handle);
+	if(Entry && (ULONG32)Entry->Sequence==(ULONG32)(Handle>>32))
+	{
+		// Invalidate the handle before the entry is cleared.
+		InterlockedIncrement(&Entry->Sequence);
+		InterlockedExchangePointer(&Entry->Object,NULL);
+		// Push the entry to the free list.
+		Entry->NextFree=NoirCvmHandleTable.FreeHead;
+		NoirCvmHandleTable.FreeHead=(ULONG32)Handle;
+		NoirCvmHandleTable.HandleCount--;
+	}
 }
 
 NOIR_STATUS NoirCreateVirtualMachine(OUT PCVM_HANDLE VirtualMachine)
@@ -224,14 +171,27 @@ NOIR_STATUS NoirReleaseVirtualMachine(IN CVM_HANDLE VirtualMachine)
 	PVOID VM=NULL;
 	KeEnterCriticalRegion();
 	ExfAcquirePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
-	VM=NoirReferenceVirtualMachineByHandleUnsafe(VirtualMachine,NoirCvmHandleTable.TableCode);
+	VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
 	if(VM)
 	{
+		PNOIR_CVM_HANDLE_ENTRY Entry=NoirGetHandleEntry(VirtualMachine);
+		// Invalidate the handle before the VM is released, so that
+		// lock-free references would not resolve to a VM being freed.
+		InterlockedIncrement(&Entry->Sequence);
+		InterlockedExchangePointer(&Entry->Object,NULL);
 		st=nvc_release_vm(VM);
 		if(st==NOIR_SUCCESS)
 		{
+			// Push the entry to the free list.
+			Entry->NextFree=NoirCvmHandleTable.FreeHead;
+			NoirCvmHandleTable.FreeHead=(ULONG32)VirtualMachine;
 			NoirCvmHandleTable.HandleCount--;
-			NoirDeleteHandleUnsafe(VirtualMachine,NoirCvmHandleTable.TableCode);
+		}
+		else
+		{
+			// The VM is not released. Restore the object before the sequence.
+			InterlockedExchangePointer(&Entry->Object,VM);
+			InterlockedDecrement(&Entry->Sequence);
 		}
 	}
 	ExfReleasePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
@@ -258,14 +218,13 @@ NOIR_STATUS NoirDecrementVirtualMachineReference(IN CVM_HANDLE VirtualMachine)
 		{
 			KeEnterCriticalRegion();
 			ExfAcquirePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
-			NoirCvmHandleTable.HandleCount--;
-			NoirDeleteHandleUnsafe(VirtualMachine,NoirCvmHandleTable.TableCode);
+			NoirDeleteHandleUnsafe(VirtualMachine);
 			ExfReleasePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
 			KeLeaveCriticalRegion();
 			NoirHaxRemoveVirtualMachineNotification(VirtualMachine);
 		}
 	}
-	return VM==NULL?st:nvc_deref_vm(VM);
+	return st;
 }
 
 NOIR_STATUS NoirQueryGpaAccessingBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,OUT PVOID Bitmap,IN ULONG32 BitmapSize)
@@ -284,6 +243,14 @@ NOIR_STATUS NoirClearGpaAccessingBits(IN CVM_HANDLE VirtualMachine,IN ULONG64 Gp
 	return st;
 }
 
+NOIR_STATUS NoirQueryGpaDirtyBitmap(IN CVM_HANDLE VirtualMachine,IN ULONG64 GpaStart,IN ULONG32 NumberOfPages,IN OUT PVOID Bitmap,IN ULONG32 BitmapSize,IN BOOLEAN Accumulate)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)st=nvc_query_gpa_dirty_bitmap(VM,GpaStart,NumberOfPages,Bitmap,BitmapSize,Accumulate);
+	return st;
+}
+
 NOIR_STATUS NoirSetMapping(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation)
 {
 	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
@@ -292,6 +259,49 @@ NOIR_STATUS NoirSetMapping(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING
 	return st;
 }
 
+NOIR_STATUS NoirSetMappingBatch(IN CVM_HANDLE VirtualMachine,IN PNOIR_ADDRESS_MAPPING MappingInformation,IN ULONG32 NumberOfRanges)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)st=nvc_set_mapping_batch(VM,MappingInformation,NumberOfRanges);
+	return st;
+}
+
+NOIR_STATUS NoirSetCpuidQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PNOIR_CPUID_QUICKPATH QuickPath)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)
+	{
+		if(VpIndex==NOIR_CPUID_QUICKPATH_FALLBACK)
+			st=nvc_set_cpuid_fallback(VM,(BOOLEAN)QuickPath->Options.Active,QuickPath->Eax,QuickPath->Ebx,QuickPath->Ecx,QuickPath->Edx);
+		else if(VpIndex==NOIR_CPUID_QUICKPATH_VM_WIDE)
+			st=nvc_set_cpuid_quickpath(VM,NULL,QuickPath);
+		else
+		{
+			PVOID VP=nvc_reference_vcpu(VM,VpIndex);
+			st=VP==NULL?NOIR_VCPU_NOT_EXIST:nvc_set_cpuid_quickpath(VM,VP,QuickPath);
+		}
+	}
+	return st;
+}
+
+NOIR_STATUS NoirSetMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN PNOIR_MSR_QUICKPATH QuickPath)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)st=nvc_set_msr_quickpath(VM,QuickPath);
+	return st;
+}
+
+NOIR_STATUS NoirQueryMsrQuickPath(IN CVM_HANDLE VirtualMachine,IN ULONG32 Index,OUT PNOIR_MSR_QUICKPATH QuickPath)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)st=nvc_query_msr_quickpath(VM,Index,QuickPath);
+	return st;
+}
+
 NOIR_STATUS NoirQueryVirtualProcessorStatistics(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize)
 {
 	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
@@ -304,6 +314,18 @@ NOIR_STATUS NoirQueryVirtualProcessorStatistics(IN CVM_HANDLE VirtualMachine,IN
 	return st;
 }
 
+NOIR_STATUS NoirQueryVirtualProcessorExitProfile(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID Buffer,IN ULONG32 BufferSize)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)
+	{
+		PVOID VP=nvc_reference_vcpu(VM,VpIndex);
+		st=VP==NULL?NOIR_VCPU_NOT_EXIST:nvc_query_vcpu_exit_profile(VP,Buffer,BufferSize);
+	}
+	return st;
+}
+
 NOIR_STATUS NoirViewVirtualProcessorRegisters(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN NOIR_CVM_REGISTER_TYPE RegisterType,OUT PVOID Buffer,IN ULONG32 BufferSize)
 {
 	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
@@ -376,6 +398,18 @@ NOIR_STATUS NoirSetVirtualProcessorOptions(IN CVM_HANDLE VirtualMachine,IN ULONG
 	return st;
 }
 
+NOIR_STATUS NoirSetVirtualProcessorControlBlock(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,IN PVOID Vpcb)
+{
+	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
+	PVOID VM=NoirReferenceVirtualMachineByHandle(VirtualMachine);
+	if(VM)
+	{
+		PVOID VP=nvc_reference_vcpu(VM,VpIndex);
+		st=VP==NULL?NOIR_VCPU_NOT_EXIST:nvc_set_vpcb(VP,Vpcb);
+	}
+	return st;
+}
+
 NOIR_STATUS NoirRunVirtualProcessor(IN CVM_HANDLE VirtualMachine,IN ULONG32 VpIndex,OUT PVOID ExitContext)
 {
 	NOIR_STATUS st=NOIR_UNSUCCESSFUL;
@@ -454,17 +488,16 @@ NOIR_STATUS NoirQueryHypervisorStatus(IN ULONG64 StatusType,OUT PVOID Status)
 	return nvc_query_hypervisor_status(StatusType,Status);
 }
 
-// Use recursion to traverse as many levels of tables as possible.
-void NoirFreeHandleTable(ULONG_PTR TableCode)
+NOIR_STATUS NoirQueryHostExitProfile(IN ULONG32 ProcessorNumber,OUT PVOID Buffer,IN ULONG32 BufferSize)
+{
+	return nvc_query_host_exit_profile(ProcessorNumber,Buffer,BufferSize);
+}
+
+void NoirFreeHandleTable()
 {
-	PULONG_PTR Base=PAGE_ALIGN((PVOID)TableCode);
-	ULONG Levels=BYTE_OFFSET((PVOID)TableCode);
-	NoirCvmTracePrint("Freeing %u level(s) of table!\n",Levels);
-	if(Levels)
-		for(ULONG32 i=0;i<HandleTableCapacity;i++)
-			if(Base[i])
-				NoirFreeHandleTable(Base[i]);
-	NoirFreeNonPagedMemory(Base);
+	NoirCvmTracePrint("Freeing %u page(s) of table!\n",NoirCvmHandleTable.PageCount);
+	for(ULONG32 i=0;i<NoirCvmHandleTable.PageCount;i++)
+		NoirFreeNonPagedMemory(NoirCvmHandleTable.Pages[i]);
 }
 
 HANDLE NoirGetVirtualMachineProcessIdByPointer(IN PVOID VirtualMachine)
@@ -481,18 +514,19 @@ void static NoirCreateProcessNotifyRoutine(IN HANDLE ParentId,IN HANDLE ProcessI
 	{
 		KeEnterCriticalRegion();	// Acquire the table resource lock with Exclusive Access.
 		ExfAcquirePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
-		for(CVM_HANDLE Handle=0;Handle<=NoirCvmHandleTable.MaximumHandleValue;Handle++)
+		for(ULONG32 Index=0;Index<(NoirCvmHandleTable.PageCount<<HandleEntryShiftBits);Index++)
 		{
-			PVOID VirtualMachine=NoirReferenceVirtualMachineByHandleUnsafe(Handle,NoirCvmHandleTable.TableCode);
+			PNOIR_CVM_HANDLE_ENTRY Entry=NoirGetHandleEntry(Index);
+			PVOID VirtualMachine=Entry->Object;
 			if(VirtualMachine)
 			{
+				CVM_HANDLE Handle=((ULONG64)(ULONG32)Entry->Sequence<<32)|Index;
 				HANDLE Pid=NoirGetVirtualMachineProcessIdByPointer(VirtualMachine);
 				if(Pid==ProcessId)
 				{
 					NoirCvmTracePrint("[Handle Recycle] Terminated PID=%u has created CVM Handle=%llu! Terminating VM...\n",(ULONG)Pid,Handle);
 					nvc_release_vm(VirtualMachine);
-					NoirCvmHandleTable.HandleCount--;
-					NoirDeleteHandleUnsafe(Handle,NoirCvmHandleTable.TableCode);
+					NoirDeleteHandleUnsafe(Handle);
 					NoirHaxRemoveVirtualMachineNotification(Handle);
 				}
 			}
@@ -505,7 +539,7 @@ void static NoirCreateProcessNotifyRoutine(IN HANDLE ParentId,IN HANDLE ProcessI
 NTSTATUS NoirFinalizeCvmModule()
 {
 	NTSTATUS st=PsSetCreateProcessNotifyRoutine(NoirCreateProcessNotifyRoutine,TRUE);
-	if(NT_SUCCESS(st))NoirFreeHandleTable(NoirCvmHandleTable.TableCode);
+	if(NT_SUCCESS(st))NoirFreeHandleTable();
 	return st;
 }
 
@@ -522,15 +556,13 @@ NTSTATUS NoirInitializeCvmModule()
 			NoirCvmTracePrint("Failed to locate ZwQueryVirtualMemory!\n");
 		else
 		{
-			PVOID TableBase=NoirAllocateNonPagedMemory(PAGE_SIZE);
-			if(TableBase)
+			// At initialization, leave only one page of table.
+			NoirCvmHandleTable.FreeHead=HandleNullIndex;
+			if(NoirExpandHandleTableUnsafe()==NOIR_SUCCESS)
 			{
-				RtlZeroMemory(TableBase,PAGE_SIZE);
-				// At initialization, leave only one level of table.
-				NoirCvmHandleTable.TableCode=(ULONG_PTR)TableBase;
 				// Register a processor creation callback to recycle VMs.
 				st=PsSetCreateProcessNotifyRoutine(NoirCreateProcessNotifyRoutine,FALSE);
-				if(NT_ERROR(st))NoirFreeNonPagedMemory(TableBase);
+				if(NT_ERROR(st))NoirFreeHandleTable();
 			}
 			else
 				st=STATUS_INSUFFICIENT_RESOURCES;
@@ -247,6 +247,19 @@ void NoirFreeLoggerBuffer(IN PVOID Buffer)
 #endif
 }
 
+void NoirPrintTraceRecord(IN ULONG32 ProcessorId,IN ULONG64 Timestamp,IN PCSTR Text)
+{
+	DbgPrintEx(DPFLTR_IHVDRIVER_ID,DPFLTR_INFO_LEVEL,"[NoirVisor - Trace | Core %03u | TSC %llu] %s",ProcessorId,Timestamp,Text);
+}
+
+void NoirDrainTraceRing(IN ULONG32 ProcessorId)
+{
+	ULONG64 DroppedCount;
+	nvd_trace_flush(ProcessorId,NoirPrintTraceRecord);
+	DroppedCount=nvd_trace_query_dropped(ProcessorId);
+	if(DroppedCount)DbgPrintEx(DPFLTR_IHVDRIVER_ID,DPFLTR_ERROR_LEVEL,"[NoirVisor - Trace | Core %03u | Panic] There are %llu trace records dropped!\n",ProcessorId,DroppedCount);
+}
+
 void NoirAsyncDebugLogThreadWorker(IN PVOID StartContext)
 {
 	PNOIR_ASYNC_DEBUG_LOG_MONITOR LogMonitor=(PNOIR_ASYNC_DEBUG_LOG_MONITOR)StartContext;
@@ -284,6 +297,8 @@ void NoirAsyncDebugLogThreadWorker(IN PVOID StartContext)
 		LogMonitor->RecordCount=0;
 		// Turn on interrupts to sleep properly.
 		_enable();
+		// Drain the binary trace ring of this processor and format the records here.
+		NoirDrainTraceRing(LogMonitor->ProcessorId);
 		// Sleep.
 		KeDelayExecutionThread(KernelMode,TRUE,&Delay);
 	}
@@ -313,12 +328,16 @@ void NoirFinalizeAsyncDebugPrinter()
 		}
 		NoirFreeLoggerBuffer(NoirAsyncDebugLogger);
 	}
+	// Drainers are all joined. It is safe to release the trace rings now.
+	nvd_trace_finalize();
 }
 
 NTSTATUS NoirInitializeAsyncDebugPrinter()
 {
 	NTSTATUS st=STATUS_INSUFFICIENT_RESOURCES;
 	ULONG NumberOfProcessors=KeQueryActiveProcessorCount(NULL);
+	// Trace rings are drained by the asynchronous logger threads.
+	if(nvd_trace_initialize()!=STATUS_SUCCESS)return st;
 	NoirAsyncDebugLogger=NoirAllocateLoggerBuffer(sizeof(NOIR_ASYNC_DEBUG_LOG_MONITOR)*NumberOfProcessors);
 	if(NoirAsyncDebugLogger)
 	{
@@ -410,6 +429,67 @@ void noir_generic_call(noir_broadcast_worker worker,void* context)
 	}
 }
 
+// The kick DPC does nothing. Its interrupt is what forces the target processor out of guest mode.
+void static NoirKickDpcRT(IN PKDPC Dpc,IN PVOID DeferedContext OPTIONAL,IN PVOID SystemArgument1 OPTIONAL,IN PVOID SystemArgument2 OPTIONAL)
+{
+	UNREFERENCED_PARAMETER(Dpc);
+	UNREFERENCED_PARAMETER(DeferedContext);
+	UNREFERENCED_PARAMETER(SystemArgument1);
+	UNREFERENCED_PARAMETER(SystemArgument2);
+}
+
+void NoirFinalizeProcessorKicks()
+{
+	if(NoirProcessorKickDpc)
+	{
+		// Wait for queued kicks to be retired before releasing their DPC objects.
+		KeFlushQueuedDpcs();
+		NoirFreeNonPagedMemory(NoirProcessorKickDpc);
+		NoirProcessorKickDpc=NULL;
+		NoirProcessorKickCount=0;
+	}
+}
+
+NTSTATUS NoirInitializeProcessorKicks()
+{
+	ULONG32 Num=noir_get_processor_count();
+	// DPCs are preallocated so that kicking a processor does not allocate memory.
+	NoirProcessorKickDpc=NoirAllocateNonPagedMemory(Num*sizeof(KDPC));
+	if(NoirProcessorKickDpc==NULL)return STATUS_INSUFFICIENT_RESOURCES;
+	for(ULONG i=0;i<Num;i++)
+	{
+		// Processor indices are system-wide. Convert them into group-relative numbers.
+		PROCESSOR_NUMBER Pn;
+		NTSTATUS st=KeGetProcessorNumberFromIndex(i,&Pn);
+		if(NT_ERROR(st))
+		{
+			NoirFreeNonPagedMemory(NoirProcessorKickDpc);
+			NoirProcessorKickDpc=NULL;
+			return st;
+		}
+		KeInitializeDpc(&NoirProcessorKickDpc[i],NoirKickDpcRT,NULL);
+		st=KeSetTargetProcessorDpcEx(&NoirProcessorKickDpc[i],&Pn);
+		if(NT_ERROR(st))
+		{
+			NoirFreeNonPagedMemory(NoirProcessorKickDpc);
+			NoirProcessorKickDpc=NULL;
+			return st;
+		}
+		// A high-importance DPC targeting a remote processor is delivered by an IPI.
+		KeSetImportanceDpc(&NoirProcessorKickDpc[i],HighImportance);
+	}
+	NoirProcessorKickCount=Num;
+	return STATUS_SUCCESS;
+}
+
+BOOLEAN noir_kick_processor(IN ULONG32 ProcessorNumber)
+{
+	// If the DPC is already queued, the pending interrupt will do the kick.
+	if(ProcessorNumber<NoirProcessorKickCount)
+		return KeInsertQueueDpc(&NoirProcessorKickDpc[ProcessorNumber],NULL,NULL);
+	return FALSE;
+}
+
 NTSTATUS NoirCopyAcpiTableRootFromRegistry(OUT PVOID *Rsdt,OUT PSIZE_T Length)
 {
 	NTSTATUS st=STATUS_INSUFFICIENT_RESOURCES;
@@ -594,6 +674,12 @@ void noir_get_locked_range(PMDL Mdl,void** virt,PULONG bytes)
 	*bytes=MmGetMdlByteCount(Mdl);
 }
 
+void* noir_map_locked_pages(PMDL Mdl)
+{
+	// The system-space mapping is released along with the MDL.
+	return MmGetSystemAddressForMdlSafe(Mdl,NormalPagePriority|MdlMappingNoExecute);
+}
+
 void noir_unlock_pages(PMDL Mdl)
 {
 	MmUnlockPages(Mdl);
@@ -721,18 +807,53 @@ void noir_free_2mb_page(void* virtual_address)
 	MmFreeContiguousMemorySpecifyCache(virtual_address,0x200000,MmCached);
 }
 
-/*
 // NoirVisor should be aware of large-scale systems with NUMA.
-void* noir_alloc_contd_memory_for_numa(ULONG32 numa_node,ULONG64 alignment,size_t length)
+void* noir_alloc_contd_memory_for_numa(ULONG32 numa_node,size_t length)
 {
 	PHYSICAL_ADDRESS L={0};
-	PHYSICAL_ADDRESS H={0xFFFFFFFFFFFFFFFFui64};
-	PHYSICAL_ADDRESS B={alignment};
+	PHYSICAL_ADDRESS H={0xFFFFFFFFFFFFFFFF};
+	PHYSICAL_ADDRESS B={0};
+	// The preferred node is not mandatory. Memory Manager falls back to other nodes.
 	PVOID p=MmAllocateContiguousMemorySpecifyCacheNode(length,L,H,B,MmCached,numa_node);
-	if(p)RtlZeroMemory(p,length);
+	if(p)
+	{
+		RtlZeroMemory(p,length);
+		InterlockedIncrement(&NoirAllocatedContiguousMemoryCount);
+	}
 	return p;
 }
-*/
+
+void* noir_alloc_nonpg_memory_for_numa(ULONG32 numa_node,size_t length)
+{
+#if _MSC_FULL_VER>192829913
+	POOL_EXTENDED_PARAMETER Param={0};
+	PVOID p;
+	Param.Type=PoolExtendedParameterNumaNode;
+	Param.PreferredNode=numa_node;
+	p=ExAllocatePool3(POOL_FLAG_NON_PAGED_EXECUTE,length,'pNvN',&Param,1);
+	if(p)InterlockedIncrement(&NoirAllocatedNonPagedPools);
+	return p;
+#else
+	return NoirAllocateNonPagedMemory(length);
+#endif
+}
+
+ULONG32 noir_get_processor_numa_node(ULONG32 processor_number)
+{
+	PROCESSOR_NUMBER Pn;
+	if(NT_SUCCESS(KeGetProcessorNumberFromIndex(processor_number,&Pn)))
+	{
+		USHORT HighestNode=KeQueryHighestNodeNumber();
+		for(USHORT i=0;i<=HighestNode;i++)
+		{
+			GROUP_AFFINITY Affinity;
+			USHORT Count;
+			KeQueryNodeActiveAffinity(i,&Affinity,&Count);
+			if(Affinity.Group==Pn.Group && _bittest64((LONG64*)&Affinity.Mask,Pn.Number))return i;
+		}
+	}
+	return 0;
+}
 
 void noir_enum_physical_memory_ranges(IN NOIR_PHYSICAL_MEMORY_RANGE_CALLBACK CallbackRoutine,IN OUT PVOID Context)
 {
@@ -863,6 +984,19 @@ BOOLEAN noir_alert_thread(IN HANDLE ThreadHandle)
 	return st==STATUS_SUCCESS;
 }
 
+// Pin the current thread to the specified processor.
+void noir_set_thread_affinity(IN ULONG32 ProcessorNumber)
+{
+	PROCESSOR_NUMBER Pn;
+	GROUP_AFFINITY Affinity={0};
+	if(KeGetProcessorNumberFromIndex(ProcessorNumber,&Pn)==STATUS_SUCCESS)
+	{
+		Affinity.Group=Pn.Group;
+		Affinity.Mask=(KAFFINITY)1<<Pn.Number;
+		KeSetSystemGroupAffinityThread(&Affinity,NULL);
+	}
+}
+
 // Sleep
 void noir_sleep(IN ULONG64 ms)
 {
@@ -871,6 +1005,24 @@ void noir_sleep(IN ULONG64 ms)
 	KeDelayExecutionThread(KernelMode,TRUE,&Time);
 }
 
+// Calibrate TSC frequency against the performance counter.
+ULONG64 noir_query_tsc_frequency()
+{
+	LARGE_INTEGER Frequency,Start,End;
+	ULONG64 TscStart,TscEnd;
+	KIRQL OldIrql;
+	// Prevent the thread from migrating to another processor during calibration.
+	KeRaiseIrql(DISPATCH_LEVEL,&OldIrql);
+	Start=KeQueryPerformanceCounter(&Frequency);
+	TscStart=__rdtsc();
+	KeStallExecutionProcessor(10000);
+	End=KeQueryPerformanceCounter(NULL);
+	TscEnd=__rdtsc();
+	KeLowerIrql(OldIrql);
+	if(End.QuadPart<=Start.QuadPart)return 0;
+	return (TscEnd-TscStart)*Frequency.QuadPart/(End.QuadPart-Start.QuadPart);
+}
+
 // Resource Lock (R/W Lock)
 PERESOURCE noir_initialize_reslock()
 {
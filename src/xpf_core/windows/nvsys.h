@@ -134,6 +134,7 @@ typedef struct _NOIR_ASYNC_DEBUG_LOG_MONITOR
 	PNOIR_DEBUG_LOG_RECORD LogInfo;
 }NOIR_ASYNC_DEBUG_LOG_MONITOR,*PNOIR_ASYNC_DEBUG_LOG_MONITOR;
 
+typedef void(*NOIR_TRACE_OUTPUT_ROUTINE)(IN ULONG32 ProcessorId,IN ULONG64 Timestamp,IN PCSTR Text);
 typedef void(*noir_broadcast_worker)(void* context,ULONG ProcessorNumber);
 typedef LONG(__cdecl *noir_sorting_comparator)(const void* a,const void*b);
 
@@ -153,8 +154,14 @@ BYTE NoirGetInstructionLength16(PBYTE Code,SIZE_T CodeLength);
 BYTE NoirGetInstructionLength32(PBYTE Code,SIZE_T CodeLength);
 BYTE NoirGetInstructionLength64(PBYTE Code,SIZE_T CodeLength);
 NTSTATUS NoirGetPageInformation(IN PVOID PageAddress,OUT PMEMORY_WORKING_SET_EX_BLOCK Information);
+ULONG32 nvd_trace_initialize();
+void nvd_trace_finalize();
+ULONG32 nvd_trace_flush(IN ULONG32 ProcessorId,IN NOIR_TRACE_OUTPUT_ROUTINE OutputRoutine);
+ULONG64 nvd_trace_query_dropped(IN ULONG32 ProcessorId);
 
 PNOIR_ASYNC_DEBUG_LOG_MONITOR NoirAsyncDebugLogger=NULL;
+PKDPC NoirProcessorKickDpc=NULL;
+ULONG32 NoirProcessorKickCount=0;
 
 PVOID NoirHostArrayIDT=NULL;
 
@@ -295,6 +295,7 @@ NTSTATUS NoirQueryEnabledFeaturesInSystem(OUT PULONG64 Features)
 	ULONG32 NestedVirtualization=0;			// Disable Nested Virtualization at default.
 	ULONG32 HideFromProcessorTrace=0;		// Do not hide from Intel Processor Trace at default.
 	ULONG32 SecureVirtualization=0;			// Disable Secure Virtualization at default.
+	ULONG32 ExitProfiler=0;					// Disable Exit Profiler at default.
 	BOOLEAN KvaShadowPresence=NoirDetectKvaShadow();
 	// Initialize.
 	NTSTATUS st=STATUS_INSUFFICIENT_RESOURCES;
@@ -340,6 +341,11 @@ NTSTATUS NoirQueryEnabledFeaturesInSystem(OUT PULONG64 Features)
 			st=ZwQueryValueKey(hKey,&uniKvName,KeyValuePartialInformation,KvPartInf,PAGE_SIZE,&RetLen);
 			if(NT_SUCCESS(st))SecureVirtualization=*(PULONG32)KvPartInf->Data;
 			NoirDebugPrint("Secure Virtualization is %s!\n",SecureVirtualization?"enabled":"disabled");
+			// Detect if Exit Profiler is enabled.
+			RtlInitUnicodeString(&uniKvName,L"ExitProfiler");
+			st=ZwQueryValueKey(hKey,&uniKvName,KeyValuePartialInformation,KvPartInf,PAGE_SIZE,&RetLen);
+			if(NT_SUCCESS(st))ExitProfiler=*(PULONG32)KvPartInf->Data;
+			NoirDebugPrint("Exit Profiler is %s!\n",ExitProfiler?"enabled":"disabled");
 			// Close the registry key handle.
 			ZwClose(hKey);
 		}
@@ -353,6 +359,7 @@ NTSTATUS NoirQueryEnabledFeaturesInSystem(OUT PULONG64 Features)
 	*Features|=KvaShadowPresence<<NOIR_HVM_FEATURE_KVA_SHADOW_PRESENCE_BIT;
 	*Features|=(HideFromProcessorTrace!=0)<<NOIR_HVM_FEATURE_HIDE_FROM_IPT_BIT;
 	*Features|=(SecureVirtualization!=0)<<NOIR_HVM_FEATURE_SECURE_VIRTUALIZATION_BIT;
+	*Features|=(ExitProfiler!=0)<<NOIR_HVM_FEATURE_EXIT_PROFILER_BIT;
 	return st;
 }
 
@@ -410,27 +417,31 @@ NTSTATUS NoirGetSystemVersion(OUT PWSTR VersionString,IN ULONG VersionLength)
 
 ULONG NoirBuildHypervisor()
 {
+	ULONG r=0;
+	noir_acquire_pushlock_exclusive(&NoirHypervisorStateLock);
 	if(NoirHypervisorStarted==FALSE)
 	{
-		ULONG r=nvc_build_hypervisor();
+		r=nvc_build_hypervisor();
 		if(r==0)
 		{
 			NoirHypervisorStarted=TRUE;
 			NoirDebugPrint("NoirVisor CVM Initialization Status: 0x%X\n",NoirInitializeCvmModule());
 		}
-		return r;
 	}
-	return 0;
+	noir_release_pushlock_exclusive(&NoirHypervisorStateLock);
+	return r;
 }
 
 void NoirTeardownHypervisor()
 {
+	noir_acquire_pushlock_exclusive(&NoirHypervisorStateLock);
 	if(NoirHypervisorStarted)
 	{
 		NoirFinalizeCvmModule();
 		nvc_teardown_hypervisor();
 		NoirHypervisorStarted=FALSE;
 	}
+	noir_release_pushlock_exclusive(&NoirHypervisorStateLock);
 }
 
 ULONG NoirVisorVersion()
@@ -538,6 +549,12 @@ void NoirFinalizeCodeIntegrity()
 	noir_finalize_ci();
 }
 
+// Returns the latency of the slowest full sweep of Software CI, in units of 100ns.
+ULONG64 NoirQueryCodeIntegrityLatency()
+{
+	return noir_ci_query_sweep_latency();
+}
+
 void static NoirPowerStateCallback(IN PVOID CallbackContext,IN PVOID Argument1,IN PVOID Argument2)
 {
 	if(Argument1==(PVOID)PO_CB_SYSTEM_STATE_LOCK)
@@ -547,7 +564,10 @@ void static NoirPowerStateCallback(IN PVOID CallbackContext,IN PVOID Argument1,I
 			// System is resuming from sleeping or hibernating.
 			// Restart the hypervisor.
 			NoirBuildHookedPages();
+			noir_acquire_pushlock_exclusive(&NoirHypervisorStateLock);
 			if(NoirHypervisorStarted)nvc_build_hypervisor();
+			NoirHypervisorSuspended=FALSE;
+			noir_release_pushlock_exclusive(&NoirHypervisorStateLock);
 		}
 		else
 		{
@@ -555,7 +575,10 @@ void static NoirPowerStateCallback(IN PVOID CallbackContext,IN PVOID Argument1,I
 			// This will trigger VM-Exit of Processor Power.
 			// Things will be complex before hypervisor is stopped.
 			// So we stop hypervisor before system power state changes.
+			noir_acquire_pushlock_exclusive(&NoirHypervisorStateLock);
 			if(NoirHypervisorStarted)nvc_teardown_hypervisor();
+			NoirHypervisorSuspended=TRUE;
+			noir_release_pushlock_exclusive(&NoirHypervisorStateLock);
 			NoirTeardownHookedPages();
 		}
 	}
@@ -585,4 +608,75 @@ NTSTATUS NoirInitializePowerStateCallback()
 		ObDereferenceObject(pCallback);
 	}
 	return st;
+}
+
+// Physical memory hot-add updates the registry resource map. Recapture the cached memory map upon changes.
+void static NoirMemoryChangeWorker(IN PVOID StartContext)
+{
+	HANDLE hKey=(HANDLE)StartContext;
+	IO_STATUS_BLOCK IoStatus;
+	PVOID WaitObjects[2]={&NoirMemoryChangeStopEvent,NULL};
+	while(1)
+	{
+		HANDLE hEvent=NULL;
+		OBJECT_ATTRIBUTES oa;
+		NTSTATUS st;
+		InitializeObjectAttributes(&oa,NULL,OBJ_KERNEL_HANDLE,NULL,NULL);
+		st=ZwCreateEvent(&hEvent,EVENT_ALL_ACCESS,&oa,SynchronizationEvent,FALSE);
+		if(NT_ERROR(st))break;
+		st=ObReferenceObjectByHandle(hEvent,SYNCHRONIZE,*ExEventObjectType,KernelMode,&WaitObjects[1],NULL);
+		if(NT_SUCCESS(st))
+		{
+			st=ZwNotifyChangeKey(hKey,hEvent,NULL,NULL,&IoStatus,REG_NOTIFY_CHANGE_LAST_SET,FALSE,NULL,0,TRUE);
+			if(NT_SUCCESS(st))st=KeWaitForMultipleObjects(2,WaitObjects,WaitAny,Executive,KernelMode,FALSE,NULL,NULL);
+			ObDereferenceObject(WaitObjects[1]);
+		}
+		ZwClose(hEvent);
+		if(st!=STATUS_WAIT_1)break;
+		// Hold the state lock so that the hypervisor would not be torn down during the refresh.
+		noir_acquire_pushlock_exclusive(&NoirHypervisorStateLock);
+		if(NoirHypervisorStarted && !NoirHypervisorSuspended)
+		{
+			NoirDebugPrint("Physical memory layout is changed! Recapturing memory map...\n");
+			st=nvc_refresh_physical_memory_map();
+			if(st)NoirDebugPrint("Failed to refresh the physical memory map! Status=0x%X\n",st);
+		}
+		noir_release_pushlock_exclusive(&NoirHypervisorStateLock);
+	}
+	// Closing the key cancels the pending notification, if any.
+	ZwClose(hKey);
+	PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+void NoirFinalizeMemoryChangeCallback()
+{
+	if(NoirMemoryChangeThread)
+	{
+		KeSetEvent(&NoirMemoryChangeStopEvent,IO_NO_INCREMENT,FALSE);
+		ZwWaitForSingleObject(NoirMemoryChangeThread,FALSE,NULL);
+		ZwClose(NoirMemoryChangeThread);
+		NoirMemoryChangeThread=NULL;
+	}
+}
+
+NTSTATUS NoirInitializeMemoryChangeCallback()
+{
+	HANDLE hKey=NULL;
+	UNICODE_STRING uniKeyName=RTL_CONSTANT_STRING(L"\\Registry\\Machine\\Hardware\\RESOURCEMAP\\System Resources\\Physical Memory");
+	OBJECT_ATTRIBUTES oa;
+	NTSTATUS st;
+	InitializeObjectAttributes(&oa,&uniKeyName,OBJ_CASE_INSENSITIVE|OBJ_KERNEL_HANDLE,NULL,NULL);
+	st=ZwOpenKey(&hKey,KEY_NOTIFY,&oa);
+	if(NT_SUCCESS(st))
+	{
+		KeInitializeEvent(&NoirMemoryChangeStopEvent,NotificationEvent,FALSE);
+		InitializeObjectAttributes(&oa,NULL,OBJ_KERNEL_HANDLE,NULL,NULL);
+		st=PsCreateSystemThread(&NoirMemoryChangeThread,SYNCHRONIZE,&oa,NULL,NULL,NoirMemoryChangeWorker,hKey);
+		if(NT_ERROR(st))
+		{
+			NoirMemoryChangeThread=NULL;
+			ZwClose(hKey);
+		}
+	}
+	return st;
 }
\ No newline at end of file
@@ -32,6 +32,7 @@
 #define NOIR_HVM_FEATURE_KVA_SHADOW_PRESENCE	0x20
 #define NOIR_HVM_FEATURE_HIDE_FROM_IPT			0x40
 #define NOIR_HVM_FEATURE_SECURE_VIRTUALIZATION	0x80
+#define NOIR_HVM_FEATURE_EXIT_PROFILER			0x200
 
 #define NOIR_HVM_FEATURE_STEALTH_MSR_HOOK_BIT		0
 #define NOIR_HVM_FEATURE_STEALTH_INLINE_HOOK_BIT	1
@@ -40,6 +41,7 @@
 #define NOIR_HVM_FEATURE_KVA_SHADOW_PRESENCE_BIT	5
 #define NOIR_HVM_FEATURE_HIDE_FROM_IPT_BIT			6
 #define NOIR_HVM_FEATURE_SECURE_VIRTUALIZATION_BIT	7
+#define NOIR_HVM_FEATURE_EXIT_PROFILER_BIT			9
 
 typedef union _HV_MSR_PROPRIETARY_GUEST_OS_ID
 {
@@ -130,6 +132,9 @@ void NoirTeardownHookedPages();
 void __cdecl NoirDebugPrint(const char* Format,...);
 ULONG nvc_build_hypervisor();
 void nvc_teardown_hypervisor();
+ULONG nvc_refresh_physical_memory_map();
+void noir_acquire_pushlock_exclusive(IN PEX_PUSH_LOCK PushLock);
+void noir_release_pushlock_exclusive(IN PEX_PUSH_LOCK PushLock);
 ULONG noir_configure_serial_port_debugger(IN BYTE PortNumber,IN USHORT PortBase,IN ULONG32 BaudRate);
 ULONG noir_configure_qemu_debug_console(IN USHORT Port);
 ULONG nvc_acpi_initialize();
@@ -143,10 +148,15 @@ BOOLEAN noir_initialize_ci(BOOLEAN soft_ci,BOOLEAN hard_ci);
 BOOLEAN noir_add_section_to_ci(PVOID base,ULONG32 size,BOOLEAN enable_scan);
 BOOLEAN noir_activate_ci();
 void noir_finalize_ci();
+ULONG64 noir_ci_query_sweep_latency();
 
 GUID EfiNoirVisorVendorGuid={0x2B1F2A1E,0xDBDF,0x44AC,0xDA,0xBC,0xC7,0xA1,0x30,0xE2,0xE7,0x1E};
 
 BOOLEAN NoirHypervisorStarted=FALSE;
+BOOLEAN NoirHypervisorSuspended=FALSE;
+EX_PUSH_LOCK NoirHypervisorStateLock=0;
 PVOID NoirPowerCallbackObject=NULL;
+HANDLE NoirMemoryChangeThread=NULL;
+KEVENT NoirMemoryChangeStopEvent;
 PVOID NvImageBase=NULL;
 ULONG NvImageSize=0;
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file implements the MSVC intrinsics used by NoirVisor with GCC
+  builtins, so that hypervisor sources could be tested in user mode.
+  Privileged intrinsics terminate the test if they are ever reached.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/intrin.h
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <x86intrin.h>
+#include <cpuid.h>
+
+void nvtest_privileged(const char* name);
+
+// Bit-Test Instructions
+static inline unsigned char _bittest(const volatile void* a,long b)
+{
+	return (((const volatile int*)a)[b>>5]>>(b&31))&1;
+}
+
+static inline unsigned char _bittestandset(void* a,long b)
+{
+	volatile int* p=&((volatile int*)a)[b>>5];
+	const unsigned char r=(*p>>(b&31))&1;
+	*p|=1u<<(b&31);
+	return r;
+}
+
+static inline unsigned char _bittestandreset(void* a,long b)
+{
+	volatile int* p=&((volatile int*)a)[b>>5];
+	const unsigned char r=(*p>>(b&31))&1;
+	*p&=~(1u<<(b&31));
+	return r;
+}
+
+static inline unsigned char _bittestandcomplement(void* a,long b)
+{
+	volatile int* p=&((volatile int*)a)[b>>5];
+	const unsigned char r=(*p>>(b&31))&1;
+	*p^=1u<<(b&31);
+	return r;
+}
+
+static inline unsigned char _bittest64(const volatile void* a,long long b)
+{
+	return (((const volatile long long*)a)[b>>6]>>(b&63))&1;
+}
+
+static inline unsigned char _bittestandset64(void* a,long long b)
+{
+	volatile long long* p=&((volatile long long*)a)[b>>6];
+	const unsigned char r=(*p>>(b&63))&1;
+	*p|=1LL<<(b&63);
+	return r;
+}
+
+static inline unsigned char _bittestandreset64(void* a,long long b)
+{
+	volatile long long* p=&((volatile long long*)a)[b>>6];
+	const unsigned char r=(*p>>(b&63))&1;
+	*p&=~(1LL<<(b&63));
+	return r;
+}
+
+static inline unsigned char _bittestandcomplement64(void* a,long long b)
+{
+	volatile long long* p=&((volatile long long*)a)[b>>6];
+	const unsigned char r=(*p>>(b&63))&1;
+	*p^=1LL<<(b&63);
+	return r;
+}
+
+// Bit-Scan Instructions
+static inline unsigned char _BitScanForward(void* index,unsigned int mask)
+{
+	if(mask==0)return 0;
+	*(unsigned int*)index=__builtin_ctz(mask);
+	return 1;
+}
+
+static inline unsigned char _BitScanReverse(void* index,unsigned int mask)
+{
+	if(mask==0)return 0;
+	*(unsigned int*)index=31-__builtin_clz(mask);
+	return 1;
+}
+
+static inline unsigned char _BitScanForward64(void* index,unsigned long long mask)
+{
+	if(mask==0)return 0;
+	*(unsigned int*)index=__builtin_ctzll(mask);
+	return 1;
+}
+
+static inline unsigned char _BitScanReverse64(void* index,unsigned long long mask)
+{
+	if(mask==0)return 0;
+	*(unsigned int*)index=63-__builtin_clzll(mask);
+	return 1;
+}
+
+// Atomic Operations. Like MSVC, bitwise operations return the original value.
+#define _InterlockedAdd(p,v)					__atomic_add_fetch((p),(v),__ATOMIC_SEQ_CST)
+#define _InterlockedIncrement(p)				__atomic_add_fetch((p),1,__ATOMIC_SEQ_CST)
+#define _InterlockedDecrement(p)				__atomic_sub_fetch((p),1,__ATOMIC_SEQ_CST)
+#define _InterlockedAnd(p,v)					__atomic_fetch_and((p),(v),__ATOMIC_SEQ_CST)
+#define _InterlockedOr(p,v)						__atomic_fetch_or((p),(v),__ATOMIC_SEQ_CST)
+#define _InterlockedXor(p,v)					__atomic_fetch_xor((p),(v),__ATOMIC_SEQ_CST)
+#define _InterlockedExchange(p,v)				__atomic_exchange_n((p),(v),__ATOMIC_SEQ_CST)
+#define _InterlockedCompareExchange(p,x,c)		__sync_val_compare_and_swap((p),(c),(x))
+#define _InterlockedAdd64						_InterlockedAdd
+#define _InterlockedIncrement64					_InterlockedIncrement
+#define _InterlockedDecrement64					_InterlockedDecrement
+#define _InterlockedAnd64						_InterlockedAnd
+#define _InterlockedOr64						_InterlockedOr
+#define _InterlockedXor64						_InterlockedXor
+#define _InterlockedExchange64					_InterlockedExchange
+#define _InterlockedCompareExchange64			_InterlockedCompareExchange
+#define _InterlockedExchangePointer				_InterlockedExchange
+#define _InterlockedCompareExchangePointer		_InterlockedCompareExchange
+
+static inline unsigned char _interlockedbittestandset(volatile void* a,long b)
+{
+	return (__atomic_fetch_or(&((volatile int*)a)[b>>5],1u<<(b&31),__ATOMIC_SEQ_CST)>>(b&31))&1;
+}
+
+static inline unsigned char _interlockedbittestandreset(volatile void* a,long b)
+{
+	return (__atomic_fetch_and(&((volatile int*)a)[b>>5],~(1u<<(b&31)),__ATOMIC_SEQ_CST)>>(b&31))&1;
+}
+
+static inline unsigned char _interlockedbittestandset64(volatile void* a,long long b)
+{
+	return (__atomic_fetch_or(&((volatile long long*)a)[b>>6],1LL<<(b&63),__ATOMIC_SEQ_CST)>>(b&63))&1;
+}
+
+static inline unsigned char _interlockedbittestandreset64(volatile void* a,long long b)
+{
+	return (__atomic_fetch_and(&((volatile long long*)a)[b>>6],~(1LL<<(b&63)),__ATOMIC_SEQ_CST)>>(b&63))&1;
+}
+
+// String Instructions
+static inline void __stosb(void* d,unsigned char v,size_t n){for(size_t i=0;i<n;i++)((volatile unsigned char*)d)[i]=v;}
+static inline void __stosw(void* d,unsigned short v,size_t n){for(size_t i=0;i<n;i++)((unsigned short*)d)[i]=v;}
+static inline void __stosd(void* d,unsigned int v,size_t n){for(size_t i=0;i<n;i++)((unsigned int*)d)[i]=v;}
+static inline void __stosq(void* d,unsigned long long v,size_t n){for(size_t i=0;i<n;i++)((unsigned long long*)d)[i]=v;}
+static inline void __movsb(void* d,const void* s,size_t n){__builtin_memmove(d,s,n);}
+static inline void __movsw(void* d,const void* s,size_t n){__builtin_memmove(d,s,n*2);}
+static inline void __movsd(void* d,const void* s,size_t n){__builtin_memmove(d,s,n*4);}
+static inline void __movsq(void* d,const void* s,size_t n){__builtin_memmove(d,s,n*8);}
+
+// Miscellaneous Instructions
+static inline void __nop(){__asm__ volatile("nop");}
+static inline void __debugbreak(){__builtin_trap();}
+
+// Privileged Instructions are not available in user mode.
+#define nvtest_privileged_fn(t,n)		static inline t n(){nvtest_privileged(#n);return (t)0;}
+#define nvtest_privileged_fn1(t,n,a)	static inline t n(a x){(void)x;nvtest_privileged(#n);return (t)0;}
+#define nvtest_privileged_fn2(t,n,a,b)	static inline t n(a x,b y){(void)x;(void)y;nvtest_privileged(#n);return (t)0;}
+nvtest_privileged_fn(unsigned long long,__readcr0)
+nvtest_privileged_fn(unsigned long long,__readcr2)
+nvtest_privileged_fn(unsigned long long,__readcr3)
+nvtest_privileged_fn(unsigned long long,__readcr4)
+nvtest_privileged_fn(unsigned long long,__readcr8)
+nvtest_privileged_fn1(int,__writecr0,unsigned long long)
+nvtest_privileged_fn1(int,__writecr3,unsigned long long)
+nvtest_privileged_fn1(int,__writecr4,unsigned long long)
+nvtest_privileged_fn1(int,__writecr8,unsigned long long)
+nvtest_privileged_fn1(unsigned long long,__readdr,unsigned int)
+nvtest_privileged_fn2(int,__writedr,unsigned int,unsigned long long)
+nvtest_privileged_fn1(unsigned long long,__readmsr,unsigned int)
+nvtest_privileged_fn2(int,__writemsr,unsigned int,unsigned long long)
+nvtest_privileged_fn1(int,__sidt,void*)
+nvtest_privileged_fn1(int,__lidt,void*)
+nvtest_privileged_fn1(unsigned char,__inbyte,unsigned short)
+nvtest_privileged_fn1(unsigned short,__inword,unsigned short)
+nvtest_privileged_fn1(unsigned int,__indword,unsigned short)
+nvtest_privileged_fn2(int,__outbyte,unsigned short,unsigned char)
+nvtest_privileged_fn2(int,__outword,unsigned short,unsigned short)
+nvtest_privileged_fn2(int,__outdword,unsigned short,unsigned int)
+nvtest_privileged_fn1(int,__invlpg,void*)
+nvtest_privileged_fn(int,_disable)
+nvtest_privileged_fn(int,_enable)
+nvtest_privileged_fn(int,__int2c)
+nvtest_privileged_fn(int,__ud2)
+nvtest_privileged_fn(int,__wbinvd)
+nvtest_privileged_fn1(unsigned char,__readgsbyte,unsigned long)
+nvtest_privileged_fn1(unsigned short,__readgsword,unsigned long)
+nvtest_privileged_fn1(unsigned int,__readgsdword,unsigned long)
+nvtest_privileged_fn1(unsigned long long,__readgsqword,unsigned long)
@@ -0,0 +1,58 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file defines the facilities of NoirVisor's user-mode tests.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/nvtest.h
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+// Assertions. A failed check is reported but the test continues running.
+#define nvtest_check(cond)		nvtest_check_fn((cond)!=0,__FILE__,__LINE__,#cond)
+#define nvtest_check_eq(a,b)	nvtest_check_eq_fn((u64)(a),(u64)(b),__FILE__,__LINE__,#a,#b)
+
+void nvtest_check_fn(bool cond,const char* file,u32 line,const char* expr);
+void nvtest_check_eq_fn(u64 a,u64 b,const char* file,u32 line,const char* expr_a,const char* expr_b);
+// Returns the exit code of the test program.
+int nvtest_finish();
+
+// Benchmarks are run only if "--bench" is specified to the runner.
+bool nvtest_is_benchmark();
+u64 nvtest_time_ns();
+void nvtest_report(const char* format,...);
+
+// Simulated Processors. Each thread is assigned to a simulated processor.
+void nvtest_set_processor_count(u32 count);
+void nvtest_set_current_processor(u32 processor_number);
+u32 nvtest_query_kick_count(u32 processor_number);
+
+// Simulated NUMA Topology. Processors are evenly distributed to nodes.
+#define nvtest_numa_node_unknown	0xffffffff
+void nvtest_set_numa_node_count(u32 count);
+u32 nvtest_query_allocation_node(void* virtual_address);
+
+// Simulated Allocation Failures. The specified number of allocations succeed before the rest fail.
+#define nvtest_unlimited_allocations	0xffffffff
+void nvtest_set_allocation_budget(u32 budget);
+
+// Simulated Physical Memory Ranges enumerated by noir_enum_physical_memory_ranges.
+void nvtest_set_physical_ranges(u64p ranges,u32 count);
+
+// Simulated TSC Frequency reported by noir_query_tsc_frequency. Zero restores the measured frequency.
+void nvtest_set_tsc_frequency(u64 frequency);
+
+// Simulated Threads
+noir_thread nvtest_create_thread(noir_thread_procedure procedure,void* context,u32 processor_number);
+
+// Simulated Hypervisors. Only the CVM facility is available.
+noir_status nvtest_initialize_svm(u32 processors);
+noir_status nvtest_initialize_vt(u32 processors);
@@ -0,0 +1,30 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file adapts MSVC-flavored keywords to GCC so that the hypervisor
+  sources can be compiled into user-mode tests on Linux.
+  It is force-included before any other header.
+
+  This program is distributed in the hope that it will be useful, but 
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/nvtest_compat.h
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#define __int8		char
+#define __int16		short
+#define __int32		int
+#define __int64		long long
+
+#define __declspec(x)
+#define __cdecl
+#define __stdcall
+#define __fastcall
+#define __forceinline	static inline __attribute__((always_inline))
@@ -0,0 +1,118 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file defines the subset of the Windows Driver Kit that is used by
+  the Windows layer of NoirVisor, so that the portable parts of the layer
+  could be tested in user mode. Kernel routines are implemented in
+  /test/platform/ntoskrnl.c.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/windows/ntddk.h
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define NTAPI
+#define NTKERNELAPI
+#define NTSYSAPI
+#define TRUE	1
+#define FALSE	0
+#ifndef NULL
+#define NULL	((void*)0)
+#endif
+#define PAGE_SIZE	0x1000
+#if defined(_AMD64_)
+#define _WIN64
+#endif
+
+typedef void VOID,*PVOID;
+typedef char CHAR,*PCHAR,*PSTR;
+typedef const char *PCSTR;
+typedef unsigned short WCHAR,*PWCHAR,*PWSTR;
+typedef unsigned char UCHAR,*PUCHAR,BOOLEAN,*PBOOLEAN;
+typedef short SHORT,CSHORT;
+typedef unsigned short USHORT,*PUSHORT;
+typedef int LONG,*PLONG;
+typedef unsigned int ULONG,*PULONG,ULONG32,*PULONG32;
+typedef long long LONG64,*PLONG64;
+typedef unsigned long long ULONG64,*PULONG64,ULONGLONG;
+typedef long long LONG_PTR;
+typedef unsigned long long ULONG_PTR,*PULONG_PTR,SIZE_T,*PSIZE_T;
+typedef LONG NTSTATUS;
+typedef PVOID HANDLE,*PHANDLE;
+typedef PVOID PEPROCESS,PMDL;
+typedef ULONG_PTR EX_PUSH_LOCK,*PEX_PUSH_LOCK;
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONG64 QuadPart;
+}LARGE_INTEGER,*PLARGE_INTEGER;
+
+typedef struct _TIME_FIELDS
+{
+	CSHORT Year;
+	CSHORT Month;
+	CSHORT Day;
+	CSHORT Hour;
+	CSHORT Minute;
+	CSHORT Second;
+	CSHORT Milliseconds;
+	CSHORT Weekday;
+}TIME_FIELDS,*PTIME_FIELDS;
+
+#define STATUS_SUCCESS					((NTSTATUS)0x00000000)
+#define STATUS_UNSUCCESSFUL				((NTSTATUS)0xC0000001)
+#define STATUS_INSUFFICIENT_RESOURCES	((NTSTATUS)0xC000009A)
+#define NT_SUCCESS(s)	((NTSTATUS)(s)>=0)
+#define NT_ERROR(s)		((ULONG)(s)>>30==3)
+
+#define DPFLTR_IHVDRIVER_ID		77
+#define DPFLTR_TRACE_LEVEL		2
+#define MemoryWorkingSetExInformation	4
+
+#define ZwCurrentProcess()		((HANDLE)(LONG_PTR)-1)
+#define RtlZeroMemory(d,l)		__builtin_memset((d),0,(l))
+#define KeMemoryBarrier()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+// Kernel APCs are not simulated.
+#define KeEnterCriticalRegion()
+#define KeLeaveCriticalRegion()
+
+static inline LONG InterlockedIncrement(LONG volatile* Addend)
+{
+	return __atomic_add_fetch(Addend,1,__ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(LONG volatile* Addend)
+{
+	return __atomic_sub_fetch(Addend,1,__ATOMIC_SEQ_CST);
+}
+
+static inline PVOID InterlockedExchangePointer(PVOID volatile* Target,PVOID Value)
+{
+	return __atomic_exchange_n(Target,Value,__ATOMIC_SEQ_CST);
+}
+
+typedef void (*PCREATE_PROCESS_NOTIFY_ROUTINE)(HANDLE ParentId,HANDLE ProcessId,BOOLEAN Create);
+
+void KeQuerySystemTime(PLARGE_INTEGER CurrentTime);
+void ExSystemTimeToLocalTime(PLARGE_INTEGER SystemTime,PLARGE_INTEGER LocalTime);
+void RtlTimeToTimeFields(PLARGE_INTEGER Time,PTIME_FIELDS TimeFields);
+ULONG DbgPrintEx(ULONG ComponentId,ULONG Level,PCSTR Format,...);
+HANDLE PsGetCurrentProcessId();
+NTSTATUS PsSetCreateProcessNotifyRoutine(PCREATE_PROCESS_NOTIFY_ROUTINE NotifyRoutine,BOOLEAN Remove);
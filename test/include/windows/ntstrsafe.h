@@ -0,0 +1,22 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file declares the safe string routines used by the Windows layer.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/windows/ntstrsafe.h
+*/
+
+#pragma once
+
+#include <ntddk.h>
+
+#define STRSAFE_FILL_BEHIND_NULL	0x200
+
+NTSTATUS RtlStringCbPrintfExA(PSTR Dest,SIZE_T DestSize,PSTR* DestEnd,PSIZE_T Remaining,ULONG Flags,PCSTR Format,...);
+NTSTATUS RtlStringCbVPrintfA(PSTR Dest,SIZE_T DestSize,PCSTR Format,va_list ArgList);
@@ -0,0 +1,21 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file defines the Windows types that are not defined in ntddk.h.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/include/windows/windef.h
+*/
+
+#pragma once
+
+#include <ntddk.h>
+
+typedef unsigned char BYTE,*PBYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
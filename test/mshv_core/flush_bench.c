@@ -0,0 +1,137 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the TLB Flush Hypercalls of MSHV Core on a
+  simulated guest with 32 vCPUs. Each shootdown is requested by a random
+  vCPU and targets all other vCPUs, in the way Windows flushes the TLB
+  of a process running on every processor. The latency of the hypercall
+  handler and the broadcast invalidations requested from SVM-Core are
+  reported. Invalidations are counted rather than executed, so the
+  latency excludes the hardware cost of the invalidations themselves.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/mshv_core/flush_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../src/mshv_core/mshv_def.h"
+#include "../../src/mshv_core/mshv_hvcall.h"
+
+#define nvtest_vcpus				32
+#define nvtest_shootdowns			200000
+// The number of pages an INVLPGB instruction may invalidate, as is reported by common processors.
+#define nvtest_invlpgb_stride		8
+
+u64 fastcall nvc_mshv_hypercall_handler(noir_mshv_vcpu_p vcpu,u64 input,u64 input_gpa,u64 output_gpa);
+
+u64 nvtest_invalidations=0;
+u64 nvtest_remote_flushes=0;
+
+// Simulated SVM-Core: count the broadcast invalidations in the same way as nvc_svm_mshv_flush_guest_tlb.
+bool nvc_svm_mshv_flush_guest_tlb(void* vcpu,u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	if(gva_list)
+		for(u32 i=0;i<count;i++)
+			nvtest_invalidations+=((u32)page_offset(gva_list[i])+nvtest_invlpgb_stride)/nvtest_invlpgb_stride;
+	else
+		nvtest_invalidations++;
+	nvtest_remote_flushes+=remote;
+	return true;
+}
+
+u64 nvtest_input(u16 call_code,u32 var_header_size,u32 rep_count)
+{
+	noir_mshv_hypercall_input input;
+	input.value=0;
+	input.call_code=call_code;
+	input.var_header_size=var_header_size;
+	input.rep_count=rep_count;
+	return input.value;
+}
+
+// The processor set of each caller excludes itself, so the parameters are prepared per caller.
+void nvtest_shootdown(const char* name,noir_mshv_vcpu_p vcpus,u8p* params,u64 input)
+{
+	noir_mshv_hypercall_input hc_input;
+	noir_mshv_hypercall_result result;
+	u64 seed=1,t0,t;
+	u32 failures=0;
+	hc_input.value=input;
+	nvtest_invalidations=nvtest_remote_flushes=0;
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_shootdowns;i++)
+	{
+		u32 caller;
+		seed=seed*6364136223846793005+1442695040888963407;
+		caller=(u32)(seed>>59);
+		result.value=nvc_mshv_hypercall_handler(&vcpus[caller],input,noir_get_physical_address(params[caller]),0);
+		failures+=result.status!=hv_status_success;
+	}
+	t=nvtest_time_ns()-t0;
+	nvtest_check_eq(failures,0);
+	nvtest_check_eq(nvtest_remote_flushes,nvtest_shootdowns);
+	nvtest_report("%-34s %4u reps: %6.1f ns per shootdown, %5.1f invalidations per shootdown\n",name,(u32)hc_input.rep_count,(double)t/nvtest_shootdowns,(double)nvtest_invalidations/nvtest_shootdowns);
+}
+
+void nvtest_fill_list(u64p gva_list,u32 count,u32 additional_pages)
+{
+	for(u32 i=0;i<count;i++)gva_list[i]=page_mult(0x7ff000000ull+i*0x10ull)|additional_pages;
+}
+
+int main()
+{
+	noir_mshv_vcpu vcpus[nvtest_vcpus];
+	u8p params[nvtest_vcpus];
+	const u32 list_counts[]={1,16,64,256};
+	memset(vcpus,0,sizeof(vcpus));
+	hvm_p->selected_core=use_svm_core;
+	hvm_p->cpu_count=nvtest_vcpus;
+	for(u32 i=0;i<nvtest_vcpus;i++)
+	{
+		vcpus[i].vp_index=i;
+		params[i]=aligned_alloc(page_size,page_size);
+		memset(params[i],0,page_size);
+	}
+	nvtest_report("Shootdowns on %u vCPUs, each targeting %u remote vCPUs:\n",nvtest_vcpus,nvtest_vcpus-1);
+	// HvCallFlushVirtualAddressSpace/List with a 64-bit processor mask.
+	for(u32 i=0;i<nvtest_vcpus;i++)
+	{
+		noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)params[i];
+		param->processor_mask=((1ull<<nvtest_vcpus)-1)&~(1ull<<i);
+		nvtest_fill_list(param->gva_list,256,0);
+	}
+	nvtest_shootdown("FlushVirtualAddressSpace",vcpus,params,nvtest_input(hv_call_flush_virtual_address_space,0,0));
+	for(u32 i=0;i<sizeof(list_counts)/sizeof(u32);i++)
+		nvtest_shootdown("FlushVirtualAddressList",vcpus,params,nvtest_input(hv_call_flush_virtual_address_list,0,list_counts[i]));
+	// Large ranges in the list are flushed as the whole address space once they exceed the threshold.
+	for(u32 i=0;i<nvtest_vcpus;i++)nvtest_fill_list(((noir_mshv_flush_va_input_p)params[i])->gva_list,256,15);
+	nvtest_shootdown("FlushVirtualAddressList (16 pages)",vcpus,params,nvtest_input(hv_call_flush_virtual_address_list,0,16));
+	nvtest_shootdown("FlushVirtualAddressList (16 pages)",vcpus,params,nvtest_input(hv_call_flush_virtual_address_list,0,64));
+	// HvCallFlushVirtualAddressSpaceEx/ListEx with a sparse processor set of one bank.
+	for(u32 i=0;i<nvtest_vcpus;i++)
+	{
+		noir_mshv_flush_va_ex_input_p param=(noir_mshv_flush_va_ex_input_p)params[i];
+		param->flags=0;
+		param->processor_set.format=hv_generic_set_sparse_4k;
+		param->processor_set.valid_bank_mask=1;
+		param->processor_set.bank_contents[0]=((1ull<<nvtest_vcpus)-1)&~(1ull<<i);
+		nvtest_fill_list(&param->processor_set.bank_contents[1],256,0);
+	}
+	nvtest_shootdown("FlushVirtualAddressSpaceEx",vcpus,params,nvtest_input(hv_call_flush_virtual_address_space_ex,1,0));
+	for(u32 i=0;i<sizeof(list_counts)/sizeof(u32);i++)
+		nvtest_shootdown("FlushVirtualAddressListEx",vcpus,params,nvtest_input(hv_call_flush_virtual_address_list_ex,1,list_counts[i]));
+	for(u32 i=0;i<nvtest_vcpus;i++)free(params[i]);
+	return nvtest_finish();
+}
@@ -0,0 +1,268 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the TLB Flush Hypercalls of MSHV Core.
+  Input parameters are decoded by the hypercall handler, and the flushes
+  it requests are recorded by a simulated SVM-Core. The rep range, the
+  processor sets (including sparse banks), the page-boundary rule and
+  the flags are checked.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/mshv_core/flush_hvcall.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../src/mshv_core/mshv_def.h"
+#include "../../src/mshv_core/mshv_hvcall.h"
+
+u64 fastcall nvc_mshv_hypercall_handler(noir_mshv_vcpu_p vcpu,u64 input,u64 input_gpa,u64 output_gpa);
+
+struct
+{
+	u64p gva_list;
+	u32 count;
+	u32 calls;
+	bool remote;
+	bool non_global;
+}nvtest_flush;
+
+// Simulated SVM-Core: record the flush instead of invalidating the TLB.
+bool nvc_svm_mshv_flush_guest_tlb(void* vcpu,u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	nvtest_flush.gva_list=gva_list;
+	nvtest_flush.count=count;
+	nvtest_flush.remote=remote;
+	nvtest_flush.non_global=non_global;
+	nvtest_flush.calls++;
+	return true;
+}
+
+u64 nvtest_input(u16 call_code,u32 var_header_size,u32 rep_count,u32 rep_start)
+{
+	noir_mshv_hypercall_input input;
+	input.value=0;
+	input.call_code=call_code;
+	input.var_header_size=var_header_size;
+	input.rep_count=rep_count;
+	input.rep_start=rep_start;
+	return input.value;
+}
+
+// Returns the status of the hypercall. Reps are checked to be completed only on success.
+u16 nvtest_hypercall(noir_mshv_vcpu_p vcpu,u64 input,void* param)
+{
+	noir_mshv_hypercall_input hc_input;
+	noir_mshv_hypercall_result result;
+	hc_input.value=input;
+	nvtest_flush.calls=0;
+	result.value=nvc_mshv_hypercall_handler(vcpu,input,noir_get_physical_address(param),0);
+	nvtest_check_eq(result.reps_completed,result.status==hv_status_success?hc_input.rep_count:0);
+	return (u16)result.status;
+}
+
+void nvtest_check_flush(u64p gva_list,u32 count,bool remote,bool non_global)
+{
+	nvtest_check_eq(nvtest_flush.calls,1);
+	nvtest_check(nvtest_flush.gva_list==gva_list);
+	nvtest_check_eq(nvtest_flush.count,count);
+	nvtest_check_eq(nvtest_flush.remote,remote);
+	nvtest_check_eq(nvtest_flush.non_global,non_global);
+}
+
+void nvtest_rep_range(noir_mshv_vcpu_p vcpu,u8p page)
+{
+	noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)page;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	param->flags=0;
+	for(u32 i=0;i<8;i++)param->gva_list[i]=page_mult((u64)i+1);
+	// The list is flushed from the starting rep.
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,8,0),param),hv_status_success);
+	nvtest_check_flush(param->gva_list,8,false,false);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,8,5),param),hv_status_success);
+	nvtest_check_flush(&param->gva_list[5],3,false,false);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,8,8),param),hv_status_success);
+	nvtest_check_flush(&param->gva_list[8],0,false,false);
+	// The starting rep must not exceed the count.
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,8,9),param),hv_status_invalid_hypercall_input);
+	// Only list flushes are rep hypercalls.
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,0,0),param),hv_status_invalid_hypercall_input);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space,0,1,0),param),hv_status_invalid_hypercall_input);
+	nvtest_check_eq(nvtest_flush.calls,0);
+	// Too many pages are flushed as the whole address space.
+	param->gva_list[0]|=0x1ff;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,1,0),param),hv_status_success);
+	nvtest_check_flush(param->gva_list,1,false,false);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,2,0),param),hv_status_success);
+	nvtest_check_flush(null,0,false,false);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,2,1),param),hv_status_success);
+	nvtest_check_flush(&param->gva_list[1],1,false,false);
+}
+
+void nvtest_processor_mask(noir_mshv_vcpu_p vcpu,u8p page)
+{
+	noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)page;
+	const u64 input=nvtest_input(hv_call_flush_virtual_address_space,0,0,0);
+	param->flags=0;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_success);
+	nvtest_check_flush(null,0,false,false);
+	param->processor_mask=~(1ull<<vcpu->vp_index);
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_success);
+	nvtest_check_flush(null,0,true,false);
+	// Nothing is flushed if no processors are targeted.
+	param->processor_mask=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_success);
+	nvtest_check_eq(nvtest_flush.calls,0);
+	param->flags=hv_flush_all_processors|hv_flush_non_global_mappings_only;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_success);
+	nvtest_check_flush(null,0,true,true);
+	// Address spaces are not tracked. Flushing all of them is the same as flushing one.
+	param->flags=hv_flush_all_virtual_address_spaces;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_success);
+	nvtest_check_flush(null,0,false,false);
+}
+
+void nvtest_flags(noir_mshv_vcpu_p vcpu,u8p page)
+{
+	noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)page;
+	const u64 input=nvtest_input(hv_call_flush_virtual_address_space,0,0,0);
+	noir_mshv_hypercall_input hc_input;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	// The extended range format is not supported.
+	param->flags=hv_flush_use_extended_range_format;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_invalid_parameter);
+	param->flags=1ull<<63;
+	nvtest_check_eq(nvtest_hypercall(vcpu,input,param),hv_status_invalid_parameter);
+	nvtest_check_eq(nvtest_flush.calls,0);
+	param->flags=0;
+	// Fast flushes, reserved bits and variable headers of non-Ex flushes are rejected.
+	hc_input.value=input;
+	hc_input.fast=1;
+	nvtest_check_eq(nvtest_hypercall(vcpu,hc_input.value,param),hv_status_invalid_hypercall_input);
+	hc_input.value=input;
+	hc_input.nested=1;
+	nvtest_check_eq(nvtest_hypercall(vcpu,hc_input.value,param),hv_status_invalid_hypercall_input);
+	hc_input.value=input;
+	hc_input.reserved2=1;
+	nvtest_check_eq(nvtest_hypercall(vcpu,hc_input.value,param),hv_status_invalid_hypercall_input);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space,1,0,0),param),hv_status_invalid_hypercall_input);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(0x7f,0,0,0),param),hv_status_invalid_hypercall_code);
+	nvtest_check_eq(nvtest_flush.calls,0);
+}
+
+// The input parameters, including the list, must be aligned and must not cross a page boundary.
+void nvtest_page_boundary(noir_mshv_vcpu_p vcpu,u8p page)
+{
+	const u32 header_size=sizeof(noir_mshv_flush_va_input);
+	noir_mshv_flush_va_input_p param=(noir_mshv_flush_va_input_p)(page+page_size-header_size-0x20);
+	param->flags=0;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	for(u32 i=0;i<4;i++)param->gva_list[i]=page_mult((u64)i);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,4,0),param),hv_status_success);
+	nvtest_check_flush(param->gva_list,4,false,false);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,5,0),param),hv_status_invalid_alignment);
+	// The starting rep does not affect the boundary check.
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list,0,5,4),param),hv_status_invalid_alignment);
+	param=(noir_mshv_flush_va_input_p)(page+page_size-header_size);
+	param->flags=0;
+	param->processor_mask=1ull<<vcpu->vp_index;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space,0,0,0),param),hv_status_success);
+	param=(noir_mshv_flush_va_input_p)(page+page_size-header_size+8);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space,0,0,0),param),hv_status_invalid_alignment);
+	param=(noir_mshv_flush_va_input_p)(page+4);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space,0,0,0),param),hv_status_invalid_alignment);
+	nvtest_check_eq(nvtest_flush.calls,0);
+}
+
+void nvtest_sparse_set(noir_mshv_vcpu_p vcpu,u8p page)
+{
+	noir_mshv_flush_va_ex_input_p param=(noir_mshv_flush_va_ex_input_p)page;
+	u64p banks=param->processor_set.bank_contents;
+	u64p gva_list;
+	param->flags=0;
+	param->processor_set.format=hv_generic_set_all;
+	param->processor_set.valid_bank_mask=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,0,0,0),param),hv_status_success);
+	nvtest_check_flush(null,0,true,false);
+	// The caller is VP 70, in the second bank.
+	param->processor_set.format=hv_generic_set_sparse_4k;
+	param->processor_set.valid_bank_mask=0x6;
+	banks[0]=1ull<<6;
+	banks[1]=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,2,0,0),param),hv_status_success);
+	nvtest_check_flush(null,0,false,false);
+	banks[1]=1;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,2,0,0),param),hv_status_success);
+	nvtest_check_flush(null,0,true,false);
+	banks[0]=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,2,0,0),param),hv_status_success);
+	nvtest_check_flush(null,0,true,false);
+	banks[1]=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,2,0,0),param),hv_status_success);
+	nvtest_check_eq(nvtest_flush.calls,0);
+	// Banks are not read beyond the variable header.
+	banks[0]=0;
+	banks[1]=1ull<<6;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,1,0,0),param),hv_status_invalid_parameter);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,0,0,0),param),hv_status_invalid_parameter);
+	param->processor_set.valid_bank_mask=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,0,0,0),param),hv_status_success);
+	param->processor_set.format=2;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_space_ex,0,0,0),param),hv_status_invalid_parameter);
+	nvtest_check_eq(nvtest_flush.calls,0);
+	// The list follows the banks.
+	param->processor_set.format=hv_generic_set_sparse_4k;
+	param->processor_set.valid_bank_mask=0x6;
+	banks[0]=1ull<<6;
+	banks[1]=0;
+	gva_list=&banks[2];
+	for(u32 i=0;i<4;i++)gva_list[i]=page_mult((u64)i);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list_ex,2,4,1),param),hv_status_success);
+	nvtest_check_flush(&gva_list[1],3,false,false);
+	// The banks are counted in the page-boundary check.
+	param=(noir_mshv_flush_va_ex_input_p)(page+page_size-sizeof(noir_mshv_flush_va_ex_input)-0x30);
+	param->flags=0;
+	param->processor_set.format=hv_generic_set_sparse_4k;
+	param->processor_set.valid_bank_mask=0x6;
+	param->processor_set.bank_contents[0]=1ull<<6;
+	param->processor_set.bank_contents[1]=0;
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list_ex,2,4,0),param),hv_status_success);
+	nvtest_check_eq(nvtest_hypercall(vcpu,nvtest_input(hv_call_flush_virtual_address_list_ex,2,5,0),param),hv_status_invalid_alignment);
+}
+
+void nvtest_flush_hypercalls()
+{
+	u8p page=aligned_alloc(page_size,page_size);
+	noir_mshv_vcpu vcpu;
+	memset(page,0,page_size);
+	memset(&vcpu,0,sizeof(vcpu));
+	hvm_p->selected_core=use_svm_core;
+	hvm_p->cpu_count=128;
+	vcpu.vp_index=3;
+	nvtest_rep_range(&vcpu,page);
+	nvtest_processor_mask(&vcpu,page);
+	nvtest_flags(&vcpu,page);
+	nvtest_page_boundary(&vcpu,page);
+	vcpu.vp_index=70;
+	nvtest_sparse_set(&vcpu,page);
+	free(page);
+}
+
+int main()
+{
+	nvtest_flush_hypercalls();
+	return nvtest_finish();
+}
@@ -0,0 +1,116 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the Partition Reference Time of MSHV Core.
+  The scale is checked against 128-bit division, then the Reference
+  Counter MSR and the Reference TSC Page are checked against each other
+  across a restart of NoirVisor with a different TSC frequency.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/mshv_core/reference_time.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+#include "../../src/mshv_core/mshv_msr.h"
+
+extern u64v noir_mshv_reference_tsc_ctrl;
+extern u64 noir_mshv_tsc_scale;
+extern u64 noir_mshv_tsc_offset;
+extern u64 noir_mshv_reference_time_base;
+
+u64 nvc_mshv_compute_tsc_scale(u64 freq);
+
+u64 nvtest_reference_time(u64 tsc,u64 scale,u64 offset)
+{
+	return (u64)(((unsigned __int128)tsc*scale)>>64)+offset;
+}
+
+void nvtest_scale()
+{
+	const u64 frequencies[]={10000001,1000000000,2500000000,3700000000,4194304000,5000000007};
+	for(u32 i=0;i<sizeof(frequencies)/sizeof(u64);i++)
+	{
+		const u64 expect=(u64)(((unsigned __int128)noir_mshv_reference_time_frequency<<64)/frequencies[i]);
+		nvtest_check_eq(nvc_mshv_compute_tsc_scale(frequencies[i]),expect);
+	}
+}
+
+// The Reference Counter MSR must be consistent with the scale-offset pair.
+void nvtest_check_counter()
+{
+	const u64 c0=noir_rdtsc();
+	const u64 t=nvc_mshv_rdmsr_handler(null,hv_x64_msr_time_ref_count);
+	const u64 c1=noir_rdtsc();
+	nvtest_check(t>=nvtest_reference_time(c0,noir_mshv_tsc_scale,noir_mshv_tsc_offset));
+	nvtest_check(t<=nvtest_reference_time(c1,noir_mshv_tsc_scale,noir_mshv_tsc_offset));
+}
+
+void nvtest_reference_time_restart()
+{
+	noir_mshv_reference_tsc_page_p ref_page=aligned_alloc(page_size,page_size);
+	noir_mshv_msr_reference_tsc msr;
+	u64 t0,t1,t2;
+	u32 seq;
+	nvtest_set_tsc_frequency(2500000000);
+	nvc_mshv_initialize_reference_time();
+	nvtest_check_eq(noir_mshv_tsc_scale,nvc_mshv_compute_tsc_scale(2500000000));
+	// Reference Time starts from zero when NoirVisor is loaded for the first time.
+	t0=nvc_mshv_rdmsr_handler(null,hv_x64_msr_time_ref_count);
+	nvtest_check(t0<noir_mshv_reference_time_frequency);
+	nvtest_check_counter();
+	// Enable the Reference TSC Page.
+	ref_page->tsc_sequence=noir_mshv_reference_tsc_invalid_sequence;
+	msr.value=0;
+	msr.enable=1;
+	msr.tsc_gpfn=page_count(noir_get_physical_address(ref_page));
+	nvc_mshv_wrmsr_handler(null,hv_x64_msr_reference_tsc,msr.value);
+	nvtest_check_eq(nvc_mshv_rdmsr_handler(null,hv_x64_msr_reference_tsc),msr.value);
+	nvtest_check(ref_page->tsc_sequence!=noir_mshv_reference_tsc_invalid_sequence);
+	nvtest_check_eq(ref_page->tsc_scale,noir_mshv_tsc_scale);
+	nvtest_check_eq(ref_page->tsc_offset,noir_mshv_tsc_offset);
+	seq=ref_page->tsc_sequence;
+	// Restart NoirVisor with a recalibrated TSC frequency, as is done when resuming from sleep.
+	noir_sleep(10);
+	nvc_mshv_finalize_reference_time();
+	t1=noir_mshv_reference_time_base;
+	nvtest_check(t1>t0);
+	nvtest_set_tsc_frequency(1250000000);
+	nvc_mshv_initialize_reference_time();
+	nvtest_check_eq(noir_mshv_tsc_scale,nvc_mshv_compute_tsc_scale(1250000000));
+	// Reference Time continues from where it stopped, rather than going backwards to zero.
+	t2=nvc_mshv_rdmsr_handler(null,hv_x64_msr_time_ref_count);
+	nvtest_check(t2>=t1);
+	nvtest_check(t2-t1<noir_mshv_reference_time_frequency);
+	nvtest_check_counter();
+	// The Reference TSC Page is refilled with a new sequence.
+	nvtest_check(ref_page->tsc_sequence!=noir_mshv_reference_tsc_invalid_sequence);
+	nvtest_check(ref_page->tsc_sequence!=seq);
+	nvtest_check_eq(ref_page->tsc_scale,noir_mshv_tsc_scale);
+	nvtest_check_eq(ref_page->tsc_offset,noir_mshv_tsc_offset);
+	nvtest_check(nvtest_reference_time(noir_rdtsc(),ref_page->tsc_scale,ref_page->tsc_offset)>=t2);
+	nvtest_set_tsc_frequency(0);
+	free(ref_page);
+}
+
+int main()
+{
+	u32 d;
+	nvtest_scale();
+	noir_cpuid(noir_mshv_cpuid_ext_powermgr_ras,0,null,null,null,&d);
+	if(noir_bt(&d,noir_mshv_cpuid_invariant_tsc))
+		nvtest_reference_time_restart();
+	else
+		nvtest_report("TSC is not invariant! Partition Reference Time is not tested!\n");
+	return nvtest_finish();
+}
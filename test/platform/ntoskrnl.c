@@ -0,0 +1,145 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file implements the Windows kernel routines that are called by
+  the Windows layer of NoirVisor in user mode, so that the portable parts
+  of the layer could be tested. Push locks are implemented with atomic
+  operations and yield the processor while they are contended.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/platform/ntoskrnl.c
+*/
+
+#include <ntddk.h>
+#include <ntstrsafe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bit 0 of a push lock indicates exclusive ownership. Shared owners are counted from bit 1.
+#define NtPushLockExclusive		1
+#define NtPushLockShareUnit		2
+
+void __fastcall ExfAcquirePushLockExclusive(IN OUT PEX_PUSH_LOCK PushLock)
+{
+	ULONG_PTR Expected=0;
+	while(!__atomic_compare_exchange_n(PushLock,&Expected,NtPushLockExclusive,FALSE,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+	{
+		sched_yield();
+		Expected=0;
+	}
+}
+
+void __fastcall ExfAcquirePushLockShared(IN OUT PEX_PUSH_LOCK PushLock)
+{
+	ULONG_PTR Value=__atomic_load_n(PushLock,__ATOMIC_RELAXED);
+	for(;;)
+	{
+		if(Value&NtPushLockExclusive)
+		{
+			sched_yield();
+			Value=__atomic_load_n(PushLock,__ATOMIC_RELAXED);
+		}
+		else if(__atomic_compare_exchange_n(PushLock,&Value,Value+NtPushLockShareUnit,FALSE,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+			return;
+	}
+}
+
+void __fastcall ExfReleasePushLockExclusive(IN OUT PEX_PUSH_LOCK PushLock)
+{
+	__atomic_store_n(PushLock,0,__ATOMIC_RELEASE);
+}
+
+void __fastcall ExfReleasePushLockShared(IN OUT PEX_PUSH_LOCK PushLock)
+{
+	__atomic_sub_fetch(PushLock,NtPushLockShareUnit,__ATOMIC_RELEASE);
+}
+
+// System time is counted in 100ns since January 1, 1601. Local time is identical to system time.
+#define NtUnixEpochOffset	116444736000000000ll
+
+void KeQuerySystemTime(PLARGE_INTEGER CurrentTime)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME,&ts);
+	CurrentTime->QuadPart=NtUnixEpochOffset+ts.tv_sec*10000000ll+ts.tv_nsec/100;
+}
+
+void ExSystemTimeToLocalTime(PLARGE_INTEGER SystemTime,PLARGE_INTEGER LocalTime)
+{
+	LocalTime->QuadPart=SystemTime->QuadPart;
+}
+
+void RtlTimeToTimeFields(PLARGE_INTEGER Time,PTIME_FIELDS TimeFields)
+{
+	const LONG64 Units=Time->QuadPart-NtUnixEpochOffset;
+	const time_t Seconds=(time_t)(Units/10000000);
+	struct tm tf;
+	gmtime_r(&Seconds,&tf);
+	TimeFields->Year=(CSHORT)(tf.tm_year+1900);
+	TimeFields->Month=(CSHORT)(tf.tm_mon+1);
+	TimeFields->Day=(CSHORT)tf.tm_mday;
+	TimeFields->Hour=(CSHORT)tf.tm_hour;
+	TimeFields->Minute=(CSHORT)tf.tm_min;
+	TimeFields->Second=(CSHORT)tf.tm_sec;
+	TimeFields->Milliseconds=(CSHORT)(Units/10000%1000);
+	TimeFields->Weekday=(CSHORT)tf.tm_wday;
+}
+
+// Debug messages are printed only if NVTEST_VERBOSE is set.
+ULONG DbgPrintEx(ULONG ComponentId,ULONG Level,PCSTR Format,...)
+{
+	if(getenv("NVTEST_VERBOSE"))
+	{
+		va_list ArgList;
+		va_start(ArgList,Format);
+		vfprintf(stderr,Format,ArgList);
+		va_end(ArgList);
+	}
+	return 0;
+}
+
+NTSTATUS RtlStringCbVPrintfA(PSTR Dest,SIZE_T DestSize,PCSTR Format,va_list ArgList)
+{
+	int Length=vsnprintf(Dest,DestSize,Format,ArgList);
+	return Length>=0 && (SIZE_T)Length<DestSize?STATUS_SUCCESS:STATUS_UNSUCCESSFUL;
+}
+
+NTSTATUS RtlStringCbPrintfExA(PSTR Dest,SIZE_T DestSize,PSTR* DestEnd,PSIZE_T Remaining,ULONG Flags,PCSTR Format,...)
+{
+	NTSTATUS st;
+	SIZE_T Length;
+	va_list ArgList;
+	va_start(ArgList,Format);
+	st=RtlStringCbVPrintfA(Dest,DestSize,Format,ArgList);
+	va_end(ArgList);
+	Length=strnlen(Dest,DestSize);
+	if(Flags&STRSAFE_FILL_BEHIND_NULL)memset(Dest+Length,0,DestSize-Length);
+	if(DestEnd)*DestEnd=Dest+Length;
+	if(Remaining)*Remaining=DestSize-Length;
+	return st;
+}
+
+HANDLE PsGetCurrentProcessId()
+{
+	return (HANDLE)(ULONG_PTR)getpid();
+}
+
+// Routines of the Windows driver called by the layered hypervisor.
+PVOID NoirAllocateNonPagedMemory(IN SIZE_T Length)
+{
+	return calloc(1,Length);
+}
+
+void NoirFreeNonPagedMemory(IN PVOID VirtualAddress)
+{
+	free(VirtualAddress);
+}
@@ -0,0 +1,614 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file is the user-mode platform layer of NoirVisor's tests.
+  It implements the Basic Development Kits with the C library and
+  POSIX threads, so that portable hypervisor logic could be tested.
+
+  Physical addresses are identical to virtual addresses in this layer.
+  GCC truncates shifts of bit-fields to the width of the bit-field, so
+  4KiB page frames in paging structures would lose bits above 2^40. So,
+  the tests are linked without PIE and all allocations are kept in the
+  brk heap, which resides at low addresses.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/platform/nvtest.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+
+// Test Facility
+static u32 nvtest_failures=0;
+static u32 nvtest_checks=0;
+
+void nvtest_check_fn(bool cond,const char* file,u32 line,const char* expr)
+{
+	noir_locked_inc(&nvtest_checks);
+	if(!cond)
+	{
+		noir_locked_inc(&nvtest_failures);
+		fprintf(stderr,"%s:%u: check failed: %s\n",file,line,expr);
+	}
+}
+
+void nvtest_check_eq_fn(u64 a,u64 b,const char* file,u32 line,const char* expr_a,const char* expr_b)
+{
+	noir_locked_inc(&nvtest_checks);
+	if(a!=b)
+	{
+		noir_locked_inc(&nvtest_failures);
+		fprintf(stderr,"%s:%u: check failed: %s==%s (0x%llX!=0x%llX)\n",file,line,expr_a,expr_b,a,b);
+	}
+}
+
+int nvtest_finish()
+{
+	printf("%u checks, %u failures.\n",nvtest_checks,nvtest_failures);
+	return nvtest_failures?1:0;
+}
+
+bool nvtest_is_benchmark()
+{
+	char* s=getenv("NVTEST_BENCHMARK");
+	return s!=null && *s=='1';
+}
+
+u64 nvtest_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (u64)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+void nvtest_report(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	vprintf(format,arg_list);
+	va_end(arg_list);
+	fflush(stdout);
+}
+
+void nvtest_privileged(const char* name)
+{
+	fprintf(stderr,"Privileged operation %s is reached in user mode!\n",name);
+	abort();
+}
+
+void __attribute__((constructor)) nvtest_initialize_heap()
+{
+	mallopt(M_MMAP_MAX,0);
+	mallopt(M_ARENA_MAX,1);
+}
+
+// Simulated Processors
+static u32 nvtest_processors=1;
+static u32 nvtest_numa_nodes=1;
+static __thread u32 nvtest_current_processor=0;
+static u32v nvtest_kicks[256];
+
+void nvtest_set_processor_count(u32 count)
+{
+	nvtest_processors=count;
+}
+
+void nvtest_set_current_processor(u32 processor_number)
+{
+	nvtest_current_processor=processor_number;
+}
+
+u32 nvtest_query_kick_count(u32 processor_number)
+{
+	return nvtest_kicks[processor_number];
+}
+
+u32 noir_get_processor_count()
+{
+	return nvtest_processors;
+}
+
+u32 noir_get_current_processor()
+{
+	return nvtest_current_processor;
+}
+
+bool noir_kick_processor(u32 processor_number)
+{
+	if(processor_number>=nvtest_processors)return false;
+	noir_locked_inc(&nvtest_kicks[processor_number]);
+	return true;
+}
+
+void noir_generic_call(noir_broadcast_worker worker,void* context)
+{
+	const u32 prev=nvtest_current_processor;
+	for(u32 i=0;i<nvtest_processors;i++)
+	{
+		nvtest_current_processor=i;
+		worker(context,i);
+	}
+	nvtest_current_processor=prev;
+}
+
+bool noir_is_under_hvm()
+{
+	return false;
+}
+
+// Memory Facility. Record the NUMA node of each allocation for placement tests.
+typedef struct _nvtest_allocation
+{
+	void* virt;
+	u32 node;
+}nvtest_allocation,*nvtest_allocation_p;
+
+static nvtest_allocation_p nvtest_allocations=null;
+static size_t nvtest_allocation_count=0;
+static size_t nvtest_allocation_limit=0;
+static pthread_mutex_t nvtest_allocation_lock=PTHREAD_MUTEX_INITIALIZER;
+
+static void nvtest_record_allocation(void* virt,u32 node)
+{
+	pthread_mutex_lock(&nvtest_allocation_lock);
+	if(nvtest_allocation_count==nvtest_allocation_limit)
+	{
+		nvtest_allocation_limit=nvtest_allocation_limit?nvtest_allocation_limit*2:256;
+		nvtest_allocations=realloc(nvtest_allocations,nvtest_allocation_limit*sizeof(nvtest_allocation));
+	}
+	nvtest_allocations[nvtest_allocation_count].virt=virt;
+	nvtest_allocations[nvtest_allocation_count++].node=node;
+	pthread_mutex_unlock(&nvtest_allocation_lock);
+}
+
+static void nvtest_forget_allocation(void* virt)
+{
+	pthread_mutex_lock(&nvtest_allocation_lock);
+	for(size_t i=0;i<nvtest_allocation_count;i++)
+	{
+		if(nvtest_allocations[i].virt==virt)
+		{
+			nvtest_allocations[i]=nvtest_allocations[--nvtest_allocation_count];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nvtest_allocation_lock);
+}
+
+void nvtest_set_numa_node_count(u32 count)
+{
+	nvtest_numa_nodes=count;
+}
+
+u32 nvtest_query_allocation_node(void* virtual_address)
+{
+	u32 node=nvtest_numa_node_unknown;
+	pthread_mutex_lock(&nvtest_allocation_lock);
+	for(size_t i=0;i<nvtest_allocation_count;i++)
+	{
+		if(nvtest_allocations[i].virt==virtual_address)
+		{
+			node=nvtest_allocations[i].node;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nvtest_allocation_lock);
+	return node;
+}
+
+u32 noir_get_processor_numa_node(u32 processor_number)
+{
+	return processor_number*nvtest_numa_nodes/nvtest_processors;
+}
+
+// Allocations fail once the budget is exhausted. Budgets are set only by single-threaded tests.
+static u32 nvtest_allocation_budget=nvtest_unlimited_allocations;
+
+void nvtest_set_allocation_budget(u32 budget)
+{
+	nvtest_allocation_budget=budget;
+}
+
+static void* nvtest_alloc(size_t length,size_t alignment)
+{
+	void* p;
+	if(nvtest_allocation_budget!=nvtest_unlimited_allocations)
+	{
+		if(nvtest_allocation_budget==0)return null;
+		nvtest_allocation_budget--;
+	}
+	length=(length+alignment-1)&~(alignment-1);
+	p=aligned_alloc(alignment,length);
+	if(p)memset(p,0,length);
+	return p;
+}
+
+void* noir_alloc_contd_memory(size_t length)
+{
+	return nvtest_alloc(length,page_size);
+}
+
+void* noir_alloc_nonpg_memory(size_t length)
+{
+	return nvtest_alloc(length,length>=page_size?page_size:16);
+}
+
+void* noir_alloc_paged_memory(size_t length)
+{
+	return nvtest_alloc(length,length>=page_size?page_size:16);
+}
+
+void* noir_alloc_2mb_page()
+{
+	return nvtest_alloc(0x200000,0x200000);
+}
+
+void* noir_alloc_contd_memory_for_numa(u32 numa_node,size_t length)
+{
+	void* p=noir_alloc_contd_memory(length);
+	if(p)nvtest_record_allocation(p,numa_node);
+	return p;
+}
+
+void* noir_alloc_nonpg_memory_for_numa(u32 numa_node,size_t length)
+{
+	void* p=noir_alloc_nonpg_memory(length);
+	if(p)nvtest_record_allocation(p,numa_node);
+	return p;
+}
+
+void noir_free_contd_memory(void* virtual_address,size_t length)
+{
+	nvtest_forget_allocation(virtual_address);
+	free(virtual_address);
+}
+
+void noir_free_nonpg_memory(void* virtual_address)
+{
+	nvtest_forget_allocation(virtual_address);
+	free(virtual_address);
+}
+
+void noir_free_paged_memory(void* virtual_address)
+{
+	free(virtual_address);
+}
+
+void noir_free_2mb_page(void* virtual_address)
+{
+	free(virtual_address);
+}
+
+u64 noir_get_physical_address(void* virtual_address)
+{
+	return (u64)virtual_address;
+}
+
+u64 noir_get_user_physical_address(void* virtual_address)
+{
+	return (u64)virtual_address;
+}
+
+void* noir_find_virt_by_phys(u64 physical_address)
+{
+	return (void*)physical_address;
+}
+
+void* noir_map_physical_memory(u64 physical_address,size_t length)
+{
+	return (void*)physical_address;
+}
+
+void noir_unmap_physical_memory(void* virtual_address,size_t length)
+{
+}
+
+// Page Locking. Locked pages are not required to be backed by memory.
+typedef struct _nvtest_locker
+{
+	void* virt;
+	u32 bytes;
+}nvtest_locker,*nvtest_locker_p;
+
+void* noir_lock_pages(void* virt,size_t bytes,u64p phys)
+{
+	nvtest_locker_p locker=malloc(sizeof(nvtest_locker));
+	if(locker)
+	{
+		locker->virt=virt;
+		locker->bytes=(u32)bytes;
+		for(size_t i=0;i<page_count(bytes);i++)
+			phys[i]=(u64)virt+page_4kb_mult(i);
+	}
+	return locker;
+}
+
+void noir_unlock_pages(void* locker)
+{
+	free(locker);
+}
+
+void noir_get_locked_range(void* locker,void** virt,u32p bytes)
+{
+	*virt=((nvtest_locker_p)locker)->virt;
+	*bytes=((nvtest_locker_p)locker)->bytes;
+}
+
+void* noir_map_locked_pages(void* locker)
+{
+	return ((nvtest_locker_p)locker)->virt;
+}
+
+void noir_copy_memory(void* dest,void* src,u32 cch)
+{
+	memcpy(dest,src,cch);
+}
+
+static u64p nvtest_physical_ranges=null;
+static u32 nvtest_physical_range_count=0;
+
+void nvtest_set_physical_ranges(u64p ranges,u32 count)
+{
+	nvtest_physical_ranges=ranges;
+	nvtest_physical_range_count=count;
+}
+
+void noir_enum_physical_memory_ranges(noir_physical_range_callback callback_routine,void* context)
+{
+	// Ranges are specified as pairs of base and length.
+	for(u32 i=0;i<nvtest_physical_range_count;i++)
+		callback_routine(nvtest_physical_ranges[i<<1],nvtest_physical_ranges[(i<<1)+1],context);
+}
+
+// String Facility. The C library substitutes the c99-snprintf library.
+int rpl_vsnprintf(char *str,size_t size,const char *format,va_list args)
+{
+	return vsnprintf(str,size,format,args);
+}
+
+// Debugging Facility. Outputs are suppressed unless NVTEST_VERBOSE is set.
+static void nvtest_vprint(const char* format,va_list arg_list)
+{
+	if(getenv("NVTEST_VERBOSE"))vfprintf(stderr,format,arg_list);
+}
+
+void cdecl nv_dprintf(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nv_tracef(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nv_async_dprintf(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nvci_tracef(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nv_dprintf_unprefixed(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nv_dprintf2(bool datetime,bool proc_id,const char* func_name,const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	nvtest_vprint(format,arg_list);
+	va_end(arg_list);
+}
+
+void cdecl nv_panicf(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	vfprintf(stderr,format,arg_list);
+	va_end(arg_list);
+	abort();
+}
+
+void cdecl nvci_panicf(const char* format,...)
+{
+	va_list arg_list;
+	va_start(arg_list,format);
+	vfprintf(stderr,format,arg_list);
+	va_end(arg_list);
+	abort();
+}
+
+// Threading Facility
+typedef struct _nvtest_thread_context
+{
+	noir_thread_procedure procedure;
+	void* context;
+	u32 processor_number;
+}nvtest_thread_context,*nvtest_thread_context_p;
+
+static void* nvtest_thread_entry(void* context)
+{
+	nvtest_thread_context thread=*(nvtest_thread_context_p)context;
+	free(context);
+	nvtest_current_processor=thread.processor_number;
+	return (void*)(ulong_ptr)thread.procedure(thread.context);
+}
+
+noir_thread nvtest_create_thread(noir_thread_procedure procedure,void* context,u32 processor_number)
+{
+	pthread_t* thread=malloc(sizeof(pthread_t));
+	nvtest_thread_context_p thread_context=malloc(sizeof(nvtest_thread_context));
+	thread_context->procedure=procedure;
+	thread_context->context=context;
+	thread_context->processor_number=processor_number;
+	if(pthread_create(thread,null,nvtest_thread_entry,thread_context))
+	{
+		free(thread_context);
+		free(thread);
+		return null;
+	}
+	return thread;
+}
+
+noir_thread noir_create_thread(noir_thread_procedure procedure,void* context)
+{
+	return nvtest_create_thread(procedure,context,nvtest_current_processor);
+}
+
+void noir_exit_thread(u32 status)
+{
+	pthread_exit((void*)(ulong_ptr)status);
+}
+
+bool noir_join_thread(noir_thread thread)
+{
+	bool result=pthread_join(*(pthread_t*)thread,null)==0;
+	free(thread);
+	return result;
+}
+
+bool noir_alert_thread(noir_thread thread)
+{
+	return false;
+}
+
+// Threads are pinned to simulated processors only.
+void noir_set_thread_affinity(u32 processor_number)
+{
+	nvtest_current_processor=processor_number;
+}
+
+void noir_sleep(u64 ms)
+{
+	usleep(ms*1000);
+}
+
+static u64 nvtest_tsc_frequency=0;
+
+void nvtest_set_tsc_frequency(u64 frequency)
+{
+	nvtest_tsc_frequency=frequency;
+}
+
+u64 noir_query_tsc_frequency()
+{
+	static u64 frequency=0;
+	if(nvtest_tsc_frequency)return nvtest_tsc_frequency;
+	if(frequency==0)
+	{
+		const u64 t0=nvtest_time_ns(),c0=noir_rdtsc();
+		usleep(20000);
+		frequency=(noir_rdtsc()-c0)*1000000000/(nvtest_time_ns()-t0);
+	}
+	return frequency;
+}
+
+u64 noir_get_system_time()
+{
+	// The unit of system time is 100ns.
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME,&ts);
+	return (u64)ts.tv_sec*10000000+ts.tv_nsec/100;
+}
+
+noir_reslock noir_initialize_reslock()
+{
+	pthread_rwlock_t* lock=malloc(sizeof(pthread_rwlock_t));
+	if(lock)pthread_rwlock_init(lock,null);
+	return lock;
+}
+
+void noir_finalize_reslock(noir_reslock lock)
+{
+	pthread_rwlock_destroy(lock);
+	free(lock);
+}
+
+void noir_acquire_reslock_shared(noir_reslock lock)
+{
+	pthread_rwlock_rdlock(lock);
+}
+
+void noir_acquire_reslock_shared_ex(noir_reslock lock)
+{
+	pthread_rwlock_rdlock(lock);
+}
+
+void noir_acquire_reslock_exclusive(noir_reslock lock)
+{
+	pthread_rwlock_wrlock(lock);
+}
+
+void noir_release_reslock(noir_reslock lock)
+{
+	pthread_rwlock_unlock(lock);
+}
+
+// Pushlocks are implemented as reader counters. All-ones indicates an exclusive owner.
+void noir_acquire_pushlock_shared(noir_pushlock *lock)
+{
+	while(1)
+	{
+		noir_pushlock v=*(volatile noir_pushlock*)lock;
+		if(v!=(noir_pushlock)-1 && __sync_bool_compare_and_swap(lock,v,v+1))break;
+		sched_yield();
+	}
+}
+
+void noir_acquire_pushlock_exclusive(noir_pushlock *lock)
+{
+	while(!__sync_bool_compare_and_swap(lock,0,(noir_pushlock)-1))sched_yield();
+}
+
+void noir_release_pushlock_shared(noir_pushlock *lock)
+{
+	__atomic_sub_fetch(lock,1,__ATOMIC_SEQ_CST);
+}
+
+void noir_release_pushlock_exclusive(noir_pushlock *lock)
+{
+	__atomic_store_n(lock,0,__ATOMIC_SEQ_CST);
+}
+
+// Miscellaneous
+void noir_qsort(void* base,u32 num,u32 width,noir_sorting_comparator comparator)
+{
+	qsort(base,num,width,comparator);
+}
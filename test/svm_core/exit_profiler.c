@@ -0,0 +1,183 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the VM-Exit latency profiler.
+  Latencies are put into log-scale buckets: zero cycles, the boundaries
+  of powers of two, and samples beyond 2^32 cycles are checked. Every
+  intercept code of AMD-V, including those of group 2 and the negative
+  codes, must map to a distinct slot in the profiler. Profiles of host
+  processors are queried through the SVM-Core.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/exit_profiler.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+#include "../../src/svm_core/svm_vmcb.h"
+#include "../../src/svm_core/svm_def.h"
+
+// Intercept codes of AMD-V. Group 2 starts at 0x400. Negative codes are errors.
+#define nvtest_group1_codes			0xA5
+#define nvtest_group2_codes			4
+#define nvtest_negative_codes		3
+#define nvtest_cpuid_code			0x72
+#define nvtest_processors			2
+
+noir_exit_profiler_p nvc_alloc_exit_profiler(u32 reasons);
+void nvc_free_exit_profiler(noir_exit_profiler_p profiler);
+void nvc_record_exit_latency(noir_exit_profiler_p profiler,u32 reason,u64 cycles);
+noir_status nvc_query_host_exit_profile(u32 processor,void* buffer,u32 buffer_size);
+u32 nvc_svm_get_exit_profiler_reason(i32 intercept_code);
+
+// Returns the bucket that a single sample falls into.
+u32 nvtest_bucket_of(noir_exit_profiler_p profiler,u64 cycles)
+{
+	noir_exit_histogram_p histogram=&profiler->histogram[0];
+	u32 bucket=noir_exit_profiler_buckets;
+	noir_stosb(histogram,0,sizeof(noir_exit_histogram));
+	nvc_record_exit_latency(profiler,0,cycles);
+	nvtest_check_eq(histogram->count,1);
+	nvtest_check_eq(histogram->cycles,cycles);
+	nvtest_check_eq(histogram->max_cycles,cycles);
+	for(u32 i=0;i<noir_exit_profiler_buckets;i++)
+	{
+		if(histogram->buckets[i])
+		{
+			nvtest_check_eq(histogram->buckets[i],1);
+			nvtest_check_eq(bucket,noir_exit_profiler_buckets);
+			bucket=i;
+		}
+	}
+	return bucket;
+}
+
+void nvtest_bucketing(noir_exit_profiler_p profiler)
+{
+	noir_exit_histogram_p histogram=&profiler->histogram[1];
+	// Bucket n counts samples of [2^n,2^(n+1)) cycles. Zero cycles fall into bucket 0.
+	nvtest_check_eq(nvtest_bucket_of(profiler,0),0);
+	nvtest_check_eq(nvtest_bucket_of(profiler,1),0);
+	for(u32 n=1;n<32;n++)
+	{
+		const u64 boundary=1ull<<n;
+		nvtest_check_eq(nvtest_bucket_of(profiler,boundary-1),n-1);
+		nvtest_check_eq(nvtest_bucket_of(profiler,boundary),n);
+		nvtest_check_eq(nvtest_bucket_of(profiler,boundary+1),n);
+	}
+	// Samples beyond 2^32 cycles fall into the last bucket, rather than a truncated one.
+	nvtest_check_eq(nvtest_bucket_of(profiler,0xffffffff),noir_exit_profiler_buckets-1);
+	nvtest_check_eq(nvtest_bucket_of(profiler,1ull<<32),noir_exit_profiler_buckets-1);
+	nvtest_check_eq(nvtest_bucket_of(profiler,(1ull<<32)+1),noir_exit_profiler_buckets-1);
+	nvtest_check_eq(nvtest_bucket_of(profiler,(1ull<<40)+0x10),noir_exit_profiler_buckets-1);
+	nvtest_check_eq(nvtest_bucket_of(profiler,maxu64),noir_exit_profiler_buckets-1);
+	// Sums and maximums are kept in 64 bits.
+	nvc_record_exit_latency(profiler,1,1ull<<33);
+	nvc_record_exit_latency(profiler,1,0);
+	nvc_record_exit_latency(profiler,1,300);
+	nvtest_check_eq(histogram->count,3);
+	nvtest_check_eq(histogram->cycles,(1ull<<33)+300);
+	nvtest_check_eq(histogram->max_cycles,1ull<<33);
+	nvtest_check_eq(histogram->buckets[0],1);
+	nvtest_check_eq(histogram->buckets[8],1);
+	nvtest_check_eq(histogram->buckets[noir_exit_profiler_buckets-1],1);
+	// Samples of reasons beyond the profiler are dropped.
+	nvc_record_exit_latency(profiler,profiler->reasons,100);
+	nvtest_check_eq(histogram->count,3);
+}
+
+void nvtest_svm_reasons()
+{
+	u8 used[noir_svm_exit_profiler_reasons]={0};
+	u32 reason;
+	nvtest_check_eq(noir_svm_exit_profiler_reasons,nvtest_group1_codes+nvtest_group2_codes+nvtest_negative_codes);
+	// Group 1 is mapped as is.
+	for(i32 code=0;code<nvtest_group1_codes;code++)
+	{
+		reason=nvc_svm_get_exit_profiler_reason(code);
+		nvtest_check_eq(reason,code);
+		used[reason]++;
+	}
+	// Group 2 follows group 1. The nested page fault (0x400) is the first.
+	nvtest_check_eq(nvc_svm_get_exit_profiler_reason(0x400),nvtest_group1_codes);
+	for(i32 code=0x400;code<0x400+nvtest_group2_codes;code++)
+	{
+		reason=nvc_svm_get_exit_profiler_reason(code);
+		nvtest_check(reason<noir_svm_exit_profiler_reasons);
+		if(reason<noir_svm_exit_profiler_reasons)used[reason]++;
+	}
+	// Negative codes come last. The invalid guest state (-1) is the first.
+	nvtest_check_eq(nvc_svm_get_exit_profiler_reason(-1),nvtest_group1_codes+nvtest_group2_codes);
+	nvtest_check_eq(nvc_svm_get_exit_profiler_reason(-nvtest_negative_codes),noir_svm_exit_profiler_reasons-1);
+	for(i32 code=-1;code>=-nvtest_negative_codes;code--)
+	{
+		reason=nvc_svm_get_exit_profiler_reason(code);
+		nvtest_check(reason<noir_svm_exit_profiler_reasons);
+		if(reason<noir_svm_exit_profiler_reasons)used[reason]++;
+	}
+	// Each slot belongs to exactly one code.
+	for(u32 i=0;i<noir_svm_exit_profiler_reasons;i++)nvtest_check_eq(used[i],1);
+}
+
+void nvtest_host_query()
+{
+	noir_svm_vcpu_p vcpu=hvm_p->virtual_cpu;
+	const u32 profile_size=(u32)noir_exit_profiler_size(noir_svm_exit_profiler_reasons);
+	noir_exit_profiler_p profile=noir_alloc_nonpg_memory(profile_size);
+	nvtest_check(profile!=null);
+	for(u32 i=0;i<nvtest_processors;i++)
+	{
+		vcpu[i].cvm_state.profiler=nvc_alloc_exit_profiler(noir_svm_exit_profiler_reasons);
+		nvtest_check(vcpu[i].cvm_state.profiler!=null);
+	}
+	// Exits of processor 1 are recorded by their intercept codes.
+	nvc_record_exit_latency(vcpu[1].cvm_state.profiler,nvc_svm_get_exit_profiler_reason(nvtest_cpuid_code),100);
+	nvc_record_exit_latency(vcpu[1].cvm_state.profiler,nvc_svm_get_exit_profiler_reason(-1),1ull<<36);
+	nvtest_check_eq(nvc_query_host_exit_profile(1,profile,profile_size),noir_success);
+	nvtest_check_eq(profile->reasons,noir_svm_exit_profiler_reasons);
+	nvtest_check_eq(profile->histogram[nvtest_cpuid_code].count,1);
+	nvtest_check_eq(profile->histogram[nvtest_cpuid_code].buckets[6],1);
+	nvtest_check_eq(profile->histogram[nvtest_group1_codes+nvtest_group2_codes].buckets[noir_exit_profiler_buckets-1],1);
+	// Histograms of processor 0 are separate.
+	nvtest_check_eq(nvc_query_host_exit_profile(0,profile,profile_size),noir_success);
+	nvtest_check_eq(profile->histogram[nvtest_cpuid_code].count,0);
+	// Small buffers receive the leading histograms only.
+	noir_stosb(profile,0xcc,profile_size);
+	nvtest_check_eq(nvc_query_host_exit_profile(1,profile,(u32)noir_exit_profiler_size(1)),noir_success);
+	nvtest_check_eq(profile->histogram[0].count,0);
+	nvtest_check_eq(profile->histogram[1].count,0xcccccccccccccccc);
+	nvtest_check_eq(nvc_query_host_exit_profile(1,profile,sizeof(noir_exit_profiler)-1),noir_buffer_too_small);
+	nvtest_check_eq(nvc_query_host_exit_profile(nvtest_processors,profile,profile_size),noir_invalid_parameter);
+	for(u32 i=0;i<nvtest_processors;i++)nvc_free_exit_profiler(vcpu[i].cvm_state.profiler);
+	noir_free_nonpg_memory(profile);
+}
+
+int main()
+{
+	noir_exit_profiler_p profiler;
+	nvtest_check_eq(nvtest_initialize_svm(nvtest_processors),noir_success);
+	// The profiler is not allocated unless it is enabled.
+	nvtest_check(nvc_alloc_exit_profiler(noir_svm_exit_profiler_reasons)==null);
+	hvm_p->options.exit_profiler=true;
+	profiler=nvc_alloc_exit_profiler(2);
+	nvtest_check(profiler!=null);
+	nvtest_bucketing(profiler);
+	nvc_free_exit_profiler(profiler);
+	hvm_p->virtual_cpu=noir_alloc_nonpg_memory(sizeof(noir_svm_vcpu)*nvtest_processors);
+	nvtest_check(hvm_p->virtual_cpu!=null);
+	nvtest_svm_reasons();
+	nvtest_host_query();
+	noir_free_nonpg_memory(hvm_p->virtual_cpu);
+	return nvtest_finish();
+}
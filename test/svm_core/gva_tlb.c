@@ -0,0 +1,251 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests guest-virtual address translations of CVMs.
+  Synthetic Long-Mode paging structures are built in guest memory that
+  is mapped through the NPT of an SVM-Core CVM. The software TLB must
+  survive until the guest writes to CR3 or invalidates its TLB, paging
+  controls are changed, or guest memory mappings are changed. Broadcast
+  invalidations by invlpgb must discard the software TLBs of all vCPUs.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/gva_tlb.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+#include "../../src/svm_core/svm_vmcb.h"
+#include "../../src/svm_core/svm_def.h"
+
+#define nvtest_guest_pages		16
+#define nvtest_pml4_gpa			0x0000
+#define nvtest_pdpt_gpa			0x1000
+#define nvtest_pd_gpa			0x2000
+#define nvtest_pt_gpa			0x3000
+#define nvtest_data_gpa			0x4000
+// GVA 0x40200000 is translated by PML4[0], PDPT[1], PD[1].
+#define nvtest_gva_base			0x40200000
+// GVA 0x40400000 is translated by a 2MiB page at PD[2].
+#define nvtest_large_gva		0x40400000
+#define nvtest_large_gpa		0x200000
+
+#define nvtest_pte_present		0x1
+#define nvtest_pte_write		0x2
+#define nvtest_pte_user			0x4
+#define nvtest_pte_psize		0x80
+#define nvtest_pte_nx			0x8000000000000000
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+bool nvc_translate_guest_virtual_address(noir_cvm_virtual_cpu_p vcpu,u64 gva,u32 access,u64p gpa,u32p error_code);
+void nvc_svm_set_guest_vcpu_options(noir_svm_custom_vcpu_p vcpu);
+
+u64p nvtest_guest_memory;
+
+u64p nvtest_table(u64 gpa)
+{
+	return (u64p)((u8p)nvtest_guest_memory+gpa);
+}
+
+noir_status nvtest_map(noir_cvm_virtual_machine_p vm,u64 gpa,u64 hva,u32 pages,bool present)
+{
+	noir_cvm_address_mapping map_info={0};
+	map_info.gpa=gpa;
+	map_info.hva=hva;
+	map_info.pages=pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=present;
+	map_info.attributes.caching=6;
+	return nvc_set_mapping(vm,&map_info);
+}
+
+void nvtest_build_paging_structures()
+{
+	nvtest_table(nvtest_pml4_gpa)[0]=nvtest_pdpt_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvtest_table(nvtest_pdpt_gpa)[1]=nvtest_pd_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvtest_table(nvtest_pd_gpa)[1]=nvtest_pt_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvtest_table(nvtest_pd_gpa)[2]=nvtest_large_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_psize;
+	// Page 0 is writable by the user. Page 1 is read-only. Page 2 is for supervisor. Page 3 is not executable.
+	nvtest_table(nvtest_pt_gpa)[0]=(nvtest_data_gpa+0x0000)|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvtest_table(nvtest_pt_gpa)[1]=(nvtest_data_gpa+0x1000)|nvtest_pte_present|nvtest_pte_user;
+	nvtest_table(nvtest_pt_gpa)[2]=(nvtest_data_gpa+0x2000)|nvtest_pte_present|nvtest_pte_write;
+	nvtest_table(nvtest_pt_gpa)[3]=(nvtest_data_gpa+0x3000)|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user|nvtest_pte_nx;
+}
+
+u64 nvtest_translate(noir_cvm_virtual_cpu_p vcpu,u64 gva,u32 access,u32p error_code)
+{
+	u64 gpa=0;
+	*error_code=0;
+	if(!nvc_translate_guest_virtual_address(vcpu,gva,access,&gpa,error_code))return maxu64;
+	return gpa;
+}
+
+void nvtest_check_statistics(noir_cvm_virtual_cpu_p vcpu,u64 hits,u64 misses)
+{
+	nvtest_check_eq(vcpu->statistics.gva_tlb.hits,hits);
+	nvtest_check_eq(vcpu->statistics.gva_tlb.misses,misses);
+}
+
+void nvtest_walk(noir_cvm_virtual_cpu_p vcpu)
+{
+	u32 err;
+	const u32 read=noir_cvm_map_va_read_bit;
+	const u32 write=noir_cvm_map_va_read_bit|noir_cvm_map_va_write_bit;
+	const u32 user=noir_cvm_map_va_read_bit|noir_cvm_map_va_user_bit;
+	const u32 exec=noir_cvm_map_va_read_bit|noir_cvm_map_va_execute_bit;
+	// 4KiB pages.
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x123,write,&err),nvtest_data_gpa+0x123);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x1FFF,user,&err),nvtest_data_gpa+0x1FFF);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x2008,read,&err),nvtest_data_gpa+0x2008);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x3010,user,&err),nvtest_data_gpa+0x3010);
+	// A 2MiB page.
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_large_gva+0x12345,write,&err),nvtest_large_gpa+0x12345);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_large_gva+0x1FFFFF,read,&err),nvtest_large_gpa+0x1FFFFF);
+	// Permissions are checked at every level.
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x1000,write,&err),maxu64);
+	nvtest_check(((noir_page_fault_error_code_p)&err)->write);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x2000,user,&err),maxu64);
+	nvtest_check(((noir_page_fault_error_code_p)&err)->user);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x3000,exec,&err),maxu64);
+	nvtest_check(((noir_page_fault_error_code_p)&err)->execute);
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_large_gva+0x1000,user,&err),maxu64);
+	// Non-present entries.
+	nvtest_check_eq(nvtest_translate(vcpu,nvtest_gva_base+0x4000,read,&err),maxu64);
+	nvtest_check(err!=0);
+	nvtest_check_eq(nvtest_translate(vcpu,0x80000000,read,&err),maxu64);
+}
+
+void nvtest_software_tlb(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu)
+{
+	noir_svm_custom_vcpu_p cvcpu=(noir_svm_custom_vcpu_p)vcpu;
+	const u32 read=noir_cvm_map_va_read_bit;
+	const u32 write=noir_cvm_map_va_read_bit|noir_cvm_map_va_write_bit;
+	const u64 gva=nvtest_gva_base+0x123;
+	u64 hits,misses;
+	u32 err;
+	// Start with an empty software TLB.
+	vcpu->state_cache.gt_valid=false;
+	hits=vcpu->statistics.gva_tlb.hits;
+	misses=vcpu->statistics.gva_tlb.misses;
+	// The first translation fills the software TLB. The second one hits.
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x123);
+	nvtest_check_eq(nvtest_translate(vcpu,gva+8,read,&err),nvtest_data_gpa+0x12B);
+	nvtest_check_statistics(vcpu,hits+1,misses+1);
+	nvtest_check(vcpu->gva_tlb_filled!=0);
+	// Accesses that were not granted by page-walking miss.
+	nvtest_check_eq(nvtest_translate(vcpu,gva,write,&err),nvtest_data_gpa+0x123);
+	nvtest_check_eq(nvtest_translate(vcpu,gva,write,&err),nvtest_data_gpa+0x123);
+	nvtest_check_statistics(vcpu,hits+2,misses+2);
+	// The guest edits its page table without invalidating its TLB. The stale translation is retained.
+	nvtest_table(nvtest_pt_gpa)[0]=(nvtest_data_gpa+0x5000)|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x123);
+	nvtest_check_statistics(vcpu,hits+3,misses+2);
+	// The guest executes invlpg. The software TLB is discarded and the interceptions are disarmed.
+	vcpu->gva_tlb_armed=true;
+	noir_svm_vmcb_bts32(cvcpu->vmcb.virt,intercept_instruction1,nvc_svm_intercept_vector1_invlpg);
+	nvc_svm_release_gva_tlb(cvcpu);
+	nvtest_check(!vcpu->gva_tlb_armed);
+	nvtest_check_eq(vcpu->gva_tlb_filled,0);
+	nvtest_check(!noir_svm_vmcb_bt32(cvcpu->vmcb.virt,intercept_instruction1,nvc_svm_intercept_vector1_invlpg));
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(vcpu,hits+3,misses+3);
+	// Translations are tagged by CR3.
+	vcpu->crs.cr3=nvtest_pml4_gpa|0x8;
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(vcpu,hits+3,misses+4);
+	vcpu->crs.cr3=nvtest_pml4_gpa;
+	// Changes to paging controls discard the software TLB.
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	vcpu->crs.cr4^=amd64_cr4_pge_bit;
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(vcpu,hits+3,misses+6);
+	// Changes to guest memory mappings discard the software TLB.
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(vcpu,hits+4,misses+6);
+	nvtest_check_eq(nvtest_map(vm,page_4kb_mult(nvtest_guest_pages),0,1,false),noir_success);
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(vcpu,hits+4,misses+7);
+	nvtest_table(nvtest_pt_gpa)[0]=nvtest_data_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvc_svm_release_gva_tlb(cvcpu);
+}
+
+void nvtest_shootdown(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,noir_cvm_virtual_cpu_p peer)
+{
+	noir_svm_custom_vcpu_p cvcpu=(noir_svm_custom_vcpu_p)vcpu;
+	const u32 read=noir_cvm_map_va_read_bit;
+	const u64 gva=nvtest_gva_base+0x123;
+	u64 hits,misses;
+	u32 err;
+	// The armed software TLB intercepts invlpgb.
+	vcpu->gva_tlb_armed=true;
+	nvc_svm_set_guest_vcpu_options(cvcpu);
+	nvtest_check(noir_svm_vmcb_bt32(cvcpu->vmcb.virt,intercept_instruction3,nvc_svm_gva_tlb_invlpgb_intercept));
+	// Both vCPUs fill their software TLBs.
+	peer->crs.cr0=vcpu->crs.cr0;
+	peer->crs.cr3=vcpu->crs.cr3;
+	peer->crs.cr4=vcpu->crs.cr4;
+	peer->msrs.efer=vcpu->msrs.efer;
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x123);
+	nvtest_check_eq(nvtest_translate(peer,gva,read,&err),nvtest_data_gpa+0x123);
+	nvtest_table(nvtest_pt_gpa)[0]=(nvtest_data_gpa+0x5000)|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	// A local invalidation does not discard the software TLB of the other vCPU.
+	nvc_svm_release_gva_tlb(cvcpu);
+	hits=peer->statistics.gva_tlb.hits;
+	misses=peer->statistics.gva_tlb.misses;
+	nvtest_check_eq(nvtest_translate(peer,gva,read,&err),nvtest_data_gpa+0x123);
+	nvtest_check_statistics(peer,hits+1,misses);
+	// The guest executes invlpgb on the first vCPU. The interception shoots down every software TLB of the VM.
+	nvtest_check_eq(nvtest_translate(vcpu,gva,read,&err),nvtest_data_gpa+0x5123);
+	vcpu->gva_tlb_armed=true;
+	nvc_svm_set_guest_vcpu_options(cvcpu);
+	nvc_shootdown_gva_tlb(vm);
+	nvc_svm_release_gva_tlb(cvcpu);
+	nvtest_check(!noir_svm_vmcb_bt32(cvcpu->vmcb.virt,intercept_instruction3,nvc_svm_gva_tlb_invlpgb_intercept));
+	nvtest_check_eq(nvtest_translate(peer,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(peer,hits+1,misses+1);
+	// The refilled software TLB of the other vCPU survives until the next shootdown.
+	nvtest_check_eq(nvtest_translate(peer,gva,read,&err),nvtest_data_gpa+0x5123);
+	nvtest_check_statistics(peer,hits+2,misses+1);
+	nvtest_table(nvtest_pt_gpa)[0]=nvtest_data_gpa|nvtest_pte_present|nvtest_pte_write|nvtest_pte_user;
+	nvc_svm_release_gva_tlb(cvcpu);
+	nvc_svm_release_gva_tlb((noir_svm_custom_vcpu_p)peer);
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_virtual_cpu_p vcpu,peer;
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&peer,1),noir_success);
+	// Guest memory is mapped in 4KiB pages.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=false;
+	nvtest_guest_memory=noir_alloc_contd_memory(page_4kb_mult(nvtest_guest_pages));
+	nvtest_check(nvtest_guest_memory!=null);
+	nvtest_check_eq(nvtest_map(vm,0,(u64)nvtest_guest_memory,nvtest_guest_pages,true),noir_success);
+	nvtest_build_paging_structures();
+	// The vCPU is in Long Mode with 4-level paging.
+	vcpu->crs.cr0=amd64_cr0_pe_bit|amd64_cr0_wp_bit|amd64_cr0_pg_bit;
+	vcpu->crs.cr3=nvtest_pml4_gpa;
+	vcpu->crs.cr4=amd64_cr4_pae_bit;
+	vcpu->msrs.efer=amd64_efer_lme_bit|amd64_efer_lma_bit|amd64_efer_nxe_bit;
+	nvtest_walk(vcpu);
+	nvtest_software_tlb(vm,vcpu);
+	nvtest_shootdown(vm,vcpu,peer);
+	nvc_release_vm(vm);
+	noir_free_contd_memory(nvtest_guest_memory,page_4kb_mult(nvtest_guest_pages));
+	return nvtest_finish();
+}
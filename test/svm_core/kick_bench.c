@@ -0,0 +1,148 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the cross-thread kicks of CVM vCPUs.
+  Runner threads run vCPUs in simulated guest mode. A simulated guest
+  leaves when its processor is interrupted, or by an I/O exit after a
+  random while. One thread kicks the vCPUs in turn. The percentiles of
+  kick-to-exit latency and the redundant IPIs are reported from the
+  statistics of vCPUs.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/kick_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_vcpus				4
+#define nvtest_kicks				2000
+#define nvtest_kick_interval		512
+#define nvtest_guest_spins			1024
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_kick_vcpu(noir_cvm_virtual_cpu_p vcpu);
+
+noir_cvm_virtual_machine_p nvtest_vm;
+noir_cvm_virtual_cpu_p nvtest_vcpu[nvtest_vcpus];
+u32v nvtest_stop=false;
+u64v nvtest_runs=0;
+u64v nvtest_rescinded=0;
+
+// Simulate the world switch. The guest leaves on the interrupt of its processor, or by an I/O exit.
+void nvtest_run_guest(noir_cvm_virtual_cpu_p vcpu,u32 processor,u32 spins)
+{
+	const u32 kicks=nvtest_query_kick_count(processor);
+	((noir_svm_custom_vcpu_p)vcpu)->proc_id=processor;
+	vcpu->exit_context.intercept_code=cv_io_instruction;
+	noir_locked_bts(&vcpu->run_state,noir_cvm_vcpu_in_guest);
+	for(u32 i=0;i<spins;i++)
+	{
+		if(nvtest_query_kick_count(processor)!=kicks)
+		{
+			vcpu->exit_context.intercept_code=cv_scheduler_exit;
+			break;
+		}
+		noir_pause();
+	}
+	noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_in_guest);
+}
+
+u32 stdcall nvtest_runner(void* context)
+{
+	const u32 index=(u32)(ulong_ptr)context;
+	noir_cvm_virtual_cpu_p vcpu=nvtest_vcpu[index];
+	u64 seed=index+1;
+	while(!nvtest_stop)
+	{
+		const u32 state=nvc_enter_vcpu_run(nvtest_vm,vcpu);
+		if(noir_bt(&state,noir_cvm_vcpu_kicked))
+		{
+			vcpu->exit_context.intercept_code=cv_rescission;
+			noir_locked_inc64(&nvtest_rescinded);
+		}
+		else
+		{
+			seed=seed*6364136223846793005+1442695040888963407;
+			nvtest_run_guest(vcpu,index,(u32)((seed>>32)%nvtest_guest_spins));
+		}
+		nvc_leave_vcpu_run(vcpu);
+		noir_locked_inc64(&nvtest_runs);
+	}
+	return 0;
+}
+
+// Each kick is consumed before the next kick to the same vCPU, so that kicks are not coalesced.
+u32 stdcall nvtest_kicker(void* context)
+{
+	for(u32 i=0;i<nvtest_kicks;i++)
+	{
+		noir_cvm_virtual_cpu_p vcpu=nvtest_vcpu[i%nvtest_vcpus];
+		while(vcpu->run_state&(1<<noir_cvm_vcpu_kicked))noir_pause();
+		nvc_kick_vcpu(vcpu);
+		for(u32 j=0;j<nvtest_kick_interval;j++)noir_pause();
+	}
+	return 0;
+}
+
+// Histograms are log-scale, so a percentile is known by the upper bound of its bucket.
+u64 nvtest_percentile(noir_exit_histogram_p histogram,u32 percent)
+{
+	const u64 rank=(histogram->count*percent+99)/100;
+	u64 seen=0;
+	for(u32 i=0;i<noir_exit_profiler_buckets-1 && rank;i++)
+	{
+		seen+=histogram->buckets[i];
+		if(seen>=rank)return (2ull<<i)<histogram->max_cycles?(2ull<<i):histogram->max_cycles;
+	}
+	return histogram->max_cycles;
+}
+
+int main()
+{
+	noir_thread runners[nvtest_vcpus],kicker;
+	noir_exit_histogram latency={0};
+	u64 requested=0,coalesced=0,ipi_sent=0,ipi_redundant=0;
+	const double ns_per_cycle=1e9/(double)noir_query_tsc_frequency();
+	nvtest_check_eq(nvtest_initialize_svm(nvtest_vcpus+1),noir_success);
+	nvtest_check_eq(nvc_create_vm(&nvtest_vm,0),noir_success);
+	for(u32 i=0;i<nvtest_vcpus;i++)nvtest_check_eq(nvc_create_vcpu(nvtest_vm,&nvtest_vcpu[i],i),noir_success);
+	for(u32 i=0;i<nvtest_vcpus;i++)runners[i]=nvtest_create_thread(nvtest_runner,(void*)(ulong_ptr)i,i);
+	kicker=nvtest_create_thread(nvtest_kicker,null,nvtest_vcpus);
+	noir_join_thread(kicker);
+	nvtest_stop=true;
+	for(u32 i=0;i<nvtest_vcpus;i++)noir_join_thread(runners[i]);
+	for(u32 i=0;i<nvtest_vcpus;i++)
+	{
+		noir_cvm_vcpu_statistics_p stat=&nvtest_vcpu[i]->statistics;
+		requested+=stat->kick.requested;
+		coalesced+=stat->kick.coalesced;
+		ipi_sent+=stat->kick.ipi_sent;
+		ipi_redundant+=stat->kick.ipi_redundant;
+		latency.count+=stat->kick.latency.count;
+		latency.cycles+=stat->kick.latency.cycles;
+		if(stat->kick.latency.max_cycles>latency.max_cycles)latency.max_cycles=stat->kick.latency.max_cycles;
+		for(u32 j=0;j<noir_exit_profiler_buckets;j++)latency.buckets[j]+=stat->kick.latency.buckets[j];
+	}
+	nvtest_check_eq(requested,nvtest_kicks);
+	// Each kick is consumed once, except for those still pending on vCPUs.
+	nvtest_check_eq(coalesced,0);
+	nvtest_check(latency.count<=requested && latency.count+nvtest_vcpus>=requested);
+	nvtest_check(ipi_redundant<=ipi_sent);
+	nvtest_report("%llu runs (%llu rescinded), %llu kicks: %llu coalesced, %llu IPIs sent, %llu redundant (%.2f%%)\n",nvtest_runs,nvtest_rescinded,requested,coalesced,ipi_sent,ipi_redundant,ipi_sent?ipi_redundant*100.0/ipi_sent:0.0);
+	nvtest_report("Kick-to-exit latency of %llu kicks: mean %.0f ns, p50 <%.0f ns, p90 <%.0f ns, p99 <%.0f ns, max %.0f ns\n",latency.count,latency.count?latency.cycles*ns_per_cycle/latency.count:0.0,nvtest_percentile(&latency,50)*ns_per_cycle,nvtest_percentile(&latency,90)*ns_per_cycle,nvtest_percentile(&latency,99)*ns_per_cycle,latency.max_cycles*ns_per_cycle);
+	nvc_release_vm(nvtest_vm);
+	return nvtest_finish();
+}
@@ -0,0 +1,173 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the NPT radix tree of SVM-Core CVMs.
+  Guest memory of 1GiB, 16GiB and 64GiB is mapped, looked up and
+  unmapped in 4KiB pages through the CVM interface.
+  Dirty pages are harvested in between. The processor is simulated by
+  setting accessed and dirty flags in the raw entries it walks through.
+  The setup time of a 32GiB guest mapped by a single batch is measured
+  on a fresh VM and over existing mappings.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/npt_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+
+#define nvtest_host_base		0x4000000000
+#define nvtest_lookups			0x1000000
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+noir_status nvc_query_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
+noir_status nvc_svmc_set_mapping_batch(noir_svm_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array);
+
+// Set the accessed flags of the entries walked through. The dirty flag is set in the PTE if specified.
+void nvtest_guest_access(noir_svm_custom_npt_manager_p nptm,u64 gpa,bool write)
+{
+	u64p table=(u64p)nptm->ncr3.virt;
+	for(u32 level=3;level;level--)
+	{
+		u64p entry=&table[(gpa>>(page_4kb_shift+level*9))&0x1ff];
+		*entry|=0x20;
+		table=(u64p)noir_find_virt_by_phys(*entry&0xFFFFFFFFFF000);
+	}
+	table[(gpa>>page_4kb_shift)&0x1ff]|=write?0x60:0x20;
+}
+
+double nvtest_harvest_us_per_gb(noir_cvm_virtual_machine_p vm,u8p bitmap,u64 pages,u32 gigabytes)
+{
+	u64 t0=nvtest_time_ns(),t1;
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,(u32)pages,bitmap,(u32)(pages>>3),false),noir_success);
+	t1=nvtest_time_ns();
+	return (double)(t1-t0)/1e3/gigabytes;
+}
+
+void nvtest_benchmark_harvest(noir_cvm_virtual_machine_p vm,u64 pages,u32 gigabytes)
+{
+	noir_svm_custom_npt_manager_p nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	u8p bitmap=malloc(pages>>3);
+	double clean,sparse,touched;
+	// No table is accessed, so every page directory is skipped.
+	clean=nvtest_harvest_us_per_gb(vm,bitmap,pages,gigabytes);
+	// One in a hundred pages is written.
+	for(u64 i=0;i<pages;i+=100)nvtest_guest_access(nptm,page_4kb_mult(i),true);
+	sparse=nvtest_harvest_us_per_gb(vm,bitmap,pages,gigabytes);
+	nvtest_check_eq(bitmap[0]&1,1);
+	// Every page table is accessed but no page is written, so all page tables are read.
+	for(u64 i=0;i<pages;i+=page_table_entries64)nvtest_guest_access(nptm,page_4kb_mult(i),false);
+	touched=nvtest_harvest_us_per_gb(vm,bitmap,pages,gigabytes);
+	nvtest_check_eq(bitmap[0]&1,0);
+	nvtest_report("%2u GiB: harvest %8.2f us/GiB clean, %8.2f us/GiB with 1%% written, %8.2f us/GiB with all tables accessed\n",gigabytes,clean,sparse,touched);
+	free(bitmap);
+}
+
+void nvtest_benchmark_npt(u32 gigabytes)
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_npt_manager_p nptm;
+	noir_cvm_address_mapping map_info={0};
+	u64 t0,t1,t2,t3,t4,hpa,seed=gigabytes;
+	u64 pages=page_4kb_count(page_1gb_mult((u64)gigabytes));
+	u32 tables;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	// Map the guest memory in 1GiB chunks.
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.pages=page_4kb_count(page_1gb_size);
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<gigabytes;i++)
+	{
+		map_info.gpa=page_1gb_mult((u64)i);
+		map_info.hva=nvtest_host_base+map_info.gpa;
+		nvtest_check_eq(nvc_set_mapping(vm,&map_info),noir_success);
+	}
+	t1=nvtest_time_ns();
+	tables=nptm->tables.pdpte+nptm->tables.pde+nptm->tables.pte;
+	// Look up random pages.
+	for(u32 i=0;i<nvtest_lookups;i++)
+	{
+		u64 gpa;
+		seed=seed*6364136223846793005+1442695040888963407;
+		gpa=page_4kb_mult((seed>>16)%pages);
+		if(!nvc_svmc_get_physical_mapping(nptm,gpa,&hpa,true,true,true) || hpa!=nvtest_host_base+gpa)
+		{
+			nvtest_check_eq(hpa,nvtest_host_base+gpa);
+			break;
+		}
+	}
+	t2=nvtest_time_ns();
+	nvtest_benchmark_harvest(vm,pages,gigabytes);
+	t3=nvtest_time_ns();
+	// Unmap the guest memory.
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=false;
+	for(u32 i=0;i<gigabytes;i++)
+	{
+		map_info.gpa=page_1gb_mult((u64)i);
+		nvtest_check_eq(nvc_set_mapping(vm,&map_info),noir_success);
+	}
+	t4=nvtest_time_ns();
+	// Unmapping 1GiB ranges releases all page directories and page tables.
+	nvtest_check_eq(nptm->tables.pde+nptm->tables.pte,0);
+	nvtest_report("%2u GiB: map %7.2f ns/page, lookup %6.2f ns, unmap %7.2f ns/page, %u paging structures\n",gigabytes,(double)(t1-t0)/pages,(double)(t2-t1)/nvtest_lookups,(double)(t4-t3)/pages,tables);
+	nvc_release_vm(vm);
+}
+
+// Map the guest memory with a batch of 1GiB ranges in 2MiB pages, the way a VMM sets up its guest.
+void nvtest_benchmark_batch(u32 gigabytes)
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_address_mapping_p ranges=malloc(sizeof(noir_cvm_address_mapping)*gigabytes);
+	const u64 pages=page_4kb_count(page_1gb_mult((u64)gigabytes));
+	u64p phys_array=malloc(pages<<3);
+	u64 t0,t1,t2;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	for(u64 i=0;i<pages;i++)phys_array[i]=nvtest_host_base+page_4kb_mult(i);
+	for(u32 i=0;i<gigabytes;i++)
+	{
+		ranges[i].gpa=page_1gb_mult((u64)i);
+		ranges[i].hva=nvtest_host_base+ranges[i].gpa;
+		ranges[i].pages=page_table_entries64;
+		ranges[i].attributes.value=0;
+		ranges[i].attributes.present=ranges[i].attributes.write=ranges[i].attributes.execute=true;
+		ranges[i].attributes.caching=noir_cvm_memory_wb;
+		ranges[i].attributes.psize=1;
+	}
+	t0=nvtest_time_ns();
+	nvtest_check_eq(nvc_svmc_set_mapping_batch((noir_svm_custom_vm_p)vm,ranges,gigabytes,phys_array),noir_success);
+	t1=nvtest_time_ns();
+	// Mapping the batch again overwrites present translations.
+	nvtest_check_eq(nvc_svmc_set_mapping_batch((noir_svm_custom_vm_p)vm,ranges,gigabytes,phys_array),noir_success);
+	t2=nvtest_time_ns();
+	nvtest_report("%2u GiB batch in 2MiB pages: setup %8.2f ms fresh, %8.2f ms over present mappings\n",gigabytes,(double)(t1-t0)/1e6,(double)(t2-t1)/1e6);
+	nvc_release_vm(vm);
+	free(phys_array);
+	free(ranges);
+}
+
+int main()
+{
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	// Large pages are disabled so that all levels of the radix tree are exercised.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=false;
+	nvtest_benchmark_npt(1);
+	nvtest_benchmark_npt(16);
+	nvtest_benchmark_npt(64);
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	nvtest_benchmark_batch(32);
+	return nvtest_finish();
+}
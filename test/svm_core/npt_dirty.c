@@ -0,0 +1,161 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the dirty-page harvest of SVM-Core CVMs.
+  The processor is simulated by setting accessed flags in the raw NPT
+  entries it walks through and the dirty flag in the leaf entry. Tables
+  below an entry whose accessed flag is clear must be skipped only if
+  the harvested range covers the entry entirely.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/npt_dirty.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_host_base		0x40000000
+#define nvtest_guest_pages		0x80000
+#define nvtest_accessed_bit		0x20
+#define nvtest_dirty_bit		0x40
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+noir_status nvc_query_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
+
+u8 nvtest_bitmap[nvtest_guest_pages>>3];
+
+noir_status nvtest_map(noir_cvm_virtual_machine_p vm,u64 gpa,u32 pages,u32 psize)
+{
+	noir_cvm_address_mapping map_info={0};
+	map_info.gpa=gpa;
+	map_info.hva=nvtest_host_base+gpa;
+	map_info.pages=pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.attributes.caching=6;
+	map_info.attributes.psize=psize;
+	return nvc_set_mapping(vm,&map_info);
+}
+
+// Walk the nested paging structures in the way the processor does and return the leaf entry.
+// Entries walked through are marked accessed if the walk is for an access.
+u64p nvtest_leaf(noir_svm_custom_npt_manager_p nptm,u64 gpa,bool access)
+{
+	u64p table=(u64p)nptm->ncr3.virt;
+	for(u32 level=3;;level--)
+	{
+		u64p entry=&table[(gpa>>(page_4kb_shift+level*9))&0x1ff];
+		if(!(*entry&1))return null;
+		if(access)*entry|=nvtest_accessed_bit;
+		// Large pages are indicated by bit 7 of PDEs and PDPTEs.
+		if(level==0 || (level<3 && (*entry&0x80)))return entry;
+		table=(u64p)noir_find_virt_by_phys(*entry&0xFFFFFFFFFF000);
+	}
+}
+
+void nvtest_guest_write(noir_svm_custom_npt_manager_p nptm,u64 gpa)
+{
+	u64p entry=nvtest_leaf(nptm,gpa,true);
+	nvtest_check(entry!=null);
+	if(entry)*entry|=nvtest_dirty_bit;
+}
+
+u32 nvtest_harvest(noir_cvm_virtual_machine_p vm,u64 gpa,u32 pages)
+{
+	u32 count=0;
+	noir_stosb(nvtest_bitmap,0xcc,sizeof(nvtest_bitmap));
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,gpa,pages,nvtest_bitmap,sizeof(nvtest_bitmap),false),noir_success);
+	for(u32 i=0;i<pages;i++)count+=noir_bt((u32p)nvtest_bitmap,i);
+	return count;
+}
+
+void nvtest_page_sizes()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_npt_manager_p nptm;
+	const u64 gb_pages=page_4kb_count(page_1gb_size);
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	// The first 1GiB is a 1GiB page. The second 1GiB has a 2MiB page followed by 4KiB pages.
+	nvtest_check_eq(nvtest_map(vm,0,1,2),noir_success);
+	nvtest_check_eq(nvtest_map(vm,page_1gb_size,1,1),noir_success);
+	// Large pages are disabled so that contiguous 4KiB pages are not coalesced.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=false;
+	nvtest_check_eq(nvtest_map(vm,page_1gb_size+page_2mb_size,1024,0),noir_success);
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	// Mapping does not make any page dirty.
+	nvtest_check_eq(nvtest_harvest(vm,0,nvtest_guest_pages),0);
+	// Writes to large pages dirty all of their 4KiB pages.
+	nvtest_guest_write(nptm,0x12345678);
+	nvtest_guest_write(nptm,page_1gb_size+0x1234);
+	nvtest_guest_write(nptm,page_1gb_size+page_2mb_size+page_4kb_mult(3));
+	nvtest_guest_write(nptm,page_1gb_size+page_2mb_size+page_4kb_mult(1023));
+	nvtest_check_eq(nvtest_harvest(vm,0,nvtest_guest_pages),gb_pages+512+2);
+	nvtest_check(noir_bt((u32p)nvtest_bitmap,gb_pages-1));
+	nvtest_check(noir_bt((u32p)nvtest_bitmap,gb_pages+511));
+	nvtest_check(noir_bt((u32p)nvtest_bitmap,gb_pages+512+3));
+	nvtest_check(noir_bt((u32p)nvtest_bitmap,gb_pages+512+1023));
+	// Dirty and accessed flags are re-armed.
+	nvtest_check_eq(*nvtest_leaf(nptm,0,false)&nvtest_dirty_bit,0);
+	nvtest_check_eq(*nvtest_leaf(nptm,page_1gb_size+page_2mb_size+page_4kb_mult(3),false)&nvtest_dirty_bit,0);
+	nvtest_check_eq(nvtest_harvest(vm,0,nvtest_guest_pages),0);
+	// Harvests starting in the middle of a large page report the pages in range.
+	nvtest_guest_write(nptm,page_1gb_size);
+	nvtest_check_eq(nvtest_harvest(vm,page_1gb_size+page_4kb_mult(500),20),12);
+	nvc_release_vm(vm);
+}
+
+void nvtest_skip_unaccessed_tables()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_vm_p svm_vm;
+	noir_svm_custom_npt_manager_p nptm;
+	u64p pde;
+	u32 generation;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	svm_vm=(noir_svm_custom_vm_p)vm;
+	nptm=&svm_vm->nptm;
+	// Pages 0-1023 are 4KiB pages in two page tables.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=false;
+	nvtest_check_eq(nvtest_map(vm,0,1024,0),noir_success);
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	// A clean harvest does not flush the TLB.
+	generation=svm_vm->tlb_tracker.generation;
+	nvtest_check_eq(nvtest_harvest(vm,0,1024),0);
+	nvtest_check_eq(svm_vm->tlb_tracker.generation,generation);
+	// A dirty harvest flushes the TLB so that the flags could be set again.
+	nvtest_guest_write(nptm,page_4kb_mult(700));
+	nvtest_check_eq(nvtest_harvest(vm,0,1024),1);
+	nvtest_check(svm_vm->tlb_tracker.generation!=generation);
+	nvtest_check_eq(*nvtest_leaf(nptm,page_4kb_mult(700),false)&nvtest_dirty_bit,0);
+	// The PDE is re-armed along with the PTE.
+	pde=(u64p)noir_find_virt_by_phys(*(u64p)noir_find_virt_by_phys(*(u64p)nptm->ncr3.virt&0xFFFFFFFFFF000)&0xFFFFFFFFFF000);
+	nvtest_check_eq(pde[1]&nvtest_accessed_bit,0);
+	// A dirty PTE below an unaccessed PDE is skipped if the PDE is covered entirely.
+	*nvtest_leaf(nptm,page_4kb_mult(700),false)|=nvtest_dirty_bit;
+	nvtest_check_eq(nvtest_harvest(vm,0,1024),0);
+	nvtest_check(*nvtest_leaf(nptm,page_4kb_mult(700),false)&nvtest_dirty_bit);
+	// It is read if the PDE is covered partially.
+	nvtest_check_eq(nvtest_harvest(vm,page_4kb_mult(600),200),1);
+	nvtest_check(noir_bt((u32p)nvtest_bitmap,100));
+	nvc_release_vm(vm);
+}
+
+int main()
+{
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	nvtest_page_sizes();
+	nvtest_skip_unaccessed_tables();
+	return nvtest_finish();
+}
@@ -0,0 +1,192 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests 2MiB and 1GiB guest mappings of SVM-Core CVMs.
+  Walk results and counts of paging structures are checked before and
+  after large pages are split and coalesced, and after a batch of
+  mappings fails halfway.
+  GCC truncates shifts of bit-fields to the width of the bit-field, so
+  the page frames of large pages are checked with a walker over the raw
+  entries, and host ranges of large pages are kept below 2GiB.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/npt_split.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_host_base		0x40000000
+#define nvtest_guest_base		0x40000000
+#define nvtest_remap_base		0x7FE00000
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+
+noir_status nvtest_map(noir_cvm_virtual_machine_p vm,u64 gpa,u64 hva,u32 pages,u32 psize,bool present)
+{
+	noir_cvm_address_mapping map_info={0};
+	map_info.gpa=gpa;
+	map_info.hva=hva;
+	map_info.pages=pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=present;
+	map_info.attributes.caching=6;
+	map_info.attributes.psize=psize;
+	return nvc_set_mapping(vm,&map_info);
+}
+
+// Walk the nested paging structures in the way the processor does.
+u64 nvtest_walk(noir_svm_custom_npt_manager_p nptm,u64 gpa)
+{
+	u64p table=(u64p)nptm->ncr3.virt;
+	for(u32 level=3;;level--)
+	{
+		const u32 shift=page_4kb_shift+level*9;
+		const u64 entry=table[(gpa>>shift)&0x1ff];
+		const u64 base=entry&0xFFFFFFFFFF000;
+		if(!(entry&1))return 0;
+		// Large pages are indicated by bit 7 of PDEs and PDPTEs.
+		if(level==0 || (level<3 && (entry&0x80)))
+			return (base&~((1ull<<shift)-1))|(gpa&((1ull<<shift)-1));
+		table=(u64p)noir_find_virt_by_phys(base);
+	}
+}
+
+void nvtest_check_tables(noir_svm_custom_npt_manager_p nptm,u32 pdpte,u32 pde,u32 pte)
+{
+	nvtest_check_eq(nptm->tables.pdpte,pdpte);
+	nvtest_check_eq(nptm->tables.pde,pde);
+	nvtest_check_eq(nptm->tables.pte,pte);
+}
+
+void nvtest_1gb_page()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_npt_manager_p nptm;
+	const u64 split_gpa=nvtest_guest_base+0x12345000;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	// A 1GiB page takes only the PDPT.
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base,nvtest_host_base,1,2,true),noir_success);
+	nvtest_check_tables(nptm,1,0,0);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base),nvtest_host_base);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+0x678),nvtest_host_base+0x12345678);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+page_1gb_size),0);
+	// Remapping a 4KiB page splits the 1GiB page into 2MiB pages, and the 2MiB page into 4KiB pages.
+	nvtest_check_eq(nvtest_map(vm,split_gpa,nvtest_remap_base,1,0,true),noir_success);
+	nvtest_check_tables(nptm,1,1,1);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+0x678),nvtest_remap_base+0x678);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa-page_size),nvtest_host_base+0x12344000);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+page_size),nvtest_host_base+0x12346000);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+0x3FFFF000),nvtest_host_base+0x3FFFF000);
+	// Restoring the page coalesces the range into a 1GiB page again.
+	nvtest_check_eq(nvtest_map(vm,split_gpa,nvtest_host_base+0x12345000,1,0,true),noir_success);
+	nvtest_check_tables(nptm,1,0,0);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+0x678),nvtest_host_base+0x12345678);
+	// Unmapping a 4KiB page splits the 1GiB page without coalescing.
+	nvtest_check_eq(nvtest_map(vm,split_gpa,0,1,0,false),noir_success);
+	nvtest_check_tables(nptm,1,1,1);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),0);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+page_size),nvtest_host_base+0x12346000);
+	// Unmapping the whole range releases the page directory and the page table.
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base,0,page_4kb_count(page_1gb_size),0,false),noir_success);
+	nvtest_check_tables(nptm,1,0,0);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa+page_size),0);
+	nvc_release_vm(vm);
+}
+
+void nvtest_2mb_page()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_npt_manager_p nptm;
+	const u64 split_gpa=nvtest_guest_base+0x201000;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	// Two 2MiB pages take the PDPT and the page directory.
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base,nvtest_host_base,2,1,true),noir_success);
+	nvtest_check_tables(nptm,1,1,0);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+0x1FFFFF),nvtest_host_base+0x1FFFFF);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),nvtest_host_base+0x201000);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+0x400000),0);
+	// Remapping a 4KiB page splits only the second 2MiB page.
+	nvtest_check_eq(nvtest_map(vm,split_gpa,nvtest_remap_base,1,0,true),noir_success);
+	nvtest_check_tables(nptm,1,1,1);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),nvtest_remap_base);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa-page_size),nvtest_host_base+0x200000);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+0x3FF000),nvtest_host_base+0x3FF000);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+0x1FF000),nvtest_host_base+0x1FF000);
+	// Mapping a 2MiB page over the split range supersedes the page table.
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base+0x200000,nvtest_remap_base,1,1,true),noir_success);
+	nvtest_check_tables(nptm,1,1,0);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),nvtest_remap_base+page_size);
+	// Unmapping the 2MiB page keeps the other 2MiB page.
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base+0x200000,0,1,1,false),noir_success);
+	nvtest_check_tables(nptm,1,1,0);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),0);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base),nvtest_host_base);
+	nvc_release_vm(vm);
+}
+
+// A batch failing at any allocation must restore the translations it has overwritten.
+void nvtest_batch_rollback()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_svm_custom_npt_manager_p nptm;
+	noir_cvm_address_mapping ranges[2]={0};
+	u64 phys_array[2]={nvtest_remap_base,nvtest_remap_base+page_size};
+	const u64 split_gpa=nvtest_guest_base+0x201000;
+	noir_status st=noir_insufficient_resources;
+	u32 budget=0;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nptm=&((noir_svm_custom_vm_p)vm)->nptm;
+	nvtest_check_eq(nvtest_map(vm,nvtest_guest_base,nvtest_host_base,2,1,true),noir_success);
+	// The first range splits a 2MiB page. The second one requires a new page directory.
+	for(u32 i=0;i<2;i++)
+	{
+		ranges[i].pages=1;
+		ranges[i].attributes.present=ranges[i].attributes.write=ranges[i].attributes.execute=true;
+		ranges[i].attributes.caching=6;
+	}
+	ranges[0].gpa=split_gpa;
+	ranges[1].gpa=nvtest_guest_base+page_1gb_size;
+	while(st!=noir_success)
+	{
+		nvtest_set_allocation_budget(budget++);
+		st=nvc_svmc_set_mapping_batch((noir_svm_custom_vm_p)vm,ranges,2,phys_array);
+		nvtest_set_allocation_budget(nvtest_unlimited_allocations);
+		if(st!=noir_success)
+		{
+			nvtest_check_eq(st,noir_insufficient_resources);
+			// The split 2MiB page is restored and merged again.
+			nvtest_check_eq(nvtest_walk(nptm,split_gpa),nvtest_host_base+0x201000);
+			nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+page_1gb_size),0);
+			nvtest_check_eq(nptm->tables.pte,0);
+		}
+	}
+	// Failures were injected before the mapping succeeded.
+	nvtest_check(budget>3);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa),nvtest_remap_base);
+	nvtest_check_eq(nvtest_walk(nptm,split_gpa-page_size),nvtest_host_base+0x200000);
+	nvtest_check_eq(nvtest_walk(nptm,nvtest_guest_base+page_1gb_size),nvtest_remap_base+page_size);
+	nvc_release_vm(vm);
+}
+
+int main()
+{
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	nvtest_1gb_page();
+	nvtest_2mb_page();
+	nvtest_batch_rollback();
+	return nvtest_finish();
+}
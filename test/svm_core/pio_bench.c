@@ -0,0 +1,148 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the scatter lists of string I/O instructions.
+  A 1MiB guest buffer is transferred by REP INS instructions. After
+  each exit, the user hypervisor completes the elements covered by the
+  scatter list, or a single element if there is no list, and the guest
+  re-executes the instruction with the remaining count. The exits per
+  KiB and the time to build each list are reported, and compared with
+  the emulation of one element per exit.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/pio_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+
+#define nvtest_buffer_pages		256
+#define nvtest_guest_pages		(nvtest_buffer_pages+4)
+#define nvtest_pml4_gpa			0x0000
+#define nvtest_pdpt_gpa			0x1000
+#define nvtest_pd_gpa			0x2000
+#define nvtest_pt_gpa			0x3000
+#define nvtest_buffer_gpa		0x4000
+// GVA 0x40200000 is translated by PML4[0], PDPT[1], PD[1].
+#define nvtest_gva_base			0x40200000
+#define nvtest_transfers		16
+
+#define nvtest_pte_present		0x1
+#define nvtest_pte_write		0x2
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+
+u64p nvtest_guest_memory;
+noir_cvm_pio_scatter_entry nvtest_list[noir_cvm_pio_scatter_limit];
+
+u64p nvtest_table(u64 gpa)
+{
+	return (u64p)((u8p)nvtest_guest_memory+gpa);
+}
+
+// If scattered, adjacent pages of the buffer are physically discontiguous.
+void nvtest_build_paging_structures(noir_cvm_virtual_cpu_p vcpu,bool scattered)
+{
+	nvtest_table(nvtest_pml4_gpa)[0]=nvtest_pdpt_gpa|nvtest_pte_present|nvtest_pte_write;
+	nvtest_table(nvtest_pdpt_gpa)[1]=nvtest_pd_gpa|nvtest_pte_present|nvtest_pte_write;
+	nvtest_table(nvtest_pd_gpa)[1]=nvtest_pt_gpa|nvtest_pte_present|nvtest_pte_write;
+	for(u32 i=0;i<nvtest_buffer_pages;i++)
+	{
+		const u32 page=scattered?(i*97)%nvtest_buffer_pages:i;
+		nvtest_table(nvtest_pt_gpa)[i]=(nvtest_buffer_gpa+page_4kb_mult(page))|nvtest_pte_present|nvtest_pte_write;
+	}
+	// Guest paging structures are changed without invalidations.
+	vcpu->state_cache.gt_valid=false;
+}
+
+// Returns the exits taken to transfer the whole buffer.
+u64 nvtest_transfer(noir_cvm_virtual_cpu_p vcpu,u32 size,bool df)
+{
+	noir_cvm_io_context_p io=&vcpu->exit_context.io;
+	const u64 elements=page_4kb_mult(nvtest_buffer_pages)/size;
+	u64 exits=0;
+	vcpu->exit_context.rflags=(u64)df<<amd64_rflags_df|2;
+	io->access.value=0;
+	io->access.io_type=1;
+	io->access.string=true;
+	io->access.repeat=true;
+	io->access.operand_size=size;
+	io->access.address_width=8;
+	io->rcx=elements;
+	io->rdi=df?nvtest_gva_base+page_4kb_mult(nvtest_buffer_pages)-size:nvtest_gva_base;
+	while(io->rcx)
+	{
+		u32 entries;
+		u32 count=nvc_build_pio_scatter_list(vcpu,nvtest_list,noir_cvm_pio_scatter_limit,&entries);
+		// Without a list, the element is emulated by the user hypervisor.
+		if(count==0)count=1;
+		io->rcx-=count;
+		if(df)
+			io->rdi-=count*size;
+		else
+			io->rdi+=count*size;
+		exits++;
+	}
+	return exits;
+}
+
+void nvtest_benchmark(noir_cvm_virtual_cpu_p vcpu,const char* layout,u32 size,bool df)
+{
+	const double kib=(double)page_4kb_mult(nvtest_buffer_pages)/1024;
+	u64 exits=0,t0,t1;
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_transfers;i++)exits+=nvtest_transfer(vcpu,size,df);
+	t1=nvtest_time_ns();
+	nvtest_check(exits!=0);
+	nvtest_report("%-10s %u-byte %-8s: %7.4f exits/KiB (%6.1f exits/KiB per element), %8.1f ns per exit\n",layout,size,df?"backward":"forward",(double)exits/nvtest_transfers/kib,1024.0/size,(double)(t1-t0)/exits);
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_virtual_cpu_p vcpu;
+	noir_cvm_address_mapping map_info={0};
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,0),noir_success);
+	nvtest_guest_memory=noir_alloc_contd_memory(page_4kb_mult(nvtest_guest_pages));
+	nvtest_check(nvtest_guest_memory!=null);
+	map_info.hva=(u64)nvtest_guest_memory;
+	map_info.pages=nvtest_guest_pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.attributes.caching=6;
+	nvtest_check_eq(nvc_set_mapping(vm,&map_info),noir_success);
+	// The vCPU is in Long Mode with 4-level paging.
+	vcpu->crs.cr0=amd64_cr0_pe_bit|amd64_cr0_wp_bit|amd64_cr0_pg_bit;
+	vcpu->crs.cr3=nvtest_pml4_gpa;
+	vcpu->crs.cr4=amd64_cr4_pae_bit;
+	vcpu->msrs.efer=amd64_efer_lme_bit|amd64_efer_lma_bit;
+	nvtest_report("Transfers of %u KiB by REP INS:\n",page_4kb_mult(nvtest_buffer_pages)/1024);
+	for(u32 i=0;i<2;i++)
+	{
+		const char* layout=i?"scattered":"contiguous";
+		nvtest_build_paging_structures(vcpu,i!=0);
+		for(u32 size=1;size<=4;size<<=1)
+		{
+			nvtest_benchmark(vcpu,layout,size,false);
+			nvtest_benchmark(vcpu,layout,size,true);
+		}
+	}
+	nvc_release_vm(vm);
+	noir_free_contd_memory(nvtest_guest_memory,page_4kb_mult(nvtest_guest_pages));
+	return nvtest_finish();
+}
@@ -0,0 +1,212 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the scatter lists of string I/O instructions.
+  The paging state of the guest is placed in a simulated VMCB and is
+  synchronized by the list builder. Buffers are transferred in both
+  directions, across physically contiguous and discontiguous pages,
+  and are truncated by pages that cannot be translated.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/pio_scatter.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+#include "../../src/svm_core/svm_vmcb.h"
+
+#define nvtest_guest_pages		32
+#define nvtest_pml4_gpa			0x0000
+#define nvtest_pdpt_gpa			0x1000
+#define nvtest_pd_gpa			0x2000
+#define nvtest_pt_gpa			0x3000
+// GVA 0x40200000 is translated by PML4[0], PDPT[1], PD[1].
+#define nvtest_gva_base			0x40200000
+
+#define nvtest_pte_present		0x1
+#define nvtest_pte_write		0x2
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+
+// Guest-physical pages of the buffer. Pages 0-3 are contiguous. Page 6 is not present.
+const u64 nvtest_buffer_gpa[8]={0x8000,0x9000,0xA000,0xB000,0x10000,0xE000,0,0xF000};
+
+u64p nvtest_guest_memory;
+noir_cvm_pio_scatter_entry nvtest_list[noir_cvm_pio_scatter_limit];
+u32 nvtest_entries;
+
+u64p nvtest_table(u64 gpa)
+{
+	return (u64p)((u8p)nvtest_guest_memory+gpa);
+}
+
+void nvtest_build_paging_structures()
+{
+	nvtest_table(nvtest_pml4_gpa)[0]=nvtest_pdpt_gpa|nvtest_pte_present|nvtest_pte_write;
+	nvtest_table(nvtest_pdpt_gpa)[1]=nvtest_pd_gpa|nvtest_pte_present|nvtest_pte_write;
+	nvtest_table(nvtest_pd_gpa)[1]=nvtest_pt_gpa|nvtest_pte_present|nvtest_pte_write;
+	for(u32 i=0;i<8;i++)
+		if(nvtest_buffer_gpa[i])
+			nvtest_table(nvtest_pt_gpa)[i]=nvtest_buffer_gpa[i]|nvtest_pte_present|nvtest_pte_write;
+}
+
+// The guest leaves by a string I/O instruction. The paging state is left in the VMCB.
+u32 nvtest_string_io(noir_cvm_virtual_cpu_p vcpu,bool in,bool rep,u32 size,u32 address_width,bool df,u64 rcx,u64 address,u32 limit)
+{
+	noir_svm_custom_vcpu_p cvcpu=(noir_svm_custom_vcpu_p)vcpu;
+	noir_cvm_io_context_p io=&vcpu->exit_context.io;
+	noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_cr0,amd64_cr0_pe_bit|amd64_cr0_wp_bit|amd64_cr0_pg_bit);
+	noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_cr3,nvtest_pml4_gpa);
+	noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_cr4,amd64_cr4_pae_bit);
+	noir_svm_vmwrite64(cvcpu->vmcb.virt,guest_efer,amd64_efer_lme_bit|amd64_efer_lma_bit|amd64_efer_svme_bit);
+	vcpu->crs.cr0=vcpu->crs.cr3=vcpu->crs.cr4=vcpu->msrs.efer=0;
+	vcpu->state_cache.value=0;
+	vcpu->state_cache.cr_valid=vcpu->state_cache.ef_valid=true;
+	vcpu->state_cache.synchronized=false;
+	vcpu->exit_context.rflags=(u64)df<<amd64_rflags_df|2;
+	io->access.value=0;
+	io->access.io_type=in;
+	io->access.string=true;
+	io->access.repeat=rep;
+	io->access.operand_size=size;
+	io->access.address_width=address_width;
+	io->rcx=rcx;
+	io->rdi=in?address:0xdeadbeef;
+	io->rsi=in?0xdeadbeef:address;
+	io->segment.base=0;
+	noir_stosb(nvtest_list,0xcc,sizeof(nvtest_list));
+	return nvc_build_pio_scatter_list(vcpu,nvtest_list,limit,&nvtest_entries);
+}
+
+void nvtest_check_entry(u32 index,u64 gpa,u32 length)
+{
+	nvtest_check_eq(nvtest_list[index].gpa,gpa);
+	nvtest_check_eq(nvtest_list[index].length,length);
+}
+
+void nvtest_zero_count(noir_cvm_virtual_cpu_p vcpu)
+{
+	// The rcx is zero. Nothing is transferred.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,0,nvtest_gva_base,noir_cvm_pio_scatter_limit),0);
+	nvtest_check_eq(nvtest_entries,0);
+	// The rcx is truncated by the address size.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,2,false,0x10000,nvtest_gva_base,noir_cvm_pio_scatter_limit),0);
+	nvtest_check_eq(nvtest_entries,0);
+	// The rcx is ignored without the rep prefix.
+	nvtest_check_eq(nvtest_string_io(vcpu,false,false,1,8,false,0,nvtest_gva_base+0x10,noir_cvm_pio_scatter_limit),1);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0x8010,1);
+}
+
+void nvtest_forward(noir_cvm_virtual_cpu_p vcpu)
+{
+	// The state in VMCB is synchronized.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,4,nvtest_gva_base+0xFF8,noir_cvm_pio_scatter_limit),4);
+	nvtest_check(vcpu->state_cache.synchronized);
+	nvtest_check_eq(vcpu->crs.cr4,amd64_cr4_pae_bit);
+	// Physically contiguous pages are merged.
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0x8FF8,16);
+	// Physically discontiguous pages are listed in the order of address.
+	nvtest_check_eq(nvtest_string_io(vcpu,false,true,4,8,false,4,nvtest_gva_base+0x3FF8,noir_cvm_pio_scatter_limit),4);
+	nvtest_check_eq(nvtest_entries,2);
+	nvtest_check_entry(0,0xBFF8,8);
+	nvtest_check_entry(1,0x10000,8);
+	// An element is split by the page boundary.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,2,nvtest_gva_base+0x3FFA,noir_cvm_pio_scatter_limit),2);
+	nvtest_check_eq(nvtest_entries,2);
+	nvtest_check_entry(0,0xBFFA,6);
+	nvtest_check_entry(1,0x10000,2);
+	// Elements are counted until the untranslatable page.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,1,8,false,0x20000,nvtest_gva_base,noir_cvm_pio_scatter_limit),0x6000);
+	nvtest_check_eq(nvtest_entries,3);
+	nvtest_check_entry(0,0x8000,0x4000);
+	nvtest_check_entry(1,0x10000,0x1000);
+	nvtest_check_entry(2,0xE000,0x1000);
+	// The address is truncated by the address size.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,2,4,false,8,0xFFFFFFFF00000000|(nvtest_gva_base+0x1FFC),noir_cvm_pio_scatter_limit),8);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0x9FFC,16);
+}
+
+void nvtest_backward(noir_cvm_virtual_cpu_p vcpu)
+{
+	// The first element is at the highest address. Ranges are still listed in the order of address.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,true,4,nvtest_gva_base+0x1004,noir_cvm_pio_scatter_limit),4);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0x8FF8,16);
+	nvtest_check_eq(nvtest_string_io(vcpu,false,true,4,8,true,4,nvtest_gva_base+0x4004,noir_cvm_pio_scatter_limit),4);
+	nvtest_check_eq(nvtest_entries,2);
+	nvtest_check_entry(0,0xBFF8,8);
+	nvtest_check_entry(1,0x10000,8);
+	// An element is split by the page boundary.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,true,2,nvtest_gva_base+0x4002,noir_cvm_pio_scatter_limit),2);
+	nvtest_check_eq(nvtest_entries,2);
+	nvtest_check_entry(0,0xBFFE,2);
+	nvtest_check_entry(1,0x10000,6);
+}
+
+void nvtest_partial(noir_cvm_virtual_cpu_p vcpu)
+{
+	// The element partially in the untranslatable page is excluded.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,4,nvtest_gva_base+0x5FF6,noir_cvm_pio_scatter_limit),2);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0xEFF6,8);
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,4,nvtest_gva_base+0x5FFE,noir_cvm_pio_scatter_limit),0);
+	nvtest_check_eq(nvtest_entries,0);
+	// In backward direction, the element below the untranslatable page is excluded.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,true,4,nvtest_gva_base+0x7002,noir_cvm_pio_scatter_limit),1);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0xF002,4);
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,true,4,nvtest_gva_base+0x6FFE,noir_cvm_pio_scatter_limit),0);
+	nvtest_check_eq(nvtest_entries,0);
+	// Elements are counted until the list is full.
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,4,nvtest_gva_base+0x3FF8,1),2);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0xBFF8,8);
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,false,4,nvtest_gva_base+0x3FFA,1),1);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0xBFFA,4);
+	nvtest_check_eq(nvtest_string_io(vcpu,true,true,4,8,true,4,nvtest_gva_base+0x4004,1),2);
+	nvtest_check_eq(nvtest_entries,1);
+	nvtest_check_entry(0,0x10000,8);
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_virtual_cpu_p vcpu;
+	noir_cvm_address_mapping map_info={0};
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,0),noir_success);
+	nvtest_guest_memory=noir_alloc_contd_memory(page_4kb_mult(nvtest_guest_pages));
+	nvtest_check(nvtest_guest_memory!=null);
+	map_info.hva=(u64)nvtest_guest_memory;
+	map_info.pages=nvtest_guest_pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.attributes.caching=6;
+	nvtest_check_eq(nvc_set_mapping(vm,&map_info),noir_success);
+	nvtest_build_paging_structures();
+	nvtest_zero_count(vcpu);
+	nvtest_forward(vcpu);
+	nvtest_backward(vcpu);
+	nvtest_partial(vcpu);
+	nvc_release_vm(vm);
+	noir_free_contd_memory(nvtest_guest_memory,page_4kb_mult(nvtest_guest_pages));
+	return nvtest_finish();
+}
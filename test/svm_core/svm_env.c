@@ -0,0 +1,62 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file prepares the simulated environment of SVM-Core tests.
+  Only the fields of the hypervisor structure that the CVM facility
+  refers to are initialized.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/svm_env.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+// Hypercalls are simulated. Only those that initialize or read memory structures are available.
+void stdcall noir_svm_vmmcall(u32 index,ulong_ptr context)
+{
+	switch(index)
+	{
+		case noir_svm_init_custom_vmcb:
+			nvc_svm_initialize_cvm_vmcb((noir_svm_custom_vcpu_p)context);
+			break;
+		case noir_cvm_dump_vcpu_vmcb:
+			nvc_svm_dump_guest_vcpu_state((noir_svm_custom_vcpu_p)context);
+			break;
+		default:
+			nvtest_privileged("noir_svm_vmmcall");
+			break;
+	}
+}
+
+noir_status nvtest_initialize_svm(u32 processors)
+{
+	noir_svm_hvm_p relative_hvm=noir_alloc_nonpg_memory(sizeof(noir_svm_hvm));
+	if(relative_hvm==null)return noir_insufficient_resources;
+	nvtest_set_processor_count(processors);
+	hvm_p->cpu_count=processors;
+	hvm_p->selected_core=use_svm_core;
+	hvm_p->relative_hvm=relative_hvm;
+	relative_hvm->virt_cap.asid_limit=0x8000;
+	// ASIDs are assigned in the same way as SVM-Core without SEV.
+	hvm_p->tlb_tagging.start=2;
+	hvm_p->tlb_tagging.limit=relative_hvm->virt_cap.asid_limit-2;
+	hvm_p->tlb_tagging.asid_pool=noir_alloc_nonpg_memory(relative_hvm->virt_cap.asid_limit>>3);
+	hvm_p->tlb_tagging.asid_pool_lock=noir_initialize_reslock();
+	if(hvm_p->tlb_tagging.asid_pool==null || hvm_p->tlb_tagging.asid_pool_lock==null)return noir_insufficient_resources;
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	hvm_p->xfeat.supported_size_max=page_size;
+	// The Page Attribute Table is in its power-on state.
+	hvm_p->host_pat.value=0x0007040600070406;
+	return nvc_svmc_initialize_cvm_module();
+}
@@ -0,0 +1,60 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the NUMA placement of SVM-Core CVM vCPUs.
+  Four simulated processors are evenly distributed to two nodes. Each
+  vCPU is created on a different processor, and its structures must be
+  allocated from the node of the creating processor.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/vcpu_numa.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_processors		4
+#define nvtest_nodes			2
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	nvtest_check_eq(nvtest_initialize_svm(nvtest_processors),noir_success);
+	nvtest_set_numa_node_count(nvtest_nodes);
+	// Processors 0-1 are on node 0. Processors 2-3 are on node 1.
+	for(u32 i=0;i<nvtest_processors;i++)
+		nvtest_check_eq(noir_get_processor_numa_node(i),i*nvtest_nodes/nvtest_processors);
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	// The VM is shared by all vCPUs, so it is not placed on any node.
+	nvtest_check_eq(nvtest_query_allocation_node(vm),nvtest_numa_node_unknown);
+	for(u32 i=0;i<nvtest_processors;i++)
+	{
+		const u32 node=i*nvtest_nodes/nvtest_processors;
+		noir_cvm_virtual_cpu_p vcpu;
+		noir_svm_custom_vcpu_p cvcpu;
+		// Create vCPU i on processor 3-i, so that the placement does not follow the vCPU index.
+		nvtest_set_current_processor(nvtest_processors-1-i);
+		nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,i),noir_success);
+		cvcpu=(noir_svm_custom_vcpu_p)vcpu;
+		nvtest_check_eq(nvtest_query_allocation_node(cvcpu),nvtest_nodes-1-node);
+		nvtest_check_eq(nvtest_query_allocation_node(cvcpu->vmcb.virt),nvtest_nodes-1-node);
+		nvtest_check_eq(nvtest_query_allocation_node(cvcpu->header.xsave_area),nvtest_nodes-1-node);
+	}
+	nvc_release_vm(vm);
+	nvtest_set_current_processor(0);
+	return nvtest_finish();
+}
@@ -0,0 +1,298 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file stress-tests the run-state protocol of CVM vCPUs.
+  Runner threads repeatedly run vCPUs in simulated guest mode, while
+  other threads take VM-wide and per-vCPU exclusions. No thread may be
+  in the run path of a vCPU while an exclusion of it is held. Runs that
+  are preempted by exclusions are resumed rather than rescinded.
+  A run preempted by a VM-wide exclusion must re-enter the guest once the
+  exclusion ends, and only an explicit kick may rescind it.
+  Finally, the VM is released while a vCPU stays in guest mode until it
+  is kicked, so the release must kick the vCPU and wait for it to leave.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/vcpu_run.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_vcpus				4
+#define nvtest_processors			8
+#define nvtest_exclusions			2000
+#define nvtest_min_runs				100000
+#define nvtest_guest_spins			64
+#define nvtest_park_interval		256
+#define nvtest_guest_timeout		5000000000
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_kick_vcpu(noir_cvm_virtual_cpu_p vcpu);
+
+noir_cvm_virtual_machine_p nvtest_vm;
+noir_cvm_virtual_cpu_p nvtest_vcpu[nvtest_vcpus];
+u32v nvtest_in_run[nvtest_vcpus];
+u32v nvtest_vcpu_excluded[nvtest_vcpus];
+u32v nvtest_vm_excluded=0;
+u32v nvtest_violations=0;
+u32v nvtest_stop=false;
+u64v nvtest_runs=0;
+u64v nvtest_rescinded=0;
+u64v nvtest_busy=0;
+u64v nvtest_parks=0;
+u64v nvtest_resumes=0;
+u64v nvtest_vm_exclusions=0;
+u64v nvtest_vcpu_exclusions=0;
+u32v nvtest_in_guest=false;
+u32v nvtest_guest_entries=0;
+u32v nvtest_left=false;
+
+void nvtest_check_vm_exclusion()
+{
+	for(u32 i=0;i<nvtest_vcpus;i++)
+		if(nvtest_in_run[i])
+			noir_locked_inc(&nvtest_violations);
+}
+
+// Simulate the world switch: stay in guest mode until the vCPU is kicked or preempted, or for a while.
+// A kick or preemption published before the vCPU enters guest mode returns at once, as is done by SVM-Core.
+void nvtest_run_guest(noir_cvm_virtual_cpu_p vcpu,u32 processor,u32 spins)
+{
+	const u32 leave_mask=(1<<noir_cvm_vcpu_kicked)|(1<<noir_cvm_vcpu_preempted);
+	((noir_svm_custom_vcpu_p)vcpu)->proc_id=processor;
+	if(!(noir_locked_or(&vcpu->run_state,1<<noir_cvm_vcpu_in_guest)&leave_mask))
+		for(u32 i=0;i<spins && !(vcpu->run_state&leave_mask);i++)noir_pause();
+	noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_in_guest);
+	vcpu->exit_context.intercept_code=cv_scheduler_exit;
+}
+
+// Exclusive operations in the run path trade the running bit, as is done by nvc_svmc_gain_exclusion.
+void nvtest_park(noir_cvm_virtual_cpu_p vcpu,u32 index)
+{
+	noir_locked_dec(&nvtest_in_run[index]);
+	nvc_park_vcpu_run(vcpu);
+	noir_acquire_reslock_shared(nvtest_vm->vcpu_list_lock);
+	nvc_acquire_vm_exclusion(nvtest_vm);
+	if(noir_locked_inc(&nvtest_vm_excluded)!=1)noir_locked_inc(&nvtest_violations);
+	nvtest_check_vm_exclusion();
+	noir_locked_dec(&nvtest_vm_excluded);
+	nvc_release_vm_exclusion(nvtest_vm);
+	noir_release_reslock(nvtest_vm->vcpu_list_lock);
+	nvc_unpark_vcpu_run(vcpu);
+	noir_locked_inc(&nvtest_in_run[index]);
+	noir_locked_inc64(&nvtest_parks);
+}
+
+bool nvtest_run_vcpu(u32 index,u32 processor,bool park)
+{
+	noir_cvm_virtual_cpu_p vcpu=nvtest_vcpu[index];
+	u32 state=nvc_enter_vcpu_run(nvtest_vm,vcpu);
+	if(noir_bt(&state,noir_cvm_vcpu_running))
+	{
+		noir_locked_inc64(&nvtest_busy);
+		return false;
+	}
+	if(noir_locked_inc(&nvtest_in_run[index])!=1)noir_locked_inc(&nvtest_violations);
+	if(nvtest_vm_excluded || nvtest_vcpu_excluded[index])noir_locked_inc(&nvtest_violations);
+	if(noir_bt(&state,noir_cvm_vcpu_kicked))
+	{
+		vcpu->exit_context.intercept_code=cv_rescission;
+		noir_locked_inc64(&nvtest_rescinded);
+	}
+	else
+	{
+		// Re-enter the guest if the run is preempted, as is done by nvc_svmc_run_vcpu.
+		while(1)
+		{
+			nvtest_run_guest(vcpu,processor,nvtest_guest_spins);
+			if(park)nvtest_park(vcpu,index);
+			park=false;
+			noir_locked_dec(&nvtest_in_run[index]);
+			if(!nvc_resume_preempted_vcpu_run(nvtest_vm,vcpu))break;
+			if(noir_locked_inc(&nvtest_in_run[index])!=1)noir_locked_inc(&nvtest_violations);
+			if(nvtest_vm_excluded || nvtest_vcpu_excluded[index])noir_locked_inc(&nvtest_violations);
+			noir_locked_inc64(&nvtest_resumes);
+		}
+		noir_locked_inc(&nvtest_in_run[index]);
+	}
+	noir_locked_dec(&nvtest_in_run[index]);
+	nvc_leave_vcpu_run(vcpu);
+	noir_locked_inc64(&nvtest_runs);
+	return true;
+}
+
+u32 stdcall nvtest_runner(void* context)
+{
+	const u32 index=(u32)(ulong_ptr)context;
+	for(u32 i=1;!nvtest_stop;i++)nvtest_run_vcpu(index,index,i%nvtest_park_interval==0);
+	return 0;
+}
+
+// The thief runs the vCPUs of other runners. It either gets the vCPU or finds it already running.
+u32 stdcall nvtest_thief(void* context)
+{
+	for(u32 i=0;!nvtest_stop;i++)nvtest_run_vcpu(i%nvtest_vcpus,nvtest_vcpus,false);
+	return 0;
+}
+
+// Exclusions continue until the runners have run enough.
+u32 stdcall nvtest_vm_excluder(void* context)
+{
+	for(u32 i=0;i<nvtest_exclusions || nvtest_runs<nvtest_min_runs;i++)
+	{
+		noir_acquire_reslock_shared(nvtest_vm->vcpu_list_lock);
+		nvc_acquire_vm_exclusion(nvtest_vm);
+		if(noir_locked_inc(&nvtest_vm_excluded)!=1)noir_locked_inc(&nvtest_violations);
+		nvtest_check_vm_exclusion();
+		for(u32 j=0;j<16;j++)noir_pause();
+		nvtest_check_vm_exclusion();
+		noir_locked_dec(&nvtest_vm_excluded);
+		nvc_release_vm_exclusion(nvtest_vm);
+		noir_release_reslock(nvtest_vm->vcpu_list_lock);
+		nvtest_vm_exclusions++;
+	}
+	return 0;
+}
+
+u32 stdcall nvtest_vcpu_excluder(void* context)
+{
+	for(u32 i=0;i<nvtest_exclusions || nvtest_runs<nvtest_min_runs;i++)
+	{
+		const u32 index=i%nvtest_vcpus;
+		nvc_acquire_vcpu_exclusion(nvtest_vcpu[index]);
+		if(noir_locked_inc(&nvtest_vcpu_excluded[index])!=1)noir_locked_inc(&nvtest_violations);
+		if(nvtest_in_run[index])noir_locked_inc(&nvtest_violations);
+		for(u32 j=0;j<16;j++)noir_pause();
+		if(nvtest_in_run[index])noir_locked_inc(&nvtest_violations);
+		noir_locked_dec(&nvtest_vcpu_excluded[index]);
+		nvc_release_vcpu_exclusion(nvtest_vcpu[index]);
+		nvtest_vcpu_exclusions++;
+	}
+	return 0;
+}
+
+void nvtest_stress()
+{
+	noir_thread runners[nvtest_vcpus],thief,excluders[2];
+	u64 kicks=0,t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_vcpus;i++)runners[i]=nvtest_create_thread(nvtest_runner,(void*)(ulong_ptr)i,i);
+	thief=nvtest_create_thread(nvtest_thief,null,nvtest_vcpus);
+	excluders[0]=nvtest_create_thread(nvtest_vm_excluder,null,nvtest_vcpus+1);
+	excluders[1]=nvtest_create_thread(nvtest_vcpu_excluder,null,nvtest_vcpus+2);
+	noir_join_thread(excluders[0]);
+	noir_join_thread(excluders[1]);
+	nvtest_stop=true;
+	for(u32 i=0;i<nvtest_vcpus;i++)noir_join_thread(runners[i]);
+	noir_join_thread(thief);
+	nvtest_check_eq(nvtest_violations,0);
+	nvtest_check(nvtest_runs!=0);
+	nvtest_check(nvtest_parks!=0);
+	// All runs have left. No vCPU is running, excluded, preempted or in guest mode.
+	for(u32 i=0;i<nvtest_vcpus;i++)
+	{
+		nvtest_check_eq(nvtest_vcpu[i]->run_state,0);
+		kicks+=nvtest_vcpu[i]->statistics.kick.requested;
+	}
+	// Exclusions preempt the vCPUs rather than kicking them. Nothing is rescinded.
+	nvtest_check_eq(kicks,0);
+	nvtest_check_eq(nvtest_rescinded,0);
+	nvtest_check_eq(nvtest_vm->exclusion_gen&1,0);
+	nvtest_report("%llu runs (%llu rescinded, %llu busy, %llu parked, %llu resumed after preemption), %llu VM and %llu vCPU exclusions in %.2f ms\n",nvtest_runs,nvtest_rescinded,nvtest_busy,nvtest_parks,nvtest_resumes,nvtest_vm_exclusions,nvtest_vcpu_exclusions,(nvtest_time_ns()-t0)/1e6);
+}
+
+// This runner stays in guest mode until it is kicked or preempted. Preempted runs are resumed.
+u32 stdcall nvtest_long_runner(void* context)
+{
+	noir_cvm_virtual_cpu_p vcpu=nvtest_vcpu[0];
+	const u32 state=nvc_enter_vcpu_run(nvtest_vm,vcpu);
+	if(noir_bt(&state,noir_cvm_vcpu_running) || noir_bt(&state,noir_cvm_vcpu_kicked))
+		noir_locked_inc(&nvtest_violations);
+	else
+	{
+		do
+		{
+			const u32 leave_mask=(1<<noir_cvm_vcpu_kicked)|(1<<noir_cvm_vcpu_preempted);
+			const u64 t0=nvtest_time_ns();
+			((noir_svm_custom_vcpu_p)vcpu)->proc_id=0;
+			noir_locked_bts(&vcpu->run_state,noir_cvm_vcpu_in_guest);
+			nvtest_guest_entries++;
+			nvtest_in_guest=true;
+			// Give up after a few seconds, so that a release that does not kick fails rather than hangs.
+			while(!(vcpu->run_state&leave_mask) && nvtest_time_ns()-t0<nvtest_guest_timeout)noir_pause();
+			nvtest_in_guest=false;
+			noir_locked_btr(&vcpu->run_state,noir_cvm_vcpu_in_guest);
+			vcpu->exit_context.intercept_code=cv_scheduler_exit;
+		}while(nvc_resume_preempted_vcpu_run(nvtest_vm,vcpu));
+	}
+	nvc_leave_vcpu_run(vcpu);
+	nvtest_left=true;
+	return 0;
+}
+
+// A VM-wide exclusion preempts the vCPU in guest mode. Its run waits for the exclusion without
+// holding the running bit, then re-enters the guest. Only the explicit kick rescinds the run.
+void nvtest_preempted_run()
+{
+	noir_cvm_virtual_cpu_p vcpu=nvtest_vcpu[0];
+	const u64 prev_requested=vcpu->statistics.kick.requested;
+	noir_thread runner=nvtest_create_thread(nvtest_long_runner,null,0);
+	while(!nvtest_in_guest && !nvtest_left)noir_pause();
+	noir_acquire_reslock_shared(nvtest_vm->vcpu_list_lock);
+	nvc_acquire_vm_exclusion(nvtest_vm);
+	// The run is resuming. It neither left nor re-entered the guest.
+	nvtest_check(!noir_bt(&vcpu->run_state,noir_cvm_vcpu_running));
+	nvtest_check(noir_bt(&vcpu->run_state,noir_cvm_vcpu_resuming));
+	nvtest_check(!noir_bt(&vcpu->run_state,noir_cvm_vcpu_in_guest));
+	nvtest_check_eq(vcpu->statistics.kick.requested,prev_requested);
+	nvtest_check(!nvtest_left);
+	nvc_release_vm_exclusion(nvtest_vm);
+	noir_release_reslock(nvtest_vm->vcpu_list_lock);
+	while(nvtest_guest_entries<2 && !nvtest_left)noir_pause();
+	while(!nvtest_in_guest && !nvtest_left)noir_pause();
+	nvtest_check(!nvtest_left);
+	nvtest_check_eq(nvc_kick_vcpu(vcpu),noir_success);
+	noir_join_thread(runner);
+	nvtest_check_eq(nvtest_guest_entries,2);
+	nvtest_check_eq(vcpu->exit_context.intercept_code,cv_rescission);
+	nvtest_check_eq(vcpu->run_state,0);
+	nvtest_check_eq(nvtest_violations,0);
+	nvtest_in_guest=false;
+	nvtest_left=false;
+}
+
+void nvtest_release_running_vm()
+{
+	const u32 prev_kicks=nvtest_query_kick_count(0);
+	noir_thread runner;
+	runner=nvtest_create_thread(nvtest_long_runner,null,0);
+	while(!nvtest_in_guest && !nvtest_left)noir_pause();
+	nvtest_check_eq(nvc_release_vm(nvtest_vm),noir_success);
+	// The release returns only after the vCPU has left.
+	nvtest_check(nvtest_left);
+	nvtest_check(nvtest_query_kick_count(0)>prev_kicks);
+	noir_join_thread(runner);
+	nvtest_check_eq(nvtest_violations,0);
+}
+
+int main()
+{
+	nvtest_check_eq(nvtest_initialize_svm(nvtest_processors),noir_success);
+	nvtest_check_eq(nvc_create_vm(&nvtest_vm,0),noir_success);
+	for(u32 i=0;i<nvtest_vcpus;i++)nvtest_check_eq(nvc_create_vcpu(nvtest_vm,&nvtest_vcpu[i],i),noir_success);
+	nvtest_stress();
+	nvtest_preempted_run();
+	nvtest_release_running_vm();
+	return nvtest_finish();
+}
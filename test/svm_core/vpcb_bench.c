@@ -0,0 +1,124 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the register groups shared by the VPCB.
+  The world switch is simulated, and the guest leaves its state cached
+  in the VMCB. After each exit, the user hypervisor reads all groups,
+  either by a view-register request for each register type, or from
+  the VPCB if the groups are published. Requests issued per exit, each
+  of which is a system call to the NoirVisor, and the latency spent in
+  the hypervisor per exit are reported.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/vpcb_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+#include "../../src/svm_core/svm_vmcb.h"
+
+#define nvtest_exits		200000
+// The x87 FPU and SSE states are enabled.
+#define nvtest_xcr0			3
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context);
+noir_status nvc_set_tunnel(noir_cvm_virtual_cpu_p vcpu,void* tunnel);
+noir_status nvc_view_vcpu_registers(noir_cvm_virtual_cpu_p vcpu,noir_cvm_register_type register_type,void* buffer,u32 buffer_size);
+
+// Register types covering the general-purpose, segment, control and FPU groups.
+const noir_cvm_register_type nvtest_views[]=
+{
+	noir_cvm_general_purpose_register,
+	noir_cvm_flags_register,
+	noir_cvm_instruction_pointer,
+	noir_cvm_segment_register,
+	noir_cvm_fgseg_register,
+	noir_cvm_descriptor_table,
+	noir_cvm_ldtr_task_register,
+	noir_cvm_control_register,
+	noir_cvm_cr2_register,
+	noir_cvm_cr8_register,
+	noir_cvm_fxstate
+};
+
+#define nvtest_view_count	(sizeof(nvtest_views)/sizeof(noir_cvm_register_type))
+
+noir_cvm_exit_context nvtest_exit_context;
+align_at(64) u8 nvtest_buffer[sizeof(noir_fx_state)];
+
+// Simulate the world switch. The guest state is left in VMCB.
+noir_status nvc_svmc_run_vcpu(noir_cvm_virtual_cpu_p vcpu)
+{
+	vcpu->rip+=2;
+	vcpu->state_cache.sr_valid=vcpu->state_cache.fg_valid=vcpu->state_cache.dt_valid=vcpu->state_cache.lt_valid=true;
+	vcpu->state_cache.cr_valid=vcpu->state_cache.cr2valid=vcpu->state_cache.tp_valid=true;
+	vcpu->state_cache.synchronized=false;
+	vcpu->exit_context.intercept_code=cv_hlt_instruction;
+	vcpu->exit_context.rip=vcpu->rip;
+	return noir_success;
+}
+
+// Returns the requests issued per exit.
+u32 nvtest_exit_by_views(noir_cvm_virtual_cpu_p vcpu)
+{
+	nvtest_check_eq(nvc_run_vcpu(vcpu,&nvtest_exit_context),noir_success);
+	for(u32 i=0;i<nvtest_view_count;i++)
+		nvtest_check_eq(nvc_view_vcpu_registers(vcpu,nvtest_views[i],nvtest_buffer,sizeof(nvtest_buffer)),noir_success);
+	return 1+nvtest_view_count;
+}
+
+u32 nvtest_exit_by_vpcb(noir_cvm_virtual_cpu_p vcpu)
+{
+	nvtest_check_eq(nvc_run_vcpu(vcpu,null),noir_success);
+	return 1;
+}
+
+void nvtest_benchmark(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb,const char* name,u32 publish)
+{
+	u64 requests=0,t0,t1;
+	vcpu->vcpu_options.use_tunnel=vpcb!=null;
+	if(vpcb)vpcb->registers.publish=publish;
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_exits;i++)requests+=vpcb?nvtest_exit_by_vpcb(vcpu):nvtest_exit_by_views(vcpu);
+	t1=nvtest_time_ns();
+	if(vpcb)nvtest_check_eq(vpcb->registers.valid,publish);
+	nvtest_report("%-24s: %5.1f system calls per exit, %6.1f ns per exit\n",name,(double)requests/nvtest_exits,(double)(t1-t0)/nvtest_exits);
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_virtual_cpu_p vcpu;
+	noir_cvm_vcpu_control_block_p vpcb;
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	hvm_p->xfeat.support_mask.value=nvtest_xcr0;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,0),noir_success);
+	vcpu->xcrs.xcr0=nvtest_xcr0;
+	vpcb=noir_alloc_nonpg_memory(sizeof(noir_cvm_vcpu_control_block));
+	nvtest_check(vpcb!=null);
+	nvtest_check_eq(nvc_set_tunnel(vcpu,vpcb),noir_success);
+	nvtest_report("Exits reading the general-purpose, segment, control and FPU registers:\n");
+	nvtest_benchmark(vcpu,null,"View-register requests",0);
+	nvtest_benchmark(vcpu,vpcb,"VPCB with all groups",noir_cvm_vpcb_group_mask);
+	// Handlers of most exits need nothing but the general-purpose registers, which are never synchronized.
+	nvtest_benchmark(vcpu,vpcb,"VPCB with GPR group",1<<noir_cvm_vpcb_group_gpr);
+	nvtest_benchmark(vcpu,vpcb,"VPCB without groups",0);
+	nvc_release_vm(vm);
+	noir_free_nonpg_memory(vpcb);
+	return nvtest_finish();
+}
@@ -0,0 +1,225 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the register groups shared by the VPCB.
+  The world switch is simulated: the guest changes every group on each
+  run, and leaves its control registers and descriptor tables cached in
+  the VMCB. Each group is published alone and must be synchronized from
+  the VMCB only if it is published. Each group is edited alone and must
+  be loaded, with its state cache invalidated, before the next run.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/svm_core/vpcb_registers.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <svm_intrin.h>
+#include <nv_intrin.h>
+#include <amd64.h>
+#include <nvtest.h>
+#include "../../src/svm_core/svm_vmcb.h"
+
+#define nvtest_groups		4
+// The x87 FPU and SSE states are enabled.
+#define nvtest_xcr0			3
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_create_vcpu(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p* vcpu,u32 vcpu_id);
+noir_status nvc_run_vcpu(noir_cvm_virtual_cpu_p vcpu,void* exit_context);
+noir_status nvc_set_tunnel(noir_cvm_virtual_cpu_p vcpu,void* tunnel);
+
+// The state of the vCPU when the simulated guest is entered.
+noir_cvm_vcpu_state_cache nvtest_entry_cache;
+noir_gpr_state nvtest_entry_gpr;
+noir_seg_state nvtest_entry_seg;
+noir_cr_state nvtest_entry_crs;
+u64 nvtest_entry_rip;
+u16 nvtest_entry_fcw;
+u64 nvtest_runs=0;
+
+// Values of the guest after the n-th run.
+u64 nvtest_guest_rax(u64 n){return 0x1000+n;}
+u64 nvtest_guest_rip(u64 n){return 0x7c00+n*2;}
+u64 nvtest_guest_cr2(u64 n){return 0x20000+page_4kb_mult(n);}
+u64 nvtest_guest_gdtr(u64 n){return 0x30000+(n<<4);}
+u16 nvtest_guest_fcw(u64 n){return (u16)(0x37f^n);}
+
+// Simulate the world switch. The general-purpose registers and the FPU are saved
+// to the vCPU, but the control registers and descriptor tables are left in VMCB.
+noir_status nvc_svmc_run_vcpu(noir_cvm_virtual_cpu_p vcpu)
+{
+	void* vmcb=((noir_svm_custom_vcpu_p)vcpu)->vmcb.virt;
+	noir_fx_state_p fx=(noir_fx_state_p)vcpu->xsave_area;
+	const u64 n=++nvtest_runs;
+	nvtest_entry_cache=vcpu->state_cache;
+	nvtest_entry_gpr=vcpu->gpr;
+	nvtest_entry_seg=vcpu->seg;
+	nvtest_entry_crs=vcpu->crs;
+	nvtest_entry_rip=vcpu->rip;
+	nvtest_entry_fcw=fx->fpu.fcw;
+	vcpu->gpr.rax=nvtest_guest_rax(n);
+	vcpu->rip=nvtest_guest_rip(n);
+	vcpu->rflags=2;
+	fx->fpu.fcw=nvtest_guest_fcw(n);
+	noir_svm_vmwrite64(vmcb,guest_cr0,amd64_cr0_pe_bit|amd64_cr0_et_bit);
+	noir_svm_vmwrite64(vmcb,guest_cr2,nvtest_guest_cr2(n));
+	noir_svm_vmwrite64(vmcb,guest_cr3,0);
+	noir_svm_vmwrite64(vmcb,guest_cr4,0);
+	noir_svm_vmwrite64(vmcb,guest_gdtr_base,nvtest_guest_gdtr(n));
+	noir_svm_vmwrite32(vmcb,guest_gdtr_limit,0xffff);
+	noir_svm_vmwrite64(vmcb,guest_idtr_base,0);
+	noir_svm_vmwrite32(vmcb,guest_idtr_limit,0x3ff);
+	vcpu->state_cache.cr_valid=vcpu->state_cache.cr2valid=vcpu->state_cache.dt_valid=true;
+	vcpu->state_cache.synchronized=false;
+	vcpu->exit_context.intercept_code=cv_hlt_instruction;
+	vcpu->exit_context.rip=vcpu->rip;
+	vcpu->exit_context.rflags=vcpu->rflags;
+	return noir_success;
+}
+
+// Only the published group is written to VPCB. A poisoned group must stay poisoned.
+void nvtest_publish(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb,u32 group)
+{
+	u64 n;
+	noir_stosb(&vpcb->registers,0xcc,sizeof(vpcb->registers));
+	vpcb->registers.publish=1<<group;
+	vpcb->registers.dirty=0;
+	nvtest_check_eq(nvc_run_vcpu(vcpu,null),noir_success);
+	n=nvtest_runs;
+	nvtest_check_eq(vpcb->intercept_code,cv_hlt_instruction);
+	nvtest_check_eq(vpcb->rip,nvtest_guest_rip(n));
+	nvtest_check_eq(vpcb->registers.valid,1<<group);
+	// Groups cached in VMCB are synchronized only if they are published.
+	nvtest_check_eq(vcpu->state_cache.synchronized,group==noir_cvm_vpcb_group_seg || group==noir_cvm_vpcb_group_cr);
+	if(group==noir_cvm_vpcb_group_gpr)
+	{
+		nvtest_check_eq(vpcb->registers.gpr.rax,nvtest_guest_rax(n));
+		nvtest_check_eq(vpcb->registers.rip,nvtest_guest_rip(n));
+		nvtest_check_eq(vpcb->registers.rflags,2);
+	}
+	else
+		nvtest_check_eq(vpcb->registers.gpr.rax,0xcccccccccccccccc);
+	if(group==noir_cvm_vpcb_group_seg)
+	{
+		nvtest_check_eq(vpcb->registers.seg.gdtr.base,nvtest_guest_gdtr(n));
+		nvtest_check_eq(vpcb->registers.seg.gdtr.limit,0xffff);
+		nvtest_check_eq(vpcb->registers.seg.idtr.limit,0x3ff);
+	}
+	else
+		nvtest_check_eq(vpcb->registers.seg.gdtr.base,0xcccccccccccccccc);
+	if(group==noir_cvm_vpcb_group_cr)
+	{
+		nvtest_check_eq(vpcb->registers.crs.cr0,amd64_cr0_pe_bit|amd64_cr0_et_bit);
+		nvtest_check_eq(vpcb->registers.crs.cr2,nvtest_guest_cr2(n));
+	}
+	else
+		nvtest_check_eq(vpcb->registers.crs.cr2,0xcccccccccccccccc);
+	if(group==noir_cvm_vpcb_group_fpu)
+		nvtest_check_eq(vpcb->registers.fx.fpu.fcw,nvtest_guest_fcw(n));
+	else
+		nvtest_check_eq(vpcb->registers.fx.fpu.fcw,0xcccc);
+}
+
+// Only the dirty group is loaded to the vCPU, and its state cache is invalidated.
+void nvtest_load(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb,u32 group)
+{
+	u64 n;
+	// Publish every group so that the vCPU holds the values of the previous run.
+	vpcb->registers.publish=noir_cvm_vpcb_group_mask;
+	vpcb->registers.dirty=0;
+	nvtest_check_eq(nvc_run_vcpu(vcpu,null),noir_success);
+	n=nvtest_runs;
+	nvtest_check_eq(vpcb->registers.valid,noir_cvm_vpcb_group_mask);
+	// Edit the group in VPCB. Edits of other groups are not marked dirty, so they must be ignored.
+	vpcb->registers.gpr.rax=0xa5a5;
+	vpcb->registers.rip=0x8000;
+	vpcb->registers.rflags=0x202;
+	vpcb->registers.seg.gdtr.base=0x50000;
+	vpcb->registers.crs.cr2=0x60000;
+	vpcb->registers.fx.fpu.fcw=0x27f;
+	vpcb->registers.dirty=1<<group;
+	nvtest_check_eq(nvc_run_vcpu(vcpu,null),noir_success);
+	nvtest_check_eq(vpcb->registers.dirty,0);
+	if(group==noir_cvm_vpcb_group_gpr)
+	{
+		nvtest_check_eq(nvtest_entry_gpr.rax,0xa5a5);
+		nvtest_check_eq(nvtest_entry_rip,0x8000);
+		nvtest_check(!nvtest_entry_cache.gprvalid);
+	}
+	else
+	{
+		nvtest_check_eq(nvtest_entry_gpr.rax,nvtest_guest_rax(n));
+		nvtest_check_eq(nvtest_entry_rip,nvtest_guest_rip(n));
+	}
+	if(group==noir_cvm_vpcb_group_seg)
+	{
+		nvtest_check_eq(nvtest_entry_seg.gdtr.base,0x50000);
+		nvtest_check(!nvtest_entry_cache.dt_valid);
+	}
+	else
+	{
+		nvtest_check_eq(nvtest_entry_seg.gdtr.base,nvtest_guest_gdtr(n));
+		nvtest_check(nvtest_entry_cache.dt_valid);
+	}
+	if(group==noir_cvm_vpcb_group_cr)
+	{
+		nvtest_check_eq(nvtest_entry_crs.cr2,0x60000);
+		nvtest_check(!nvtest_entry_cache.cr_valid && !nvtest_entry_cache.cr2valid);
+	}
+	else
+	{
+		nvtest_check_eq(nvtest_entry_crs.cr2,nvtest_guest_cr2(n));
+		nvtest_check(nvtest_entry_cache.cr_valid && nvtest_entry_cache.cr2valid);
+	}
+	if(group==noir_cvm_vpcb_group_fpu)
+		nvtest_check_eq(nvtest_entry_fcw,0x27f);
+	else
+		nvtest_check_eq(nvtest_entry_fcw,nvtest_guest_fcw(n));
+}
+
+// Dirty groups are loaded even if the edited state is invalid, but the run is refused.
+void nvtest_invalid_state(noir_cvm_virtual_cpu_p vcpu,noir_cvm_vcpu_control_block_p vpcb)
+{
+	const u64 runs=nvtest_runs;
+	const u64 xcr0=vcpu->xcrs.xcr0;
+	vcpu->xcrs.xcr0=0;
+	vpcb->registers.publish=0;
+	vpcb->registers.gpr.rax=0x5a5a;
+	vpcb->registers.dirty=1<<noir_cvm_vpcb_group_gpr;
+	nvtest_check_eq(nvc_run_vcpu(vcpu,null),noir_success);
+	nvtest_check_eq(nvtest_runs,runs);
+	nvtest_check_eq(vpcb->intercept_code,cv_invalid_state);
+	nvtest_check_eq(vpcb->registers.dirty,0);
+	nvtest_check_eq(vcpu->gpr.rax,0x5a5a);
+	vcpu->xcrs.xcr0=xcr0;
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_virtual_cpu_p vcpu;
+	noir_cvm_vcpu_control_block_p vpcb;
+	nvtest_check_eq(nvtest_initialize_svm(1),noir_success);
+	hvm_p->xfeat.support_mask.value=nvtest_xcr0;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	nvtest_check_eq(nvc_create_vcpu(vm,&vcpu,0),noir_success);
+	vcpu->xcrs.xcr0=nvtest_xcr0;
+	vpcb=noir_alloc_nonpg_memory(sizeof(noir_cvm_vcpu_control_block));
+	nvtest_check(vpcb!=null);
+	nvtest_check_eq(nvc_set_tunnel(vcpu,vpcb),noir_success);
+	for(u32 i=0;i<nvtest_groups;i++)nvtest_publish(vcpu,vpcb,i);
+	for(u32 i=0;i<nvtest_groups;i++)nvtest_load(vcpu,vpcb,i);
+	nvtest_invalid_state(vcpu,vpcb);
+	nvc_release_vm(vm);
+	noir_free_nonpg_memory(vpcb);
+	return nvtest_finish();
+}
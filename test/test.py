@@ -0,0 +1,156 @@
+#!/usr/bin/python3
+# NoirVisor - Hardware-Accelerated Hypervisor solution
+#
+# Copyright 2018-2024, Zero Tang. All rights reserved.
+#
+# This script builds and runs NoirVisor's user-mode tests with GCC.
+# Hypervisor sources are compiled with the pre-processor definitions of
+# their manifests (build.json), so that tests exercise the real code.
+# Symbols that are referenced by a source file but never reached in a
+# test are substituted with stubs that terminate the test once reached.
+#
+# Usage: python3 test/test.py [--bench] [--verbose] [test names...]
+#
+# This program is distributed in the hope that it will be useful, but
+# without any warranty (no matter implied warranty or merchantability
+# or fitness for a particular purpose, etc.).
+#
+# File Location: /test/test.py
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),"tools"))
+import masm2gas
+
+verbose:bool=False
+repo_base:str=os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+undefined_pattern=re.compile(r"undefined reference to `([^']+)'")
+
+def run_command(cmd:list[str])->subprocess.CompletedProcess:
+	if verbose:
+		print("[Command] {}".format(" ".join(cmd)))
+	return subprocess.run(cmd,stdout=subprocess.PIPE,stderr=subprocess.PIPE,text=True)
+
+def source_definitions(file_name:str,arch:str,family:str)->list[str]:
+	# Use the pre-processor definitions in the manifest of the source directory.
+	manifest_fn:str=os.path.join(os.path.dirname(file_name),"build.json")
+	defs:list[str]=[]
+	if os.path.exists(manifest_fn):
+		with open(manifest_fn,'r') as f:
+			manifest:dict=json.load(f)
+		target_name:str=".".join(os.path.basename(file_name).split('.')[0:-1])
+		dict_pool:dict={"target_name":target_name,"arch":arch,"ARCH":arch.upper(),"compiler_family":family}
+		if "hypervisor" in manifest:
+			flags:list[str]=manifest["hypervisor"].get("extra_preproc_defflag",[])
+			defs+=[flag.format(**dict_pool) for flag in flags]
+			per_file:dict=manifest["hypervisor"].get("extra_preproc_defflag_per_file",{})
+			defs+=per_file.get(os.path.basename(file_name),[])
+	return defs
+
+class test_unit:
+	def __init__(self,definition:dict,config:dict):
+		self.name:str=definition["name"]
+		self.kind:str=definition.get("kind","test")
+		self.config:dict=config
+		self.c_sources:list[str]=definition.get("c_sources",[])+config["common_sources"]
+		self.asm_sources:list[str]=definition.get("asm_sources",[])
+		self.defines:list[str]=definition.get("defines",[])
+		self.c_includes:list[str]=definition.get("c_includes",[])+config["c_includes"]
+		self.output_dir:str=os.path.join(repo_base,config["output_dir"],self.name)
+		self.objects:list[str]=[]
+
+	def compile(self)->bool:
+		os.makedirs(self.output_dir,exist_ok=True)
+		arch:str=self.config["arch"]
+		family:str=self.config["compiler_family"]
+		includes:list[str]=["-I"+os.path.join(repo_base,inc) for inc in self.c_includes]
+		for src in self.c_sources:
+			src_fn:str=os.path.join(repo_base,src)
+			obj_fn:str=os.path.join(self.output_dir,os.path.basename(src)+".o")
+			defs:list[str]=["_"+arch,"_"+family]
+			if src.startswith("src/"):
+				defs=source_definitions(src_fn,arch,family)
+			else:
+				defs+=self.defines
+			cmd:list[str]=[self.config["cc"],"-c",src_fn,"-o",obj_fn]+[flag.format(repo_base=repo_base) for flag in self.config["cflags"]]+includes
+			cmd+=["-D"+d for d in defs]
+			result=run_command(cmd)
+			if result.returncode:
+				print("Failed to compile {}!\n{}".format(src,result.stderr))
+				return False
+			self.objects.append(obj_fn)
+		for src in self.asm_sources:
+			src_fn:str=os.path.join(repo_base,src)
+			gas_fn:str=os.path.join(self.output_dir,os.path.basename(src)+".s")
+			obj_fn:str=os.path.join(self.output_dir,os.path.basename(src)+".o")
+			with open(src_fn,'r') as f:
+				text:str=masm2gas.translate(f.read(),["_"+arch,"_"+family],True)
+			with open(gas_fn,'w') as f:
+				f.write(text)
+			result=run_command([self.config["as"],gas_fn,"-o",obj_fn])
+			if result.returncode:
+				print("Failed to assemble {}!\n{}".format(src,result.stderr))
+				return False
+			self.objects.append(obj_fn)
+		return True
+
+	def link(self)->bool:
+		binary:str=os.path.join(self.output_dir,self.name)
+		stub_fn:str=os.path.join(self.output_dir,"stubs.c")
+		stubs:list[str]=[]
+		while True:
+			cmd:list[str]=[self.config["cc"],"-o",binary]+self.objects
+			if len(stubs):
+				cmd.append(stub_fn)
+			cmd+=self.config["ldflags"]
+			result=run_command(cmd)
+			if result.returncode==0:
+				return True
+			missing:list[str]=sorted(set(undefined_pattern.findall(result.stderr))-set(stubs))
+			if len(missing)==0:
+				print("Failed to link {}!\n{}".format(self.name,result.stderr))
+				return False
+			stubs+=missing
+			with open(stub_fn,'w') as f:
+				f.write("void nvtest_privileged(const char* name);\n")
+				for sym in stubs:
+					f.write("void {0}(){{nvtest_privileged(\"{0}\");}}\n".format(sym))
+
+	def run(self)->bool:
+		env:dict=dict(os.environ)
+		env["NVTEST_BENCHMARK"]="1" if self.kind=="benchmark" else "0"
+		t0:float=time.time()
+		result=subprocess.run([os.path.join(self.output_dir,self.name)],env=env)
+		print("[{}] {} ({:.2f}s)".format("Passed" if result.returncode==0 else "Failed",self.name,time.time()-t0))
+		return result.returncode==0
+
+if __name__=="__main__":
+	run_benchmarks:bool=False
+	selected:list[str]=[]
+	for arg in sys.argv[1:]:
+		if arg=="--bench":
+			run_benchmarks=True
+		elif arg=="--verbose":
+			verbose=True
+		else:
+			selected.append(arg)
+	with open(os.path.join(repo_base,"test","tests.json"),'r') as f:
+		config:dict=json.load(f)
+	failures:int=0
+	total:int=0
+	for definition in config["tests"]:
+		unit=test_unit(definition,config)
+		if len(selected):
+			if unit.name not in selected:
+				continue
+		elif (unit.kind=="benchmark")!=run_benchmarks:
+			continue
+		total+=1
+		if not(unit.compile() and unit.link() and unit.run()):
+			failures+=1
+	print("{} of {} tests passed.".format(total-failures,total))
+	sys.exit(1 if failures else 0)
@@ -0,0 +1,113 @@
+#!/usr/bin/python3
+# NoirVisor - Hardware-Accelerated Hypervisor solution
+#
+# Copyright 2018-2024, Zero Tang. All rights reserved.
+#
+# This script translates the subset of MASM syntax used by NoirVisor's
+# amd64 assembly sources into GNU assembler syntax.
+# Only the user-mode tests use it, so that assembly routines could be
+# tested on Linux without a MASM-compatible assembler.
+# Procedures follow the Microsoft x64 calling convention. If requested,
+# each procedure is exported through a thunk for System V callers.
+#
+# This program is distributed in the hope that it will be useful, but
+# without any warranty (no matter implied warranty or merchantability
+# or fitness for a particular purpose, etc.).
+#
+# File Location: /test/tools/masm2gas.py
+import re
+import sys
+
+number_pattern=re.compile(r"\b([0-9][0-9a-fA-F]*)([hHbB])\b")
+word_pattern=re.compile(r"\b[A-Za-z_][A-Za-z0-9_]*\b")
+
+def convert_number(m:re.Match)->str:
+	digits,suffix=m.group(1),m.group(2).lower()
+	if suffix=='h':
+		return "0x{}".format(digits)
+	if all(c in "01" for c in digits):
+		return "0b{}".format(digits)
+	return m.group(0)
+
+# Thunks pass up to six integer arguments, with shadow space reserved.
+sysv_thunk_template:str="""
+.globl {0}
+{0}:
+	sub rsp,0x38
+	mov [rsp+0x20],r8
+	mov [rsp+0x28],r9
+	mov r9,rcx
+	mov r8,rdx
+	mov rdx,rsi
+	mov rcx,rdi
+	call __ms_{0}
+	add rsp,0x38
+	ret"""
+
+def translate(source:str,defines:list[str],sysv_thunks:bool=False)->str:
+	output:list[str]=[".intel_syntax noprefix",".text"]
+	macro_params:list[str]=[]
+	# Stack of conditional assembly states: (active,branch_taken)
+	cond_stack:list[tuple[bool,bool]]=[]
+	for raw_line in source.splitlines():
+		line=raw_line.split(';',1)[0].strip()
+		if len(line)==0:
+			continue
+		words=line.split()
+		keyword=words[0].lower()
+		# Conditional assembly on preprocessor definitions.
+		if keyword=="ifdef":
+			parent=all(c[0] for c in cond_stack)
+			taken=words[1] in defines
+			cond_stack.append((parent and taken,taken))
+			continue
+		if keyword=="else" and len(macro_params)==0:
+			parent=all(c[0] for c in cond_stack[:-1])
+			taken=cond_stack[-1][1]
+			cond_stack[-1]=(parent and not taken,True)
+			continue
+		if keyword=="endif" and len(macro_params)==0:
+			cond_stack.pop()
+			continue
+		if not all(c[0] for c in cond_stack):
+			continue
+		if keyword in [".code",".686p",".model","end"]:
+			continue
+		# Conditional assembly inside macros.
+		if keyword=="if":
+			line=".if "+" ".join(words[1:])
+		elif keyword=="else":
+			line=".else"
+		elif keyword=="endif":
+			line=".endif"
+		elif keyword=="endm":
+			output.append(".endm")
+			macro_params=[]
+			continue
+		elif len(words)>1 and words[1].lower()=="macro":
+			macro_params=[p.strip() for p in " ".join(words[2:]).split(',') if len(p.strip())]
+			output.append(".macro {} {}".format(words[0],",".join(macro_params)))
+			if len(macro_params)==0:
+				macro_params=[""]
+			continue
+		elif len(words)>1 and words[1].lower()=="proc":
+			if sysv_thunks:
+				output.append(sysv_thunk_template.format(words[0]))
+				output.append("__ms_{}:".format(words[0]))
+			else:
+				output.append(".globl {0}\n{0}:".format(words[0]))
+			continue
+		elif len(words)>1 and words[1].lower()=="endp":
+			continue
+		line=number_pattern.sub(convert_number,line)
+		if len(macro_params):
+			line=word_pattern.sub(lambda m:"\\"+m.group(0) if m.group(0) in macro_params else m.group(0),line)
+		output.append(line)
+	return "\n".join(output)+"\n"
+
+if __name__=="__main__":
+	defines=[a[2:] for a in sys.argv[3:] if a.startswith("-D")]
+	with open(sys.argv[1],"r") as f:
+		text=translate(f.read(),defines,"--sysv-thunks" in sys.argv[3:])
+	with open(sys.argv[2],"w") as f:
+		f.write(text)
@@ -0,0 +1,118 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the dirty-page harvest of VT-Core CVMs.
+  Guest memory of 16GiB is mapped in 4KiB pages, then harvested with
+  none, one in a hundred and all of the pages written by the guest.
+  Dirty flags are set in the raw EPT entries to simulate the processor.
+  The setup time of a 32GiB guest mapped by a single batch is measured
+  on a fresh VM and over existing mappings.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/vt_core/ept_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <vt_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+
+#define nvtest_host_base		0x4000000000
+#define nvtest_gigabytes		16
+#define nvtest_dirty_bit		0x200
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+noir_status nvc_query_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
+noir_status nvc_vtc_set_mapping_batch(noir_vt_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array);
+
+u64p nvtest_pte(noir_vt_custom_vm_p vm,u64 gpa)
+{
+	u64p table=(u64p)vm->eptm.eptp.virt;
+	for(u32 level=3;level;level--)
+		table=(u64p)noir_find_virt_by_phys(table[(gpa>>(page_4kb_shift+level*9))&0x1ff]&0xFFFFFFFFFF000);
+	return &table[(gpa>>page_4kb_shift)&0x1ff];
+}
+
+void nvtest_benchmark_harvest(noir_cvm_virtual_machine_p vm,u8p bitmap,u32 pages,u32 stride)
+{
+	u32 dirty=0;
+	u64 t0,t1;
+	for(u32 i=0;stride && i<pages;i+=stride,dirty++)
+		*nvtest_pte((noir_vt_custom_vm_p)vm,page_4kb_mult((u64)i))|=nvtest_dirty_bit;
+	t0=nvtest_time_ns();
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,pages,bitmap,pages>>3,false),noir_success);
+	t1=nvtest_time_ns();
+	nvtest_check_eq(bitmap[0]&1,stride?1:0);
+	nvtest_report("%u GiB, %7u dirty page(s): harvest %8.2f us/GiB, %5.2f ns/page\n",nvtest_gigabytes,dirty,(double)(t1-t0)/1e3/nvtest_gigabytes,(double)(t1-t0)/pages);
+}
+
+// Map the guest memory with a batch of 1GiB ranges in 2MiB pages, the way a VMM sets up its guest.
+void nvtest_benchmark_batch(u32 gigabytes)
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_address_mapping_p ranges=malloc(sizeof(noir_cvm_address_mapping)*gigabytes);
+	const u64 pages=page_4kb_count(page_1gb_mult((u64)gigabytes));
+	u64p phys_array=malloc(pages<<3);
+	u64 t0,t1,t2;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	for(u64 i=0;i<pages;i++)phys_array[i]=nvtest_host_base+page_4kb_mult(i);
+	for(u32 i=0;i<gigabytes;i++)
+	{
+		ranges[i].gpa=page_1gb_mult((u64)i);
+		ranges[i].hva=nvtest_host_base+ranges[i].gpa;
+		ranges[i].pages=page_table_entries64;
+		ranges[i].attributes.value=0;
+		ranges[i].attributes.present=ranges[i].attributes.write=ranges[i].attributes.execute=true;
+		ranges[i].attributes.caching=noir_cvm_memory_wb;
+		ranges[i].attributes.psize=1;
+	}
+	t0=nvtest_time_ns();
+	nvtest_check_eq(nvc_vtc_set_mapping_batch((noir_vt_custom_vm_p)vm,ranges,gigabytes,phys_array),noir_success);
+	t1=nvtest_time_ns();
+	// Mapping the batch again overwrites present translations.
+	nvtest_check_eq(nvc_vtc_set_mapping_batch((noir_vt_custom_vm_p)vm,ranges,gigabytes,phys_array),noir_success);
+	t2=nvtest_time_ns();
+	nvtest_report("%2u GiB batch in 2MiB pages: setup %8.2f ms fresh, %8.2f ms over present mappings\n",gigabytes,(double)(t1-t0)/1e6,(double)(t2-t1)/1e6);
+	nvc_release_vm(vm);
+	free(phys_array);
+	free(ranges);
+}
+
+int main()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_cvm_address_mapping map_info={0};
+	const u32 pages=(u32)page_4kb_count(page_1gb_mult((u64)nvtest_gigabytes));
+	u8p bitmap=malloc(pages>>3);
+	nvtest_check_eq(nvtest_initialize_vt(1),noir_success);
+	// Large pages are disabled so that every page has its own dirty flag.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=false;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.pages=page_4kb_count(page_1gb_size);
+	for(u32 i=0;i<nvtest_gigabytes;i++)
+	{
+		map_info.gpa=page_1gb_mult((u64)i);
+		map_info.hva=nvtest_host_base+map_info.gpa;
+		nvtest_check_eq(nvc_set_mapping(vm,&map_info),noir_success);
+	}
+	nvtest_benchmark_harvest(vm,bitmap,pages,0);
+	nvtest_benchmark_harvest(vm,bitmap,pages,100);
+	nvtest_benchmark_harvest(vm,bitmap,pages,1);
+	nvc_release_vm(vm);
+	free(bitmap);
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	nvtest_benchmark_batch(32);
+	return nvtest_finish();
+}
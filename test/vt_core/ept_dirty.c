@@ -0,0 +1,236 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the dirty-page harvest of VT-Core CVMs.
+  The processor is simulated by setting dirty flags in the raw EPT
+  entries. Harvests must report and re-arm them, and the next entry on
+  each processor that ran the VM must invalidate the EPT with the
+  invept type supported by the processor. A batch of mappings failing
+  halfway must restore the translations it has overwritten.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/vt_core/ept_dirty.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <vt_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_host_base		0x40000000
+#define nvtest_guest_pages		0x400
+#define nvtest_dirty_bit		0x200
+#define nvtest_remap_base		0x7FE00000
+
+extern u32v nvtest_invept_count;
+extern size_t nvtest_invept_type;
+extern u64 nvtest_invept_eptp;
+
+noir_status nvc_create_vm(noir_cvm_virtual_machine_p* vm,u32 process_id);
+noir_status nvc_release_vm(noir_cvm_virtual_machine_p vm);
+noir_status nvc_set_mapping(noir_cvm_virtual_machine_p virtual_machine,noir_cvm_address_mapping_p mapping_info);
+noir_status nvc_query_gpa_dirty_bitmap(noir_cvm_virtual_machine_p virtual_machine,u64 gpa_start,u32 page_count,void* bitmap,u32 bitmap_size,bool accumulate);
+noir_status nvc_vtc_set_mapping_batch(noir_vt_custom_vm_p virtual_machine,noir_cvm_address_mapping_p mapping_info,u32 count,u64p phys_array);
+
+noir_status nvtest_map(noir_cvm_virtual_machine_p vm,u64 gpa,u32 pages,u32 psize)
+{
+	noir_cvm_address_mapping map_info={0};
+	map_info.gpa=gpa;
+	map_info.hva=nvtest_host_base+gpa;
+	map_info.pages=pages;
+	map_info.attributes.present=map_info.attributes.write=map_info.attributes.execute=true;
+	map_info.attributes.caching=6;
+	map_info.attributes.psize=psize;
+	return nvc_set_mapping(vm,&map_info);
+}
+
+// Walk the EPT in the way the processor does and return the leaf entry.
+u64p nvtest_leaf(noir_vt_custom_vm_p vm,u64 gpa)
+{
+	u64p table=(u64p)vm->eptm.eptp.virt;
+	for(u32 level=3;;level--)
+	{
+		const u32 shift=page_4kb_shift+level*9;
+		u64p entry=&table[(gpa>>shift)&0x1ff];
+		if(!(*entry&7))return null;
+		// Large pages are indicated by bit 7 of PDEs and PDPTEs.
+		if(level==0 || (level<3 && (*entry&0x80)))return entry;
+		table=(u64p)noir_find_virt_by_phys(*entry&0xFFFFFFFFFF000);
+	}
+}
+
+// Translate the GPA in the way the processor does. Zero is returned if the GPA is not translated.
+u64 nvtest_translate(noir_vt_custom_vm_p vm,u64 gpa)
+{
+	u64p table=(u64p)vm->eptm.eptp.virt;
+	for(u32 level=3;;level--)
+	{
+		const u32 shift=page_4kb_shift+level*9;
+		const u64 entry=table[(gpa>>shift)&0x1ff];
+		const u64 base=entry&0xFFFFFFFFFF000;
+		if(!(entry&7))return 0;
+		if(level==0 || (level<3 && (entry&0x80)))
+			return (base&~((1ull<<shift)-1))|(gpa&((1ull<<shift)-1));
+		table=(u64p)noir_find_virt_by_phys(base);
+	}
+}
+
+// The processor sets the dirty flag when the guest writes to the page.
+void nvtest_guest_write(noir_vt_custom_vm_p vm,u64 gpa)
+{
+	u64p entry=nvtest_leaf(vm,gpa);
+	nvtest_check(entry!=null);
+	if(entry)*entry|=nvtest_dirty_bit;
+}
+
+u32 nvtest_count_bits(u8p bitmap,u32 pages)
+{
+	u32 count=0;
+	for(u32 i=0;i<pages;i++)count+=noir_bt((u32p)bitmap,i);
+	return count;
+}
+
+void nvtest_harvest()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_vt_custom_vm_p vtvm;
+	u8 bitmap[nvtest_guest_pages>>3];
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	vtvm=(noir_vt_custom_vm_p)vm;
+	// Pages 0-511 are a 2MiB page. Pages 512-1023 are 4KiB pages, except for 1000-1023.
+	nvtest_check_eq(nvtest_map(vm,0,1,1),noir_success);
+	nvtest_check_eq(nvtest_map(vm,page_2mb_size,488,0),noir_success);
+	// Nothing is written yet.
+	noir_stosb(bitmap,0xff,sizeof(bitmap));
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	nvtest_check_eq(nvtest_count_bits(bitmap,nvtest_guest_pages),0);
+	// A write to the large page dirties all of its 4KiB pages.
+	nvtest_guest_write(vtvm,0x12345);
+	nvtest_guest_write(vtvm,page_2mb_size+page_4kb_mult(7));
+	nvtest_guest_write(vtvm,page_2mb_size+page_4kb_mult(487));
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	nvtest_check_eq(nvtest_count_bits(bitmap,nvtest_guest_pages),514);
+	nvtest_check(noir_bt((u32p)bitmap,511));
+	nvtest_check(noir_bt((u32p)bitmap,519));
+	nvtest_check(noir_bt((u32p)bitmap,999));
+	// The dirty flags are re-armed.
+	nvtest_check_eq(*nvtest_leaf(vtvm,0)&nvtest_dirty_bit,0);
+	nvtest_check_eq(*nvtest_leaf(vtvm,page_2mb_size+page_4kb_mult(7))&nvtest_dirty_bit,0);
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	nvtest_check_eq(nvtest_count_bits(bitmap,nvtest_guest_pages),0);
+	// Accumulated harvests keep the pages reported earlier.
+	nvtest_guest_write(vtvm,page_2mb_size);
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	nvtest_guest_write(vtvm,page_2mb_size+page_4kb_size);
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),true),noir_success);
+	nvtest_check_eq(nvtest_count_bits(bitmap,nvtest_guest_pages),2);
+	nvtest_check(noir_bt((u32p)bitmap,512) && noir_bt((u32p)bitmap,513));
+	// The bitmap must be large enough.
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap)-1,false),noir_buffer_too_small);
+	nvc_release_vm(vm);
+}
+
+void nvtest_invalidation()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_vt_custom_vm_p vtvm;
+	noir_vt_custom_vcpu cvcpu={0};
+	noir_vt_hvm_p relative_hvm=hvm_p->relative_hvm;
+	u8 bitmap[nvtest_guest_pages>>3];
+	u32 invept_count;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	vtvm=(noir_vt_custom_vm_p)vm;
+	cvcpu.vm=vtvm;
+	nvtest_check_eq(nvtest_map(vm,0,nvtest_guest_pages,0),noir_success);
+	// Every processor invalidates the EPT before its first entry. Processors 2 and 3 do not run the VM yet.
+	invept_count=nvtest_invept_count;
+	for(u32 i=0;i<2;i++)nvc_vt_invalidate_stale_ept(&cvcpu,i);
+	nvtest_check_eq(nvtest_invept_count-invept_count,2);
+	nvtest_check_eq(nvtest_invept_type,ept_single_invd);
+	nvtest_check_eq(nvtest_invept_eptp,vtvm->eptm.eptp.phys);
+	// Subsequent entries do not invalidate the EPT.
+	invept_count=nvtest_invept_count;
+	nvc_vt_invalidate_stale_ept(&cvcpu,0);
+	nvtest_check_eq(nvtest_invept_count,invept_count);
+	// A clean harvest keeps the translations.
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	for(u32 i=0;i<2;i++)nvc_vt_invalidate_stale_ept(&cvcpu,i);
+	nvtest_check_eq(nvtest_invept_count,invept_count);
+	// A dirty harvest invalidates the EPT on processors that ran the VM.
+	// All-context invalidation is used if single-context invalidation is unsupported.
+	relative_hvm->cvm_invept_type=ept_global_invd;
+	nvtest_guest_write(vtvm,0);
+	nvtest_check_eq(nvc_query_gpa_dirty_bitmap(vm,0,nvtest_guest_pages,bitmap,sizeof(bitmap),false),noir_success);
+	for(u32 i=0;i<2;i++)nvc_vt_invalidate_stale_ept(&cvcpu,i);
+	nvtest_check_eq(nvtest_invept_count-invept_count,2);
+	nvtest_check_eq(nvtest_invept_type,ept_global_invd);
+	// Processors 2 and 3 still have to invalidate the EPT before their first entries.
+	relative_hvm->cvm_invept_type=ept_single_invd;
+	invept_count=nvtest_invept_count;
+	for(u32 i=0;i<4;i++)nvc_vt_invalidate_stale_ept(&cvcpu,i);
+	nvtest_check_eq(nvtest_invept_count-invept_count,2);
+	nvtest_check_eq(nvtest_invept_type,ept_single_invd);
+	nvtest_check_eq(cvcpu.header.statistics.tlb_flush.issued,6);
+	nvc_release_vm(vm);
+}
+
+// A batch failing at any allocation must restore the translations it has overwritten.
+void nvtest_batch_rollback()
+{
+	noir_cvm_virtual_machine_p vm;
+	noir_vt_custom_vm_p vtvm;
+	noir_cvm_address_mapping ranges[2]={0};
+	u64 phys_array[2]={nvtest_remap_base,nvtest_remap_base+page_size};
+	const u64 split_gpa=0x201000;
+	noir_status st=noir_insufficient_resources;
+	u32 budget=0;
+	nvtest_check_eq(nvc_create_vm(&vm,0),noir_success);
+	vtvm=(noir_vt_custom_vm_p)vm;
+	nvtest_check_eq(nvtest_map(vm,0,2,1),noir_success);
+	// The first range splits a 2MiB page. The second one requires a new page directory.
+	for(u32 i=0;i<2;i++)
+	{
+		ranges[i].pages=1;
+		ranges[i].attributes.present=ranges[i].attributes.write=ranges[i].attributes.execute=true;
+		ranges[i].attributes.caching=6;
+	}
+	ranges[0].gpa=split_gpa;
+	ranges[1].gpa=page_1gb_size;
+	while(st!=noir_success)
+	{
+		nvtest_set_allocation_budget(budget++);
+		st=nvc_vtc_set_mapping_batch(vtvm,ranges,2,phys_array);
+		nvtest_set_allocation_budget(nvtest_unlimited_allocations);
+		if(st!=noir_success)
+		{
+			nvtest_check_eq(st,noir_insufficient_resources);
+			// The split 2MiB page is restored and merged again.
+			nvtest_check_eq(nvtest_translate(vtvm,split_gpa),nvtest_host_base+split_gpa);
+			nvtest_check(*nvtest_leaf(vtvm,split_gpa)&0x80);
+			nvtest_check_eq(nvtest_translate(vtvm,page_1gb_size),0);
+		}
+	}
+	// Failures were injected before the mapping succeeded.
+	nvtest_check(budget>3);
+	nvtest_check_eq(nvtest_translate(vtvm,split_gpa),nvtest_remap_base);
+	nvtest_check_eq(nvtest_translate(vtvm,split_gpa-page_size),nvtest_host_base+0x200000);
+	nvtest_check_eq(nvtest_translate(vtvm,page_1gb_size),nvtest_remap_base+page_size);
+	nvc_release_vm(vm);
+}
+
+int main()
+{
+	nvtest_check_eq(nvtest_initialize_vt(4),noir_success);
+	nvtest_harvest();
+	nvtest_invalidation();
+	nvtest_batch_rollback();
+	return nvtest_finish();
+}
@@ -0,0 +1,65 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file prepares the simulated environment of VT-Core tests.
+  Only the fields of the hypervisor structure that the CVM facility
+  refers to are initialized.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/vt_core/vt_env.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <vt_intrin.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+// The invept instruction is simulated. The last invalidation is recorded for the tests.
+u32v nvtest_invept_count=0;
+size_t nvtest_invept_type=0;
+u64 nvtest_invept_eptp=0;
+
+u8 noir_vt_invept(size_t type,invept_descriptor_p descriptor)
+{
+	nvtest_invept_type=type;
+	nvtest_invept_eptp=descriptor->eptp;
+	noir_locked_inc(&nvtest_invept_count);
+	return 0;
+}
+
+// Hypercalls are simulated. VMCS is not simulated, so its initialization is skipped.
+u8 noir_vt_vmcall(u32 function,ulong_ptr context)
+{
+	if(function!=noir_vt_init_custom_vmcs)nvtest_privileged("noir_vt_vmcall");
+	return 0;
+}
+
+noir_status nvtest_initialize_vt(u32 processors)
+{
+	noir_vt_hvm_p relative_hvm=noir_alloc_nonpg_memory(sizeof(noir_vt_hvm));
+	if(relative_hvm==null)return noir_insufficient_resources;
+	nvtest_set_processor_count(processors);
+	hvm_p->cpu_count=processors;
+	hvm_p->selected_core=use_vt_core;
+	hvm_p->relative_hvm=relative_hvm;
+	// VPIDs are assigned in the same way as VT-Core without nested virtualization.
+	hvm_p->tlb_tagging.start=2;
+	hvm_p->tlb_tagging.limit=65534;
+	hvm_p->tlb_tagging.vpid_pool=noir_alloc_nonpg_memory(page_size*2);
+	hvm_p->tlb_tagging.vpid_pool_lock=noir_initialize_reslock();
+	if(hvm_p->tlb_tagging.vpid_pool==null || hvm_p->tlb_tagging.vpid_pool_lock==null)return noir_insufficient_resources;
+	// The processor supports large pages, EPT A/D flags and single-context invept.
+	hvm_p->cvm_cap.large_page=hvm_p->cvm_cap.huge_page=true;
+	hvm_p->cvm_cap.accessed_dirty=true;
+	relative_hvm->cvm_invept_type=ept_single_invd;
+	hvm_p->xfeat.supported_size_max=page_size;
+	return nvc_vtc_initialize_cvm_module();
+}
@@ -0,0 +1,127 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the AES-NI Engine of NoirVisor.
+  The reference cipher is checked with the known-answer tests of FIPS-197
+  before it is used to check the expanded keys and the XEX-encrypted pages.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/aes.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define nvtest_pages		3
+#define nvtest_tweak		0x123456789000
+// Aligned declarations are dropped by the compatibility header.
+#define nvtest_align16		__attribute__((aligned(16)))
+
+void nvtest_aes128_reference_expand(u8p key,u8p round_keys);
+void nvtest_aes128_reference(u8p key,u8p input,u8p output);
+void nvtest_aes128_reference_inv_mix_column(u8p input,u8p output);
+void nvtest_xex_block_tweak(u8p round_keys,u64 page_tweak,u32 block,u8p tweak);
+void nvtest_xex_reference(u8p key,u8p pages,u32 count,u64 page_tweak);
+
+// FIPS-197 Appendix A.1 and Appendix C.1
+u8 nvtest_fips_key_a1[16]={0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c};
+u8 nvtest_fips_last_round_a1[16]={0xd0,0x14,0xf9,0xa8,0xc9,0xee,0x25,0x89,0xe1,0x3f,0x0c,0xc8,0xb6,0x63,0x0c,0xa6};
+u8 nvtest_fips_key_c1[16]={0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f};
+u8 nvtest_fips_plain_c1[16]={0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xdd,0xee,0xff};
+u8 nvtest_fips_cipher_c1[16]={0x69,0xc4,0xe0,0xd8,0x6a,0x7b,0x04,0x30,0xd8,0xcd,0xb7,0x80,0x70,0xb4,0xc5,0x5a};
+
+void nvtest_reference_kat()
+{
+	u8 block[16];
+	nvtest_aes128_reference(nvtest_fips_key_c1,nvtest_fips_plain_c1,block);
+	nvtest_check(memcmp(block,nvtest_fips_cipher_c1,16)==0);
+}
+
+void nvtest_expand_key()
+{
+	u8 nvtest_align16 key[16];
+	u8 nvtest_align16 enc_keys[160];
+	u8 nvtest_align16 dec_keys[160];
+	u8 ref_keys[176];
+	memcpy(key,nvtest_fips_key_a1,16);
+	noir_aes128_expand_key(key,true,enc_keys);
+	noir_aes128_expand_key(key,false,dec_keys);
+	nvtest_aes128_reference_expand(key,ref_keys);
+	// Expanded keys exclude the round-0 key, which is the key itself.
+	nvtest_check(memcmp(enc_keys,&ref_keys[16],160)==0);
+	nvtest_check(memcmp(&enc_keys[144],nvtest_fips_last_round_a1,16)==0);
+	// Decryption keys of rounds 1-9 go through InvMixColumns. The last one does not.
+	for(u32 i=0;i<9;i++)
+	{
+		u8 imc[16];
+		nvtest_aes128_reference_inv_mix_column(&enc_keys[i<<4],imc);
+		nvtest_check(memcmp(&dec_keys[i<<4],imc,16)==0);
+	}
+	nvtest_check(memcmp(&dec_keys[144],&enc_keys[144],16)==0);
+}
+
+void nvtest_encrypt_pages()
+{
+	u8 nvtest_align16 key[16];
+	u8 nvtest_align16 enc_keys[160];
+	u8 nvtest_align16 dec_keys[160];
+	u8p pages=aligned_alloc(page_size,page_mult(nvtest_pages));
+	u8p plain=malloc(page_mult(nvtest_pages));
+	u8p expect=malloc(page_mult(nvtest_pages));
+	u64 seed=1;
+	memcpy(key,nvtest_fips_key_c1,16);
+	noir_aes128_expand_key(key,true,enc_keys);
+	noir_aes128_expand_key(key,false,dec_keys);
+	for(u32 i=0;i<page_mult(nvtest_pages);i++)
+	{
+		seed=seed*6364136223846793005+1442695040888963407;
+		plain[i]=(u8)(seed>>56);
+	}
+	// The first and the last page are identical, yet their ciphertext must differ.
+	memcpy(&plain[page_mult(nvtest_pages-1)],plain,page_size);
+	memcpy(pages,plain,page_mult(nvtest_pages));
+	memcpy(expect,plain,page_mult(nvtest_pages));
+	nvtest_xex_reference(key,expect,nvtest_pages,nvtest_tweak);
+	noir_aes128_encrypt_pages(pages,enc_keys,nvtest_pages,key,nvtest_tweak);
+	nvtest_check(memcmp(pages,expect,page_mult(nvtest_pages))==0);
+	nvtest_check(memcmp(pages,&pages[page_mult(nvtest_pages-1)],page_size)!=0);
+	// The block of FIPS-197 C.1 is recovered after removing the tweak of block 0.
+	{
+		u8 round_keys[176],tweak[16];
+		nvtest_aes128_reference_expand(key,round_keys);
+		nvtest_xex_block_tweak(round_keys,nvtest_tweak,0,tweak);
+		for(u32 i=0;i<16;i++)pages[i]=nvtest_fips_plain_c1[i]^tweak[i];
+		noir_aes128_encrypt_pages(pages,enc_keys,1,key,nvtest_tweak);
+		for(u32 i=0;i<16;i++)pages[i]^=tweak[i];
+		nvtest_check(memcmp(pages,nvtest_fips_cipher_c1,16)==0);
+	}
+	// Decryption restores the plaintext.
+	memcpy(pages,expect,page_mult(nvtest_pages));
+	noir_aes128_decrypt_pages(pages,dec_keys,nvtest_pages,key,nvtest_tweak,enc_keys);
+	nvtest_check(memcmp(pages,plain,page_mult(nvtest_pages))==0);
+	// A different tweak does not decrypt the pages.
+	memcpy(pages,expect,page_mult(nvtest_pages));
+	noir_aes128_decrypt_pages(pages,dec_keys,nvtest_pages,key,nvtest_tweak+page_size,enc_keys);
+	nvtest_check(memcmp(pages,plain,page_size)!=0);
+	free(expect);
+	free(plain);
+	free(pages);
+}
+
+int main()
+{
+	nvtest_reference_kat();
+	nvtest_expand_key();
+	nvtest_encrypt_pages();
+	return nvtest_finish();
+}
@@ -0,0 +1,79 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the AES-NI Engine of NoirVisor.
+  The four-block XEX routines are compared with a single-block ECB loop,
+  which is how pages were encrypted before the rounds were interleaved.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/aes_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wmmintrin.h>
+
+#define nvtest_pages		1024
+#define nvtest_rounds		64
+#define nvtest_align16		__attribute__((aligned(16)))
+
+// Single-block ECB encryption, as was done by noir_aes128_encrypt_pages.
+void __attribute__((target("aes"),noinline)) nvtest_aes128_encrypt_pages_serial(void* page_base,u8p expanded_keys,u64 pages,u8p key)
+{
+	__m128i* blocks=(__m128i*)page_base;
+	__m128i* keys=(__m128i*)expanded_keys;
+	const __m128i k0=_mm_load_si128((__m128i*)key);
+	for(u64 i=0;i<page_mult(pages)/16;i++)
+	{
+		__m128i b=_mm_xor_si128(_mm_load_si128(&blocks[i]),k0);
+		for(u32 r=0;r<9;r++)b=_mm_aesenc_si128(b,_mm_load_si128(&keys[r]));
+		_mm_store_si128(&blocks[i],_mm_aesenclast_si128(b,_mm_load_si128(&keys[9])));
+	}
+}
+
+double nvtest_gbps(u64 t0,u64 t1)
+{
+	return (double)page_mult((u64)nvtest_pages*nvtest_rounds)/(double)(t1-t0);
+}
+
+int main()
+{
+	u8 nvtest_align16 key[16]={0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f};
+	u8 nvtest_align16 enc_keys[160];
+	u8 nvtest_align16 dec_keys[160];
+	u8p pages=aligned_alloc(page_size,page_mult(nvtest_pages));
+	u8p snapshot=malloc(page_mult(nvtest_pages));
+	u64 t0,t1,t2,t3;
+	memset(pages,0x5A,page_mult(nvtest_pages));
+	noir_aes128_expand_key(key,true,enc_keys);
+	noir_aes128_expand_key(key,false,dec_keys);
+	// Warm up the pages and the caches.
+	nvtest_aes128_encrypt_pages_serial(pages,enc_keys,nvtest_pages,key);
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_rounds;i++)
+		nvtest_aes128_encrypt_pages_serial(pages,enc_keys,nvtest_pages,key);
+	t1=nvtest_time_ns();
+	memcpy(snapshot,pages,page_mult(nvtest_pages));
+	for(u32 i=0;i<nvtest_rounds;i++)
+		noir_aes128_encrypt_pages(pages,enc_keys,nvtest_pages,key,page_mult((u64)i));
+	t2=nvtest_time_ns();
+	for(u32 i=nvtest_rounds;i>0;i--)
+		noir_aes128_decrypt_pages(pages,dec_keys,nvtest_pages,key,page_mult((u64)i-1),enc_keys);
+	t3=nvtest_time_ns();
+	// Decryption in the reverse order restores the pages.
+	nvtest_check(memcmp(pages,snapshot,page_mult(nvtest_pages))==0);
+	nvtest_report("%u KiB x %u: single-block ECB %.2f GB/s, four-block XEX encryption %.2f GB/s, decryption %.2f GB/s\n",page_mult(nvtest_pages)>>10,nvtest_rounds,nvtest_gbps(t0,t1),nvtest_gbps(t1,t2),nvtest_gbps(t2,t3));
+	free(snapshot);
+	free(pages);
+	return nvtest_finish();
+}
@@ -0,0 +1,158 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file is a reference AES-128 cipher for the tests of the AES-NI
+  Engine. It is a plain implementation of FIPS-197 without AES-NI.
+  The XEX mode follows the AES-NI Engine: the page tweak is encrypted with
+  the key, then multiplied by x in GF(2^128) before each block.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/aes_ref.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+
+u8 static nvtest_aes_sbox[256];
+
+u8 static nvtest_gf_mul(u8 a,u8 b)
+{
+	u8 r=0;
+	while(b)
+	{
+		if(b&1)r^=a;
+		a=(u8)((a<<1)^((a&0x80)?0x1b:0));
+		b>>=1;
+	}
+	return r;
+}
+
+void static nvtest_aes_initialize_sbox()
+{
+	// The S-Box is the multiplicative inverse followed by the affine transformation.
+	for(u32 i=0;i<256;i++)
+	{
+		u8 inv=0,s;
+		for(u32 j=1;j<256 && i;j++)
+		{
+			if(nvtest_gf_mul((u8)i,(u8)j)==1)
+			{
+				inv=(u8)j;
+				break;
+			}
+		}
+		s=inv;
+		for(u32 k=1;k<5;k++)s^=(u8)((inv<<k)|(inv>>(8-k)));
+		nvtest_aes_sbox[i]=s^0x63;
+	}
+}
+
+// Round keys are 176 bytes, including the round-0 key.
+void nvtest_aes128_reference_expand(u8p key,u8p round_keys)
+{
+	u8 rcon=1;
+	if(nvtest_aes_sbox[0]==0)nvtest_aes_initialize_sbox();
+	for(u32 i=0;i<16;i++)round_keys[i]=key[i];
+	for(u32 i=16;i<176;i+=4)
+	{
+		u8 t[4]={round_keys[i-4],round_keys[i-3],round_keys[i-2],round_keys[i-1]};
+		if(i%16==0)
+		{
+			const u8 t0=t[0];
+			t[0]=nvtest_aes_sbox[t[1]]^rcon;
+			t[1]=nvtest_aes_sbox[t[2]];
+			t[2]=nvtest_aes_sbox[t[3]];
+			t[3]=nvtest_aes_sbox[t0];
+			rcon=nvtest_gf_mul(rcon,2);
+		}
+		for(u32 j=0;j<4;j++)round_keys[i+j]=round_keys[i+j-16]^t[j];
+	}
+}
+
+void nvtest_aes128_reference_encrypt(u8p round_keys,u8p input,u8p output)
+{
+	u8 s[16];
+	for(u32 i=0;i<16;i++)s[i]=input[i]^round_keys[i];
+	for(u32 r=1;r<=10;r++)
+	{
+		u8 t[16];
+		// SubBytes and ShiftRows
+		for(u32 c=0;c<4;c++)
+			for(u32 j=0;j<4;j++)
+				t[c*4+j]=nvtest_aes_sbox[s[((c+j)%4)*4+j]];
+		// MixColumns, except for the last round.
+		for(u32 c=0;c<4 && r<10;c++)
+		{
+			u8p a=&t[c*4];
+			const u8 a0=a[0],a1=a[1],a2=a[2],a3=a[3];
+			a[0]=nvtest_gf_mul(a0,2)^nvtest_gf_mul(a1,3)^a2^a3;
+			a[1]=a0^nvtest_gf_mul(a1,2)^nvtest_gf_mul(a2,3)^a3;
+			a[2]=a0^a1^nvtest_gf_mul(a2,2)^nvtest_gf_mul(a3,3);
+			a[3]=nvtest_gf_mul(a0,3)^a1^a2^nvtest_gf_mul(a3,2);
+		}
+		for(u32 i=0;i<16;i++)s[i]=t[i]^round_keys[r*16+i];
+	}
+	for(u32 i=0;i<16;i++)output[i]=s[i];
+}
+
+void nvtest_aes128_reference(u8p key,u8p input,u8p output)
+{
+	u8 round_keys[176];
+	nvtest_aes128_reference_expand(key,round_keys);
+	nvtest_aes128_reference_encrypt(round_keys,input,output);
+}
+
+void nvtest_aes128_reference_inv_mix_column(u8p input,u8p output)
+{
+	for(u32 c=0;c<4;c++)
+	{
+		u8p a=&input[c*4];
+		output[c*4+0]=nvtest_gf_mul(a[0],14)^nvtest_gf_mul(a[1],11)^nvtest_gf_mul(a[2],13)^nvtest_gf_mul(a[3],9);
+		output[c*4+1]=nvtest_gf_mul(a[0],9)^nvtest_gf_mul(a[1],14)^nvtest_gf_mul(a[2],11)^nvtest_gf_mul(a[3],13);
+		output[c*4+2]=nvtest_gf_mul(a[0],13)^nvtest_gf_mul(a[1],9)^nvtest_gf_mul(a[2],14)^nvtest_gf_mul(a[3],11);
+		output[c*4+3]=nvtest_gf_mul(a[0],11)^nvtest_gf_mul(a[1],13)^nvtest_gf_mul(a[2],9)^nvtest_gf_mul(a[3],14);
+	}
+}
+
+// Returns the tweak of the block in the page whose tweak is specified.
+void nvtest_xex_block_tweak(u8p round_keys,u64 page_tweak,u32 block,u8p tweak)
+{
+	u8 input[16]={0};
+	u64 lo,hi;
+	for(u32 i=0;i<8;i++)input[i]=(u8)(page_tweak>>(i*8));
+	nvtest_aes128_reference_encrypt(round_keys,input,tweak);
+	lo=*(u64p)&tweak[0];
+	hi=*(u64p)&tweak[8];
+	// The first block is multiplied by x as well.
+	for(u32 i=0;i<=block;i++)
+	{
+		const u64 carry=(hi>>63)*0x87;
+		hi=(hi<<1)|(lo>>63);
+		lo=(lo<<1)^carry;
+	}
+	*(u64p)&tweak[0]=lo;
+	*(u64p)&tweak[8]=hi;
+}
+
+void nvtest_xex_reference(u8p key,u8p pages,u32 count,u64 page_tweak)
+{
+	u8 round_keys[176];
+	nvtest_aes128_reference_expand(key,round_keys);
+	for(u32 p=0;p<count;p++,page_tweak+=page_size)
+	{
+		for(u32 b=0;b<page_size/16;b++)
+		{
+			u8p block=&pages[page_mult(p)+b*16];
+			u8 tweak[16];
+			nvtest_xex_block_tweak(round_keys,page_tweak,b,tweak);
+			for(u32 i=0;i<16;i++)block[i]^=tweak[i];
+			nvtest_aes128_reference_encrypt(round_keys,block,block);
+			for(u32 i=0;i<16;i++)block[i]^=tweak[i];
+		}
+	}
+}
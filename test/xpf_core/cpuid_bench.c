@@ -0,0 +1,146 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the CPUID Quick-Paths of CVMs.
+  A few hundred leaves and subleaves are set in the VM, like a guest
+  with the leaves of a modern processor. The latency of resolving the
+  cpuid instruction in the exit handler is reported for leaves found
+  in the vCPU and the VM, for subleaves covered by a whole leaf, and
+  for leaves that are absent or passed to the host.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/cpuid_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_basic_leaves		0x20
+#define nvtest_extended_leaves	0x40
+#define nvtest_subleaves		8
+#define nvtest_rounds			200
+
+bool nvc_resolve_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,noir_cpuid_general_info_p info);
+noir_status nvc_set_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,noir_cvm_cpuid_quickpath_info_p info);
+noir_status nvc_set_cpuid_fallback(noir_cvm_virtual_machine_p vm,bool enabled,u32 eax_mask,u32 ebx_mask,u32 ecx_mask,u32 edx_mask);
+
+noir_cvm_virtual_machine_p nvtest_vm;
+noir_cvm_virtual_cpu_p nvtest_vcpu;
+noir_cvm_cpuid_quickpath_info nvtest_entries[noir_cvm_cpuid_quickpath_limit_per_vm];
+u32 nvtest_entry_count=0;
+u32 nvtest_queries[noir_cvm_cpuid_quickpath_limit_per_vm][2];
+
+void nvtest_set(noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,bool has_subleaf)
+{
+	noir_cvm_cpuid_quickpath_info info={0};
+	info.leaf=leaf;
+	info.subleaf=subleaf;
+	info.options.active=true;
+	info.options.has_subleaf=has_subleaf;
+	info.eax=leaf;
+	info.ebx=subleaf;
+	nvtest_check_eq(nvc_set_cpuid_quickpath(nvtest_vm,vcpu,&info),noir_success);
+	if(vcpu==null)nvtest_entries[nvtest_entry_count++]=info;
+}
+
+// Basic and extended leaves, the first of which have subleaves, and the leaves of a hypervisor.
+void nvtest_populate()
+{
+	for(u32 i=0;i<nvtest_basic_leaves;i++)
+	{
+		if(i<8)
+			for(u32 j=0;j<nvtest_subleaves;j++)nvtest_set(null,i,j,true);
+		else
+			nvtest_set(null,i,0,false);
+	}
+	for(u32 i=0;i<nvtest_extended_leaves;i++)
+	{
+		if(i<8)
+			for(u32 j=0;j<nvtest_subleaves;j++)nvtest_set(null,0x80000000+i,j,true);
+		else
+			nvtest_set(null,0x80000000+i,0,false);
+	}
+	for(u32 i=0;nvtest_entry_count<noir_cvm_cpuid_quickpath_limit_per_vm;i++)
+		nvtest_set(null,0x40000000+i,0,false);
+	// The vCPU overrides some leaves, like the x2APIC ID of leaf 0xB.
+	nvtest_set(nvtest_vcpu,0xb,0,true);
+	nvtest_set(nvtest_vcpu,0xb,1,true);
+}
+
+// Returns the mean latency in nanoseconds.
+double nvtest_measure(u32 count)
+{
+	noir_cpuid_general_info info;
+	u64 t0,t1,resolved=0;
+	t0=nvtest_time_ns();
+	for(u32 r=0;r<nvtest_rounds;r++)
+		for(u32 i=0;i<count;i++)
+			resolved+=nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,nvtest_queries[i][0],nvtest_queries[i][1],&info);
+	t1=nvtest_time_ns();
+	nvtest_check_eq(resolved,(u64)nvtest_rounds*count);
+	return (double)(t1-t0)/resolved;
+}
+
+void nvtest_benchmark(const char* name,u32 count)
+{
+	nvtest_report("%-28s %4u queries: %6.1f ns\n",name,count,nvtest_measure(count));
+}
+
+int main()
+{
+	u32 count;
+	nvtest_set_processor_count(1);
+	nvtest_vm=noir_alloc_nonpg_memory(sizeof(noir_cvm_virtual_machine));
+	nvtest_vcpu=noir_alloc_nonpg_memory(sizeof(noir_cvm_virtual_cpu));
+	nvtest_check(nvtest_vm!=null && nvtest_vcpu!=null);
+	nvtest_vm->vcpu_list_lock=noir_initialize_reslock();
+	nvtest_populate();
+	nvtest_report("CPUID exits resolved by Quick-Paths with %u leaves in the VM:\n",nvtest_entry_count);
+	// Leaves of the vCPU.
+	for(u32 i=0;i<2;i++)
+	{
+		nvtest_queries[i][0]=0xb;
+		nvtest_queries[i][1]=i;
+	}
+	nvtest_benchmark("Leaves of the vCPU",2);
+	// Leaves of the VM.
+	for(u32 i=0;i<nvtest_entry_count;i++)
+	{
+		nvtest_queries[i][0]=nvtest_entries[i].leaf;
+		nvtest_queries[i][1]=nvtest_entries[i].subleaf;
+	}
+	nvtest_benchmark("Leaves of the VM",nvtest_entry_count);
+	// Subleaves covered by whole leaves are found by the second probe.
+	count=0;
+	for(u32 i=0;i<nvtest_entry_count;i++)
+	{
+		if(!nvtest_entries[i].options.has_subleaf)
+		{
+			nvtest_queries[count][0]=nvtest_entries[i].leaf;
+			nvtest_queries[count++][1]=5;
+		}
+	}
+	nvtest_benchmark("Subleaves of whole leaves",count);
+	// Absent leaves.
+	for(u32 i=0;i<nvtest_entry_count;i++)
+	{
+		nvtest_queries[i][0]=0xC0000000+i;
+		nvtest_queries[i][1]=0;
+	}
+	nvtest_benchmark("Absent leaves",nvtest_entry_count);
+	nvtest_check_eq(nvc_set_cpuid_fallback(nvtest_vm,true,0xffffffff,0xffffffff,0xffffffff,0xffffffff),noir_success);
+	nvtest_benchmark("Absent leaves to the host",nvtest_entry_count);
+	noir_finalize_reslock(nvtest_vm->vcpu_list_lock);
+	noir_free_nonpg_memory(nvtest_vcpu);
+	noir_free_nonpg_memory(nvtest_vm);
+	return nvtest_finish();
+}
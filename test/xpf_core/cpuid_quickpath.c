@@ -0,0 +1,205 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the CPUID Quick-Paths of CVMs.
+  Entries are inserted, probed and retired in the open-addressed hash
+  tables of the VM and the vCPU. The sequence must make the exit handler
+  retry, rather than return, results read amid an update of the host.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/cpuid_quickpath.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+
+#define nvtest_updates		100000
+
+noir_status nvc_insert_cpuid_quickpath(noir_cvm_cpuid_quickpath_info_p table,u32 slots,u32 limit,u32p count,noir_cvm_cpuid_quickpath_info_p info);
+bool nvc_resolve_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,noir_cpuid_general_info_p info);
+noir_status nvc_set_cpuid_quickpath(noir_cvm_virtual_machine_p vm,noir_cvm_virtual_cpu_p vcpu,noir_cvm_cpuid_quickpath_info_p info);
+noir_status nvc_set_cpuid_fallback(noir_cvm_virtual_machine_p vm,bool enabled,u32 eax_mask,u32 ebx_mask,u32 ecx_mask,u32 edx_mask);
+
+noir_cvm_virtual_machine_p nvtest_vm;
+noir_cvm_virtual_cpu_p nvtest_vcpu;
+u32v nvtest_stop=false;
+
+// All four registers of an entry carry the same value, so that a torn read is detectable.
+noir_status nvtest_set(noir_cvm_virtual_cpu_p vcpu,u32 leaf,u32 subleaf,bool has_subleaf,bool active,u32 value)
+{
+	noir_cvm_cpuid_quickpath_info info={0};
+	info.leaf=leaf;
+	info.subleaf=subleaf;
+	info.options.active=active;
+	info.options.has_subleaf=has_subleaf;
+	info.eax=info.ebx=info.ecx=info.edx=value;
+	return nvc_set_cpuid_quickpath(nvtest_vm,vcpu,&info);
+}
+
+// Returns the value of the resolved entry. Zero means no entry is resolved.
+u32 nvtest_resolve(u32 leaf,u32 subleaf)
+{
+	noir_cpuid_general_info info;
+	nvtest_check(nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,leaf,subleaf,&info));
+	nvtest_check(info.eax==info.ebx && info.eax==info.ecx && info.eax==info.edx);
+	return info.eax;
+}
+
+void nvtest_insert_and_probe()
+{
+	// Entries covering all subleaves match any subleaf.
+	nvtest_check_eq(nvtest_set(null,1,0,false,true,0x101),noir_success);
+	nvtest_check_eq(nvtest_resolve(1,0),0x101);
+	nvtest_check_eq(nvtest_resolve(1,5),0x101);
+	// Subleaf-specific entries take precedence.
+	nvtest_check_eq(nvtest_set(null,7,0,false,true,0x700),noir_success);
+	nvtest_check_eq(nvtest_set(null,7,1,true,true,0x701),noir_success);
+	nvtest_check_eq(nvtest_resolve(7,1),0x701);
+	nvtest_check_eq(nvtest_resolve(7,2),0x700);
+	// Entries of the vCPU take precedence over those of the VM.
+	nvtest_check_eq(nvtest_set(nvtest_vcpu,1,0,false,true,0x111),noir_success);
+	nvtest_check_eq(nvtest_resolve(1,0),0x111);
+	nvtest_check_eq(nvtest_vm->cpuid_quickpath_count,3);
+	nvtest_check_eq(nvtest_vcpu->cpuid_quickpath_count,1);
+	// Updates replace the entry in place.
+	nvtest_check_eq(nvtest_set(null,7,1,true,true,0x7011),noir_success);
+	nvtest_check_eq(nvtest_resolve(7,1),0x7011);
+	nvtest_check_eq(nvtest_vm->cpuid_quickpath_count,3);
+	// Absent leaves are resolved as zeros.
+	nvtest_check_eq(nvtest_resolve(0x80000008,0),0);
+	// Each update is bracketed by the sequence.
+	nvtest_check_eq(nvtest_vm->cpuid_quickpath_seq&1,0);
+	nvtest_check_eq(nvtest_vm->cpuid_quickpath_seq,10);
+}
+
+void nvtest_retire()
+{
+	noir_cvm_cpuid_quickpath_info table[noir_cvm_cpuid_quickpath_slots_per_vcpu]={0};
+	noir_cvm_cpuid_quickpath_info info={0};
+	u32 count=0;
+	info.options.active=true;
+	// Fill the table to its limit. Some of the keys collide.
+	for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vcpu;i++)
+	{
+		info.leaf=0x80000000+i;
+		info.eax=i;
+		nvtest_check_eq(nvc_insert_cpuid_quickpath(table,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&count,&info),noir_success);
+	}
+	nvtest_check_eq(count,noir_cvm_cpuid_quickpath_limit_per_vcpu);
+	info.leaf=0x40000000;
+	nvtest_check_eq(nvc_insert_cpuid_quickpath(table,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&count,&info),noir_insufficient_resources);
+	// Retire the entries one by one. Entries probed past the retired slots remain reachable.
+	for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vcpu;i++)
+	{
+		info.leaf=0x80000000+i;
+		info.options.active=false;
+		nvtest_check_eq(nvc_insert_cpuid_quickpath(table,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&count,&info),noir_success);
+		nvtest_check_eq(nvc_insert_cpuid_quickpath(table,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&count,&info),noir_unsuccessful);
+		noir_copy_memory(nvtest_vcpu->cpuid_quickpath,table,sizeof(table));
+		for(u32 j=0;j<noir_cvm_cpuid_quickpath_limit_per_vcpu;j++)
+		{
+			noir_cpuid_general_info result;
+			nvtest_check(nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0x80000000+j,0,&result));
+			if(j>i)
+				nvtest_check_eq(result.eax,j);
+			else
+				nvtest_check_eq(result.eax|result.ebx|result.ecx|result.edx,0);
+		}
+	}
+	// Retired slots are reused without consuming empty slots.
+	for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vcpu;i++)
+	{
+		info.leaf=0x40000100+i;
+		info.eax=i;
+		info.options.active=true;
+		nvtest_check_eq(nvc_insert_cpuid_quickpath(table,noir_cvm_cpuid_quickpath_slots_per_vcpu,noir_cvm_cpuid_quickpath_limit_per_vcpu,&count,&info),noir_success);
+	}
+	nvtest_check_eq(count,noir_cvm_cpuid_quickpath_limit_per_vcpu);
+	noir_copy_memory(nvtest_vcpu->cpuid_quickpath,table,sizeof(table));
+	for(u32 i=0;i<noir_cvm_cpuid_quickpath_limit_per_vcpu;i++)
+	{
+		noir_cpuid_general_info result;
+		nvtest_check(nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0x40000100+i,0,&result));
+		nvtest_check_eq(result.eax,i);
+	}
+	noir_stosb(nvtest_vcpu->cpuid_quickpath,0,sizeof(table));
+	nvtest_vcpu->cpuid_quickpath_count=0;
+}
+
+void nvtest_fallback()
+{
+	noir_cpuid_general_info host,info;
+	// Leaves absent from Quick-Paths are passed to host CPUID and masked.
+	nvtest_check_eq(nvc_set_cpuid_fallback(nvtest_vm,true,0xffffffff,0,0xffff0000,0x0000ffff),noir_success);
+	noir_cpuid(0,0,&host.eax,&host.ebx,&host.ecx,&host.edx);
+	nvtest_check(nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0,0,&info));
+	nvtest_check_eq(info.eax,host.eax);
+	nvtest_check_eq(info.ebx,0);
+	nvtest_check_eq(info.ecx,host.ecx&0xffff0000);
+	nvtest_check_eq(info.edx,host.edx&0x0000ffff);
+	// Hypervisor leaves of the host are never exposed.
+	nvtest_check_eq(nvtest_resolve(0x40000000,0),0);
+	nvtest_check_eq(nvc_set_cpuid_fallback(nvtest_vm,false,0,0,0,0),noir_success);
+	nvtest_check_eq(nvtest_resolve(0,0),0);
+}
+
+u32 stdcall nvtest_writer(void* context)
+{
+	// Flip the entry between two values until the reader is finished.
+	for(u32 i=0;!nvtest_stop;i++)
+		nvtest_set(null,0xd,1,true,true,i&1?0xaaaaaaaa:0x55555555);
+	return 0;
+}
+
+void nvtest_sequence()
+{
+	noir_cpuid_general_info info;
+	noir_thread writer;
+	u32 retries=0,torn=0;
+	// An update in progress makes the exit handler retry at once.
+	nvtest_check_eq(nvtest_set(null,0xd,1,true,true,0x55555555),noir_success);
+	nvtest_vm->cpuid_quickpath_seq++;
+	nvtest_check(!nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0xd,1,&info));
+	nvtest_vm->cpuid_quickpath_seq++;
+	nvtest_check(nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0xd,1,&info));
+	nvtest_check_eq(info.eax,0x55555555);
+	// Results accepted amid concurrent updates are never torn.
+	writer=nvtest_create_thread(nvtest_writer,null,1);
+	for(u32 i=0;i<nvtest_updates;i++)
+	{
+		if(!nvc_resolve_cpuid_quickpath(nvtest_vm,nvtest_vcpu,0xd,1,&info))
+			retries++;
+		else if(info.eax!=info.ebx || info.eax!=info.ecx || info.eax!=info.edx || (info.eax!=0xaaaaaaaa && info.eax!=0x55555555))
+			torn++;
+	}
+	nvtest_stop=true;
+	noir_join_thread(writer);
+	nvtest_check_eq(torn,0);
+	nvtest_check(retries<nvtest_updates);
+}
+
+int main()
+{
+	nvtest_set_processor_count(2);
+	nvtest_vm=noir_alloc_nonpg_memory(sizeof(noir_cvm_virtual_machine));
+	nvtest_vcpu=noir_alloc_nonpg_memory(sizeof(noir_cvm_virtual_cpu));
+	nvtest_check(nvtest_vm!=null && nvtest_vcpu!=null);
+	nvtest_vm->vcpu_list_lock=noir_initialize_reslock();
+	nvtest_insert_and_probe();
+	nvtest_retire();
+	nvtest_fallback();
+	nvtest_sequence();
+	noir_finalize_reslock(nvtest_vm->vcpu_list_lock);
+	noir_free_nonpg_memory(nvtest_vcpu);
+	noir_free_nonpg_memory(nvtest_vm);
+	return nvtest_finish();
+}
@@ -0,0 +1,131 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the CRC32C routines of the CI component.
+  The interleaved routine is checked against the serial routine and a
+  bitwise reference before the throughput of both routines is measured.
+  A full sweep of Software CI is then simulated with up to eight pinned
+  workers, each owning a strided partition of the protected pages.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/crc_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nv_intrin.h>
+#include <nvtest.h>
+#include <stdlib.h>
+
+#define nvtest_pages		4096
+#define nvtest_rounds		16
+#define nvtest_max_workers	8
+
+typedef u32 (stdcall *nvtest_crc32_page_func)(void* page);
+
+u32 stdcall noir_crc32_page_sse(void* page);
+u32 stdcall noir_crc32_page_clmul(void* page);
+bool fastcall noir_check_sse42();
+bool fastcall noir_check_pclmulqdq();
+
+typedef struct _nvtest_sweep_worker
+{
+	u8p image;
+	u32 index;
+	u32 workers;
+	u32 mismatches;
+	u32 reserved;
+	u32p crc;
+}nvtest_sweep_worker,*nvtest_sweep_worker_p;
+
+// Bit-reflected CRC32C without pre- and post-inversion, as is done by crc32 instructions.
+u32 nvtest_crc32c_reference(u8p page)
+{
+	u32 crc=0;
+	for(u32 i=0;i<page_size;i++)
+	{
+		crc^=page[i];
+		for(u32 j=0;j<8;j++)crc=(crc>>1)^(0x82F63B78&(0-(crc&1)));
+	}
+	return crc;
+}
+
+double nvtest_crc_gbps(nvtest_crc32_page_func crc32_page,u8p image)
+{
+	u32v sink=0;
+	u64 t0=nvtest_time_ns(),t1;
+	for(u32 r=0;r<nvtest_rounds;r++)
+		for(u32 i=0;i<nvtest_pages;i++)
+			sink+=crc32_page(&image[page_mult(i)]);
+	t1=nvtest_time_ns();
+	return (double)page_mult((u64)nvtest_pages*nvtest_rounds)/(double)(t1-t0);
+}
+
+u32 stdcall nvtest_sweep_worker_routine(void* context)
+{
+	nvtest_sweep_worker_p worker=(nvtest_sweep_worker_p)context;
+	noir_set_thread_affinity(worker->index);
+	for(u32 i=worker->index;i<nvtest_pages;i+=worker->workers)
+		if(noir_crc32_page_clmul(&worker->image[page_mult(i)])!=worker->crc[i])
+			worker->mismatches++;
+	return 0;
+}
+
+double nvtest_sweep_ms(u8p image,u32p crc,u32 workers)
+{
+	nvtest_sweep_worker worker[nvtest_max_workers];
+	noir_thread threads[nvtest_max_workers];
+	u64 t0=nvtest_time_ns(),t1;
+	for(u32 i=0;i<workers;i++)
+	{
+		worker[i].image=image;
+		worker[i].index=i;
+		worker[i].workers=workers;
+		worker[i].mismatches=0;
+		worker[i].crc=crc;
+		threads[i]=nvtest_create_thread(nvtest_sweep_worker_routine,&worker[i],i);
+	}
+	for(u32 i=0;i<workers;i++)
+	{
+		noir_join_thread(threads[i]);
+		nvtest_check_eq(worker[i].mismatches,0);
+	}
+	t1=nvtest_time_ns();
+	return (double)(t1-t0)/1e6;
+}
+
+int main()
+{
+	u8p image=aligned_alloc(page_size,page_mult(nvtest_pages));
+	u32p crc=malloc(sizeof(u32)*nvtest_pages);
+	u64 seed=1;
+	if(!noir_check_sse42() || !noir_check_pclmulqdq())
+	{
+		nvtest_report("SSE4.2 and PCLMULQDQ are required!\n");
+		return nvtest_finish();
+	}
+	for(u32 i=0;i<page_mult(nvtest_pages);i++)
+	{
+		seed=seed*6364136223846793005+1442695040888963407;
+		image[i]=(u8)(seed>>56);
+	}
+	for(u32 i=0;i<nvtest_pages;i++)
+	{
+		crc[i]=noir_crc32_page_sse(&image[page_mult(i)]);
+		nvtest_check_eq(noir_crc32_page_clmul(&image[page_mult(i)]),crc[i]);
+		if(i<64)nvtest_check_eq(nvtest_crc32c_reference(&image[page_mult(i)]),crc[i]);
+	}
+	nvtest_set_processor_count(nvtest_max_workers);
+	nvtest_report("%u MiB: serial crc32 %.2f GB/s, three-stream crc32 %.2f GB/s\n",page_mult(nvtest_pages)>>20,nvtest_crc_gbps(noir_crc32_page_sse,image),nvtest_crc_gbps(noir_crc32_page_clmul,image));
+	for(u32 workers=1;workers<=nvtest_max_workers;workers<<=1)
+		nvtest_report("%u worker(s): full sweep of %u pages in %.2f ms\n",workers,nvtest_pages,nvtest_sweep_ms(image,crc,workers));
+	free(crc);
+	free(image);
+	return nvtest_finish();
+}
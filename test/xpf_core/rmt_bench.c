@@ -0,0 +1,113 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the ownership index of the Reverse-Mapping Table
+  on a simulated host with 1TiB of physical memory.
+  A CVM maps 2MiB host chunks scattered over the host, then unmaps most
+  of them. The enumeration at teardown is timed with the shrunk index,
+  with an index that only grows, and with a scan of the entire table.
+  The table is reserved without being committed, so only the entries of
+  the CVM and the entries visited by the scan are backed by memory.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/rmt_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nvtest.h>
+#include <sys/mman.h>
+
+#define nvtest_host_size		0x10000000000
+#define nvtest_host_chunks		(u32)(nvtest_host_size>>page_2mb_shift)
+#define nvtest_vm_chunks		8192
+#define nvtest_chunk_pages		512
+#define nvtest_asid				2
+
+// Odd multipliers permute the chunks of the host, so that the chunks are scattered and never reused.
+u64 nvtest_chunk_base(u32 chunk)
+{
+	return page_2mb_mult((u64)((chunk*40503+1)&(nvtest_host_chunks-1)));
+}
+
+void nvtest_assign_chunk(u32 chunk,u64p hpa_list,u32 asid)
+{
+	noir_rmt_entry_p rm_table=nvc_get_rmt_entry(nvtest_chunk_base(chunk));
+	for(u32 i=0;i<nvtest_chunk_pages;i++)
+	{
+		hpa_list[i]=nvtest_chunk_base(chunk)+page_4kb_mult((u64)i);
+		rm_table[i].low.asid=asid;
+	}
+}
+
+double nvtest_enum_ms(noir_rmt_ownership_index_p index,u32p pages)
+{
+	u64 t0=nvtest_time_ns();
+	*pages=nvc_enum_rmt_entries_by_asid(index,nvtest_asid,null,null);
+	return (double)(nvtest_time_ns()-t0)/1e6;
+}
+
+int main()
+{
+	noir_rmt_ownership_index shrunk={0},grown={0},overflown={0};
+	noir_rmt_directory_entry_p rmt_dir=noir_alloc_contd_memory(page_size);
+	u64 hpa_list[nvtest_chunk_pages];
+	u64 t0,t1,t2;
+	u32 shrunk_pages,grown_pages,scan_pages,grown_extents;
+	double shrunk_ms,grown_ms,scan_ms;
+	rmt_dir->hpa_start=0;
+	rmt_dir->hpa_end=nvtest_host_size;
+	rmt_dir->table.virt=mmap(null,page_4kb_count(nvtest_host_size)*sizeof(noir_rmt_entry),PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+	if(rmt_dir->table.virt==MAP_FAILED)
+	{
+		nvtest_report("Failed to reserve the Reverse-Mapping Table of a 1TiB host!\n");
+		return nvtest_finish();
+	}
+	hvm_p->rmd.directory.virt=rmt_dir;
+	hvm_p->rmd.dir_count=1;
+	// Map 16GiB to the CVM.
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_vm_chunks;i++)
+	{
+		nvtest_assign_chunk(i,hpa_list,nvtest_asid);
+		nvc_rmt_index_insert(&shrunk,hpa_list,nvtest_chunk_pages);
+		nvc_rmt_index_insert(&grown,hpa_list,nvtest_chunk_pages);
+	}
+	t1=nvtest_time_ns();
+	// Unmap three of every four chunks. The grown index does not remove them.
+	for(u32 i=0;i<nvtest_vm_chunks;i++)
+	{
+		if(i&3)
+		{
+			nvtest_assign_chunk(i,hpa_list,1);
+			nvc_rmt_index_remove(&shrunk,hpa_list,nvtest_chunk_pages);
+		}
+	}
+	t2=nvtest_time_ns();
+	grown_extents=grown.count;
+	overflown.overflow=true;
+	shrunk_ms=nvtest_enum_ms(&shrunk,&shrunk_pages);
+	grown_ms=nvtest_enum_ms(&grown,&grown_pages);
+	scan_ms=nvtest_enum_ms(&overflown,&scan_pages);
+	nvtest_check_eq(shrunk.count,nvtest_vm_chunks/4);
+	nvtest_check_eq(shrunk_pages,nvtest_vm_chunks/4*nvtest_chunk_pages);
+	nvtest_check_eq(grown_pages,shrunk_pages);
+	nvtest_check_eq(scan_pages,shrunk_pages);
+	nvtest_report("Insertion: %.1f ns/page. Removal: %.1f ns/page.\n",(double)(t1-t0)/(nvtest_vm_chunks*nvtest_chunk_pages),(double)(t2-t1)/(nvtest_vm_chunks/4*3*nvtest_chunk_pages));
+	nvtest_report("Teardown enumeration of %u pages on a 1TiB host:\n",shrunk_pages);
+	nvtest_report("  shrunk index: %u extents (%u KiB), %.2f ms\n",shrunk.count,(u32)(shrunk.limit*sizeof(noir_rmt_extent)>>10),shrunk_ms);
+	nvtest_report("  grown index:  %u extents (%u KiB), %.2f ms\n",grown_extents,(u32)(grown.limit*sizeof(noir_rmt_extent)>>10),grown_ms);
+	nvtest_report("  full scan:    %.2f ms\n",scan_ms);
+	nvc_rmt_index_release(&shrunk);
+	nvc_rmt_index_release(&grown);
+	munmap(rmt_dir->table.virt,page_4kb_count(nvtest_host_size)*sizeof(noir_rmt_entry));
+	noir_free_contd_memory(rmt_dir,page_size);
+	return nvtest_finish();
+}
@@ -0,0 +1,119 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file tests the ownership index of the Reverse-Mapping Table.
+  Extents are inserted and removed in the way pages are mapped to and
+  unmapped from a CVM, and the index is checked to shrink accordingly.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/rmt_index.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <noirhvm.h>
+#include <nvtest.h>
+
+#define nvtest_base		0x100000000
+
+void nvtest_fill(u64p hpa_list,u64 start,u32 pages)
+{
+	for(u32 i=0;i<pages;i++)hpa_list[i]=start+page_4kb_mult((u64)i);
+}
+
+void nvtest_check_extent(noir_rmt_ownership_index_p index,u32 i,u64 start,u64 pages)
+{
+	nvtest_check_eq(index->extents[i].hpa_start,start);
+	nvtest_check_eq(index->extents[i].pages,pages);
+}
+
+void nvtest_trim_and_split()
+{
+	noir_rmt_ownership_index index={0};
+	u64 hpa_list[16];
+	nvtest_fill(hpa_list,nvtest_base,16);
+	nvc_rmt_index_insert(&index,hpa_list,16);
+	nvtest_fill(hpa_list,nvtest_base+0x100000,8);
+	nvc_rmt_index_insert(&index,hpa_list,8);
+	nvtest_check_eq(index.count,2);
+	// Removing pages in the middle splits the extent.
+	nvtest_fill(hpa_list,nvtest_base+0x4000,4);
+	nvc_rmt_index_remove(&index,hpa_list,4);
+	nvtest_check_eq(index.count,3);
+	nvtest_check_extent(&index,0,nvtest_base,4);
+	nvtest_check_extent(&index,1,nvtest_base+0x8000,8);
+	nvtest_check_extent(&index,2,nvtest_base+0x100000,8);
+	// Removing the head and the tail trims the extents.
+	nvtest_fill(hpa_list,nvtest_base,2);
+	nvc_rmt_index_remove(&index,hpa_list,2);
+	nvtest_fill(hpa_list,nvtest_base+0x104000,4);
+	nvc_rmt_index_remove(&index,hpa_list,4);
+	nvtest_check_eq(index.count,3);
+	nvtest_check_extent(&index,0,nvtest_base+0x2000,2);
+	nvtest_check_extent(&index,2,nvtest_base+0x100000,4);
+	// A run covering several extents deletes them, including pages never indexed.
+	nvtest_fill(hpa_list,nvtest_base+0x2000,16);
+	nvc_rmt_index_remove(&index,hpa_list,16);
+	nvtest_check_eq(index.count,1);
+	nvtest_check_extent(&index,0,nvtest_base+0x100000,4);
+	// Scattered pages are removed as separate runs.
+	hpa_list[0]=nvtest_base+0x103000;
+	hpa_list[1]=nvtest_base+0x100000;
+	nvc_rmt_index_remove(&index,hpa_list,2);
+	nvtest_check_eq(index.count,1);
+	nvtest_check_extent(&index,0,nvtest_base+0x101000,2);
+	// The storage is released when the index is emptied.
+	nvtest_fill(hpa_list,nvtest_base+0x101000,2);
+	nvc_rmt_index_remove(&index,hpa_list,2);
+	nvtest_check_eq(index.count,0);
+	nvtest_check(index.extents==null);
+	nvc_rmt_index_release(&index);
+}
+
+void nvtest_shrink()
+{
+	noir_rmt_ownership_index index={0};
+	const u32 extents=noir_rmt_index_initial_extents*16;
+	// Every other page is indexed so that no extents are merged.
+	for(u32 i=0;i<extents;i++)
+	{
+		u64 hpa=nvtest_base+page_4kb_mult((u64)i<<1);
+		nvc_rmt_index_insert(&index,&hpa,1);
+	}
+	nvtest_check_eq(index.count,extents);
+	nvtest_check_eq(index.limit,extents);
+	// Remove all but the first 1/16 of the extents with a single run.
+	{
+		u64p hpa_list=noir_alloc_nonpg_memory(sizeof(u64)*extents*2);
+		nvtest_fill(hpa_list,nvtest_base+page_4kb_mult((u64)noir_rmt_index_initial_extents<<1),(extents-noir_rmt_index_initial_extents)*2);
+		nvc_rmt_index_remove(&index,hpa_list,(extents-noir_rmt_index_initial_extents)*2);
+		noir_free_nonpg_memory(hpa_list);
+	}
+	nvtest_check_eq(index.count,noir_rmt_index_initial_extents);
+	nvtest_check(index.limit<extents);
+	nvtest_check_extent(&index,noir_rmt_index_initial_extents-1,nvtest_base+page_4kb_mult((u64)(noir_rmt_index_initial_extents-1)<<1),1);
+	// Reinserting the adjacent pages merges the extents again.
+	{
+		u64 hpa_list[noir_rmt_index_initial_extents*2];
+		nvtest_fill(hpa_list,nvtest_base,noir_rmt_index_initial_extents*2);
+		nvc_rmt_index_insert(&index,hpa_list,noir_rmt_index_initial_extents*2);
+		// Removals normalize the index, merging the adjacent extents.
+		nvc_rmt_index_remove(&index,hpa_list,0);
+		nvtest_check_eq(index.count,1);
+		nvtest_check_extent(&index,0,nvtest_base,noir_rmt_index_initial_extents*2);
+	}
+	nvc_rmt_index_release(&index);
+}
+
+int main()
+{
+	nvtest_trim_and_split();
+	nvtest_shrink();
+	return nvtest_finish();
+}
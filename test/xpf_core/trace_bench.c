@@ -0,0 +1,112 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file benchmarks the binary tracing facility against nvd_printf.
+  Producers run on separate simulated processors while one drainer
+  flushes all rings, in the way the Windows logger and the UEFI timer do.
+  The debug port is not configured, so the cost of nvd_printf here is
+  formatting and the port lock, without the UART.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/trace_bench.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nv_intrin.h>
+#include <debug.h>
+#include <nvtest.h>
+
+#define nvtest_events_per_thread		0x100000
+#define nvtest_max_threads				8
+
+u32v nvtest_producers_running=0;
+u64v nvtest_flushed=0;
+u64v nvtest_dropped=0;
+u64 nvtest_elapsed[nvtest_max_threads];
+
+void nvtest_count_record(u32 proc_id,u64 timestamp,const char* text)
+{
+	nvtest_flushed++;
+}
+
+u32 stdcall nvtest_trace_producer(void* context)
+{
+	const u32 index=(u32)(ulong_ptr)context;
+	u64 t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_events_per_thread;i++)
+		nvd_trace2(noir_trace_event_msr_write,0xC0000080,i);
+	nvtest_elapsed[index]=nvtest_time_ns()-t0;
+	noir_locked_dec(&nvtest_producers_running);
+	return 0;
+}
+
+u32 stdcall nvtest_printf_producer(void* context)
+{
+	const u32 index=(u32)(ulong_ptr)context;
+	u64 t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_events_per_thread;i++)
+		nvd_printf("Intercepted MSR-write to Index=0x%X! Incoming Value: 0x%016llX\n",0xC0000080,(u64)i);
+	nvtest_elapsed[index]=nvtest_time_ns()-t0;
+	noir_locked_dec(&nvtest_producers_running);
+	return 0;
+}
+
+void nvtest_flush_all(u32 threads)
+{
+	for(u32 i=0;i<threads;i++)
+	{
+		nvd_trace_flush(i,nvtest_count_record);
+		nvtest_dropped+=nvd_trace_query_dropped(i);
+	}
+}
+
+double nvtest_run_producers(noir_thread_procedure procedure,u32 threads,bool drain)
+{
+	noir_thread handles[nvtest_max_threads];
+	u64 total=0;
+	nvtest_producers_running=threads;
+	for(u32 i=0;i<threads;i++)
+	{
+		handles[i]=nvtest_create_thread(procedure,(void*)(ulong_ptr)i,i);
+		nvtest_check(handles[i]!=null);
+	}
+	// The main thread acts as the drainer.
+	while(nvtest_producers_running)
+		if(drain)nvtest_flush_all(threads);
+	for(u32 i=0;i<threads;i++)
+	{
+		noir_join_thread(handles[i]);
+		total+=nvtest_elapsed[i];
+	}
+	if(drain)nvtest_flush_all(threads);
+	return (double)total/((u64)threads*nvtest_events_per_thread);
+}
+
+void nvtest_benchmark_trace(u32 threads)
+{
+	const u64 events=(u64)threads*nvtest_events_per_thread;
+	double trace_ns,printf_ns;
+	nvtest_set_processor_count(threads);
+	nvtest_check_eq(nvd_trace_initialize(),noir_success);
+	nvtest_flushed=nvtest_dropped=0;
+	trace_ns=nvtest_run_producers(nvtest_trace_producer,threads,true);
+	// Every record is either flushed or counted as dropped.
+	nvtest_check_eq(nvtest_flushed+nvtest_dropped,events);
+	nvd_trace_finalize();
+	printf_ns=nvtest_run_producers(nvtest_printf_producer,threads,false);
+	nvtest_report("%u thread(s): nvd_trace %6.2f ns/event, nvd_printf %7.2f ns/event, %llu flushed, %llu dropped (%.2f%%)\n",threads,trace_ns,printf_ns,nvtest_flushed,nvtest_dropped,nvtest_dropped*100.0/events);
+}
+
+int main()
+{
+	for(u32 threads=1;threads<=nvtest_max_threads;threads<<=1)
+		nvtest_benchmark_trace(threads);
+	return nvtest_finish();
+}
@@ -0,0 +1,256 @@
+/*
+  NoirVisor - Hardware-Accelerated Hypervisor solution
+
+  Copyright 2018-2024, Zero Tang. All rights reserved.
+
+  This file stress-tests the handle table of the CVM in the Windows layer.
+  Each thread creates, references and deletes handles in a ring of live
+  handles, while it references handles published by other threads without
+  acquiring the lock. A stale handle must never resolve to an object.
+  Releasing a VM must invalidate its handle while the VM is released.
+
+  This program is distributed in the hope that it will be useful, but
+  without any warranty (no matter implied warranty or merchantability
+  or fitness for a particular purpose, etc.).
+
+  File Location: /test/xpf_core/windows/cvm_handle.c
+*/
+
+#include <nvdef.h>
+#include <nvbdk.h>
+#include <nvstatus.h>
+#include <nvtest.h>
+#include <ntddk.h>
+#include "../../../src/xpf_core/windows/custom_vm.h"
+
+#define nvtest_threads				4
+#define nvtest_operations			1000000
+#define nvtest_ring_size			64
+#define nvtest_published_size		1024
+#define nvtest_object_tag			0x4E56000000000000
+
+extern NOIR_CVM_HANDLE_TABLE NoirCvmHandleTable;
+
+PNOIR_CVM_HANDLE_ENTRY NoirGetHandleEntry(IN CVM_HANDLE Handle);
+NOIR_STATUS NoirExpandHandleTableUnsafe();
+NOIR_STATUS NoirCreateHandle(OUT PCVM_HANDLE Handle,IN PVOID ReferencedEntry);
+void NoirDeleteHandleUnsafe(IN CVM_HANDLE Handle);
+void NoirFreeHandleTable();
+NOIR_STATUS NoirReleaseVirtualMachine(IN CVM_HANDLE VirtualMachine);
+
+typedef struct _nvtest_handle_worker
+{
+	u32 index;
+	u32 mismatches;
+	u32 stale_hits;
+	u32 cross_hits;
+	u64 operations;
+}nvtest_handle_worker,*nvtest_handle_worker_p;
+
+CVM_HANDLE volatile nvtest_published[nvtest_published_size];
+CVM_HANDLE nvtest_releasing=0;
+NOIR_STATUS nvtest_release_status=NOIR_SUCCESS;
+u32 nvtest_releases=0;
+
+// Objects are never dereferenced. They encode the owner thread and a counter.
+PVOID nvtest_make_object(u32 thread,u64 counter)
+{
+	return (PVOID)(nvtest_object_tag|((u64)thread<<40)|(counter&0xFFFFFFFFFF));
+}
+
+bool nvtest_valid_object(PVOID object)
+{
+	const u64 v=(u64)object;
+	return (v&0xFFFF000000000000)==nvtest_object_tag && ((v>>40)&0xFF)<nvtest_threads;
+}
+
+void nvtest_delete_handle(CVM_HANDLE handle)
+{
+	ExfAcquirePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
+	NoirDeleteHandleUnsafe(handle);
+	ExfReleasePushLockExclusive(&NoirCvmHandleTable.HandleTableLock);
+}
+
+// Simulated release of VM. The handle must not resolve while the VM is being released.
+NOIR_STATUS nvc_release_vm(PVOID VirtualMachine)
+{
+	nvtest_check(NoirReferenceVirtualMachineByHandle(nvtest_releasing)==NULL);
+	nvtest_releases++;
+	return nvtest_release_status;
+}
+
+// No HAXM-compatible notifications are registered in the simulated driver.
+NTSTATUS NoirHaxRemoveVirtualMachineNotification(IN CVM_HANDLE VmHandle)
+{
+	return STATUS_SUCCESS;
+}
+
+void nvtest_initialize_table()
+{
+	RtlZeroMemory(&NoirCvmHandleTable,sizeof(NoirCvmHandleTable));
+	NoirCvmHandleTable.FreeHead=HandleNullIndex;
+	nvtest_check_eq(NoirExpandHandleTableUnsafe(),NOIR_SUCCESS);
+}
+
+// Count the free entries. A cycle in the free list would exceed the capacity.
+u32 nvtest_count_free_entries()
+{
+	const u32 capacity=NoirCvmHandleTable.PageCount<<HandleEntryShiftBits;
+	u32 count=0;
+	for(u32 i=NoirCvmHandleTable.FreeHead;i!=HandleNullIndex && count<=capacity;count++)
+		i=NoirGetHandleEntry(i)->NextFree;
+	return count;
+}
+
+void nvtest_single_thread()
+{
+	CVM_HANDLE h1,h2,h3;
+	PVOID o1=nvtest_make_object(0,1),o2=nvtest_make_object(0,2);
+	nvtest_check_eq(NoirCreateHandle(&h1,o1),NOIR_SUCCESS);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h1)==o1);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,1);
+	// Out-of-table indices do not resolve.
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h1|0xFFFFFF)==NULL);
+	nvtest_delete_handle(h1);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h1)==NULL);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,0);
+	// The entry is reused with a new sequence. The stale handle does not resolve to the new object.
+	nvtest_check_eq(NoirCreateHandle(&h2,o2),NOIR_SUCCESS);
+	nvtest_check_eq((u32)h2,(u32)h1);
+	nvtest_check((h2>>32)!=(h1>>32));
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h1)==NULL);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h2)==o2);
+	// Deleting the stale handle does not affect the new one.
+	nvtest_delete_handle(h1);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h2)==o2);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,1);
+	nvtest_delete_handle(h2);
+	// Exhausting the first page expands the table.
+	for(u32 i=0;i<=HandleEntriesPerPage;i++)
+	{
+		nvtest_check_eq(NoirCreateHandle(&h3,o1),NOIR_SUCCESS);
+		nvtest_published[i]=h3;
+	}
+	nvtest_check_eq(NoirCvmHandleTable.PageCount,2);
+	for(u32 i=0;i<=HandleEntriesPerPage;i++)
+	{
+		nvtest_delete_handle(nvtest_published[i]);
+		nvtest_published[i]=0;
+	}
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,0);
+	nvtest_check_eq(nvtest_count_free_entries(),NoirCvmHandleTable.PageCount<<HandleEntryShiftBits);
+}
+
+void nvtest_release_vm()
+{
+	CVM_HANDLE h;
+	PVOID o=nvtest_make_object(0,3);
+	nvtest_check_eq(NoirCreateHandle(&h,o),NOIR_SUCCESS);
+	nvtest_releasing=h;
+	// A failed release restores the handle.
+	nvtest_release_status=NOIR_UNSUCCESSFUL;
+	nvtest_check_eq(NoirReleaseVirtualMachine(h),NOIR_UNSUCCESSFUL);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h)==o);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,1);
+	nvtest_release_status=NOIR_SUCCESS;
+	nvtest_check_eq(NoirReleaseVirtualMachine(h),NOIR_SUCCESS);
+	nvtest_check(NoirReferenceVirtualMachineByHandle(h)==NULL);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,0);
+	nvtest_check_eq(nvtest_count_free_entries(),NoirCvmHandleTable.PageCount<<HandleEntryShiftBits);
+	// The released handle cannot be released again.
+	nvtest_check_eq(NoirReleaseVirtualMachine(h),NOIR_UNSUCCESSFUL);
+	nvtest_check_eq(nvtest_releases,2);
+}
+
+u32 stdcall nvtest_handle_worker_routine(void* context)
+{
+	nvtest_handle_worker_p worker=(nvtest_handle_worker_p)context;
+	CVM_HANDLE ring[nvtest_ring_size]={0};
+	PVOID objects[nvtest_ring_size]={0};
+	u64 seed=worker->index+1;
+	const u64 iterations=nvtest_operations/nvtest_threads;
+	for(u64 i=0;i<iterations;i++)
+	{
+		const u32 slot=(u32)(i%nvtest_ring_size);
+		PVOID object=nvtest_make_object(worker->index,i);
+		CVM_HANDLE handle;
+		// Retire the oldest handle in the ring. It must be stale afterwards.
+		if(ring[slot])
+		{
+			if(NoirReferenceVirtualMachineByHandle(ring[slot])!=objects[slot])worker->mismatches++;
+			nvtest_delete_handle(ring[slot]);
+			if(NoirReferenceVirtualMachineByHandle(ring[slot])!=NULL)worker->stale_hits++;
+			worker->operations+=3;
+		}
+		if(NoirCreateHandle(&handle,object)!=NOIR_SUCCESS)
+		{
+			worker->mismatches++;
+			break;
+		}
+		if(NoirReferenceVirtualMachineByHandle(handle)!=object)worker->mismatches++;
+		ring[slot]=handle;
+		objects[slot]=object;
+		// Publish the handle, then reference a handle that may be deleted by another thread at any time.
+		seed=seed*6364136223846793005+1442695040888963407;
+		nvtest_published[(seed>>33)%nvtest_published_size]=handle;
+		seed=seed*6364136223846793005+1442695040888963407;
+		{
+			PVOID other=NoirReferenceVirtualMachineByHandle(nvtest_published[(seed>>33)%nvtest_published_size]);
+			if(other)
+			{
+				if(!nvtest_valid_object(other))worker->mismatches++;
+				worker->cross_hits++;
+			}
+		}
+		worker->operations+=3;
+	}
+	for(u32 i=0;i<nvtest_ring_size;i++)
+	{
+		if(ring[i])
+		{
+			nvtest_delete_handle(ring[i]);
+			if(NoirReferenceVirtualMachineByHandle(ring[i])!=NULL)worker->stale_hits++;
+		}
+	}
+	return 0;
+}
+
+void nvtest_multi_thread()
+{
+	nvtest_handle_worker worker[nvtest_threads]={0};
+	noir_thread threads[nvtest_threads];
+	u64 operations=0,cross_hits=0,t0,t1;
+	nvtest_set_processor_count(nvtest_threads);
+	t0=nvtest_time_ns();
+	for(u32 i=0;i<nvtest_threads;i++)
+	{
+		worker[i].index=i;
+		threads[i]=nvtest_create_thread(nvtest_handle_worker_routine,&worker[i],i);
+		nvtest_check(threads[i]!=null);
+	}
+	for(u32 i=0;i<nvtest_threads;i++)
+	{
+		noir_join_thread(threads[i]);
+		nvtest_check_eq(worker[i].mismatches,0);
+		nvtest_check_eq(worker[i].stale_hits,0);
+		operations+=worker[i].operations;
+		cross_hits+=worker[i].cross_hits;
+	}
+	t1=nvtest_time_ns();
+	nvtest_check(operations>=nvtest_operations);
+	nvtest_check_eq(NoirCvmHandleTable.HandleCount,0);
+	// Each thread holds at most a ring of handles, so the table does not grow further.
+	nvtest_check(NoirCvmHandleTable.PageCount<=(nvtest_threads*nvtest_ring_size+HandleEntriesPerPage-1)/HandleEntriesPerPage+1);
+	nvtest_check_eq(nvtest_count_free_entries(),NoirCvmHandleTable.PageCount<<HandleEntryShiftBits);
+	nvtest_report("%u threads: %llu handle operations in %.2f ms, %llu lock-free references of other threads' handles resolved, %u page(s) of table\n",nvtest_threads,operations,(double)(t1-t0)/1e6,cross_hits,NoirCvmHandleTable.PageCount);
+}
+
+int main()
+{
+	nvtest_initialize_table();
+	nvtest_single_thread();
+	nvtest_release_vm();
+	nvtest_multi_thread();
+	NoirFreeHandleTable();
+	return nvtest_finish();
+}